@@ -982,9 +982,33 @@ static int rfc4106_decrypt(struct aead_request *req)
 	}
 }
 
+/*
+ * Returns the kernel address of the first @len bytes described by @sg
+ * if they are contiguous in the direct mapping, or NULL if they have to
+ * be bounced. Besides single entry lists, this catches skbs whose frags
+ * were carved out of one high-order page and sit back to back.
+ */
+static u8 *rfc4106_sg_linear(struct scatterlist *sg, unsigned int len)
+{
+	u8 *start = NULL, *end = NULL;
+
+	for (; sg; sg = sg_next(sg)) {
+		if (PageHighMem(sg_page(sg)))
+			return NULL;
+		if (!start)
+			start = end = sg_virt(sg);
+		else if (sg_virt(sg) != end)
+			return NULL;
+		end += sg->length;
+		if (end - start >= len)
+			return start;
+	}
+	return NULL;
+}
+
 static int __driver_rfc4106_encrypt(struct aead_request *req)
 {
-	u8 one_entry_in_sg = 0;
+	u8 linear = 0;
 	u8 *src, *dst, *assoc;
 	__be32 counter = cpu_to_be32(1);
 	struct crypto_aead *tfm = crypto_aead_reqtfm(req);
@@ -993,9 +1017,6 @@ static int __driver_rfc4106_encrypt(struct aead_request *req)
 	unsigned long auth_tag_len = crypto_aead_authsize(tfm);
 	u8 iv_tab[16+AESNI_ALIGN];
 	u8* iv = (u8 *) PTR_ALIGN((u8 *)iv_tab, AESNI_ALIGN);
-	struct scatter_walk src_sg_walk;
-	struct scatter_walk assoc_sg_walk;
-	struct scatter_walk dst_sg_walk;
 	unsigned int i;
 
 	/* Assuming we are supporting rfc4106 64-bit extended */
@@ -1010,18 +1031,17 @@ static int __driver_rfc4106_encrypt(struct aead_request *req)
 		*(iv+4+i) = req->iv[i];
 	*((__be32 *)(iv+12)) = counter;
 
-	if ((sg_is_last(req->src)) && (sg_is_last(req->assoc))) {
-		one_entry_in_sg = 1;
-		scatterwalk_start(&src_sg_walk, req->src);
-		scatterwalk_start(&assoc_sg_walk, req->assoc);
-		src = scatterwalk_map(&src_sg_walk);
-		assoc = scatterwalk_map(&assoc_sg_walk);
-		dst = src;
-		if (unlikely(req->src != req->dst)) {
-			scatterwalk_start(&dst_sg_walk, req->dst);
-			dst = scatterwalk_map(&dst_sg_walk);
-		}
+	assoc = rfc4106_sg_linear(req->assoc, req->assoclen);
+	if (likely(req->src == req->dst)) {
+		src = dst = rfc4106_sg_linear(req->src,
+					      req->cryptlen + auth_tag_len);
+	} else {
+		src = rfc4106_sg_linear(req->src, req->cryptlen);
+		dst = rfc4106_sg_linear(req->dst, req->cryptlen + auth_tag_len);
+	}
 
+	if (assoc && src && dst) {
+		linear = 1;
 	} else {
 		/* Allocate memory for src, dst, assoc */
 		src = kmalloc(req->cryptlen + auth_tag_len + req->assoclen,
@@ -1041,16 +1061,7 @@ static int __driver_rfc4106_encrypt(struct aead_request *req)
 
 	/* The authTag (aka the Integrity Check Value) needs to be written
 	 * back to the packet. */
-	if (one_entry_in_sg) {
-		if (unlikely(req->src != req->dst)) {
-			scatterwalk_unmap(dst);
-			scatterwalk_done(&dst_sg_walk, 0, 0);
-		}
-		scatterwalk_unmap(src);
-		scatterwalk_unmap(assoc);
-		scatterwalk_done(&src_sg_walk, 0, 0);
-		scatterwalk_done(&assoc_sg_walk, 0, 0);
-	} else {
+	if (!linear) {
 		scatterwalk_map_and_copy(dst, req->dst, 0,
 			req->cryptlen + auth_tag_len, 1);
 		kfree(src);
@@ -1060,7 +1071,7 @@ static int __driver_rfc4106_encrypt(struct aead_request *req)
 
 static int __driver_rfc4106_decrypt(struct aead_request *req)
 {
-	u8 one_entry_in_sg = 0;
+	u8 linear = 0;
 	u8 *src, *dst, *assoc;
 	unsigned long tempCipherLen = 0;
 	__be32 counter = cpu_to_be32(1);
@@ -1072,9 +1083,6 @@ static int __driver_rfc4106_decrypt(struct aead_request *req)
 	u8 iv_and_authTag[32+AESNI_ALIGN];
 	u8 *iv = (u8 *) PTR_ALIGN((u8 *)iv_and_authTag, AESNI_ALIGN);
 	u8 *authTag = iv + 16;
-	struct scatter_walk src_sg_walk;
-	struct scatter_walk assoc_sg_walk;
-	struct scatter_walk dst_sg_walk;
 	unsigned int i;
 
 	if (unlikely((req->cryptlen < auth_tag_len) ||
@@ -1092,24 +1100,20 @@ static int __driver_rfc4106_decrypt(struct aead_request *req)
 		*(iv+4+i) = req->iv[i];
 	*((__be32 *)(iv+12)) = counter;
 
-	if ((sg_is_last(req->src)) && (sg_is_last(req->assoc))) {
-		one_entry_in_sg = 1;
-		scatterwalk_start(&src_sg_walk, req->src);
-		scatterwalk_start(&assoc_sg_walk, req->assoc);
-		src = scatterwalk_map(&src_sg_walk);
-		assoc = scatterwalk_map(&assoc_sg_walk);
-		dst = src;
-		if (unlikely(req->src != req->dst)) {
-			scatterwalk_start(&dst_sg_walk, req->dst);
-			dst = scatterwalk_map(&dst_sg_walk);
-		}
+	assoc = rfc4106_sg_linear(req->assoc, req->assoclen);
+	src = rfc4106_sg_linear(req->src, req->cryptlen);
+	dst = src;
+	if (unlikely(req->src != req->dst))
+		dst = rfc4106_sg_linear(req->dst, tempCipherLen);
 
+	if (assoc && src && dst) {
+		linear = 1;
 	} else {
 		/* Allocate memory for src, dst, assoc */
 		src = kmalloc(req->cryptlen + req->assoclen, GFP_ATOMIC);
 		if (!src)
 			return -ENOMEM;
-		assoc = (src + req->cryptlen + auth_tag_len);
+		assoc = (src + req->cryptlen);
 		scatterwalk_map_and_copy(src, req->src, 0, req->cryptlen, 0);
 		scatterwalk_map_and_copy(assoc, req->assoc, 0,
 			req->assoclen, 0);
@@ -1124,16 +1128,7 @@ static int __driver_rfc4106_decrypt(struct aead_request *req)
 	retval = crypto_memneq(src + tempCipherLen, authTag, auth_tag_len) ?
 		-EBADMSG : 0;
 
-	if (one_entry_in_sg) {
-		if (unlikely(req->src != req->dst)) {
-			scatterwalk_unmap(dst);
-			scatterwalk_done(&dst_sg_walk, 0, 0);
-		}
-		scatterwalk_unmap(src);
-		scatterwalk_unmap(assoc);
-		scatterwalk_done(&src_sg_walk, 0, 0);
-		scatterwalk_done(&assoc_sg_walk, 0, 0);
-	} else {
+	if (!linear) {
 		scatterwalk_map_and_copy(dst, req->dst, 0, req->cryptlen, 1);
 		kfree(src);
 	}
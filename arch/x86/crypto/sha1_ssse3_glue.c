@@ -114,12 +114,14 @@ static int sha1_ssse3_update(struct shash_desc *desc, const u8 *data,
 }
 
 
-/* Add padding and return the message digest. */
-static int sha1_ssse3_final(struct shash_desc *desc, u8 *out)
+/*
+ * Add padding, must be called between kernel_fpu_begin() and
+ * kernel_fpu_end().
+ */
+static void __sha1_ssse3_pad(struct shash_desc *desc)
 {
 	struct sha1_state *sctx = shash_desc_ctx(desc);
-	unsigned int i, index, padlen;
-	__be32 *dst = (__be32 *)out;
+	unsigned int index, padlen;
 	__be64 bits;
 	static const u8 padding[SHA1_BLOCK_SIZE] = { 0x80, };
 
@@ -128,21 +130,22 @@ static int sha1_ssse3_final(struct shash_desc *desc, u8 *out)
 	/* Pad out to 56 mod 64 and append length */
 	index = sctx->count % SHA1_BLOCK_SIZE;
 	padlen = (index < 56) ? (56 - index) : ((SHA1_BLOCK_SIZE+56) - index);
-	if (!irq_fpu_usable()) {
-		crypto_sha1_update(desc, padding, padlen);
-		crypto_sha1_update(desc, (const u8 *)&bits, sizeof(bits));
+
+	/* We need to fill a whole block for __sha1_ssse3_update() */
+	if (padlen <= 56) {
+		sctx->count += padlen;
+		memcpy(sctx->buffer + index, padding, padlen);
 	} else {
-		kernel_fpu_begin();
-		/* We need to fill a whole block for __sha1_ssse3_update() */
-		if (padlen <= 56) {
-			sctx->count += padlen;
-			memcpy(sctx->buffer + index, padding, padlen);
-		} else {
-			__sha1_ssse3_update(desc, padding, padlen, index);
-		}
-		__sha1_ssse3_update(desc, (const u8 *)&bits, sizeof(bits), 56);
-		kernel_fpu_end();
+		__sha1_ssse3_update(desc, padding, padlen, index);
 	}
+	__sha1_ssse3_update(desc, (const u8 *)&bits, sizeof(bits), 56);
+}
+
+static void sha1_ssse3_store(struct shash_desc *desc, u8 *out)
+{
+	struct sha1_state *sctx = shash_desc_ctx(desc);
+	__be32 *dst = (__be32 *)out;
+	unsigned int i;
 
 	/* Store state in digest */
 	for (i = 0; i < 5; i++)
@@ -150,6 +153,62 @@ static int sha1_ssse3_final(struct shash_desc *desc, u8 *out)
 
 	/* Wipe context */
 	memset(sctx, 0, sizeof(*sctx));
+}
+
+/* Add padding and return the message digest. */
+static int sha1_ssse3_final(struct shash_desc *desc, u8 *out)
+{
+	struct sha1_state *sctx = shash_desc_ctx(desc);
+	unsigned int index, padlen;
+	__be64 bits;
+	static const u8 padding[SHA1_BLOCK_SIZE] = { 0x80, };
+
+	if (!irq_fpu_usable()) {
+		bits = cpu_to_be64(sctx->count << 3);
+		index = sctx->count % SHA1_BLOCK_SIZE;
+		padlen = (index < 56) ? (56 - index) :
+					((SHA1_BLOCK_SIZE+56) - index);
+		crypto_sha1_update(desc, padding, padlen);
+		crypto_sha1_update(desc, (const u8 *)&bits, sizeof(bits));
+	} else {
+		kernel_fpu_begin();
+		__sha1_ssse3_pad(desc);
+		kernel_fpu_end();
+	}
+
+	sha1_ssse3_store(desc, out);
+
+	return 0;
+}
+
+/*
+ * Hash the tail of the message and pad it within a single FPU section,
+ * so that one-shot digests of short, independent buffers do not pay for
+ * the FPU state save and restore once per update and twice more for
+ * the padding.
+ */
+static int sha1_ssse3_finup(struct shash_desc *desc, const u8 *data,
+			     unsigned int len, u8 *out)
+{
+	struct sha1_state *sctx = shash_desc_ctx(desc);
+	unsigned int partial = sctx->count % SHA1_BLOCK_SIZE;
+
+	if (!irq_fpu_usable()) {
+		crypto_sha1_update(desc, data, len);
+		return sha1_ssse3_final(desc, out);
+	}
+
+	kernel_fpu_begin();
+	if (partial + len < SHA1_BLOCK_SIZE) {
+		sctx->count += len;
+		memcpy(sctx->buffer + partial, data, len);
+	} else {
+		__sha1_ssse3_update(desc, data, len, partial);
+	}
+	__sha1_ssse3_pad(desc);
+	kernel_fpu_end();
+
+	sha1_ssse3_store(desc, out);
 
 	return 0;
 }
@@ -189,6 +248,7 @@ static struct shash_alg alg = {
 	.init		=	sha1_ssse3_init,
 	.update		=	sha1_ssse3_update,
 	.final		=	sha1_ssse3_final,
+	.finup		=	sha1_ssse3_finup,
 	.export		=	sha1_ssse3_export,
 	.import		=	sha1_ssse3_import,
 	.descsize	=	sizeof(struct sha1_state),
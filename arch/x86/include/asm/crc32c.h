@@ -0,0 +1,9 @@
+#ifndef _ASM_X86_CRC32C_H
+#define _ASM_X86_CRC32C_H
+
+#include <linux/types.h>
+
+extern bool arch_crc32c_usable(void);
+extern u32 arch_crc32c(u32 crc, const void *data, unsigned int len);
+
+#endif /* _ASM_X86_CRC32C_H */
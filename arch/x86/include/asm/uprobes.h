@@ -39,6 +39,11 @@ struct arch_uprobe {
 		u8			insn[MAX_UINSN_BYTES];
 		u8			ixol[MAX_UINSN_BYTES];
 	};
+	/* set if the insn can be emulated instead of single-stepped */
+	u8				emulate;
+	u8				ilen;
+	u8				reg;
+	s32				disp;
 #ifdef CONFIG_X86_64
 	unsigned long			rip_rela_target_address;
 #endif
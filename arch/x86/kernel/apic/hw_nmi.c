@@ -56,6 +56,9 @@ void arch_trigger_all_cpu_backtrace(void)
 		mdelay(1);
 	}
 
+	/* CPUs with interrupts disabled can't flush their backtraces */
+	printk_stage_flush_all();
+
 	clear_bit(0, &backtrace_flag);
 	smp_mb__after_clear_bit();
 }
@@ -49,6 +49,13 @@
 
 #define	UPROBE_TRAP_NR		UINT_MAX
 
+/* Instructions arch_uprobe_skip_sstep() emulates. */
+#define UPROBE_EMUL_NONE	0
+#define UPROBE_EMUL_NOP		1	/* nop, nopl */
+#define UPROBE_EMUL_PUSH	2	/* push reg */
+#define UPROBE_EMUL_JMP		3	/* jmp rel8, jmp rel32 */
+#define UPROBE_EMUL_CALL	4	/* call rel32 */
+
 /* Adaptations for mhiramat x86 decoder v14. */
 #define OPCODE1(insn)		((insn)->opcode.bytes[0])
 #define OPCODE2(insn)		((insn)->opcode.bytes[1])
@@ -412,6 +419,66 @@ static int validate_insn_bits(struct arch_uprobe *auprobe, struct mm_struct *mm,
 }
 #endif /* CONFIG_X86_64 */
 
+/*
+ * Find out whether arch_uprobe_skip_sstep() can emulate the instruction,
+ * so that hitting the probe costs neither the XOL slot nor the extra
+ * debug trap of the single-step. Only the instructions commonly found
+ * at function entries are handled: nops used for padding, the push of
+ * the frame pointer or callee-saved registers, and relative jumps and
+ * calls. Prefixes on the latter would change their operand size, so
+ * they are only emulated without.
+ */
+static void prepare_emulation(struct arch_uprobe *auprobe, struct insn *insn)
+{
+	u8 opc1 = OPCODE1(insn);
+	int i;
+
+	auprobe->emulate = UPROBE_EMUL_NONE;
+	insn_get_length(insn);
+	auprobe->ilen = insn->length;
+
+	if (insn->opcode.nbytes == 2) {
+		/* 0x0f 0x1f: nopl, nopw */
+		if (opc1 == 0x0f && OPCODE2(insn) == 0x1f)
+			auprobe->emulate = UPROBE_EMUL_NOP;
+		return;
+	}
+
+	if (insn->opcode.nbytes != 1)
+		return;
+
+	if (opc1 == 0x90) {
+		/* 0x66* 0x90, but not pause or xchg %r8,%rax */
+		for (i = 0; i < insn->length - 1; i++) {
+			if (auprobe->insn[i] != 0x66)
+				return;
+		}
+		auprobe->emulate = UPROBE_EMUL_NOP;
+		return;
+	}
+
+	if (insn->prefixes.nbytes)
+		return;
+
+	switch (opc1) {
+	case 0x50 ... 0x57:
+		auprobe->reg = opc1 - 0x50;
+		if (X86_REX_B(insn->rex_prefix.value))
+			auprobe->reg += 8;
+		auprobe->emulate = UPROBE_EMUL_PUSH;
+		break;
+	case 0xe8:
+		auprobe->disp = insn->immediate.value;
+		auprobe->emulate = UPROBE_EMUL_CALL;
+		break;
+	case 0xe9:
+	case 0xeb:
+		auprobe->disp = insn->immediate.value;
+		auprobe->emulate = UPROBE_EMUL_JMP;
+		break;
+	}
+}
+
 /**
  * arch_uprobe_analyze_insn - instruction analysis including validity and fixups.
  * @mm: the probed address space.
@@ -429,6 +496,7 @@ int arch_uprobe_analyze_insn(struct arch_uprobe *auprobe, struct mm_struct *mm,
 	if (ret != 0)
 		return ret;
 
+	prepare_emulation(auprobe, &insn);
 	handle_riprel_insn(auprobe, mm, &insn);
 	prepare_fixups(auprobe, &insn);
 
@@ -668,24 +736,78 @@ void arch_uprobe_abort_xol(struct arch_uprobe *auprobe, struct pt_regs *regs)
 		regs->flags &= ~X86_EFLAGS_TF;
 }
 
+static unsigned long *uprobe_reg(struct pt_regs *regs, u8 reg)
+{
+	switch (reg) {
+	case 0: return &regs->ax;
+	case 1: return &regs->cx;
+	case 2: return &regs->dx;
+	case 3: return &regs->bx;
+	case 4: return &regs->sp;
+	case 5: return &regs->bp;
+	case 6: return &regs->si;
+	case 7: return &regs->di;
+#ifdef CONFIG_X86_64
+	case 8: return &regs->r8;
+	case 9: return &regs->r9;
+	case 10: return &regs->r10;
+	case 11: return &regs->r11;
+	case 12: return &regs->r12;
+	case 13: return &regs->r13;
+	case 14: return &regs->r14;
+	case 15: return &regs->r15;
+#endif
+	}
+	return NULL;
+}
+
+static bool emulate_push(struct pt_regs *regs, unsigned long val)
+{
+	int size = is_ia32_task() ? 4 : 8;
+	unsigned long new_sp = regs->sp - size;
+
+	if (copy_to_user((void __user *)new_sp, &val, size))
+		return false;
+
+	regs->sp = new_sp;
+	return true;
+}
+
+static void emulate_jmp(struct pt_regs *regs, unsigned long new_ip)
+{
+	if (is_ia32_task())
+		new_ip = (u32)new_ip;
+	regs->ip = new_ip;
+}
+
 /*
- * Skip these instructions as per the currently known x86 ISA.
- * rep=0x66*; nop=0x90
+ * Emulate the instruction found by prepare_emulation(); regs->ip is the
+ * probed address. Returns false, to single-step it instead, if it can't.
  */
 static bool __skip_sstep(struct arch_uprobe *auprobe, struct pt_regs *regs)
 {
-	int i;
+	unsigned long next_ip = regs->ip + auprobe->ilen;
+	unsigned long *reg;
 
-	for (i = 0; i < MAX_UINSN_BYTES; i++) {
-		if (auprobe->insn[i] == 0x66)
-			continue;
+	switch (auprobe->emulate) {
+	case UPROBE_EMUL_NOP:
+		regs->ip = next_ip;
+		return true;
 
-		if (auprobe->insn[i] == 0x90) {
-			regs->ip += i + 1;
-			return true;
-		}
+	case UPROBE_EMUL_PUSH:
+		reg = uprobe_reg(regs, auprobe->reg);
+		if (!reg || !emulate_push(regs, *reg))
+			return false;
+		regs->ip = next_ip;
+		return true;
 
-		break;
+	case UPROBE_EMUL_CALL:
+		if (!emulate_push(regs, next_ip))
+			return false;
+		/* fall through */
+	case UPROBE_EMUL_JMP:
+		emulate_jmp(regs, next_ip + auprobe->disp);
+		return true;
 	}
 	return false;
 }
@@ -2780,7 +2780,7 @@ exit:
 	return ret;
 }
 
-static bool page_fault_can_be_fast(u32 error_code)
+static bool page_fault_can_be_fast(struct kvm_vcpu *vcpu, u32 error_code)
 {
 	/*
 	 * Do not fix the mmio spte with invalid generation number which
@@ -2790,15 +2790,19 @@ static bool page_fault_can_be_fast(u32 error_code)
 		return false;
 
 	/*
-	 * #PF can be fast only if the shadow page table is present and it
+	 * #PF can be fast if the shadow page table is present and it
 	 * is caused by write-protect, that means we just need change the
 	 * W bit of the spte which can be done out of mmu-lock.
 	 */
-	if (!(error_code & PFERR_PRESENT_MASK) ||
-	      !(error_code & PFERR_WRITE_MASK))
-		return false;
+	if (error_code & PFERR_PRESENT_MASK)
+		return error_code & PFERR_WRITE_MASK;
 
-	return true;
+	/*
+	 * On a direct map, a fault on a non-present spte can also be
+	 * fast if another vcpu has installed the spte in the meantime,
+	 * as happens when many vcpus touch the same memory at once.
+	 */
+	return vcpu->arch.mmu.direct_map;
 }
 
 static bool
@@ -2836,7 +2840,7 @@ static bool fast_page_fault(struct kvm_vcpu *vcpu, gva_t gva, int level,
 	if (!VALID_PAGE(vcpu->arch.mmu.root_hpa))
 		return false;
 
-	if (!page_fault_can_be_fast(error_code))
+	if (!page_fault_can_be_fast(vcpu, error_code))
 		return false;
 
 	walk_shadow_page_lockless_begin(vcpu);
@@ -2846,10 +2850,11 @@ static bool fast_page_fault(struct kvm_vcpu *vcpu, gva_t gva, int level,
 
 	/*
 	 * If the mapping has been changed, let the vcpu fault on the
-	 * same address again.
+	 * same address again.  A spte that is still not present needs
+	 * the real page fault path.
 	 */
 	if (!is_rmap_spte(spte)) {
-		ret = true;
+		ret = error_code & PFERR_PRESENT_MASK;
 		goto exit;
 	}
 
@@ -2857,12 +2862,15 @@ static bool fast_page_fault(struct kvm_vcpu *vcpu, gva_t gva, int level,
 		goto exit;
 
 	/*
-	 * Check if it is a spurious fault caused by TLB lazily flushed.
+	 * Check if it is a spurious fault caused by TLB lazily flushed,
+	 * or by a spte that another vcpu installed after the fault.
+	 * Direct sptes always allow read and fetch, so only a write
+	 * needs checking.
 	 *
 	 * Need not check the access of upper level table entries since
 	 * they are always ACC_ALL.
 	 */
-	 if (is_writable_pte(spte)) {
+	if (is_writable_pte(spte) || !(error_code & PFERR_WRITE_MASK)) {
 		ret = true;
 		goto exit;
 	}
@@ -32,6 +32,7 @@
 #include <linux/slab.h>
 #include <linux/tboot.h>
 #include <linux/hrtimer.h>
+#include <linux/interrupt.h>
 #include "kvm_cache_regs.h"
 #include "x86.h"
 
@@ -45,6 +46,7 @@
 #include <asm/perf_event.h>
 #include <asm/debugreg.h>
 #include <asm/kexec.h>
+#include <asm/irq_remapping.h>
 
 #include "trace.h"
 
@@ -388,8 +390,24 @@ struct nested_vmx {
 /* Posted-Interrupt Descriptor */
 struct pi_desc {
 	u32 pir[8];     /* Posted interrupt requested */
-	u32 control;	/* bit 0 of control is outstanding notification bit */
-	u32 rsvd[7];
+	union {
+		struct {
+				/* bit 256 - Outstanding Notification */
+			u16	on	: 1,
+				/* bit 257 - Suppress Notification */
+				sn	: 1,
+				/* bit 271:258 - Reserved */
+				rsvd_1	: 14;
+				/* bit 279:272 - Notification Vector */
+			u8	nv;
+				/* bit 287:280 - Reserved */
+			u8	rsvd_2;
+				/* bit 319:288 - Notification Destination */
+			u32	ndst;
+		};
+		u64 control;
+	};
+	u32 rsvd[6];
 } __aligned(64);
 
 static bool pi_test_and_set_on(struct pi_desc *pi_desc)
@@ -409,6 +427,19 @@ static int pi_test_and_set_pir(int vector, struct pi_desc *pi_desc)
 	return test_and_set_bit(vector, (unsigned long *)pi_desc->pir);
 }
 
+static bool pi_test_on(struct pi_desc *pi_desc)
+{
+	return test_bit(POSTED_INTR_ON, (unsigned long *)&pi_desc->control);
+}
+
+/* Notification destination for @cpu, in the format the IOMMU expects */
+static u32 pi_ndst(int cpu)
+{
+	unsigned int dest = cpu_physical_id(cpu);
+
+	return x2apic_enabled() ? dest : (dest << 8) & 0xff00;
+}
+
 struct vcpu_vmx {
 	struct kvm_vcpu       vcpu;
 	unsigned long         host_rsp;
@@ -479,6 +510,13 @@ struct vcpu_vmx {
 	/* Posted interrupt descriptor */
 	struct pi_desc pi_desc;
 
+	/*
+	 * While blocked, assigned devices post with the wakeup vector to
+	 * pre_pcpu, which has this vcpu on its blocked_vcpu_on_cpu list.
+	 */
+	struct list_head blocked_vcpu_list;
+	int pre_pcpu;
+
 	/* Support for a guest hypervisor (nested VMX) */
 	struct nested_vmx nested;
 };
@@ -749,6 +787,10 @@ static DEFINE_PER_CPU(struct vmcs *, current_vmcs);
  * when a CPU is brought down, and we need to VMCLEAR all VMCSs loaded on it.
  */
 static DEFINE_PER_CPU(struct list_head, loaded_vmcss_on_cpu);
+
+/* Vcpus that get POSTED_INTR_WAKEUP_VECTOR on this cpu, see vmx_pre_block() */
+static DEFINE_PER_CPU(struct list_head, blocked_vcpu_on_cpu);
+static DEFINE_PER_CPU(spinlock_t, blocked_vcpu_on_cpu_lock);
 static DEFINE_PER_CPU(struct desc_ptr, host_gdt);
 
 static unsigned long *vmx_io_bitmap_a;
@@ -1786,6 +1828,40 @@ static void vmx_load_host_state(struct vcpu_vmx *vmx)
 	preempt_enable();
 }
 
+/*
+ * Device posted interrupts are only set up for VMs that use posted
+ * interrupts for their own IPIs, and only if the IOMMU can post.
+ */
+static bool vmx_pi_enabled(struct kvm_vcpu *vcpu)
+{
+	return kvm_x86_ops->update_pi_irte && enable_apicv &&
+	       irqchip_in_kernel(vcpu->kvm);
+}
+
+/* Point device notifications at the cpu the vcpu now runs on */
+static void vmx_vcpu_pi_load(struct kvm_vcpu *vcpu, int cpu)
+{
+	struct pi_desc *pi_desc = &to_vmx(vcpu)->pi_desc;
+	struct pi_desc old, new;
+
+	if (!vmx_pi_enabled(vcpu))
+		return;
+
+	do {
+		old.control = new.control = pi_desc->control;
+
+		/* Blocked: vmx_post_block() retargets the descriptor */
+		if (old.nv == POSTED_INTR_WAKEUP_VECTOR)
+			return;
+		if (vcpu->cpu == cpu && old.nv == POSTED_INTR_VECTOR)
+			return;
+
+		new.ndst = pi_ndst(cpu);
+		new.nv = POSTED_INTR_VECTOR;
+	} while (cmpxchg64(&pi_desc->control, old.control,
+			   new.control) != old.control);
+}
+
 /*
  * Switches to specified vcpu, until a matching vcpu_put(), but assumes
  * vcpu mutex is already taken.
@@ -1836,6 +1912,8 @@ static void vmx_vcpu_load(struct kvm_vcpu *vcpu, int cpu)
 		vmcs_writel(HOST_IA32_SYSENTER_ESP, sysenter_esp); /* 22.2.3 */
 		vmx->loaded_vmcs->cpu = cpu;
 	}
+
+	vmx_vcpu_pi_load(vcpu, cpu);
 }
 
 static void vmx_vcpu_put(struct kvm_vcpu *vcpu)
@@ -3113,6 +3191,12 @@ static __init int hardware_setup(void)
 		kvm_x86_ops->sync_pir_to_irr = vmx_sync_pir_to_irr_dummy;
 	}
 
+	if (!enable_apicv || !irq_remapping_cap(IRQ_POSTING_CAP)) {
+		kvm_x86_ops->pre_block = NULL;
+		kvm_x86_ops->post_block = NULL;
+		kvm_x86_ops->update_pi_irte = NULL;
+	}
+
 	if (nested)
 		nested_vmx_setup_ctls_msrs();
 
@@ -4221,6 +4305,145 @@ static void vmx_sync_pir_to_irr_dummy(struct kvm_vcpu *vcpu)
 	return;
 }
 
+/*
+ * Kick the blocked vcpus on this cpu that an assigned device has posted
+ * an interrupt to.  Runs in POSTED_INTR_WAKEUP_VECTOR context.
+ */
+static void pi_wakeup_handler(void)
+{
+	struct vcpu_vmx *vmx;
+	int cpu = smp_processor_id();
+
+	spin_lock(&per_cpu(blocked_vcpu_on_cpu_lock, cpu));
+	list_for_each_entry(vmx, &per_cpu(blocked_vcpu_on_cpu, cpu),
+			    blocked_vcpu_list) {
+		if (pi_test_on(&vmx->pi_desc))
+			kvm_vcpu_kick(&vmx->vcpu);
+	}
+	spin_unlock(&per_cpu(blocked_vcpu_on_cpu_lock, cpu));
+}
+
+/*
+ * A halted vcpu is not in non-root mode to take POSTED_INTR_VECTOR, so
+ * while it blocks, device notifications go to POSTED_INTR_WAKEUP_VECTOR
+ * on this cpu instead, where pi_wakeup_handler() finds and kicks it.  An
+ * interrupt posted before the switch leaves ON set, which
+ * kvm_arch_vcpu_runnable() sees through sync_pir_to_irr.
+ */
+static void vmx_pre_block(struct kvm_vcpu *vcpu)
+{
+	struct vcpu_vmx *vmx = to_vmx(vcpu);
+	struct pi_desc *pi_desc = &vmx->pi_desc;
+	struct pi_desc old, new;
+	unsigned long flags;
+
+	if (!vmx_pi_enabled(vcpu))
+		return;
+
+	preempt_disable();
+	vmx->pre_pcpu = vcpu->cpu;
+
+	spin_lock_irqsave(&per_cpu(blocked_vcpu_on_cpu_lock, vmx->pre_pcpu),
+			  flags);
+	list_add_tail(&vmx->blocked_vcpu_list,
+		      &per_cpu(blocked_vcpu_on_cpu, vmx->pre_pcpu));
+	spin_unlock_irqrestore(&per_cpu(blocked_vcpu_on_cpu_lock,
+					vmx->pre_pcpu), flags);
+
+	do {
+		old.control = new.control = pi_desc->control;
+		new.ndst = pi_ndst(vmx->pre_pcpu);
+		new.nv = POSTED_INTR_WAKEUP_VECTOR;
+	} while (cmpxchg64(&pi_desc->control, old.control,
+			   new.control) != old.control);
+	preempt_enable();
+}
+
+static void vmx_post_block(struct kvm_vcpu *vcpu)
+{
+	struct vcpu_vmx *vmx = to_vmx(vcpu);
+	struct pi_desc *pi_desc = &vmx->pi_desc;
+	struct pi_desc old, new;
+	unsigned long flags;
+
+	if (!vmx_pi_enabled(vcpu) || vmx->pre_pcpu == -1)
+		return;
+
+	preempt_disable();
+	do {
+		old.control = new.control = pi_desc->control;
+		new.ndst = pi_ndst(vcpu->cpu);
+		new.nv = POSTED_INTR_VECTOR;
+	} while (cmpxchg64(&pi_desc->control, old.control,
+			   new.control) != old.control);
+
+	spin_lock_irqsave(&per_cpu(blocked_vcpu_on_cpu_lock, vmx->pre_pcpu),
+			  flags);
+	list_del(&vmx->blocked_vcpu_list);
+	spin_unlock_irqrestore(&per_cpu(blocked_vcpu_on_cpu_lock,
+					vmx->pre_pcpu), flags);
+	vmx->pre_pcpu = -1;
+	preempt_enable();
+}
+
+/*
+ * vmx_update_pi_irte - set IRTE for Posted-Interrupts
+ *
+ * @kvm: kvm
+ * @host_irq: host irq of the interrupt
+ * @guest_irq: gsi of the interrupt
+ * @set: set or unset PI
+ *
+ * Posting needs a single destination vcpu, so only MSIs whose fixed or
+ * lowest priority destination resolves to one vcpu are posted; all others
+ * stay in remapped mode and reach the guest through the irqfd as before.
+ * Called with kvm->irqfds.lock held.
+ */
+static int vmx_update_pi_irte(struct kvm *kvm, unsigned int host_irq,
+			      uint32_t guest_irq, bool set)
+{
+	struct kvm_kernel_irq_routing_entry *e;
+	struct kvm_irq_routing_table *irq_rt;
+	struct kvm_lapic_irq irq;
+	struct kvm_vcpu *vcpu;
+	struct vcpu_data vcpu_info;
+	int ret = 0;
+
+	if (!vmx_vm_has_apicv(kvm))
+		return 0;
+
+	rcu_read_lock();
+	irq_rt = rcu_dereference(kvm->irq_routing);
+	if (guest_irq >= irq_rt->nr_rt_entries)
+		goto out;
+
+	hlist_for_each_entry(e, &irq_rt->map[guest_irq], link) {
+		if (e->type != KVM_IRQ_ROUTING_MSI)
+			continue;
+
+		kvm_set_msi_irq(e, &irq);
+		if (!set || !kvm_intr_is_single_vcpu(kvm, &irq, &vcpu)) {
+			ret = irq_set_vcpu_affinity(host_irq, NULL);
+			if (ret < 0)
+				break;
+			continue;
+		}
+
+		vcpu_info.pi_desc_addr = __pa(&to_vmx(vcpu)->pi_desc);
+		vcpu_info.vector = irq.vector;
+
+		ret = irq_set_vcpu_affinity(host_irq, &vcpu_info);
+		if (ret < 0)
+			break;
+	}
+
+	if (ret < 0)
+		printk(KERN_INFO "%s: failed to update PI IRTE\n", __func__);
+out:
+	rcu_read_unlock();
+	return ret < 0 ? ret : 0;
+}
+
 /*
  * Set up the vmcs's constant host-state fields, i.e., host-state fields that
  * will not change in the lifetime of the guest.
@@ -4538,8 +4761,11 @@ static void vmx_vcpu_reset(struct kvm_vcpu *vcpu)
 		vmcs_write64(APIC_ACCESS_ADDR,
 			     page_to_phys(vmx->vcpu.kvm->arch.apic_access_page));
 
-	if (vmx_vm_has_apicv(vcpu->kvm))
-		memset(&vmx->pi_desc, 0, sizeof(struct pi_desc));
+	/* Keep nv/ndst, an IRTE may already post to this descriptor */
+	if (vmx_vm_has_apicv(vcpu->kvm)) {
+		memset(vmx->pi_desc.pir, 0, sizeof(vmx->pi_desc.pir));
+		pi_test_and_clear_on(&vmx->pi_desc);
+	}
 
 	if (vmx->vpid != 0)
 		vmcs_write16(VIRTUAL_PROCESSOR_ID, vmx->vpid);
@@ -7267,6 +7493,15 @@ static void __noclone vmx_vcpu_run(struct kvm_vcpu *vcpu)
 	if (vmx->emulation_required)
 		return;
 
+	/*
+	 * A device interrupt posted while we were in root mode had its
+	 * notification taken by the host.  Interrupts are off now, so any
+	 * later notification is processed in non-root mode; fold in what
+	 * is already pending.
+	 */
+	if (vmx_pi_enabled(vcpu) && pi_test_on(&vmx->pi_desc))
+		vmx_hwapic_irr_update(vcpu, kvm_lapic_find_highest_irr(vcpu));
+
 	if (vmx->nested.sync_shadow_vmcs) {
 		copy_vmcs12_to_shadow(vmx);
 		vmx->nested.sync_shadow_vmcs = false;
@@ -7512,6 +7747,9 @@ static struct kvm_vcpu *vmx_create_vcpu(struct kvm *kvm, unsigned int id)
 	vmx->nested.current_vmptr = -1ull;
 	vmx->nested.current_vmcs12 = NULL;
 
+	INIT_LIST_HEAD(&vmx->blocked_vcpu_list);
+	vmx->pre_pcpu = -1;
+
 	return &vmx->vcpu;
 
 free_vmcs:
@@ -8792,6 +9030,10 @@ static struct kvm_x86_ops vmx_x86_ops = {
 	.mpx_supported = vmx_mpx_supported,
 
 	.check_nested_events = vmx_check_nested_events,
+
+	.pre_block = vmx_pre_block,
+	.post_block = vmx_post_block,
+	.update_pi_irte = vmx_update_pi_irte,
 };
 
 static int __init vmx_init(void)
@@ -8855,6 +9097,11 @@ static int __init vmx_init(void)
 
 	set_bit(0, vmx_vpid_bitmap); /* 0 is reserved for host */
 
+	for_each_possible_cpu(i) {
+		INIT_LIST_HEAD(&per_cpu(blocked_vcpu_on_cpu, i));
+		spin_lock_init(&per_cpu(blocked_vcpu_on_cpu_lock, i));
+	}
+
 	r = kvm_init(&vmx_x86_ops, sizeof(struct vcpu_vmx),
 		     __alignof__(struct vcpu_vmx), THIS_MODULE);
 	if (r)
@@ -8906,6 +9153,8 @@ static int __init vmx_init(void)
 	} else
 		kvm_disable_tdp();
 
+	kvm_set_posted_intr_wakeup_handler(pi_wakeup_handler);
+
 	return 0;
 
 out7:
@@ -8938,6 +9187,8 @@ static void __exit vmx_exit(void)
 	free_page((unsigned long)vmx_vmwrite_bitmap);
 	free_page((unsigned long)vmx_vmread_bitmap);
 
+	kvm_set_posted_intr_wakeup_handler(NULL);
+
 #ifdef CONFIG_KEXEC
 	rcu_assign_pointer(crash_vmclear_loaded_vmcss, NULL);
 	synchronize_rcu();
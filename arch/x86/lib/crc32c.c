@@ -0,0 +1,145 @@
+/*
+ * crc32c with the SSE4.2 crc32 instruction, for direct calls from
+ * lib/libcrc32c.c without going through the crypto API.
+ *
+ * The instruction has a latency of three cycles but a throughput of one
+ * per cycle, so large buffers are processed as three interleaved lanes
+ * whose crcs are combined afterwards. Shifting a crc over the zero bytes
+ * of a lane is linear, so it is done with a table built once at boot.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <linux/export.h>
+#include <linux/init.h>
+#include <linux/types.h>
+
+#include <asm/processor.h>
+#include <asm/cpufeature.h>
+#include <asm/crc32c.h>
+
+#define CRC32C_LANE	256
+
+static u32 crc32c_shift_table[4][256] __read_mostly;
+static bool crc32c_hw __read_mostly;
+
+#ifdef CONFIG_X86_64
+#define REX_PRE "0x48, "
+#else
+#define REX_PRE
+#endif
+
+static inline u32 crc32c_u8(u32 crc, u8 val)
+{
+#ifdef CONFIG_AS_CRC32
+	asm ("crc32b %1,%0\n" : "+r" (crc) : "rm" (val));
+#else
+	asm (".byte 0xf2, 0x0f, 0x38, 0xf0, 0xc1" : "+a" (crc) : "c" (val));
+#endif
+	return crc;
+}
+
+static inline u32 crc32c_ulong(u32 crc, unsigned long val)
+{
+#ifdef CONFIG_AS_CRC32
+#ifdef CONFIG_X86_64
+	asm ("crc32q %1,%q0\n" : "+r" (crc) : "rm" (val));
+#else
+	asm ("crc32l %1,%0\n" : "+r" (crc) : "rm" (val));
+#endif
+#else
+	asm (".byte 0xf2, " REX_PRE "0x0f, 0x38, 0xf1, 0xc1"
+	     : "+a" (crc) : "c" (val));
+#endif
+	return crc;
+}
+
+/* The crc of @crc followed by CRC32C_LANE zero bytes */
+static inline u32 crc32c_shift(u32 crc)
+{
+	return crc32c_shift_table[0][crc & 0xff] ^
+	       crc32c_shift_table[1][(crc >> 8) & 0xff] ^
+	       crc32c_shift_table[2][(crc >> 16) & 0xff] ^
+	       crc32c_shift_table[3][crc >> 24];
+}
+
+static u32 crc32c_hw_seq(u32 crc, const u8 *p, unsigned int len)
+{
+	for (; len >= sizeof(unsigned long); len -= sizeof(unsigned long)) {
+		crc = crc32c_ulong(crc, *(const unsigned long *)p);
+		p += sizeof(unsigned long);
+	}
+	while (len--)
+		crc = crc32c_u8(crc, *p++);
+
+	return crc;
+}
+
+bool arch_crc32c_usable(void)
+{
+	return crc32c_hw;
+}
+EXPORT_SYMBOL(arch_crc32c_usable);
+
+/* Same as __crc32c_le(), only valid if arch_crc32c_usable() */
+u32 arch_crc32c(u32 crc, const void *data, unsigned int len)
+{
+	const u8 *p = data;
+
+	while (len >= 3 * CRC32C_LANE) {
+		const unsigned long *a = (const unsigned long *)p;
+		const unsigned long *b = (const unsigned long *)(p + CRC32C_LANE);
+		const unsigned long *c = (const unsigned long *)(p + 2 * CRC32C_LANE);
+		u32 crc_b = 0, crc_c = 0;
+		unsigned int i;
+
+		for (i = 0; i < CRC32C_LANE / sizeof(unsigned long); i++) {
+			crc = crc32c_ulong(crc, a[i]);
+			crc_b = crc32c_ulong(crc_b, b[i]);
+			crc_c = crc32c_ulong(crc_c, c[i]);
+		}
+		crc = crc32c_shift(crc) ^ crc_b;
+		crc = crc32c_shift(crc) ^ crc_c;
+
+		p += 3 * CRC32C_LANE;
+		len -= 3 * CRC32C_LANE;
+	}
+
+	return crc32c_hw_seq(crc, p, len);
+}
+EXPORT_SYMBOL(arch_crc32c);
+
+static int __init crc32c_hw_init(void)
+{
+	u32 col[32];
+	unsigned int i, j, k;
+
+	if (!cpu_has_xmm4_2)
+		return 0;
+
+	/* Shift of each single bit crc, then of each byte of a crc */
+	for (i = 0; i < 32; i++) {
+		u32 crc = 1U << i;
+
+		for (j = 0; j < CRC32C_LANE / sizeof(unsigned long); j++)
+			crc = crc32c_ulong(crc, 0);
+		col[i] = crc;
+	}
+	for (k = 0; k < 4; k++) {
+		for (i = 0; i < 256; i++) {
+			u32 crc = 0;
+
+			for (j = 0; j < 8; j++)
+				if (i & (1 << j))
+					crc ^= col[8 * k + j];
+			crc32c_shift_table[k][i] = crc;
+		}
+	}
+
+	crc32c_hw = true;
+	return 0;
+}
+arch_initcall(crc32c_hw_init);
@@ -311,11 +311,33 @@ no_merge:
 	return 0;
 }
 
+/*
+ * Would appending @next to @prev leave a hole in the virtual address
+ * range covered by the two?  Only meaningful for QUEUE_FLAG_SG_GAPS queues.
+ */
+static bool bio_gap_to_prev(struct request_queue *q, struct bio *prev,
+			    struct bio *next)
+{
+	struct bio_vec bprv, bvec;
+	struct bvec_iter iter;
+
+	if (!(q->queue_flags & (1 << QUEUE_FLAG_SG_GAPS)))
+		return false;
+	if (!bio_has_data(prev) || !bio_has_data(next))
+		return false;
+
+	bio_for_each_segment(bprv, prev, iter)
+		;
+	bvec = bio_iovec(next);
+	return bvec_gap_to_prev(&bprv, bvec.bv_offset);
+}
+
 int ll_back_merge_fn(struct request_queue *q, struct request *req,
 		     struct bio *bio)
 {
 	if (blk_rq_sectors(req) + bio_sectors(bio) >
-	    blk_rq_get_max_sectors(req)) {
+	    blk_rq_get_max_sectors(req) ||
+	    bio_gap_to_prev(q, req->biotail, bio)) {
 		req->cmd_flags |= REQ_NOMERGE;
 		if (req == q->last_merge)
 			q->last_merge = NULL;
@@ -333,7 +355,8 @@ int ll_front_merge_fn(struct request_queue *q, struct request *req,
 		      struct bio *bio)
 {
 	if (blk_rq_sectors(req) + bio_sectors(bio) >
-	    blk_rq_get_max_sectors(req)) {
+	    blk_rq_get_max_sectors(req) ||
+	    bio_gap_to_prev(q, bio, req->bio)) {
 		req->cmd_flags |= REQ_NOMERGE;
 		if (req == q->last_merge)
 			q->last_merge = NULL;
@@ -379,6 +402,9 @@ static int ll_merge_requests_fn(struct request_queue *q, struct request *req,
 	    blk_rq_get_max_sectors(req))
 		return 0;
 
+	if (bio_gap_to_prev(q, req->biotail, next->bio))
+		return 0;
+
 	total_phys_segments = req->nr_phys_segments + next->nr_phys_segments;
 	if (blk_phys_contig_segment(q, req->biotail, next->bio)) {
 		if (req->nr_phys_segments == 1)
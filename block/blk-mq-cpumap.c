@@ -80,6 +80,23 @@ int blk_mq_update_queue_map(unsigned int *map, unsigned int nr_queues)
 	return 0;
 }
 
+/*
+ * Map each CPU to the hardware queue whose interrupt is bound to it. As
+ * the masks cover the possible CPUs, the map doesn't change on hotplug.
+ */
+void blk_mq_affinity_queue_map(unsigned int *map, const struct cpumask *masks,
+			       unsigned int nr_queues)
+{
+	unsigned int queue, cpu;
+
+	for_each_possible_cpu(cpu)
+		map[cpu] = 0;
+
+	for (queue = 0; queue < nr_queues; queue++)
+		for_each_cpu(cpu, &masks[queue])
+			map[cpu] = queue;
+}
+
 unsigned int *blk_mq_make_queue_map(struct blk_mq_reg *reg)
 {
 	unsigned int *map;
@@ -90,6 +107,12 @@ unsigned int *blk_mq_make_queue_map(struct blk_mq_reg *reg)
 	if (!map)
 		return NULL;
 
+	if (reg->queue_affinity) {
+		blk_mq_affinity_queue_map(map, reg->queue_affinity,
+					  reg->nr_hw_queues);
+		return map;
+	}
+
 	if (!blk_mq_update_queue_map(map, reg->nr_hw_queues))
 		return map;
 
@@ -0,0 +1,201 @@
+/*
+ * Scheduler hook for blk-mq hardware queues, and the list of schedulers
+ * that can be attached to them.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/blkdev.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include <linux/blk-mq.h>
+#include "blk.h"
+#include "blk-mq.h"
+#include "blk-mq-sched.h"
+
+static DEFINE_SPINLOCK(sched_list_lock);
+static LIST_HEAD(sched_list);
+
+static struct blk_mq_sched_type *blk_mq_sched_find(const char *name)
+{
+	struct blk_mq_sched_type *e;
+
+	list_for_each_entry(e, &sched_list, list) {
+		if (!strcmp(e->name, name))
+			return e;
+	}
+
+	return NULL;
+}
+
+static struct blk_mq_sched_type *blk_mq_sched_get(const char *name)
+{
+	struct blk_mq_sched_type *e;
+
+	spin_lock(&sched_list_lock);
+
+	e = blk_mq_sched_find(name);
+	if (!e) {
+		spin_unlock(&sched_list_lock);
+		request_module("%s-mqsched", name);
+		spin_lock(&sched_list_lock);
+		e = blk_mq_sched_find(name);
+	}
+
+	if (e && !try_module_get(e->owner))
+		e = NULL;
+
+	spin_unlock(&sched_list_lock);
+
+	return e;
+}
+
+int blk_mq_sched_register(struct blk_mq_sched_type *e)
+{
+	spin_lock(&sched_list_lock);
+	if (blk_mq_sched_find(e->name)) {
+		spin_unlock(&sched_list_lock);
+		return -EBUSY;
+	}
+	list_add_tail(&e->list, &sched_list);
+	spin_unlock(&sched_list_lock);
+
+	printk(KERN_INFO "blk-mq: scheduler %s registered\n", e->name);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(blk_mq_sched_register);
+
+void blk_mq_sched_unregister(struct blk_mq_sched_type *e)
+{
+	spin_lock(&sched_list_lock);
+	list_del_init(&e->list);
+	spin_unlock(&sched_list_lock);
+}
+EXPORT_SYMBOL_GPL(blk_mq_sched_unregister);
+
+/*
+ * Hand requests pulled off the software queues to the scheduler. Flush
+ * sequence requests are left on @list, to be issued right away.
+ */
+void blk_mq_sched_insert(struct blk_mq_hw_ctx *hctx, struct list_head *list)
+{
+	struct request *rq, *next;
+	LIST_HEAD(sched_rqs);
+
+	list_for_each_entry_safe(rq, next, list, queuelist) {
+		if (!(rq->cmd_flags & REQ_FLUSH_SEQ))
+			list_move_tail(&rq->queuelist, &sched_rqs);
+	}
+
+	if (!list_empty(&sched_rqs))
+		hctx->sched->ops.insert_requests(hctx, &sched_rqs);
+}
+
+static void blk_mq_sched_exit_hctxs(struct request_queue *q,
+				    unsigned int nr_hctx)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_sched_type *e = NULL;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (i == nr_hctx)
+			break;
+		if (!hctx->sched)
+			continue;
+
+		e = hctx->sched;
+		e->ops.exit_hctx(hctx);
+		hctx->sched = NULL;
+		hctx->sched_data = NULL;
+	}
+
+	if (e)
+		module_put(e->owner);
+}
+
+/*
+ * Tear down the scheduler of a queue that is going away. Nothing can be
+ * left inside it, the queue has been drained.
+ */
+void blk_mq_sched_exit_queue(struct request_queue *q)
+{
+	blk_mq_sched_exit_hctxs(q, q->nr_hw_queues);
+}
+
+/**
+ * blk_mq_sched_switch - change the scheduler of a blk-mq queue
+ * @q:		the request queue
+ * @name:	name of the new scheduler, or "none"
+ *
+ * Description:
+ *	Freezes @q, so that no request is left inside the old scheduler, and
+ *	sets up the new one on every hardware queue. If that fails the queue
+ *	is left without a scheduler. Called with q->sysfs_lock held.
+ **/
+int blk_mq_sched_switch(struct request_queue *q, const char *name)
+{
+	struct blk_mq_sched_type *e = NULL;
+	struct blk_mq_hw_ctx *hctx;
+	int i, ret = 0;
+
+	if (strcmp(name, "none")) {
+		e = blk_mq_sched_get(name);
+		if (!e)
+			return -EINVAL;
+	}
+
+	blk_mq_freeze_queue(q);
+
+	/*
+	 * Queue runs from process context now all need a request, which
+	 * the freeze prevents. Wait for the ones already kicked off.
+	 */
+	queue_for_each_hw_ctx(q, hctx, i)
+		cancel_delayed_work_sync(&hctx->delayed_work);
+
+	blk_mq_sched_exit_queue(q);
+
+	if (!e)
+		goto out;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		hctx->sched = e;
+		ret = e->ops.init_hctx(hctx);
+		if (ret) {
+			hctx->sched = NULL;
+			blk_mq_sched_exit_hctxs(q, i);
+			if (!i)
+				module_put(e->owner);
+			break;
+		}
+	}
+
+out:
+	blk_mq_unfreeze_queue(q);
+	return ret;
+}
+
+ssize_t blk_mq_sched_show(struct request_queue *q, char *page)
+{
+	struct blk_mq_sched_type *cur = q->queue_hw_ctx[0]->sched;
+	struct blk_mq_sched_type *e;
+	int len = 0;
+
+	if (!cur)
+		len += sprintf(page + len, "[none] ");
+	else
+		len += sprintf(page + len, "none ");
+
+	spin_lock(&sched_list_lock);
+	list_for_each_entry(e, &sched_list, list) {
+		if (e == cur)
+			len += sprintf(page + len, "[%s] ", e->name);
+		else
+			len += sprintf(page + len, "%s ", e->name);
+	}
+	spin_unlock(&sched_list_lock);
+
+	len += sprintf(page + len, "\n");
+	return len;
+}
@@ -0,0 +1,22 @@
+#ifndef INT_BLK_MQ_SCHED_H
+#define INT_BLK_MQ_SCHED_H
+
+extern void blk_mq_sched_insert(struct blk_mq_hw_ctx *hctx, struct list_head *list);
+extern int blk_mq_sched_switch(struct request_queue *q, const char *name);
+extern void blk_mq_sched_exit_queue(struct request_queue *q);
+extern ssize_t blk_mq_sched_show(struct request_queue *q, char *page);
+
+static inline struct request *blk_mq_sched_dispatch(struct blk_mq_hw_ctx *hctx)
+{
+	if (!hctx->sched)
+		return NULL;
+
+	return hctx->sched->ops.dispatch_request(hctx);
+}
+
+static inline bool blk_mq_sched_has_work(struct blk_mq_hw_ctx *hctx)
+{
+	return hctx->sched && hctx->sched->ops.has_work(hctx);
+}
+
+#endif
@@ -12,6 +12,7 @@
 #include <linux/blk-mq.h>
 #include "blk-mq.h"
 #include "blk-mq-tag.h"
+#include "blk-mq-sched.h"
 
 static void blk_mq_sysfs_release(struct kobject *kobj)
 {
@@ -29,6 +30,12 @@ struct blk_mq_hw_ctx_sysfs_entry {
 	ssize_t (*store)(struct blk_mq_hw_ctx *, const char *, size_t);
 };
 
+struct blk_mq_queue_sysfs_entry {
+	struct attribute attr;
+	ssize_t (*show)(struct request_queue *, char *);
+	ssize_t (*store)(struct request_queue *, const char *, size_t);
+};
+
 static ssize_t blk_mq_sysfs_show(struct kobject *kobj, struct attribute *attr,
 				 char *page)
 {
@@ -122,6 +129,49 @@ static ssize_t blk_mq_hw_sysfs_store(struct kobject *kobj,
 	return res;
 }
 
+static ssize_t blk_mq_queue_sysfs_show(struct kobject *kobj,
+				       struct attribute *attr, char *page)
+{
+	struct blk_mq_queue_sysfs_entry *entry;
+	struct request_queue *q;
+	ssize_t res;
+
+	entry = container_of(attr, struct blk_mq_queue_sysfs_entry, attr);
+	q = container_of(kobj, struct request_queue, mq_kobj);
+
+	if (!entry->show)
+		return -EIO;
+
+	res = -ENOENT;
+	mutex_lock(&q->sysfs_lock);
+	if (!blk_queue_dying(q))
+		res = entry->show(q, page);
+	mutex_unlock(&q->sysfs_lock);
+	return res;
+}
+
+static ssize_t blk_mq_queue_sysfs_store(struct kobject *kobj,
+					struct attribute *attr,
+					const char *page, size_t length)
+{
+	struct blk_mq_queue_sysfs_entry *entry;
+	struct request_queue *q;
+	ssize_t res;
+
+	entry = container_of(attr, struct blk_mq_queue_sysfs_entry, attr);
+	q = container_of(kobj, struct request_queue, mq_kobj);
+
+	if (!entry->store)
+		return -EIO;
+
+	res = -ENOENT;
+	mutex_lock(&q->sysfs_lock);
+	if (!blk_queue_dying(q))
+		res = entry->store(q, page, length);
+	mutex_unlock(&q->sysfs_lock);
+	return res;
+}
+
 static ssize_t blk_mq_sysfs_dispatched_show(struct blk_mq_ctx *ctx, char *page)
 {
 	return sprintf(page, "%lu %lu\n", ctx->rq_dispatched[1],
@@ -191,6 +241,39 @@ static ssize_t blk_mq_hw_sysfs_dispatched_show(struct blk_mq_hw_ctx *hctx,
 	return page - start_page;
 }
 
+static ssize_t blk_mq_hw_sysfs_latency_show(struct blk_mq_hw_ctx *hctx,
+					    char *page)
+{
+	char *start_page = page;
+	int i, cpu;
+
+	page += sprintf(page, "%8s\t%s\t%s\n", "usecs", "queue", "complete");
+
+	for (i = 0; i < BLK_MQ_LAT_BUCKETS; i++) {
+		unsigned long queue = 0, complete = 0;
+
+		for_each_possible_cpu(cpu) {
+			struct blk_mq_lat_stat *stat;
+
+			stat = per_cpu_ptr(hctx->lat_stat, cpu);
+			queue += stat->queue[i];
+			complete += stat->complete[i];
+		}
+
+		page += sprintf(page, "%8lu\t%lu\t%lu\n", i ? 1UL << i : 0UL,
+				queue, complete);
+	}
+
+	return page - start_page;
+}
+
+static ssize_t blk_mq_hw_sysfs_poll_show(struct blk_mq_hw_ctx *hctx,
+					 char *page)
+{
+	return sprintf(page, "invoked=%lu, success=%lu\n",
+			hctx->poll_invoked, hctx->poll_success);
+}
+
 static ssize_t blk_mq_hw_sysfs_rq_list_show(struct blk_mq_hw_ctx *hctx,
 					    char *page)
 {
@@ -244,6 +327,12 @@ static ssize_t blk_mq_hw_sysfs_tags_show(struct blk_mq_hw_ctx *hctx, char *page)
 	return blk_mq_tag_sysfs_show(hctx->tags, page);
 }
 
+static ssize_t blk_mq_hw_sysfs_active_show(struct blk_mq_hw_ctx *hctx,
+					   char *page)
+{
+	return sprintf(page, "%u\n", atomic_read(&hctx->nr_active));
+}
+
 static ssize_t blk_mq_hw_sysfs_cpus_show(struct blk_mq_hw_ctx *hctx, char *page)
 {
 	unsigned int i, queue_num, first = 1;
@@ -270,6 +359,57 @@ static ssize_t blk_mq_hw_sysfs_cpus_show(struct blk_mq_hw_ctx *hctx, char *page)
 	return ret;
 }
 
+static ssize_t blk_mq_queue_sysfs_io_poll_show(struct request_queue *q,
+					       char *page)
+{
+	return sprintf(page, "%u\n", blk_queue_poll(q));
+}
+
+static ssize_t blk_mq_queue_sysfs_io_poll_store(struct request_queue *q,
+						const char *page, size_t len)
+{
+	unsigned long val;
+
+	if (!q->mq_ops->poll)
+		return -EINVAL;
+
+	if (kstrtoul(page, 10, &val)) {
+		pr_err("blk-mq-sysfs: invalid input '%s'\n", page);
+		return -EINVAL;
+	}
+
+	spin_lock_irq(q->queue_lock);
+	if (val)
+		queue_flag_set(QUEUE_FLAG_POLL, q);
+	else
+		queue_flag_clear(QUEUE_FLAG_POLL, q);
+	spin_unlock_irq(q->queue_lock);
+
+	return len;
+}
+
+static ssize_t blk_mq_queue_sysfs_sched_show(struct request_queue *q,
+					     char *page)
+{
+	return blk_mq_sched_show(q, page);
+}
+
+static ssize_t blk_mq_queue_sysfs_sched_store(struct request_queue *q,
+					      const char *page, size_t len)
+{
+	char name[BLK_MQ_SCHED_NAME_MAX];
+	int ret;
+
+	strlcpy(name, page, sizeof(name));
+	ret = blk_mq_sched_switch(q, strstrip(name));
+	if (ret) {
+		pr_err("blk-mq-sysfs: switch to scheduler '%s' failed\n", name);
+		return ret;
+	}
+
+	return len;
+}
+
 static struct blk_mq_ctx_sysfs_entry blk_mq_sysfs_dispatched = {
 	.attr = {.name = "dispatched", .mode = S_IRUGO },
 	.show = blk_mq_sysfs_dispatched_show,
@@ -320,11 +460,24 @@ static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_tags = {
 	.attr = {.name = "tags", .mode = S_IRUGO },
 	.show = blk_mq_hw_sysfs_tags_show,
 };
+static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_active = {
+	.attr = {.name = "active", .mode = S_IRUGO },
+	.show = blk_mq_hw_sysfs_active_show,
+};
 static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_cpus = {
 	.attr = {.name = "cpu_list", .mode = S_IRUGO },
 	.show = blk_mq_hw_sysfs_cpus_show,
 };
 
+static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_latency = {
+	.attr = {.name = "latency", .mode = S_IRUGO },
+	.show = blk_mq_hw_sysfs_latency_show,
+};
+static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_poll = {
+	.attr = {.name = "io_poll", .mode = S_IRUGO },
+	.show = blk_mq_hw_sysfs_poll_show,
+};
+
 static struct attribute *default_hw_ctx_attrs[] = {
 	&blk_mq_hw_sysfs_queued.attr,
 	&blk_mq_hw_sysfs_run.attr,
@@ -332,7 +485,28 @@ static struct attribute *default_hw_ctx_attrs[] = {
 	&blk_mq_hw_sysfs_pending.attr,
 	&blk_mq_hw_sysfs_ipi.attr,
 	&blk_mq_hw_sysfs_tags.attr,
+	&blk_mq_hw_sysfs_active.attr,
 	&blk_mq_hw_sysfs_cpus.attr,
+	&blk_mq_hw_sysfs_poll.attr,
+	&blk_mq_hw_sysfs_latency.attr,
+	NULL,
+};
+
+static struct blk_mq_queue_sysfs_entry blk_mq_queue_sysfs_io_poll = {
+	.attr = {.name = "io_poll", .mode = S_IRUGO | S_IWUSR},
+	.show = blk_mq_queue_sysfs_io_poll_show,
+	.store = blk_mq_queue_sysfs_io_poll_store,
+};
+
+static struct blk_mq_queue_sysfs_entry blk_mq_queue_sysfs_sched = {
+	.attr = {.name = "scheduler", .mode = S_IRUGO | S_IWUSR},
+	.show = blk_mq_queue_sysfs_sched_show,
+	.store = blk_mq_queue_sysfs_sched_store,
+};
+
+static struct attribute *default_queue_attrs[] = {
+	&blk_mq_queue_sysfs_io_poll.attr,
+	&blk_mq_queue_sysfs_sched.attr,
 	NULL,
 };
 
@@ -346,8 +520,14 @@ static const struct sysfs_ops blk_mq_hw_sysfs_ops = {
 	.store	= blk_mq_hw_sysfs_store,
 };
 
+static const struct sysfs_ops blk_mq_queue_sysfs_ops = {
+	.show	= blk_mq_queue_sysfs_show,
+	.store	= blk_mq_queue_sysfs_store,
+};
+
 static struct kobj_type blk_mq_ktype = {
-	.sysfs_ops	= &blk_mq_sysfs_ops,
+	.sysfs_ops	= &blk_mq_queue_sysfs_ops,
+	.default_attrs	= default_queue_attrs,
 	.release	= blk_mq_sysfs_release,
 };
 
@@ -7,23 +7,75 @@
 #include "blk-mq.h"
 #include "blk-mq-tag.h"
 
+void blk_mq_wait_for_tags(struct blk_mq_hw_ctx *hctx)
+{
+	struct blk_mq_tags *tags = hctx->tags;
+	int tag;
+
+	wait_event(tags->active_wait, blk_mq_tag_may_queue(hctx));
+
+	tag = blk_mq_get_tag(tags, __GFP_WAIT, false);
+	blk_mq_put_tag(tags, tag);
+}
+
 /*
- * Per tagged queue (tag address space) map
+ * Mark the hardware queue as an active user of its shared tag map.
  */
-struct blk_mq_tags {
-	unsigned int nr_tags;
-	unsigned int nr_reserved_tags;
-	unsigned int nr_batch_move;
-	unsigned int nr_max_cache;
+void __blk_mq_tag_busy(struct blk_mq_hw_ctx *hctx)
+{
+	if (!test_bit(BLK_MQ_S_TAG_ACTIVE, &hctx->state) &&
+	    !test_and_set_bit(BLK_MQ_S_TAG_ACTIVE, &hctx->state))
+		atomic_inc(&hctx->tags->active_queues);
+}
 
-	struct percpu_ida free_tags;
-	struct percpu_ida reserved_tags;
-};
+/*
+ * The hardware queue went idle, let the remaining users have its share.
+ */
+void __blk_mq_tag_idle(struct blk_mq_hw_ctx *hctx)
+{
+	struct blk_mq_tags *tags = hctx->tags;
 
-void blk_mq_wait_for_tags(struct blk_mq_tags *tags)
+	if (!test_and_clear_bit(BLK_MQ_S_TAG_ACTIVE, &hctx->state))
+		return;
+
+	atomic_dec(&tags->active_queues);
+	if (waitqueue_active(&tags->active_wait))
+		wake_up(&tags->active_wait);
+}
+
+/*
+ * For shared tag users, we track the number of currently active users
+ * and attempt to provide a fair share of the tag depth for each of them.
+ */
+bool blk_mq_tag_may_queue(struct blk_mq_hw_ctx *hctx)
 {
-	int tag = blk_mq_get_tag(tags, __GFP_WAIT, false);
-	blk_mq_put_tag(tags, tag);
+	struct blk_mq_tags *tags = hctx->tags;
+	unsigned int depth, users;
+
+	if (!(hctx->flags & BLK_MQ_F_TAG_SHARED))
+		return true;
+	if (!test_bit(BLK_MQ_S_TAG_ACTIVE, &hctx->state))
+		return true;
+
+	users = atomic_read(&tags->active_queues);
+	if (!users)
+		return true;
+
+	/*
+	 * Allow at least some tags
+	 */
+	depth = tags->nr_tags - tags->nr_reserved_tags;
+	depth = max((depth + users - 1) / users, 4U);
+	return atomic_read(&hctx->nr_active) < depth;
+}
+
+void blk_mq_tag_dec_active(struct blk_mq_hw_ctx *hctx)
+{
+	struct blk_mq_tags *tags = hctx->tags;
+
+	atomic_dec(&hctx->nr_active);
+	if (waitqueue_active(&tags->active_wait))
+		wake_up(&tags->active_wait);
 }
 
 bool blk_mq_has_free_tags(struct blk_mq_tags *tags)
@@ -146,6 +198,9 @@ struct blk_mq_tags *blk_mq_init_tags(unsigned int total_tags,
 	tags->nr_reserved_tags = reserved_tags;
 	tags->nr_max_cache = nr_cache;
 	tags->nr_batch_move = max(1u, nr_cache / 2);
+	atomic_set(&tags->active_queues, 0);
+	init_waitqueue_head(&tags->active_wait);
+	INIT_LIST_HEAD(&tags->page_list);
 
 	ret = __percpu_ida_init(&tags->free_tags, tags->nr_tags -
 				tags->nr_reserved_tags,
@@ -196,6 +251,8 @@ ssize_t blk_mq_tag_sysfs_show(struct blk_mq_tags *tags, char *page)
 	page += sprintf(page, "nr_free=%u, nr_reserved=%u\n",
 			percpu_ida_free_tags(&tags->free_tags, nr_cpu_ids),
 			percpu_ida_free_tags(&tags->reserved_tags, nr_cpu_ids));
+	page += sprintf(page, "active_queues=%u\n",
+			atomic_read(&tags->active_queues));
 
 	for_each_possible_cpu(cpu) {
 		page += sprintf(page, "  cpu%02u: nr_free=%u\n", cpu,
@@ -21,6 +21,7 @@
 #include "blk.h"
 #include "blk-mq.h"
 #include "blk-mq-tag.h"
+#include "blk-mq-sched.h"
 
 static DEFINE_MUTEX(all_q_mutex);
 static LIST_HEAD(all_q_list);
@@ -79,10 +80,20 @@ static struct request *__blk_mq_alloc_request(struct blk_mq_hw_ctx *hctx,
 	struct request *rq;
 	unsigned int tag;
 
+	if (!reserved) {
+		blk_mq_tag_busy(hctx);
+		if (!blk_mq_tag_may_queue(hctx))
+			return NULL;
+	}
+
 	tag = blk_mq_get_tag(hctx->tags, gfp, reserved);
 	if (tag != BLK_MQ_TAG_FAIL) {
-		rq = hctx->rqs[tag];
+		rq = hctx->tags->rqs[tag];
 		rq->tag = tag;
+		if (hctx->flags & BLK_MQ_F_TAG_SHARED) {
+			rq->cmd_flags = REQ_MQ_INFLIGHT;
+			atomic_inc(&hctx->nr_active);
+		}
 
 		return rq;
 	}
@@ -141,7 +152,7 @@ static void __blk_mq_drain_queue(struct request_queue *q)
  * Guarantee no request is in use, so we can change any data structure of
  * the queue afterward.
  */
-static void blk_mq_freeze_queue(struct request_queue *q)
+void blk_mq_freeze_queue(struct request_queue *q)
 {
 	bool drain;
 
@@ -159,7 +170,7 @@ void blk_mq_drain_queue(struct request_queue *q)
 	__blk_mq_drain_queue(q);
 }
 
-static void blk_mq_unfreeze_queue(struct request_queue *q)
+void blk_mq_unfreeze_queue(struct request_queue *q)
 {
 	bool wake = false;
 
@@ -180,14 +191,21 @@ bool blk_mq_can_queue(struct blk_mq_hw_ctx *hctx)
 }
 EXPORT_SYMBOL(blk_mq_can_queue);
 
+struct request *blk_mq_tag_to_rq(struct blk_mq_hw_ctx *hctx, unsigned int tag)
+{
+	return hctx->tags->rqs[tag];
+}
+EXPORT_SYMBOL(blk_mq_tag_to_rq);
+
 static void blk_mq_rq_ctx_init(struct request_queue *q, struct blk_mq_ctx *ctx,
 			       struct request *rq, unsigned int rw_flags)
 {
 	if (blk_queue_io_stat(q))
 		rw_flags |= REQ_IO_STAT;
 
+	rq->q = q;
 	rq->mq_ctx = ctx;
-	rq->cmd_flags = rw_flags;
+	rq->cmd_flags |= rw_flags;
 	rq->start_time = jiffies;
 	set_start_time_ns(rq);
 	ctx->rq_dispatched[rw_is_sync(rw_flags)]++;
@@ -214,7 +232,7 @@ static struct request *blk_mq_alloc_request_pinned(struct request_queue *q,
 			break;
 
 		__blk_mq_run_hw_queue(hctx);
-		blk_mq_wait_for_tags(hctx->tags);
+		blk_mq_wait_for_tags(hctx);
 	} while (1);
 
 	return rq;
@@ -265,6 +283,9 @@ static void __blk_mq_free_request(struct blk_mq_hw_ctx *hctx,
 	const int tag = rq->tag;
 	struct request_queue *q = rq->q;
 
+	if (rq->cmd_flags & REQ_MQ_INFLIGHT)
+		blk_mq_tag_dec_active(hctx);
+
 	blk_mq_rq_init(hctx, rq);
 	blk_mq_put_tag(hctx->tags, tag);
 
@@ -283,13 +304,36 @@ void blk_mq_free_request(struct request *rq)
 	__blk_mq_free_request(hctx, ctx, rq);
 }
 
+static unsigned int blk_mq_lat_bucket(u64 start, u64 now)
+{
+	u64 usecs;
+
+	if (now <= start)
+		return 0;
+
+	usecs = div_u64(now - start, NSEC_PER_USEC);
+	if (usecs < 2)
+		return 0;
+
+	return min_t(unsigned int, ilog2(usecs), BLK_MQ_LAT_BUCKETS - 1);
+}
+
 bool blk_mq_end_io_partial(struct request *rq, int error, unsigned int nr_bytes)
 {
-	if (blk_update_request(rq, error, blk_rq_bytes(rq)))
+	if (blk_update_request(rq, error, nr_bytes))
 		return true;
 
 	blk_account_io_done(rq);
 
+	if (rq->mq_issue_ns) {
+		struct request_queue *q = rq->q;
+		struct blk_mq_hw_ctx *hctx;
+
+		hctx = q->mq_ops->map_queue(q, rq->mq_ctx->cpu);
+		this_cpu_inc(hctx->lat_stat->complete[blk_mq_lat_bucket(
+				rq->mq_issue_ns, ktime_to_ns(ktime_get()))]);
+	}
+
 	if (rq->end_io)
 		rq->end_io(rq, error);
 	else
@@ -344,12 +388,97 @@ void blk_mq_complete_request(struct request *rq)
 }
 EXPORT_SYMBOL(blk_mq_complete_request);
 
-static void blk_mq_start_request(struct request *rq, bool last)
+/*
+ * Complete a batch sent over from another cpu. The other requests of the
+ * batch hang off ->ipi_list of the one the IPI was sent for.
+ */
+static void __blk_mq_complete_batch_remote(void *data)
+{
+	struct request *rq = data, *next;
+	LIST_HEAD(list);
+
+	list_splice_init(&rq->ipi_list, &list);
+
+	rq->q->softirq_done_fn(rq);
+	list_for_each_entry_safe(rq, next, &list, ipi_list)
+		rq->q->softirq_done_fn(rq);
+}
+
+/**
+ * blk_mq_complete_request_list - end I/O on a batch of requests
+ * @list:	requests linked through ->queuelist, emptied on return
+ *
+ * Description:
+ *	Like calling blk_mq_complete_request() on each request, but the
+ *	requests whose completion belongs to another cpu are sent there
+ *	together, with a single IPI per cpu. Meant for drivers reaping a
+ *	number of requests in one interrupt.
+ **/
+void blk_mq_complete_request_list(struct list_head *list)
+{
+	struct request *rq, *next, *first;
+	int cpu, rq_cpu;
+
+	cpu = get_cpu();
+	while (!list_empty(list)) {
+		first = list_first_entry(list, struct request, queuelist);
+		list_del_init(&first->queuelist);
+
+		if (unlikely(blk_should_fake_timeout(first->q)) ||
+		    blk_mark_rq_complete(first))
+			continue;
+
+		rq_cpu = first->mq_ctx->cpu;
+		if (!first->mq_ctx->ipi_redirect || rq_cpu == cpu ||
+		    !cpu_online(rq_cpu)) {
+			first->q->softirq_done_fn(first);
+			continue;
+		}
+
+		/*
+		 * Gather everything else going to the same cpu behind the
+		 * first request.
+		 */
+		INIT_LIST_HEAD(&first->ipi_list);
+		list_for_each_entry_safe(rq, next, list, queuelist) {
+			if (rq->mq_ctx->cpu != rq_cpu ||
+			    !rq->mq_ctx->ipi_redirect)
+				continue;
+
+			list_del_init(&rq->queuelist);
+			if (unlikely(blk_should_fake_timeout(rq->q)) ||
+			    blk_mark_rq_complete(rq))
+				continue;
+			list_add_tail(&rq->ipi_list, &first->ipi_list);
+		}
+
+		first->csd.func = __blk_mq_complete_batch_remote;
+		first->csd.info = first;
+		first->csd.flags = 0;
+		smp_call_function_single_async(rq_cpu, &first->csd);
+	}
+	put_cpu();
+}
+EXPORT_SYMBOL(blk_mq_complete_request_list);
+
+static void blk_mq_start_request(struct blk_mq_hw_ctx *hctx,
+				 struct request *rq, bool last)
 {
 	struct request_queue *q = rq->q;
 
 	trace_block_rq_issue(q, rq);
 
+	/*
+	 * Only the first dispatch counts towards queueing latency, a
+	 * requeued request keeps its original insertion time out of it.
+	 */
+	rq->mq_issue_ns = ktime_to_ns(ktime_get());
+	if (rq->mq_queue_ns) {
+		this_cpu_inc(hctx->lat_stat->queue[blk_mq_lat_bucket(
+				rq->mq_queue_ns, rq->mq_issue_ns)]);
+		rq->mq_queue_ns = 0;
+	}
+
 	/*
 	 * Just mark start time and set the started bit. Due to memory
 	 * ordering, we know we'll see the correct deadline as long as
@@ -416,8 +545,10 @@ static void blk_mq_timeout_check(void *__data, unsigned long *free_tags)
 		if (tag >= hctx->queue_depth)
 			break;
 
-		rq = hctx->rqs[tag++];
+		rq = hctx->tags->rqs[tag++];
 
+		if (rq->q != hctx->queue)
+			continue;
 		if (!test_bit(REQ_ATOM_STARTED, &rq->atomic_flags))
 			continue;
 
@@ -454,6 +585,10 @@ static void blk_mq_rq_timer(unsigned long data)
 
 	if (next_set)
 		mod_timer(&q->timeout, round_jiffies_up(next));
+	else {
+		queue_for_each_hw_ctx(q, hctx, i)
+			blk_mq_tag_idle(hctx);
+	}
 }
 
 /*
@@ -532,6 +667,13 @@ static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
 		spin_unlock(&ctx->lock);
 	}
 
+	/*
+	 * With a scheduler attached, it decides the issue order of what
+	 * we just pulled in.
+	 */
+	if (hctx->sched && !list_empty(&rq_list))
+		blk_mq_sched_insert(hctx, &rq_list);
+
 	/*
 	 * If we have previous entries on our dispatch list, grab them
 	 * and stuff them at the front for more fair dispatch.
@@ -549,15 +691,24 @@ static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
 	queued = 0;
 
 	/*
-	 * Now process all the entries, sending them to the driver.
+	 * Now process all the entries, sending them to the driver. Once
+	 * the list is empty, keep going with what the scheduler hands out.
 	 */
-	while (!list_empty(&rq_list)) {
+	while (1) {
 		int ret;
 
-		rq = list_first_entry(&rq_list, struct request, queuelist);
-		list_del_init(&rq->queuelist);
+		if (!list_empty(&rq_list)) {
+			rq = list_first_entry(&rq_list, struct request,
+						queuelist);
+			list_del_init(&rq->queuelist);
+		} else {
+			rq = blk_mq_sched_dispatch(hctx);
+			if (!rq)
+				break;
+		}
 
-		blk_mq_start_request(rq, list_empty(&rq_list));
+		blk_mq_start_request(hctx, rq, list_empty(&rq_list) &&
+					!blk_mq_sched_has_work(hctx));
 
 		ret = q->mq_ops->queue_rq(hctx, rq);
 		switch (ret) {
@@ -615,6 +766,59 @@ void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
 	}
 }
 
+/**
+ * blk_poll - spin on the hardware queue of the submitting cpu
+ * @q:		the request queue a synchronous request was submitted to
+ *
+ * Description:
+ *	Called by a submitter about to sleep waiting for its own request, with
+ *	its task state already set. Repeatedly asks the driver to reap
+ *	completions until the task has been woken, a signal is pending or
+ *	the cpu is needed elsewhere. Returns true if the caller doesn't need
+ *	to sleep.
+ **/
+bool blk_poll(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_plug *plug;
+	long state;
+
+	if (!q->mq_ops || !q->mq_ops->poll || !blk_queue_poll(q))
+		return false;
+
+	plug = current->plug;
+	if (plug)
+		blk_flush_plug_list(plug, false);
+
+	hctx = q->mq_ops->map_queue(q, raw_smp_processor_id());
+
+	state = current->state;
+	while (!need_resched()) {
+		int ret;
+
+		hctx->poll_invoked++;
+
+		ret = q->mq_ops->poll(hctx);
+		if (ret > 0) {
+			hctx->poll_success++;
+			set_current_state(TASK_RUNNING);
+			return true;
+		}
+
+		if (signal_pending_state(state, current))
+			set_current_state(TASK_RUNNING);
+
+		if (current->state == TASK_RUNNING)
+			return true;
+		if (ret < 0)
+			break;
+		cpu_relax();
+	}
+
+	return false;
+}
+EXPORT_SYMBOL(blk_poll);
+
 void blk_mq_run_queues(struct request_queue *q, bool async)
 {
 	struct blk_mq_hw_ctx *hctx;
@@ -622,7 +826,8 @@ void blk_mq_run_queues(struct request_queue *q, bool async)
 
 	queue_for_each_hw_ctx(q, hctx, i) {
 		if ((!blk_mq_hctx_has_pending(hctx) &&
-		    list_empty_careful(&hctx->dispatch)) ||
+		    list_empty_careful(&hctx->dispatch) &&
+		    !blk_mq_sched_has_work(hctx)) ||
 		    test_bit(BLK_MQ_S_STOPPED, &hctx->state))
 			continue;
 
@@ -685,6 +890,8 @@ static void __blk_mq_insert_request(struct blk_mq_hw_ctx *hctx,
 
 	trace_block_rq_insert(hctx->queue, rq);
 
+	rq->mq_queue_ns = ktime_to_ns(ktime_get());
+
 	if (at_head)
 		list_add(&rq->queuelist, &ctx->rq_list);
 	else
@@ -1007,7 +1214,7 @@ static int blk_mq_init_hw_commands(struct blk_mq_hw_ctx *hctx,
 	int ret = 0;
 
 	for (i = 0; i < hctx->queue_depth; i++) {
-		struct request *rq = hctx->rqs[i];
+		struct request *rq = hctx->tags->rqs[i];
 
 		ret = init(data, hctx, rq, i);
 		if (ret)
@@ -1044,7 +1251,7 @@ static void blk_mq_free_hw_commands(struct blk_mq_hw_ctx *hctx,
 	unsigned int i;
 
 	for (i = 0; i < hctx->queue_depth; i++) {
-		struct request *rq = hctx->rqs[i];
+		struct request *rq = hctx->tags->rqs[i];
 
 		free(data, hctx, rq, i);
 	}
@@ -1063,20 +1270,22 @@ void blk_mq_free_commands(struct request_queue *q,
 }
 EXPORT_SYMBOL(blk_mq_free_commands);
 
-static void blk_mq_free_rq_map(struct blk_mq_hw_ctx *hctx)
+static void blk_mq_free_rq_pages(struct list_head *page_list)
 {
 	struct page *page;
 
-	while (!list_empty(&hctx->page_list)) {
-		page = list_first_entry(&hctx->page_list, struct page, lru);
+	while (!list_empty(page_list)) {
+		page = list_first_entry(page_list, struct page, lru);
 		list_del_init(&page->lru);
 		__free_pages(page, page->private);
 	}
+}
 
-	kfree(hctx->rqs);
-
-	if (hctx->tags)
-		blk_mq_free_tags(hctx->tags);
+static void blk_mq_free_rq_map(struct blk_mq_tags *tags)
+{
+	blk_mq_free_rq_pages(&tags->page_list);
+	kfree(tags->rqs);
+	blk_mq_free_tags(tags);
 }
 
 static size_t order_to_size(unsigned int order)
@@ -1089,28 +1298,28 @@ static size_t order_to_size(unsigned int order)
 	return ret;
 }
 
-static int blk_mq_init_rq_map(struct blk_mq_hw_ctx *hctx,
-			      unsigned int reserved_tags, int node)
+static struct blk_mq_tags *blk_mq_init_rq_map(unsigned int depth,
+		unsigned int reserved_tags, unsigned int cmd_size, int node)
 {
 	unsigned int i, j, entries_per_page, max_order = 4;
+	struct blk_mq_tags *tags;
+	struct request **rqs;
+	LIST_HEAD(page_list);
 	size_t rq_size, left;
 
-	INIT_LIST_HEAD(&hctx->page_list);
-
-	hctx->rqs = kmalloc_node(hctx->queue_depth * sizeof(struct request *),
-					GFP_KERNEL, node);
-	if (!hctx->rqs)
-		return -ENOMEM;
+	rqs = kmalloc_node(depth * sizeof(struct request *), GFP_KERNEL, node);
+	if (!rqs)
+		return NULL;
 
 	/*
 	 * rq_size is the size of the request plus driver payload, rounded
 	 * to the cacheline size
 	 */
-	rq_size = round_up(sizeof(struct request) + hctx->cmd_size,
+	rq_size = round_up(sizeof(struct request) + cmd_size,
 				cache_line_size());
-	left = rq_size * hctx->queue_depth;
+	left = rq_size * depth;
 
-	for (i = 0; i < hctx->queue_depth;) {
+	for (i = 0; i < depth;) {
 		int this_order = max_order;
 		struct page *page;
 		int to_do;
@@ -1133,15 +1342,17 @@ static int blk_mq_init_rq_map(struct blk_mq_hw_ctx *hctx,
 			break;
 
 		page->private = this_order;
-		list_add_tail(&page->lru, &hctx->page_list);
+		list_add_tail(&page->lru, &page_list);
 
 		p = page_address(page);
 		entries_per_page = order_to_size(this_order) / rq_size;
-		to_do = min(entries_per_page, hctx->queue_depth - i);
+		to_do = min(entries_per_page, depth - i);
 		left -= to_do * rq_size;
 		for (j = 0; j < to_do; j++) {
-			hctx->rqs[i] = p;
-			blk_mq_rq_init(hctx, hctx->rqs[i]);
+			rqs[i] = p;
+			blk_rq_init(NULL, rqs[i]);
+			if (cmd_size)
+				rqs[i]->special = blk_mq_rq_to_pdu(rqs[i]);
 			p += rq_size;
 			i++;
 		}
@@ -1149,20 +1360,23 @@ static int blk_mq_init_rq_map(struct blk_mq_hw_ctx *hctx,
 
 	if (i < (reserved_tags + BLK_MQ_TAG_MIN))
 		goto err_rq_map;
-	else if (i != hctx->queue_depth) {
-		hctx->queue_depth = i;
+	else if (i != depth) {
+		depth = i;
 		pr_warn("%s: queue depth set to %u because of low memory\n",
 					__func__, i);
 	}
 
-	hctx->tags = blk_mq_init_tags(hctx->queue_depth, reserved_tags, node);
-	if (!hctx->tags) {
+	tags = blk_mq_init_tags(depth, reserved_tags, node);
+	if (!tags) {
 err_rq_map:
-		blk_mq_free_rq_map(hctx);
-		return -ENOMEM;
+		blk_mq_free_rq_pages(&page_list);
+		kfree(rqs);
+		return NULL;
 	}
 
-	return 0;
+	tags->rqs = rqs;
+	list_splice(&page_list, &tags->page_list);
+	return tags;
 }
 
 static int blk_mq_init_hw_queues(struct request_queue *q,
@@ -1195,8 +1409,15 @@ static int blk_mq_init_hw_queues(struct request_queue *q,
 						blk_mq_hctx_notify, hctx);
 		blk_mq_register_cpu_notifier(&hctx->cpu_notifier);
 
-		if (blk_mq_init_rq_map(hctx, reg->reserved_tags, node))
+		if (reg->tag_set)
+			hctx->tags = reg->tag_set->tags[i];
+		else
+			hctx->tags = blk_mq_init_rq_map(reg->queue_depth,
+					reg->reserved_tags, reg->cmd_size, node);
+		if (!hctx->tags)
 			break;
+		hctx->queue_depth = hctx->tags->nr_tags;
+		atomic_set(&hctx->nr_active, 0);
 
 		/*
 		 * Allocate space for all possible cpus to avoid allocation in
@@ -1213,6 +1434,10 @@ static int blk_mq_init_hw_queues(struct request_queue *q,
 		if (!hctx->ctx_map)
 			break;
 
+		hctx->lat_stat = alloc_percpu(struct blk_mq_lat_stat);
+		if (!hctx->lat_stat)
+			break;
+
 		hctx->nr_ctx_map = num_maps;
 		hctx->nr_ctx = 0;
 
@@ -1235,8 +1460,10 @@ static int blk_mq_init_hw_queues(struct request_queue *q,
 			reg->ops->exit_hctx(hctx, j);
 
 		blk_mq_unregister_cpu_notifier(&hctx->cpu_notifier);
-		blk_mq_free_rq_map(hctx);
+		if (!reg->tag_set)
+			blk_mq_free_rq_map(hctx->tags);
 		kfree(hctx->ctxs);
+		free_percpu(hctx->lat_stat);
 	}
 
 	return 1;
@@ -1294,14 +1521,64 @@ static void blk_mq_map_swqueue(struct request_queue *q)
 	}
 }
 
+static void blk_mq_update_tag_set_shared(struct blk_mq_tag_set *set,
+					 bool shared)
+{
+	struct request_queue *q;
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	list_for_each_entry(q, &set->tag_list, tag_set_list) {
+		queue_for_each_hw_ctx(q, hctx, i) {
+			if (shared)
+				hctx->flags |= BLK_MQ_F_TAG_SHARED;
+			else {
+				hctx->flags &= ~BLK_MQ_F_TAG_SHARED;
+				blk_mq_tag_idle(hctx);
+			}
+		}
+	}
+}
+
+static void blk_mq_add_queue_tag_set(struct blk_mq_tag_set *set,
+				     struct request_queue *q)
+{
+	q->tag_set = set;
+
+	mutex_lock(&set->tag_list_lock);
+	list_add_tail(&q->tag_set_list, &set->tag_list);
+	if (!list_is_singular(&set->tag_list))
+		blk_mq_update_tag_set_shared(set, true);
+	mutex_unlock(&set->tag_list_lock);
+}
+
+static void blk_mq_del_queue_tag_set(struct request_queue *q)
+{
+	struct blk_mq_tag_set *set = q->tag_set;
+
+	mutex_lock(&set->tag_list_lock);
+	list_del_init(&q->tag_set_list);
+	if (list_is_singular(&set->tag_list))
+		blk_mq_update_tag_set_shared(set, false);
+	mutex_unlock(&set->tag_list_lock);
+}
+
 struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
 					void *driver_data)
 {
+	struct blk_mq_tag_set *set = reg->tag_set;
 	struct blk_mq_hw_ctx **hctxs;
 	struct blk_mq_ctx *ctx;
 	struct request_queue *q;
 	int i;
 
+	if (set) {
+		reg->nr_hw_queues = set->nr_hw_queues;
+		reg->queue_depth = set->queue_depth;
+		reg->reserved_tags = set->reserved_tags;
+		reg->cmd_size = set->cmd_size;
+	}
+
 	if (!reg->nr_hw_queues ||
 	    !reg->ops->queue_rq || !reg->ops->map_queue ||
 	    !reg->ops->alloc_hctx || !reg->ops->free_hctx)
@@ -1343,6 +1620,7 @@ struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
 	q->mq_map = blk_mq_make_queue_map(reg);
 	if (!q->mq_map)
 		goto err_map;
+	q->mq_affinity = reg->queue_affinity;
 
 	setup_timer(&q->timeout, blk_mq_rq_timer, (unsigned long) q);
 	blk_queue_rq_timeout(q, 30000);
@@ -1355,6 +1633,7 @@ struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
 
 	q->mq_ops = reg->ops;
 	q->queue_flags |= QUEUE_FLAG_MQ_DEFAULT;
+	INIT_LIST_HEAD(&q->tag_set_list);
 
 	q->sg_reserved_size = INT_MAX;
 
@@ -1379,6 +1658,9 @@ struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
 
 	blk_mq_map_swqueue(q);
 
+	if (set)
+		blk_mq_add_queue_tag_set(set, q);
+
 	mutex_lock(&all_q_mutex);
 	list_add_tail(&q->all_q_node, &all_q_list);
 	mutex_unlock(&all_q_mutex);
@@ -1409,10 +1691,18 @@ void blk_mq_free_queue(struct request_queue *q)
 	struct blk_mq_hw_ctx *hctx;
 	int i;
 
+	if (q->tag_set)
+		blk_mq_del_queue_tag_set(q);
+
+	blk_mq_sched_exit_queue(q);
+
 	queue_for_each_hw_ctx(q, hctx, i) {
 		kfree(hctx->ctx_map);
 		kfree(hctx->ctxs);
-		blk_mq_free_rq_map(hctx);
+		free_percpu(hctx->lat_stat);
+		blk_mq_tag_idle(hctx);
+		if (!q->tag_set)
+			blk_mq_free_rq_map(hctx->tags);
 		blk_mq_unregister_cpu_notifier(&hctx->cpu_notifier);
 		if (q->mq_ops->exit_hctx)
 			q->mq_ops->exit_hctx(hctx, i);
@@ -1432,12 +1722,77 @@ void blk_mq_free_queue(struct request_queue *q)
 	mutex_unlock(&all_q_mutex);
 }
 
+/**
+ * blk_mq_alloc_tag_set - allocate tags and requests shared by several queues
+ * @set:	tag set, with the queue geometry filled in by the driver
+ *
+ * Description:
+ *	Allocates one tag map and its requests per hardware queue. Queues set
+ *	up with @set in their blk_mq_reg share them, each active queue being
+ *	limited to a fair share of the depth.
+ **/
+int blk_mq_alloc_tag_set(struct blk_mq_tag_set *set)
+{
+	int i;
+
+	if (!set->nr_hw_queues)
+		return -EINVAL;
+
+	if (!set->queue_depth)
+		set->queue_depth = BLK_MQ_MAX_DEPTH;
+	else if (set->queue_depth > BLK_MQ_MAX_DEPTH) {
+		pr_err("blk-mq: queuedepth too large (%u)\n", set->queue_depth);
+		set->queue_depth = BLK_MQ_MAX_DEPTH;
+	}
+
+	if (set->queue_depth < (set->reserved_tags + BLK_MQ_TAG_MIN))
+		return -EINVAL;
+
+	set->tags = kmalloc_node(set->nr_hw_queues * sizeof(*set->tags),
+				 GFP_KERNEL, set->numa_node);
+	if (!set->tags)
+		return -ENOMEM;
+
+	for (i = 0; i < set->nr_hw_queues; i++) {
+		set->tags[i] = blk_mq_init_rq_map(set->queue_depth,
+				set->reserved_tags, set->cmd_size,
+				set->numa_node);
+		if (!set->tags[i])
+			goto out_unwind;
+	}
+
+	mutex_init(&set->tag_list_lock);
+	INIT_LIST_HEAD(&set->tag_list);
+	return 0;
+
+out_unwind:
+	while (--i >= 0)
+		blk_mq_free_rq_map(set->tags[i]);
+	kfree(set->tags);
+	return -ENOMEM;
+}
+EXPORT_SYMBOL(blk_mq_alloc_tag_set);
+
+void blk_mq_free_tag_set(struct blk_mq_tag_set *set)
+{
+	int i;
+
+	WARN_ON(!list_empty(&set->tag_list));
+
+	for (i = 0; i < set->nr_hw_queues; i++)
+		blk_mq_free_rq_map(set->tags[i]);
+	kfree(set->tags);
+}
+EXPORT_SYMBOL(blk_mq_free_tag_set);
+
 /* Basically redo blk_mq_init_queue with queue frozen */
 static void blk_mq_queue_reinit(struct request_queue *q)
 {
 	blk_mq_freeze_queue(q);
 
-	blk_mq_update_queue_map(q->mq_map, q->nr_hw_queues);
+	/* A map following the interrupt affinity is good for all CPUs */
+	if (!q->mq_affinity)
+		blk_mq_update_queue_map(q->mq_map, q->nr_hw_queues);
 
 	/*
 	 * redo blk_mq_init_cpu_queues and blk_mq_init_hw_queues. FIXME: maybe
@@ -26,6 +26,8 @@ void __blk_mq_complete_request(struct request *rq);
 void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async);
 void blk_mq_init_flush(struct request_queue *q);
 void blk_mq_drain_queue(struct request_queue *q);
+void blk_mq_freeze_queue(struct request_queue *q);
+void blk_mq_unfreeze_queue(struct request_queue *q);
 void blk_mq_free_queue(struct request_queue *q);
 void blk_mq_rq_init(struct blk_mq_hw_ctx *hctx, struct request *rq);
 
@@ -48,6 +50,9 @@ void blk_mq_disable_hotplug(void);
 struct blk_mq_reg;
 extern unsigned int *blk_mq_make_queue_map(struct blk_mq_reg *reg);
 extern int blk_mq_update_queue_map(unsigned int *map, unsigned int nr_queues);
+extern void blk_mq_affinity_queue_map(unsigned int *map,
+				      const struct cpumask *masks,
+				      unsigned int nr_queues);
 
 void blk_mq_add_timer(struct request *rq);
 
@@ -21,6 +21,9 @@ static int throtl_quantum = 32;
 /* Throttling is performed over 100ms slice and after that slice is renewed */
 static unsigned long throtl_slice = HZ/10;	/* 100 ms */
 
+/* Max bios granted to a cpu's token cache in one refill, 0 disables it */
+static unsigned int throtl_token_batch = 8;
+
 static struct blkcg_policy blkcg_policy_throtl;
 
 /* A workqueue to queue throttle related work */
@@ -89,6 +92,17 @@ struct tg_stats_cpu {
 	struct blkg_rwstat		service_bytes;
 	/* total IOs serviced, post merge */
 	struct blkg_rwstat		serviced;
+
+	/*
+	 * Token cache.  Budget already charged to the group's current
+	 * slice, which bios issued on this cpu may consume without taking
+	 * the queue_lock.  Only valid while token_gen matches the group's
+	 * and the slice it was taken from hasn't run out.
+	 */
+	unsigned int			token_gen;
+	unsigned long			token_expires[2];
+	unsigned int			token_ios[2];
+	u64				token_bytes[2];
 };
 
 struct throtl_grp {
@@ -142,6 +156,9 @@ struct throtl_grp {
 	unsigned long slice_start[2];
 	unsigned long slice_end[2];
 
+	/* bumped to invalidate the per cpu token caches */
+	unsigned int token_gen;
+
 	/* Per cpu stats pointer */
 	struct tg_stats_cpu __percpu *stats_cpu;
 
@@ -1008,6 +1025,94 @@ static void throtl_charge_bio(struct throtl_grp *tg, struct bio *bio)
 	}
 }
 
+/*
+ * Charge up to throtl_token_batch more bios worth of @tg's remaining
+ * budget in the current slice to this cpu's token cache, so that the
+ * following bios can go through blk_throtl_bio() without the queue_lock.
+ * Called with the queue_lock held, right after @bio was charged.
+ */
+static void throtl_refill_tokens(struct throtl_grp *tg, struct bio *bio)
+{
+	bool rw = bio_data_dir(bio);
+	unsigned int ios = throtl_token_batch;
+	u64 bytes = (u64)throtl_token_batch * bio->bi_iter.bi_size;
+	unsigned long jiffy_elapsed_rnd;
+	struct tg_stats_cpu *sc;
+	u64 tmp;
+
+	if (!throtl_token_batch || tg->stats_cpu == NULL)
+		return;
+
+	jiffy_elapsed_rnd = max(jiffies - tg->slice_start[rw], 1UL);
+	jiffy_elapsed_rnd = roundup(jiffy_elapsed_rnd, throtl_slice);
+
+	if (tg->bps[rw] != -1) {
+		tmp = tg->bps[rw] * jiffy_elapsed_rnd;
+		do_div(tmp, HZ);
+		if (tmp <= tg->bytes_disp[rw])
+			return;
+		bytes = min(bytes, tmp - tg->bytes_disp[rw]);
+	}
+
+	if (tg->iops[rw] != -1) {
+		tmp = (u64)tg->iops[rw] * jiffy_elapsed_rnd;
+		do_div(tmp, HZ);
+		if (tmp <= tg->io_disp[rw])
+			return;
+		ios = min_t(u64, ios, tmp - tg->io_disp[rw]);
+	}
+
+	if (!bytes)
+		return;
+
+	tg->bytes_disp[rw] += bytes;
+	tg->io_disp[rw] += ios;
+
+	/* queue_lock is held with irqs disabled, we can't migrate */
+	sc = this_cpu_ptr(tg->stats_cpu);
+	if (sc->token_gen != tg->token_gen ||
+	    !time_before(jiffies, sc->token_expires[rw])) {
+		sc->token_ios[rw] = 0;
+		sc->token_bytes[rw] = 0;
+	}
+	sc->token_gen = tg->token_gen;
+	sc->token_expires[rw] = tg->slice_end[rw];
+	sc->token_ios[rw] += ios;
+	sc->token_bytes[rw] += bytes;
+
+	throtl_log(&tg->service_queue, "[%c] token refill ios=%u bytes=%llu",
+		   rw == READ ? 'R' : 'W', ios, bytes);
+}
+
+/*
+ * Lockless fast path: let @bio through if this cpu's token cache for @tg
+ * covers it.  Bios already queued on @tg come first, so don't bypass them.
+ */
+static bool throtl_use_token(struct throtl_grp *tg, struct bio *bio)
+{
+	bool rw = bio_data_dir(bio);
+	struct tg_stats_cpu *sc;
+	unsigned long flags;
+	bool ret = false;
+
+	if (tg->stats_cpu == NULL ||
+	    ACCESS_ONCE(tg->service_queue.nr_queued[rw]))
+		return false;
+
+	local_irq_save(flags);
+	sc = this_cpu_ptr(tg->stats_cpu);
+	if (sc->token_ios[rw] && sc->token_bytes[rw] >= bio->bi_iter.bi_size &&
+	    sc->token_gen == ACCESS_ONCE(tg->token_gen) &&
+	    time_before(jiffies, sc->token_expires[rw])) {
+		sc->token_ios[rw]--;
+		sc->token_bytes[rw] -= bio->bi_iter.bi_size;
+		ret = true;
+	}
+	local_irq_restore(flags);
+
+	return ret;
+}
+
 /**
  * throtl_add_bio_tg - add a bio to the specified throtl_grp
  * @bio: bio to add
@@ -1393,8 +1498,10 @@ static int tg_set_conf(struct cgroup_subsys_state *css, struct cftype *cft,
 	 *
 	 * Restart the slices for both READ and WRITES. It might happen
 	 * that a group's limit are dropped suddenly and we don't want to
-	 * account recently dispatched IO with new low rate.
+	 * account recently dispatched IO with new low rate.  Tokens handed
+	 * out under the old limits are void as well.
 	 */
+	tg->token_gen++;
 	throtl_start_new_slice(tg, 0);
 	throtl_start_new_slice(tg, 1);
 
@@ -1497,7 +1604,7 @@ bool blk_throtl_bio(struct request_queue *q, struct bio *bio)
 	blkcg = bio_blkcg(bio);
 	tg = throtl_lookup_tg(td, blkcg);
 	if (tg) {
-		if (!tg->has_rules[rw]) {
+		if (!tg->has_rules[rw] || throtl_use_token(tg, bio)) {
 			throtl_update_dispatch_stats(tg_to_blkg(tg),
 					bio->bi_iter.bi_size, bio->bi_rw);
 			goto out_unlock_rcu;
@@ -1540,6 +1647,14 @@ bool blk_throtl_bio(struct request_queue *q, struct bio *bio)
 		 */
 		throtl_trim_slice(tg, rw);
 
+		/*
+		 * Tokens can only be handed out by a group whose limits are
+		 * the last ones on the way up, bios using them skip the
+		 * rest of the hierarchy.
+		 */
+		if (!qn && !sq_to_tg(sq->parent_sq))
+			throtl_refill_tokens(tg, bio);
+
 		/*
 		 * @bio passed through this layer without being throttled.
 		 * Climb up the ladder.  If we''re already at the top, it
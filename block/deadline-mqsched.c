@@ -0,0 +1,263 @@
+/*
+ *  Deadline scheduler for blk-mq hardware queues. Same policy as
+ *  deadline-iosched.c, with one instance per hardware queue driven from
+ *  the queue run instead of the elevator.
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/elevator.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/rbtree.h>
+
+/*
+ * See Documentation/block/deadline-iosched.txt. The tunables are shared by
+ * all queues using this scheduler.
+ */
+static unsigned int read_expire = 500;	/* msecs before a read is submitted */
+module_param(read_expire, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(read_expire, "Read deadline in msecs. Default: 500");
+
+static unsigned int write_expire = 5000; /* ditto for writes, SOFT limits */
+module_param(write_expire, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(write_expire, "Write deadline in msecs. Default: 5000");
+
+static unsigned int writes_starved = 2;	/* max times reads can starve a write */
+module_param(writes_starved, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(writes_starved, "Read batches that may starve writes. Default: 2");
+
+static unsigned int fifo_batch = 16;	/* # of sequential requests treated as one */
+module_param(fifo_batch, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(fifo_batch, "Requests dispatched in one sorted batch. Default: 16");
+
+struct deadline_mq_data {
+	spinlock_t lock;
+
+	/*
+	 * requests are present on both sort_list and fifo_list
+	 */
+	struct rb_root sort_list[2];
+	struct list_head fifo_list[2];
+
+	/*
+	 * next in sort order. read, write or both are NULL
+	 */
+	struct request *next_rq[2];
+	unsigned int batching;		/* number of sequential requests made */
+	unsigned int starved;		/* times reads have starved writes */
+};
+
+static inline struct request *
+deadline_mq_latter_request(struct request *rq)
+{
+	struct rb_node *node = rb_next(&rq->rb_node);
+
+	if (node)
+		return rb_entry_rq(node);
+
+	return NULL;
+}
+
+static void
+deadline_mq_add_request(struct deadline_mq_data *dd, struct request *rq)
+{
+	const int data_dir = rq_data_dir(rq);
+	unsigned int expire;
+
+	elv_rb_add(&dd->sort_list[data_dir], rq);
+
+	/*
+	 * set expire time and add to fifo list
+	 */
+	expire = data_dir == READ ? read_expire : write_expire;
+	rq->fifo_time = jiffies + msecs_to_jiffies(expire);
+	list_add_tail(&rq->queuelist, &dd->fifo_list[data_dir]);
+}
+
+/*
+ * remove rq from rbtree and fifo, lining up the next one in sort order
+ */
+static void
+deadline_mq_remove_request(struct deadline_mq_data *dd, struct request *rq)
+{
+	const int data_dir = rq_data_dir(rq);
+
+	dd->next_rq[READ] = NULL;
+	dd->next_rq[WRITE] = NULL;
+	dd->next_rq[data_dir] = deadline_mq_latter_request(rq);
+
+	rq_fifo_clear(rq);
+	elv_rb_del(&dd->sort_list[data_dir], rq);
+}
+
+/*
+ * returns 1 if the oldest request in this direction has expired.
+ * Requires !list_empty(&dd->fifo_list[data_dir])
+ */
+static inline int deadline_mq_check_fifo(struct deadline_mq_data *dd, int ddir)
+{
+	struct request *rq = rq_entry_fifo(dd->fifo_list[ddir].next);
+
+	return time_after_eq(jiffies, rq->fifo_time);
+}
+
+/*
+ * select the best request according to read/write expire, fifo_batch, etc
+ */
+static struct request *__deadline_mq_dispatch(struct deadline_mq_data *dd)
+{
+	const int reads = !list_empty(&dd->fifo_list[READ]);
+	const int writes = !list_empty(&dd->fifo_list[WRITE]);
+	struct request *rq;
+	int data_dir;
+
+	/*
+	 * batches are currently reads XOR writes
+	 */
+	if (dd->next_rq[WRITE])
+		rq = dd->next_rq[WRITE];
+	else
+		rq = dd->next_rq[READ];
+
+	if (rq && dd->batching < fifo_batch)
+		/* we have a next request are still entitled to batch */
+		goto dispatch_request;
+
+	/*
+	 * at this point we are not running a batch. select the appropriate
+	 * data direction (read / write)
+	 */
+	if (reads) {
+		BUG_ON(RB_EMPTY_ROOT(&dd->sort_list[READ]));
+
+		if (writes && (dd->starved++ >= writes_starved))
+			goto dispatch_writes;
+
+		data_dir = READ;
+		goto dispatch_find_request;
+	}
+
+	/*
+	 * there are either no reads or writes have been starved
+	 */
+	if (writes) {
+dispatch_writes:
+		BUG_ON(RB_EMPTY_ROOT(&dd->sort_list[WRITE]));
+
+		dd->starved = 0;
+		data_dir = WRITE;
+		goto dispatch_find_request;
+	}
+
+	return NULL;
+
+dispatch_find_request:
+	/*
+	 * we are not running a batch, find best request for selected data_dir
+	 */
+	if (deadline_mq_check_fifo(dd, data_dir) || !dd->next_rq[data_dir])
+		rq = rq_entry_fifo(dd->fifo_list[data_dir].next);
+	else
+		rq = dd->next_rq[data_dir];
+
+	dd->batching = 0;
+
+dispatch_request:
+	dd->batching++;
+	deadline_mq_remove_request(dd, rq);
+	return rq;
+}
+
+static void deadline_mq_insert_requests(struct blk_mq_hw_ctx *hctx,
+					struct list_head *list)
+{
+	struct deadline_mq_data *dd = hctx->sched_data;
+	struct request *rq;
+
+	spin_lock(&dd->lock);
+	while (!list_empty(list)) {
+		rq = list_first_entry(list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+		deadline_mq_add_request(dd, rq);
+	}
+	spin_unlock(&dd->lock);
+}
+
+static struct request *deadline_mq_dispatch_request(struct blk_mq_hw_ctx *hctx)
+{
+	struct deadline_mq_data *dd = hctx->sched_data;
+	struct request *rq;
+
+	spin_lock(&dd->lock);
+	rq = __deadline_mq_dispatch(dd);
+	spin_unlock(&dd->lock);
+
+	return rq;
+}
+
+static bool deadline_mq_has_work(struct blk_mq_hw_ctx *hctx)
+{
+	struct deadline_mq_data *dd = hctx->sched_data;
+
+	return !list_empty_careful(&dd->fifo_list[READ]) ||
+		!list_empty_careful(&dd->fifo_list[WRITE]);
+}
+
+static int deadline_mq_init_hctx(struct blk_mq_hw_ctx *hctx)
+{
+	struct deadline_mq_data *dd;
+
+	dd = kzalloc_node(sizeof(*dd), GFP_KERNEL, hctx->numa_node);
+	if (!dd)
+		return -ENOMEM;
+
+	spin_lock_init(&dd->lock);
+	INIT_LIST_HEAD(&dd->fifo_list[READ]);
+	INIT_LIST_HEAD(&dd->fifo_list[WRITE]);
+	dd->sort_list[READ] = RB_ROOT;
+	dd->sort_list[WRITE] = RB_ROOT;
+
+	hctx->sched_data = dd;
+	return 0;
+}
+
+static void deadline_mq_exit_hctx(struct blk_mq_hw_ctx *hctx)
+{
+	struct deadline_mq_data *dd = hctx->sched_data;
+
+	BUG_ON(!list_empty(&dd->fifo_list[READ]));
+	BUG_ON(!list_empty(&dd->fifo_list[WRITE]));
+
+	kfree(dd);
+}
+
+static struct blk_mq_sched_type mqsched_deadline = {
+	.ops = {
+		.init_hctx		= deadline_mq_init_hctx,
+		.exit_hctx		= deadline_mq_exit_hctx,
+		.insert_requests	= deadline_mq_insert_requests,
+		.dispatch_request	= deadline_mq_dispatch_request,
+		.has_work		= deadline_mq_has_work,
+	},
+	.name	= "deadline",
+	.owner	= THIS_MODULE,
+};
+
+static int __init deadline_mq_init(void)
+{
+	return blk_mq_sched_register(&mqsched_deadline);
+}
+
+static void __exit deadline_mq_exit(void)
+{
+	blk_mq_sched_unregister(&mqsched_deadline);
+}
+
+module_init(deadline_mq_init);
+module_exit(deadline_mq_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("deadline blk-mq scheduler");
@@ -28,6 +28,8 @@
 #include <linux/module.h>
 #include <linux/mm.h>
 #include <linux/dma-mapping.h>
+#include <linux/completion.h>
+#include <linux/sched.h>
 #include <linux/async_tx.h>
 
 /**
@@ -105,6 +107,70 @@ async_memcpy(struct page *dest, struct page *src, unsigned int dest_offset,
 }
 EXPORT_SYMBOL_GPL(async_memcpy);
 
+static unsigned int copy_offload_threshold = 16 * PAGE_SIZE;
+module_param(copy_offload_threshold, uint, 0644);
+MODULE_PARM_DESC(copy_offload_threshold,
+		 "smallest async_copy_pages() run, in bytes, sent to a dma engine");
+
+static void async_copy_pages_done(void *param)
+{
+	complete(param);
+}
+
+/**
+ * async_copy_pages - copy whole pages, offloading large runs to a dma engine
+ * @dest: array of destination pages
+ * @src: array of source pages
+ * @nr_pages: number of entries in @dest and @src
+ *
+ * Copies the contents of each @src page to the matching @dest page and
+ * returns once all of them are copied.  Runs of at least
+ * copy_offload_threshold bytes are submitted to a memcpy channel as one
+ * dependency chain, and the caller sleeps until it completes;
+ * async_memcpy() falls back to the cpu for any page the channel cannot
+ * take.  Smaller runs are copied with copy_highpage(), as the setup and
+ * completion of a dma transfer cost more than they save.
+ *
+ * Must be called from process context.
+ */
+void async_copy_pages(struct page **dest, struct page **src,
+		      unsigned int nr_pages)
+{
+	struct dma_async_tx_descriptor *tx = NULL;
+	struct async_submit_ctl submit;
+	struct completion done;
+	struct dma_chan *chan;
+	unsigned int i;
+
+	might_sleep();
+
+	init_async_submit(&submit, 0, NULL, NULL, NULL, NULL);
+	chan = async_tx_find_channel(&submit, DMA_MEMCPY, dest, nr_pages,
+				     src, nr_pages, PAGE_SIZE);
+	if (!chan || !nr_pages ||
+	    (size_t)nr_pages * PAGE_SIZE < copy_offload_threshold) {
+		for (i = 0; i < nr_pages; i++) {
+			copy_highpage(dest[i], src[i]);
+			cond_resched();
+		}
+		return;
+	}
+
+	init_completion(&done);
+	for (i = 0; i < nr_pages; i++) {
+		if (i == nr_pages - 1)
+			init_async_submit(&submit, ASYNC_TX_ACK, tx,
+					  async_copy_pages_done, &done, NULL);
+		else
+			init_async_submit(&submit, 0, tx, NULL, NULL, NULL);
+		tx = async_memcpy(dest[i], src[i], 0, 0, PAGE_SIZE, &submit);
+	}
+	async_tx_issue_pending(tx);
+
+	wait_for_completion(&done);
+}
+EXPORT_SYMBOL_GPL(async_copy_pages);
+
 MODULE_AUTHOR("Intel Corporation");
 MODULE_DESCRIPTION("asynchronous memcpy api");
 MODULE_LICENSE("GPL");
@@ -0,0 +1,348 @@
+/*
+ * Handle async block requests by crypto hardware engine.
+ *
+ * Requests queued on an engine are handed to the driver in batches of
+ * consecutive requests for the same transform, so that the hardware key
+ * context can be reused and the doorbell rung once per batch rather than
+ * once per request. The number of requests owned by the hardware is
+ * bounded; beyond that requests wait in the engine queue, and once that
+ * is full too the usual -EBUSY/backlog semantics of crypto_queue push
+ * back on the submitters.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+#include <linux/delay.h>
+#include <linux/err.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <crypto/engine.h>
+
+#define CRYPTO_ENGINE_STOP_RETRIES	100
+
+static void crypto_engine_kick(struct crypto_engine *engine)
+{
+	queue_kthread_work(&engine->kworker, &engine->pump_requests);
+}
+
+/*
+ * Collect a batch of requests for the same transform off the queue and
+ * hand it to the hardware. Runs in the engine kthread only, so batches
+ * are submitted in queue order.
+ */
+static void crypto_pump_requests(struct kthread_work *work)
+{
+	struct crypto_engine *engine =
+		container_of(work, struct crypto_engine, pump_requests);
+	struct crypto_async_request *req, *backlog;
+	struct crypto_tfm *tfm = NULL;
+	unsigned long flags;
+	unsigned int n = 0;
+	bool more = false;
+	LIST_HEAD(batch);
+	int err;
+
+	for (;;) {
+		spin_lock_irqsave(&engine->queue_lock, flags);
+		if (!engine->queue.qlen)
+			break;
+		if (n == engine->max_batch ||
+		    engine->inflight >= engine->max_inflight) {
+			more = engine->inflight < engine->max_inflight;
+			break;
+		}
+		req = list_first_entry(&engine->queue.list,
+				       struct crypto_async_request, list);
+		if (tfm && req->tfm != tfm) {
+			more = true;
+			break;
+		}
+		tfm = req->tfm;
+
+		backlog = crypto_get_backlog(&engine->queue);
+		crypto_dequeue_request(&engine->queue);
+		engine->inflight++;
+		spin_unlock_irqrestore(&engine->queue_lock, flags);
+
+		list_add_tail(&req->list, &batch);
+		n++;
+
+		if (backlog)
+			backlog->complete(backlog, -EINPROGRESS);
+	}
+	spin_unlock_irqrestore(&engine->queue_lock, flags);
+
+	if (!n)
+		return;
+
+	err = engine->ops->do_batch(engine, &batch, n);
+	if (err) {
+		pr_err("%s: failed to submit %u requests: %d\n",
+		       engine->name, n, err);
+		crypto_finalize_batch(engine, &batch, err);
+	}
+
+	if (more)
+		crypto_engine_kick(engine);
+}
+
+/**
+ * crypto_engine_enqueue - queue a request on an engine
+ * @engine: the engine
+ * @req: the request
+ *
+ * Returns -EINPROGRESS if the request was queued, -EBUSY if the queue is
+ * full (the request is then only queued if it may be backlogged, and its
+ * completion is called with -EINPROGRESS once it leaves the backlog) and
+ * -ESHUTDOWN if the engine is stopped.
+ */
+int crypto_engine_enqueue(struct crypto_engine *engine,
+			  struct crypto_async_request *req)
+{
+	unsigned long flags;
+	int err;
+
+	spin_lock_irqsave(&engine->queue_lock, flags);
+	if (engine->running)
+		err = crypto_enqueue_request(&engine->queue, req);
+	else
+		err = -ESHUTDOWN;
+	spin_unlock_irqrestore(&engine->queue_lock, flags);
+
+	if (err != -ESHUTDOWN)
+		crypto_engine_kick(engine);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(crypto_engine_enqueue);
+
+/**
+ * crypto_engine_enqueue_list - queue a list of requests on an engine
+ * @engine: the engine
+ * @reqs: requests linked through their &crypto_async_request.list
+ *
+ * Queues the requests in order under a single lock round trip and wakes
+ * the engine once. Queueing stops at the first request that is refused
+ * because the queue is full and may not be backlogged; it and the ones
+ * after it are left on @reqs. Returns -EINPROGRESS if all requests were
+ * queued, -EBUSY if any was backlogged or refused and -ESHUTDOWN if the
+ * engine is stopped.
+ */
+int crypto_engine_enqueue_list(struct crypto_engine *engine,
+			       struct list_head *reqs)
+{
+	struct crypto_async_request *req, *tmp;
+	unsigned long flags;
+	int err = -EINPROGRESS;
+
+	spin_lock_irqsave(&engine->queue_lock, flags);
+	if (!engine->running) {
+		spin_unlock_irqrestore(&engine->queue_lock, flags);
+		return -ESHUTDOWN;
+	}
+
+	list_for_each_entry_safe(req, tmp, reqs, list) {
+		list_del(&req->list);
+		if (crypto_enqueue_request(&engine->queue, req) == -EINPROGRESS)
+			continue;
+
+		err = -EBUSY;
+		if (!(req->flags & CRYPTO_TFM_REQ_MAY_BACKLOG)) {
+			list_add(&req->list, reqs);
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&engine->queue_lock, flags);
+
+	crypto_engine_kick(engine);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(crypto_engine_enqueue_list);
+
+static void crypto_engine_complete(struct crypto_engine *engine,
+				   unsigned int n)
+{
+	unsigned long flags;
+	bool kick;
+
+	spin_lock_irqsave(&engine->queue_lock, flags);
+	engine->inflight -= n;
+	kick = engine->queue.qlen;
+	spin_unlock_irqrestore(&engine->queue_lock, flags);
+
+	if (kick)
+		crypto_engine_kick(engine);
+}
+
+/**
+ * crypto_finalize_request - complete a request handed to the hardware
+ * @engine: the engine the request was queued on
+ * @req: the request
+ * @err: the result of the request
+ *
+ * May be called from any context the request's completion tolerates.
+ */
+void crypto_finalize_request(struct crypto_engine *engine,
+			     struct crypto_async_request *req, int err)
+{
+	crypto_engine_complete(engine, 1);
+	req->complete(req, err);
+}
+EXPORT_SYMBOL_GPL(crypto_finalize_request);
+
+/**
+ * crypto_finalize_batch - complete a list of requests handed to the hardware
+ * @engine: the engine the requests were queued on
+ * @reqs: requests linked through their &crypto_async_request.list
+ * @err: the result of the requests
+ *
+ * Like crypto_finalize_request() for each request, but accounts for the
+ * whole batch at once; meant for hardware signalling the completion of
+ * several requests with one interrupt.
+ */
+void crypto_finalize_batch(struct crypto_engine *engine,
+			   struct list_head *reqs, int err)
+{
+	struct crypto_async_request *req, *tmp;
+	unsigned int n = 0;
+
+	list_for_each_entry(req, reqs, list)
+		n++;
+
+	crypto_engine_complete(engine, n);
+
+	list_for_each_entry_safe(req, tmp, reqs, list) {
+		list_del(&req->list);
+		req->complete(req, err);
+	}
+}
+EXPORT_SYMBOL_GPL(crypto_finalize_batch);
+
+/**
+ * crypto_engine_start - start accepting requests
+ * @engine: the engine
+ */
+int crypto_engine_start(struct crypto_engine *engine)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&engine->queue_lock, flags);
+	if (engine->running) {
+		spin_unlock_irqrestore(&engine->queue_lock, flags);
+		return -EBUSY;
+	}
+	engine->running = true;
+	spin_unlock_irqrestore(&engine->queue_lock, flags);
+
+	crypto_engine_kick(engine);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(crypto_engine_start);
+
+/**
+ * crypto_engine_stop - stop accepting requests and drain the engine
+ * @engine: the engine
+ *
+ * Waits for the queued and in-flight requests to complete. Returns -EBUSY
+ * and leaves the engine running if they do not within about a second.
+ */
+int crypto_engine_stop(struct crypto_engine *engine)
+{
+	unsigned int limit = CRYPTO_ENGINE_STOP_RETRIES;
+	unsigned long flags;
+	bool busy;
+
+	spin_lock_irqsave(&engine->queue_lock, flags);
+	engine->running = false;
+
+	for (;;) {
+		busy = engine->queue.qlen || engine->inflight;
+		if (!busy || !limit--)
+			break;
+		spin_unlock_irqrestore(&engine->queue_lock, flags);
+		msleep(10);
+		spin_lock_irqsave(&engine->queue_lock, flags);
+	}
+
+	if (busy)
+		engine->running = true;
+	spin_unlock_irqrestore(&engine->queue_lock, flags);
+
+	if (busy) {
+		pr_warn("%s: could not stop engine\n", engine->name);
+		return -EBUSY;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(crypto_engine_stop);
+
+/**
+ * crypto_engine_alloc_init - allocate a crypto engine and its kthread
+ * @name: name of the kthread
+ * @ops: hardware hooks
+ * @qlen: length of the queue in front of the hardware
+ * @max_inflight: maximum number of requests owned by the hardware
+ * @max_batch: maximum number of requests passed to one @ops->do_batch()
+ *
+ * The engine is created stopped. Returns NULL on failure.
+ */
+struct crypto_engine *crypto_engine_alloc_init(const char *name,
+					const struct crypto_engine_ops *ops,
+					unsigned int qlen,
+					unsigned int max_inflight,
+					unsigned int max_batch)
+{
+	struct crypto_engine *engine;
+
+	if (!ops->do_batch || !max_inflight || !max_batch)
+		return NULL;
+
+	engine = kzalloc(sizeof(*engine), GFP_KERNEL);
+	if (!engine)
+		return NULL;
+
+	engine->name = name;
+	engine->ops = ops;
+	engine->max_inflight = max_inflight;
+	engine->max_batch = max_batch;
+	spin_lock_init(&engine->queue_lock);
+	crypto_init_queue(&engine->queue, qlen);
+
+	init_kthread_worker(&engine->kworker);
+	init_kthread_work(&engine->pump_requests, crypto_pump_requests);
+	engine->kworker_task = kthread_run(kthread_worker_fn, &engine->kworker,
+					   "%s", name);
+	if (IS_ERR(engine->kworker_task)) {
+		kfree(engine);
+		return NULL;
+	}
+
+	return engine;
+}
+EXPORT_SYMBOL_GPL(crypto_engine_alloc_init);
+
+/**
+ * crypto_engine_exit - stop and free a crypto engine
+ * @engine: the engine
+ */
+void crypto_engine_exit(struct crypto_engine *engine)
+{
+	crypto_engine_stop(engine);
+
+	flush_kthread_worker(&engine->kworker);
+	kthread_stop(engine->kworker_task);
+
+	kfree(engine);
+}
+EXPORT_SYMBOL_GPL(crypto_engine_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Crypto hardware engine framework");
@@ -362,6 +362,9 @@ int driver_probe_done(void)
 	return 0;
 }
 
+/* Asynchronous probes of drivers with async_probe set */
+static ASYNC_DOMAIN(probe_domain);
+
 /**
  * wait_for_device_probe
  * Wait for device probing to be completed.
@@ -453,6 +456,56 @@ out_unlock:
 }
 EXPORT_SYMBOL_GPL(device_attach);
 
+static void __driver_attach_async(void *data, async_cookie_t cookie)
+{
+	struct device *dev = data;
+	struct device_driver *drv;
+
+	if (dev->parent)	/* Needed for USB */
+		device_lock(dev->parent);
+	device_lock(dev);
+	drv = dev->p->async_driver;
+	dev->p->async_driver = NULL;
+	if (!dev->driver)
+		driver_probe_device(drv, dev);
+	device_unlock(dev);
+	if (dev->parent)
+		device_unlock(dev->parent);
+
+	atomic_dec(&probe_count);
+	wake_up(&probe_waitqueue);
+	put_device(dev);
+}
+
+/*
+ * Hand the probe of @dev over to an async thread.  Returns false if a
+ * probe is already pending for another driver, then the caller probes
+ * synchronously.
+ *
+ * Probing under the parent lock keeps the probes of a parent and its
+ * children ordered, and -EPROBE_DEFER still sorts out the others.
+ * driver_detach() waits for the pending probes before unbinding.
+ */
+static bool driver_probe_device_async(struct device_driver *drv,
+				      struct device *dev)
+{
+	bool scheduled = false;
+
+	device_lock(dev);
+	if (!dev->driver && !dev->p->async_driver) {
+		dev->p->async_driver = drv;
+		/* keep wait_for_device_probe() and driver_probe_done() honest */
+		atomic_inc(&probe_count);
+		get_device(dev);
+		async_schedule_domain(__driver_attach_async, dev,
+				      &probe_domain);
+		scheduled = true;
+	}
+	device_unlock(dev);
+
+	return scheduled;
+}
+
 static int __driver_attach(struct device *dev, void *data)
 {
 	struct device_driver *drv = data;
@@ -470,6 +523,9 @@ static int __driver_attach(struct device *dev, void *data)
 	if (!driver_match_device(drv, dev))
 		return 0;
 
+	if (drv->async_probe && driver_probe_device_async(drv, dev))
+		return 0;
+
 	if (dev->parent)	/* Needed for USB */
 		device_lock(dev->parent);
 	device_lock(dev);
@@ -490,6 +546,9 @@ static int __driver_attach(struct device *dev, void *data)
  * match the driver with each one.  If driver_probe_device()
  * returns 0 and the @dev->driver is set, we've found a
  * compatible pair.
+ *
+ * If @drv->async_probe is set the devices are probed asynchronously,
+ * use wait_for_device_probe() to wait for them.
  */
 int driver_attach(struct device_driver *drv)
 {
@@ -563,6 +622,9 @@ void driver_detach(struct device_driver *drv)
 	struct device_private *dev_prv;
 	struct device *dev;
 
+	if (drv->async_probe)
+		async_synchronize_full_domain(&probe_domain);
+
 	for (;;) {
 		spin_lock(&drv->p->klist_devices.k_lock);
 		if (list_empty(&drv->p->klist_devices.k_list)) {
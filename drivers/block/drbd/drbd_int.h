@@ -92,6 +92,9 @@ extern char usermode_helper[];
  */
 #define DRBD_SIGKILL SIGHUP
 
+/* Number of P_WRITE_ACKs the asender packs into one P_WRITE_ACKS at most */
+#define DRBD_WRITE_ACKS_MAX 128
+
 #define ID_IN_SYNC      (4711ULL)
 #define ID_OUT_OF_SYNC  (4712ULL)
 #define ID_SYNCER (-1ULL)
@@ -609,6 +612,14 @@ struct drbd_connection {
 	struct drbd_socket data;	/* data/barrier/cstate/parameter packets */
 	struct drbd_socket meta;	/* ping/ack (metadata) packets */
 	int agreed_pro_version;		/* actually used protocol version */
+
+	/* P_WRITE_ACKs collected for one P_WRITE_ACKS, protected by meta.mutex */
+	struct {
+		int vnr;
+		u32 seq_num;
+		unsigned int count;
+		struct p_block_ack_entry acks[DRBD_WRITE_ACKS_MAX];
+	} write_acks;
 	unsigned long last_received;	/* in jiffies, either socket */
 	unsigned int ko_count;
 
@@ -897,6 +908,7 @@ extern void drbd_send_b_ack(struct drbd_connection *connection, u32 barrier_nr,
 			    u32 set_size);
 extern int drbd_send_ack(struct drbd_peer_device *, enum drbd_packet,
 			 struct drbd_peer_request *);
+extern int drbd_flush_write_acks(struct drbd_connection *);
 extern void drbd_send_ack_rp(struct drbd_peer_device *, enum drbd_packet,
 			     struct p_block_req *rp);
 extern void drbd_send_ack_dp(struct drbd_peer_device *, enum drbd_packet,
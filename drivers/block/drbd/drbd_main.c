@@ -622,11 +622,17 @@ static void *__conn_prepare_command(struct drbd_connection *connection,
 	return sock->sbuf + drbd_header_size(connection);
 }
 
+static int __drbd_flush_write_acks(struct drbd_connection *connection);
+
 void *conn_prepare_command(struct drbd_connection *connection, struct drbd_socket *sock)
 {
 	void *p;
 
 	mutex_lock(&sock->mutex);
+	/* Collected write acks go out before anything else on the meta socket,
+	 * in particular before the P_BARRIER_ACK of their epoch. */
+	if (sock == &connection->meta)
+		__drbd_flush_write_acks(connection);
 	p = __conn_prepare_command(connection, sock);
 	if (!p)
 		mutex_unlock(&sock->mutex);
@@ -665,6 +671,40 @@ static int __send_command(struct drbd_connection *connection, int vnr,
 	return err;
 }
 
+static int __drbd_flush_write_acks(struct drbd_connection *connection)
+{
+	struct drbd_socket *sock = &connection->meta;
+	unsigned int count = connection->write_acks.count;
+	struct p_block_acks *p;
+
+	if (!count)
+		return 0;
+	connection->write_acks.count = 0;
+
+	p = __conn_prepare_command(connection, sock);
+	if (!p)
+		return -EIO;
+	p->seq_num = cpu_to_be32(connection->write_acks.seq_num);
+	memcpy(p->acks, connection->write_acks.acks, count * sizeof(p->acks[0]));
+	return __send_command(connection, connection->write_acks.vnr, sock,
+			      P_WRITE_ACKS,
+			      sizeof(*p) + count * sizeof(p->acks[0]), NULL, 0);
+}
+
+/**
+ * drbd_flush_write_acks() - Sends the write acks collected so far
+ * @connection:	DRBD connection.
+ */
+int drbd_flush_write_acks(struct drbd_connection *connection)
+{
+	int err;
+
+	mutex_lock(&connection->meta.mutex);
+	err = __drbd_flush_write_acks(connection);
+	mutex_unlock(&connection->meta.mutex);
+	return err;
+}
+
 static int __conn_send_command(struct drbd_connection *connection, struct drbd_socket *sock,
 			       enum drbd_packet cmd, unsigned int header_size,
 			       void *data, unsigned int size)
@@ -1298,6 +1338,41 @@ void drbd_send_b_ack(struct drbd_connection *connection, u32 barrier_nr, u32 set
 	conn_send_command(connection, sock, P_BARRIER_ACK, sizeof(*p), NULL, 0);
 }
 
+static int drbd_queue_write_ack(struct drbd_peer_device *peer_device,
+				u64 sector, u32 blksize, u64 block_id)
+{
+	struct drbd_connection *connection = peer_device->connection;
+	struct drbd_socket *sock = &connection->meta;
+	struct p_block_ack_entry *e;
+	int err = 0;
+
+	mutex_lock(&sock->mutex);
+	if (!sock->socket) {
+		err = -EIO;
+		goto out;
+	}
+	if (connection->write_acks.count &&
+	    connection->write_acks.vnr != peer_device->device->vnr) {
+		err = __drbd_flush_write_acks(connection);
+		if (err)
+			goto out;
+	}
+
+	e = &connection->write_acks.acks[connection->write_acks.count++];
+	e->sector = sector;
+	e->block_id = block_id;
+	e->blksize = blksize;
+	connection->write_acks.vnr = peer_device->device->vnr;
+	connection->write_acks.seq_num =
+		atomic_inc_return(&peer_device->device->packet_seq);
+
+	if (connection->write_acks.count == DRBD_WRITE_ACKS_MAX)
+		err = __drbd_flush_write_acks(connection);
+out:
+	mutex_unlock(&sock->mutex);
+	return err;
+}
+
 /**
  * _drbd_send_ack() - Sends an ack packet
  * @device:	DRBD device.
@@ -1315,6 +1390,12 @@ static int _drbd_send_ack(struct drbd_peer_device *peer_device, enum drbd_packet
 	if (peer_device->device->state.conn < C_CONNECTED)
 		return -EIO;
 
+	/* Peers that know P_WRITE_ACKS get write acks in batches, these are
+	 * sent when the asender is done with its current round of completed
+	 * peer requests, or earlier if another meta packet goes out first. */
+	if (cmd == P_WRITE_ACK && peer_device->connection->agreed_pro_version >= 102)
+		return drbd_queue_write_ack(peer_device, sector, blksize, block_id);
+
 	sock = &peer_device->connection->meta;
 	p = drbd_prepare_command(peer_device, sock);
 	if (!p)
@@ -2972,6 +3053,7 @@ void drbd_free_sock(struct drbd_connection *connection)
 		kernel_sock_shutdown(connection->meta.socket, SHUT_RDWR);
 		sock_release(connection->meta.socket);
 		connection->meta.socket = NULL;
+		connection->write_acks.count = 0;
 		mutex_unlock(&connection->meta.mutex);
 	}
 }
@@ -3743,6 +3825,7 @@ const char *cmdname(enum drbd_packet cmd)
 		[P_CONN_ST_CHG_REPLY]	= "conn_st_chg_reply",
 		[P_RETRY_WRITE]		= "retry_write",
 		[P_PROTOCOL_UPDATE]	= "protocol_update",
+		[P_WRITE_ACKS]		= "WriteAcks",
 
 		/* enum drbd_packet, but not commands - obsoleted flags:
 		 *	P_MAY_IGNORE
@@ -54,6 +54,7 @@ enum drbd_packet {
 	P_CONN_ST_CHG_REPLY   = 0x2b, /* meta sock: Connection side state req reply */
 	P_RETRY_WRITE	      = 0x2c, /* Protocol C: retry conflicting write request */
 	P_PROTOCOL_UPDATE     = 0x2d, /* data sock: is used in established connections */
+	P_WRITE_ACKS	      = 0x2e, /* meta sock: several P_WRITE_ACKs, protocol 102 */
 
 	P_MAY_IGNORE	      = 0x100, /* Flag to test if (cmd > P_MAY_IGNORE) ... */
 	P_MAX_OPT_CMD	      = 0x101,
@@ -134,6 +135,22 @@ struct p_block_ack {
 	u32	    seq_num;
 } __packed;
 
+/*
+ * P_WRITE_ACKS: the entries of a run of P_WRITE_ACKs for one volume,
+ * with the sequence number of the last of them.  The number of entries
+ * follows from the packet size.
+ */
+struct p_block_ack_entry {
+	u64	    sector;
+	u64	    block_id;
+	u32	    blksize;
+} __packed;
+
+struct p_block_acks {
+	u32	    seq_num;
+	struct p_block_ack_entry acks[0];
+} __packed;
+
 struct p_block_req {
 	u64 sector;
 	u64 block_id;
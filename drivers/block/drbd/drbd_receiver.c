@@ -5066,6 +5066,36 @@ static int got_BlockAck(struct drbd_connection *connection, struct packet_info *
 					     what, false);
 }
 
+static int got_BlockAcks(struct drbd_connection *connection, struct packet_info *pi)
+{
+	struct drbd_peer_device *peer_device;
+	struct drbd_device *device;
+	struct p_block_acks *p = pi->data;
+	unsigned int payload = pi->size - sizeof(*p);
+	unsigned int i;
+	int err;
+
+	if (payload % sizeof(p->acks[0]))
+		return -EIO;
+
+	peer_device = conn_peer_device(connection, pi->vnr);
+	if (!peer_device)
+		return -EIO;
+	device = peer_device->device;
+
+	update_peer_seq(peer_device, be32_to_cpu(p->seq_num));
+
+	for (i = 0; i < payload / sizeof(p->acks[0]); i++) {
+		err = validate_req_change_req_state(device, p->acks[i].block_id,
+						    be64_to_cpu(p->acks[i].sector),
+						    &device->write_requests, __func__,
+						    WRITE_ACKED_BY_PEER, false);
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
 static int got_NegAck(struct drbd_connection *connection, struct packet_info *pi)
 {
 	struct drbd_peer_device *peer_device;
@@ -5275,12 +5305,13 @@ static int connection_finish_peer_reqs(struct drbd_connection *connection)
 		rcu_read_unlock();
 	} while (not_empty);
 
-	return 0;
+	return drbd_flush_write_acks(connection) ? 1 : 0;
 }
 
 struct asender_cmd {
 	size_t pkt_size;
 	int (*fn)(struct drbd_connection *connection, struct packet_info *);
+	bool variable_size;	/* pkt_size is the minimum, up to a full rbuf */
 };
 
 static struct asender_cmd asender_tbl[] = {
@@ -5301,6 +5332,7 @@ static struct asender_cmd asender_tbl[] = {
 	[P_RS_CANCEL]       = { sizeof(struct p_block_ack), got_NegRSDReply },
 	[P_CONN_ST_CHG_REPLY]={ sizeof(struct p_req_state_reply), got_conn_RqSReply },
 	[P_RETRY_WRITE]	    = { sizeof(struct p_block_ack), got_BlockAck },
+	[P_WRITE_ACKS]	    = { sizeof(struct p_block_acks), got_BlockAcks, true },
 };
 
 int drbd_asender(struct drbd_thread *thi)
@@ -5419,6 +5451,9 @@ int drbd_asender(struct drbd_thread *thi)
 				goto disconnect;
 			}
 			expect = header_size + cmd->pkt_size;
+			if (cmd->variable_size && pi.size >= cmd->pkt_size &&
+			    pi.size <= DRBD_SOCKET_BUFFER_SIZE - header_size)
+				expect = header_size + pi.size;
 			if (pi.size != expect - header_size) {
 				drbd_err(connection, "Wrong packet size on meta (c: %d, l: %d)\n",
 					pi.cmd, pi.size);
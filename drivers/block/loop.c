@@ -84,6 +84,9 @@ static DEFINE_MUTEX(loop_index_mutex);
 
 static int max_part;
 static int part_shift;
+static int workers;
+static bool direct_io;
+static struct bio_set *loop_bio_set;
 
 /*
  * Transfer functions
@@ -484,6 +487,57 @@ static struct bio *loop_get_bio(struct loop_device *lo)
 	return bio_list_pop(&lo->lo_bio_list);
 }
 
+/*
+ * A block device backed loop without a transfer function is only an
+ * offset remap, so the bio can be handed to the backing device as is
+ * instead of being copied through its page cache by a worker.
+ */
+static inline bool loop_can_remap(struct loop_device *lo, struct bio *bio)
+{
+	return (lo->lo_flags & LO_FLAGS_DIRECT_IO) &&
+		lo->transfer == transfer_none &&
+		!(lo->lo_offset & 511) && bio->bi_bdev;
+}
+
+static void loop_remap_done(struct loop_device *lo)
+{
+	if (atomic_dec_and_test(&lo->lo_direct_pending))
+		wake_up(&lo->lo_event);
+}
+
+static void loop_remap_end_io(struct bio *clone, int error)
+{
+	struct bio *bio = clone->bi_private;
+	struct loop_device *lo = bio->bi_bdev->bd_disk->private_data;
+
+	bio_put(clone);
+	bio_endio(bio, error);
+	loop_remap_done(lo);
+}
+
+/*
+ * Called with lo_direct_pending elevated, which keeps the backing file
+ * (and so the backing block device) around until the clone completes.
+ */
+static void loop_remap_bio(struct loop_device *lo, struct bio *bio)
+{
+	struct bio *clone;
+
+	clone = bio_clone_fast(bio, GFP_NOIO, loop_bio_set);
+	if (!clone) {
+		bio_endio(bio, -ENOMEM);
+		loop_remap_done(lo);
+		return;
+	}
+
+	clone->bi_bdev = I_BDEV(lo->lo_backing_file->f_mapping->host);
+	clone->bi_iter.bi_sector += lo->lo_offset >> 9;
+	clone->bi_end_io = loop_remap_end_io;
+	clone->bi_private = bio;
+
+	generic_make_request(clone);
+}
+
 static void loop_make_request(struct request_queue *q, struct bio *old_bio)
 {
 	struct loop_device *lo = q->queuedata;
@@ -499,6 +553,12 @@ static void loop_make_request(struct request_queue *q, struct bio *old_bio)
 		goto out;
 	if (unlikely(rw == WRITE && (lo->lo_flags & LO_FLAGS_READ_ONLY)))
 		goto out;
+	if (loop_can_remap(lo, old_bio)) {
+		atomic_inc(&lo->lo_direct_pending);
+		spin_unlock_irq(&lo->lo_lock);
+		loop_remap_bio(lo, old_bio);
+		return;
+	}
 	if (lo->lo_bio_count >= q->nr_congestion_on)
 		wait_event_lock_irq(lo->lo_req_wait,
 				    lo->lo_bio_count < q->nr_congestion_off,
@@ -523,8 +583,17 @@ static void do_loop_switch(struct loop_device *, struct switch_request *);
 static inline void loop_handle_bio(struct loop_device *lo, struct bio *bio)
 {
 	if (unlikely(!bio->bi_bdev)) {
+		/*
+		 * Everything queued before the switch has to be done
+		 * before the backing file is changed.
+		 */
+		wait_event(lo->lo_event, ACCESS_ONCE(lo->lo_bio_active) == 1);
 		do_loop_switch(lo, bio->bi_private);
 		bio_put(bio);
+
+		spin_lock_irq(&lo->lo_lock);
+		lo->lo_switching = false;
+		spin_unlock_irq(&lo->lo_lock);
 	} else {
 		int ret = do_bio_filebacked(lo, bio);
 		bio_endio(bio, ret);
@@ -532,45 +601,124 @@ static inline void loop_handle_bio(struct loop_device *lo, struct bio *bio)
 }
 
 /*
- * worker thread that handles reads/writes to file backed loop devices,
- * to avoid blocking in our make_request_fn. it also does loop decrypting
+ * The transfer functions keep per device state (cryptoloop shares one
+ * cipher), so only the first worker serves a device that has one set.
+ */
+static inline bool loop_worker_has_work(struct loop_worker *w)
+{
+	struct loop_device *lo = w->lo;
+
+	if (bio_list_empty(&lo->lo_bio_list) || lo->lo_switching)
+		return false;
+
+	return !w->index || lo->transfer == transfer_none;
+}
+
+/*
+ * worker threads that handle reads/writes to file backed loop devices,
+ * to avoid blocking in our make_request_fn. they also do loop decrypting
  * on reads for block backed loop, as that is too heavy to do from
  * b_end_io context where irqs may be disabled.
  *
  * Loop explanation:  loop_clr_fd() sets lo_state to Lo_rundown before
- * calling kthread_stop().  Therefore once kthread_should_stop() is
- * true, make_request will not place any more requests.  Therefore
- * once kthread_should_stop() is true and lo_bio is NULL, we are
- * done with the loop.
+ * calling kthread_stop() on each worker, the first one last.  Therefore
+ * once kthread_should_stop() is true, make_request will not place any
+ * more requests, and once the first worker sees kthread_should_stop()
+ * with lo_bio_list empty, we are done with the loop.
  */
 static int loop_thread(void *data)
 {
-	struct loop_device *lo = data;
+	struct loop_worker *w = data;
+	struct loop_device *lo = w->lo;
 	struct bio *bio;
 
 	set_user_nice(current, -20);
 
-	while (!kthread_should_stop() || !bio_list_empty(&lo->lo_bio_list)) {
+	while (!kthread_should_stop() || loop_worker_has_work(w)) {
 
 		wait_event_interruptible(lo->lo_event,
-				!bio_list_empty(&lo->lo_bio_list) ||
+				loop_worker_has_work(w) ||
 				kthread_should_stop());
 
-		if (bio_list_empty(&lo->lo_bio_list))
-			continue;
 		spin_lock_irq(&lo->lo_lock);
+		if (!loop_worker_has_work(w)) {
+			spin_unlock_irq(&lo->lo_lock);
+			continue;
+		}
 		bio = loop_get_bio(lo);
+		if (unlikely(!bio->bi_bdev))
+			lo->lo_switching = true;
+		lo->lo_bio_active++;
 		if (lo->lo_bio_count < lo->lo_queue->nr_congestion_off)
 			wake_up(&lo->lo_req_wait);
 		spin_unlock_irq(&lo->lo_lock);
 
-		BUG_ON(!bio);
 		loop_handle_bio(lo, bio);
+
+		spin_lock_irq(&lo->lo_lock);
+		lo->lo_bio_active--;
+		if (lo->lo_switching || !bio_list_empty(&lo->lo_bio_list))
+			wake_up(&lo->lo_event);
+		spin_unlock_irq(&lo->lo_lock);
 	}
 
 	return 0;
 }
 
+static int loop_start_workers(struct loop_device *lo)
+{
+	int i, nr = workers;
+
+	if (nr <= 0)
+		nr = num_online_cpus();
+	nr = min(nr, LOOP_MAX_WORKERS);
+
+	for (i = 0; i < nr; i++) {
+		struct loop_worker *w = &lo->lo_workers[i];
+
+		w->lo = lo;
+		w->index = i;
+		if (i)
+			w->task = kthread_create(loop_thread, w, "loop%d/%d",
+						 lo->lo_number, i);
+		else
+			w->task = kthread_create(loop_thread, w, "loop%d",
+						 lo->lo_number);
+		if (IS_ERR(w->task)) {
+			int error = PTR_ERR(w->task);
+
+			w->task = NULL;
+			while (--i >= 0) {
+				kthread_stop(lo->lo_workers[i].task);
+				lo->lo_workers[i].task = NULL;
+			}
+			return error;
+		}
+	}
+	lo->lo_nr_workers = nr;
+	return 0;
+}
+
+static void loop_wake_workers(struct loop_device *lo)
+{
+	int i;
+
+	for (i = 0; i < lo->lo_nr_workers; i++)
+		wake_up_process(lo->lo_workers[i].task);
+}
+
+static void loop_stop_workers(struct loop_device *lo)
+{
+	int i;
+
+	/* the first worker goes last, it drains what the others may not */
+	for (i = lo->lo_nr_workers - 1; i >= 0; i--) {
+		kthread_stop(lo->lo_workers[i].task);
+		lo->lo_workers[i].task = NULL;
+	}
+	lo->lo_nr_workers = 0;
+}
+
 /*
  * loop_switch performs the hard work of switching a backing store.
  * First it needs to flush existing IO, it does this by sending a magic
@@ -597,9 +745,10 @@ static int loop_switch(struct loop_device *lo, struct file *file)
 static int loop_flush(struct loop_device *lo)
 {
 	/* loop not yet configured, no running thread, nothing to flush */
-	if (!lo->lo_thread)
+	if (!lo->lo_nr_workers)
 		return 0;
 
+	wait_event(lo->lo_event, !atomic_read(&lo->lo_direct_pending));
 	return loop_switch(lo, NULL);
 }
 
@@ -669,11 +818,24 @@ static int loop_change_fd(struct loop_device *lo, struct block_device *bdev,
 	if (get_loop_size(lo, file) != get_loop_size(lo, old_file))
 		goto out_putf;
 
+	/* bios remapped to the old backing device must finish first */
+	spin_lock_irq(&lo->lo_lock);
+	lo->lo_flags &= ~LO_FLAGS_DIRECT_IO;
+	spin_unlock_irq(&lo->lo_lock);
+	wait_event(lo->lo_event, !atomic_read(&lo->lo_direct_pending));
+
 	/* and ... switch */
 	error = loop_switch(lo, file);
 	if (error)
 		goto out_putf;
 
+	if (direct_io && S_ISBLK(inode->i_mode)) {
+		invalidate_inode_pages2(file->f_mapping);
+		spin_lock_irq(&lo->lo_lock);
+		lo->lo_flags |= LO_FLAGS_DIRECT_IO;
+		spin_unlock_irq(&lo->lo_lock);
+	}
+
 	fput(old_file);
 	if (lo->lo_flags & LO_FLAGS_PARTSCAN)
 		ioctl_by_bdev(bdev, BLKRRPART, 0);
@@ -759,11 +921,25 @@ static ssize_t loop_attr_partscan_show(struct loop_device *lo, char *buf)
 	return sprintf(buf, "%s\n", partscan ? "1" : "0");
 }
 
+static ssize_t loop_attr_direct_io_show(struct loop_device *lo, char *buf)
+{
+	int dio = (lo->lo_flags & LO_FLAGS_DIRECT_IO);
+
+	return sprintf(buf, "%s\n", dio ? "1" : "0");
+}
+
+static ssize_t loop_attr_workers_show(struct loop_device *lo, char *buf)
+{
+	return sprintf(buf, "%d\n", lo->lo_nr_workers);
+}
+
 LOOP_ATTR_RO(backing_file);
 LOOP_ATTR_RO(offset);
 LOOP_ATTR_RO(sizelimit);
 LOOP_ATTR_RO(autoclear);
 LOOP_ATTR_RO(partscan);
+LOOP_ATTR_RO(direct_io);
+LOOP_ATTR_RO(workers);
 
 static struct attribute *loop_attrs[] = {
 	&loop_attr_backing_file.attr,
@@ -771,6 +947,8 @@ static struct attribute *loop_attrs[] = {
 	&loop_attr_sizelimit.attr,
 	&loop_attr_autoclear.attr,
 	&loop_attr_partscan.attr,
+	&loop_attr_direct_io.attr,
+	&loop_attr_workers.attr,
 	NULL,
 };
 
@@ -890,11 +1068,23 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 	lo->ioctl = NULL;
 	lo->lo_sizelimit = 0;
 	lo->lo_bio_count = 0;
+	lo->lo_bio_active = 0;
+	lo->lo_switching = false;
 	lo->old_gfp_mask = mapping_gfp_mask(mapping);
 	mapping_set_gfp_mask(mapping, lo->old_gfp_mask & ~(__GFP_IO|__GFP_FS));
 
 	bio_list_init(&lo->lo_bio_list);
 
+	/*
+	 * Bios remapped to the backing device bypass its page cache, so
+	 * write back and drop what is cached there now, as O_DIRECT does.
+	 */
+	if (direct_io && S_ISBLK(inode->i_mode)) {
+		filemap_write_and_wait(mapping);
+		invalidate_inode_pages2(mapping);
+		lo->lo_flags |= LO_FLAGS_DIRECT_IO;
+	}
+
 	if (!(lo_flags & LO_FLAGS_READ_ONLY) && file->f_op->fsync)
 		blk_queue_flush(lo->lo_queue, REQ_FLUSH);
 
@@ -906,14 +1096,11 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 
 	set_blocksize(bdev, lo_blocksize);
 
-	lo->lo_thread = kthread_create(loop_thread, lo, "loop%d",
-						lo->lo_number);
-	if (IS_ERR(lo->lo_thread)) {
-		error = PTR_ERR(lo->lo_thread);
+	error = loop_start_workers(lo);
+	if (error)
 		goto out_clr;
-	}
 	lo->lo_state = Lo_bound;
-	wake_up_process(lo->lo_thread);
+	loop_wake_workers(lo);
 	if (part_shift)
 		lo->lo_flags |= LO_FLAGS_PARTSCAN;
 	if (lo->lo_flags & LO_FLAGS_PARTSCAN)
@@ -927,7 +1114,6 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 
 out_clr:
 	loop_sysfs_exit(lo);
-	lo->lo_thread = NULL;
 	lo->lo_device = NULL;
 	lo->lo_backing_file = NULL;
 	lo->lo_flags = 0;
@@ -1014,7 +1200,8 @@ static int loop_clr_fd(struct loop_device *lo)
 	lo->lo_state = Lo_rundown;
 	spin_unlock_irq(&lo->lo_lock);
 
-	kthread_stop(lo->lo_thread);
+	wait_event(lo->lo_event, !atomic_read(&lo->lo_direct_pending));
+	loop_stop_workers(lo);
 
 	spin_lock_irq(&lo->lo_lock);
 	lo->lo_backing_file = NULL;
@@ -1028,7 +1215,6 @@ static int loop_clr_fd(struct loop_device *lo)
 	lo->lo_offset = 0;
 	lo->lo_sizelimit = 0;
 	lo->lo_encrypt_key_size = 0;
-	lo->lo_thread = NULL;
 	memset(lo->lo_encrypt_key, 0, LO_KEY_SIZE);
 	memset(lo->lo_crypt_name, 0, LO_NAME_SIZE);
 	memset(lo->lo_file_name, 0, LO_NAME_SIZE);
@@ -1560,6 +1746,10 @@ module_param(max_loop, int, S_IRUGO);
 MODULE_PARM_DESC(max_loop, "Maximum number of loop devices");
 module_param(max_part, int, S_IRUGO);
 MODULE_PARM_DESC(max_part, "Maximum number of partitions per loop device");
+module_param(workers, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(workers, "Worker threads per bound loop device, 0 for one per online cpu (at most 8)");
+module_param(direct_io, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(direct_io, "Remap bios of block device backed loops to the backing device");
 MODULE_LICENSE("GPL");
 MODULE_ALIAS_BLOCKDEV_MAJOR(LOOP_MAJOR);
 
@@ -1664,7 +1854,7 @@ static int loop_add(struct loop_device **l, int i)
 	disk->flags |= GENHD_FL_EXT_DEVT;
 	mutex_init(&lo->lo_ctl_mutex);
 	lo->lo_number		= i;
-	lo->lo_thread		= NULL;
+	atomic_set(&lo->lo_direct_pending, 0);
 	init_waitqueue_head(&lo->lo_event);
 	init_waitqueue_head(&lo->lo_req_wait);
 	spin_lock_init(&lo->lo_lock);
@@ -1825,9 +2015,13 @@ static int __init loop_init(void)
 	struct loop_device *lo;
 	int err;
 
+	loop_bio_set = bioset_create(BIO_POOL_SIZE, 0);
+	if (!loop_bio_set)
+		return -ENOMEM;
+
 	err = misc_register(&loop_misc);
 	if (err < 0)
-		return err;
+		goto bioset_out;
 
 	part_shift = 0;
 	if (max_part > 0) {
@@ -1889,6 +2083,8 @@ static int __init loop_init(void)
 
 misc_out:
 	misc_deregister(&loop_misc);
+bioset_out:
+	bioset_free(loop_bio_set);
 	return err;
 }
 
@@ -1913,6 +2109,7 @@ static void __exit loop_exit(void)
 	unregister_blkdev(LOOP_MAJOR, "loop");
 
 	misc_deregister(&loop_misc);
+	bioset_free(loop_bio_set);
 }
 
 module_init(loop_init);
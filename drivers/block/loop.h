@@ -23,6 +23,15 @@ enum {
 };
 
 struct loop_func_table;
+struct loop_device;
+
+#define LOOP_MAX_WORKERS	8
+
+struct loop_worker {
+	struct loop_device	*lo;
+	struct task_struct	*task;
+	int			index;
+};
 
 struct loop_device {
 	int		lo_number;
@@ -54,9 +63,16 @@ struct loop_device {
 	spinlock_t		lo_lock;
 	struct bio_list		lo_bio_list;
 	unsigned int		lo_bio_count;
+	/* bios taken off lo_bio_list by a worker and not yet completed */
+	unsigned int		lo_bio_active;
+	/* a worker is waiting for the others to go idle to switch files */
+	bool			lo_switching;
+	/* bios remapped straight to the backing block device */
+	atomic_t		lo_direct_pending;
 	int			lo_state;
 	struct mutex		lo_ctl_mutex;
-	struct task_struct	*lo_thread;
+	int			lo_nr_workers;
+	struct loop_worker	lo_workers[LOOP_MAX_WORKERS];
 	wait_queue_head_t	lo_event;
 	/* wait queue for incoming requests */
 	wait_queue_head_t	lo_req_wait;
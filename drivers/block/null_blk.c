@@ -8,6 +8,8 @@
 #include <linux/slab.h>
 #include <linux/blk-mq.h>
 #include <linux/hrtimer.h>
+#include <linux/random.h>
+#include <linux/rcupdate.h>
 
 struct nullb_cmd {
 	struct list_head list;
@@ -17,6 +19,7 @@ struct nullb_cmd {
 	struct bio *bio;
 	unsigned int tag;
 	struct nullb_queue *nq;
+	struct hrtimer timer;
 };
 
 struct nullb_queue {
@@ -25,6 +28,12 @@ struct nullb_queue {
 	unsigned int queue_depth;
 
 	struct nullb_cmd *cmds;
+
+	/* blk-mq only: emulated device side depth limit and busy events */
+	struct blk_mq_hw_ctx *hctx;
+	atomic_t inflight;
+	unsigned int max_inflight;
+	struct hrtimer restart_timer;
 };
 
 struct nullb {
@@ -68,6 +77,13 @@ enum {
 	NULL_Q_MQ		= 2,
 };
 
+enum {
+	NULL_LAT_FIXED		= 0,
+	NULL_LAT_BIMODAL	= 1,
+	NULL_LAT_LOGNORMAL	= 2,
+	NULL_LAT_TRACE		= 3,
+};
+
 static int submit_queues;
 module_param(submit_queues, int, S_IRUGO);
 MODULE_PARM_DESC(submit_queues, "Number of submission queues");
@@ -108,6 +124,125 @@ static bool use_per_node_hctx = false;
 module_param(use_per_node_hctx, bool, S_IRUGO);
 MODULE_PARM_DESC(use_per_node_hctx, "Use per-node allocation for hardware context queues. Default: false");
 
+static bool shared_tags;
+module_param(shared_tags, bool, S_IRUGO);
+MODULE_PARM_DESC(shared_tags, "Share tag set between devices for blk-mq. Default: false");
+
+static struct blk_mq_tag_set null_tag_set;
+
+static int completion_dist = NULL_LAT_FIXED;
+module_param(completion_dist, int, S_IRUGO);
+MODULE_PARM_DESC(completion_dist, "Completion latency distribution for irqmode=2. 0-fixed, 1-bimodal, 2-lognormal, 3-trace");
+
+static int bimodal_nsec = 1000000;
+module_param(bimodal_nsec, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(bimodal_nsec, "Completion time of the slow mode of the bimodal distribution. Default: 1,000,000ns");
+
+static int bimodal_pct = 1;
+module_param(bimodal_pct, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(bimodal_pct, "Percentage of requests taking bimodal_nsec. Default: 1");
+
+static int lognormal_sigma = 100;
+module_param(lognormal_sigma, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(lognormal_sigma, "Standard deviation of log2(completion time) for the lognormal distribution, in 1/100ths. Default: 100");
+
+/*
+ * Completion times to replay for NULL_LAT_TRACE, in a loop shared by all
+ * devices. Set by writing a list of nsec values to the completion_trace
+ * parameter, e.g. from a file with one value per line.
+ */
+struct null_trace {
+	unsigned int nr;
+	u32 nsec[];
+};
+
+static struct null_trace __rcu *null_trace;
+static DEFINE_MUTEX(null_trace_lock);
+static atomic_t null_trace_pos = ATOMIC_INIT(0);
+
+static int null_set_trace(const char *val, const struct kernel_param *kp)
+{
+	struct null_trace *trace, *old;
+	char *buf, *p, *tok;
+	unsigned int nr = 0;
+	int ret = 0;
+
+	buf = kstrdup(val, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	trace = kmalloc(sizeof(*trace) + (strlen(buf) / 2 + 1) * sizeof(u32),
+			GFP_KERNEL);
+	if (!trace) {
+		kfree(buf);
+		return -ENOMEM;
+	}
+
+	p = buf;
+	while ((tok = strsep(&p, ", \t\n")) != NULL) {
+		if (!*tok)
+			continue;
+		ret = kstrtou32(tok, 10, &trace->nsec[nr]);
+		if (ret)
+			break;
+		nr++;
+	}
+	kfree(buf);
+
+	if (ret) {
+		kfree(trace);
+		return ret;
+	}
+
+	trace->nr = nr;
+	if (!nr) {
+		kfree(trace);
+		trace = NULL;
+	}
+
+	mutex_lock(&null_trace_lock);
+	old = rcu_dereference_protected(null_trace,
+					lockdep_is_held(&null_trace_lock));
+	rcu_assign_pointer(null_trace, trace);
+	atomic_set(&null_trace_pos, 0);
+	mutex_unlock(&null_trace_lock);
+
+	synchronize_rcu();
+	kfree(old);
+	return 0;
+}
+
+static int null_get_trace(char *buffer, const struct kernel_param *kp)
+{
+	struct null_trace *trace;
+	int ret;
+
+	rcu_read_lock();
+	trace = rcu_dereference(null_trace);
+	ret = sprintf(buffer, "%u entries", trace ? trace->nr : 0);
+	rcu_read_unlock();
+
+	return ret;
+}
+
+static struct kernel_param_ops null_trace_ops = {
+	.set	= null_set_trace,
+	.get	= null_get_trace,
+};
+module_param_cb(completion_trace, &null_trace_ops, NULL, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(completion_trace, "Completion times in ns to replay for completion_dist=3");
+
+#define NULL_MAX_HCTX_DEPTHS	64
+
+static int hctx_depth[NULL_MAX_HCTX_DEPTHS];
+static int nr_hctx_depth;
+module_param_array(hctx_depth, int, &nr_hctx_depth, S_IRUGO);
+MODULE_PARM_DESC(hctx_depth, "Max requests in flight per hardware queue, blk-mq only. The last value applies to the remaining queues. Default: no limit");
+
+static int inject_busy;
+module_param(inject_busy, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(inject_busy, "Return busy for 1 in N requests, blk-mq only. Default: 0 (never)");
+
 static void put_tag(struct nullb_queue *nq, unsigned int tag)
 {
 	clear_bit_unlock(tag, nq->tag_map);
@@ -174,9 +309,15 @@ static struct nullb_cmd *alloc_cmd(struct nullb_queue *nq, int can_wait)
 
 static void end_cmd(struct nullb_cmd *cmd)
 {
+	struct nullb_queue *nq = cmd->nq;
+
 	switch (queue_mode)  {
 	case NULL_Q_MQ:
 		blk_mq_end_io(cmd->rq, 0);
+		if (nq->max_inflight &&
+		    atomic_dec_return(&nq->inflight) < nq->max_inflight &&
+		    test_bit(BLK_MQ_S_STOPPED, &nq->hctx->state))
+			blk_mq_start_stopped_hw_queues(nq->hctx->queue);
 		return;
 	case NULL_Q_RQ:
 		INIT_LIST_HEAD(&cmd->rq->queuelist);
@@ -190,30 +331,135 @@ static void end_cmd(struct nullb_cmd *cmd)
 	free_cmd(cmd);
 }
 
+static int null_complete_list(struct llist_node *entry)
+{
+	struct nullb_cmd *cmd;
+	int nr = 0;
+
+	entry = llist_reverse_order(entry);
+	do {
+		cmd = container_of(entry, struct nullb_cmd, ll_list);
+		entry = entry->next;
+		end_cmd(cmd);
+		nr++;
+	} while (entry);
+
+	return nr;
+}
+
 static enum hrtimer_restart null_cmd_timer_expired(struct hrtimer *timer)
 {
 	struct completion_queue *cq;
 	struct llist_node *entry;
-	struct nullb_cmd *cmd;
 
 	cq = &per_cpu(completion_queues, smp_processor_id());
 
-	while ((entry = llist_del_all(&cq->list)) != NULL) {
-		entry = llist_reverse_order(entry);
-		do {
-			cmd = container_of(entry, struct nullb_cmd, ll_list);
-			end_cmd(cmd);
-			entry = entry->next;
-		} while (entry);
+	while ((entry = llist_del_all(&cq->list)) != NULL)
+		null_complete_list(entry);
+
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * 2^(i/16) in 16.16 fixed point, to scale by fractional powers of two
+ */
+static const u32 null_pow2_frac[17] = {
+	65536, 68438, 71468, 74632, 77936, 81386, 84990, 88752, 92682,
+	96785, 101070, 105545, 110218, 115098, 120194, 125515, 131072,
+};
+
+/* @nsec * 2^(@exp / 65536), tops out at about 4 seconds */
+static u64 null_scale_pow2(u64 nsec, s64 exp)
+{
+	int shift = exp >> 16;
+	u32 frac = exp & 0xffff, i = frac >> 12;
+	u64 mult;
+
+	mult = null_pow2_frac[i] +
+		(((u64)(null_pow2_frac[i + 1] - null_pow2_frac[i]) *
+		  (frac & 0xfff)) >> 12);
+	nsec = (nsec * mult) >> 16;
+
+	if (shift >= 0) {
+		if (shift >= 32 || nsec >= (1ULL << 32) >> shift)
+			return 1ULL << 32;
+		return nsec << shift;
 	}
+	return nsec >> min(-shift, 63);
+}
+
+static u64 null_lognormal_nsec(void)
+{
+	s64 z = 0;
+	int i;
+
+	/*
+	 * The sum of 12 uniform variables on [0, 1) minus 6 is close enough
+	 * to a standard normal one, here in 16.16 fixed point.
+	 */
+	for (i = 0; i < 12; i++)
+		z += prandom_u32() >> 16;
+	z -= 6 << 16;
+
+	return null_scale_pow2(completion_nsec, div_s64(z * lognormal_sigma, 100));
+}
+
+static u64 null_trace_nsec(void)
+{
+	struct null_trace *trace;
+	u64 nsec = completion_nsec;
+
+	rcu_read_lock();
+	trace = rcu_dereference(null_trace);
+	if (trace) {
+		unsigned int pos = atomic_inc_return(&null_trace_pos);
+
+		nsec = trace->nsec[pos % trace->nr];
+	}
+	rcu_read_unlock();
+
+	return nsec;
+}
 
+static u64 null_completion_nsec(void)
+{
+	switch (completion_dist) {
+	case NULL_LAT_BIMODAL:
+		if (prandom_u32_max(100) < bimodal_pct)
+			return bimodal_nsec;
+		break;
+	case NULL_LAT_LOGNORMAL:
+		return null_lognormal_nsec();
+	case NULL_LAT_TRACE:
+		return null_trace_nsec();
+	}
+
+	return completion_nsec;
+}
+
+static enum hrtimer_restart null_cmd_timer_fn(struct hrtimer *timer)
+{
+	end_cmd(container_of(timer, struct nullb_cmd, timer));
 	return HRTIMER_NORESTART;
 }
 
 static void null_cmd_end_timer(struct nullb_cmd *cmd)
 {
-	struct completion_queue *cq = &per_cpu(completion_queues, get_cpu());
+	struct completion_queue *cq;
 
+	/*
+	 * Latencies varying per command need a timer each. The fixed one
+	 * batches all commands of this cpu on one timer.
+	 */
+	if (completion_dist != NULL_LAT_FIXED) {
+		hrtimer_init(&cmd->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		cmd->timer.function = null_cmd_timer_fn;
+		hrtimer_start(&cmd->timer, ns_to_ktime(null_completion_nsec()),
+				HRTIMER_MODE_REL);
+		return;
+	}
+
+	cq = &per_cpu(completion_queues, get_cpu());
 	cmd->ll_list.next = NULL;
 	if (llist_add(&cmd->ll_list, &cq->list)) {
 		ktime_t kt = ktime_set(0, completion_nsec);
@@ -229,6 +475,32 @@ static void null_softirq_done_fn(struct request *rq)
 	end_cmd(rq->special);
 }
 
+/*
+ * Reap the timer completion list of this cpu as soon as the emulated
+ * completion time has passed, instead of waiting for the hrtimer to fire.
+ * The other irqmodes have completed the request before anyone can poll.
+ */
+static int null_poll(struct blk_mq_hw_ctx *hctx)
+{
+	struct completion_queue *cq;
+	struct llist_node *entry;
+	int nr = 0;
+
+	if (irqmode != NULL_IRQ_TIMER)
+		return 0;
+
+	cq = &per_cpu(completion_queues, get_cpu());
+	if (!llist_empty(&cq->list) &&
+	    ktime_to_ns(hrtimer_get_remaining(&cq->timer)) <= 0) {
+		entry = llist_del_all(&cq->list);
+		if (entry)
+			nr = null_complete_list(entry);
+	}
+	put_cpu();
+
+	return nr;
+}
+
 static inline void null_handle_cmd(struct nullb_cmd *cmd)
 {
 	/* Complete IO by inline, softirq or timer */
@@ -309,12 +581,45 @@ static void null_request_fn(struct request_queue *q)
 	}
 }
 
+static enum hrtimer_restart null_restart_timer_expired(struct hrtimer *timer)
+{
+	struct nullb_queue *nq = container_of(timer, struct nullb_queue,
+						restart_timer);
+
+	blk_mq_start_stopped_hw_queues(nq->hctx->queue);
+	return HRTIMER_NORESTART;
+}
+
 static int null_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *rq)
 {
 	struct nullb_cmd *cmd = rq->special;
+	struct nullb_queue *nq = hctx->driver_data;
+
+	/*
+	 * Emulate a device that is too busy to take the request right now,
+	 * and restarts the queue once it has caught up.
+	 */
+	if (inject_busy > 0 && !prandom_u32_max(inject_busy)) {
+		blk_mq_stop_hw_queue(hctx);
+		hrtimer_start(&nq->restart_timer, ns_to_ktime(completion_nsec),
+				HRTIMER_MODE_REL);
+		return BLK_MQ_RQ_QUEUE_BUSY;
+	}
+
+	if (nq->max_inflight &&
+	    atomic_inc_return(&nq->inflight) > nq->max_inflight) {
+		blk_mq_stop_hw_queue(hctx);
+		/*
+		 * Everything may have completed before the queue was
+		 * stopped, restart it ourselves in that case.
+		 */
+		if (atomic_dec_return(&nq->inflight) < nq->max_inflight)
+			blk_mq_start_stopped_hw_queues(hctx->queue);
+		return BLK_MQ_RQ_QUEUE_BUSY;
+	}
 
 	cmd->rq = rq;
-	cmd->nq = hctx->driver_data;
+	cmd->nq = nq;
 
 	null_handle_cmd(cmd);
 	return BLK_MQ_RQ_QUEUE_OK;
@@ -379,6 +684,14 @@ static int null_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
 	null_init_queue(nullb, nq);
 	nullb->nr_queues++;
 
+	nq->hctx = hctx;
+	atomic_set(&nq->inflight, 0);
+	if (nr_hctx_depth)
+		nq->max_inflight = max(hctx_depth[min(index,
+					(unsigned int)nr_hctx_depth - 1)], 0);
+	hrtimer_init(&nq->restart_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	nq->restart_timer.function = null_restart_timer_expired;
+
 	return 0;
 }
 
@@ -387,6 +700,7 @@ static struct blk_mq_ops null_mq_ops = {
 	.map_queue      = blk_mq_map_queue,
 	.init_hctx	= null_init_hctx,
 	.complete	= null_softirq_done_fn,
+	.poll		= null_poll,
 };
 
 static struct blk_mq_reg null_mq_reg = {
@@ -402,6 +716,14 @@ static void null_del_dev(struct nullb *nullb)
 
 	del_gendisk(nullb->disk);
 	blk_cleanup_queue(nullb->q);
+
+	if (queue_mode == NULL_Q_MQ) {
+		int i;
+
+		for (i = 0; i < nullb->nr_queues; i++)
+			hrtimer_cancel(&nullb->queues[i].restart_timer);
+	}
+
 	put_disk(nullb->disk);
 	kfree(nullb);
 }
@@ -520,6 +842,7 @@ static int null_add_dev(void)
 		null_mq_reg.numa_node = home_node;
 		null_mq_reg.queue_depth = hw_queue_depth;
 		null_mq_reg.nr_hw_queues = submit_queues;
+		null_mq_reg.tag_set = shared_tags ? &null_tag_set : NULL;
 
 		if (use_per_node_hctx) {
 			null_mq_reg.ops->alloc_hctx = null_alloc_hctx;
@@ -617,9 +940,25 @@ static int __init null_init(void)
 		cq->timer.function = null_cmd_timer_expired;
 	}
 
+	if (queue_mode == NULL_Q_MQ && shared_tags) {
+		int ret;
+
+		null_tag_set.nr_hw_queues = submit_queues;
+		null_tag_set.queue_depth = hw_queue_depth;
+		null_tag_set.cmd_size = sizeof(struct nullb_cmd);
+		null_tag_set.numa_node = home_node;
+
+		ret = blk_mq_alloc_tag_set(&null_tag_set);
+		if (ret)
+			return ret;
+	}
+
 	null_major = register_blkdev(0, "nullb");
-	if (null_major < 0)
+	if (null_major < 0) {
+		if (queue_mode == NULL_Q_MQ && shared_tags)
+			blk_mq_free_tag_set(&null_tag_set);
 		return null_major;
+	}
 
 	for (i = 0; i < nr_devices; i++) {
 		if (null_add_dev()) {
@@ -644,6 +983,9 @@ static void __exit null_exit(void)
 		null_del_dev(nullb);
 	}
 	mutex_unlock(&lock);
+
+	if (queue_mode == NULL_Q_MQ && shared_tags)
+		blk_mq_free_tag_set(&null_tag_set);
 }
 
 module_init(null_init);
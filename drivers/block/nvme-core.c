@@ -20,6 +20,7 @@
 #include <linux/bio.h>
 #include <linux/bitops.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/cpu.h>
 #include <linux/delay.h>
 #include <linux/errno.h>
@@ -94,8 +95,8 @@ struct nvme_queue {
 	dma_addr_t cq_dma_addr;
 	wait_queue_head_t sq_full;
 	wait_queue_t sq_cong_wait;
-	struct bio_list sq_cong;
-	struct list_head iod_bio;
+	struct list_head sq_cong;
+	struct list_head iod_req;
 	u32 __iomem *q_db;
 	u16 q_depth;
 	u16 cq_vector;
@@ -286,10 +287,10 @@ static struct nvme_queue *get_nvmeq(struct nvme_dev *dev) __acquires(RCU)
 	return rcu_dereference(dev->queues[queue_id]);
 }
 
-static void put_nvmeq(struct nvme_queue *nvmeq) __releases(RCU)
+static void put_nvmeq(struct nvme_dev *dev) __releases(RCU)
 {
 	rcu_read_unlock();
-	put_cpu_var(nvmeq->dev->io_queue);
+	put_cpu_var(dev->io_queue);
 }
 
 static struct nvme_queue *lock_nvmeq(struct nvme_dev *dev, int q_idx)
@@ -384,59 +385,30 @@ void nvme_free_iod(struct nvme_dev *dev, struct nvme_iod *iod)
 	kfree(iod);
 }
 
-static void nvme_start_io_acct(struct bio *bio)
-{
-	struct gendisk *disk = bio->bi_bdev->bd_disk;
-	const int rw = bio_data_dir(bio);
-	int cpu = part_stat_lock();
-	part_round_stats(cpu, &disk->part0);
-	part_stat_inc(cpu, &disk->part0, ios[rw]);
-	part_stat_add(cpu, &disk->part0, sectors[rw], bio_sectors(bio));
-	part_inc_in_flight(&disk->part0, rw);
-	part_stat_unlock();
-}
-
-static void nvme_end_io_acct(struct bio *bio, unsigned long start_time)
-{
-	struct gendisk *disk = bio->bi_bdev->bd_disk;
-	const int rw = bio_data_dir(bio);
-	unsigned long duration = jiffies - start_time;
-	int cpu = part_stat_lock();
-	part_stat_add(cpu, &disk->part0, ticks[rw], duration);
-	part_round_stats(cpu, &disk->part0);
-	part_dec_in_flight(&disk->part0, rw);
-	part_stat_unlock();
-}
-
-static void bio_completion(struct nvme_queue *nvmeq, void *ctx,
+static void req_completion(struct nvme_queue *nvmeq, void *ctx,
 						struct nvme_completion *cqe)
 {
 	struct nvme_iod *iod = ctx;
-	struct bio *bio = iod->private;
+	struct request *req = iod->private;
 	u16 status = le16_to_cpup(&cqe->status) >> 1;
 
 	if (unlikely(status)) {
 		if (!(status & NVME_SC_DNR ||
-				bio->bi_rw & REQ_FAILFAST_MASK) &&
+				req->cmd_flags & REQ_FAILFAST_MASK) &&
 				(jiffies - iod->start_time) < IOD_TIMEOUT) {
 			if (!waitqueue_active(&nvmeq->sq_full))
 				add_wait_queue(&nvmeq->sq_full,
 							&nvmeq->sq_cong_wait);
-			list_add_tail(&iod->node, &nvmeq->iod_bio);
+			list_add_tail(&iod->node, &nvmeq->iod_req);
 			wake_up(&nvmeq->sq_full);
 			return;
 		}
 	}
-	if (iod->nents) {
+	if (iod->nents)
 		dma_unmap_sg(nvmeq->q_dmadev, iod->sg, iod->nents,
-			bio_data_dir(bio) ? DMA_TO_DEVICE : DMA_FROM_DEVICE);
-		nvme_end_io_acct(bio, iod->start_time);
-	}
+			rq_data_dir(req) ? DMA_TO_DEVICE : DMA_FROM_DEVICE);
 	nvme_free_iod(nvmeq->dev, iod);
-	if (status)
-		bio_endio(bio, -EIO);
-	else
-		bio_endio(bio, 0);
+	blk_mq_end_io(req, status ? -EIO : 0);
 }
 
 /* length is in bytes.  gfp flags indicates whether we may sleep. */
@@ -518,82 +490,51 @@ int nvme_setup_prps(struct nvme_dev *dev, struct nvme_iod *iod, int total_len,
 	return total_len;
 }
 
-static int nvme_split_and_submit(struct bio *bio, struct nvme_queue *nvmeq,
-				 int len)
+/*
+ * NVMe PRPs cannot describe a hole in the virtual address range.  The
+ * queue is marked QUEUE_FLAG_SG_GAPS so the block layer should never
+ * build such a request, but check rather than corrupt data if it does.
+ */
+static bool nvme_sg_has_gaps(struct scatterlist *sgl, int nents)
 {
-	struct bio *split = bio_split(bio, len >> 9, GFP_ATOMIC, NULL);
-	if (!split)
-		return -ENOMEM;
-
-	bio_chain(split, bio);
-
-	if (!waitqueue_active(&nvmeq->sq_full))
-		add_wait_queue(&nvmeq->sq_full, &nvmeq->sq_cong_wait);
-	bio_list_add(&nvmeq->sq_cong, split);
-	bio_list_add(&nvmeq->sq_cong, bio);
-	wake_up(&nvmeq->sq_full);
+	struct scatterlist *sg;
+	int i;
 
-	return 0;
+	for_each_sg(sgl, sg, nents, i) {
+		if (i && sg->offset)
+			return true;
+		if (i < nents - 1 && (sg->offset + sg->length) % PAGE_SIZE)
+			return true;
+	}
+	return false;
 }
 
-/* NVMe scatterlists require no holes in the virtual address */
-#define BIOVEC_NOT_VIRT_MERGEABLE(vec1, vec2)	((vec2)->bv_offset || \
-			(((vec1)->bv_offset + (vec1)->bv_len) % PAGE_SIZE))
-
-static int nvme_map_bio(struct nvme_queue *nvmeq, struct nvme_iod *iod,
-		struct bio *bio, enum dma_data_direction dma_dir, int psegs)
+static int nvme_map_rq(struct nvme_queue *nvmeq, struct nvme_iod *iod,
+		struct request *req, enum dma_data_direction dma_dir)
 {
-	struct bio_vec bvec, bvprv;
-	struct bvec_iter iter;
-	struct scatterlist *sg = NULL;
-	int length = 0, nsegs = 0, split_len = bio->bi_iter.bi_size;
-	int first = 1;
-
-	if (nvmeq->dev->stripe_size)
-		split_len = nvmeq->dev->stripe_size -
-			((bio->bi_iter.bi_sector << 9) &
-			 (nvmeq->dev->stripe_size - 1));
-
-	sg_init_table(iod->sg, psegs);
-	bio_for_each_segment(bvec, bio, iter) {
-		if (!first && BIOVEC_PHYS_MERGEABLE(&bvprv, &bvec)) {
-			sg->length += bvec.bv_len;
-		} else {
-			if (!first && BIOVEC_NOT_VIRT_MERGEABLE(&bvprv, &bvec))
-				return nvme_split_and_submit(bio, nvmeq,
-							     length);
-
-			sg = sg ? sg + 1 : iod->sg;
-			sg_set_page(sg, bvec.bv_page,
-				    bvec.bv_len, bvec.bv_offset);
-			nsegs++;
-		}
-
-		if (split_len - length < bvec.bv_len)
-			return nvme_split_and_submit(bio, nvmeq, split_len);
-		length += bvec.bv_len;
-		bvprv = bvec;
-		first = 0;
+	sg_init_table(iod->sg, req->nr_phys_segments);
+	iod->nents = blk_rq_map_sg(req->q, req, iod->sg);
+	if (nvme_sg_has_gaps(iod->sg, iod->nents)) {
+		iod->nents = 0;
+		return -EIO;
 	}
-	iod->nents = nsegs;
-	sg_mark_end(sg);
-	if (dma_map_sg(nvmeq->q_dmadev, iod->sg, iod->nents, dma_dir) == 0)
+	if (dma_map_sg(nvmeq->q_dmadev, iod->sg, iod->nents, dma_dir) == 0) {
+		iod->nents = 0;
 		return -ENOMEM;
-
-	BUG_ON(length != bio->bi_iter.bi_size);
-	return length;
+	}
+	return 0;
 }
 
 static int nvme_submit_discard(struct nvme_queue *nvmeq, struct nvme_ns *ns,
-		struct bio *bio, struct nvme_iod *iod, int cmdid)
+		struct request *req, struct nvme_iod *iod, int cmdid)
 {
 	struct nvme_dsm_range *range =
 				(struct nvme_dsm_range *)iod_list(iod)[0];
 	struct nvme_command *cmnd = &nvmeq->sq_cmds[nvmeq->sq_tail];
 
 	range->cattr = cpu_to_le32(0);
-	range->nlb = cpu_to_le32(bio->bi_iter.bi_size >> ns->lba_shift);
-	range->slba = cpu_to_le64(nvme_block_nr(ns, bio->bi_iter.bi_sector));
+	range->nlb = cpu_to_le32(blk_rq_bytes(req) >> ns->lba_shift);
+	range->slba = cpu_to_le64(nvme_block_nr(ns, blk_rq_pos(req)));
 
 	memset(cmnd, 0, sizeof(*cmnd));
 	cmnd->dsm.opcode = nvme_cmd_dsm;
@@ -627,55 +568,45 @@ static int nvme_submit_flush(struct nvme_queue *nvmeq, struct nvme_ns *ns,
 	return 0;
 }
 
-int nvme_submit_flush_data(struct nvme_queue *nvmeq, struct nvme_ns *ns)
-{
-	int cmdid = alloc_cmdid(nvmeq, (void *)CMD_CTX_FLUSH,
-					special_completion, NVME_IO_TIMEOUT);
-	if (unlikely(cmdid < 0))
-		return cmdid;
-
-	return nvme_submit_flush(nvmeq, ns, cmdid);
-}
-
 static int nvme_submit_iod(struct nvme_queue *nvmeq, struct nvme_iod *iod)
 {
-	struct bio *bio = iod->private;
-	struct nvme_ns *ns = bio->bi_bdev->bd_disk->private_data;
+	struct request *req = iod->private;
+	struct nvme_ns *ns = req->q->queuedata;
 	struct nvme_command *cmnd;
 	int cmdid;
 	u16 control;
 	u32 dsmgmt;
 
-	cmdid = alloc_cmdid(nvmeq, iod, bio_completion, NVME_IO_TIMEOUT);
+	cmdid = alloc_cmdid(nvmeq, iod, req_completion, NVME_IO_TIMEOUT);
 	if (unlikely(cmdid < 0))
 		return cmdid;
 
-	if (bio->bi_rw & REQ_DISCARD)
-		return nvme_submit_discard(nvmeq, ns, bio, iod, cmdid);
-	if ((bio->bi_rw & REQ_FLUSH) && !iod->nents)
+	if (req->cmd_flags & REQ_DISCARD)
+		return nvme_submit_discard(nvmeq, ns, req, iod, cmdid);
+	if ((req->cmd_flags & REQ_FLUSH) && !iod->nents)
 		return nvme_submit_flush(nvmeq, ns, cmdid);
 
 	control = 0;
-	if (bio->bi_rw & REQ_FUA)
+	if (req->cmd_flags & REQ_FUA)
 		control |= NVME_RW_FUA;
-	if (bio->bi_rw & (REQ_FAILFAST_DEV | REQ_RAHEAD))
+	if (req->cmd_flags & (REQ_FAILFAST_DEV | REQ_RAHEAD))
 		control |= NVME_RW_LR;
 
 	dsmgmt = 0;
-	if (bio->bi_rw & REQ_RAHEAD)
+	if (req->cmd_flags & REQ_RAHEAD)
 		dsmgmt |= NVME_RW_DSM_FREQ_PREFETCH;
 
 	cmnd = &nvmeq->sq_cmds[nvmeq->sq_tail];
 	memset(cmnd, 0, sizeof(*cmnd));
 
-	cmnd->rw.opcode = bio_data_dir(bio) ? nvme_cmd_write : nvme_cmd_read;
+	cmnd->rw.opcode = rq_data_dir(req) ? nvme_cmd_write : nvme_cmd_read;
 	cmnd->rw.command_id = cmdid;
 	cmnd->rw.nsid = cpu_to_le32(ns->ns_id);
 	cmnd->rw.prp1 = cpu_to_le64(sg_dma_address(iod->sg));
 	cmnd->rw.prp2 = cpu_to_le64(iod->first_dma);
-	cmnd->rw.slba = cpu_to_le64(nvme_block_nr(ns, bio->bi_iter.bi_sector));
+	cmnd->rw.slba = cpu_to_le64(nvme_block_nr(ns, blk_rq_pos(req)));
 	cmnd->rw.length =
-		cpu_to_le16((bio->bi_iter.bi_size >> ns->lba_shift) - 1);
+		cpu_to_le16((blk_rq_bytes(req) >> ns->lba_shift) - 1);
 	cmnd->rw.control = cpu_to_le16(control);
 	cmnd->rw.dsmgmt = cpu_to_le32(dsmgmt);
 
@@ -689,25 +620,20 @@ static int nvme_submit_iod(struct nvme_queue *nvmeq, struct nvme_iod *iod)
 /*
  * Called with local interrupts disabled and the q_lock held.  May not sleep.
  */
-static int nvme_submit_bio_queue(struct nvme_queue *nvmeq, struct nvme_ns *ns,
-								struct bio *bio)
+static int nvme_submit_req_queue(struct nvme_queue *nvmeq, struct nvme_ns *ns,
+							struct request *req)
 {
 	struct nvme_iod *iod;
-	int psegs = bio_phys_segments(ns->queue, bio);
+	int psegs = req->nr_phys_segments;
+	int length = blk_rq_bytes(req);
 	int result;
 
-	if ((bio->bi_rw & REQ_FLUSH) && psegs) {
-		result = nvme_submit_flush_data(nvmeq, ns);
-		if (result)
-			return result;
-	}
-
-	iod = nvme_alloc_iod(psegs, bio->bi_iter.bi_size, GFP_ATOMIC);
+	iod = nvme_alloc_iod(psegs, length, GFP_ATOMIC);
 	if (!iod)
 		return -ENOMEM;
 
-	iod->private = bio;
-	if (bio->bi_rw & REQ_DISCARD) {
+	iod->private = req;
+	if (req->cmd_flags & REQ_DISCARD) {
 		void *range;
 		/*
 		 * We reuse the small pool to allocate the 16-byte range here
@@ -724,22 +650,24 @@ static int nvme_submit_bio_queue(struct nvme_queue *nvmeq, struct nvme_ns *ns,
 		iod_list(iod)[0] = (__le64 *)range;
 		iod->npages = 0;
 	} else if (psegs) {
-		result = nvme_map_bio(nvmeq, iod, bio,
-			bio_data_dir(bio) ? DMA_TO_DEVICE : DMA_FROM_DEVICE,
-			psegs);
-		if (result <= 0)
+		enum dma_data_direction dma_dir = rq_data_dir(req) ?
+						DMA_TO_DEVICE : DMA_FROM_DEVICE;
+
+		result = nvme_map_rq(nvmeq, iod, req, dma_dir);
+		if (result)
 			goto free_iod;
-		if (nvme_setup_prps(nvmeq->dev, iod, result, GFP_ATOMIC) !=
-								result) {
+		if (nvme_setup_prps(nvmeq->dev, iod, length, GFP_ATOMIC) !=
+								length) {
+			dma_unmap_sg(nvmeq->q_dmadev, iod->sg, iod->nents,
+								dma_dir);
 			result = -ENOMEM;
 			goto free_iod;
 		}
-		nvme_start_io_acct(bio);
 	}
 	if (unlikely(nvme_submit_iod(nvmeq, iod))) {
 		if (!waitqueue_active(&nvmeq->sq_full))
 			add_wait_queue(&nvmeq->sq_full, &nvmeq->sq_cong_wait);
-		list_add_tail(&iod->node, &nvmeq->iod_bio);
+		list_add_tail(&iod->node, &nvmeq->iod_req);
 	}
 	return 0;
 
@@ -788,30 +716,36 @@ static int nvme_process_cq(struct nvme_queue *nvmeq)
 	return 1;
 }
 
-static void nvme_make_request(struct request_queue *q, struct bio *bio)
+static int nvme_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *req)
 {
-	struct nvme_ns *ns = q->queuedata;
-	struct nvme_queue *nvmeq = get_nvmeq(ns->dev);
+	struct nvme_ns *ns = hctx->queue->queuedata;
+	struct nvme_queue *nvmeq;
 	int result = -EBUSY;
 
+	if (unlikely(req->cmd_type != REQ_TYPE_FS))
+		return BLK_MQ_RQ_QUEUE_ERROR;
+
+	nvmeq = get_nvmeq(ns->dev);
 	if (!nvmeq) {
-		put_nvmeq(NULL);
-		bio_endio(bio, -EIO);
-		return;
+		put_nvmeq(ns->dev);
+		return BLK_MQ_RQ_QUEUE_ERROR;
 	}
 
 	spin_lock_irq(&nvmeq->q_lock);
-	if (!nvmeq->q_suspended && bio_list_empty(&nvmeq->sq_cong))
-		result = nvme_submit_bio_queue(nvmeq, ns, bio);
-	if (unlikely(result)) {
+	if (!nvmeq->q_suspended && list_empty(&nvmeq->sq_cong))
+		result = nvme_submit_req_queue(nvmeq, ns, req);
+	if (unlikely(result == -EBUSY || result == -ENOMEM)) {
 		if (!waitqueue_active(&nvmeq->sq_full))
 			add_wait_queue(&nvmeq->sq_full, &nvmeq->sq_cong_wait);
-		bio_list_add(&nvmeq->sq_cong, bio);
+		list_add_tail(&req->queuelist, &nvmeq->sq_cong);
+		result = 0;
 	}
 
 	nvme_process_cq(nvmeq);
 	spin_unlock_irq(&nvmeq->q_lock);
-	put_nvmeq(nvmeq);
+	put_nvmeq(ns->dev);
+
+	return result ? BLK_MQ_RQ_QUEUE_ERROR : BLK_MQ_RQ_QUEUE_OK;
 }
 
 static irqreturn_t nvme_irq(int irq, void *data)
@@ -1144,20 +1078,23 @@ static void nvme_free_queue(struct rcu_head *r)
 	struct nvme_queue *nvmeq = container_of(r, struct nvme_queue, r_head);
 
 	spin_lock_irq(&nvmeq->q_lock);
-	while (bio_list_peek(&nvmeq->sq_cong)) {
-		struct bio *bio = bio_list_pop(&nvmeq->sq_cong);
-		bio_endio(bio, -EIO);
-	}
-	while (!list_empty(&nvmeq->iod_bio)) {
+	while (!list_empty(&nvmeq->sq_cong)) {
+		struct request *req = list_first_entry(&nvmeq->sq_cong,
+							struct request,
+							queuelist);
+		list_del_init(&req->queuelist);
+		blk_mq_end_io(req, -EIO);
+	}
+	while (!list_empty(&nvmeq->iod_req)) {
 		static struct nvme_completion cqe = {
 			.status = cpu_to_le16(
 				(NVME_SC_ABORT_REQ | NVME_SC_DNR) << 1),
 		};
-		struct nvme_iod *iod = list_first_entry(&nvmeq->iod_bio,
+		struct nvme_iod *iod = list_first_entry(&nvmeq->iod_req,
 							struct nvme_iod,
 							node);
 		list_del(&iod->node);
-		bio_completion(nvmeq, iod, &cqe);
+		req_completion(nvmeq, iod, &cqe);
 	}
 	spin_unlock_irq(&nvmeq->q_lock);
 
@@ -1265,8 +1202,8 @@ static struct nvme_queue *nvme_alloc_queue(struct nvme_dev *dev, int qid,
 	nvmeq->cq_phase = 1;
 	init_waitqueue_head(&nvmeq->sq_full);
 	init_waitqueue_entry(&nvmeq->sq_cong_wait, nvme_thread);
-	bio_list_init(&nvmeq->sq_cong);
-	INIT_LIST_HEAD(&nvmeq->iod_bio);
+	INIT_LIST_HEAD(&nvmeq->sq_cong);
+	INIT_LIST_HEAD(&nvmeq->iod_req);
 	nvmeq->q_db = &dev->dbs[qid * 2 * dev->db_stride];
 	nvmeq->q_depth = depth;
 	nvmeq->cq_vector = vector;
@@ -1775,34 +1712,41 @@ static void nvme_resubmit_iods(struct nvme_queue *nvmeq)
 {
 	struct nvme_iod *iod, *next;
 
-	list_for_each_entry_safe(iod, next, &nvmeq->iod_bio, node) {
+	list_for_each_entry_safe(iod, next, &nvmeq->iod_req, node) {
 		if (unlikely(nvme_submit_iod(nvmeq, iod)))
 			break;
 		list_del(&iod->node);
-		if (bio_list_empty(&nvmeq->sq_cong) &&
-						list_empty(&nvmeq->iod_bio))
+		if (list_empty(&nvmeq->sq_cong) &&
+						list_empty(&nvmeq->iod_req))
 			remove_wait_queue(&nvmeq->sq_full,
 						&nvmeq->sq_cong_wait);
 	}
 }
 
-static void nvme_resubmit_bios(struct nvme_queue *nvmeq)
+static void nvme_resubmit_reqs(struct nvme_queue *nvmeq)
 {
-	while (bio_list_peek(&nvmeq->sq_cong)) {
-		struct bio *bio = bio_list_pop(&nvmeq->sq_cong);
-		struct nvme_ns *ns = bio->bi_bdev->bd_disk->private_data;
+	while (!list_empty(&nvmeq->sq_cong)) {
+		struct request *req = list_first_entry(&nvmeq->sq_cong,
+							struct request,
+							queuelist);
+		struct nvme_ns *ns = req->q->queuedata;
+		int result;
 
-		if (bio_list_empty(&nvmeq->sq_cong) &&
-						list_empty(&nvmeq->iod_bio))
+		list_del_init(&req->queuelist);
+		if (list_empty(&nvmeq->sq_cong) &&
+						list_empty(&nvmeq->iod_req))
 			remove_wait_queue(&nvmeq->sq_full,
 							&nvmeq->sq_cong_wait);
-		if (nvme_submit_bio_queue(nvmeq, ns, bio)) {
+		result = nvme_submit_req_queue(nvmeq, ns, req);
+		if (result == -EBUSY || result == -ENOMEM) {
 			if (!waitqueue_active(&nvmeq->sq_full))
 				add_wait_queue(&nvmeq->sq_full,
 							&nvmeq->sq_cong_wait);
-			bio_list_add_head(&nvmeq->sq_cong, bio);
+			list_add(&req->queuelist, &nvmeq->sq_cong);
 			break;
 		}
+		if (result)
+			blk_mq_end_io(req, -EIO);
 	}
 }
 
@@ -1837,7 +1781,7 @@ static int nvme_kthread(void *data)
 					goto unlock;
 				nvme_process_cq(nvmeq);
 				nvme_cancel_ios(nvmeq, true);
-				nvme_resubmit_bios(nvmeq);
+				nvme_resubmit_reqs(nvmeq);
 				nvme_resubmit_iods(nvmeq);
  unlock:
 				spin_unlock_irq(&nvmeq->q_lock);
@@ -1860,9 +1804,41 @@ static void nvme_config_discard(struct nvme_ns *ns)
 	queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, ns->queue);
 }
 
+/*
+ * Some devices have a vendor specific stripe size and perform much better
+ * when commands do not straddle a stripe boundary, so stop bios from
+ * growing across one.
+ */
+static int nvme_mergeable_bvec(struct request_queue *q,
+				struct bvec_merge_data *bvm,
+				struct bio_vec *biovec)
+{
+	struct nvme_ns *ns = q->queuedata;
+	unsigned int stripe_sectors = ns->dev->stripe_size >> 9;
+	sector_t sector = bvm->bi_sector + get_start_sect(bvm->bi_bdev);
+	unsigned int bio_sectors = bvm->bi_size >> 9;
+	int max;
+
+	max = (stripe_sectors - ((sector & (stripe_sectors - 1))
+						+ bio_sectors)) << 9;
+	if (max < 0)
+		max = 0; /* bio_add cannot handle a negative return */
+	if (max <= biovec->bv_len && bio_sectors == 0)
+		return biovec->bv_len;
+	return max;
+}
+
+static struct blk_mq_ops nvme_mq_ops = {
+	.queue_rq	= nvme_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+	.alloc_hctx	= blk_mq_alloc_single_hw_queue,
+	.free_hctx	= blk_mq_free_single_hw_queue,
+};
+
 static struct nvme_ns *nvme_alloc_ns(struct nvme_dev *dev, unsigned nsid,
 			struct nvme_id_ns *id, struct nvme_lba_range_type *rt)
 {
+	struct blk_mq_reg reg = { };
 	struct nvme_ns *ns;
 	struct gendisk *disk;
 	int lbaf;
@@ -1873,13 +1849,30 @@ static struct nvme_ns *nvme_alloc_ns(struct nvme_dev *dev, unsigned nsid,
 	ns = kzalloc(sizeof(*ns), GFP_KERNEL);
 	if (!ns)
 		return NULL;
-	ns->queue = blk_alloc_queue(GFP_KERNEL);
-	if (!ns->queue)
+
+	/*
+	 * Commands are issued on the submission queue assigned to the
+	 * submitting cpu, shared by every namespace on the device, so
+	 * blk-mq tags are not used as command ids.
+	 */
+	reg.ops = &nvme_mq_ops;
+	reg.nr_hw_queues = max_t(unsigned, dev->queue_count - 1, 1);
+	reg.queue_depth = dev->q_depth - 1;
+	reg.numa_node = dev_to_node(&dev->pci_dev->dev);
+	reg.timeout = NVME_IO_TIMEOUT;
+	if (!dev->stripe_size)
+		reg.flags = BLK_MQ_F_SHOULD_MERGE;
+
+	ns->queue = blk_mq_init_queue(&reg, ns);
+	if (IS_ERR(ns->queue))
 		goto out_free_ns;
-	ns->queue->queue_flags = QUEUE_FLAG_DEFAULT;
-	queue_flag_set_unlocked(QUEUE_FLAG_NOMERGES, ns->queue);
+	queue_flag_set_unlocked(QUEUE_FLAG_SG_GAPS, ns->queue);
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, ns->queue);
-	blk_queue_make_request(ns->queue, nvme_make_request);
+	blk_queue_flush(ns->queue, REQ_FLUSH | REQ_FUA);
+	if (dev->stripe_size) {
+		queue_flag_set_unlocked(QUEUE_FLAG_NOMERGES, ns->queue);
+		blk_queue_merge_bvec(ns->queue, nvme_mergeable_bvec);
+	}
 	ns->dev = dev;
 	ns->queue->queuedata = ns;
 
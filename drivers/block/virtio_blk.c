@@ -129,26 +129,50 @@ static inline void virtblk_request_done(struct request *req)
 static void virtblk_done(struct virtqueue *vq)
 {
 	struct virtio_blk *vblk = vq->vdev->priv;
-	bool req_done = false;
 	struct virtblk_req *vbr;
 	unsigned long flags;
 	unsigned int len;
+	LIST_HEAD(done);
 
 	spin_lock_irqsave(&vblk->vq_lock, flags);
 	do {
 		virtqueue_disable_cb(vq);
-		while ((vbr = virtqueue_get_buf(vblk->vq, &len)) != NULL) {
-			blk_mq_complete_request(vbr->req);
-			req_done = true;
-		}
+		while ((vbr = virtqueue_get_buf(vblk->vq, &len)) != NULL)
+			list_add_tail(&vbr->req->queuelist, &done);
 		if (unlikely(virtqueue_is_broken(vq)))
 			break;
 	} while (!virtqueue_enable_cb(vq));
 	spin_unlock_irqrestore(&vblk->vq_lock, flags);
 
 	/* In case queue is stopped waiting for more buffers. */
-	if (req_done)
+	if (!list_empty(&done)) {
+		blk_mq_complete_request_list(&done);
+		blk_mq_start_stopped_hw_queues(vblk->disk->queue);
+	}
+}
+
+static int virtblk_poll(struct blk_mq_hw_ctx *hctx)
+{
+	struct virtio_blk *vblk = hctx->queue->queuedata;
+	struct virtblk_req *vbr;
+	unsigned long flags;
+	unsigned int len;
+	int found = 0;
+
+	spin_lock_irqsave(&vblk->vq_lock, flags);
+	while ((vbr = virtqueue_get_buf(vblk->vq, &len)) != NULL) {
+		blk_mq_complete_request(vbr->req);
+		found++;
+	}
+	spin_unlock_irqrestore(&vblk->vq_lock, flags);
+
+	/* In case queue is stopped waiting for more buffers. */
+	if (found)
 		blk_mq_start_stopped_hw_queues(vblk->disk->queue);
+	else if (unlikely(virtqueue_is_broken(vblk->vq)))
+		return -EIO;
+
+	return found;
 }
 
 static int virtio_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *req)
@@ -486,6 +510,7 @@ static struct blk_mq_ops virtio_mq_ops = {
 	.alloc_hctx	= blk_mq_alloc_single_hw_queue,
 	.free_hctx	= blk_mq_free_single_hw_queue,
 	.complete	= virtblk_request_done,
+	.poll		= virtblk_poll,
 };
 
 static struct blk_mq_reg virtio_mq_reg = {
@@ -23,6 +23,7 @@
 #include <linux/kernel.h>
 #include <linux/bio.h>
 #include <linux/bitops.h>
+#include <linux/bit_spinlock.h>
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
 #include <linux/device.h>
@@ -39,6 +40,7 @@
 static int zram_major;
 static struct zram *zram_devices;
 static const char *default_compressor = "lzo";
+static struct workqueue_struct *zram_wq;
 
 /* Module params (documentation at end) */
 static unsigned int num_devices = 1;
@@ -151,6 +153,31 @@ out:
 	return ret;
 }
 
+static ssize_t async_write_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", zram->async_write);
+}
+
+static ssize_t async_write_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+	int ret;
+
+	ret = strtobool(buf, &val);
+	if (ret < 0)
+		return ret;
+
+	down_write(&zram->init_lock);
+	zram->async_write = val;
+	up_write(&zram->init_lock);
+	return len;
+}
+
 static ssize_t comp_algorithm_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -179,23 +206,46 @@ static ssize_t comp_algorithm_store(struct device *dev,
 	return len;
 }
 
-/* flag operations needs meta->tb_lock */
+static inline void zram_lock_slot(struct zram_meta *meta, u32 index)
+{
+	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+}
+
+static inline void zram_unlock_slot(struct zram_meta *meta, u32 index)
+{
+	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+}
+
+/* flag and size operations need the slot lock */
 static int zram_test_flag(struct zram_meta *meta, u32 index,
 			enum zram_pageflags flag)
 {
-	return meta->table[index].flags & BIT(flag);
+	return meta->table[index].value & BIT(flag);
 }
 
 static void zram_set_flag(struct zram_meta *meta, u32 index,
 			enum zram_pageflags flag)
 {
-	meta->table[index].flags |= BIT(flag);
+	meta->table[index].value |= BIT(flag);
 }
 
 static void zram_clear_flag(struct zram_meta *meta, u32 index,
 			enum zram_pageflags flag)
 {
-	meta->table[index].flags &= ~BIT(flag);
+	meta->table[index].value &= ~BIT(flag);
+}
+
+static size_t zram_get_obj_size(struct zram_meta *meta, u32 index)
+{
+	return meta->table[index].value & (BIT(ZRAM_FLAG_SHIFT) - 1);
+}
+
+static void zram_set_obj_size(struct zram_meta *meta,
+					u32 index, size_t size)
+{
+	unsigned long flags = meta->table[index].value >> ZRAM_FLAG_SHIFT;
+
+	meta->table[index].value = (flags << ZRAM_FLAG_SHIFT) | size;
 }
 
 static inline int is_partial_io(struct bio_vec *bvec)
@@ -255,7 +305,6 @@ static struct zram_meta *zram_meta_alloc(u64 disksize)
 		goto free_table;
 	}
 
-	rwlock_init(&meta->tb_lock);
 	return meta;
 
 free_table:
@@ -304,7 +353,7 @@ static void handle_zero_page(struct bio_vec *bvec)
 	flush_dcache_page(page);
 }
 
-/* NOTE: caller should hold meta->tb_lock with write-side */
+/* NOTE: caller should hold the slot lock of @index */
 static void zram_free_page(struct zram *zram, size_t index)
 {
 	struct zram_meta *meta = zram->meta;
@@ -324,11 +373,12 @@ static void zram_free_page(struct zram *zram, size_t index)
 
 	zs_free(meta->mem_pool, handle);
 
-	atomic64_sub(meta->table[index].size, &zram->stats.compr_data_size);
+	atomic64_sub(zram_get_obj_size(meta, index),
+			&zram->stats.compr_data_size);
 	atomic64_dec(&zram->stats.pages_stored);
 
 	meta->table[index].handle = 0;
-	meta->table[index].size = 0;
+	zram_set_obj_size(meta, index, 0);
 }
 
 static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
@@ -337,14 +387,14 @@ static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 	unsigned char *cmem;
 	struct zram_meta *meta = zram->meta;
 	unsigned long handle;
-	u16 size;
+	size_t size;
 
-	read_lock(&meta->tb_lock);
+	zram_lock_slot(meta, index);
 	handle = meta->table[index].handle;
-	size = meta->table[index].size;
+	size = zram_get_obj_size(meta, index);
 
 	if (!handle || zram_test_flag(meta, index, ZRAM_ZERO)) {
-		read_unlock(&meta->tb_lock);
+		zram_unlock_slot(meta, index);
 		clear_page(mem);
 		return 0;
 	}
@@ -355,7 +405,7 @@ static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 	else
 		ret = zcomp_decompress(zram->comp, cmem, size, mem);
 	zs_unmap_object(meta->mem_pool, handle);
-	read_unlock(&meta->tb_lock);
+	zram_unlock_slot(meta, index);
 
 	/* Should NEVER happen. Return bio error if it does. */
 	if (unlikely(ret)) {
@@ -376,14 +426,14 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 	struct zram_meta *meta = zram->meta;
 	page = bvec->bv_page;
 
-	read_lock(&meta->tb_lock);
+	zram_lock_slot(meta, index);
 	if (unlikely(!meta->table[index].handle) ||
 			zram_test_flag(meta, index, ZRAM_ZERO)) {
-		read_unlock(&meta->tb_lock);
+		zram_unlock_slot(meta, index);
 		handle_zero_page(bvec);
 		return 0;
 	}
-	read_unlock(&meta->tb_lock);
+	zram_unlock_slot(meta, index);
 
 	if (is_partial_io(bvec))
 		/* Use  a temporary buffer to decompress the page */
@@ -461,10 +511,10 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	if (page_zero_filled(uncmem)) {
 		kunmap_atomic(user_mem);
 		/* Free memory associated with this sector now. */
-		write_lock(&zram->meta->tb_lock);
+		zram_lock_slot(meta, index);
 		zram_free_page(zram, index);
 		zram_set_flag(meta, index, ZRAM_ZERO);
-		write_unlock(&zram->meta->tb_lock);
+		zram_unlock_slot(meta, index);
 
 		atomic64_inc(&zram->stats.zero_pages);
 		ret = 0;
@@ -514,12 +564,12 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	 * Free memory associated with this sector
 	 * before overwriting unused sectors.
 	 */
-	write_lock(&zram->meta->tb_lock);
+	zram_lock_slot(meta, index);
 	zram_free_page(zram, index);
 
 	meta->table[index].handle = handle;
-	meta->table[index].size = clen;
-	write_unlock(&zram->meta->tb_lock);
+	zram_set_obj_size(meta, index, clen);
+	zram_unlock_slot(meta, index);
 
 	/* Update stats */
 	atomic64_add(clen, &zram->stats.compr_data_size);
@@ -584,9 +634,9 @@ static void zram_bio_discard(struct zram *zram, u32 index,
 		 * Discard request can be large so the lock hold times could be
 		 * lengthy.  So take the lock once per page.
 		 */
-		write_lock(&zram->meta->tb_lock);
+		zram_lock_slot(zram->meta, index);
 		zram_free_page(zram, index);
-		write_unlock(&zram->meta->tb_lock);
+		zram_unlock_slot(zram->meta, index);
 		index++;
 		n -= PAGE_SIZE;
 	}
@@ -603,6 +653,9 @@ static void zram_reset_device(struct zram *zram, bool reset_capacity)
 		return;
 	}
 
+	/* Let the workers finish what make_request already queued */
+	wait_event(zram->io_wait, !atomic_read(&zram->pending));
+
 	meta = zram->meta;
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
@@ -769,6 +822,55 @@ out:
 	bio_io_error(bio);
 }
 
+static void zram_worker_fn(struct work_struct *work)
+{
+	struct zram_worker *worker = container_of(work, struct zram_worker,
+						  work);
+	struct zram *zram = worker->zram;
+	struct bio_list bios;
+	struct bio *bio;
+
+	spin_lock_irq(&worker->lock);
+	bios = worker->bios;
+	bio_list_init(&worker->bios);
+	spin_unlock_irq(&worker->lock);
+
+	/*
+	 * No init_lock here: zram_reset_device() waits for pending to drop
+	 * to zero before it tears down meta and comp.
+	 */
+	while ((bio = bio_list_pop(&bios))) {
+		__zram_make_request(zram, bio);
+		if (atomic_dec_and_test(&zram->pending))
+			wake_up(&zram->io_wait);
+	}
+}
+
+/*
+ * Spread writes round robin over the online cpus, so a single
+ * submitter (kswapd) gets as many compressors as there are cpus.
+ * Called with init_lock held for read.
+ */
+static void zram_queue_bio(struct zram *zram, struct bio *bio)
+{
+	struct zram_worker *worker;
+	unsigned long flags;
+	int cpu;
+
+	cpu = cpumask_next(ACCESS_ONCE(zram->next_cpu), cpu_online_mask);
+	if (cpu >= nr_cpu_ids)
+		cpu = cpumask_first(cpu_online_mask);
+	zram->next_cpu = cpu;
+
+	atomic_inc(&zram->pending);
+	worker = per_cpu_ptr(zram->workers, cpu);
+	spin_lock_irqsave(&worker->lock, flags);
+	bio_list_add(&worker->bios, bio);
+	spin_unlock_irqrestore(&worker->lock, flags);
+
+	queue_work_on(cpu, zram_wq, &worker->work);
+}
+
 /*
  * Handler function for all zram I/O requests.
  */
@@ -785,7 +887,12 @@ static void zram_make_request(struct request_queue *queue, struct bio *bio)
 		goto error;
 	}
 
-	__zram_make_request(zram, bio);
+	/* Reads are waited on synchronously, offloading only adds latency */
+	if (zram->async_write && bio_data_dir(bio) == WRITE &&
+	    !(bio->bi_rw & REQ_DISCARD))
+		zram_queue_bio(zram, bio);
+	else
+		__zram_make_request(zram, bio);
 	up_read(&zram->init_lock);
 
 	return;
@@ -804,9 +911,9 @@ static void zram_slot_free_notify(struct block_device *bdev,
 	zram = bdev->bd_disk->private_data;
 	meta = zram->meta;
 
-	write_lock(&meta->tb_lock);
+	zram_lock_slot(meta, index);
 	zram_free_page(zram, index);
-	write_unlock(&meta->tb_lock);
+	zram_unlock_slot(meta, index);
 	atomic64_inc(&zram->stats.notify_free);
 }
 
@@ -825,6 +932,8 @@ static DEVICE_ATTR(max_comp_streams, S_IRUGO | S_IWUSR,
 		max_comp_streams_show, max_comp_streams_store);
 static DEVICE_ATTR(comp_algorithm, S_IRUGO | S_IWUSR,
 		comp_algorithm_show, comp_algorithm_store);
+static DEVICE_ATTR(async_write, S_IRUGO | S_IWUSR,
+		async_write_show, async_write_store);
 
 ZRAM_ATTR_RO(num_reads);
 ZRAM_ATTR_RO(num_writes);
@@ -851,6 +960,7 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_mem_used_total.attr,
 	&dev_attr_max_comp_streams.attr,
 	&dev_attr_comp_algorithm.attr,
+	&dev_attr_async_write.attr,
 	NULL,
 };
 
@@ -861,14 +971,33 @@ static struct attribute_group zram_disk_attr_group = {
 static int create_device(struct zram *zram, int device_id)
 {
 	int ret = -ENOMEM;
+	int cpu;
 
 	init_rwsem(&zram->init_lock);
+	init_waitqueue_head(&zram->io_wait);
+	atomic_set(&zram->pending, 0);
+
+	zram->workers = alloc_percpu(struct zram_worker);
+	if (!zram->workers) {
+		pr_err("Error allocating workers for device %d\n",
+			device_id);
+		goto out;
+	}
+
+	for_each_possible_cpu(cpu) {
+		struct zram_worker *worker = per_cpu_ptr(zram->workers, cpu);
+
+		spin_lock_init(&worker->lock);
+		bio_list_init(&worker->bios);
+		INIT_WORK(&worker->work, zram_worker_fn);
+		worker->zram = zram;
+	}
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
 		pr_err("Error allocating disk queue for device %d\n",
 			device_id);
-		goto out;
+		goto out_free_workers;
 	}
 
 	blk_queue_make_request(zram->queue, zram_make_request);
@@ -936,6 +1065,8 @@ out_free_disk:
 	put_disk(zram->disk);
 out_free_queue:
 	blk_cleanup_queue(zram->queue);
+out_free_workers:
+	free_percpu(zram->workers);
 out:
 	return ret;
 }
@@ -949,6 +1080,9 @@ static void destroy_device(struct zram *zram)
 	put_disk(zram->disk);
 
 	blk_cleanup_queue(zram->queue);
+
+	wait_event(zram->io_wait, !atomic_read(&zram->pending));
+	free_percpu(zram->workers);
 }
 
 static int __init zram_init(void)
@@ -962,11 +1096,17 @@ static int __init zram_init(void)
 		goto out;
 	}
 
+	zram_wq = alloc_workqueue("zram", WQ_MEM_RECLAIM | WQ_HIGHPRI, 0);
+	if (!zram_wq) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
 	zram_major = register_blkdev(0, "zram");
 	if (zram_major <= 0) {
 		pr_warn("Unable to get major number\n");
 		ret = -EBUSY;
-		goto out;
+		goto destroy_wq;
 	}
 
 	/* Allocate the device array and initialize each one */
@@ -992,6 +1132,8 @@ free_devices:
 	kfree(zram_devices);
 unregister:
 	unregister_blkdev(zram_major, "zram");
+destroy_wq:
+	destroy_workqueue(zram_wq);
 out:
 	return ret;
 }
@@ -1013,6 +1155,7 @@ static void __exit zram_exit(void)
 	}
 
 	unregister_blkdev(zram_major, "zram");
+	destroy_workqueue(zram_wq);
 
 	kfree(zram_devices);
 	pr_debug("Cleanup done!\n");
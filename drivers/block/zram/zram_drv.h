@@ -16,6 +16,8 @@
 #define _ZRAM_DRV_H_
 
 #include <linux/spinlock.h>
+#include <linux/bio.h>
+#include <linux/workqueue.h>
 #include <linux/zsmalloc.h>
 
 #include "zcomp.h"
@@ -51,10 +53,18 @@ static const size_t max_zpage_size = PAGE_SIZE / 4 * 3;
 #define ZRAM_SECTOR_PER_LOGICAL_BLOCK	\
 	(1 << (ZRAM_LOGICAL_BLOCK_SHIFT - SECTOR_SHIFT))
 
-/* Flags for zram pages (table[page_no].flags) */
+/*
+ * The lower ZRAM_FLAG_SHIFT bits of table.value hold the object size
+ * (excluding header), the higher bits hold the zram_pageflags.
+ */
+#define ZRAM_FLAG_SHIFT 24
+
+/* Flags for zram pages (table[page_no].value) */
 enum zram_pageflags {
 	/* Page consists entirely of zeros */
-	ZRAM_ZERO,
+	ZRAM_ZERO = ZRAM_FLAG_SHIFT,
+	/* Slot lock, taken with bit_spin_lock() */
+	ZRAM_ACCESS,
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -64,9 +74,8 @@ enum zram_pageflags {
 /* Allocated for each disk page */
 struct table {
 	unsigned long handle;
-	u16 size;	/* object size (excluding header) */
-	u8 flags;
-} __aligned(4);
+	unsigned long value;
+};
 
 struct zram_stats {
 	atomic64_t compr_data_size;	/* compressed size of pages stored */
@@ -81,11 +90,18 @@ struct zram_stats {
 };
 
 struct zram_meta {
-	rwlock_t tb_lock;	/* protect table */
 	struct table *table;
 	struct zs_pool *mem_pool;
 };
 
+/* Per-cpu queue of write bios compressed off the submitting task */
+struct zram_worker {
+	spinlock_t lock;
+	struct bio_list bios;
+	struct work_struct work;
+	struct zram *zram;
+};
+
 struct zram {
 	struct zram_meta *meta;
 	struct request_queue *queue;
@@ -100,6 +116,13 @@ struct zram {
 	 */
 	u64 disksize;	/* bytes */
 	int max_comp_streams;
+	/* Hand write bios to the per-cpu workers instead of compressing inline */
+	bool async_write;
+	struct zram_worker __percpu *workers;
+	int next_cpu;
+	/* Bios queued to the workers and not yet completed */
+	atomic_t pending;
+	wait_queue_head_t io_wait;
 	struct zram_stats stats;
 	char compressor[10];
 };
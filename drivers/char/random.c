@@ -258,6 +258,8 @@
 #include <linux/workqueue.h>
 #include <linux/irq.h>
 
+#include <crypto/chacha20.h>
+
 #include <asm/processor.h>
 #include <asm/uaccess.h>
 #include <asm/irq.h>
@@ -1181,6 +1183,187 @@ static ssize_t extract_entropy_user(struct entropy_store *r, void __user *buf,
 	return ret;
 }
 
+/*********************************************************************
+ *
+ * Per-CPU output generators
+ *
+ *********************************************************************/
+
+/*
+ * Once the nonblocking pool is initialized, /dev/urandom and
+ * get_random_bytes() are served by ChaCha20 instead of extracting
+ * from the pool, so that readers no longer serialize on its lock.
+ *
+ * The primary key is reseeded from the nonblocking pool every
+ * CRNG_RESEED_INTERVAL.  Each CPU keeps a key of its own, derived
+ * from the primary key whenever the primary generation changes, and
+ * otherwise produces output without touching any shared cacheline.
+ * Every key is overwritten by output generated with it before that
+ * output is used, so a later compromise of the state does not reveal
+ * what was generated earlier.
+ *
+ * In FIPS mode the SHA extraction path, with its continuous test,
+ * stays in use.
+ */
+#define CRNG_RESEED_INTERVAL	(300 * HZ)
+#define CRNG_KEY_WORDS		(CHACHA20_KEY_SIZE / sizeof(__u32))
+
+struct crng_state {
+	__u32 key[CRNG_KEY_WORDS];
+	unsigned long generation;
+};
+
+static struct {
+	struct crng_state crng;
+	unsigned long birth;
+	spinlock_t lock;
+} primary_crng = {
+	.lock = __SPIN_LOCK_UNLOCKED(primary_crng.lock),
+};
+
+static DEFINE_PER_CPU(struct crng_state, crng_pcpu);
+
+static inline bool crng_ready(void)
+{
+	return nonblocking_pool.initialized && !fips_enabled;
+}
+
+/*
+ * Folds fresh output of the nonblocking pool into the primary key and
+ * bumps the generation, so every CPU rekeys on its next use.  Racing
+ * reseeds are harmless: each one only adds more key material.
+ */
+static void crng_reseed(void)
+{
+	__u32 key[CRNG_KEY_WORDS];
+	unsigned long flags;
+	int i;
+
+	extract_entropy(&nonblocking_pool, key, sizeof(key), 0, 0);
+
+	spin_lock_irqsave(&primary_crng.lock, flags);
+	for (i = 0; i < CRNG_KEY_WORDS; i++)
+		primary_crng.crng.key[i] ^= key[i];
+	if (++primary_crng.crng.generation == 0)
+		primary_crng.crng.generation = 1;
+	primary_crng.birth = jiffies;
+	spin_unlock_irqrestore(&primary_crng.lock, flags);
+
+	memset(key, 0, sizeof(key));
+}
+
+static void crng_init_state(__u32 state[16], const __u32 *key)
+{
+	state[0] = 0x61707865;	/* "expand 32-byte k" */
+	state[1] = 0x3320646e;
+	state[2] = 0x79622d32;
+	state[3] = 0x6b206574;
+	memcpy(&state[4], key, CHACHA20_KEY_SIZE);
+	state[12] = state[13] = state[14] = state[15] = 0;
+}
+
+/*
+ * Sets up @state with a key for the caller's exclusive use, taken
+ * from this CPU's generator, which moves on to a fresh key.
+ */
+static void crng_make_state(__u32 state[16])
+{
+	struct crng_state *crng;
+	__u8 block[CHACHA20_BLOCK_SIZE];
+	unsigned long flags, v;
+
+	if (unlikely(!ACCESS_ONCE(primary_crng.crng.generation) ||
+		     time_after(jiffies, ACCESS_ONCE(primary_crng.birth) +
+				CRNG_RESEED_INTERVAL)))
+		crng_reseed();
+
+	local_irq_save(flags);
+	crng = &__get_cpu_var(crng_pcpu);
+
+	if (unlikely(crng->generation !=
+		     ACCESS_ONCE(primary_crng.crng.generation))) {
+		spin_lock(&primary_crng.lock);
+		crng_init_state(state, primary_crng.crng.key);
+		chacha20_block(state, block);
+		memcpy(primary_crng.crng.key, block, CHACHA20_KEY_SIZE);
+		memcpy(crng->key, block + CHACHA20_KEY_SIZE,
+		       CHACHA20_KEY_SIZE);
+		crng->generation = primary_crng.crng.generation;
+		spin_unlock(&primary_crng.lock);
+	}
+
+	crng_init_state(state, crng->key);
+	chacha20_block(state, block);
+	memcpy(crng->key, block, CHACHA20_KEY_SIZE);
+	local_irq_restore(flags);
+
+	crng_init_state(state, (__u32 *)(block + CHACHA20_KEY_SIZE));
+	if (arch_get_random_long(&v))
+		state[14] ^= v;
+	memset(block, 0, sizeof(block));
+}
+
+static void crng_next_block(__u32 state[16], __u8 *block)
+{
+	chacha20_block(state, block);
+	if (unlikely(state[12] == 0))
+		state[13]++;
+}
+
+static void extract_crng(void *buf, size_t nbytes)
+{
+	__u32 state[16];
+	__u8 tmp[CHACHA20_BLOCK_SIZE];
+	size_t i;
+
+	crng_make_state(state);
+	while (nbytes) {
+		crng_next_block(state, tmp);
+		i = min_t(size_t, nbytes, CHACHA20_BLOCK_SIZE);
+		memcpy(buf, tmp, i);
+		nbytes -= i;
+		buf += i;
+	}
+
+	memset(tmp, 0, sizeof(tmp));
+	memset(state, 0, sizeof(state));
+}
+
+static ssize_t extract_crng_user(void __user *buf, size_t nbytes)
+{
+	ssize_t ret = 0, i;
+	__u32 state[16];
+	__u8 tmp[CHACHA20_BLOCK_SIZE];
+
+	crng_make_state(state);
+	while (nbytes) {
+		if (need_resched()) {
+			if (signal_pending(current)) {
+				if (ret == 0)
+					ret = -ERESTARTSYS;
+				break;
+			}
+			schedule();
+		}
+
+		crng_next_block(state, tmp);
+		i = min_t(size_t, nbytes, CHACHA20_BLOCK_SIZE);
+		if (copy_to_user(buf, tmp, i)) {
+			ret = -EFAULT;
+			break;
+		}
+
+		nbytes -= i;
+		buf += i;
+		ret += i;
+	}
+
+	memset(tmp, 0, sizeof(tmp));
+	memset(state, 0, sizeof(state));
+
+	return ret;
+}
+
 /*
  * This function is the exported kernel interface.  It returns some
  * number of good random numbers, suitable for key generation, seeding
@@ -1198,7 +1381,10 @@ void get_random_bytes(void *buf, int nbytes)
 		       nonblocking_pool.entropy_total);
 #endif
 	trace_get_random_bytes(nbytes, _RET_IP_);
-	extract_entropy(&nonblocking_pool, buf, nbytes, 0, 0);
+	if (crng_ready())
+		extract_crng(buf, nbytes);
+	else
+		extract_entropy(&nonblocking_pool, buf, nbytes, 0, 0);
 }
 EXPORT_SYMBOL(get_random_bytes);
 
@@ -1229,7 +1415,9 @@ void get_random_bytes_arch(void *buf, int nbytes)
 		nbytes -= chunk;
 	}
 
-	if (nbytes)
+	if (nbytes && crng_ready())
+		extract_crng(p, nbytes);
+	else if (nbytes)
 		extract_entropy(&nonblocking_pool, p, nbytes, 0, 0);
 }
 EXPORT_SYMBOL(get_random_bytes_arch);
@@ -1374,7 +1562,10 @@ urandom_read(struct file *file, char __user *buf, size_t nbytes, loff_t *ppos)
 			    "with %d bits of entropy available\n",
 			    current->comm, nonblocking_pool.entropy_total);
 
-	ret = extract_entropy_user(&nonblocking_pool, buf, nbytes);
+	if (crng_ready())
+		ret = extract_crng_user(buf, nbytes);
+	else
+		ret = extract_entropy_user(&nonblocking_pool, buf, nbytes);
 
 	trace_urandom_read(8 * nbytes, ENTROPY_BITS(&nonblocking_pool),
 			   ENTROPY_BITS(&input_pool));
@@ -38,6 +38,8 @@
 
 struct eb_vmas {
 	struct list_head vmas;
+	struct drm_i915_gem_object **objects;
+	unsigned int count;
 	int and;
 	union {
 		struct i915_vma *lut[0];
@@ -73,6 +75,13 @@ eb_create(struct drm_i915_gem_execbuffer2 *args)
 	} else
 		eb->and = -args->buffer_count;
 
+	eb->objects = drm_malloc_ab(args->buffer_count, sizeof(*eb->objects));
+	if (eb->objects == NULL) {
+		kfree(eb);
+		return NULL;
+	}
+	eb->count = 0;
+
 	INIT_LIST_HEAD(&eb->vmas);
 	return eb;
 }
@@ -84,44 +93,64 @@ eb_reset(struct eb_vmas *eb)
 		memset(eb->buckets, 0, (eb->and+1)*sizeof(struct hlist_head));
 }
 
+/*
+ * Look the handles up and take a reference on their objects.  This only
+ * needs the file's table_lock, so it is done before taking struct_mutex,
+ * once per execbuffer: the references keep the objects around until
+ * eb_destroy(), including across the unlocked relocation slow path.
+ */
 static int
-eb_lookup_vmas(struct eb_vmas *eb,
-	       struct drm_i915_gem_exec_object2 *exec,
-	       const struct drm_i915_gem_execbuffer2 *args,
-	       struct i915_address_space *vm,
-	       struct drm_file *file)
+eb_lookup_objects(struct eb_vmas *eb,
+		  struct drm_i915_gem_exec_object2 *exec,
+		  const struct drm_i915_gem_execbuffer2 *args,
+		  struct drm_file *file)
 {
-	struct drm_i915_private *dev_priv = vm->dev->dev_private;
-	struct drm_i915_gem_object *obj;
-	struct list_head objects;
-	int i, ret;
+	int i;
 
-	INIT_LIST_HEAD(&objects);
 	spin_lock(&file->table_lock);
-	/* Grab a reference to the object and release the lock so we can lookup
-	 * or create the VMA without using GFP_ATOMIC */
 	for (i = 0; i < args->buffer_count; i++) {
+		struct drm_i915_gem_object *obj;
+
 		obj = to_intel_bo(idr_find(&file->object_idr, exec[i].handle));
 		if (obj == NULL) {
 			spin_unlock(&file->table_lock);
 			DRM_DEBUG("Invalid object handle %d at index %d\n",
 				   exec[i].handle, i);
-			ret = -ENOENT;
-			goto err;
+			return -ENOENT;
 		}
 
+		drm_gem_object_reference(&obj->base);
+		eb->objects[eb->count++] = obj;
+	}
+	spin_unlock(&file->table_lock);
+
+	return 0;
+}
+
+static int
+eb_lookup_vmas(struct eb_vmas *eb,
+	       struct drm_i915_gem_exec_object2 *exec,
+	       const struct drm_i915_gem_execbuffer2 *args,
+	       struct i915_address_space *vm)
+{
+	struct drm_i915_private *dev_priv = vm->dev->dev_private;
+	struct drm_i915_gem_object *obj;
+	struct list_head objects;
+	int i, ret;
+
+	INIT_LIST_HEAD(&objects);
+	for (i = 0; i < eb->count; i++) {
+		obj = eb->objects[i];
+
 		if (!list_empty(&obj->obj_exec_link)) {
-			spin_unlock(&file->table_lock);
 			DRM_DEBUG("Object %p [handle %d, index %d] appears more than once in object list\n",
 				   obj, exec[i].handle, i);
 			ret = -EINVAL;
 			goto err;
 		}
 
-		drm_gem_object_reference(&obj->base);
 		list_add_tail(&obj->obj_exec_link, &objects);
 	}
-	spin_unlock(&file->table_lock);
 
 	i = 0;
 	while (!list_empty(&objects)) {
@@ -160,7 +189,7 @@ eb_lookup_vmas(struct eb_vmas *eb,
 			goto err;
 		}
 
-		/* Transfer ownership from the objects list to the vmas list. */
+		/* Transfer from the objects list to the vmas list. */
 		list_add_tail(&vma->exec_list, &eb->vmas);
 		list_del_init(&obj->obj_exec_link);
 
@@ -185,11 +214,10 @@ err:
 				       struct drm_i915_gem_object,
 				       obj_exec_link);
 		list_del_init(&obj->obj_exec_link);
-		drm_gem_object_unreference(&obj->base);
 	}
 	/*
-	 * Objects already transfered to the vmas list will be unreferenced by
-	 * eb_destroy.
+	 * Objects already transfered to the vmas list are taken off it by
+	 * eb_destroy, which drops all the references.
 	 */
 
 	return ret;
@@ -239,6 +267,8 @@ i915_gem_execbuffer_unreserve_vma(struct i915_vma *vma)
 
 static void eb_destroy(struct eb_vmas *eb)
 {
+	unsigned int i;
+
 	while (!list_empty(&eb->vmas)) {
 		struct i915_vma *vma;
 
@@ -247,8 +277,22 @@ static void eb_destroy(struct eb_vmas *eb)
 				       exec_list);
 		list_del_init(&vma->exec_list);
 		i915_gem_execbuffer_unreserve_vma(vma);
-		drm_gem_object_unreference(&vma->obj->base);
 	}
+
+	for (i = 0; i < eb->count; i++)
+		drm_gem_object_unreference(&eb->objects[i]->base);
+	drm_free_large(eb->objects);
+	kfree(eb);
+}
+
+/* For the errors before struct_mutex is taken, there are no vmas yet */
+static void eb_destroy_unlocked(struct eb_vmas *eb)
+{
+	unsigned int i;
+
+	for (i = 0; i < eb->count; i++)
+		drm_gem_object_unreference_unlocked(&eb->objects[i]->base);
+	drm_free_large(eb->objects);
 	kfree(eb);
 }
 
@@ -707,7 +751,6 @@ err:
 static int
 i915_gem_execbuffer_relocate_slow(struct drm_device *dev,
 				  struct drm_i915_gem_execbuffer2 *args,
-				  struct drm_file *file,
 				  struct intel_ring_buffer *ring,
 				  struct eb_vmas *eb,
 				  struct drm_i915_gem_exec_object2 *exec)
@@ -725,12 +768,13 @@ i915_gem_execbuffer_relocate_slow(struct drm_device *dev,
 
 	vm = list_first_entry(&eb->vmas, struct i915_vma, exec_list)->vm;
 
-	/* We may process another execbuffer during the unlock... */
+	/* We may process another execbuffer during the unlock, which may use
+	 * the same objects. They stay referenced by eb->objects meanwhile.
+	 */
 	while (!list_empty(&eb->vmas)) {
 		vma = list_first_entry(&eb->vmas, struct i915_vma, exec_list);
 		list_del_init(&vma->exec_list);
 		i915_gem_execbuffer_unreserve_vma(vma);
-		drm_gem_object_unreference(&vma->obj->base);
 	}
 
 	mutex_unlock(&dev->struct_mutex);
@@ -792,9 +836,9 @@ i915_gem_execbuffer_relocate_slow(struct drm_device *dev,
 		goto err;
 	}
 
-	/* reacquire the objects */
+	/* rebuild the vma list */
 	eb_reset(eb);
-	ret = eb_lookup_vmas(eb, exec, args, vm, file);
+	ret = eb_lookup_vmas(eb, exec, args, vm);
 	if (ret)
 		goto err;
 
@@ -1117,22 +1161,35 @@ i915_gem_do_execbuffer(struct drm_device *dev, void *data,
 
 	intel_runtime_pm_get(dev_priv);
 
+	eb = eb_create(args);
+	if (eb == NULL) {
+		ret = -ENOMEM;
+		goto pre_mutex_err;
+	}
+
+	/* Look up object handles, struct_mutex is not needed for that */
+	ret = eb_lookup_objects(eb, exec, args, file);
+	if (ret) {
+		eb_destroy_unlocked(eb);
+		goto pre_mutex_err;
+	}
+
 	ret = i915_mutex_lock_interruptible(dev);
-	if (ret)
+	if (ret) {
+		eb_destroy_unlocked(eb);
 		goto pre_mutex_err;
+	}
 
 	if (dev_priv->ums.mm_suspended) {
-		mutex_unlock(&dev->struct_mutex);
 		ret = -EBUSY;
-		goto pre_mutex_err;
+		goto err_unlock;
 	}
 
 	ctx = i915_gem_validate_context(dev, file, ring, ctx_id);
 	if (IS_ERR(ctx)) {
-		mutex_unlock(&dev->struct_mutex);
 		ret = PTR_ERR(ctx);
-		goto pre_mutex_err;
-	} 
+		goto err_unlock;
+	}
 
 	i915_gem_context_reference(ctx);
 
@@ -1140,15 +1197,7 @@ i915_gem_do_execbuffer(struct drm_device *dev, void *data,
 	if (!USES_FULL_PPGTT(dev))
 		vm = &dev_priv->gtt.base;
 
-	eb = eb_create(args);
-	if (eb == NULL) {
-		mutex_unlock(&dev->struct_mutex);
-		ret = -ENOMEM;
-		goto pre_mutex_err;
-	}
-
-	/* Look up object handles */
-	ret = eb_lookup_vmas(eb, exec, args, vm, file);
+	ret = eb_lookup_vmas(eb, exec, args, vm);
 	if (ret)
 		goto err;
 
@@ -1166,7 +1215,7 @@ i915_gem_do_execbuffer(struct drm_device *dev, void *data,
 		ret = i915_gem_execbuffer_relocate(eb);
 	if (ret) {
 		if (ret == -EFAULT) {
-			ret = i915_gem_execbuffer_relocate_slow(dev, args, file, ring,
+			ret = i915_gem_execbuffer_relocate_slow(dev, args, ring,
 								eb, exec);
 			BUG_ON(!mutex_is_locked(&dev->struct_mutex));
 		}
@@ -1277,6 +1326,7 @@ i915_gem_do_execbuffer(struct drm_device *dev, void *data,
 err:
 	/* the request owns the ref now */
 	i915_gem_context_unreference(ctx);
+err_unlock:
 	eb_destroy(eb);
 
 	mutex_unlock(&dev->struct_mutex);
@@ -29,6 +29,9 @@
  * - Pool collects resently freed pages for reuse
  * - Use page->lru to keep a free list
  * - doesn't track currently in use pages
+ * - One set of pools per NUMA node, pages go back to the pool of their node
+ * - Global dma32 pools, ZONE_DMA32 usually lives on a single node
+ * - New pages come in huge page sized chunks when memory isn't fragmented
  */
 
 #define pr_fmt(fmt) "[TTM] " fmt
@@ -55,6 +58,9 @@
 #define NUM_PAGES_TO_ALLOC		(PAGE_SIZE/sizeof(struct page *))
 #define SMALL_ALLOCATION		16
 #define FREE_ALL_PAGES			(~0U)
+/* new pages are split from such blocks when they are available */
+#define HUGE_ORDER			min_t(unsigned, PMD_SHIFT - PAGE_SHIFT, \
+					      MAX_ORDER - 1)
 /* times are in msecs */
 #define PAGE_FREE_INTERVAL		1000
 
@@ -67,6 +73,7 @@
  * @fill_lock: Prevent concurrent calls to fill.
  * @list: Pool of free uc/wc pages for fast reuse.
  * @gfp_flags: Flags to pass for alloc_page.
+ * @nid: NUMA node of the pages of the pool, NUMA_NO_NODE for any.
  * @npages: Number of pages in pool.
  */
 struct ttm_page_pool {
@@ -74,6 +81,7 @@ struct ttm_page_pool {
 	bool			fill_lock;
 	struct list_head	list;
 	gfp_t			gfp_flags;
+	int			nid;
 	unsigned		npages;
 	char			*name;
 	unsigned long		nfrees;
@@ -92,7 +100,8 @@ struct ttm_pool_opts {
 	unsigned	small;
 };
 
-#define NUM_POOLS 4
+#define NUM_DMA32_POOLS 2
+#define NUM_NODE_POOLS 2
 
 /**
  * struct ttm_pool_manager - Holds memory pools for fst allocation
@@ -105,22 +114,16 @@ struct ttm_pool_opts {
  * some pages to free.
  * @small_allocation: Limit in number of pages what is small allocation.
  *
- * @pools: All pool objects in use.
+ * @pools: All pool objects in use: the global wc dma32 and uc dma32 ones,
+ * then NUM_NODE_POOLS per node: wc and uc.
  **/
 struct ttm_pool_manager {
 	struct kobject		kobj;
 	struct shrinker		mm_shrink;
 	struct ttm_pool_opts	options;
 
-	union {
-		struct ttm_page_pool	pools[NUM_POOLS];
-		struct {
-			struct ttm_page_pool	wc_pool;
-			struct ttm_page_pool	uc_pool;
-			struct ttm_page_pool	wc_pool_dma32;
-			struct ttm_page_pool	uc_pool_dma32;
-		} ;
-	};
+	struct ttm_page_pool	*pools;
+	unsigned		npools;
 };
 
 static struct attribute ttm_page_pool_max = {
@@ -147,6 +150,7 @@ static void ttm_pool_kobj_release(struct kobject *kobj)
 {
 	struct ttm_pool_manager *m =
 		container_of(kobj, struct ttm_pool_manager, kobj);
+	kfree(m->pools);
 	kfree(m);
 }
 
@@ -252,9 +256,9 @@ static int set_pages_array_uc(struct page **pages, int addrinarray)
 #endif
 
 /**
- * Select the right pool or requested caching state and ttm flags. */
+ * Select the right pool or requested caching state, ttm flags and node. */
 static struct ttm_page_pool *ttm_get_pool(int flags,
-		enum ttm_caching_state cstate)
+		enum ttm_caching_state cstate, int nid)
 {
 	int pool_index;
 
@@ -267,9 +271,10 @@ static struct ttm_page_pool *ttm_get_pool(int flags,
 		pool_index = 0x1;
 
 	if (flags & TTM_PAGE_FLAG_DMA32)
-		pool_index |= 0x2;
+		return &_manager->pools[pool_index];
 
-	return &_manager->pools[pool_index];
+	return &_manager->pools[NUM_DMA32_POOLS + nid * NUM_NODE_POOLS +
+				pool_index];
 }
 
 /* set memory back to wb and free the pages. */
@@ -398,13 +403,13 @@ ttm_pool_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
 	int shrink_pages = sc->nr_to_scan;
 	unsigned long freed = 0;
 
-	pool_offset = pool_offset % NUM_POOLS;
+	pool_offset = pool_offset % _manager->npools;
 	/* select start pool in round robin fashion */
-	for (i = 0; i < NUM_POOLS; ++i) {
+	for (i = 0; i < _manager->npools; ++i) {
 		unsigned nr_free = shrink_pages;
 		if (shrink_pages == 0)
 			break;
-		pool = &_manager->pools[(i + pool_offset)%NUM_POOLS];
+		pool = &_manager->pools[(i + pool_offset) % _manager->npools];
 		shrink_pages = ttm_page_pool_free(pool, nr_free);
 		freed += nr_free - shrink_pages;
 	}
@@ -418,7 +423,7 @@ ttm_pool_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
 	unsigned i;
 	unsigned long count = 0;
 
-	for (i = 0; i < NUM_POOLS; ++i)
+	for (i = 0; i < _manager->npools; ++i)
 		count += _manager->pools[i].npages;
 
 	return count;
@@ -476,6 +481,33 @@ static void ttm_handle_caching_state_failure(struct list_head *pages,
 	}
 }
 
+/**
+ * Allocate a block of pages on @nid: a huge page sized one split into single
+ * pages if @count allows and there is one at hand, a single page otherwise.
+ * Longer runs of contiguous pages are cheaper to change the caching of and
+ * map.
+ *
+ * @return the first page of the block, and its number of pages in @npages.
+ */
+static struct page *ttm_alloc_page_block(gfp_t gfp_flags, int nid,
+		unsigned count, unsigned *npages)
+{
+	struct page *p;
+
+	if (count >= (1 << HUGE_ORDER)) {
+		p = alloc_pages_node(nid, gfp_flags | __GFP_NORETRY |
+				     __GFP_NOWARN, HUGE_ORDER);
+		if (p) {
+			split_page(p, HUGE_ORDER);
+			*npages = 1 << HUGE_ORDER;
+			return p;
+		}
+	}
+
+	*npages = 1;
+	return alloc_pages_node(nid, gfp_flags, 0);
+}
+
 /**
  * Allocate new pages with correct caching.
  *
@@ -483,12 +515,13 @@ static void ttm_handle_caching_state_failure(struct list_head *pages,
  * pages returned in pages array.
  */
 static int ttm_alloc_new_pages(struct list_head *pages, gfp_t gfp_flags,
-		int ttm_flags, enum ttm_caching_state cstate, unsigned count)
+		int ttm_flags, enum ttm_caching_state cstate, unsigned count,
+		int nid)
 {
 	struct page **caching_array;
 	struct page *p;
 	int r = 0;
-	unsigned i, cpages;
+	unsigned i, j, cpages, nblock;
 	unsigned max_cpages = min(count,
 			(unsigned)(PAGE_SIZE/sizeof(struct page *)));
 
@@ -500,8 +533,8 @@ static int ttm_alloc_new_pages(struct list_head *pages, gfp_t gfp_flags,
 		return -ENOMEM;
 	}
 
-	for (i = 0, cpages = 0; i < count; ++i) {
-		p = alloc_page(gfp_flags);
+	for (i = 0, cpages = 0; i < count; i += nblock) {
+		p = ttm_alloc_page_block(gfp_flags, nid, count - i, &nblock);
 
 		if (!p) {
 			pr_err("Unable to get page %u\n", i);
@@ -520,13 +553,16 @@ static int ttm_alloc_new_pages(struct list_head *pages, gfp_t gfp_flags,
 			goto out;
 		}
 
+		for (j = 0; j < nblock; j++, p++) {
+			list_add(&p->lru, pages);
+
 #ifdef CONFIG_HIGHMEM
-		/* gfp flags of highmem page should never be dma32 so we
-		 * we should be fine in such case
-		 */
-		if (!PageHighMem(p))
+			/* gfp flags of highmem page should never be dma32 so
+			 * we should be fine in such case
+			 */
+			if (PageHighMem(p))
+				continue;
 #endif
-		{
 			caching_array[cpages++] = p;
 			if (cpages == max_cpages) {
 
@@ -536,13 +572,14 @@ static int ttm_alloc_new_pages(struct list_head *pages, gfp_t gfp_flags,
 					ttm_handle_caching_state_failure(pages,
 						ttm_flags, cstate,
 						caching_array, cpages);
+					/* and the rest of the block */
+					while (++j < nblock)
+						__free_page(++p);
 					goto out;
 				}
 				cpages = 0;
 			}
 		}
-
-		list_add(&p->lru, pages);
 	}
 
 	if (cpages) {
@@ -594,7 +631,7 @@ static void ttm_page_pool_fill_locked(struct ttm_page_pool *pool,
 
 		INIT_LIST_HEAD(&new_pages);
 		r = ttm_alloc_new_pages(&new_pages, pool->gfp_flags, ttm_flags,
-				cstate,	alloc_size);
+				cstate,	alloc_size, pool->nid);
 		spin_lock_irqsave(&pool->lock, *irq_flags);
 
 		if (!r) {
@@ -664,30 +701,33 @@ out:
 	return count;
 }
 
-/* Put all pages in pages list to correct pool to wait for reuse */
-static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
-			  enum ttm_caching_state cstate)
+/*
+ * Put the pages from @start on to the pool of the node of the first one, up
+ * to the first page of another node; all of them for the dma32 pools.
+ *
+ * @return the index of that page.
+ */
+static unsigned ttm_put_pages_node(struct page **pages, unsigned start,
+				   unsigned npages, int flags,
+				   enum ttm_caching_state cstate)
 {
 	unsigned long irq_flags;
-	struct ttm_page_pool *pool = ttm_get_pool(flags, cstate);
+	struct ttm_page_pool *pool;
 	unsigned i;
 
-	if (pool == NULL) {
-		/* No pool for this memory type so free the pages */
-		for (i = 0; i < npages; i++) {
-			if (pages[i]) {
-				if (page_count(pages[i]) != 1)
-					pr_err("Erroneous page count. Leaking pages.\n");
-				__free_page(pages[i]);
-				pages[i] = NULL;
-			}
-		}
-		return;
-	}
+	while (start < npages && !pages[start])
+		start++;
+	if (start == npages)
+		return npages;
+
+	pool = ttm_get_pool(flags, cstate, page_to_nid(pages[start]));
 
 	spin_lock_irqsave(&pool->lock, irq_flags);
-	for (i = 0; i < npages; i++) {
+	for (i = start; i < npages; i++) {
 		if (pages[i]) {
+			if (pool->nid != NUMA_NO_NODE &&
+			    page_to_nid(pages[i]) != pool->nid)
+				break;
 			if (page_count(pages[i]) != 1)
 				pr_err("Erroneous page count. Leaking pages.\n");
 			list_add_tail(&pages[i]->lru, &pool->list);
@@ -695,6 +735,7 @@ static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
 			pool->npages++;
 		}
 	}
+	start = i;
 	/* Check that we don't go over the pool limit */
 	npages = 0;
 	if (pool->npages > _manager->options.max_size) {
@@ -707,6 +748,34 @@ static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
 	spin_unlock_irqrestore(&pool->lock, irq_flags);
 	if (npages)
 		ttm_page_pool_free(pool, npages);
+
+	return start;
+}
+
+/* Put all pages in pages list to correct pool to wait for reuse */
+static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
+			  enum ttm_caching_state cstate)
+{
+	struct ttm_page_pool *pool = ttm_get_pool(flags, cstate, 0);
+	unsigned i;
+
+	if (pool == NULL) {
+		/* No pool for this memory type so free the pages */
+		for (i = 0; i < npages; i++) {
+			if (pages[i]) {
+				if (page_count(pages[i]) != 1)
+					pr_err("Erroneous page count. Leaking pages.\n");
+				__free_page(pages[i]);
+				pages[i] = NULL;
+			}
+		}
+		return;
+	}
+
+	/* in runs of pages of the same node, usually a single one */
+	i = 0;
+	while (i < npages)
+		i = ttm_put_pages_node(pages, i, npages, flags, cstate);
 }
 
 /*
@@ -716,7 +785,8 @@ static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
 static int ttm_get_pages(struct page **pages, unsigned npages, int flags,
 			 enum ttm_caching_state cstate)
 {
-	struct ttm_page_pool *pool = ttm_get_pool(flags, cstate);
+	struct ttm_page_pool *pool = ttm_get_pool(flags, cstate,
+						  numa_node_id());
 	struct list_head plist;
 	struct page *p = NULL;
 	gfp_t gfp_flags = GFP_USER;
@@ -739,6 +809,7 @@ static int ttm_get_pages(struct page **pages, unsigned npages, int flags,
 			if (!p) {
 
 				pr_err("Unable to allocate page\n");
+				ttm_put_pages(pages, r, flags, cstate);
 				return -ENOMEM;
 			}
 
@@ -774,7 +845,8 @@ static int ttm_get_pages(struct page **pages, unsigned npages, int flags,
 		 * multiple requests in parallel.
 		 **/
 		INIT_LIST_HEAD(&plist);
-		r = ttm_alloc_new_pages(&plist, gfp_flags, flags, cstate, npages);
+		r = ttm_alloc_new_pages(&plist, gfp_flags, flags, cstate, npages,
+					pool->nid);
 		list_for_each_entry(p, &plist, lru) {
 			pages[count++] = p;
 		}
@@ -791,35 +863,54 @@ static int ttm_get_pages(struct page **pages, unsigned npages, int flags,
 }
 
 static void ttm_page_pool_init_locked(struct ttm_page_pool *pool, int flags,
-		char *name)
+		char *name, int nid)
 {
 	spin_lock_init(&pool->lock);
 	pool->fill_lock = false;
 	INIT_LIST_HEAD(&pool->list);
 	pool->npages = pool->nfrees = 0;
 	pool->gfp_flags = flags;
+	pool->nid = nid;
 	pool->name = name;
 }
 
 int ttm_page_alloc_init(struct ttm_mem_global *glob, unsigned max_pages)
 {
-	int ret;
+	struct ttm_page_pool *pools;
+	int ret, nid;
 
 	WARN_ON(_manager);
 
 	pr_info("Initializing pool allocator\n");
 
 	_manager = kzalloc(sizeof(*_manager), GFP_KERNEL);
+	if (!_manager)
+		return -ENOMEM;
 
-	ttm_page_pool_init_locked(&_manager->wc_pool, GFP_HIGHUSER, "wc");
+	_manager->npools = NUM_DMA32_POOLS + NUM_NODE_POOLS * nr_node_ids;
+	_manager->pools = kcalloc(_manager->npools, sizeof(*_manager->pools),
+				  GFP_KERNEL);
+	if (!_manager->pools) {
+		kfree(_manager);
+		_manager = NULL;
+		return -ENOMEM;
+	}
 
-	ttm_page_pool_init_locked(&_manager->uc_pool, GFP_HIGHUSER, "uc");
+	pools = _manager->pools;
 
-	ttm_page_pool_init_locked(&_manager->wc_pool_dma32,
-				  GFP_USER | GFP_DMA32, "wc dma");
+	ttm_page_pool_init_locked(&pools[0], GFP_USER | GFP_DMA32, "wc dma",
+				  NUMA_NO_NODE);
 
-	ttm_page_pool_init_locked(&_manager->uc_pool_dma32,
-				  GFP_USER | GFP_DMA32, "uc dma");
+	ttm_page_pool_init_locked(&pools[1], GFP_USER | GFP_DMA32, "uc dma",
+				  NUMA_NO_NODE);
+
+	for (nid = 0; nid < nr_node_ids; nid++) {
+		pools = &_manager->pools[NUM_DMA32_POOLS + nid * NUM_NODE_POOLS];
+
+		ttm_page_pool_init_locked(&pools[0], GFP_HIGHUSER, "wc", nid);
+
+		ttm_page_pool_init_locked(&pools[1], GFP_HIGHUSER, "uc", nid);
+	}
 
 	_manager->options.max_size = max_pages;
 	_manager->options.small = SMALL_ALLOCATION;
@@ -845,13 +936,28 @@ void ttm_page_alloc_fini(void)
 	pr_info("Finalizing pool allocator\n");
 	ttm_pool_mm_shrink_fini(_manager);
 
-	for (i = 0; i < NUM_POOLS; ++i)
+	for (i = 0; i < _manager->npools; ++i)
 		ttm_page_pool_free(&_manager->pools[i], FREE_ALL_PAGES);
 
 	kobject_put(&_manager->kobj);
 	_manager = NULL;
 }
 
+/* Only the first @mem_count pages are accounted in the global memory */
+static void ttm_pool_unpopulate_helper(struct ttm_tt *ttm, unsigned mem_count)
+{
+	unsigned i;
+
+	for (i = 0; i < mem_count; ++i) {
+		if (ttm->pages[i])
+			ttm_mem_global_free_page(ttm->glob->mem_glob,
+						 ttm->pages[i]);
+	}
+	ttm_put_pages(ttm->pages, ttm->num_pages, ttm->page_flags,
+		      ttm->caching_state);
+	ttm->state = tt_unpopulated;
+}
+
 int ttm_pool_populate(struct ttm_tt *ttm)
 {
 	struct ttm_mem_global *mem_glob = ttm->glob->mem_glob;
@@ -861,19 +967,17 @@ int ttm_pool_populate(struct ttm_tt *ttm)
 	if (ttm->state != tt_unpopulated)
 		return 0;
 
-	for (i = 0; i < ttm->num_pages; ++i) {
-		ret = ttm_get_pages(&ttm->pages[i], 1,
-				    ttm->page_flags,
-				    ttm->caching_state);
-		if (ret != 0) {
-			ttm_pool_unpopulate(ttm);
-			return -ENOMEM;
-		}
+	/* all at once, so that the caching changes are done in batches */
+	ret = ttm_get_pages(ttm->pages, ttm->num_pages, ttm->page_flags,
+			    ttm->caching_state);
+	if (ret != 0)
+		return -ENOMEM;
 
+	for (i = 0; i < ttm->num_pages; ++i) {
 		ret = ttm_mem_global_alloc_page(mem_glob, ttm->pages[i],
 						false, false);
 		if (unlikely(ret != 0)) {
-			ttm_pool_unpopulate(ttm);
+			ttm_pool_unpopulate_helper(ttm, i);
 			return -ENOMEM;
 		}
 	}
@@ -893,18 +997,7 @@ EXPORT_SYMBOL(ttm_pool_populate);
 
 void ttm_pool_unpopulate(struct ttm_tt *ttm)
 {
-	unsigned i;
-
-	for (i = 0; i < ttm->num_pages; ++i) {
-		if (ttm->pages[i]) {
-			ttm_mem_global_free_page(ttm->glob->mem_glob,
-						 ttm->pages[i]);
-			ttm_put_pages(&ttm->pages[i], 1,
-				      ttm->page_flags,
-				      ttm->caching_state);
-		}
-	}
-	ttm->state = tt_unpopulated;
+	ttm_pool_unpopulate_helper(ttm, ttm->num_pages);
 }
 EXPORT_SYMBOL(ttm_pool_unpopulate);
 
@@ -912,18 +1005,20 @@ int ttm_page_alloc_debugfs(struct seq_file *m, void *data)
 {
 	struct ttm_page_pool *p;
 	unsigned i;
-	char *h[] = {"pool", "refills", "pages freed", "size"};
+	char *h[] = {"pool", "node", "refills", "pages freed", "size"};
 	if (!_manager) {
 		seq_printf(m, "No pool allocator running.\n");
 		return 0;
 	}
-	seq_printf(m, "%6s %12s %13s %8s\n",
-			h[0], h[1], h[2], h[3]);
-	for (i = 0; i < NUM_POOLS; ++i) {
+	seq_printf(m, "%6s %4s %12s %13s %8s\n",
+			h[0], h[1], h[2], h[3], h[4]);
+	for (i = 0; i < _manager->npools; ++i) {
 		p = &_manager->pools[i];
 
-		seq_printf(m, "%6s %12ld %13ld %8d\n",
-				p->name, p->nrefills,
+		if (p->nid != NUMA_NO_NODE && !node_online(p->nid))
+			continue;
+		seq_printf(m, "%6s %4d %12ld %13ld %8d\n",
+				p->name, p->nid, p->nrefills,
 				p->nfrees, p->npages);
 	}
 	return 0;
@@ -210,9 +210,28 @@ enum ipoib_cm_state {
 	IPOIB_CM_RX_FLUSH  /* Last WQE Reached event observed */
 };
 
+/*
+ * Connected mode receive QPs are spread over several CQs, each with its
+ * own NAPI context and completion vector.  A ring is only ever polled
+ * from its NAPI context, which is the only writer of its counters.
+ */
+struct ipoib_cm_rx_ring {
+	struct net_device      *dev;
+	struct ib_cq	       *cq;
+	struct napi_struct	napi;
+	int			num_qps; /* protected by priv->lock */
+	struct ib_wc		ibwc[IPOIB_NUM_WC];
+	struct ib_sge		rx_sge[IPOIB_CM_RX_SG];
+	struct ib_recv_wr       rx_wr;
+	unsigned long		rx_packets;
+	unsigned long		rx_bytes;
+	unsigned long		rx_dropped;
+};
+
 struct ipoib_cm_rx {
 	struct ib_cm_id	       *id;
 	struct ib_qp	       *qp;
+	struct ipoib_cm_rx_ring *ring;
 	struct ipoib_cm_rx_buf *rx_ring;
 	struct list_head	list;
 	struct net_device      *dev;
@@ -260,6 +279,8 @@ struct ipoib_cm_dev_priv {
 	struct ib_wc		ibwc[IPOIB_NUM_WC];
 	struct ib_sge		rx_sge[IPOIB_CM_RX_SG];
 	struct ib_recv_wr       rx_wr;
+	struct ipoib_cm_rx_ring *rx_rings;
+	int			num_rx_rings;
 	int			nonsrq_conn_qp;
 	int			max_cm_mtu;
 	int			num_frags;
@@ -604,6 +625,12 @@ void ipoib_cm_skb_too_long(struct net_device *dev, struct sk_buff *skb,
 			   unsigned int mtu);
 void ipoib_cm_handle_rx_wc(struct net_device *dev, struct ib_wc *wc);
 void ipoib_cm_handle_tx_wc(struct net_device *dev, struct ib_wc *wc);
+void ipoib_cm_napi_enable(struct net_device *dev);
+void ipoib_cm_napi_disable(struct net_device *dev);
+void ipoib_cm_drain_rx_rings(struct net_device *dev);
+int ipoib_cm_set_coalesce(struct net_device *dev, u16 frames, u16 usecs);
+void ipoib_cm_get_stats(struct net_device *dev,
+			struct rtnl_link_stats64 *stats);
 #else
 
 struct ipoib_cm_tx;
@@ -707,6 +734,29 @@ static inline void ipoib_cm_handle_rx_wc(struct net_device *dev, struct ib_wc *w
 static inline void ipoib_cm_handle_tx_wc(struct net_device *dev, struct ib_wc *wc)
 {
 }
+
+static inline void ipoib_cm_napi_enable(struct net_device *dev)
+{
+}
+
+static inline void ipoib_cm_napi_disable(struct net_device *dev)
+{
+}
+
+static inline void ipoib_cm_drain_rx_rings(struct net_device *dev)
+{
+}
+
+static inline int ipoib_cm_set_coalesce(struct net_device *dev, u16 frames,
+					u16 usecs)
+{
+	return 0;
+}
+
+static inline void ipoib_cm_get_stats(struct net_device *dev,
+				      struct rtnl_link_stats64 *stats)
+{
+}
 #endif
 
 #ifdef CONFIG_INFINIBAND_IPOIB_DEBUG
@@ -48,6 +48,14 @@ MODULE_PARM_DESC(max_nonsrq_conn_qp,
 		 "Max number of connected-mode QPs per interface "
 		 "(applied only if shared receive queue is not available)");
 
+static int ipoib_cm_rx_rings;
+
+module_param_named(cm_rx_rings, ipoib_cm_rx_rings, int, 0444);
+MODULE_PARM_DESC(cm_rx_rings,
+		 "Number of connected-mode receive CQs, each with its own "
+		 "NAPI context (default: one per CPU, up to the number of "
+		 "completion vectors; applied only with a shared receive queue)");
+
 #ifdef CONFIG_INFINIBAND_IPOIB_DEBUG_DATA
 static int data_debug_level;
 
@@ -69,6 +77,8 @@ static struct ib_qp_attr ipoib_cm_err_attr = {
 
 #define IPOIB_CM_RX_DRAIN_WRID 0xffffffff
 
+#define IPOIB_CM_MAX_RX_RINGS 32
+
 static struct ib_send_wr ipoib_cm_rx_drain_wr = {
 	.wr_id = IPOIB_CM_RX_DRAIN_WRID,
 	.opcode = IB_WR_SEND,
@@ -88,18 +98,20 @@ static void ipoib_cm_dma_unmap_rx(struct ipoib_dev_priv *priv, int frags,
 		ib_dma_unmap_page(priv->ca, mapping[i + 1], PAGE_SIZE, DMA_FROM_DEVICE);
 }
 
-static int ipoib_cm_post_receive_srq(struct net_device *dev, int id)
+static int ipoib_cm_post_receive_srq(struct net_device *dev,
+				     struct ib_recv_wr *wr,
+				     struct ib_sge *sge, int id)
 {
 	struct ipoib_dev_priv *priv = netdev_priv(dev);
 	struct ib_recv_wr *bad_wr;
 	int i, ret;
 
-	priv->cm.rx_wr.wr_id = id | IPOIB_OP_CM | IPOIB_OP_RECV;
+	wr->wr_id = id | IPOIB_OP_CM | IPOIB_OP_RECV;
 
 	for (i = 0; i < priv->cm.num_frags; ++i)
-		priv->cm.rx_sge[i].addr = priv->cm.srq_ring[id].mapping[i];
+		sge[i].addr = priv->cm.srq_ring[id].mapping[i];
 
-	ret = ib_post_srq_recv(priv->cm.srq, &priv->cm.rx_wr, &bad_wr);
+	ret = ib_post_srq_recv(priv->cm.srq, wr, &bad_wr);
 	if (unlikely(ret)) {
 		ipoib_warn(priv, "post srq failed for buf %d (%d)\n", id, ret);
 		ipoib_cm_dma_unmap_rx(priv, priv->cm.num_frags - 1,
@@ -210,9 +222,10 @@ static void ipoib_cm_free_rx_ring(struct net_device *dev,
 static void ipoib_cm_start_rx_drain(struct ipoib_dev_priv *priv)
 {
 	struct ib_send_wr *bad_wr;
-	struct ipoib_cm_rx *p;
+	struct ipoib_cm_rx *p, *n;
+	struct ipoib_cm_rx_ring *ring;
 
-	/* We only reserved 1 extra slot in CQ for drain WRs, so
+	/* We only reserved 1 extra slot in each CQ for drain WRs, so
 	 * make sure we have at most 1 outstanding WR. */
 	if (list_empty(&priv->cm.rx_flush_list) ||
 	    !list_empty(&priv->cm.rx_drain_list))
@@ -221,12 +234,17 @@ static void ipoib_cm_start_rx_drain(struct ipoib_dev_priv *priv)
 	/*
 	 * QPs on flush list are error state.  This way, a "flush
 	 * error" WC will be immediately generated for each WR we post.
+	 * The drain WC only follows the flush WCs of QPs sharing its CQ,
+	 * so drain the QPs of one receive ring at a time.
 	 */
 	p = list_entry(priv->cm.rx_flush_list.next, typeof(*p), list);
+	ring = p->ring;
 	if (ib_post_send(p->qp, &ipoib_cm_rx_drain_wr, &bad_wr))
 		ipoib_warn(priv, "failed to post drain wr\n");
 
-	list_splice_init(&priv->cm.rx_flush_list, &priv->cm.rx_drain_list);
+	list_for_each_entry_safe(p, n, &priv->cm.rx_flush_list, list)
+		if (p->ring == ring)
+			list_move_tail(&p->list, &priv->cm.rx_drain_list);
 }
 
 static void ipoib_cm_rx_event_handler(struct ib_event *event, void *ctx)
@@ -251,8 +269,8 @@ static struct ib_qp *ipoib_cm_create_rx_qp(struct net_device *dev,
 	struct ipoib_dev_priv *priv = netdev_priv(dev);
 	struct ib_qp_init_attr attr = {
 		.event_handler = ipoib_cm_rx_event_handler,
-		.send_cq = priv->recv_cq, /* For drain WR */
-		.recv_cq = priv->recv_cq,
+		.send_cq = p->ring->cq, /* For drain WR */
+		.recv_cq = p->ring->cq,
 		.srq = priv->cm.srq,
 		.cap.max_send_wr = 1, /* For drain WR */
 		.cap.max_send_sge = 1, /* FIXME: 0 Seems not to work */
@@ -437,6 +455,30 @@ static int ipoib_cm_send_rep(struct net_device *dev, struct ib_cm_id *cm_id,
 	return ib_send_cm_rep(cm_id, &rep);
 }
 
+/* Hand new connections to the receive ring with the fewest QPs */
+static struct ipoib_cm_rx_ring *ipoib_cm_get_rx_ring(struct ipoib_dev_priv *priv)
+{
+	struct ipoib_cm_rx_ring *ring = priv->cm.rx_rings;
+	int i;
+
+	spin_lock_irq(&priv->lock);
+	for (i = 1; i < priv->cm.num_rx_rings; ++i)
+		if (priv->cm.rx_rings[i].num_qps < ring->num_qps)
+			ring = &priv->cm.rx_rings[i];
+	++ring->num_qps;
+	spin_unlock_irq(&priv->lock);
+
+	return ring;
+}
+
+static void ipoib_cm_put_rx_ring(struct ipoib_dev_priv *priv,
+				 struct ipoib_cm_rx_ring *ring)
+{
+	spin_lock_irq(&priv->lock);
+	--ring->num_qps;
+	spin_unlock_irq(&priv->lock);
+}
+
 static int ipoib_cm_req_handler(struct ib_cm_id *cm_id, struct ib_cm_event *event)
 {
 	struct net_device *dev = cm_id->context;
@@ -455,6 +497,7 @@ static int ipoib_cm_req_handler(struct ib_cm_id *cm_id, struct ib_cm_event *even
 	p->state = IPOIB_CM_RX_LIVE;
 	p->jiffies = jiffies;
 	INIT_LIST_HEAD(&p->list);
+	p->ring = ipoib_cm_get_rx_ring(priv);
 
 	p->qp = ipoib_cm_create_rx_qp(dev, p);
 	if (IS_ERR(p->qp)) {
@@ -494,6 +537,7 @@ static int ipoib_cm_req_handler(struct ib_cm_id *cm_id, struct ib_cm_event *even
 err_modify:
 	ib_destroy_qp(p->qp);
 err_qp:
+	ipoib_cm_put_rx_ring(priv, p->ring);
 	kfree(p);
 	return ret;
 }
@@ -561,6 +605,7 @@ void ipoib_cm_handle_rx_wc(struct net_device *dev, struct ib_wc *wc)
 	struct ipoib_cm_rx_buf *rx_ring;
 	unsigned int wr_id = wc->wr_id & ~(IPOIB_OP_CM | IPOIB_OP_RECV);
 	struct sk_buff *skb, *newskb;
+	struct ipoib_cm_rx_ring *ring;
 	struct ipoib_cm_rx *p;
 	unsigned long flags;
 	u64 mapping[IPOIB_CM_RX_SG];
@@ -585,6 +630,7 @@ void ipoib_cm_handle_rx_wc(struct net_device *dev, struct ib_wc *wc)
 	}
 
 	p = wc->qp->qp_context;
+	ring = p->ring;
 
 	has_srq = ipoib_cm_has_srq(dev);
 	rx_ring = has_srq ? priv->cm.srq_ring : p->rx_ring;
@@ -595,7 +641,7 @@ void ipoib_cm_handle_rx_wc(struct net_device *dev, struct ib_wc *wc)
 		ipoib_dbg(priv, "cm recv error "
 			   "(status=%d, wrid=%d vend_err %x)\n",
 			   wc->status, wr_id, wc->vendor_err);
-		++dev->stats.rx_dropped;
+		++ring->rx_dropped;
 		if (has_srq)
 			goto repost;
 		else {
@@ -649,7 +695,7 @@ void ipoib_cm_handle_rx_wc(struct net_device *dev, struct ib_wc *wc)
 		 * this packet and reuse the old buffer.
 		 */
 		ipoib_dbg(priv, "failed to allocate receive buffer %d\n", wr_id);
-		++dev->stats.rx_dropped;
+		++ring->rx_dropped;
 		goto repost;
 	}
 
@@ -666,8 +712,8 @@ copied:
 	skb_reset_mac_header(skb);
 	skb_pull(skb, IPOIB_ENCAP_LEN);
 
-	++dev->stats.rx_packets;
-	dev->stats.rx_bytes += skb->len;
+	++ring->rx_packets;
+	ring->rx_bytes += skb->len;
 
 	skb->dev = dev;
 	/* XXX get correct PACKET_ type here */
@@ -676,13 +722,14 @@ copied:
 
 repost:
 	if (has_srq) {
-		if (unlikely(ipoib_cm_post_receive_srq(dev, wr_id)))
+		if (unlikely(ipoib_cm_post_receive_srq(dev, &ring->rx_wr,
+						       ring->rx_sge, wr_id)))
 			ipoib_warn(priv, "ipoib_cm_post_receive_srq failed "
 				   "for buf %d\n", wr_id);
 	} else {
 		if (unlikely(ipoib_cm_post_receive_nonsrq(dev, p,
-							  &priv->cm.rx_wr,
-							  priv->cm.rx_sge,
+							  &ring->rx_wr,
+							  ring->rx_sge,
 							  wr_id))) {
 			--p->recv_count;
 			ipoib_warn(priv, "ipoib_cm_post_receive_nonsrq failed "
@@ -838,6 +885,120 @@ void ipoib_cm_handle_tx_wc(struct net_device *dev, struct ib_wc *wc)
 	netif_tx_unlock(dev);
 }
 
+static int ipoib_cm_rx_poll(struct napi_struct *napi, int budget)
+{
+	struct ipoib_cm_rx_ring *ring =
+		container_of(napi, struct ipoib_cm_rx_ring, napi);
+	int done = 0;
+	int t, n, i;
+
+poll_more:
+	while (done < budget) {
+		t = min(IPOIB_NUM_WC, budget - done);
+		n = ib_poll_cq(ring->cq, t, ring->ibwc);
+
+		for (i = 0; i < n; ++i)
+			ipoib_cm_handle_rx_wc(ring->dev, ring->ibwc + i);
+
+		done += n;
+		if (n != t)
+			break;
+	}
+
+	if (done < budget) {
+		napi_complete(napi);
+		if (unlikely(ib_req_notify_cq(ring->cq,
+					      IB_CQ_NEXT_COMP |
+					      IB_CQ_REPORT_MISSED_EVENTS)) &&
+		    napi_reschedule(napi))
+			goto poll_more;
+	}
+
+	return done;
+}
+
+static void ipoib_cm_rx_completion(struct ib_cq *cq, void *ring_ptr)
+{
+	struct ipoib_cm_rx_ring *ring = ring_ptr;
+
+	napi_schedule(&ring->napi);
+}
+
+void ipoib_cm_napi_enable(struct net_device *dev)
+{
+	struct ipoib_dev_priv *priv = netdev_priv(dev);
+	struct ipoib_cm_rx_ring *ring;
+	int i;
+
+	for (i = 0; i < priv->cm.num_rx_rings; ++i) {
+		ring = &priv->cm.rx_rings[i];
+		napi_enable(&ring->napi);
+		/* Pick up anything that completed while we were stopped */
+		if (ib_req_notify_cq(ring->cq, IB_CQ_NEXT_COMP |
+				     IB_CQ_REPORT_MISSED_EVENTS) > 0)
+			napi_schedule(&ring->napi);
+	}
+}
+
+void ipoib_cm_napi_disable(struct net_device *dev)
+{
+	struct ipoib_dev_priv *priv = netdev_priv(dev);
+	int i;
+
+	for (i = 0; i < priv->cm.num_rx_rings; ++i)
+		napi_disable(&priv->cm.rx_rings[i].napi);
+}
+
+/* Called from ipoib_drain_cq() with BHs disabled and NAPI stopped */
+void ipoib_cm_drain_rx_rings(struct net_device *dev)
+{
+	struct ipoib_dev_priv *priv = netdev_priv(dev);
+	struct ipoib_cm_rx_ring *ring;
+	int i, j, n;
+
+	for (i = 0; i < priv->cm.num_rx_rings; ++i) {
+		ring = &priv->cm.rx_rings[i];
+		do {
+			n = ib_poll_cq(ring->cq, IPOIB_NUM_WC, ring->ibwc);
+			for (j = 0; j < n; ++j) {
+				/* Don't pass packets up after going down */
+				if (ring->ibwc[j].status == IB_WC_SUCCESS)
+					ring->ibwc[j].status = IB_WC_WR_FLUSH_ERR;
+				ipoib_cm_handle_rx_wc(dev, ring->ibwc + j);
+			}
+		} while (n == IPOIB_NUM_WC);
+	}
+}
+
+int ipoib_cm_set_coalesce(struct net_device *dev, u16 frames, u16 usecs)
+{
+	struct ipoib_dev_priv *priv = netdev_priv(dev);
+	int i, ret;
+
+	for (i = 0; i < priv->cm.num_rx_rings; ++i) {
+		ret = ib_modify_cq(priv->cm.rx_rings[i].cq, frames, usecs);
+		if (ret && ret != -ENOSYS)
+			return ret;
+	}
+
+	return 0;
+}
+
+void ipoib_cm_get_stats(struct net_device *dev,
+			struct rtnl_link_stats64 *stats)
+{
+	struct ipoib_dev_priv *priv = netdev_priv(dev);
+	struct ipoib_cm_rx_ring *ring;
+	int i;
+
+	for (i = 0; i < priv->cm.num_rx_rings; ++i) {
+		ring = &priv->cm.rx_rings[i];
+		stats->rx_packets += ring->rx_packets;
+		stats->rx_bytes   += ring->rx_bytes;
+		stats->rx_dropped += ring->rx_dropped;
+	}
+}
+
 int ipoib_cm_dev_open(struct net_device *dev)
 {
 	struct ipoib_dev_priv *priv = netdev_priv(dev);
@@ -883,12 +1044,13 @@ static void ipoib_cm_free_rx_reap_list(struct net_device *dev)
 	list_for_each_entry_safe(rx, n, &list, list) {
 		ib_destroy_cm_id(rx->id);
 		ib_destroy_qp(rx->qp);
-		if (!ipoib_cm_has_srq(dev)) {
+		if (!ipoib_cm_has_srq(dev))
 			ipoib_cm_free_rx_ring(priv->dev, rx->rx_ring);
-			spin_lock_irq(&priv->lock);
+		spin_lock_irq(&priv->lock);
+		--rx->ring->num_qps;
+		if (!ipoib_cm_has_srq(dev))
 			--priv->cm.nonsrq_conn_qp;
-			spin_unlock_irq(&priv->lock);
-		}
+		spin_unlock_irq(&priv->lock);
 		kfree(rx);
 	}
 }
@@ -1512,6 +1674,78 @@ static void ipoib_cm_create_srq(struct net_device *dev, int max_sge)
 
 }
 
+static void ipoib_cm_destroy_rx_rings(struct net_device *dev)
+{
+	struct ipoib_dev_priv *priv = netdev_priv(dev);
+	struct ipoib_cm_rx_ring *ring;
+	int i;
+
+	for (i = 0; i < priv->cm.num_rx_rings; ++i) {
+		ring = &priv->cm.rx_rings[i];
+		netif_napi_del(&ring->napi);
+		if (ib_destroy_cq(ring->cq))
+			ipoib_warn(priv, "ib_cq_destroy (CM recv %d) failed\n", i);
+	}
+
+	kfree(priv->cm.rx_rings);
+	priv->cm.rx_rings = NULL;
+	priv->cm.num_rx_rings = 0;
+}
+
+static int ipoib_cm_create_rx_rings(struct net_device *dev)
+{
+	struct ipoib_dev_priv *priv = netdev_priv(dev);
+	struct ipoib_cm_rx_ring *ring;
+	int num, size, i, ret;
+
+	/*
+	 * Without an SRQ every QP brings its own receive queue, and a CQ
+	 * has to hold the completions of all of them: keep a single ring.
+	 */
+	if (ipoib_cm_has_srq(dev)) {
+		num = ipoib_cm_rx_rings;
+		if (num <= 0)
+			num = min_t(int, num_online_cpus(),
+				    priv->ca->num_comp_vectors);
+		num = clamp(num, 1, IPOIB_CM_MAX_RX_RINGS);
+		size = ipoib_recvq_size + 1; /* 1 extra for rx_drain_qp */
+	} else {
+		num = 1;
+		size = ipoib_recvq_size * ipoib_max_conn_qp;
+	}
+
+	priv->cm.rx_rings = kcalloc(num, sizeof *priv->cm.rx_rings,
+				    GFP_KERNEL);
+	if (!priv->cm.rx_rings)
+		return -ENOMEM;
+
+	for (i = 0; i < num; ++i) {
+		ring = &priv->cm.rx_rings[i];
+		ring->dev = dev;
+		ring->cq = ib_create_cq(priv->ca, ipoib_cm_rx_completion, NULL,
+					ring, size,
+					i % priv->ca->num_comp_vectors);
+		if (IS_ERR(ring->cq)) {
+			printk(KERN_WARNING "%s: failed to create CM receive CQ %d\n",
+			       priv->ca->name, i);
+			ret = PTR_ERR(ring->cq);
+			goto err;
+		}
+
+		netif_napi_add(dev, &ring->napi, ipoib_cm_rx_poll,
+			       NAPI_POLL_WEIGHT);
+		ipoib_cm_init_rx_wr(dev, &ring->rx_wr, ring->rx_sge);
+		priv->cm.num_rx_rings = i + 1;
+	}
+
+	ipoib_dbg(priv, "%d connected mode receive rings\n", num);
+	return 0;
+
+err:
+	ipoib_cm_destroy_rx_rings(dev);
+	return ret;
+}
+
 int ipoib_cm_dev_init(struct net_device *dev)
 {
 	struct ipoib_dev_priv *priv = netdev_priv(dev);
@@ -1555,6 +1789,12 @@ int ipoib_cm_dev_init(struct net_device *dev)
 
 	ipoib_cm_init_rx_wr(dev, &priv->cm.rx_wr, priv->cm.rx_sge);
 
+	ret = ipoib_cm_create_rx_rings(dev);
+	if (ret) {
+		ipoib_cm_dev_cleanup(dev);
+		return ret;
+	}
+
 	if (ipoib_cm_has_srq(dev)) {
 		for (i = 0; i < ipoib_recvq_size; ++i) {
 			if (!ipoib_cm_alloc_rx_skb(dev, priv->cm.srq_ring, i,
@@ -1567,7 +1807,8 @@ int ipoib_cm_dev_init(struct net_device *dev)
 				return -ENOMEM;
 			}
 
-			if (ipoib_cm_post_receive_srq(dev, i)) {
+			if (ipoib_cm_post_receive_srq(dev, &priv->cm.rx_wr,
+						      priv->cm.rx_sge, i)) {
 				ipoib_warn(priv, "ipoib_cm_post_receive_srq "
 					   "failed for buf %d\n", i);
 				ipoib_cm_dev_cleanup(dev);
@@ -1585,6 +1826,8 @@ void ipoib_cm_dev_cleanup(struct net_device *dev)
 	struct ipoib_dev_priv *priv = netdev_priv(dev);
 	int ret;
 
+	ipoib_cm_destroy_rx_rings(dev);
+
 	if (!priv->cm.srq)
 		return;
 
@@ -91,6 +91,13 @@ static int ipoib_set_coalesce(struct net_device *dev,
 		return ret;
 	}
 
+	ret = ipoib_cm_set_coalesce(dev, coal->rx_max_coalesced_frames,
+				    coal->rx_coalesce_usecs);
+	if (ret) {
+		ipoib_warn(priv, "failed modifying CM receive CQ (%d)\n", ret);
+		return ret;
+	}
+
 	priv->ethtool.coalesce_usecs       = coal->rx_coalesce_usecs;
 	priv->ethtool.max_coalesced_frames = coal->rx_max_coalesced_frames;
 
@@ -698,13 +698,17 @@ int ipoib_ib_dev_open(struct net_device *dev)
 	queue_delayed_work(ipoib_workqueue, &priv->ah_reap_task,
 			   round_jiffies_relative(HZ));
 
-	if (!test_and_set_bit(IPOIB_FLAG_INITIALIZED, &priv->flags))
+	if (!test_and_set_bit(IPOIB_FLAG_INITIALIZED, &priv->flags)) {
 		napi_enable(&priv->napi);
+		ipoib_cm_napi_enable(dev);
+	}
 
 	return 0;
 dev_stop:
-	if (!test_and_set_bit(IPOIB_FLAG_INITIALIZED, &priv->flags))
+	if (!test_and_set_bit(IPOIB_FLAG_INITIALIZED, &priv->flags)) {
 		napi_enable(&priv->napi);
+		ipoib_cm_napi_enable(dev);
+	}
 	ipoib_ib_dev_stop(dev, 1);
 	return -1;
 }
@@ -807,6 +811,8 @@ void ipoib_drain_cq(struct net_device *dev)
 		}
 	} while (n == IPOIB_NUM_WC);
 
+	ipoib_cm_drain_rx_rings(dev);
+
 	while (poll_tx(priv))
 		; /* nothing */
 
@@ -821,8 +827,10 @@ int ipoib_ib_dev_stop(struct net_device *dev, int flush)
 	struct ipoib_tx_buf *tx_req;
 	int i;
 
-	if (test_and_clear_bit(IPOIB_FLAG_INITIALIZED, &priv->flags))
+	if (test_and_clear_bit(IPOIB_FLAG_INITIALIZED, &priv->flags)) {
 		napi_disable(&priv->napi);
+		ipoib_cm_napi_disable(dev);
+	}
 
 	ipoib_cm_dev_stop(dev);
 
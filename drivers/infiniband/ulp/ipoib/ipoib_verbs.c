@@ -157,15 +157,11 @@ int ipoib_transport_dev_init(struct net_device *dev, struct ib_device *ca)
 		goto out_free_pd;
 	}
 
+	/* Connected mode receives complete on the CQs of its own rings */
 	size = ipoib_recvq_size + 1;
 	ret = ipoib_cm_dev_init(dev);
-	if (!ret) {
+	if (!ret)
 		size += ipoib_sendq_size;
-		if (ipoib_cm_has_srq(dev))
-			size += ipoib_recvq_size + 1; /* 1 extra for rx_drain_qp */
-		else
-			size += ipoib_recvq_size * ipoib_max_conn_qp;
-	}
 
 	priv->recv_cq = ib_create_cq(priv->ca, ipoib_ib_completion, NULL, dev, size, 0);
 	if (IS_ERR(priv->recv_cq)) {
@@ -113,6 +113,7 @@ static int alloc_irte(struct intel_iommu *iommu, int irq, u16 count)
 		irq_iommu->irte_index =  index;
 		irq_iommu->sub_handle = 0;
 		irq_iommu->irte_mask = mask;
+		irq_iommu->posted = 0;
 	}
 	raw_spin_unlock_irqrestore(&irq_2_ir_lock, flags);
 
@@ -162,6 +163,7 @@ static int set_irte_irq(int irq, struct intel_iommu *iommu, u16 index, u16 subha
 	irq_iommu->irte_index = index;
 	irq_iommu->sub_handle = subhandle;
 	irq_iommu->irte_mask = 0;
+	irq_iommu->posted = 0;
 
 	raw_spin_unlock_irqrestore(&irq_2_ir_lock, flags);
 
@@ -186,8 +188,25 @@ static int modify_irte(int irq, struct irte *irte_modified)
 	index = irq_iommu->irte_index + irq_iommu->sub_handle;
 	irte = &iommu->ir_table->base[index];
 
-	set_64bit(&irte->low, irte_modified->low);
-	set_64bit(&irte->high, irte_modified->high);
+#ifdef CONFIG_X86_64
+	/*
+	 * The posted descriptor address straddles both halves of the
+	 * IRTE, so switching to or from posted format has to update the
+	 * whole entry at once.
+	 */
+	if (irte->p_pst || irte_modified->p_pst) {
+		bool ret;
+
+		ret = cmpxchg_double(&irte->low, &irte->high,
+				     irte->low, irte->high,
+				     irte_modified->low, irte_modified->high);
+		WARN_ON(!ret);
+	} else
+#endif
+	{
+		set_64bit(&irte->low, irte_modified->low);
+		set_64bit(&irte->high, irte_modified->high);
+	}
 	__iommu_flush_cache(iommu, irte, sizeof(*irte));
 
 	rc = qi_flush_iec(iommu, index, 0);
@@ -269,6 +288,7 @@ static int free_irte(int irq)
 	irq_iommu->irte_index = 0;
 	irq_iommu->sub_handle = 0;
 	irq_iommu->irte_mask = 0;
+	irq_iommu->posted = 0;
 
 	raw_spin_unlock_irqrestore(&irq_2_ir_lock, flags);
 
@@ -650,6 +670,22 @@ static int __init intel_enable_irq_remapping(void)
 
 	irq_remapping_enabled = 1;
 
+	/*
+	 * Posting needs every unit to understand the posted IRTE format, and
+	 * cmpxchg16b to switch an entry between the two formats atomically.
+	 */
+	if (!disable_irq_post && config_enabled(CONFIG_X86_64) &&
+	    cpu_has_cx16) {
+		intel_irq_remap_ops.capability |= 1 << IRQ_POSTING_CAP;
+
+		for_each_iommu(iommu, drhd)
+			if (!cap_pi_support(iommu->cap)) {
+				intel_irq_remap_ops.capability &=
+					~(1 << IRQ_POSTING_CAP);
+				break;
+			}
+	}
+
 	/*
 	 * VT-d has a different layout for IO-APIC entries when
 	 * interrupt remapping is enabled. So it needs a special routine
@@ -1006,14 +1042,21 @@ intel_ioapic_set_affinity(struct irq_data *data, const struct cpumask *mask,
 		return err;
 	}
 
-	irte.vector = cfg->vector;
-	irte.dest_id = IRTE_DEST(dest);
-
 	/*
-	 * Atomically updates the IRTE with the new destination, vector
-	 * and flushes the interrupt entry cache.
+	 * A posted IRTE targets the guest, not the host vector; the new
+	 * host vector and destination are written back when the interrupt
+	 * leaves posted mode in intel_ir_set_vcpu_affinity().
 	 */
-	modify_irte(irq, &irte);
+	if (!irq_2_iommu(irq)->posted) {
+		irte.vector = cfg->vector;
+		irte.dest_id = IRTE_DEST(dest);
+
+		/*
+		 * Atomically updates the IRTE with the new destination,
+		 * vector and flushes the interrupt entry cache.
+		 */
+		modify_irte(irq, &irte);
+	}
 
 	/*
 	 * After this point, all the interrupts will start arriving
@@ -1027,6 +1070,73 @@ intel_ioapic_set_affinity(struct irq_data *data, const struct cpumask *mask,
 	return 0;
 }
 
+/*
+ * Switch a remapped MSI between remapped and posted format.  With a
+ * vcpu_data the IRTE is rewritten to post the guest vector into the
+ * given posted-interrupt descriptor; with NULL it is rebuilt from the
+ * host vector and affinity.  Called under the irq descriptor lock, which
+ * also serializes against intel_ioapic_set_affinity().
+ */
+static int intel_ir_set_vcpu_affinity(struct irq_data *data, void *info)
+{
+	struct irq_2_iommu *irq_iommu = irq_2_iommu(data->irq);
+	struct irq_cfg *cfg = data->chip_data;
+	struct vcpu_data *vcpu_pi_info = info;
+	struct irte old, irte;
+	unsigned int dest;
+	int err;
+
+	/* Only PCI MSI and MSI-X interrupts can be handed to a guest */
+	if (!irq_iommu || !data->msi_desc)
+		return -EINVAL;
+
+	if (get_irte(data->irq, &old))
+		return -EBUSY;
+
+	if (!vcpu_pi_info) {
+		if (!irq_iommu->posted)
+			return 0;
+
+		err = apic->cpu_mask_to_apicid_and(cfg->domain, data->affinity,
+						   &dest);
+		if (err)
+			return err;
+
+		prepare_irte(&irte, cfg->vector, dest);
+		irte.fpd = old.p_fpd;
+		irte.avail = old.p_avail;
+		irte.sid = old.p_sid;
+		irte.sq = old.p_sq;
+		irte.svt = old.p_svt;
+
+		err = modify_irte(data->irq, &irte);
+		if (!err)
+			irq_iommu->posted = 0;
+		return err;
+	}
+
+	if (!(intel_irq_remap_ops.capability & (1 << IRQ_POSTING_CAP)))
+		return -ENODEV;
+
+	memset(&irte, 0, sizeof(irte));
+	irte.p_present = 1;
+	irte.p_fpd = old.fpd;
+	irte.p_avail = old.avail;
+	irte.p_urgent = 0;
+	irte.p_pst = 1;
+	irte.p_vector = vcpu_pi_info->vector;
+	irte.pda_l = (vcpu_pi_info->pi_desc_addr >> 6) & ((1ULL << 26) - 1);
+	irte.pda_h = vcpu_pi_info->pi_desc_addr >> 32;
+	irte.p_sid = old.sid;
+	irte.p_sq = old.sq;
+	irte.p_svt = old.svt;
+
+	err = modify_irte(data->irq, &irte);
+	if (!err)
+		irq_iommu->posted = 1;
+	return err;
+}
+
 static void intel_compose_msi_msg(struct pci_dev *pdev,
 				  unsigned int irq, unsigned int dest,
 				  struct msi_msg *msg, u8 hpet_id)
@@ -1138,6 +1248,7 @@ struct irq_remap_ops intel_irq_remap_ops = {
 	.enable_faulting	= enable_drhd_fault_handling,
 	.setup_ioapic_entry	= intel_setup_ioapic_entry,
 	.set_affinity		= intel_ioapic_set_affinity,
+	.set_vcpu_affinity	= intel_ir_set_vcpu_affinity,
 	.free_irq		= free_irte,
 	.compose_msi_msg	= intel_compose_msi_msg,
 	.msi_alloc_irq		= intel_msi_alloc_irq,
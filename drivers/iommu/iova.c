@@ -18,6 +18,12 @@
  */
 
 #include <linux/iova.h>
+#include <linux/slab.h>
+#include <linux/smp.h>
+#include <linux/log2.h>
+
+static void init_iova_rcaches(struct iova_domain *iovad);
+static void free_iova_rcaches(struct iova_domain *iovad);
 
 void
 init_iova_domain(struct iova_domain *iovad, unsigned long pfn_32bit)
@@ -26,6 +32,7 @@ init_iova_domain(struct iova_domain *iovad, unsigned long pfn_32bit)
 	iovad->rbroot = RB_ROOT;
 	iovad->cached32_node = NULL;
 	iovad->dma_32bit_pfn = pfn_32bit;
+	init_iova_rcaches(iovad);
 }
 
 static struct rb_node *
@@ -236,35 +243,18 @@ alloc_iova(struct iova_domain *iovad, unsigned long size,
 	return new_iova;
 }
 
-/**
- * find_iova - find's an iova for a given pfn
- * @iovad: - iova domain in question.
- * @pfn: - page frame number
- * This function finds and returns an iova belonging to the
- * given doamin which matches the given pfn.
- */
-struct iova *find_iova(struct iova_domain *iovad, unsigned long pfn)
+/* Must be called with iova_rbtree_lock held */
+static struct iova *
+private_find_iova(struct iova_domain *iovad, unsigned long pfn)
 {
-	unsigned long flags;
-	struct rb_node *node;
+	struct rb_node *node = iovad->rbroot.rb_node;
 
-	/* Take the lock so that no other thread is manipulating the rbtree */
-	spin_lock_irqsave(&iovad->iova_rbtree_lock, flags);
-	node = iovad->rbroot.rb_node;
 	while (node) {
 		struct iova *iova = container_of(node, struct iova, node);
 
 		/* If pfn falls within iova's range, return iova */
-		if ((pfn >= iova->pfn_lo) && (pfn <= iova->pfn_hi)) {
-			spin_unlock_irqrestore(&iovad->iova_rbtree_lock, flags);
-			/* We are not holding the lock while this iova
-			 * is referenced by the caller as the same thread
-			 * which called this function also calls __free_iova()
-			 * and it is by design that only one thread can possibly
-			 * reference a particular iova and hence no conflict.
-			 */
+		if ((pfn >= iova->pfn_lo) && (pfn <= iova->pfn_hi))
 			return iova;
-		}
 
 		if (pfn < iova->pfn_lo)
 			node = node->rb_left;
@@ -272,10 +262,34 @@ struct iova *find_iova(struct iova_domain *iovad, unsigned long pfn)
 			node = node->rb_right;
 	}
 
-	spin_unlock_irqrestore(&iovad->iova_rbtree_lock, flags);
 	return NULL;
 }
 
+/**
+ * find_iova - find's an iova for a given pfn
+ * @iovad: - iova domain in question.
+ * @pfn: - page frame number
+ * This function finds and returns an iova belonging to the
+ * given doamin which matches the given pfn.
+ */
+struct iova *find_iova(struct iova_domain *iovad, unsigned long pfn)
+{
+	unsigned long flags;
+	struct iova *iova;
+
+	/* Take the lock so that no other thread is manipulating the rbtree */
+	spin_lock_irqsave(&iovad->iova_rbtree_lock, flags);
+	iova = private_find_iova(iovad, pfn);
+	spin_unlock_irqrestore(&iovad->iova_rbtree_lock, flags);
+	/* We are not holding the lock while this iova
+	 * is referenced by the caller as the same thread
+	 * which called this function also calls __free_iova()
+	 * and it is by design that only one thread can possibly
+	 * reference a particular iova and hence no conflict.
+	 */
+	return iova;
+}
+
 /**
  * __free_iova - frees the given iova
  * @iovad: iova domain in question.
@@ -320,6 +334,7 @@ void put_iova_domain(struct iova_domain *iovad)
 	struct rb_node *node;
 	unsigned long flags;
 
+	free_iova_rcaches(iovad);
 	spin_lock_irqsave(&iovad->iova_rbtree_lock, flags);
 	node = rb_first(&iovad->rbroot);
 	while (node) {
@@ -485,3 +500,379 @@ error:
 		free_iova_mem(prev);
 	return NULL;
 }
+
+/*
+ * Per-cpu caching of freed ranges
+ *
+ * Ranges of up to 1 << (IOVA_RANGE_CACHE_MAX_SIZE - 1) pages that are
+ * freed through free_iova_fast() stay in the rbtree, but their pfns are
+ * kept in magazines sorted by size.  Each cpu has a loaded and a
+ * previous magazine per size that it allocates from and frees into
+ * without taking iova_rbtree_lock; full and empty magazines are
+ * exchanged with a small per-domain depot.  Only a miss in both goes
+ * to the rbtree.
+ */
+#define IOVA_MAG_SIZE 127
+
+struct iova_magazine {
+	unsigned long size;
+	unsigned long pfns[IOVA_MAG_SIZE];
+};
+
+struct iova_cpu_rcache {
+	spinlock_t lock;
+	struct iova_magazine *loaded;
+	struct iova_magazine *prev;
+};
+
+struct iova_cpu_rcaches {
+	struct iova_cpu_rcache rcache[IOVA_RANGE_CACHE_MAX_SIZE];
+} ____cacheline_aligned_in_smp;
+
+static struct iova_magazine *iova_magazine_alloc(void)
+{
+	return kzalloc(sizeof(struct iova_magazine), GFP_ATOMIC);
+}
+
+static bool iova_magazine_full(struct iova_magazine *mag)
+{
+	return mag->size == IOVA_MAG_SIZE;
+}
+
+static bool iova_magazine_empty(struct iova_magazine *mag)
+{
+	return mag->size == 0;
+}
+
+static void iova_magazine_push(struct iova_magazine *mag, unsigned long pfn)
+{
+	mag->pfns[mag->size++] = pfn;
+}
+
+/* Takes out a range of @size pages that ends at or below @limit_pfn */
+static unsigned long iova_magazine_pop(struct iova_magazine *mag,
+				       unsigned long size,
+				       unsigned long limit_pfn)
+{
+	unsigned long pfn;
+	int i;
+
+	for (i = mag->size - 1; i >= 0; i--)
+		if (mag->pfns[i] + size - 1 <= limit_pfn)
+			break;
+	if (i < 0)
+		return 0;
+
+	pfn = mag->pfns[i];
+	mag->pfns[i] = mag->pfns[--mag->size];
+	return pfn;
+}
+
+/* Returns the ranges held in @mag to the rbtree */
+static void iova_magazine_free_pfns(struct iova_magazine *mag,
+				    struct iova_domain *iovad)
+{
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&iovad->iova_rbtree_lock, flags);
+	for (i = 0; i < mag->size; i++) {
+		struct iova *iova = private_find_iova(iovad, mag->pfns[i]);
+
+		BUG_ON(!iova);
+		__cached_rbnode_delete_update(iovad, iova);
+		rb_erase(&iova->node, &iovad->rbroot);
+		free_iova_mem(iova);
+	}
+	spin_unlock_irqrestore(&iovad->iova_rbtree_lock, flags);
+
+	mag->size = 0;
+}
+
+static void init_iova_rcaches(struct iova_domain *iovad)
+{
+	int i;
+
+	for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; i++) {
+		spin_lock_init(&iovad->rcaches[i].lock);
+		iovad->rcaches[i].depot_size = 0;
+	}
+
+	/* Domains may be set up in atomic context; without the array
+	 * the domain simply runs uncached. */
+	iovad->cpu_rcaches = kcalloc(nr_cpu_ids, sizeof(*iovad->cpu_rcaches),
+				     GFP_ATOMIC);
+}
+
+static void free_cpu_rcaches(struct iova_cpu_rcaches *rcs)
+{
+	int i;
+
+	for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; i++) {
+		kfree(rcs->rcache[i].loaded);
+		kfree(rcs->rcache[i].prev);
+	}
+	kfree(rcs);
+}
+
+/*
+ * Returns the caches of this cpu, setting them up on first use.  Must
+ * be called with interrupts disabled.
+ */
+static struct iova_cpu_rcaches *iova_this_cpu_rcaches(struct iova_domain *iovad)
+{
+	int cpu = smp_processor_id();
+	struct iova_cpu_rcaches *rcs;
+	int i;
+
+	if (!iovad->cpu_rcaches)
+		return NULL;
+
+	rcs = iovad->cpu_rcaches[cpu];
+	if (likely(rcs))
+		return rcs;
+
+	rcs = kzalloc_node(sizeof(*rcs), GFP_ATOMIC, cpu_to_node(cpu));
+	if (!rcs)
+		return NULL;
+
+	for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; i++) {
+		struct iova_cpu_rcache *cpu_rcache = &rcs->rcache[i];
+
+		spin_lock_init(&cpu_rcache->lock);
+		cpu_rcache->loaded = iova_magazine_alloc();
+		cpu_rcache->prev = iova_magazine_alloc();
+		if (!cpu_rcache->loaded || !cpu_rcache->prev) {
+			free_cpu_rcaches(rcs);
+			return NULL;
+		}
+	}
+
+	/* free_cached_iovas() may look at them from another cpu */
+	smp_wmb();
+	iovad->cpu_rcaches[cpu] = rcs;
+	return rcs;
+}
+
+static bool iova_rcache_insert(struct iova_domain *iovad, unsigned long pfn,
+			       unsigned long size)
+{
+	struct iova_magazine *mag_to_free = NULL;
+	struct iova_cpu_rcache *cpu_rcache;
+	struct iova_cpu_rcaches *rcs;
+	struct iova_rcache *rcache;
+	unsigned int log_size = order_base_2(size);
+	bool can_insert = false;
+	unsigned long flags;
+
+	if (log_size >= IOVA_RANGE_CACHE_MAX_SIZE)
+		return false;
+	rcache = &iovad->rcaches[log_size];
+
+	local_irq_save(flags);
+	rcs = iova_this_cpu_rcaches(iovad);
+	if (!rcs) {
+		local_irq_restore(flags);
+		return false;
+	}
+	cpu_rcache = &rcs->rcache[log_size];
+	spin_lock(&cpu_rcache->lock);
+
+	if (!iova_magazine_full(cpu_rcache->loaded)) {
+		can_insert = true;
+	} else if (!iova_magazine_full(cpu_rcache->prev)) {
+		swap(cpu_rcache->prev, cpu_rcache->loaded);
+		can_insert = true;
+	} else {
+		struct iova_magazine *new_mag = iova_magazine_alloc();
+
+		if (new_mag) {
+			spin_lock(&rcache->lock);
+			if (rcache->depot_size < IOVA_MAX_GLOBAL_MAGS)
+				rcache->depot[rcache->depot_size++] =
+						cpu_rcache->loaded;
+			else
+				mag_to_free = cpu_rcache->loaded;
+			spin_unlock(&rcache->lock);
+
+			cpu_rcache->loaded = new_mag;
+			can_insert = true;
+		}
+	}
+
+	if (can_insert)
+		iova_magazine_push(cpu_rcache->loaded, pfn);
+
+	spin_unlock(&cpu_rcache->lock);
+	local_irq_restore(flags);
+
+	if (mag_to_free) {
+		iova_magazine_free_pfns(mag_to_free, iovad);
+		kfree(mag_to_free);
+	}
+
+	return can_insert;
+}
+
+static unsigned long iova_rcache_get(struct iova_domain *iovad,
+				     unsigned long size,
+				     unsigned long limit_pfn)
+{
+	struct iova_cpu_rcache *cpu_rcache;
+	struct iova_cpu_rcaches *rcs;
+	struct iova_rcache *rcache;
+	unsigned int log_size = order_base_2(size);
+	unsigned long pfn = 0;
+	bool has_pfn = false;
+	unsigned long flags;
+
+	if (log_size >= IOVA_RANGE_CACHE_MAX_SIZE)
+		return 0;
+	rcache = &iovad->rcaches[log_size];
+
+	local_irq_save(flags);
+	rcs = iova_this_cpu_rcaches(iovad);
+	if (!rcs) {
+		local_irq_restore(flags);
+		return 0;
+	}
+	cpu_rcache = &rcs->rcache[log_size];
+	spin_lock(&cpu_rcache->lock);
+
+	if (!iova_magazine_empty(cpu_rcache->loaded)) {
+		has_pfn = true;
+	} else if (!iova_magazine_empty(cpu_rcache->prev)) {
+		swap(cpu_rcache->prev, cpu_rcache->loaded);
+		has_pfn = true;
+	} else {
+		spin_lock(&rcache->lock);
+		if (rcache->depot_size > 0) {
+			kfree(cpu_rcache->loaded);
+			cpu_rcache->loaded = rcache->depot[--rcache->depot_size];
+			has_pfn = true;
+		}
+		spin_unlock(&rcache->lock);
+	}
+
+	if (has_pfn)
+		pfn = iova_magazine_pop(cpu_rcache->loaded, 1UL << log_size,
+					limit_pfn);
+
+	spin_unlock(&cpu_rcache->lock);
+	local_irq_restore(flags);
+
+	return pfn;
+}
+
+/* Returns every cached range of @iovad to the rbtree */
+static void free_cached_iovas(struct iova_domain *iovad)
+{
+	struct iova_cpu_rcaches *rcs;
+	unsigned long flags;
+	unsigned int cpu;
+	int i, j;
+
+	if (iovad->cpu_rcaches) {
+		for_each_possible_cpu(cpu) {
+			rcs = ACCESS_ONCE(iovad->cpu_rcaches[cpu]);
+			if (!rcs)
+				continue;
+			smp_read_barrier_depends();
+
+			for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; i++) {
+				struct iova_cpu_rcache *cpu_rcache =
+							&rcs->rcache[i];
+
+				spin_lock_irqsave(&cpu_rcache->lock, flags);
+				iova_magazine_free_pfns(cpu_rcache->loaded, iovad);
+				iova_magazine_free_pfns(cpu_rcache->prev, iovad);
+				spin_unlock_irqrestore(&cpu_rcache->lock, flags);
+			}
+		}
+	}
+
+	for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; i++) {
+		struct iova_rcache *rcache = &iovad->rcaches[i];
+
+		spin_lock_irqsave(&rcache->lock, flags);
+		for (j = 0; j < rcache->depot_size; j++) {
+			iova_magazine_free_pfns(rcache->depot[j], iovad);
+			kfree(rcache->depot[j]);
+		}
+		rcache->depot_size = 0;
+		spin_unlock_irqrestore(&rcache->lock, flags);
+	}
+}
+
+/* Frees the caches themselves; the ranges go with the rbtree */
+static void free_iova_rcaches(struct iova_domain *iovad)
+{
+	unsigned int cpu;
+	int i, j;
+
+	if (iovad->cpu_rcaches) {
+		for_each_possible_cpu(cpu)
+			if (iovad->cpu_rcaches[cpu])
+				free_cpu_rcaches(iovad->cpu_rcaches[cpu]);
+		kfree(iovad->cpu_rcaches);
+		iovad->cpu_rcaches = NULL;
+	}
+
+	for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; i++) {
+		struct iova_rcache *rcache = &iovad->rcaches[i];
+
+		for (j = 0; j < rcache->depot_size; j++)
+			kfree(rcache->depot[j]);
+		rcache->depot_size = 0;
+	}
+}
+
+/**
+ * alloc_iova_fast - allocates an iova from the per-cpu caches
+ * @iovad: - iova domain in question
+ * @size: - size of page frames to allocate
+ * @limit_pfn: - max limit address
+ * @flush_rcache: - set to return the cached ranges to the rbtree and
+ *	retry once if the rbtree has no room
+ * This function returns the first pfn of a range of
+ * roundup_pow_of_two(@size) pages, naturally aligned on that size, or 0.
+ * Ranges freed with free_iova_fast() are handed out again without
+ * taking iova_rbtree_lock; only on a miss is alloc_iova() used.
+ */
+unsigned long
+alloc_iova_fast(struct iova_domain *iovad, unsigned long size,
+		unsigned long limit_pfn, bool flush_rcache)
+{
+	struct iova *new_iova;
+	unsigned long pfn;
+
+	pfn = iova_rcache_get(iovad, size, limit_pfn);
+	if (pfn)
+		return pfn;
+
+	new_iova = alloc_iova(iovad, size, limit_pfn, true);
+	if (!new_iova && flush_rcache) {
+		free_cached_iovas(iovad);
+		new_iova = alloc_iova(iovad, size, limit_pfn, true);
+	}
+
+	return new_iova ? new_iova->pfn_lo : 0;
+}
+
+/**
+ * free_iova_fast - frees an iova allocated with alloc_iova_fast()
+ * @iovad: - iova domain in question
+ * @pfn: - first pfn of the range
+ * @size: - size of page frames that was passed to alloc_iova_fast()
+ * The range goes into this cpu's cache, or back to the rbtree if it is
+ * too large to be cached.
+ */
+void
+free_iova_fast(struct iova_domain *iovad, unsigned long pfn,
+	       unsigned long size)
+{
+	if (iova_rcache_insert(iovad, pfn, size))
+		return;
+
+	free_iova(iovad, pfn);
+}
@@ -1,6 +1,7 @@
 #include <linux/seq_file.h>
 #include <linux/cpumask.h>
 #include <linux/kernel.h>
+#include <linux/export.h>
 #include <linux/string.h>
 #include <linux/errno.h>
 #include <linux/msi.h>
@@ -18,6 +19,7 @@
 int irq_remapping_enabled;
 
 int disable_irq_remap;
+int disable_irq_post;
 int irq_remap_broken;
 int disable_sourceid_checking;
 int no_x2apic_optout;
@@ -193,6 +195,8 @@ static __init int setup_irqremap(char *str)
 			disable_sourceid_checking = 1;
 		else if (!strncmp(str, "no_x2apic_optout", 16))
 			no_x2apic_optout = 1;
+		else if (!strncmp(str, "nopost", 6))
+			disable_irq_post = 1;
 
 		str += strcspn(str, ",");
 		while (*str == ',')
@@ -229,6 +233,15 @@ int irq_remapping_supported(void)
 	return remap_ops->supported();
 }
 
+int irq_remapping_cap(enum irq_remap_cap cap)
+{
+	if (!irq_remapping_enabled || !remap_ops || disable_irq_post)
+		return 0;
+
+	return (remap_ops->capability & (1 << cap));
+}
+EXPORT_SYMBOL_GPL(irq_remapping_cap);
+
 int __init irq_remapping_prepare(void)
 {
 	if (!remap_ops || !remap_ops->prepare)
@@ -305,6 +318,15 @@ static int set_remapped_irq_affinity(struct irq_data *data,
 	return remap_ops->set_affinity(data, mask, force);
 }
 
+static int set_remapped_irq_vcpu_affinity(struct irq_data *data,
+					  void *vcpu_info)
+{
+	if (!remap_ops || !remap_ops->set_vcpu_affinity)
+		return -ENOSYS;
+
+	return remap_ops->set_vcpu_affinity(data, vcpu_info);
+}
+
 void free_remapped_irq(int irq)
 {
 	struct irq_cfg *cfg = irq_get_chip_data(irq);
@@ -381,6 +403,7 @@ void irq_remap_modify_chip_defaults(struct irq_chip *chip)
 	chip->irq_ack = ir_ack_apic_edge;
 	chip->irq_eoi = ir_ack_apic_level;
 	chip->irq_set_affinity = x86_io_apic_ops.set_affinity;
+	chip->irq_set_vcpu_affinity = set_remapped_irq_vcpu_affinity;
 }
 
 bool setup_remapped_irq(int irq, struct irq_cfg *cfg, struct irq_chip *chip)
@@ -32,12 +32,16 @@ struct pci_dev;
 struct msi_msg;
 
 extern int disable_irq_remap;
+extern int disable_irq_post;
 extern int irq_remap_broken;
 extern int disable_sourceid_checking;
 extern int no_x2apic_optout;
 extern int irq_remapping_enabled;
 
 struct irq_remap_ops {
+	/* The supported capabilities, a mask of enum irq_remap_cap bits */
+	int capability;
+
 	/* Check whether Interrupt Remapping is supported */
 	int (*supported)(void);
 
@@ -65,6 +69,9 @@ struct irq_remap_ops {
 	int (*set_affinity)(struct irq_data *data, const struct cpumask *mask,
 			    bool force);
 
+	/* Post a remapped interrupt to a vCPU, or back to the host on NULL */
+	int (*set_vcpu_affinity)(struct irq_data *data, void *vcpu_info);
+
 	/* Free an IRQ */
 	int (*free_irq)(int);
 
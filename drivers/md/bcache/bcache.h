@@ -382,6 +382,14 @@ struct cached_dev {
 	unsigned		writeback_rate_update_seconds;
 	unsigned		writeback_rate_d_term;
 	unsigned		writeback_rate_p_term_inverse;
+
+	/*
+	 * Foreground IO latency to the backing device; if it goes over
+	 * writeback_latency_target_us, background writeback is throttled.
+	 */
+	unsigned		writeback_latency_target_us;
+	unsigned		backing_latency_us;
+	unsigned		backing_last_io_us;
 };
 
 enum alloc_reserve {
@@ -460,6 +468,7 @@ struct cache {
 
 struct gc_stat {
 	size_t			nodes;
+	size_t			nodes_pre;
 	size_t			key_bytes;
 
 	size_t			nkeys;
@@ -646,6 +655,9 @@ struct cache_set {
 	unsigned		congested_last_us;
 	atomic_t		congested;
 
+	/* Searches in flight, so that gc can back off and let them run */
+	atomic_t		search_inflight;
+
 	/* The rest of this all shows up in sysfs */
 	unsigned		congested_read_threshold_us;
 	unsigned		congested_write_threshold_us;
@@ -1275,6 +1275,13 @@ static bool btree_gc_mark_node(struct btree *b, struct gc_stat *gc)
 
 #define GC_MERGE_NODES	4U
 
+/*
+ * When foreground searches are in flight, gc yields after this many nodes
+ * and sleeps for GC_SLEEP_MS before picking up where it left off.
+ */
+#define MIN_GC_NODES	100
+#define GC_SLEEP_MS	100
+
 struct gc_merge_info {
 	struct btree	*b;
 	unsigned	keys;
@@ -1562,6 +1569,13 @@ static int btree_gc_recurse(struct btree *b, struct btree_op *op,
 		memmove(r + 1, r, sizeof(r[0]) * (GC_MERGE_NODES - 1));
 		r->b = NULL;
 
+		if (atomic_read(&b->c->search_inflight) &&
+		    gc->nodes >= gc->nodes_pre + MIN_GC_NODES) {
+			gc->nodes_pre = gc->nodes;
+			ret = -EAGAIN;
+			break;
+		}
+
 		if (need_resched()) {
 			ret = -EAGAIN;
 			break;
@@ -1730,7 +1744,9 @@ static void bch_btree_gc(struct cache_set *c)
 		ret = btree_root(gc_root, c, &op, &writes, &stats);
 		closure_sync(&writes);
 
-		if (ret && ret != -EAGAIN)
+		if (ret == -EAGAIN && atomic_read(&c->search_inflight))
+			schedule_timeout_interruptible(msecs_to_jiffies(GC_SLEEP_MS));
+		else if (ret && ret != -EAGAIN)
 			pr_warn("gc failed!");
 	} while (ret);
 
@@ -465,6 +465,7 @@ struct search {
 	unsigned		read_dirty_data:1;
 
 	unsigned long		start_time;
+	unsigned		backing_submit_us;
 
 	struct btree_op		op;
 	struct data_insert_op	iop;
@@ -597,6 +598,34 @@ static void request_endio(struct bio *bio, int error)
 	closure_put(cl);
 }
 
+/*
+ * Foreground IO to the backing device goes through here, so that background
+ * writeback can be throttled when it is hurting foreground latency.
+ */
+static void backing_request_endio(struct bio *bio, int error)
+{
+	struct closure *cl = bio->bi_private;
+	struct search *s = container_of(cl, struct search, cl);
+	struct cached_dev *dc = container_of(s->d, struct cached_dev, disk);
+	unsigned now = local_clock_us();
+	unsigned latency = ACCESS_ONCE(dc->backing_latency_us);
+
+	ewma_add(latency, now - s->backing_submit_us, 8, 0);
+	dc->backing_latency_us	= latency;
+	dc->backing_last_io_us	= now;
+
+	request_endio(bio, error);
+}
+
+static void backing_request_submit(struct search *s, struct bio *bio,
+				   struct closure *cl)
+{
+	s->backing_submit_us	= local_clock_us();
+	bio->bi_end_io		= backing_request_endio;
+
+	closure_bio_submit(bio, cl, s->d);
+}
+
 static void bio_complete(struct search *s)
 {
 	if (s->orig_bio) {
@@ -634,6 +663,7 @@ static void search_free(struct closure *cl)
 	if (s->iop.bio)
 		bio_put(s->iop.bio);
 
+	atomic_dec(&s->d->c->search_inflight);
 	closure_debug_destroy(cl);
 	mempool_free(s, s->d->c->search);
 }
@@ -644,6 +674,7 @@ static inline struct search *search_alloc(struct bio *bio,
 	struct search *s;
 
 	s = mempool_alloc(d->c->search, GFP_NOIO);
+	atomic_inc(&d->c->search_inflight);
 
 	closure_init(&s->cl, NULL);
 	do_bio_hook(s, bio);
@@ -714,7 +745,7 @@ static void cached_dev_read_error(struct closure *cl)
 
 		/* XXX: invalidate cache */
 
-		closure_bio_submit(bio, cl, s->d);
+		backing_request_submit(s, bio, cl);
 	}
 
 	continue_at(cl, cached_dev_cache_miss_done, NULL);
@@ -843,9 +874,8 @@ static int cached_dev_cache_miss(struct btree *b, struct search *s,
 out_put:
 	bio_put(cache_bio);
 out_submit:
-	miss->bi_end_io		= request_endio;
 	miss->bi_private	= &s->cl;
-	closure_bio_submit(miss, &s->cl, s->d);
+	backing_request_submit(s, miss, &s->cl);
 	return ret;
 }
 
@@ -910,7 +940,7 @@ static void cached_dev_write(struct cached_dev *dc, struct search *s)
 
 		if (!(bio->bi_rw & REQ_DISCARD) ||
 		    blk_queue_discard(bdev_get_queue(dc->bdev)))
-			closure_bio_submit(bio, cl, s->d);
+			backing_request_submit(s, bio, cl);
 	} else if (s->iop.writeback) {
 		bch_writeback_add(dc);
 		s->iop.bio = bio;
@@ -922,15 +952,14 @@ static void cached_dev_write(struct cached_dev *dc, struct search *s)
 
 			flush->bi_rw	= WRITE_FLUSH;
 			flush->bi_bdev	= bio->bi_bdev;
-			flush->bi_end_io = request_endio;
 			flush->bi_private = cl;
 
-			closure_bio_submit(flush, cl, s->d);
+			backing_request_submit(s, flush, cl);
 		}
 	} else {
 		s->iop.bio = bio_clone_fast(bio, GFP_NOIO, dc->disk.bio_split);
 
-		closure_bio_submit(bio, cl, s->d);
+		backing_request_submit(s, bio, cl);
 	}
 
 	closure_call(&s->iop.cl, bch_data_insert, NULL, cl);
@@ -946,7 +975,7 @@ static void cached_dev_nodata(struct closure *cl)
 		bch_journal_meta(s->iop.c, cl);
 
 	/* If it's a flush, we send the flush to the backing device too */
-	closure_bio_submit(bio, cl, s->d);
+	backing_request_submit(s, bio, cl);
 
 	continue_at(cl, cached_dev_bio_complete, NULL);
 }
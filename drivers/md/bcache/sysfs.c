@@ -82,6 +82,7 @@ rw_attribute(writeback_rate);
 rw_attribute(writeback_rate_update_seconds);
 rw_attribute(writeback_rate_d_term);
 rw_attribute(writeback_rate_p_term_inverse);
+rw_attribute(writeback_latency_target_us);
 read_attribute(writeback_rate_debug);
 
 read_attribute(stripe_size);
@@ -131,6 +132,7 @@ SHOW(__bch_cached_dev)
 	var_print(writeback_rate_update_seconds);
 	var_print(writeback_rate_d_term);
 	var_print(writeback_rate_p_term_inverse);
+	var_print(writeback_latency_target_us);
 
 	if (attr == &sysfs_writeback_rate_debug) {
 		char rate[20];
@@ -158,9 +160,11 @@ SHOW(__bch_cached_dev)
 			       "proportional:\t%s\n"
 			       "derivative:\t%s\n"
 			       "change:\t\t%s/sec\n"
-			       "next io:\t%llims\n",
+			       "next io:\t%llims\n"
+			       "backing latency:\t%uus\n",
 			       rate, dirty, target, proportional,
-			       derivative, change, next_io);
+			       derivative, change, next_io,
+			       dc->backing_latency_us);
 	}
 
 	sysfs_hprint(dirty_data,
@@ -214,6 +218,7 @@ STORE(__cached_dev)
 	d_strtoul_nonzero(writeback_rate_update_seconds);
 	d_strtoul(writeback_rate_d_term);
 	d_strtoul_nonzero(writeback_rate_p_term_inverse);
+	d_strtoul(writeback_latency_target_us);
 
 	d_strtoi_h(sequential_cutoff);
 	d_strtoi_h(readahead);
@@ -320,6 +325,7 @@ static struct attribute *bch_cached_dev_files[] = {
 	&sysfs_writeback_rate_update_seconds,
 	&sysfs_writeback_rate_d_term,
 	&sysfs_writeback_rate_p_term_inverse,
+	&sysfs_writeback_latency_target_us,
 	&sysfs_writeback_rate_debug,
 	&sysfs_dirty_data,
 	&sysfs_stripe_size,
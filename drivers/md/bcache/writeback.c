@@ -34,6 +34,7 @@ static void __update_writeback_rate(struct cached_dev *dc)
 	int64_t derivative = dirty - dc->disk.sectors_dirty_last;
 	int64_t proportional = dirty - target;
 	int64_t change;
+	unsigned latency = 0;
 
 	dc->disk.sectors_dirty_last = dirty;
 
@@ -59,10 +60,36 @@ static void __update_writeback_rate(struct cached_dev *dc)
 			 dc->writeback_rate.next + NSEC_PER_MSEC))
 		change = 0;
 
+	/*
+	 * If foreground IO to the backing device is slower than the latency
+	 * target, don't increase the rate and back off writeback in proportion
+	 * to how far over we are.  The latency average is only meaningful
+	 * while there is foreground IO, so forget it once the device has been
+	 * idle for an update period.
+	 */
+	if (dc->writeback_latency_target_us) {
+		latency = dc->backing_latency_us;
+
+		if (local_clock_us() - dc->backing_last_io_us >
+		    dc->writeback_rate_update_seconds * USEC_PER_SEC)
+			latency = dc->backing_latency_us = 0;
+
+		if (latency > dc->writeback_latency_target_us)
+			change = min_t(int64_t, change, 0);
+	}
+
 	dc->writeback_rate.rate =
 		clamp_t(int64_t, (int64_t) dc->writeback_rate.rate + change,
 			1, NSEC_PER_MSEC);
 
+	if (dc->writeback_latency_target_us &&
+	    latency > dc->writeback_latency_target_us)
+		dc->writeback_rate.rate =
+			max_t(int64_t, 1,
+			      div_u64((uint64_t) dc->writeback_rate.rate *
+				      dc->writeback_latency_target_us,
+				      latency));
+
 	dc->writeback_rate_proportional = proportional;
 	dc->writeback_rate_derivative = derivative;
 	dc->writeback_rate_change = change;
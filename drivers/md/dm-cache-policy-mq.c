@@ -8,8 +8,12 @@
 #include "dm.h"
 
 #include <linux/hash.h>
+#include <linux/jhash.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/rculist.h>
+#include <linux/seqlock.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 
@@ -213,6 +217,97 @@ static struct list_head *list_pop(struct list_head *lh)
 
 /*----------------------------------------------------------------*/
 
+/*
+ * A count-min sketch remembers roughly how often each origin block has
+ * been seen, long after its pre_cache entry has been recycled.  Each
+ * block maps to one 8 bit counter in each row; the estimate is the
+ * smallest of them.  Only the smallest counters are bumped (conservative
+ * update), and all counters are halved every generation so the sketch
+ * follows changing io patterns.
+ */
+#define SKETCH_ROWS 4
+#define SKETCH_MAX 255
+
+struct sketch {
+	unsigned width_mask;
+	u8 *counts;
+};
+
+static int sketch_init(struct sketch *sk, unsigned width)
+{
+	sk->counts = vzalloc(SKETCH_ROWS * width);
+	if (!sk->counts)
+		return -ENOMEM;
+
+	sk->width_mask = width - 1;
+
+	return 0;
+}
+
+static void sketch_exit(struct sketch *sk)
+{
+	vfree(sk->counts);
+}
+
+static u8 *sketch_counter(struct sketch *sk, unsigned row, dm_oblock_t oblock)
+{
+	u64 b = from_oblock(oblock);
+	unsigned i = jhash_2words((u32) b, (u32) (b >> 32), row) & sk->width_mask;
+
+	return sk->counts + (row * (sk->width_mask + 1)) + i;
+}
+
+/*
+ * Records a hit and returns the new estimate of the block's frequency.
+ */
+static unsigned sketch_inc(struct sketch *sk, dm_oblock_t oblock)
+{
+	unsigned row, min = SKETCH_MAX;
+	u8 *c[SKETCH_ROWS];
+
+	for (row = 0; row < SKETCH_ROWS; row++) {
+		c[row] = sketch_counter(sk, row, oblock);
+		min = min_t(unsigned, min, *c[row]);
+	}
+
+	if (min == SKETCH_MAX)
+		return min;
+
+	for (row = 0; row < SKETCH_ROWS; row++)
+		if (*c[row] == min)
+			(*c[row])++;
+
+	return min + 1;
+}
+
+static void sketch_age(struct sketch *sk)
+{
+	unsigned i, nr = SKETCH_ROWS * (sk->width_mask + 1);
+
+	for (i = 0; i < nr; i++)
+		sk->counts[i] >>= 1;
+}
+
+/*----------------------------------------------------------------*/
+
+/*
+ * Cache hits found without the policy lock are recorded in a per cpu
+ * buffer, and folded into the queues the next time the lock is taken
+ * after a tick.  If a buffer fills up before then further hits on that
+ * cpu are simply not counted; the queue levels only need a sample of
+ * them.
+ */
+#define HIT_BUFFER_SIZE 64
+
+struct hit_buffer {
+	spinlock_t lock;
+	unsigned nr;
+	dm_cblock_t cblocks[HIT_BUFFER_SIZE];
+	dm_oblock_t oblocks[HIT_BUFFER_SIZE];
+};
+
+/*----------------------------------------------------------------*/
+
 /*
  * Describes a cache entry.  Used in both the cache and the pre_cache.
  */
@@ -332,7 +427,7 @@ static dm_cblock_t infer_cblock(struct entry_pool *ep, struct entry *e)
 struct mq_policy {
 	struct dm_cache_policy policy;
 
-	/* protects everything */
+	/* protects everything, except the lockless lookups below */
 	struct mutex lock;
 	dm_cblock_t cache_size;
 	struct io_tracker tracker;
@@ -401,6 +496,18 @@ struct mq_policy {
 	unsigned nr_buckets;
 	dm_block_t hash_bits;
 	struct hlist_head *table;
+
+	/*
+	 * Bumped around every change to the hash chains, so that
+	 * lookup_cached() can walk them without the lock and check
+	 * afterwards that what it found is still valid.
+	 */
+	seqcount_t hash_seq;
+
+	struct hit_buffer __percpu *hit_buffers;
+	unsigned folded_tick;
+
+	struct sketch sketch;
 };
 
 #define DEFAULT_DISCARD_PROMOTE_ADJUSTMENT 1
@@ -417,7 +524,9 @@ static void hash_insert(struct mq_policy *mq, struct entry *e)
 {
 	unsigned h = hash_64(from_oblock(e->oblock), mq->hash_bits);
 
-	hlist_add_head(&e->hlist, mq->table + h);
+	write_seqcount_begin(&mq->hash_seq);
+	hlist_add_head_rcu(&e->hlist, mq->table + h);
+	write_seqcount_end(&mq->hash_seq);
 }
 
 static struct entry *hash_lookup(struct mq_policy *mq, dm_oblock_t oblock)
@@ -427,18 +536,22 @@ static struct entry *hash_lookup(struct mq_policy *mq, dm_oblock_t oblock)
 	struct entry *e;
 
 	hlist_for_each_entry(e, bucket, hlist)
-		if (e->oblock == oblock) {
-			hlist_del(&e->hlist);
-			hlist_add_head(&e->hlist, bucket);
+		if (e->oblock == oblock)
 			return e;
-		}
 
 	return NULL;
 }
 
-static void hash_remove(struct entry *e)
+/*
+ * Entries removed from a chain keep their ->next pointer, and entry
+ * memory is only freed when the policy is destroyed, so a lockless walk
+ * racing with changes always runs into other entries or NULL.
+ */
+static void hash_remove(struct mq_policy *mq, struct entry *e)
 {
-	hlist_del(&e->hlist);
+	write_seqcount_begin(&mq->hash_seq);
+	hlist_del_init_rcu(&e->hlist);
+	write_seqcount_end(&mq->hash_seq);
 }
 
 /*----------------------------------------------------------------*/
@@ -497,7 +610,7 @@ static void push(struct mq_policy *mq, struct entry *e)
 static void del(struct mq_policy *mq, struct entry *e)
 {
 	queue_remove(&e->list);
-	hash_remove(e);
+	hash_remove(mq, e);
 }
 
 /*
@@ -513,7 +626,7 @@ static struct entry *pop(struct mq_policy *mq, struct queue *q)
 		return NULL;
 
 	e = container_of(h, struct entry, list);
-	hash_remove(e);
+	hash_remove(mq, e);
 
 	return e;
 }
@@ -550,6 +663,7 @@ static void check_generation(struct mq_policy *mq)
 	if ((mq->hit_count >= mq->generation_period) && (epool_empty(&mq->cache_pool))) {
 		mq->hit_count = 0;
 		mq->generation++;
+		sketch_age(&mq->sketch);
 
 		for (level = 0; level < NR_QUEUE_LEVELS && count < MAX_TO_AVERAGE; level++) {
 			head = mq->cache_clean.qs + level;
@@ -750,7 +864,7 @@ static int pre_cache_entry_found(struct mq_policy *mq, struct entry *e,
 }
 
 static void insert_in_pre_cache(struct mq_policy *mq,
-				dm_oblock_t oblock)
+				dm_oblock_t oblock, unsigned hit_count)
 {
 	struct entry *e = alloc_entry(&mq->pre_cache_pool);
 
@@ -768,13 +882,13 @@ static void insert_in_pre_cache(struct mq_policy *mq,
 
 	e->dirty = false;
 	e->oblock = oblock;
-	e->hit_count = 1;
+	e->hit_count = hit_count;
 	e->generation = mq->generation;
 	push(mq, e);
 }
 
 static void insert_in_cache(struct mq_policy *mq, dm_oblock_t oblock,
-			    struct policy_result *result)
+			    unsigned hit_count, struct policy_result *result)
 {
 	int r;
 	struct entry *e;
@@ -784,7 +898,7 @@ static void insert_in_cache(struct mq_policy *mq, dm_oblock_t oblock,
 		r = demote_cblock(mq, &result->old_oblock);
 		if (unlikely(r)) {
 			result->op = POLICY_MISS;
-			insert_in_pre_cache(mq, oblock);
+			insert_in_pre_cache(mq, oblock, hit_count);
 			return;
 		}
 
@@ -801,24 +915,31 @@ static void insert_in_cache(struct mq_policy *mq, dm_oblock_t oblock,
 
 	e->oblock = oblock;
 	e->dirty = false;
-	e->hit_count = 1;
+	e->hit_count = hit_count;
 	e->generation = mq->generation;
 	push(mq, e);
 
 	result->cblock = infer_cblock(&mq->cache_pool, e);
 }
 
+/*
+ * The block isn't in the pre_cache, but the sketch may remember it being
+ * hit before its pre_cache entry was recycled.  Blocks whose sampled
+ * frequency already passes the threshold get promoted straight away.
+ */
 static int no_entry_found(struct mq_policy *mq, dm_oblock_t oblock,
 			  bool can_migrate, bool discarded_oblock,
 			  int data_dir, struct policy_result *result)
 {
-	if (adjusted_promote_threshold(mq, discarded_oblock, data_dir) <= 1) {
+	unsigned hit_count = sketch_inc(&mq->sketch, oblock);
+
+	if (adjusted_promote_threshold(mq, discarded_oblock, data_dir) <= hit_count) {
 		if (can_migrate)
-			insert_in_cache(mq, oblock, result);
+			insert_in_cache(mq, oblock, hit_count, result);
 		else
 			return -EWOULDBLOCK;
 	} else {
-		insert_in_pre_cache(mq, oblock);
+		insert_in_pre_cache(mq, oblock, hit_count);
 		result->op = POLICY_MISS;
 	}
 
@@ -842,11 +963,12 @@ static int map(struct mq_policy *mq, dm_oblock_t oblock,
 	else if (iot_pattern(&mq->tracker) == PATTERN_SEQUENTIAL)
 		result->op = POLICY_MISS;
 
-	else if (e)
+	else if (e) {
+		sketch_inc(&mq->sketch, oblock);
 		r = pre_cache_entry_found(mq, e, can_migrate, discarded_oblock,
 					  data_dir, result);
 
-	else
+	} else
 		r = no_entry_found(mq, oblock, can_migrate, discarded_oblock,
 				   data_dir, result);
 
@@ -872,6 +994,8 @@ static void mq_destroy(struct dm_cache_policy *p)
 {
 	struct mq_policy *mq = to_mq_policy(p);
 
+	sketch_exit(&mq->sketch);
+	free_percpu(mq->hit_buffers);
 	vfree(mq->table);
 	epool_exit(&mq->cache_pool);
 	epool_exit(&mq->pre_cache_pool);
@@ -887,21 +1011,116 @@ static void copy_tick(struct mq_policy *mq)
 	spin_unlock_irqrestore(&mq->tick_lock, flags);
 }
 
+/*
+ * Looks for a cache (not pre_cache) entry without taking mq->lock.
+ * Gives up rather than waiting if the hash chains are being changed.
+ */
+#define MAX_LOCKLESS_STEPS 64
+
+static bool lookup_cached(struct mq_policy *mq, dm_oblock_t oblock,
+			  dm_cblock_t *cblock)
+{
+	unsigned h = hash_64(from_oblock(oblock), mq->hash_bits);
+	unsigned seq, steps = 0;
+	struct entry *e;
+	bool found = false;
+
+	seq = raw_read_seqcount_begin(&mq->hash_seq);
+	if (seq & 1)
+		return false;
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(e, mq->table + h, hlist) {
+		if (++steps > MAX_LOCKLESS_STEPS)
+			break;
+
+		if (ACCESS_ONCE(e->oblock) == oblock) {
+			if (in_cache(mq, e)) {
+				*cblock = infer_cblock(&mq->cache_pool, e);
+				found = true;
+			}
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	return found && !read_seqcount_retry(&mq->hash_seq, seq);
+}
+
+static void buffer_hit(struct mq_policy *mq, dm_oblock_t oblock,
+		       dm_cblock_t cblock)
+{
+	struct hit_buffer *hb = get_cpu_ptr(mq->hit_buffers);
+
+	spin_lock(&hb->lock);
+	if (hb->nr < HIT_BUFFER_SIZE) {
+		hb->cblocks[hb->nr] = cblock;
+		hb->oblocks[hb->nr] = oblock;
+		hb->nr++;
+	}
+	spin_unlock(&hb->lock);
+	put_cpu_ptr(mq->hit_buffers);
+}
+
+/*
+ * Called with mq->lock held.  Entries that have been remapped since the
+ * hit was buffered are skipped.
+ */
+static void fold_hits(struct mq_policy *mq)
+{
+	int cpu;
+	unsigned i;
+	struct entry *e;
+	struct hit_buffer *hb;
+
+	if (mq->folded_tick == mq->tick)
+		return;
+	mq->folded_tick = mq->tick;
+
+	for_each_possible_cpu(cpu) {
+		hb = per_cpu_ptr(mq->hit_buffers, cpu);
+		if (!ACCESS_ONCE(hb->nr))
+			continue;
+
+		spin_lock(&hb->lock);
+		for (i = 0; i < hb->nr; i++) {
+			e = epool_find(&mq->cache_pool, hb->cblocks[i]);
+			if (e && e->oblock == hb->oblocks[i])
+				requeue_and_update_tick(mq, e);
+		}
+		hb->nr = 0;
+		spin_unlock(&hb->lock);
+	}
+}
+
 static int mq_map(struct dm_cache_policy *p, dm_oblock_t oblock,
 		  bool can_block, bool can_migrate, bool discarded_oblock,
 		  struct bio *bio, struct policy_result *result)
 {
 	int r;
+	dm_cblock_t cblock;
 	struct mq_policy *mq = to_mq_policy(p);
 
 	result->op = POLICY_MISS;
 
+	/*
+	 * Hits are the common case, and need neither the io tracker nor
+	 * the lock.
+	 */
+	if (lookup_cached(mq, oblock, &cblock)) {
+		buffer_hit(mq, oblock, cblock);
+		result->op = POLICY_HIT;
+		result->cblock = cblock;
+		return 0;
+	}
+
 	if (can_block)
 		mutex_lock(&mq->lock);
 	else if (!mutex_trylock(&mq->lock))
 		return -EWOULDBLOCK;
 
 	copy_tick(mq);
+	fold_hits(mq);
 
 	iot_examine_bio(&mq->tracker, bio);
 	r = map(mq, oblock, can_migrate, discarded_oblock,
@@ -918,6 +1137,9 @@ static int mq_lookup(struct dm_cache_policy *p, dm_oblock_t oblock, dm_cblock_t
 	struct mq_policy *mq = to_mq_policy(p);
 	struct entry *e;
 
+	if (lookup_cached(mq, oblock, cblock))
+		return 0;
+
 	if (!mutex_trylock(&mq->lock))
 		return -EWOULDBLOCK;
 
@@ -1207,6 +1429,7 @@ static struct dm_cache_policy *mq_create(dm_cblock_t cache_size,
 					 sector_t origin_size,
 					 sector_t cache_block_size)
 {
+	int cpu;
 	struct mq_policy *mq = kzalloc(sizeof(*mq), GFP_KERNEL);
 
 	if (!mq)
@@ -1236,6 +1459,7 @@ static struct dm_cache_policy *mq_create(dm_cblock_t cache_size,
 	mq->write_promote_adjustment = DEFAULT_WRITE_PROMOTE_ADJUSTMENT;
 	mutex_init(&mq->lock);
 	spin_lock_init(&mq->tick_lock);
+	seqcount_init(&mq->hash_seq);
 
 	queue_init(&mq->pre_cache);
 	queue_init(&mq->cache_clean);
@@ -1249,8 +1473,28 @@ static struct dm_cache_policy *mq_create(dm_cblock_t cache_size,
 	if (!mq->table)
 		goto bad_alloc_table;
 
+	mq->hit_buffers = alloc_percpu(struct hit_buffer);
+	if (!mq->hit_buffers)
+		goto bad_alloc_hit_buffers;
+
+	for_each_possible_cpu(cpu) {
+		struct hit_buffer *hb = per_cpu_ptr(mq->hit_buffers, cpu);
+
+		spin_lock_init(&hb->lock);
+		hb->nr = 0;
+	}
+
+	if (sketch_init(&mq->sketch, next_power(from_cblock(cache_size), 1024))) {
+		DMERR("couldn't allocate frequency sketch");
+		goto bad_sketch_init;
+	}
+
 	return &mq->policy;
 
+bad_sketch_init:
+	free_percpu(mq->hit_buffers);
+bad_alloc_hit_buffers:
+	vfree(mq->table);
 bad_alloc_table:
 	epool_exit(&mq->cache_pool);
 bad_cache_init:
@@ -1265,7 +1509,7 @@ bad_pre_cache_init:
 
 static struct dm_cache_policy_type mq_policy_type = {
 	.name = "mq",
-	.version = {1, 2, 0},
+	.version = {1, 3, 0},
 	.hint_size = 4,
 	.owner = THIS_MODULE,
 	.create = mq_create
@@ -1273,7 +1517,7 @@ static struct dm_cache_policy_type mq_policy_type = {
 
 static struct dm_cache_policy_type default_policy_type = {
 	.name = "default",
-	.version = {1, 2, 0},
+	.version = {1, 3, 0},
 	.hint_size = 4,
 	.owner = THIS_MODULE,
 	.create = mq_create,
@@ -862,6 +862,7 @@ static int dm_table_set_type(struct dm_table *t)
 {
 	unsigned i;
 	unsigned bio_based = 0, request_based = 0, hybrid = 0;
+	bool use_blk_mq = false;
 	struct dm_target *tgt;
 	struct dm_dev_internal *dd;
 	struct list_head *devices;
@@ -890,7 +891,8 @@ static int dm_table_set_type(struct dm_table *t)
 		 * Default to bio-based if device is new.
 		 */
 		live_md_type = dm_get_md_type(t->md);
-		if (live_md_type == DM_TYPE_REQUEST_BASED)
+		if (live_md_type == DM_TYPE_REQUEST_BASED ||
+		    live_md_type == DM_TYPE_MQ_REQUEST_BASED)
 			request_based = 1;
 		else
 			bio_based = 1;
@@ -907,11 +909,33 @@ static int dm_table_set_type(struct dm_table *t)
 	/* Non-request-stackable devices can't be used for request-based dm */
 	devices = dm_table_get_devices(t);
 	list_for_each_entry(dd, devices, list) {
-		if (!blk_queue_stackable(bdev_get_queue(dd->dm_dev.bdev))) {
+		struct request_queue *q = bdev_get_queue(dd->dm_dev.bdev);
+
+		if (!blk_queue_stackable(q)) {
 			DMWARN("table load rejected: including"
 			       " non-request-stackable devices");
 			return -EINVAL;
 		}
+
+		if (q->mq_ops)
+			use_blk_mq = true;
+	}
+
+	if (use_blk_mq) {
+		/* clones are allocated differently, so don't mix queue types */
+		list_for_each_entry(dd, devices, list)
+			if (!bdev_get_queue(dd->dm_dev.bdev)->mq_ops) {
+				DMWARN("table load rejected: not all devices"
+				       " are blk-mq request-stackable");
+				return -EINVAL;
+			}
+
+		for (i = 0; i < t->num_targets; i++)
+			if (!t->targets[i].type->clone_and_map_rq) {
+				DMWARN("table load rejected: target does not"
+				       " support blk-mq devices");
+				return -EINVAL;
+			}
 	}
 
 	/*
@@ -925,7 +949,7 @@ static int dm_table_set_type(struct dm_table *t)
 		return -EINVAL;
 	}
 
-	t->type = DM_TYPE_REQUEST_BASED;
+	t->type = use_blk_mq ? DM_TYPE_MQ_REQUEST_BASED : DM_TYPE_REQUEST_BASED;
 
 	return 0;
 }
@@ -942,7 +966,10 @@ struct target_type *dm_table_get_immutable_target_type(struct dm_table *t)
 
 bool dm_table_request_based(struct dm_table *t)
 {
-	return dm_table_get_type(t) == DM_TYPE_REQUEST_BASED;
+	unsigned type = dm_table_get_type(t);
+
+	return type == DM_TYPE_REQUEST_BASED ||
+	       type == DM_TYPE_MQ_REQUEST_BASED;
 }
 
 static int dm_table_alloc_md_mempools(struct dm_table *t)
@@ -1450,6 +1450,27 @@ int dm_thin_insert_block(struct dm_thin_device *td, dm_block_t block,
 	return r;
 }
 
+void dm_pool_insert_batch_begin(struct dm_pool_metadata *pmd)
+	__acquires(pmd->root_lock)
+{
+	down_write(&pmd->root_lock);
+}
+
+int dm_thin_insert_block_batched(struct dm_thin_device *td, dm_block_t block,
+				 dm_block_t data_block)
+{
+	if (td->pmd->fail_io)
+		return -EINVAL;
+
+	return __insert(td, block, data_block);
+}
+
+void dm_pool_insert_batch_end(struct dm_pool_metadata *pmd)
+	__releases(pmd->root_lock)
+{
+	up_write(&pmd->root_lock);
+}
+
 static int __remove(struct dm_thin_device *td, dm_block_t block)
 {
 	int r;
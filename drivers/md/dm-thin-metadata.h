@@ -159,6 +159,17 @@ int dm_thin_insert_block(struct dm_thin_device *td, dm_block_t block,
 
 int dm_thin_remove_block(struct dm_thin_device *td, dm_block_t block);
 
+/*
+ * Batched inserts.  A run of dm_thin_insert_block_batched() calls against
+ * devices of the same pool is bracketed by these so the metadata lock is
+ * taken once for the whole run.  No other metadata operation may be
+ * called inside the bracket.
+ */
+void dm_pool_insert_batch_begin(struct dm_pool_metadata *pmd);
+int dm_thin_insert_block_batched(struct dm_thin_device *td, dm_block_t block,
+				 dm_block_t data_block);
+void dm_pool_insert_batch_end(struct dm_pool_metadata *pmd);
+
 /*
  * Queries.
  */
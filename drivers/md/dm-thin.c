@@ -12,6 +12,7 @@
 #include <linux/dm-io.h>
 #include <linux/dm-kcopyd.h>
 #include <linux/list.h>
+#include <linux/list_sort.h>
 #include <linux/rculist.h>
 #include <linux/init.h>
 #include <linux/module.h>
@@ -551,6 +552,7 @@ struct dm_thin_new_mapping {
 	bool prepared:1;
 	bool pass_discard:1;
 	bool definitely_not_shared:1;
+	bool inserted:1;
 
 	int err;
 	struct thin_c *tc;
@@ -677,15 +679,18 @@ static void process_prepared_mapping(struct dm_thin_new_mapping *m)
 	}
 
 	/*
-	 * Commit the prepared block into the mapping btree.
+	 * Commit the prepared block into the mapping btree, unless
+	 * process_prepared_mappings() already did so as part of a batch.
 	 * Any I/O for this block arriving after this point will get
 	 * remapped to it directly.
 	 */
-	r = dm_thin_insert_block(tc->td, m->virt_block, m->data_block);
-	if (r) {
-		metadata_operation_failed(pool, "dm_thin_insert_block", r);
-		cell_error(pool, m->cell);
-		goto out;
+	if (!m->inserted) {
+		r = dm_thin_insert_block(tc->td, m->virt_block, m->data_block);
+		if (r) {
+			metadata_operation_failed(pool, "dm_thin_insert_block", r);
+			cell_error(pool, m->cell);
+			goto out;
+		}
 	}
 
 	/*
@@ -767,6 +772,73 @@ static void process_prepared(struct pool *pool, struct list_head *head,
 		(*fn)(m);
 }
 
+static int cmp_mapping(void *priv, struct list_head *a, struct list_head *b)
+{
+	struct dm_thin_new_mapping *ma = list_entry(a, struct dm_thin_new_mapping, list);
+	struct dm_thin_new_mapping *mb = list_entry(b, struct dm_thin_new_mapping, list);
+
+	if (ma->tc->dev_id != mb->tc->dev_id)
+		return ma->tc->dev_id < mb->tc->dev_id ? -1 : 1;
+
+	if (ma->virt_block != mb->virt_block)
+		return ma->virt_block < mb->virt_block ? -1 : 1;
+
+	return 0;
+}
+
+/*
+ * Insert all the prepared mappings into the btree under a single hold of
+ * the metadata lock, in key order so neighbouring inserts reuse the
+ * nodes already shadowed in this transaction, then complete them.
+ * This keeps the lock free for the lookups in thin_bio_map() far more
+ * often than taking it once per mapping.
+ */
+static void process_prepared_mappings(struct pool *pool)
+{
+	int r;
+	unsigned long flags;
+	struct list_head maps;
+	struct dm_thin_new_mapping *m, *tmp;
+
+	INIT_LIST_HEAD(&maps);
+	spin_lock_irqsave(&pool->lock, flags);
+	list_splice_init(&pool->prepared_mappings, &maps);
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	if (list_empty(&maps))
+		return;
+
+	if (pool->process_prepared_mapping == process_prepared_mapping) {
+		list_sort(NULL, &maps, cmp_mapping);
+
+		r = 0;
+		dm_pool_insert_batch_begin(pool->pmd);
+		list_for_each_entry(m, &maps, list) {
+			if (m->err)
+				continue;
+
+			r = dm_thin_insert_block_batched(m->tc->td, m->virt_block,
+							 m->data_block);
+			if (r) {
+				m->err = r;
+				break;
+			}
+			m->inserted = true;
+		}
+		dm_pool_insert_batch_end(pool->pmd);
+
+		/*
+		 * This switches the pool to read-only mode, so the mappings
+		 * below are all completed by process_prepared_mapping_fail().
+		 */
+		if (r)
+			metadata_operation_failed(pool, "dm_thin_insert_block", r);
+	}
+
+	list_for_each_entry_safe(m, tmp, &maps, list)
+		pool->process_prepared_mapping(m);
+}
+
 /*
  * Deferred bio jobs.
  */
@@ -1576,7 +1648,7 @@ static void do_worker(struct work_struct *ws)
 {
 	struct pool *pool = container_of(ws, struct pool, worker);
 
-	process_prepared(pool, &pool->prepared_mappings, &pool->process_prepared_mapping);
+	process_prepared_mappings(pool);
 	process_prepared(pool, &pool->prepared_discards, &pool->process_prepared_discard);
 	process_deferred_bios(pool);
 }
@@ -37,6 +37,7 @@
 #define DM_TYPE_NONE		0
 #define DM_TYPE_BIO_BASED	1
 #define DM_TYPE_REQUEST_BASED	2
+#define DM_TYPE_MQ_REQUEST_BASED	3	/* request-based on blk-mq paths */
 
 /*
  * List of devices that a metadevice uses and should open/close.
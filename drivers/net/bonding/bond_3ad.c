@@ -2130,8 +2130,12 @@ re_arm:
 	rcu_read_unlock();
 	read_unlock(&bond->lock);
 
+	/* Ports changed state: also refresh the xmit slave array. Both
+	 * are retried on the next run if RTNL is busy.
+	 */
 	if (should_notify_rtnl && rtnl_trylock()) {
 		bond_slave_state_notify(bond);
+		bond_update_slave_arr(bond, NULL);
 		rtnl_unlock();
 	}
 	queue_delayed_work(bond->wq, &bond->ad_work, ad_delta_in_ticks);
@@ -2426,6 +2430,9 @@ int bond_3ad_xmit_xor(struct sk_buff *skb, struct net_device *dev)
 	int slave_agg_no;
 	int agg_id;
 
+	if (likely(bond_xmit_slave_arr(bond, skb)))
+		goto out;
+
 	if (__bond_3ad_get_active_agg_info(bond, &ad_info)) {
 		pr_debug("%s: Error: __bond_3ad_get_active_agg_info failed\n",
 			 dev->name);
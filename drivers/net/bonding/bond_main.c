@@ -1538,6 +1538,7 @@ int bond_enslave(struct net_device *bond_dev, struct net_device *slave_dev)
 	bond->slave_cnt++;
 	bond_compute_features(bond);
 	bond_set_carrier(bond);
+	bond_update_slave_arr(bond, NULL);
 
 	if (USES_PRIMARY(bond->params.mode)) {
 		block_netpoll_tx();
@@ -1666,6 +1667,9 @@ static int __bond_release_one(struct net_device *bond_dev,
 
 	write_unlock_bh(&bond->lock);
 
+	/* Stop hashing traffic to it before the grace period below. */
+	bond_update_slave_arr(bond, slave);
+
 	pr_info("%s: Releasing %s interface %s\n",
 		bond_dev->name,
 		bond_is_active_slave(slave) ? "active" : "backup",
@@ -2044,6 +2048,7 @@ do_failover:
 	}
 
 	bond_set_carrier(bond);
+	bond_update_slave_arr(bond, NULL);
 }
 
 /*
@@ -2484,6 +2489,7 @@ static void bond_loadbalance_arp_mon(struct work_struct *work)
 			write_unlock_bh(&bond->curr_slave_lock);
 			unblock_netpoll_tx();
 		}
+		bond_update_slave_arr(bond, NULL);
 		rtnl_unlock();
 	}
 
@@ -2863,11 +2869,13 @@ static int bond_slave_netdev_event(unsigned long event,
 			if (old_duplex != slave->duplex)
 				bond_3ad_adapter_duplex_changed(slave);
 		}
+		bond_update_slave_arr(bond, NULL);
 		break;
 	case NETDEV_DOWN:
 		/*
 		 * ... Or is it this?
 		 */
+		bond_update_slave_arr(bond, NULL);
 		break;
 	case NETDEV_CHANGEMTU:
 		/*
@@ -2980,7 +2988,9 @@ static bool bond_flow_dissect(struct bonding *bond, struct sk_buff *skb,
 	const struct iphdr *iph;
 	int noff, proto = -1;
 
-	if (bond->params.xmit_policy > BOND_XMIT_POLICY_LAYER23)
+	if (bond->params.xmit_policy == BOND_XMIT_POLICY_ENCAP23)
+		return __skb_flow_dissect(skb, fk, FLOW_DISSECTOR_F_STOP_AT_L3);
+	if (bond->params.xmit_policy == BOND_XMIT_POLICY_ENCAP34)
 		return skb_flow_dissect(skb, fk);
 
 	fk->ports = 0;
@@ -3026,6 +3036,11 @@ int bond_xmit_hash(struct bonding *bond, struct sk_buff *skb, int count)
 	struct flow_keys flow;
 	u32 hash;
 
+	/* Reuse a 4-tuple hash the device or the stack already computed */
+	if (bond->params.xmit_policy == BOND_XMIT_POLICY_ENCAP34 &&
+	    skb->l4_hash)
+		return skb->hash % count;
+
 	if (bond->params.xmit_policy == BOND_XMIT_POLICY_LAYER2 ||
 	    !bond_flow_dissect(bond, skb, &flow))
 		return bond_eth_hash(skb) % count;
@@ -3042,6 +3057,93 @@ int bond_xmit_hash(struct bonding *bond, struct sk_buff *skb, int count)
 	return hash % count;
 }
 
+/**
+ * bond_update_slave_arr - rebuild the array of usable slaves
+ * @bond: bonding device
+ * @skipslave: slave being released, left out of the array (may be NULL)
+ *
+ * Collects the slaves the xor and 802.3ad modes may hash traffic to, so
+ * the xmit path picks a slave with a single array lookup instead of
+ * walking the slave list. On allocation failure the array is removed and
+ * the xmit path falls back to the list walk. Must be called with RTNL.
+ */
+int bond_update_slave_arr(struct bonding *bond, struct slave *skipslave)
+{
+	struct bond_up_slave *new_arr, *old_arr;
+	struct list_head *iter;
+	struct slave *slave;
+	int agg_id = 0;
+	int ret = 0;
+
+	ASSERT_RTNL();
+
+	if (bond->params.mode != BOND_MODE_XOR &&
+	    bond->params.mode != BOND_MODE_8023AD)
+		return 0;
+
+	new_arr = kzalloc(offsetof(struct bond_up_slave, arr[bond->slave_cnt]),
+			  GFP_KERNEL);
+	if (!new_arr) {
+		ret = -ENOMEM;
+		goto publish;
+	}
+
+	if (bond->params.mode == BOND_MODE_8023AD) {
+		struct ad_info ad_info;
+
+		/* No active aggregator: nothing to transmit on */
+		if (bond_3ad_get_active_agg_info(bond, &ad_info))
+			goto publish;
+		agg_id = ad_info.aggregator_id;
+	}
+
+	bond_for_each_slave(bond, slave, iter) {
+		if (slave == skipslave || !slave_can_tx(slave))
+			continue;
+		if (bond->params.mode == BOND_MODE_8023AD) {
+			struct aggregator *agg;
+
+			agg = SLAVE_AD_INFO(slave).port.aggregator;
+			if (!agg || agg->aggregator_identifier != agg_id)
+				continue;
+		}
+		new_arr->arr[new_arr->count++] = slave;
+	}
+
+publish:
+	old_arr = rtnl_dereference(bond->slave_arr);
+	rcu_assign_pointer(bond->slave_arr, new_arr);
+	if (old_arr)
+		kfree_rcu(old_arr, rcu);
+	return ret;
+}
+
+/**
+ * bond_xmit_slave_arr - transmit through the usable slave array
+ * @bond: bonding device
+ * @skb: buffer to transmit
+ *
+ * Returns true if the skb was consumed. Returns false if the array is
+ * missing or empty, or the slave it points to can no longer transmit; the
+ * caller then uses its slave list walk. Called with rcu_read_lock held.
+ */
+bool bond_xmit_slave_arr(struct bonding *bond, struct sk_buff *skb)
+{
+	struct bond_up_slave *slaves;
+	struct slave *slave;
+
+	slaves = rcu_dereference(bond->slave_arr);
+	if (unlikely(!slaves || !slaves->count))
+		return false;
+
+	slave = slaves->arr[bond_xmit_hash(bond, skb, slaves->count)];
+	if (unlikely(!slave_can_tx(slave)))
+		return false;
+
+	bond_dev_queue_xmit(bond, skb, slave->dev);
+	return true;
+}
+
 /*-------------------------- Device entry points ----------------------------*/
 
 static void bond_work_init_all(struct bonding *bond)
@@ -3666,6 +3768,9 @@ static int bond_xmit_xor(struct sk_buff *skb, struct net_device *bond_dev)
 {
 	struct bonding *bond = netdev_priv(bond_dev);
 
+	if (likely(bond_xmit_slave_arr(bond, skb)))
+		return NETDEV_TX_OK;
+
 	bond_xmit_slave_id(bond, skb, bond_xmit_hash(bond, skb, bond->slave_cnt));
 
 	return NETDEV_TX_OK;
@@ -3959,6 +4064,7 @@ void bond_setup(struct net_device *bond_dev)
 static void bond_uninit(struct net_device *bond_dev)
 {
 	struct bonding *bond = netdev_priv(bond_dev);
+	struct bond_up_slave *arr;
 	struct list_head *iter;
 	struct slave *slave;
 
@@ -3969,6 +4075,12 @@ static void bond_uninit(struct net_device *bond_dev)
 		__bond_release_one(bond_dev, slave->dev, true);
 	pr_info("%s: Released all slaves\n", bond_dev->name);
 
+	arr = rtnl_dereference(bond->slave_arr);
+	if (arr) {
+		RCU_INIT_POINTER(bond->slave_arr, NULL);
+		kfree_rcu(arr, rcu);
+	}
+
 	list_del(&bond->bond_list);
 
 	bond_debug_unregister(bond);
@@ -217,6 +217,17 @@ struct slave {
  */
 #define BOND_LINK_NOCHANGE -1
 
+/*
+ * Slaves a hash based xmit mode (xor, 802.3ad) can transmit on, rebuilt
+ * under RTNL whenever membership or slave state changes and read under RCU
+ * in the xmit path.
+ */
+struct bond_up_slave {
+	unsigned int	count;
+	struct rcu_head	rcu;
+	struct slave	*arr[0];
+};
+
 /*
  * Here are the locking policies for the two bonding locks:
  *
@@ -231,6 +242,7 @@ struct bonding {
 	struct   slave *curr_active_slave;
 	struct   slave *current_arp_slave;
 	struct   slave *primary_slave;
+	struct   bond_up_slave __rcu *slave_arr; /* usable slaves for xmit hash */
 	bool     force_primary;
 	s32      slave_cnt; /* never change this value outside the attach/detach wrappers */
 	int     (*recv_probe)(const struct sk_buff *, struct bonding *,
@@ -500,6 +512,8 @@ void bond_sysfs_slave_del(struct slave *slave);
 int bond_enslave(struct net_device *bond_dev, struct net_device *slave_dev);
 int bond_release(struct net_device *bond_dev, struct net_device *slave_dev);
 int bond_xmit_hash(struct bonding *bond, struct sk_buff *skb, int count);
+int bond_update_slave_arr(struct bonding *bond, struct slave *skipslave);
+bool bond_xmit_slave_arr(struct bonding *bond, struct sk_buff *skb);
 void bond_select_active_slave(struct bonding *bond);
 void bond_change_active_slave(struct bonding *bond, struct slave *new_active);
 void bond_create_debugfs(void);
@@ -102,6 +102,9 @@
  */
 #define IXGBE_RX_HDR_SIZE IXGBE_RXBUFFER_256
 
+/* Rx pages kept mapped per ring while the stack holds them, power of 2 */
+#define IXGBE_RX_STASH_SIZE	64
+
 /* How many Rx Buffers do we bundle into one write to the hardware ? */
 #define IXGBE_RX_BUFFER_WRITE	16	/* Must be power of 2 */
 
@@ -280,6 +283,11 @@ struct ixgbe_ring {
 		};
 	};
 
+	/* Rx pages still used by the stack, kept mapped for reuse */
+	struct ixgbe_rx_buffer *rx_stash;
+	u16 stash_head;
+	u16 stash_tail;
+
 	u8 dcb_tc;
 	struct ixgbe_queue_stats stats;
 	struct u64_stats_sync syncp;
@@ -404,6 +412,20 @@ struct ixgbe_q_vector {
 	/* for dynamic allocation of rings associated with this q_vector */
 	struct ixgbe_ring ring[0] ____cacheline_internodealigned_in_smp;
 };
+
+/*
+ * The node Rx pages are allocated and recycled on: the one of the q_vector
+ * when it is bound to a CPU, so that the pages put on the ring at open time,
+ * from process context, aren't dropped on first use, else the local memory
+ * node of the CPU cleaning the ring.
+ */
+static inline int ixgbe_rx_node(struct ixgbe_ring *ring)
+{
+	int node = ring->q_vector ? ring->q_vector->numa_node : NUMA_NO_NODE;
+
+	return node != NUMA_NO_NODE ? node : numa_mem_id();
+}
+
 #ifdef CONFIG_NET_RX_BUSY_POLL
 static inline void ixgbe_qv_init_lock(struct ixgbe_q_vector *q_vector)
 {
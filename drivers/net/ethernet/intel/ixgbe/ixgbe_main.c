@@ -48,6 +48,7 @@
 #include <linux/if_macvlan.h>
 #include <linux/if_bridge.h>
 #include <linux/prefetch.h>
+#include <linux/filter.h>
 #include <scsi/fc/fc_fcoe.h>
 
 #include "ixgbe.h"
@@ -1408,6 +1409,84 @@ static inline void ixgbe_release_rx_desc(struct ixgbe_ring *rx_ring, u32 val)
 	ixgbe_write_tail(rx_ring, val);
 }
 
+/**
+ * ixgbe_stash_rx_page - park a page the stack still holds a reference to
+ * @rx_ring: rx descriptor ring the page was mapped for
+ * @rx_buffer: buffer holding the page and its DMA mapping
+ *
+ * Pages that could not be flipped because the stack is still using the
+ * other half are kept mapped in a small FIFO instead of being unmapped,
+ * so that ixgbe_alloc_mapped_page() can pick them up again once the
+ * stack has let go of them.  Returns true if the mapping now belongs to
+ * the stash.
+ **/
+static bool ixgbe_stash_rx_page(struct ixgbe_ring *rx_ring,
+				struct ixgbe_rx_buffer *rx_buffer)
+{
+#if (PAGE_SIZE < 8192)
+	struct page *page = rx_buffer->page;
+	struct ixgbe_rx_buffer *stash;
+
+	/* only keep pages that are local and not from the emergency reserve */
+	if (page_to_nid(page) != ixgbe_rx_node(rx_ring) || page->pfmemalloc)
+		return false;
+
+	/* stash is full, release the oldest entry to make room */
+	if ((u16)(rx_ring->stash_tail - rx_ring->stash_head) ==
+	    IXGBE_RX_STASH_SIZE) {
+		stash = &rx_ring->rx_stash[rx_ring->stash_head++ &
+					   (IXGBE_RX_STASH_SIZE - 1)];
+		dma_unmap_page(rx_ring->dev, stash->dma,
+			       ixgbe_rx_pg_size(rx_ring), DMA_FROM_DEVICE);
+		put_page(stash->page);
+	}
+
+	stash = &rx_ring->rx_stash[rx_ring->stash_tail++ &
+				   (IXGBE_RX_STASH_SIZE - 1)];
+	get_page(page);
+	stash->page = page;
+	stash->dma = rx_buffer->dma;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * ixgbe_unstash_rx_page - reuse the oldest stashed page if it is free
+ * @rx_ring: rx descriptor ring to take the page from
+ * @bi: buffer to hand the page and its DMA mapping to
+ **/
+static bool ixgbe_unstash_rx_page(struct ixgbe_ring *rx_ring,
+				  struct ixgbe_rx_buffer *bi)
+{
+	struct ixgbe_rx_buffer *stash;
+
+	if (rx_ring->stash_head == rx_ring->stash_tail)
+		return false;
+
+	stash = &rx_ring->rx_stash[rx_ring->stash_head &
+				   (IXGBE_RX_STASH_SIZE - 1)];
+
+	/* the stack is still holding on to the page */
+	if (page_count(stash->page) != 1)
+		return false;
+
+	rx_ring->stash_head++;
+
+	bi->page = stash->page;
+	bi->dma = stash->dma;
+	bi->page_offset = 0;
+
+	/* the CPU may have touched the page, give it back to the device */
+	dma_sync_single_range_for_device(rx_ring->dev, bi->dma, 0,
+					 ixgbe_rx_pg_size(rx_ring),
+					 DMA_FROM_DEVICE);
+
+	return true;
+}
+
 static bool ixgbe_alloc_mapped_page(struct ixgbe_ring *rx_ring,
 				    struct ixgbe_rx_buffer *bi)
 {
@@ -1420,8 +1499,15 @@ static bool ixgbe_alloc_mapped_page(struct ixgbe_ring *rx_ring,
 
 	/* alloc new page for storage */
 	if (likely(!page)) {
-		page = __skb_alloc_pages(GFP_ATOMIC | __GFP_COLD | __GFP_COMP,
-					 bi->skb, ixgbe_rx_pg_order(rx_ring));
+		if (ixgbe_unstash_rx_page(rx_ring, bi))
+			return true;
+
+		page = alloc_pages_node(ixgbe_rx_node(rx_ring),
+					GFP_ATOMIC | __GFP_COLD | __GFP_COMP |
+					__GFP_MEMALLOC,
+					ixgbe_rx_pg_order(rx_ring));
+		if (page && page->pfmemalloc && bi->skb)
+			bi->skb->pfmemalloc = true;
 		if (unlikely(!page)) {
 			rx_ring->rx_stats.alloc_rx_page_failed++;
 			return false;
@@ -1936,7 +2022,7 @@ static bool ixgbe_add_rx_frag(struct ixgbe_ring *rx_ring,
 		memcpy(__skb_put(skb, size), va, ALIGN(size, sizeof(long)));
 
 		/* we can reuse buffer as-is, just make sure it is local */
-		if (likely(page_to_nid(page) == numa_node_id()))
+		if (likely(page_to_nid(page) == ixgbe_rx_node(rx_ring)))
 			return true;
 
 		/* this page cannot be reused so discard it */
@@ -1948,7 +2034,7 @@ static bool ixgbe_add_rx_frag(struct ixgbe_ring *rx_ring,
 			rx_buffer->page_offset, size, truesize);
 
 	/* avoid re-using remote pages */
-	if (unlikely(page_to_nid(page) != numa_node_id()))
+	if (unlikely(page_to_nid(page) != ixgbe_rx_node(rx_ring)))
 		return false;
 
 #if (PAGE_SIZE < 8192)
@@ -2047,7 +2133,7 @@ dma_sync:
 	} else if (IXGBE_CB(skb)->dma == rx_buffer->dma) {
 		/* the page has been released from the ring */
 		IXGBE_CB(skb)->page_released = true;
-	} else {
+	} else if (!ixgbe_stash_rx_page(rx_ring, rx_buffer)) {
 		/* we are not reusing the buffer so unmap it */
 		dma_unmap_page(rx_ring->dev, rx_buffer->dma,
 			       ixgbe_rx_pg_size(rx_ring),
@@ -2062,6 +2148,54 @@ dma_sync:
 	return skb;
 }
 
+/**
+ * ixgbe_rx_filter_drop - run the early Rx filter on a raw Rx buffer
+ * @rx_ring: rx descriptor ring the frame arrived on
+ * @rx_desc: descriptor of the frame at next_to_clean
+ *
+ * Only frames that fit a single buffer are filtered; chained and errored
+ * frames take the normal path.  A dropped frame hands its buffer straight
+ * back to the ring, so no skb is ever allocated for it.
+ *
+ * Returns true if the frame was dropped and the descriptor consumed.
+ **/
+static bool ixgbe_rx_filter_drop(struct ixgbe_ring *rx_ring,
+				 union ixgbe_adv_rx_desc *rx_desc)
+{
+	struct ixgbe_rx_buffer *rx_buffer;
+	unsigned int size;
+	void *va;
+	u16 ntc;
+
+	rx_buffer = &rx_ring->rx_buffer_info[rx_ring->next_to_clean];
+	if (rx_buffer->skb ||
+	    !ixgbe_test_staterr(rx_desc, IXGBE_RXD_STAT_EOP) ||
+	    ixgbe_test_staterr(rx_desc, IXGBE_RXDADV_ERR_FRAME_ERR_MASK))
+		return false;
+
+	size = le16_to_cpu(rx_desc->wb.upper.length);
+	dma_sync_single_range_for_cpu(rx_ring->dev,
+				      rx_buffer->dma,
+				      rx_buffer->page_offset,
+				      size,
+				      DMA_FROM_DEVICE);
+	va = page_address(rx_buffer->page) + rx_buffer->page_offset;
+
+	if (netdev_rx_filter_run(rx_ring->netdev, va, size,
+				 rx_ring->queue_index) != NET_RX_FILTER_DROP)
+		return false;
+
+	/* the buffer was never handed out, give it back as it is */
+	ixgbe_reuse_rx_page(rx_ring, rx_buffer);
+	rx_buffer->dma = 0;
+	rx_buffer->page = NULL;
+
+	ntc = rx_ring->next_to_clean + 1;
+	rx_ring->next_to_clean = (ntc < rx_ring->count) ? ntc : 0;
+
+	return true;
+}
+
 /**
  * ixgbe_clean_rx_irq - Clean completed descriptors from Rx ring - bounce buf
  * @q_vector: structure containing interrupt and ring information
@@ -2109,6 +2243,13 @@ static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 		 */
 		rmb();
 
+		if (unlikely(rcu_access_pointer(rx_ring->netdev->rx_filter)) &&
+		    ixgbe_rx_filter_drop(rx_ring, rx_desc)) {
+			cleaned_count++;
+			total_rx_packets++;
+			continue;
+		}
+
 		/* retrieve a buffer from the ring */
 		skb = ixgbe_fetch_rx_buffer(rx_ring, rx_desc);
 
@@ -4328,7 +4469,21 @@ static void ixgbe_clean_rx_ring(struct ixgbe_ring *rx_ring)
 		rx_buffer->page = NULL;
 	}
 
-	size = sizeof(struct ixgbe_rx_buffer) * rx_ring->count;
+	/* Release the pages still parked in the stash */
+	while (rx_ring->stash_head != rx_ring->stash_tail) {
+		struct ixgbe_rx_buffer *stash;
+
+		stash = &rx_ring->rx_stash[rx_ring->stash_head++ &
+					   (IXGBE_RX_STASH_SIZE - 1)];
+		dma_unmap_page(dev, stash->dma, ixgbe_rx_pg_size(rx_ring),
+			       DMA_FROM_DEVICE);
+		put_page(stash->page);
+	}
+	rx_ring->stash_head = 0;
+	rx_ring->stash_tail = 0;
+
+	size = sizeof(struct ixgbe_rx_buffer) *
+	       (rx_ring->count + IXGBE_RX_STASH_SIZE);
 	memset(rx_ring->rx_buffer_info, 0, size);
 
 	/* Zero out the descriptor ring */
@@ -5249,7 +5404,9 @@ int ixgbe_setup_rx_resources(struct ixgbe_ring *rx_ring)
 	int numa_node = -1;
 	int size;
 
-	size = sizeof(struct ixgbe_rx_buffer) * rx_ring->count;
+	/* the page stash lives right behind the buffers of the ring */
+	size = sizeof(struct ixgbe_rx_buffer) *
+	       (rx_ring->count + IXGBE_RX_STASH_SIZE);
 
 	if (rx_ring->q_vector)
 		numa_node = rx_ring->q_vector->numa_node;
@@ -5260,6 +5417,10 @@ int ixgbe_setup_rx_resources(struct ixgbe_ring *rx_ring)
 	if (!rx_ring->rx_buffer_info)
 		goto err;
 
+	rx_ring->rx_stash = rx_ring->rx_buffer_info + rx_ring->count;
+	rx_ring->stash_head = 0;
+	rx_ring->stash_tail = 0;
+
 	u64_stats_init(&rx_ring->syncp);
 
 	/* Round up to nearest 4K */
@@ -6696,6 +6857,32 @@ static void ixgbe_tx_olinfo_status(union ixgbe_adv_tx_desc *tx_desc,
 	tx_desc->read.olinfo_status = cpu_to_le32(olinfo_status);
 }
 
+static int __ixgbe_maybe_stop_tx(struct ixgbe_ring *tx_ring, u16 size)
+{
+	netif_stop_subqueue(tx_ring->netdev, tx_ring->queue_index);
+	/* Herbert's original patch had:
+	 *  smp_mb__after_netif_stop_queue();
+	 * but since that doesn't exist yet, just open code it. */
+	smp_mb();
+
+	/* We need to check again in a case another CPU has just
+	 * made room available. */
+	if (likely(ixgbe_desc_unused(tx_ring) < size))
+		return -EBUSY;
+
+	/* A reprieve! - use start_queue because it doesn't call schedule */
+	netif_start_subqueue(tx_ring->netdev, tx_ring->queue_index);
+	++tx_ring->tx_stats.restart_queue;
+	return 0;
+}
+
+static inline int ixgbe_maybe_stop_tx(struct ixgbe_ring *tx_ring, u16 size)
+{
+	if (likely(ixgbe_desc_unused(tx_ring) >= size))
+		return 0;
+	return __ixgbe_maybe_stop_tx(tx_ring, size);
+}
+
 #define IXGBE_TXD_CMD (IXGBE_TXD_CMD_EOP | \
 		       IXGBE_TXD_CMD_RS)
 
@@ -6817,8 +7004,11 @@ static void ixgbe_tx_map(struct ixgbe_ring *tx_ring,
 
 	tx_ring->next_to_use = i;
 
-	/* notify HW of packet */
-	ixgbe_write_tail(tx_ring, i);
+	ixgbe_maybe_stop_tx(tx_ring, DESC_NEEDED);
+
+	/* notify HW of packet, unless the stack has more for this ring */
+	if (netif_xmit_stopped(txring_txq(tx_ring)) || !skb->xmit_more)
+		ixgbe_write_tail(tx_ring, i);
 
 	return;
 dma_error:
@@ -6926,32 +7116,6 @@ static void ixgbe_atr(struct ixgbe_ring *ring,
 					      input, common, ring->queue_index);
 }
 
-static int __ixgbe_maybe_stop_tx(struct ixgbe_ring *tx_ring, u16 size)
-{
-	netif_stop_subqueue(tx_ring->netdev, tx_ring->queue_index);
-	/* Herbert's original patch had:
-	 *  smp_mb__after_netif_stop_queue();
-	 * but since that doesn't exist yet, just open code it. */
-	smp_mb();
-
-	/* We need to check again in a case another CPU has just
-	 * made room available. */
-	if (likely(ixgbe_desc_unused(tx_ring) < size))
-		return -EBUSY;
-
-	/* A reprieve! - use start_queue because it doesn't call schedule */
-	netif_start_subqueue(tx_ring->netdev, tx_ring->queue_index);
-	++tx_ring->tx_stats.restart_queue;
-	return 0;
-}
-
-static inline int ixgbe_maybe_stop_tx(struct ixgbe_ring *tx_ring, u16 size)
-{
-	if (likely(ixgbe_desc_unused(tx_ring) >= size))
-		return 0;
-	return __ixgbe_maybe_stop_tx(tx_ring, size);
-}
-
 static u16 ixgbe_select_queue(struct net_device *dev, struct sk_buff *skb,
 			      void *accel_priv, select_queue_fallback_t fallback)
 {
@@ -7120,8 +7284,6 @@ xmit_fcoe:
 #endif /* IXGBE_FCOE */
 	ixgbe_tx_map(tx_ring, first, hdr_len);
 
-	ixgbe_maybe_stop_tx(tx_ring, DESC_NEEDED);
-
 	return NETDEV_TX_OK;
 
 out_drop:
@@ -8135,6 +8297,7 @@ skip_sriov:
 
 	netdev->priv_flags |= IFF_UNICAST_FLT;
 	netdev->priv_flags |= IFF_SUPP_NOFCS;
+	netdev->priv_flags |= IFF_RX_FILTER;
 
 #ifdef CONFIG_IXGBE_DCB
 	netdev->dcbnl_ops = &dcbnl_ops;
@@ -40,10 +40,71 @@
 #include <linux/if_ether.h>
 #include <linux/if_vlan.h>
 #include <linux/vmalloc.h>
+#include <linux/filter.h>
 
 #include "mlx4_en.h"
 
+/* Keep an exhausted page mapped until the stack is done with its frags */
+static bool mlx4_en_rx_recycle(struct mlx4_en_priv *priv,
+			       struct mlx4_en_rx_ring *ring,
+			       const struct mlx4_en_rx_alloc *frag)
+{
+	struct mlx4_en_page_cache *cache = &ring->page_cache;
+	struct mlx4_en_rx_alloc *entry;
+	struct page *page = frag->page;
+
+	/* Only cache full size, local pages not taken from the reserves */
+	if (frag->page_size != PAGE_SIZE << MLX4_EN_ALLOC_PREFER_ORDER ||
+	    page->pfmemalloc || page_to_nid(page) != numa_mem_id())
+		return false;
+
+	/* Cache is full, release the oldest entry to make room so that a
+	 * page the stack holds on to can't stall recycling for good.
+	 */
+	if (cache->tail - cache->head == MLX4_EN_CACHE_SIZE) {
+		entry = &cache->buf[cache->head++ & (MLX4_EN_CACHE_SIZE - 1)];
+		dma_unmap_page(priv->ddev, entry->dma, entry->page_size,
+			       PCI_DMA_FROMDEVICE);
+		put_page(entry->page);
+	}
+
+	get_page(page);
+	cache->buf[cache->tail++ & (MLX4_EN_CACHE_SIZE - 1)] = *frag;
+	return true;
+}
+
+static bool mlx4_en_rx_reuse_page(struct mlx4_en_priv *priv,
+				  struct mlx4_en_rx_ring *ring,
+				  struct mlx4_en_rx_alloc *page_alloc,
+				  const struct mlx4_en_frag_info *frag_info)
+{
+	struct mlx4_en_page_cache *cache = &ring->page_cache;
+	struct mlx4_en_rx_alloc *entry;
+
+	if (cache->head == cache->tail)
+		return false;
+
+	/* The oldest page is the most likely to be released by now */
+	entry = &cache->buf[cache->head & (MLX4_EN_CACHE_SIZE - 1)];
+	if (page_count(entry->page) != 1)
+		return false;
+	cache->head++;
+
+	dma_sync_single_for_device(priv->ddev, entry->dma, entry->page_size,
+				   DMA_FROM_DEVICE);
+	page_alloc->page_size = entry->page_size;
+	page_alloc->page = entry->page;
+	page_alloc->dma = entry->dma;
+	page_alloc->page_offset = frag_info->frag_align;
+	/* We hold the only reference, see mlx4_alloc_pages() */
+	atomic_set(&entry->page->_count,
+		   page_alloc->page_size / frag_info->frag_stride);
+	ring->page_reuse++;
+	return true;
+}
+
 static int mlx4_alloc_pages(struct mlx4_en_priv *priv,
+			    struct mlx4_en_rx_ring *ring,
 			    struct mlx4_en_rx_alloc *page_alloc,
 			    const struct mlx4_en_frag_info *frag_info,
 			    gfp_t _gfp)
@@ -52,6 +113,9 @@ static int mlx4_alloc_pages(struct mlx4_en_priv *priv,
 	struct page *page;
 	dma_addr_t dma;
 
+	if (mlx4_en_rx_reuse_page(priv, ring, page_alloc, frag_info))
+		return 0;
+
 	for (order = MLX4_EN_ALLOC_PREFER_ORDER; ;) {
 		gfp_t gfp = _gfp;
 
@@ -83,6 +147,7 @@ static int mlx4_alloc_pages(struct mlx4_en_priv *priv,
 }
 
 static int mlx4_en_alloc_frags(struct mlx4_en_priv *priv,
+			       struct mlx4_en_rx_ring *ring,
 			       struct mlx4_en_rx_desc *rx_desc,
 			       struct mlx4_en_rx_alloc *frags,
 			       struct mlx4_en_rx_alloc *ring_alloc,
@@ -103,7 +168,8 @@ static int mlx4_en_alloc_frags(struct mlx4_en_priv *priv,
 		    ring_alloc[i].page_size)
 			continue;
 
-		if (mlx4_alloc_pages(priv, &page_alloc[i], frag_info, gfp))
+		if (mlx4_alloc_pages(priv, ring, &page_alloc[i], frag_info,
+				     gfp))
 			goto out;
 	}
 
@@ -130,20 +196,34 @@ out:
 	return -ENOMEM;
 }
 
-static void mlx4_en_free_frag(struct mlx4_en_priv *priv,
-			      struct mlx4_en_rx_alloc *frags,
-			      int i)
+/* Called with the last frag of a page: unmap the page or cache it */
+static void mlx4_en_release_page(struct mlx4_en_priv *priv,
+				 struct mlx4_en_rx_ring *ring,
+				 struct mlx4_en_rx_alloc *frags,
+				 int i)
 {
 	const struct mlx4_en_frag_info *frag_info = &priv->frag_info[i];
 	u32 next_frag_end = frags[i].page_offset + 2 * frag_info->frag_stride;
 
+	if (next_frag_end <= frags[i].page_size)
+		return;
 
-	if (next_frag_end > frags[i].page_size)
+	if (!mlx4_en_rx_recycle(priv, ring, &frags[i]))
 		dma_unmap_page(priv->ddev, frags[i].dma, frags[i].page_size,
 			       PCI_DMA_FROMDEVICE);
+}
+
+/* Frags handed to the stack were already released by complete_rx_desc */
+static void mlx4_en_free_frag(struct mlx4_en_priv *priv,
+			      struct mlx4_en_rx_ring *ring,
+			      struct mlx4_en_rx_alloc *frags,
+			      int i)
+{
+	if (!frags[i].page)
+		return;
 
-	if (frags[i].page)
-		put_page(frags[i].page);
+	mlx4_en_release_page(priv, ring, frags, i);
+	put_page(frags[i].page);
 }
 
 static int mlx4_en_init_allocator(struct mlx4_en_priv *priv,
@@ -155,7 +235,7 @@ static int mlx4_en_init_allocator(struct mlx4_en_priv *priv,
 	for (i = 0; i < priv->num_frags; i++) {
 		const struct mlx4_en_frag_info *frag_info = &priv->frag_info[i];
 
-		if (mlx4_alloc_pages(priv, &ring->page_alloc[i],
+		if (mlx4_alloc_pages(priv, ring, &ring->page_alloc[i],
 				     frag_info, GFP_KERNEL))
 			goto out;
 	}
@@ -179,9 +259,20 @@ out:
 static void mlx4_en_destroy_allocator(struct mlx4_en_priv *priv,
 				      struct mlx4_en_rx_ring *ring)
 {
+	struct mlx4_en_page_cache *cache = &ring->page_cache;
 	struct mlx4_en_rx_alloc *page_alloc;
 	int i;
 
+	while (cache->head != cache->tail) {
+		page_alloc = &cache->buf[cache->head++ &
+					 (MLX4_EN_CACHE_SIZE - 1)];
+		dma_unmap_page(priv->ddev, page_alloc->dma,
+			       page_alloc->page_size, PCI_DMA_FROMDEVICE);
+		put_page(page_alloc->page);
+	}
+	cache->head = 0;
+	cache->tail = 0;
+
 	for (i = 0; i < priv->num_frags; i++) {
 		const struct mlx4_en_frag_info *frag_info = &priv->frag_info[i];
 
@@ -233,7 +324,8 @@ static int mlx4_en_prepare_rx_desc(struct mlx4_en_priv *priv,
 	struct mlx4_en_rx_alloc *frags = ring->rx_info +
 					(index << priv->log_rx_info);
 
-	return mlx4_en_alloc_frags(priv, rx_desc, frags, ring->page_alloc, gfp);
+	return mlx4_en_alloc_frags(priv, ring, rx_desc, frags,
+				   ring->page_alloc, gfp);
 }
 
 static inline void mlx4_en_update_rx_prod_db(struct mlx4_en_rx_ring *ring)
@@ -251,7 +343,7 @@ static void mlx4_en_free_rx_desc(struct mlx4_en_priv *priv,
 	frags = ring->rx_info + (index << priv->log_rx_info);
 	for (nr = 0; nr < priv->num_frags; nr++) {
 		en_dbg(DRV, priv, "Freeing fragment:%d\n", nr);
-		mlx4_en_free_frag(priv, frags, nr);
+		mlx4_en_free_frag(priv, ring, frags, nr);
 	}
 }
 
@@ -513,6 +605,7 @@ void mlx4_en_deactivate_rx_ring(struct mlx4_en_priv *priv,
 
 
 static int mlx4_en_complete_rx_desc(struct mlx4_en_priv *priv,
+				    struct mlx4_en_rx_ring *ring,
 				    struct mlx4_en_rx_desc *rx_desc,
 				    struct mlx4_en_rx_alloc *frags,
 				    struct sk_buff *skb,
@@ -540,6 +633,7 @@ static int mlx4_en_complete_rx_desc(struct mlx4_en_priv *priv,
 		skb_frag_size_set(&skb_frags_rx[nr], frag_info->frag_size);
 		skb_frags_rx[nr].page_offset = frags[nr].page_offset;
 		skb->truesize += frag_info->frag_stride;
+		mlx4_en_release_page(priv, ring, frags, nr);
 		frags[nr].page = NULL;
 	}
 	/* Adjust size of last fragment to match actual length */
@@ -558,6 +652,7 @@ fail:
 
 
 static struct sk_buff *mlx4_en_rx_skb(struct mlx4_en_priv *priv,
+				      struct mlx4_en_rx_ring *ring,
 				      struct mlx4_en_rx_desc *rx_desc,
 				      struct mlx4_en_rx_alloc *frags,
 				      unsigned int length)
@@ -589,8 +684,8 @@ static struct sk_buff *mlx4_en_rx_skb(struct mlx4_en_priv *priv,
 		skb->tail += length;
 	} else {
 		/* Move relevant fragments to skb */
-		used_frags = mlx4_en_complete_rx_desc(priv, rx_desc, frags,
-							skb, length);
+		used_frags = mlx4_en_complete_rx_desc(priv, ring, rx_desc,
+						      frags, skb, length);
 		if (unlikely(!used_frags)) {
 			kfree_skb(skb);
 			return NULL;
@@ -640,6 +735,24 @@ static void mlx4_en_refill_rx_buffers(struct mlx4_en_priv *priv,
 	}
 }
 
+/* Run the early Rx filter on the first fragment, before any skb exists */
+static bool mlx4_en_rx_filter_drop(struct mlx4_en_priv *priv,
+				   struct mlx4_en_rx_desc *rx_desc,
+				   struct mlx4_en_rx_alloc *frags,
+				   unsigned int length, int ring)
+{
+	dma_addr_t dma = be64_to_cpu(rx_desc->data[0].addr);
+	unsigned int len = min_t(unsigned int, length,
+				 priv->frag_info[0].frag_size);
+	void *va;
+
+	dma_sync_single_for_cpu(priv->ddev, dma, len, DMA_FROM_DEVICE);
+	va = page_address(frags[0].page) + frags[0].page_offset;
+
+	return netdev_rx_filter_run(priv->dev, va, len, ring) ==
+		NET_RX_FILTER_DROP;
+}
+
 int mlx4_en_process_rx_cq(struct net_device *dev, struct mlx4_en_cq *cq, int budget)
 {
 	struct mlx4_en_priv *priv = netdev_priv(dev);
@@ -736,6 +849,12 @@ int mlx4_en_process_rx_cq(struct net_device *dev, struct mlx4_en_cq *cq, int bud
 		 */
 		length = be32_to_cpu(cqe->byte_cnt);
 		length -= ring->fcs_del;
+
+		if (unlikely(rcu_access_pointer(dev->rx_filter)) &&
+		    mlx4_en_rx_filter_drop(priv, rx_desc, frags, length,
+					   cq->ring))
+			goto next;
+
 		ring->bytes += length;
 		ring->packets++;
 		l2_tunnel = (dev->hw_enc_features & NETIF_F_RXCSUM) &&
@@ -759,7 +878,7 @@ int mlx4_en_process_rx_cq(struct net_device *dev, struct mlx4_en_cq *cq, int bud
 						goto next;
 
 					nr = mlx4_en_complete_rx_desc(priv,
-						rx_desc, frags, gro_skb,
+						ring, rx_desc, frags, gro_skb,
 						length);
 					if (!nr)
 						goto next;
@@ -808,7 +927,7 @@ int mlx4_en_process_rx_cq(struct net_device *dev, struct mlx4_en_cq *cq, int bud
 			ring->csum_none++;
 		}
 
-		skb = mlx4_en_rx_skb(priv, rx_desc, frags, length);
+		skb = mlx4_en_rx_skb(priv, ring, rx_desc, frags, length);
 		if (!skb) {
 			priv->stats.rx_dropped++;
 			goto next;
@@ -851,7 +970,7 @@ int mlx4_en_process_rx_cq(struct net_device *dev, struct mlx4_en_cq *cq, int bud
 
 next:
 		for (nr = 0; nr < priv->num_frags; nr++)
-			mlx4_en_free_frag(priv, frags, nr);
+			mlx4_en_free_frag(priv, ring, frags, nr);
 
 		++cq->mcq.cons_index;
 		index = (cq->mcq.cons_index) & ring->size_mask;
@@ -644,12 +644,25 @@ static void mlx4_bf_copy(void __iomem *dst, unsigned long *src, unsigned bytecnt
 	__iowrite64_copy(dst, src, bytecnt / 8);
 }
 
+static void mlx4_en_xmit_doorbell(struct mlx4_en_tx_ring *ring)
+{
+	wmb();
+	iowrite32be(ring->doorbell_qpn,
+		    ring->bf.uar->map + MLX4_SEND_DOORBELL);
+}
+
+static bool mlx4_en_is_tx_ring_full(struct mlx4_en_tx_ring *ring)
+{
+	return (int)(ring->prod - ring->cons) >
+	       ring->size - HEADROOM - MAX_DESC_TXBBS;
+}
+
 netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct mlx4_en_priv *priv = netdev_priv(dev);
 	struct mlx4_en_dev *mdev = priv->mdev;
 	struct device *ddev = priv->ddev;
-	struct mlx4_en_tx_ring *ring;
+	struct mlx4_en_tx_ring *ring = NULL;
 	struct mlx4_en_tx_desc *tx_desc;
 	struct mlx4_wqe_data_seg *data;
 	struct mlx4_en_tx_info *tx_info;
@@ -664,10 +677,15 @@ netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 	int lso_header_size;
 	void *fragptr;
 	bool bounce = false;
+	bool send_doorbell;
+	bool stop_queue = false;
 
 	if (!priv->port_up)
 		goto tx_drop;
 
+	tx_ind = skb->queue_mapping;
+	ring = priv->tx_ring[tx_ind];
+
 	real_size = get_real_size(skb, dev, &lso_header_size);
 	if (unlikely(!real_size))
 		goto tx_drop;
@@ -681,14 +699,14 @@ netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 		goto tx_drop;
 	}
 
-	tx_ind = skb->queue_mapping;
-	ring = priv->tx_ring[tx_ind];
 	if (vlan_tx_tag_present(skb))
 		vlan_tag = vlan_tx_tag_get(skb);
 
-	/* Check available TXBBs And 2K spare for prefetch */
-	if (unlikely(((int)(ring->prod - ring->cons)) >
-		     ring->size - HEADROOM - MAX_DESC_TXBBS)) {
+	/* Check available TXBBs And 2K spare for prefetch.  The queue is
+	 * normally stopped below once the ring fills up; this only catches
+	 * a stack that keeps sending regardless.
+	 */
+	if (unlikely(mlx4_en_is_tx_ring_full(ring))) {
 		/* every full Tx ring stops queue */
 		netif_tx_stop_queue(ring->tx_queue);
 		ring->queue_stopped++;
@@ -701,11 +719,12 @@ netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 		 */
 		wmb();
 
-		if (unlikely(((int)(ring->prod - ring->cons)) <=
-			     ring->size - HEADROOM - MAX_DESC_TXBBS)) {
+		if (unlikely(!mlx4_en_is_tx_ring_full(ring))) {
 			netif_tx_wake_queue(ring->tx_queue);
 			ring->wake_queue++;
 		} else {
+			/* Don't strand descriptors deferred by xmit_more */
+			mlx4_en_xmit_doorbell(ring);
 			return NETDEV_TX_BUSY;
 		}
 	}
@@ -875,7 +894,23 @@ netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 
 	skb_tx_timestamp(skb);
 
-	if (ring->bf_enabled && desc_size <= MAX_BF && !bounce && !vlan_tx_tag_present(skb)) {
+	/* Stop the queue as soon as the ring can't take another maximum
+	 * sized descriptor, so that the doorbell below isn't deferred with
+	 * nothing left to ring it.
+	 */
+	if (unlikely(mlx4_en_is_tx_ring_full(ring))) {
+		netif_tx_stop_queue(ring->tx_queue);
+		ring->queue_stopped++;
+		stop_queue = true;
+	}
+
+	/* Let the stack batch descriptors behind a single doorbell, unless
+	 * the queue got stopped (by us or by BQL) and nothing else will come.
+	 */
+	send_doorbell = !skb->xmit_more || netif_xmit_stopped(ring->tx_queue);
+
+	if (ring->bf_enabled && desc_size <= MAX_BF && !bounce &&
+	    !vlan_tx_tag_present(skb) && send_doorbell) {
 		tx_desc->ctrl.bf_qpn |= cpu_to_be32(ring->doorbell_qpn);
 
 		op_own |= htonl((bf_index & 0xffff) << 8);
@@ -897,8 +932,22 @@ netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 		* before setting ownership of this descriptor to HW */
 		wmb();
 		tx_desc->ctrl.owner_opcode = op_own;
-		wmb();
-		iowrite32be(ring->doorbell_qpn, ring->bf.uar->map + MLX4_SEND_DOORBELL);
+		if (send_doorbell)
+			mlx4_en_xmit_doorbell(ring);
+		else
+			ring->xmit_more++;
+	}
+
+	if (unlikely(stop_queue)) {
+		/* If the completion handler emptied the ring before it saw
+		 * the stopped queue, nobody else will wake it.  The barrier
+		 * orders the stop against the ring->cons read.
+		 */
+		smp_mb();
+		if (!mlx4_en_is_tx_ring_full(ring)) {
+			netif_tx_wake_queue(ring->tx_queue);
+			ring->wake_queue++;
+		}
 	}
 
 	return NETDEV_TX_OK;
@@ -914,6 +963,9 @@ tx_drop_unmap:
 	}
 
 tx_drop:
+	/* Earlier packets may still be waiting for a deferred doorbell */
+	if (ring)
+		mlx4_en_xmit_doorbell(ring);
 	dev_kfree_skb_any(skb);
 	priv->stats.tx_dropped++;
 	return NETDEV_TX_OK;
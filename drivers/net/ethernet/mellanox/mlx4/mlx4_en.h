@@ -110,6 +110,9 @@ enum {
 };
 #define MLX4_EN_MAX_RX_FRAGS	4
 
+/* Exhausted Rx pages kept mapped per ring until the stack releases them */
+#define MLX4_EN_CACHE_SIZE	(2 * NAPI_POLL_WEIGHT)	/* Must be power of 2 */
+
 /* Maximum ring sizes */
 #define MLX4_EN_MAX_TX_SIZE	8192
 #define MLX4_EN_MAX_RX_SIZE	8192
@@ -121,7 +124,7 @@ enum {
 #define MLX4_EN_SMALL_PKT_SIZE		64
 #define MLX4_EN_MAX_TX_RING_P_UP	32
 #define MLX4_EN_NUM_UP			8
-#define MLX4_EN_DEF_TX_RING_SIZE	512
+#define MLX4_EN_DEF_TX_RING_SIZE	1024
 #define MLX4_EN_DEF_RX_RING_SIZE  	1024
 #define MAX_TX_RINGS			(MLX4_EN_MAX_TX_RING_P_UP * \
 					 MLX4_EN_NUM_UP)
@@ -249,6 +252,12 @@ struct mlx4_en_rx_alloc {
 	u32		page_size;
 };
 
+struct mlx4_en_page_cache {
+	u32 head;
+	u32 tail;
+	struct mlx4_en_rx_alloc buf[MLX4_EN_CACHE_SIZE];
+};
+
 struct mlx4_en_tx_ring {
 	struct mlx4_hwq_resources wqres;
 	u32 size ; /* number of TXBBs */
@@ -276,6 +285,7 @@ struct mlx4_en_tx_ring {
 	unsigned long tx_csum;
 	unsigned long queue_stopped;
 	unsigned long wake_queue;
+	unsigned long xmit_more;
 	struct mlx4_bf bf;
 	bool bf_enabled;
 	struct netdev_queue *tx_queue;
@@ -291,6 +301,7 @@ struct mlx4_en_rx_desc {
 struct mlx4_en_rx_ring {
 	struct mlx4_hwq_resources wqres;
 	struct mlx4_en_rx_alloc page_alloc[MLX4_EN_MAX_RX_FRAGS];
+	struct mlx4_en_page_cache page_cache;
 	u32 size ;	/* number of Rx descs*/
 	u32 actual_size;
 	u32 size_mask;
@@ -312,6 +323,7 @@ struct mlx4_en_rx_ring {
 #endif
 	unsigned long csum_ok;
 	unsigned long csum_none;
+	unsigned long page_reuse;
 	int hwtstamp_rx_filter;
 };
 
@@ -427,7 +439,9 @@ struct mlx4_en_port_stats {
 	unsigned long rx_chksum_good;
 	unsigned long rx_chksum_none;
 	unsigned long tx_chksum_offload;
-#define NUM_PORT_STATS		8
+	unsigned long xmit_more;
+	unsigned long rx_page_reuse;
+#define NUM_PORT_STATS		10
 };
 
 struct mlx4_en_perf_stats {
@@ -659,6 +659,7 @@ static bool try_fill_recv(struct receive_queue *rq, gfp_t gfp)
 	bool oom;
 
 	gfp |= __GFP_COLD;
+	virtqueue_batch_begin(rq->vq);
 	do {
 		if (vi->mergeable_rx_bufs)
 			err = add_recvbuf_mergeable(rq, gfp);
@@ -671,6 +672,7 @@ static bool try_fill_recv(struct receive_queue *rq, gfp_t gfp)
 		if (err)
 			break;
 	} while (rq->vq->num_free);
+	virtqueue_batch_end(rq->vq);
 	virtqueue_kick(rq->vq);
 	return !oom;
 }
@@ -386,8 +386,13 @@ static void free_msi_irqs(struct pci_dev *dev)
 			nvec = 1 << entry->msi_attrib.multiple;
 		for (i = 0; i < nvec; i++)
 			BUG_ON(irq_has_action(entry->irq + i));
+		if (dev->msix_affinity)
+			irq_set_managed_affinity(entry->irq, NULL);
 	}
 
+	kfree(dev->msix_affinity);
+	dev->msix_affinity = NULL;
+
 	arch_teardown_msi_irqs(dev);
 
 	list_for_each_entry_safe(entry, tmp, &dev->msi_list, list) {
@@ -1191,3 +1196,54 @@ int pci_enable_msix_range(struct pci_dev *dev, struct msix_entry *entries,
 	return nvec;
 }
 EXPORT_SYMBOL(pci_enable_msix_range);
+
+/**
+ * pci_enable_msix_spread - enable MSI-X with vectors spread over all CPUs
+ * @dev: pointer to the pci_dev data structure of MSI-X device function
+ * @entries: pointer to an array of MSI-X entries
+ * @minvec: minimum number of MSI-X irqs requested
+ * @maxvec: maximum number of MSI-X irqs requested
+ *
+ * Same as pci_enable_msix_range(), but the affinity of the allocated
+ * interrupts is spread over the possible CPUs, node by node, and managed
+ * by the kernel: user space can't change it and it follows CPU hotplug.
+ * Multiqueue drivers use pci_irq_get_affinity() to map their queues to
+ * the same CPUs.
+ **/
+int pci_enable_msix_spread(struct pci_dev *dev, struct msix_entry *entries,
+			   int minvec, int maxvec)
+{
+	struct cpumask *masks;
+	int nvec, i;
+
+	nvec = pci_enable_msix_range(dev, entries, minvec, maxvec);
+	if (nvec < 0)
+		return nvec;
+
+	/* Unmanaged vectors still work, so this is not fatal */
+	masks = irq_create_affinity_masks(nvec);
+	if (!masks)
+		return nvec;
+
+	dev->msix_affinity = masks;
+	for (i = 0; i < nvec; i++)
+		irq_set_managed_affinity(entries[i].vector, &masks[i]);
+
+	return nvec;
+}
+EXPORT_SYMBOL(pci_enable_msix_spread);
+
+/**
+ * pci_irq_get_affinity - CPUs a vector enabled by pci_enable_msix_spread() is bound to
+ * @dev: PCI device
+ * @nr: index of the vector in the entries passed to pci_enable_msix_spread()
+ *
+ * Returns %NULL if the affinity of the vectors of @dev is not managed.
+ **/
+const struct cpumask *pci_irq_get_affinity(struct pci_dev *dev, int nr)
+{
+	if (!dev->msix_affinity)
+		return NULL;
+	return &dev->msix_affinity[nr];
+}
+EXPORT_SYMBOL(pci_irq_get_affinity);
@@ -252,17 +252,25 @@ static int vaddr_get_pfn(unsigned long vaddr, int prot, unsigned long *pfn)
 	return ret;
 }
 
+/* Pages pinned per get_user_pages_fast() call after the first one */
+#define VFIO_PIN_BATCH	(PAGE_SIZE / sizeof(struct page *))
+
 /*
  * Attempt to pin pages.  We really don't want to track all the pfns and
  * the iommu can only map chunks of consecutive pfns anyway, so get the
  * first page and all consecutive pages with the same locking.
+ *
+ * The consecutive pages are pinned in batches, which lets
+ * get_user_pages_fast() take a whole hugetlbfs or THP mapping in one
+ * step and gives the iommu runs long enough for its largest page sizes.
  */
 static long vfio_pin_pages(unsigned long vaddr, long npage,
 			   int prot, unsigned long *pfn_base)
 {
 	unsigned long limit = rlimit(RLIMIT_MEMLOCK) >> PAGE_SHIFT;
 	bool lock_cap = capable(CAP_IPC_LOCK);
-	long ret, i;
+	struct page *stack_page, **pages;
+	long ret, i, nr_batch;
 
 	if (!current->mm)
 		return -ENODEV;
@@ -286,27 +294,56 @@ static long vfio_pin_pages(unsigned long vaddr, long npage,
 		return 1;
 	}
 
+	pages = (struct page **)__get_free_page(GFP_KERNEL);
+	if (pages) {
+		nr_batch = VFIO_PIN_BATCH;
+	} else {
+		pages = &stack_page;
+		nr_batch = 1;
+	}
+
 	/* Lock all the consecutive pages from pfn_base */
-	for (i = 1, vaddr += PAGE_SIZE; i < npage; i++, vaddr += PAGE_SIZE) {
-		unsigned long pfn = 0;
+	for (i = 1, vaddr += PAGE_SIZE; i < npage; ) {
+		long batch = min(npage - i, nr_batch);
+		long got, j;
+
+		if (!lock_cap && current->mm->locked_vm + i + batch > limit) {
+			batch = limit - current->mm->locked_vm - i;
+			if (batch <= 0) {
+				pr_warn("%s: RLIMIT_MEMLOCK (%ld) exceeded\n",
+					__func__, limit << PAGE_SHIFT);
+				break;
+			}
+		}
 
-		ret = vaddr_get_pfn(vaddr, prot, &pfn);
-		if (ret)
+		got = get_user_pages_fast(vaddr, batch,
+					  !!(prot & IOMMU_WRITE), pages);
+		if (got <= 0)
 			break;
 
-		if (pfn != *pfn_base + i || is_invalid_reserved_pfn(pfn)) {
-			put_pfn(pfn, prot);
-			break;
+		for (j = 0; j < got; j++) {
+			unsigned long pfn = page_to_pfn(pages[j]);
+
+			if (pfn != *pfn_base + i + j ||
+			    is_invalid_reserved_pfn(pfn))
+				break;
 		}
 
-		if (!lock_cap && current->mm->locked_vm + i + 1 > limit) {
-			put_pfn(pfn, prot);
-			pr_warn("%s: RLIMIT_MEMLOCK (%ld) exceeded\n",
-				__func__, limit << PAGE_SHIFT);
+		/* Drop everything from the first discontiguous page on */
+		while (got > j)
+			put_page(pages[--got]);
+
+		i += j;
+		vaddr += j << PAGE_SHIFT;
+		if (j < batch)
 			break;
-		}
+
+		cond_resched();
 	}
 
+	if (pages != &stack_page)
+		free_page((unsigned long)pages);
+
 	vfio_lock_acct(i);
 
 	return i;
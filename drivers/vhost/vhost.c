@@ -24,6 +24,7 @@
 #include <linux/highmem.h>
 #include <linux/slab.h>
 #include <linux/kthread.h>
+#include <linux/workqueue.h>
 #include <linux/cgroup.h>
 #include <linux/module.h>
 
@@ -34,6 +35,18 @@ enum {
 	VHOST_MEMORY_F_LOG = 0x1,
 };
 
+/* Max number of work items a device runs per pass on a shared worker,
+ * before it yields to the other devices queued on the same pool. */
+#define VHOST_SHARED_WORK_BUDGET 16
+
+static bool shared_workers;
+module_param(shared_workers, bool, 0444);
+MODULE_PARM_DESC(shared_workers,
+		 "Run devices on a shared per-NUMA-node worker pool "
+		 "instead of a kthread per device (no cgroup attach)");
+
+static struct workqueue_struct *vhost_shared_wq;
+
 #define vhost_used_event(vq) ((u16 __user *)&vq->avail->ring[vq->num])
 #define vhost_avail_event(vq) ((u16 __user *)&vq->used->ring[vq->num])
 
@@ -162,7 +175,10 @@ void vhost_work_queue(struct vhost_dev *dev, struct vhost_work *work)
 		list_add_tail(&work->node, &dev->work_list);
 		work->queue_seq++;
 		spin_unlock_irqrestore(&dev->work_lock, flags);
-		wake_up_process(dev->worker);
+		if (dev->worker)
+			wake_up_process(dev->worker);
+		else
+			queue_work(vhost_shared_wq, &dev->shared_work);
 	} else {
 		spin_unlock_irqrestore(&dev->work_lock, flags);
 	}
@@ -249,6 +265,53 @@ static int vhost_worker(void *data)
 	return 0;
 }
 
+/* Shared worker: runs the device's work list from a worker of the unbound
+ * vhost workqueue, which keeps a pool of threads per NUMA node. The
+ * workqueue never runs the same work_struct concurrently, so work items of
+ * one device stay serialized as with the per device thread. */
+static void vhost_shared_worker(struct work_struct *shared_work)
+{
+	struct vhost_dev *dev = container_of(shared_work, struct vhost_dev,
+					     shared_work);
+	struct vhost_work *work = NULL;
+	unsigned uninitialized_var(seq);
+	int budget = VHOST_SHARED_WORK_BUDGET;
+	mm_segment_t oldfs = get_fs();
+
+	set_fs(USER_DS);
+	use_mm(dev->mm);
+
+	for (;;) {
+		spin_lock_irq(&dev->work_lock);
+		if (work) {
+			work->done_seq = seq;
+			if (work->flushing)
+				wake_up_all(&work->done);
+		}
+
+		if (list_empty(&dev->work_list)) {
+			spin_unlock_irq(&dev->work_lock);
+			break;
+		}
+		/* Be fair to other devices: requeue ourselves at the tail. */
+		if (!budget--) {
+			queue_work(vhost_shared_wq, &dev->shared_work);
+			spin_unlock_irq(&dev->work_lock);
+			break;
+		}
+		work = list_first_entry(&dev->work_list,
+					struct vhost_work, node);
+		list_del_init(&work->node);
+		seq = work->queue_seq;
+		spin_unlock_irq(&dev->work_lock);
+
+		work->fn(work);
+		cond_resched();
+	}
+	unuse_mm(dev->mm);
+	set_fs(oldfs);
+}
+
 static void vhost_vq_free_iovecs(struct vhost_virtqueue *vq)
 {
 	kfree(vq->indirect);
@@ -306,6 +369,7 @@ void vhost_dev_init(struct vhost_dev *dev,
 	spin_lock_init(&dev->work_lock);
 	INIT_LIST_HEAD(&dev->work_list);
 	dev->worker = NULL;
+	INIT_WORK(&dev->shared_work, vhost_shared_worker);
 
 	for (i = 0; i < dev->nvqs; ++i) {
 		vq = dev->vqs[i];
@@ -376,6 +440,9 @@ long vhost_dev_set_owner(struct vhost_dev *dev)
 
 	/* No owner, become one */
 	dev->mm = get_task_mm(current);
+	if (vhost_shared_wq)
+		goto alloc_iovecs;
+
 	worker = kthread_create(vhost_worker, dev, "vhost-%d", current->pid);
 	if (IS_ERR(worker)) {
 		err = PTR_ERR(worker);
@@ -389,14 +456,17 @@ long vhost_dev_set_owner(struct vhost_dev *dev)
 	if (err)
 		goto err_cgroup;
 
+alloc_iovecs:
 	err = vhost_dev_alloc_iovecs(dev);
 	if (err)
 		goto err_cgroup;
 
 	return 0;
 err_cgroup:
-	kthread_stop(worker);
-	dev->worker = NULL;
+	if (dev->worker) {
+		kthread_stop(dev->worker);
+		dev->worker = NULL;
+	}
 err_worker:
 	if (dev->mm)
 		mmput(dev->mm);
@@ -471,6 +541,8 @@ void vhost_dev_cleanup(struct vhost_dev *dev, bool locked)
 		kthread_stop(dev->worker);
 		dev->worker = NULL;
 	}
+	/* The shared worker may still hold the mm once the last work is done */
+	flush_work(&dev->shared_work);
 	if (dev->mm)
 		mmput(dev->mm);
 	dev->mm = NULL;
@@ -1539,11 +1611,19 @@ EXPORT_SYMBOL_GPL(vhost_disable_notify);
 
 static int __init vhost_init(void)
 {
+	if (!shared_workers)
+		return 0;
+
+	vhost_shared_wq = alloc_workqueue("vhost", WQ_UNBOUND | WQ_SYSFS, 0);
+	if (!vhost_shared_wq)
+		return -ENOMEM;
 	return 0;
 }
 
 static void __exit vhost_exit(void)
 {
+	if (vhost_shared_wq)
+		destroy_workqueue(vhost_shared_wq);
 }
 
 module_init(vhost_init);
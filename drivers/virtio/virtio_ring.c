@@ -78,6 +78,11 @@ struct vring_virtqueue
 	/* Number we've added since last sync. */
 	unsigned int num_added;
 
+	/* Next avail index to fill; ahead of avail->idx while batching. */
+	u16 avail_idx_shadow;
+	/* Inside virtqueue_batch_begin/end: don't publish avail->idx. */
+	bool batching;
+
 	/* Last used index we've seen. */
 	u16 last_used_idx;
 
@@ -283,14 +288,17 @@ add_head:
 
 	/* Put entry in available array (but don't update avail->idx until they
 	 * do sync). */
-	avail = (vq->vring.avail->idx & (vq->vring.num-1));
+	avail = (vq->avail_idx_shadow & (vq->vring.num-1));
 	vq->vring.avail->ring[avail] = head;
+	vq->avail_idx_shadow++;
+	vq->num_added++;
 
 	/* Descriptors and available array need to be set before we expose the
 	 * new available array entries. */
-	virtio_wmb(vq->weak_barriers);
-	vq->vring.avail->idx++;
-	vq->num_added++;
+	if (!vq->batching) {
+		virtio_wmb(vq->weak_barriers);
+		vq->vring.avail->idx = vq->avail_idx_shadow;
+	}
 
 	/* This is very unlikely, but theoretically possible.  Kick
 	 * just in case. */
@@ -386,6 +394,56 @@ int virtqueue_add_inbuf(struct virtqueue *vq,
 }
 EXPORT_SYMBOL_GPL(virtqueue_add_inbuf);
 
+/* Expose the entries queued since the last update of avail->idx. */
+static inline void virtqueue_publish_avail(struct vring_virtqueue *vq)
+{
+	if (vq->vring.avail->idx != vq->avail_idx_shadow) {
+		virtio_wmb(vq->weak_barriers);
+		vq->vring.avail->idx = vq->avail_idx_shadow;
+	}
+}
+
+/**
+ * virtqueue_batch_begin - start adding a batch of buffers
+ * @vq: the struct virtqueue
+ *
+ * Until virtqueue_batch_end() is called, the virtqueue_add_* calls fill in
+ * descriptors and available array entries without the write barrier and
+ * avail->idx update each of them does otherwise, so the whole batch becomes
+ * visible to the other side at once. A kick in the middle of a batch
+ * publishes what was added so far.
+ *
+ * Caller must ensure we don't call this with other virtqueue operations
+ * at the same time (except where noted).
+ */
+void virtqueue_batch_begin(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+
+	vq->batching = true;
+}
+EXPORT_SYMBOL_GPL(virtqueue_batch_begin);
+
+/**
+ * virtqueue_batch_end - publish a batch of buffers
+ * @vq: the struct virtqueue
+ *
+ * Makes the buffers added since virtqueue_batch_begin() available to the
+ * other side with a single avail->idx update. This does not notify the
+ * other side; use virtqueue_kick() for that as usual.
+ *
+ * Caller must ensure we don't call this with other virtqueue operations
+ * at the same time (except where noted).
+ */
+void virtqueue_batch_end(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+
+	vq->batching = false;
+	virtqueue_publish_avail(vq);
+}
+EXPORT_SYMBOL_GPL(virtqueue_batch_end);
+
 /**
  * virtqueue_kick_prepare - first half of split virtqueue_kick call.
  * @vq: the struct virtqueue
@@ -404,12 +462,15 @@ bool virtqueue_kick_prepare(struct virtqueue *_vq)
 	bool needs_kick;
 
 	START_USE(vq);
+	/* Entries added by an unfinished batch go out with this kick. */
+	virtqueue_publish_avail(vq);
+
 	/* We need to expose available array entries before checking avail
 	 * event. */
 	virtio_mb(vq->weak_barriers);
 
-	old = vq->vring.avail->idx - vq->num_added;
-	new = vq->vring.avail->idx;
+	old = vq->avail_idx_shadow - vq->num_added;
+	new = vq->avail_idx_shadow;
 	vq->num_added = 0;
 
 #ifdef DEBUG
@@ -724,7 +785,8 @@ void *virtqueue_detach_unused_buf(struct virtqueue *_vq)
 		/* detach_buf clears data, so grab it now. */
 		buf = vq->data[i];
 		detach_buf(vq, i);
-		vq->vring.avail->idx--;
+		vq->avail_idx_shadow--;
+		vq->vring.avail->idx = vq->avail_idx_shadow;
 		END_USE(vq);
 		return buf;
 	}
@@ -790,6 +852,8 @@ struct virtqueue *vring_new_virtqueue(unsigned int index,
 	vq->broken = false;
 	vq->last_used_idx = 0;
 	vq->num_added = 0;
+	vq->avail_idx_shadow = vq->vring.avail->idx;
+	vq->batching = false;
 	list_add_tail(&vq->vq.list, &vdev->vqs);
 #ifdef DEBUG
 	vq->in_use = false;
@@ -1284,6 +1284,45 @@ static ssize_t aio_setup_single_vector(struct kiocb *kiocb,
 	return 0;
 }
 
+struct aio_fsync_work {
+	struct work_struct	work;
+	struct kiocb		*iocb;
+	int			datasync;
+};
+
+static void aio_fsync_work(struct work_struct *work)
+{
+	struct aio_fsync_work *fw = container_of(work, struct aio_fsync_work,
+						 work);
+
+	aio_complete(fw->iocb, vfs_fsync(fw->iocb->ki_filp, fw->datasync), 0);
+	kfree(fw);
+}
+
+/*
+ * Few filesystems implement ->aio_fsync, so for everybody else run the
+ * ordinary ->fsync from a worker and complete the iocb from there,
+ * instead of failing the request or blocking io_submit() on it.
+ */
+static ssize_t aio_fsync(struct kiocb *req, int datasync)
+{
+	struct file *file = req->ki_filp;
+	struct aio_fsync_work *fw;
+
+	if (file->f_op->aio_fsync)
+		return file->f_op->aio_fsync(req, datasync);
+
+	fw = kmalloc(sizeof(*fw), GFP_KERNEL);
+	if (!fw)
+		return -ENOMEM;
+
+	INIT_WORK(&fw->work, aio_fsync_work);
+	fw->iocb = req;
+	fw->datasync = datasync;
+	queue_work(system_long_wq, &fw->work);
+	return -EIOCBQUEUED;
+}
+
 /*
  * aio_setup_iocb:
  *	Performs the initial checks and aio retry method
@@ -1354,17 +1393,17 @@ rw_common:
 		break;
 
 	case IOCB_CMD_FDSYNC:
-		if (!file->f_op->aio_fsync)
+		if (!file->f_op->aio_fsync && !file->f_op->fsync)
 			return -EINVAL;
 
-		ret = file->f_op->aio_fsync(req, 1);
+		ret = aio_fsync(req, 1);
 		break;
 
 	case IOCB_CMD_FSYNC:
-		if (!file->f_op->aio_fsync)
+		if (!file->f_op->aio_fsync && !file->f_op->fsync)
 			return -EINVAL;
 
-		ret = file->f_op->aio_fsync(req, 0);
+		ret = aio_fsync(req, 0);
 		break;
 
 	default:
@@ -749,6 +749,14 @@ static int __bio_add_page(struct request_queue *q, struct bio *bio, struct page
 	if (bio->bi_vcnt >= bio->bi_max_vecs)
 		return 0;
 
+	/*
+	 * If the queue doesn't support SG gaps and adding this
+	 * offset would create a gap, disallow it.
+	 */
+	if (q->queue_flags & (1 << QUEUE_FLAG_SG_GAPS) && bio->bi_vcnt &&
+	    bvec_gap_to_prev(&bio->bi_io_vec[bio->bi_vcnt - 1], offset))
+		return 0;
+
 	/*
 	 * we might lose a segment or two here, but rather that than
 	 * make this too complex.
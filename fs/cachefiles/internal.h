@@ -89,10 +89,11 @@ struct cachefiles_cache {
  */
 struct cachefiles_one_read {
 	wait_queue_t			monitor;	/* link into monitored waitqueue */
-	struct page			*back_page;	/* backing file page we're waiting for */
+	struct page			*back_page;	/* backing file page we're waiting for (NULL if direct) */
 	struct page			*netfs_page;	/* netfs page we're going to fill */
 	struct fscache_retrieval	*op;		/* retrieval op covering this */
 	struct list_head		op_link;	/* link in op's todo list */
+	int				error;		/* result of direct read */
 };
 
 /*
@@ -13,6 +13,8 @@
 #include <linux/slab.h>
 #include <linux/file.h>
 #include <linux/swap.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
 #include "internal.h"
 
 /*
@@ -142,8 +144,138 @@ unlock_discard:
 	return ret;
 }
 
+/*
+ * note the completion of a direct read into a netfs page
+ * - called from bio completion, so we just queue the page for the FS-Cache
+ *   thread pool as cachefiles_read_waiter() does
+ */
+static void cachefiles_read_direct_end_io(struct bio *bio, int error)
+{
+	struct cachefiles_one_read *monitor = bio->bi_private;
+	struct cachefiles_object *object;
+	unsigned long flags;
+
+	if (!error && !test_bit(BIO_UPTODATE, &bio->bi_flags))
+		error = -EIO;
+	monitor->error = error;
+	bio_put(bio);
+
+	object = container_of(monitor->op->op.object,
+			      struct cachefiles_object, fscache);
+
+	spin_lock_irqsave(&object->work_lock, flags);
+	list_add_tail(&monitor->op_link, &monitor->op->to_do);
+	spin_unlock_irqrestore(&object->work_lock, flags);
+
+	fscache_enqueue_retrieval(monitor->op);
+}
+
+/*
+ * see if a netfs page can be read straight from the backing device into the
+ * netfs page, rather than through the backing file's pagecache and a copy
+ * - the backing page mustn't be in the pagecache as it may be newer than
+ *   what's on disk
+ * - all the blocks of the page must be mapped contiguously and lie within
+ *   EOF, so we don't have to deal with holes or a partial tail
+ * - returns the first block of the page in *_block if so
+ */
+static bool cachefiles_read_direct_ok(struct cachefiles_object *object,
+				      struct page *netpage, unsigned shift,
+				      sector_t *_block)
+{
+	struct inode *inode = object->backer->d_inode;
+	struct address_space *bmapping = inode->i_mapping;
+	struct page *backpage;
+	sector_t block0, block;
+	unsigned i;
+
+	if (((loff_t)(netpage->index + 1) << PAGE_SHIFT) > i_size_read(inode))
+		return false;
+
+	backpage = find_get_page(bmapping, netpage->index);
+	if (backpage) {
+		page_cache_release(backpage);
+		return false;
+	}
+
+	block0 = (sector_t)netpage->index << shift;
+	block = bmapping->a_ops->bmap(bmapping, block0);
+	if (!block)
+		return false;
+
+	for (i = 1; i < (1U << shift); i++)
+		if (bmapping->a_ops->bmap(bmapping, block0 + i) != block + i)
+			return false;
+
+	*_block = block;
+	return true;
+}
+
+/*
+ * issue a direct read of a netfs page from the backing device
+ * - if mapping is given, the netfs page is added to it once we know the read
+ *   can be issued
+ * - the page is handed to cachefiles_read_copier() on completion
+ * - returns 0 if the read was submitted, -EEXIST if the netfs page is already
+ *   in the mapping or -ENOMEM
+ */
+static int cachefiles_read_direct(struct cachefiles_object *object,
+				  struct fscache_retrieval *op,
+				  struct page *netpage,
+				  struct address_space *mapping,
+				  sector_t block)
+{
+	struct cachefiles_one_read *monitor;
+	struct inode *inode = object->backer->d_inode;
+	struct bio *bio;
+	int ret;
+
+	_enter("{%lu},%llx", netpage->index, (unsigned long long) block);
+
+	monitor = kzalloc(sizeof(*monitor), cachefiles_gfp);
+	if (!monitor)
+		goto nomem;
+
+	bio = bio_alloc(cachefiles_gfp, 1);
+	if (!bio)
+		goto nomem_monitor;
+
+	if (mapping) {
+		ret = add_to_page_cache_lru(netpage, mapping, netpage->index,
+					    cachefiles_gfp);
+		if (ret < 0) {
+			bio_put(bio);
+			kfree(monitor);
+			_leave(" = %d", ret);
+			return ret;
+		}
+	}
+
+	page_cache_get(netpage);
+	monitor->netfs_page = netpage;
+	monitor->op = fscache_get_retrieval(op);
+	INIT_LIST_HEAD(&monitor->op_link);
+
+	bio->bi_bdev = inode->i_sb->s_bdev;
+	bio->bi_iter.bi_sector = block << (inode->i_blkbits - 9);
+	bio->bi_end_io = cachefiles_read_direct_end_io;
+	bio->bi_private = monitor;
+	bio_add_page(bio, netpage, PAGE_SIZE, 0);
+	submit_bio(READ, bio);
+
+	_leave(" = 0");
+	return 0;
+
+nomem_monitor:
+	kfree(monitor);
+nomem:
+	_leave(" = -ENOMEM");
+	return -ENOMEM;
+}
+
 /*
  * copy data from backing pages to netfs pages to complete a read operation
+ * - pages read directly from the backing device just need completing
  * - driven by FS-Cache's thread pool
  */
 static void cachefiles_read_copier(struct fscache_operation *_op)
@@ -172,6 +304,26 @@ static void cachefiles_read_copier(struct fscache_operation *_op)
 
 		spin_unlock_irq(&object->work_lock);
 
+		if (!monitor->back_page) {
+			_debug("- direct {%lu}", monitor->netfs_page->index);
+
+			if (test_bit(FSCACHE_COOKIE_INVALIDATING,
+				     &object->fscache.cookie->flags)) {
+				error = -ESTALE;
+			} else if (monitor->error) {
+				cachefiles_io_error_obj(
+					object,
+					"Direct read failed on backing file: %d",
+					monitor->error);
+				error = -EIO;
+			} else {
+				fscache_mark_page_cached(monitor->op,
+							 monitor->netfs_page);
+				error = 0;
+			}
+			goto complete;
+		}
+
 		_debug("- copy {%lu}", monitor->back_page->index);
 
 	recheck:
@@ -199,6 +351,7 @@ static void cachefiles_read_copier(struct fscache_operation *_op)
 
 		page_cache_release(monitor->back_page);
 
+	complete:
 		fscache_end_io(op, monitor->netfs_page, error);
 		page_cache_release(monitor->netfs_page);
 		fscache_retrieval_complete(op, 1);
@@ -443,7 +596,12 @@ int cachefiles_read_or_alloc_page(struct fscache_retrieval *op,
 	       (unsigned long long) block0,
 	       (unsigned long long) block);
 
-	if (block) {
+	if (block && cachefiles_read_direct_ok(object, page, shift, &block)) {
+		/* read the page straight from the backing device */
+		ret = cachefiles_read_direct(object, op, page, NULL, block);
+		if (ret < 0)
+			fscache_retrieval_complete(op, 1);
+	} else if (block) {
 		/* submit the apparently valid page to the backing fs to be
 		 * read from disk */
 		ret = cachefiles_read_backing_file_one(object, op, page);
@@ -471,11 +629,13 @@ enobufs:
  */
 static int cachefiles_read_backing_file(struct cachefiles_object *object,
 					struct fscache_retrieval *op,
-					struct list_head *list)
+					struct list_head *list,
+					unsigned shift)
 {
 	struct cachefiles_one_read *monitor = NULL;
 	struct address_space *bmapping = object->backer->d_inode->i_mapping;
 	struct page *newpage = NULL, *netpage, *_n, *backpage = NULL;
+	sector_t block;
 	int ret = 0;
 
 	_enter("");
@@ -486,6 +646,21 @@ static int cachefiles_read_backing_file(struct cachefiles_object *object,
 		_debug("read back %p{%lu,%d}",
 		       netpage, netpage->index, page_count(netpage));
 
+		if (cachefiles_read_direct_ok(object, netpage, shift, &block)) {
+			ret = cachefiles_read_direct(object, op, netpage,
+						     op->mapping, block);
+			if (ret == -EEXIST) {
+				page_cache_release(netpage);
+				fscache_retrieval_complete(op, 1);
+				continue;
+			}
+			if (ret < 0)
+				goto nomem;
+			page_cache_release(netpage);
+			netpage = NULL;
+			continue;
+		}
+
 		if (!monitor) {
 			monitor = kzalloc(sizeof(*monitor), cachefiles_gfp);
 			if (!monitor)
@@ -774,7 +949,8 @@ int cachefiles_read_or_alloc_pages(struct fscache_retrieval *op,
 	/* submit the apparently valid pages to the backing fs to be read from
 	 * disk */
 	if (nrbackpages > 0) {
-		ret2 = cachefiles_read_backing_file(object, op, &backpages);
+		ret2 = cachefiles_read_backing_file(object, op, &backpages,
+						    shift);
 		if (ret2 == -ENOMEM || ret2 == -EINTR)
 			ret = ret2;
 	}
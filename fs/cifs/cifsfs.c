@@ -904,6 +904,7 @@ const struct file_operations cifs_file_ops = {
 	.unlocked_ioctl	= cifs_ioctl,
 #endif /* CONFIG_CIFS_POSIX */
 	.setlease = cifs_setlease,
+	.copy_file_range = cifs_copy_file_range,
 };
 
 const struct file_operations cifs_file_strict_ops = {
@@ -923,6 +924,7 @@ const struct file_operations cifs_file_strict_ops = {
 	.unlocked_ioctl	= cifs_ioctl,
 #endif /* CONFIG_CIFS_POSIX */
 	.setlease = cifs_setlease,
+	.copy_file_range = cifs_copy_file_range,
 };
 
 const struct file_operations cifs_file_direct_ops = {
@@ -943,6 +945,7 @@ const struct file_operations cifs_file_direct_ops = {
 #endif /* CONFIG_CIFS_POSIX */
 	.llseek = cifs_llseek,
 	.setlease = cifs_setlease,
+	.copy_file_range = cifs_copy_file_range,
 };
 
 const struct file_operations cifs_file_nobrl_ops = {
@@ -961,6 +964,7 @@ const struct file_operations cifs_file_nobrl_ops = {
 	.unlocked_ioctl	= cifs_ioctl,
 #endif /* CONFIG_CIFS_POSIX */
 	.setlease = cifs_setlease,
+	.copy_file_range = cifs_copy_file_range,
 };
 
 const struct file_operations cifs_file_strict_nobrl_ops = {
@@ -979,6 +983,7 @@ const struct file_operations cifs_file_strict_nobrl_ops = {
 	.unlocked_ioctl	= cifs_ioctl,
 #endif /* CONFIG_CIFS_POSIX */
 	.setlease = cifs_setlease,
+	.copy_file_range = cifs_copy_file_range,
 };
 
 const struct file_operations cifs_file_direct_nobrl_ops = {
@@ -998,6 +1003,7 @@ const struct file_operations cifs_file_direct_nobrl_ops = {
 #endif /* CONFIG_CIFS_POSIX */
 	.llseek = cifs_llseek,
 	.setlease = cifs_setlease,
+	.copy_file_range = cifs_copy_file_range,
 };
 
 const struct file_operations cifs_dir_ops = {
@@ -213,6 +213,13 @@ struct smb_version_operations {
 	int * (*get_credits_field)(struct TCP_Server_Info *, const int);
 	unsigned int (*get_credits)(struct mid_q_entry *);
 	__u64 (*get_next_mid)(struct TCP_Server_Info *);
+	/*
+	 * reserve enough credits for a read or write of up to size bytes;
+	 * returns the number of bytes that may be sent in *num and the
+	 * credits taken in *credits (0 if the request uses none of its own)
+	 */
+	int (*wait_mtu_credits)(struct TCP_Server_Info *, unsigned int size,
+				unsigned int *num, unsigned int *credits);
 	/* data offset from read response message */
 	unsigned int (*read_data_offset)(char *);
 	/* data length from read response message */
@@ -638,6 +645,23 @@ add_credits(struct TCP_Server_Info *server, const unsigned int add,
 	server->ops->add_credits(server, add, optype);
 }
 
+static inline void
+add_credits_and_wake_if(struct TCP_Server_Info *server,
+			const unsigned int add, const int optype)
+{
+	if (add) {
+		server->ops->add_credits(server, add, optype);
+		wake_up(&server->request_q);
+	}
+}
+
+static inline int
+wait_mtu_credits(struct TCP_Server_Info *server, unsigned int size,
+		 unsigned int *num, unsigned int *credits)
+{
+	return server->ops->wait_mtu_credits(server, size, num, credits);
+}
+
 static inline void
 set_credits(struct TCP_Server_Info *server, const int val)
 {
@@ -1043,6 +1067,7 @@ struct cifs_readdata {
 	struct address_space		*mapping;
 	__u64				offset;
 	unsigned int			bytes;
+	unsigned int			credits;
 	pid_t				pid;
 	int				result;
 	struct work_struct		work;
@@ -1069,6 +1094,7 @@ struct cifs_writedata {
 	__u64				offset;
 	pid_t				pid;
 	unsigned int			bytes;
+	unsigned int			credits;
 	int				result;
 	unsigned int			pagesz;
 	unsigned int			tailsz;
@@ -1397,6 +1423,8 @@ static inline void free_dfs_info_array(struct dfs_info3_param *param,
 #define   CIFS_NEG_OP      0x0200    /* negotiate request */
 #define   CIFS_OP_MASK     0x0380    /* mask request type */
 
+#define   CIFS_HAS_CREDITS 0x0400    /* already has credits */
+
 /* Security Flags: indicate type of session setup needed */
 #define   CIFSSEC_MAY_SIGN	0x00001
 #define   CIFSSEC_MAY_NTLM	0x00002
@@ -1908,17 +1908,23 @@ static int cifs_writepages(struct address_space *mapping,
 	}
 retry:
 	while (!done && index <= end) {
-		unsigned int i, nr_pages, found_pages;
+		unsigned int i, nr_pages, found_pages, wsize, credits;
 		pgoff_t next = 0, tofind;
 		struct page **pages;
 
-		tofind = min((cifs_sb->wsize / PAGE_CACHE_SIZE) - 1,
-				end - index) + 1;
+		server = cifs_sb_master_tcon(cifs_sb)->ses->server;
+		rc = wait_mtu_credits(server, cifs_sb->wsize, &wsize,
+				      &credits);
+		if (rc)
+			break;
+
+		tofind = min((wsize / PAGE_CACHE_SIZE) - 1, end - index) + 1;
 
 		wdata = cifs_writedata_alloc((unsigned int)tofind,
 					     cifs_writev_complete);
 		if (!wdata) {
 			rc = -ENOMEM;
+			add_credits_and_wake_if(server, credits, 0);
 			break;
 		}
 
@@ -1941,6 +1947,7 @@ retry:
 
 		if (found_pages == 0) {
 			kref_put(&wdata->refcount, cifs_writedata_release);
+			add_credits_and_wake_if(server, credits, 0);
 			break;
 		}
 
@@ -2017,9 +2024,11 @@ retry:
 		/* nothing to write? */
 		if (nr_pages == 0) {
 			kref_put(&wdata->refcount, cifs_writedata_release);
+			add_credits_and_wake_if(server, credits, 0);
 			continue;
 		}
 
+		wdata->credits = credits;
 		wdata->sync_mode = wbc->sync_mode;
 		wdata->nr_pages = nr_pages;
 		wdata->offset = page_offset(wdata->pages[0]);
@@ -2039,10 +2048,12 @@ retry:
 			if (!wdata->cfile) {
 				cifs_dbg(VFS, "No writable handles for inode\n");
 				rc = -EBADF;
+				add_credits_and_wake_if(server, wdata->credits,
+							0);
+				wdata->credits = 0;
 				break;
 			}
 			wdata->pid = wdata->cfile->pid;
-			server = tlink_tcon(wdata->cfile->tlink)->ses->server;
 			rc = server->ops->async_writev(wdata,
 							cifs_writedata_release);
 		} while (wbc->sync_mode == WB_SYNC_ALL && rc == -EAGAIN);
@@ -2381,6 +2392,11 @@ cifs_uncached_retry_writev(struct cifs_writedata *wdata)
 					       cifs_uncached_writedata_release);
 	} while (rc == -EAGAIN);
 
+	if (rc) {
+		/* the reopen failed before the reserved credits were used */
+		add_credits_and_wake_if(server, wdata->credits, 0);
+		wdata->credits = 0;
+	}
 	return rc;
 }
 
@@ -2398,6 +2414,7 @@ cifs_iovec_write(struct file *file, const struct iovec *iov,
 	struct cifs_sb_info *cifs_sb;
 	struct cifs_writedata *wdata, *tmp;
 	struct list_head wdata_list;
+	struct TCP_Server_Info *server;
 	int rc;
 	pid_t pid;
 
@@ -2424,21 +2441,30 @@ cifs_iovec_write(struct file *file, const struct iovec *iov,
 	else
 		pid = current->tgid;
 
+	server = tcon->ses->server;
 	iov_iter_init(&it, iov, nr_segs, len, 0);
 	do {
 		size_t save_len;
+		unsigned int wsize, credits;
+
+		rc = wait_mtu_credits(server, cifs_sb->wsize, &wsize,
+				      &credits);
+		if (rc)
+			break;
 
-		nr_pages = get_numpages(cifs_sb->wsize, len, &cur_len);
+		nr_pages = get_numpages(wsize, len, &cur_len);
 		wdata = cifs_writedata_alloc(nr_pages,
 					     cifs_uncached_writev_complete);
 		if (!wdata) {
 			rc = -ENOMEM;
+			add_credits_and_wake_if(server, credits, 0);
 			break;
 		}
 
 		rc = cifs_write_allocate_pages(wdata->pages, nr_pages);
 		if (rc) {
 			kfree(wdata);
+			add_credits_and_wake_if(server, credits, 0);
 			break;
 		}
 
@@ -2471,6 +2497,7 @@ cifs_iovec_write(struct file *file, const struct iovec *iov,
 			for (i = 0; i < nr_pages; i++)
 				put_page(wdata->pages[i]);
 			kfree(wdata);
+			add_credits_and_wake_if(server, credits, 0);
 			rc = -EFAULT;
 			break;
 		}
@@ -2491,6 +2518,7 @@ cifs_iovec_write(struct file *file, const struct iovec *iov,
 		wdata->bytes = cur_len;
 		wdata->pagesz = PAGE_SIZE;
 		wdata->tailsz = cur_len - ((nr_pages - 1) * PAGE_SIZE);
+		wdata->credits = credits;
 		rc = cifs_uncached_retry_writev(wdata);
 		if (rc) {
 			kref_put(&wdata->refcount,
@@ -2744,6 +2772,11 @@ cifs_retry_async_readv(struct cifs_readdata *rdata)
 		rc = server->ops->async_readv(rdata);
 	} while (rc == -EAGAIN);
 
+	if (rc) {
+		/* the reopen failed before the reserved credits were used */
+		add_credits_and_wake_if(server, rdata->credits, 0);
+		rdata->credits = 0;
+	}
 	return rc;
 }
 
@@ -2845,6 +2878,7 @@ ssize_t cifs_user_readv(struct kiocb *iocb, const struct iovec *iov,
 	struct cifsFileInfo *open_file;
 	struct cifs_readdata *rdata, *tmp;
 	struct list_head rdata_list;
+	struct TCP_Server_Info *server;
 	struct iov_iter to;
 	pid_t pid;
 
@@ -2873,17 +2907,27 @@ ssize_t cifs_user_readv(struct kiocb *iocb, const struct iovec *iov,
 	if ((file->f_flags & O_ACCMODE) == O_WRONLY)
 		cifs_dbg(FYI, "attempting read on write only file instance\n");
 
+	server = tcon->ses->server;
 	do {
-		cur_len = min_t(const size_t, len - total_read, cifs_sb->rsize);
+		unsigned int rsize, credits;
+
+		rc = wait_mtu_credits(server, cifs_sb->rsize, &rsize,
+				      &credits);
+		if (rc)
+			break;
+
+		cur_len = min_t(const size_t, len - total_read, rsize);
 		npages = DIV_ROUND_UP(cur_len, PAGE_SIZE);
 
 		/* allocate a readdata struct */
 		rdata = cifs_readdata_alloc(npages,
 					    cifs_uncached_readv_complete);
 		if (!rdata) {
+			add_credits_and_wake_if(server, credits, 0);
 			rc = -ENOMEM;
 			break;
 		}
+		rdata->credits = credits;
 
 		rc = cifs_read_allocate_pages(rdata, npages);
 		if (rc)
@@ -2900,6 +2944,8 @@ ssize_t cifs_user_readv(struct kiocb *iocb, const struct iovec *iov,
 		rc = cifs_retry_async_readv(rdata);
 error:
 		if (rc) {
+			add_credits_and_wake_if(server, rdata->credits, 0);
+			rdata->credits = 0;
 			kref_put(&rdata->refcount,
 				 cifs_uncached_readdata_release);
 			break;
@@ -3254,7 +3300,7 @@ static int cifs_readpages(struct file *file, struct address_space *mapping,
 	struct list_head tmplist;
 	struct cifsFileInfo *open_file = file->private_data;
 	struct cifs_sb_info *cifs_sb = CIFS_SB(file->f_path.dentry->d_sb);
-	unsigned int rsize = cifs_sb->rsize;
+	struct TCP_Server_Info *server;
 	pid_t pid;
 
 	/*
@@ -3263,7 +3309,7 @@ static int cifs_readpages(struct file *file, struct address_space *mapping,
 	 * point however since we set ra_pages to 0 when the rsize is smaller
 	 * than a cache page.
 	 */
-	if (unlikely(rsize < PAGE_CACHE_SIZE))
+	if (unlikely(cifs_sb->rsize < PAGE_CACHE_SIZE))
 		return 0;
 
 	/*
@@ -3285,6 +3331,7 @@ static int cifs_readpages(struct file *file, struct address_space *mapping,
 
 	rc = 0;
 	INIT_LIST_HEAD(&tmplist);
+	server = tlink_tcon(open_file->tlink)->ses->server;
 
 	cifs_dbg(FYI, "%s: file=%p mapping=%p num_pages=%u\n",
 		 __func__, file, mapping, num_pages);
@@ -3305,10 +3352,20 @@ static int cifs_readpages(struct file *file, struct address_space *mapping,
 		unsigned int bytes = PAGE_CACHE_SIZE;
 		unsigned int expected_index;
 		unsigned int nr_pages = 1;
+		unsigned int rsize, credits;
 		loff_t offset;
 		struct page *page, *tpage;
 		struct cifs_readdata *rdata;
 
+		/*
+		 * Size this request by the credits we can get for it, so a
+		 * LARGE_MTU connection reads up to rsize in one go.
+		 */
+		rc = wait_mtu_credits(server, cifs_sb->rsize, &rsize,
+				      &credits);
+		if (rc)
+			break;
+
 		page = list_entry(page_list->prev, struct page, lru);
 
 		/*
@@ -3323,6 +3380,7 @@ static int cifs_readpages(struct file *file, struct address_space *mapping,
 		/* give up if we can't stick it in the cache */
 		if (rc) {
 			__clear_page_locked(page);
+			add_credits_and_wake_if(server, credits, 0);
 			break;
 		}
 
@@ -3363,6 +3421,7 @@ static int cifs_readpages(struct file *file, struct address_space *mapping,
 				page_cache_release(page);
 			}
 			rc = -ENOMEM;
+			add_credits_and_wake_if(server, credits, 0);
 			break;
 		}
 
@@ -3370,6 +3429,7 @@ static int cifs_readpages(struct file *file, struct address_space *mapping,
 		rdata->mapping = mapping;
 		rdata->offset = offset;
 		rdata->bytes = bytes;
+		rdata->credits = credits;
 		rdata->pid = pid;
 		rdata->pagesz = PAGE_CACHE_SIZE;
 		rdata->read_into_pages = cifs_readpages_read_into_pages;
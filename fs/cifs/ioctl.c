@@ -35,57 +35,35 @@
 #define CIFS_IOCTL_MAGIC	0xCF
 #define CIFS_IOC_COPYCHUNK_FILE	_IOW(CIFS_IOCTL_MAGIC, 3, int)
 
-static long cifs_ioctl_clone(unsigned int xid, struct file *dst_file,
-			unsigned long srcfd, u64 off, u64 len, u64 destoff)
+static long cifs_file_clone_range(unsigned int xid, struct file *src_file,
+				  struct file *dst_file, u64 off, u64 len,
+				  u64 destoff)
 {
 	int rc;
-	struct cifsFileInfo *smb_file_target = dst_file->private_data;
-	struct inode *target_inode = file_inode(dst_file);
-	struct cifs_tcon *target_tcon;
-	struct fd src_file;
+	struct cifsFileInfo *smb_file_target;
 	struct cifsFileInfo *smb_file_src;
+	struct inode *target_inode = file_inode(dst_file);
 	struct inode *src_inode;
+	struct cifs_tcon *target_tcon;
 	struct cifs_tcon *src_tcon;
 
-	cifs_dbg(FYI, "ioctl clone range\n");
-	/* the destination must be opened for writing */
-	if (!(dst_file->f_mode & FMODE_WRITE)) {
-		cifs_dbg(FYI, "file target not open for write\n");
-		return -EINVAL;
-	}
-
-	/* check if target volume is readonly and take reference */
-	rc = mnt_want_write_file(dst_file);
-	if (rc) {
-		cifs_dbg(FYI, "mnt_want_write failed with rc %d\n", rc);
-		return rc;
-	}
-
-	src_file = fdget(srcfd);
-	if (!src_file.file) {
-		rc = -EBADF;
-		goto out_drop_write;
-	}
-
-	if ((!src_file.file->private_data) || (!dst_file->private_data)) {
-		rc = -EBADF;
+	if ((!src_file->private_data) || (!dst_file->private_data)) {
 		cifs_dbg(VFS, "missing cifsFileInfo on copy range src file\n");
-		goto out_fput;
+		return -EBADF;
 	}
 
-	rc = -EXDEV;
 	smb_file_target = dst_file->private_data;
-	smb_file_src = src_file.file->private_data;
+	smb_file_src = src_file->private_data;
 	src_tcon = tlink_tcon(smb_file_src->tlink);
 	target_tcon = tlink_tcon(smb_file_target->tlink);
 
 	/* check if source and target are on same tree connection */
 	if (src_tcon != target_tcon) {
 		cifs_dbg(VFS, "file copy src and target on different volume\n");
-		goto out_fput;
+		return -EXDEV;
 	}
 
-	src_inode = src_file.file->f_dentry->d_inode;
+	src_inode = file_inode(src_file);
 
 	/*
 	 * Note: cifs case is easier than btrfs since server responsible for
@@ -94,7 +72,9 @@ static long cifs_ioctl_clone(unsigned int xid, struct file *dst_file,
 	 */
 
 	/* so we do not deadlock racing two ioctls on same files */
-	if (target_inode < src_inode) {
+	if (target_inode == src_inode) {
+		mutex_lock(&src_inode->i_mutex);
+	} else if (target_inode < src_inode) {
 		mutex_lock_nested(&target_inode->i_mutex, I_MUTEX_PARENT);
 		mutex_lock_nested(&src_inode->i_mutex, I_MUTEX_CHILD);
 	} else {
@@ -124,20 +104,86 @@ static long cifs_ioctl_clone(unsigned int xid, struct file *dst_file,
 out_unlock:
 	/* although unlocking in the reverse order from locking is not
 	   strictly necessary here it is a little cleaner to be consistent */
-	if (target_inode < src_inode) {
+	if (target_inode == src_inode) {
+		mutex_unlock(&src_inode->i_mutex);
+	} else if (target_inode < src_inode) {
 		mutex_unlock(&src_inode->i_mutex);
 		mutex_unlock(&target_inode->i_mutex);
 	} else {
 		mutex_unlock(&target_inode->i_mutex);
 		mutex_unlock(&src_inode->i_mutex);
 	}
-out_fput:
+	return rc;
+}
+
+static long cifs_ioctl_clone(unsigned int xid, struct file *dst_file,
+			unsigned long srcfd, u64 off, u64 len, u64 destoff)
+{
+	int rc;
+	struct fd src_file;
+
+	cifs_dbg(FYI, "ioctl clone range\n");
+	/* the destination must be opened for writing */
+	if (!(dst_file->f_mode & FMODE_WRITE)) {
+		cifs_dbg(FYI, "file target not open for write\n");
+		return -EINVAL;
+	}
+
+	/* check if target volume is readonly and take reference */
+	rc = mnt_want_write_file(dst_file);
+	if (rc) {
+		cifs_dbg(FYI, "mnt_want_write failed with rc %d\n", rc);
+		return rc;
+	}
+
+	src_file = fdget(srcfd);
+	if (!src_file.file) {
+		rc = -EBADF;
+		goto out_drop_write;
+	}
+
+	rc = cifs_file_clone_range(xid, src_file.file, dst_file, off, len,
+				   destoff);
+
 	fdput(src_file);
 out_drop_write:
 	mnt_drop_write_file(dst_file);
 	return rc;
 }
 
+/*
+ * ->copy_file_range: have the server copy the range (SMB2 copychunk)
+ * instead of moving the data over the wire twice. Dialects without
+ * server side copy return -EOPNOTSUPP so the VFS falls back to splice.
+ */
+ssize_t cifs_copy_file_range(struct file *src_file, loff_t off,
+			     struct file *dst_file, loff_t destoff,
+			     size_t len, unsigned int flags)
+{
+	struct cifsFileInfo *smb_file_target = dst_file->private_data;
+	struct inode *src_inode = file_inode(src_file);
+	unsigned int xid;
+	loff_t size;
+	long rc;
+
+	if (!smb_file_target ||
+	    !tlink_tcon(smb_file_target->tlink)->ses->server->ops->clone_range)
+		return -EOPNOTSUPP;
+
+	/* copy_file_range copies short at EOF, clone_range refuses to */
+	size = i_size_read(src_inode);
+	if (off >= size)
+		return 0;
+	if (len > size - off)
+		len = size - off;
+
+	xid = get_xid();
+	rc = cifs_file_clone_range(xid, src_file, dst_file, off, len, destoff);
+	free_xid(xid);
+
+	return rc < 0 ? rc : len;
+}
+
 long cifs_ioctl(struct file *filep, unsigned int command, unsigned long arg)
 {
 	struct inode *inode = file_inode(filep);
@@ -1020,6 +1020,7 @@ struct smb_version_operations smb1_operations = {
 	.get_credits_field = cifs_get_credits_field,
 	.get_credits = cifs_get_credits,
 	.get_next_mid = cifs_get_next_mid,
+	.wait_mtu_credits = cifs_wait_mtu_credits,
 	.read_data_offset = cifs_read_data_offset,
 	.read_data_length = cifs_read_data_length,
 	.map_error = map_smb_to_linux_error,
@@ -108,8 +108,11 @@ smb2_hdr_assemble(struct smb2_hdr *hdr, __le16 smb2_cmd /* command */ ,
 	if (!tcon)
 		goto out;
 
-	/* BB FIXME when we do write > 64K add +1 for every 64K in req or rsp */
-	/* GLOBAL_CAP_LARGE_MTU will only be set if dialect > SMB2.02 */
+	/*
+	 * Reads and writes larger than 64K raise this to one credit per 64K
+	 * of payload in smb2_set_credit_charge.
+	 * GLOBAL_CAP_LARGE_MTU will only be set if dialect > SMB2.02
+	 */
 	/* See sections 2.2.4 and 3.2.4.1.5 of MS-SMB2 */
 	if ((tcon->ses) &&
 	    (tcon->ses->server->capabilities & SMB2_GLOBAL_CAP_LARGE_MTU))
@@ -1693,6 +1696,78 @@ smb2_new_read_req(struct kvec *iov, struct cifs_io_parms *io_parms,
 	return rc;
 }
 
+static bool
+smb2_has_mtu_credits(struct TCP_Server_Info *server, unsigned int num)
+{
+	bool ret;
+
+	spin_lock(&server->req_lock);
+	ret = server->credits >= num || server->tcpStatus == CifsExiting;
+	spin_unlock(&server->req_lock);
+	return ret;
+}
+
+/*
+ * Charge a read or write of len bytes the credits it needs on a LARGE_MTU
+ * connection. Requests issued by the readpages/writepages paths arrive with
+ * credits reserved by wait_mtu_credits and hand back whatever the charge
+ * does not use. A resend after reconnect arrives with none and has to wait
+ * here until the server has granted enough. Returns 0 and the number of
+ * credits now owned by the request in *credits, which is 0 if the request
+ * goes out with the single credit cifs_call_async takes for it.
+ */
+static int
+smb2_set_credit_charge(struct TCP_Server_Info *server, struct smb2_hdr *hdr,
+		       unsigned int len, unsigned int *credits)
+{
+	unsigned int charge;
+	int rc;
+
+	if (!(server->capabilities & SMB2_GLOBAL_CAP_LARGE_MTU))
+		return 0;
+
+	charge = DIV_ROUND_UP(max_t(unsigned int, len, 1),
+			      SMB2_MAX_BUFFER_SIZE);
+
+	if (*credits == 0) {
+		if (charge == 1)
+			return 0;
+
+		spin_lock(&server->req_lock);
+		while (server->credits < charge) {
+			spin_unlock(&server->req_lock);
+			cifs_num_waiters_inc(server);
+			rc = wait_event_killable(server->request_q,
+					smb2_has_mtu_credits(server, charge));
+			cifs_num_waiters_dec(server);
+			if (rc)
+				return rc;
+			spin_lock(&server->req_lock);
+			if (server->tcpStatus == CifsExiting) {
+				spin_unlock(&server->req_lock);
+				return -ENOENT;
+			}
+		}
+		server->credits -= charge;
+		server->in_flight++;
+		spin_unlock(&server->req_lock);
+	} else if (*credits > charge) {
+		spin_lock(&server->req_lock);
+		server->credits += *credits - charge;
+		spin_unlock(&server->req_lock);
+		wake_up(&server->request_q);
+	} else if (WARN_ON_ONCE(*credits < charge)) {
+		/* sized by wait_mtu_credits, so this cannot be short */
+		return -EIO;
+	}
+
+	*credits = charge;
+	hdr->CreditCharge = cpu_to_le16(charge);
+	hdr->CreditRequest = cpu_to_le16(le16_to_cpu(hdr->CreditRequest) +
+					 charge - 1);
+	return 0;
+}
+
 static void
 smb2_readv_callback(struct mid_q_entry *mid)
 {
@@ -1749,11 +1824,12 @@ smb2_readv_callback(struct mid_q_entry *mid)
 int
 smb2_async_readv(struct cifs_readdata *rdata)
 {
-	int rc;
+	int rc, flags = 0;
 	struct smb2_hdr *buf;
 	struct cifs_io_parms io_parms;
 	struct smb_rqst rqst = { .rq_iov = &rdata->iov,
 				 .rq_nvec = 1 };
+	struct TCP_Server_Info *server;
 
 	cifs_dbg(FYI, "%s: offset=%llu bytes=%u\n",
 		 __func__, rdata->offset, rdata->bytes);
@@ -1764,22 +1840,40 @@ smb2_async_readv(struct cifs_readdata *rdata)
 	io_parms.persistent_fid = rdata->cfile->fid.persistent_fid;
 	io_parms.volatile_fid = rdata->cfile->fid.volatile_fid;
 	io_parms.pid = rdata->pid;
+	server = io_parms.tcon->ses->server;
 	rc = smb2_new_read_req(&rdata->iov, &io_parms, 0, 0);
-	if (rc)
+	if (rc) {
+		add_credits_and_wake_if(server, rdata->credits, 0);
+		rdata->credits = 0;
 		return rc;
+	}
 
 	buf = (struct smb2_hdr *)rdata->iov.iov_base;
 	/* 4 for rfc1002 length field */
 	rdata->iov.iov_len = get_rfc1002_length(rdata->iov.iov_base) + 4;
 
+	rc = smb2_set_credit_charge(server, buf, rdata->bytes,
+				    &rdata->credits);
+	if (rc) {
+		add_credits_and_wake_if(server, rdata->credits, 0);
+		rdata->credits = 0;
+		cifs_small_buf_release(buf);
+		return rc;
+	}
+	if (rdata->credits)
+		flags |= CIFS_HAS_CREDITS;
+
 	kref_get(&rdata->refcount);
-	rc = cifs_call_async(io_parms.tcon->ses->server, &rqst,
+	rc = cifs_call_async(server, &rqst,
 			     cifs_readv_receive, smb2_readv_callback,
-			     rdata, 0);
+			     rdata, flags);
 	if (rc) {
 		kref_put(&rdata->refcount, cifs_readdata_release);
 		cifs_stats_fail_inc(io_parms.tcon, SMB2_READ_HE);
+		add_credits_and_wake_if(server, rdata->credits, 0);
 	}
+	/* once sent, the response gives the credits back */
+	rdata->credits = 0;
 
 	cifs_small_buf_release(buf);
 	return rc;
@@ -1893,9 +1987,10 @@ int
 smb2_async_writev(struct cifs_writedata *wdata,
 		  void (*release)(struct kref *kref))
 {
-	int rc = -EACCES;
+	int rc = -EACCES, flags = 0;
 	struct smb2_write_req *req = NULL;
 	struct cifs_tcon *tcon = tlink_tcon(wdata->cfile->tlink);
+	struct TCP_Server_Info *server = tcon->ses->server;
 	struct kvec iov;
 	struct smb_rqst rqst;
 
@@ -1934,16 +2029,30 @@ smb2_async_writev(struct cifs_writedata *wdata,
 
 	inc_rfc1001_len(&req->hdr, wdata->bytes - 1 /* Buffer */);
 
+	rc = smb2_set_credit_charge(server, &req->hdr, wdata->bytes,
+				    &wdata->credits);
+	if (rc)
+		goto async_writev_out;
+	if (wdata->credits)
+		flags |= CIFS_HAS_CREDITS;
+
 	kref_get(&wdata->refcount);
-	rc = cifs_call_async(tcon->ses->server, &rqst, NULL,
-				smb2_writev_callback, wdata, 0);
+	rc = cifs_call_async(server, &rqst, NULL,
+				smb2_writev_callback, wdata, flags);
 
 	if (rc) {
 		kref_put(&wdata->refcount, release);
 		cifs_stats_fail_inc(tcon, SMB2_WRITE_HE);
+	} else {
+		/* once sent, the response gives the credits back */
+		wdata->credits = 0;
 	}
 
 async_writev_out:
+	if (rc) {
+		add_credits_and_wake_if(server, wdata->credits, 0);
+		wdata->credits = 0;
+	}
 	cifs_small_buf_release(req);
 	return rc;
 }
@@ -448,6 +448,19 @@ wait_for_free_request(struct TCP_Server_Info *server, const int timeout,
 	return wait_for_free_credits(server, timeout, val);
 }
 
+/*
+ * Dialects without multi-credit requests send every read or write with the
+ * single credit taken in cifs_call_async, so nothing is reserved up front.
+ */
+int
+cifs_wait_mtu_credits(struct TCP_Server_Info *server, unsigned int size,
+		      unsigned int *num, unsigned int *credits)
+{
+	*num = size;
+	*credits = 0;
+	return 0;
+}
+
 static int allocate_mid(struct cifs_ses *ses, struct smb_hdr *in_buf,
 			struct mid_q_entry **ppmidQ)
 {
@@ -535,16 +548,25 @@ cifs_call_async(struct TCP_Server_Info *server, struct smb_rqst *rqst,
 	timeout = flags & CIFS_TIMEOUT_MASK;
 	optype = flags & CIFS_OP_MASK;
 
-	rc = wait_for_free_request(server, timeout, optype);
-	if (rc)
-		return rc;
+	/*
+	 * Callers that passed CIFS_HAS_CREDITS reserved their own credits
+	 * (possibly several for a large read or write) and are responsible
+	 * for giving them back if the request never makes it to the wire.
+	 */
+	if ((flags & CIFS_HAS_CREDITS) == 0) {
+		rc = wait_for_free_request(server, timeout, optype);
+		if (rc)
+			return rc;
+	}
 
 	mutex_lock(&server->srv_mutex);
 	mid = server->ops->setup_async_request(server, rqst);
 	if (IS_ERR(mid)) {
 		mutex_unlock(&server->srv_mutex);
-		add_credits(server, 1, optype);
-		wake_up(&server->request_q);
+		if ((flags & CIFS_HAS_CREDITS) == 0) {
+			add_credits(server, 1, optype);
+			wake_up(&server->request_q);
+		}
 		return PTR_ERR(mid);
 	}
 
@@ -572,8 +594,10 @@ cifs_call_async(struct TCP_Server_Info *server, struct smb_rqst *rqst,
 		return 0;
 
 	cifs_delete_mid(mid);
-	add_credits(server, 1, optype);
-	wake_up(&server->request_q);
+	if ((flags & CIFS_HAS_CREDITS) == 0) {
+		add_credits(server, 1, optype);
+		wake_up(&server->request_q);
+	}
 	return rc;
 }
 
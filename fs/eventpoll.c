@@ -42,6 +42,9 @@
 #include <linux/seq_file.h>
 #include <linux/compat.h>
 #include <linux/rculist.h>
+#include <linux/net.h>
+#include <net/sock.h>
+#include <net/busy_poll.h>
 
 /*
  * LOCKING:
@@ -92,7 +95,12 @@
  */
 
 /* Epoll private bits inside the event mask */
-#define EP_PRIVATE_BITS (EPOLLWAKEUP | EPOLLONESHOT | EPOLLET)
+#define EP_PRIVATE_BITS (EPOLLWAKEUP | EPOLLONESHOT | EPOLLET | EPOLLEXCLUSIVE)
+
+#define EPOLLINOUT_BITS (POLLIN | POLLOUT)
+
+#define EPOLLEXCLUSIVE_OK_BITS (EPOLLINOUT_BITS | POLLERR | POLLHUP | \
+				EPOLLWAKEUP | EPOLLET | EPOLLEXCLUSIVE)
 
 /* Maximum number of nesting allowed inside epoll sets */
 #define EP_MAX_NESTS 4
@@ -103,6 +111,9 @@
 
 #define EP_ITEM_COST (sizeof(struct epitem) + sizeof(struct eppoll_entry))
 
+/* Number of RX queues remembered for busy polling in ep_poll() */
+#define EP_BUSY_POLL_NAPI 4
+
 struct epoll_filefd {
 	struct file *file;
 	int fd;
@@ -219,6 +230,12 @@ struct eventpoll {
 	/* used to optimize loop detection check */
 	int visited;
 	struct list_head visited_list_link;
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	/* NAPI contexts that recently made our sockets ready, protected by lock */
+	unsigned int napi_id[EP_BUSY_POLL_NAPI];
+	unsigned int napi_next;
+#endif
 };
 
 /* Wait structure used by the poll hooks */
@@ -379,6 +396,83 @@ static inline int ep_events_available(struct eventpoll *ep)
 	return !list_empty(&ep->rdllist) || ep->ovflist != EP_UNACTIVE_PTR;
 }
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/**
+ * ep_set_busy_poll_napi_id - Remembers the RX queue of a socket item.
+ *
+ * @epi: Pointer to the epitem, ep->lock must be held.
+ */
+static void ep_set_busy_poll_napi_id(struct epitem *epi)
+{
+	struct eventpoll *ep = epi->ep;
+	unsigned int napi_id, i;
+	struct socket *sock;
+	int err;
+
+	if (!net_busy_loop_on())
+		return;
+
+	sock = sock_from_file(epi->ffd.file, &err);
+	if (!sock || !sock->sk)
+		return;
+
+	napi_id = ACCESS_ONCE(sock->sk->sk_napi_id);
+	if (!napi_id)
+		return;
+
+	for (i = 0; i < EP_BUSY_POLL_NAPI; i++)
+		if (ep->napi_id[i] == napi_id)
+			return;
+	ep->napi_id[ep->napi_next++ % EP_BUSY_POLL_NAPI] = napi_id;
+}
+
+/**
+ * ep_busy_loop - Busy polls the RX queues feeding this epoll.
+ *
+ * @ep: Pointer to the eventpoll context.
+ * @nonblock: Poll every queue once instead of looping.
+ *
+ * Returns: Returns a value different than zero if ready events became
+ *          available.
+ */
+static int ep_busy_loop(struct eventpoll *ep, int nonblock)
+{
+	unsigned long end_time;
+	unsigned int i, napi_id;
+	int polled;
+
+	if (!net_busy_loop_on())
+		return 0;
+
+	end_time = busy_loop_end_time();
+	do {
+		polled = 0;
+		for (i = 0; i < EP_BUSY_POLL_NAPI; i++) {
+			napi_id = ACCESS_ONCE(ep->napi_id[i]);
+			if (napi_id &&
+			    napi_busy_loop_once(napi_id) != LL_FLUSH_FAILED)
+				polled++;
+		}
+		if (!polled)
+			break;
+		cpu_relax();
+	} while (!nonblock && !ep_events_available(ep) &&
+		 !need_resched() && !signal_pending(current) &&
+		 !busy_loop_timeout(end_time));
+
+	return ep_events_available(ep);
+}
+#else
+static inline void ep_set_busy_poll_napi_id(struct epitem *epi)
+{
+}
+
+static inline int ep_busy_loop(struct eventpoll *ep, int nonblock)
+{
+	return 0;
+}
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
 /**
  * ep_call_nested - Perform a bound (possibly) nested call, by checking
  *                  that the recursion limit is not exceeded, and that
@@ -998,10 +1092,15 @@ static struct epitem *ep_find(struct eventpoll *ep, struct file *file, int fd)
  * This is the callback that is passed to the wait queue wakeup
  * mechanism. It is called by the stored file descriptors when they
  * have events to report.
+ *
+ * For an EPOLLEXCLUSIVE item it returns nonzero only when it actually
+ * woke an epoll_wait() caller for the event's direction, so an
+ * exclusive wakeup keeps looking for another epoll instance otherwise.
  */
 static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *key)
 {
 	int pwake = 0;
+	int ewake = 0;
 	unsigned long flags;
 	struct epitem *epi = ep_item_from_wait(wait);
 	struct eventpoll *ep = epi->ep;
@@ -1028,6 +1127,8 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	if (!(epi->event.events & ~EP_PRIVATE_BITS))
 		goto out_unlock;
 
+	ep_set_busy_poll_napi_id(epi);
+
 	/*
 	 * Check the events coming with the callback. At this stage, not
 	 * every device reports the events in the "key" parameter of the
@@ -1069,8 +1170,25 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
 	 * wait list.
 	 */
-	if (waitqueue_active(&ep->wq))
+	if (waitqueue_active(&ep->wq)) {
+		if ((epi->event.events & EPOLLEXCLUSIVE) &&
+		    !((unsigned long)key & POLLFREE)) {
+			switch ((unsigned long)key & EPOLLINOUT_BITS) {
+			case POLLIN:
+				if (epi->event.events & POLLIN)
+					ewake = 1;
+				break;
+			case POLLOUT:
+				if (epi->event.events & POLLOUT)
+					ewake = 1;
+				break;
+			case 0:
+				ewake = 1;
+				break;
+			}
+		}
 		wake_up_locked(&ep->wq);
+	}
 	if (waitqueue_active(&ep->poll_wait))
 		pwake++;
 
@@ -1081,7 +1199,10 @@ out_unlock:
 	if (pwake)
 		ep_poll_safewake(&ep->poll_wait);
 
-	return 1;
+	if (!(epi->event.events & EPOLLEXCLUSIVE))
+		ewake = 1;
+
+	return ewake;
 }
 
 /*
@@ -1098,7 +1219,10 @@ static void ep_ptable_queue_proc(struct file *file, wait_queue_head_t *whead,
 		init_waitqueue_func_entry(&pwq->wait, ep_poll_callback);
 		pwq->whead = whead;
 		pwq->base = epi;
-		add_wait_queue(whead, &pwq->wait);
+		if (epi->event.events & EPOLLEXCLUSIVE)
+			add_wait_queue_exclusive(whead, &pwq->wait);
+		else
+			add_wait_queue(whead, &pwq->wait);
 		list_add_tail(&pwq->llink, &epi->pwqlist);
 		epi->nwait++;
 	} else {
@@ -1337,6 +1461,8 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	/* We have to drop the new item inside our item list to keep track of it */
 	spin_lock_irqsave(&ep->lock, flags);
 
+	ep_set_busy_poll_napi_id(epi);
+
 	/* If the file is already "ready" we drop it inside the ready list */
 	if ((revents & event->events) && !ep_is_linked(&epi->rdllink)) {
 		list_add_tail(&epi->rdllink, &ep->rdllist);
@@ -1606,11 +1732,20 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		 * caller specified a non blocking operation.
 		 */
 		timed_out = 1;
+		if (!ep_events_available(ep))
+			ep_busy_loop(ep, timed_out);
 		spin_lock_irqsave(&ep->lock, flags);
 		goto check_events;
 	}
 
 fetch_events:
+	/*
+	 * Before sleeping, spin on the RX queues our sockets are fed from,
+	 * like sk_busy_loop() does for a single blocking socket.
+	 */
+	if (!ep_events_available(ep))
+		ep_busy_loop(ep, timed_out);
+
 	spin_lock_irqsave(&ep->lock, flags);
 
 	if (!ep_events_available(ep)) {
@@ -1863,6 +1998,19 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	if (f.file == tf.file || !is_file_epoll(f.file))
 		goto error_tgt_fput;
 
+	/*
+	 * EPOLLEXCLUSIVE is only allowed on EPOLL_CTL_ADD, with a restricted
+	 * set of companion events, and not for nested epoll files, whose
+	 * wakeups fan out again.
+	 */
+	if (ep_op_has_event(op) && (epds.events & EPOLLEXCLUSIVE)) {
+		if (op == EPOLL_CTL_MOD)
+			goto error_tgt_fput;
+		if (op == EPOLL_CTL_ADD && (is_file_epoll(tf.file) ||
+				(epds.events & ~EPOLLEXCLUSIVE_OK_BITS)))
+			goto error_tgt_fput;
+	}
+
 	/*
 	 * At this point it is safe to assume that the "private_data" contains
 	 * our own data structure.
@@ -1934,8 +2082,10 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 		break;
 	case EPOLL_CTL_MOD:
 		if (epi) {
-			epds.events |= POLLERR | POLLHUP;
-			error = ep_modify(ep, epi, &epds);
+			if (!(epi->event.events & EPOLLEXCLUSIVE)) {
+				epds.events |= POLLERR | POLLHUP;
+				error = ep_modify(ep, epi, &epds);
+			}
 		} else
 			error = -ENOENT;
 		break;
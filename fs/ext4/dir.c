@@ -26,6 +26,7 @@
 #include <linux/buffer_head.h>
 #include <linux/slab.h>
 #include <linux/rbtree.h>
+#include <linux/blkdev.h>
 #include "ext4.h"
 #include "xattr.h"
 
@@ -102,6 +103,24 @@ int __ext4_check_dir_entry(const char *function, unsigned int line,
 	return 1;
 }
 
+/*
+ * Queue the next EXT4_DIR_RA_BLOCKS logical blocks of a linear directory
+ * from @lblk on, so that a fragmented directory is not read one
+ * synchronous block at a time.
+ */
+static void ext4_readdir_readahead(struct inode *inode, ext4_lblk_t lblk)
+{
+	ext4_lblk_t blocks[EXT4_DIR_RA_BLOCKS];
+	ext4_lblk_t nblocks = (inode->i_size + inode->i_sb->s_blocksize - 1) >>
+			      EXT4_BLOCK_SIZE_BITS(inode->i_sb);
+	int n = 0;
+
+	while (lblk < nblocks && n < EXT4_DIR_RA_BLOCKS)
+		blocks[n++] = lblk++;
+	if (n)
+		ext4_readahead_dir_blocks(inode, blocks, n);
+}
+
 static int ext4_readdir(struct file *file, struct dir_context *ctx)
 {
 	unsigned int offset;
@@ -111,9 +130,13 @@ static int ext4_readdir(struct file *file, struct dir_context *ctx)
 	struct inode *inode = file_inode(file);
 	struct super_block *sb = inode->i_sb;
 	int dir_has_error = 0;
+	struct blk_plug plug;
+	ext4_fsblk_t last_itb = 0;
 
 	if (is_dx_dir(inode)) {
+		blk_start_plug(&plug);
 		err = ext4_dx_readdir(file, ctx);
+		blk_finish_plug(&plug);
 		if (err != ERR_BAD_DX_DIR) {
 			return err;
 		}
@@ -136,12 +159,14 @@ static int ext4_readdir(struct file *file, struct dir_context *ctx)
 	stored = 0;
 	offset = ctx->pos & (sb->s_blocksize - 1);
 
+	blk_start_plug(&plug);
 	while (ctx->pos < inode->i_size) {
 		struct ext4_map_blocks map;
 		struct buffer_head *bh = NULL;
 
 		map.m_lblk = ctx->pos >> EXT4_BLOCK_SIZE_BITS(sb);
 		map.m_len = 1;
+		ext4_readdir_readahead(inode, map.m_lblk + 1);
 		err = ext4_map_blocks(NULL, inode, &map, 0);
 		if (err > 0) {
 			pgoff_t index = map.m_pblk >>
@@ -229,12 +254,16 @@ static int ext4_readdir(struct file *file, struct dir_context *ctx)
 			offset += ext4_rec_len_from_disk(de->rec_len,
 					sb->s_blocksize);
 			if (le32_to_cpu(de->inode)) {
+				if (EXT4_SB(sb)->s_dir_inode_prefetch)
+					ext4_inode_table_readahead(sb,
+						le32_to_cpu(de->inode),
+						&last_itb);
 				if (!dir_emit(ctx, de->name,
 						de->name_len,
 						le32_to_cpu(de->inode),
 						get_dtype(sb, de->file_type))) {
 					brelse(bh);
-					return 0;
+					goto out;
 				}
 			}
 			ctx->pos += ext4_rec_len_from_disk(de->rec_len,
@@ -244,9 +273,11 @@ static int ext4_readdir(struct file *file, struct dir_context *ctx)
 		brelse(bh);
 		if (ctx->pos < inode->i_size) {
 			if (!dir_relax(inode))
-				return 0;
+				goto out;
 		}
 	}
+out:
+	blk_finish_plug(&plug);
 	return 0;
 }
 
@@ -465,6 +496,9 @@ static int call_filldir(struct file *file, struct dir_context *ctx,
 	}
 	ctx->pos = hash2pos(file, fname->hash, fname->minor_hash);
 	while (fname) {
+		if (EXT4_SB(sb)->s_dir_inode_prefetch)
+			ext4_inode_table_readahead(sb, fname->inode,
+						   &info->last_itb);
 		if (!dir_emit(ctx, fname->name,
 				fname->name_len,
 				fname->inode,
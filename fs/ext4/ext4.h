@@ -891,7 +891,7 @@ struct ext4_inode_info {
 	rwlock_t i_es_lock;
 	struct list_head i_es_lru;
 	unsigned int i_es_lru_nr;	/* protected by i_es_lock */
-	unsigned long i_touch_when;	/* jiffies of last accessing */
+	ext4_lblk_t i_es_shrink_lblk;	/* where the shrinker continues */
 
 	/* ialloc */
 	ext4_group_t	i_last_alloc_group;
@@ -1209,6 +1209,7 @@ struct ext4_sb_info {
 	int s_inode_size;
 	int s_first_ino;
 	unsigned int s_inode_readahead_blks;
+	unsigned int s_dir_inode_prefetch;
 	unsigned int s_inode_goal;
 	spinlock_t s_next_gen_lock;
 	u32 s_next_generation;
@@ -1328,8 +1329,8 @@ struct ext4_sb_info {
 
 	/* Reclaim extents from extent status tree */
 	struct shrinker s_es_shrinker;
-	struct list_head s_es_lru;
-	unsigned long s_es_last_sorted;
+	struct list_head s_es_lru;	/* scanned round-robin */
+	unsigned long s_es_nr_inode;	/* inodes on s_es_lru */
 	struct percpu_counter s_extent_cache_cnt;
 	struct mb_cache *s_mb_cache;
 	spinlock_t s_es_lru_lock ____cacheline_aligned_in_smp;
@@ -1581,6 +1582,9 @@ static inline void ext4_clear_state_flags(struct ext4_inode_info *ei)
 
 #define EXT4_DEF_INODE_READAHEAD_BLKS	32
 
+/* Directory blocks read ahead in one go by readdir */
+#define EXT4_DIR_RA_BLOCKS		16
+
 /*
  * Default mount options
  */
@@ -1810,6 +1814,7 @@ struct dir_private_info {
 	__u32		curr_hash;
 	__u32		curr_minor_hash;
 	__u32		next_hash;
+	ext4_fsblk_t	last_itb;	/* inode table block last prefetched */
 };
 
 /* calculate the first block number of the group */
@@ -2097,6 +2102,9 @@ struct buffer_head *ext4_getblk(handle_t *, struct inode *,
 						ext4_lblk_t, int, int *);
 struct buffer_head *ext4_bread(handle_t *, struct inode *,
 						ext4_lblk_t, int, int *);
+void ext4_readahead_dir_blocks(struct inode *, ext4_lblk_t *, int);
+void ext4_inode_table_readahead(struct super_block *, unsigned long,
+				ext4_fsblk_t *);
 int ext4_get_block_write(struct inode *inode, sector_t iblock,
 			 struct buffer_head *bh_result, int create);
 int ext4_get_block(struct inode *inode, sector_t iblock,
@@ -46,8 +46,11 @@
 #define ES_DELAYED		(1ULL << 61)
 #define ES_HOLE			(1ULL << 60)
 
+/* Not a status: set on lookup, cleared by the shrinker (second chance). */
+#define ES_REFERENCED		(1ULL << 59)
+
 #define ES_MASK			(ES_WRITTEN | ES_UNWRITTEN | \
-				 ES_DELAYED | ES_HOLE)
+				 ES_DELAYED | ES_HOLE | ES_REFERENCED)
 
 struct ext4_sb_info;
 struct ext4_extent;
@@ -102,6 +105,21 @@ static inline int ext4_es_is_hole(struct extent_status *es)
 	return (es->es_pblk & ES_HOLE) != 0;
 }
 
+static inline int ext4_es_is_referenced(struct extent_status *es)
+{
+	return (es->es_pblk & ES_REFERENCED) != 0;
+}
+
+static inline void ext4_es_set_referenced(struct extent_status *es)
+{
+	es->es_pblk |= ES_REFERENCED;
+}
+
+static inline void ext4_es_clear_referenced(struct extent_status *es)
+{
+	es->es_pblk &= ~ES_REFERENCED;
+}
+
 static inline unsigned int ext4_es_status(struct extent_status *es)
 {
 	return es->es_pblk >> ES_SHIFT;
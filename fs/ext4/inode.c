@@ -849,6 +849,37 @@ struct buffer_head *ext4_bread(handle_t *handle, struct inode *inode,
 	return NULL;
 }
 
+/*
+ * Start reads of up to EXT4_DIR_RA_BLOCKS directory blocks without waiting
+ * for them, so that the ext4_bread() of each one later finds it in flight
+ * or done.  If the first block is already cached or under I/O, an earlier
+ * call has queued this window and we don't bother looking again.
+ */
+void ext4_readahead_dir_blocks(struct inode *dir, ext4_lblk_t *blocks,
+			       int nr)
+{
+	struct buffer_head *bhs[EXT4_DIR_RA_BLOCKS];
+	int i, n = 0, err;
+
+	for (i = 0; i < nr && n < EXT4_DIR_RA_BLOCKS; i++) {
+		struct buffer_head *bh;
+
+		bh = ext4_getblk(NULL, dir, blocks[i], 0, &err);
+		if (!bh)
+			continue;
+		if (buffer_uptodate(bh) || buffer_locked(bh)) {
+			brelse(bh);
+			if (!i)
+				return;
+			continue;
+		}
+		bhs[n++] = bh;
+	}
+	ll_rw_block(READA | REQ_META | REQ_PRIO, n, bhs);
+	for (i = 0; i < n; i++)
+		brelse(bhs[i]);
+}
+
 int ext4_walk_page_buffers(handle_t *handle,
 			   struct buffer_head *head,
 			   unsigned from,
@@ -3790,6 +3821,35 @@ out_stop:
 	trace_ext4_truncate_exit(inode);
 }
 
+/*
+ * Start reading the inode table block holding inode @ino, for callers
+ * like readdir that know which inodes are about to be looked up.  *last
+ * is the block queued by the previous call, so that a run of inodes
+ * sharing one table block costs a single lookup.
+ */
+void ext4_inode_table_readahead(struct super_block *sb, unsigned long ino,
+				ext4_fsblk_t *last)
+{
+	struct ext4_group_desc *gdp;
+	ext4_fsblk_t block;
+	unsigned long offset;
+
+	if (ino < EXT4_ROOT_INO ||
+	    ino > le32_to_cpu(EXT4_SB(sb)->s_es->s_inodes_count))
+		return;
+	gdp = ext4_get_group_desc(sb, (ino - 1) / EXT4_INODES_PER_GROUP(sb),
+				  NULL);
+	if (!gdp)
+		return;
+	offset = (ino - 1) % EXT4_INODES_PER_GROUP(sb);
+	block = ext4_inode_table(sb, gdp) +
+		offset / EXT4_SB(sb)->s_inodes_per_block;
+	if (block == *last)
+		return;
+	*last = block;
+	sb_breadahead(sb, block);
+}
+
 /*
  * ext4_get_inode_loc returns with an extra refcount against the inode's
  * underlying buffer_head on success. If 'in_mem' is true, we have all
@@ -1645,6 +1645,9 @@ static void ext4_mb_use_best_found(struct ext4_allocation_context *ac,
 		sbi->s_mb_last_start = ac->ac_f_ex.fe_start;
 		spin_unlock(&sbi->s_md_lock);
 	}
+	/* and the group this CPU's locality group should try first */
+	if (ac->ac_lg)
+		ACCESS_ONCE(ac->ac_lg->lg_last_group) = ac->ac_f_ex.fe_group;
 }
 
 /*
@@ -2115,6 +2118,16 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 		ac->ac_g_ex.fe_group = sbi->s_mb_last_group;
 		ac->ac_g_ex.fe_start = sbi->s_mb_last_start;
 		spin_unlock(&sbi->s_md_lock);
+	} else if (ac->ac_lg) {
+		/*
+		 * Small files share the per-CPU locality group preallocation,
+		 * so there is no point in starting every CPU's scan at the
+		 * inode's group: continue from where this CPU last found
+		 * space.  This keeps parallel writers on disjoint groups.
+		 */
+		group = ACCESS_ONCE(ac->ac_lg->lg_last_group);
+		if (group < ngroups)
+			ac->ac_g_ex.fe_group = group;
 	}
 
 	/* Let's just scan groups to find more-less suitable blocks */
@@ -2145,6 +2158,16 @@ repeat:
 			if (!ext4_mb_good_group(ac, group, cr))
 				continue;
 
+			/*
+			 * In the picky passes don't wait for a group somebody
+			 * else is allocating from; there likely are other
+			 * suitable groups and we get back to this one in the
+			 * later passes anyway.
+			 */
+			if (cr < 2 && ngroups > 1 &&
+			    spin_is_locked(ext4_group_lock_ptr(sb, group)))
+				continue;
+
 			err = ext4_mb_load_buddy(sb, group, &e4b);
 			if (err)
 				goto out;
@@ -2540,7 +2563,8 @@ static int ext4_groupinfo_create_slab(size_t size)
 int ext4_mb_init(struct super_block *sb)
 {
 	struct ext4_sb_info *sbi = EXT4_SB(sb);
-	unsigned i, j;
+	ext4_group_t ngroups, spread;
+	unsigned i, j, n;
 	unsigned offset;
 	unsigned max;
 	int ret;
@@ -2619,6 +2643,9 @@ int ext4_mb_init(struct super_block *sb)
 		ret = -ENOMEM;
 		goto out_free_groupinfo_slab;
 	}
+	ngroups = ext4_get_groups_count(sb);
+	spread = ngroups / num_possible_cpus();
+	n = 0;
 	for_each_possible_cpu(i) {
 		struct ext4_locality_group *lg;
 		lg = per_cpu_ptr(sbi->s_locality_groups, i);
@@ -2626,6 +2653,8 @@ int ext4_mb_init(struct super_block *sb)
 		for (j = 0; j < PREALLOC_TB_SIZE; j++)
 			INIT_LIST_HEAD(&lg->lg_prealloc_list[j]);
 		spin_lock_init(&lg->lg_prealloc_lock);
+		/* give each CPU its own slice of groups to start from */
+		lg->lg_last_group = spread * n++;
 	}
 
 	/* init file for buddy data */
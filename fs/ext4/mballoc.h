@@ -157,6 +157,8 @@ struct ext4_locality_group {
 	/* list of preallocations */
 	struct list_head	lg_prealloc_list[PREALLOC_TB_SIZE];
 	spinlock_t		lg_prealloc_lock;
+	/* group the last allocation came from, where the next scan starts */
+	ext4_group_t		lg_last_group;
 };
 
 struct ext4_allocation_context {
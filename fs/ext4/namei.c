@@ -940,6 +940,23 @@ static int htree_dirblock_to_tree(struct file *dir_file,
 }
 
 
+/*
+ * Queue the leaf blocks that follow frame->at, which readdir is about to
+ * walk in hash order and which are scattered over the directory.
+ */
+static void dx_readahead_leaves(struct inode *dir, struct dx_frame *frame)
+{
+	ext4_lblk_t blocks[EXT4_DIR_RA_BLOCKS];
+	struct dx_entry *p = frame->at + 1;
+	struct dx_entry *end = frame->entries + dx_get_count(frame->entries);
+	int n = 0;
+
+	while (p < end && n < EXT4_DIR_RA_BLOCKS)
+		blocks[n++] = dx_get_block(p++);
+	if (n)
+		ext4_readahead_dir_blocks(dir, blocks, n);
+}
+
 /*
  * This function fills a red-black tree with information from a
  * directory.  We start scanning the directory in hash order, starting
@@ -1008,6 +1025,7 @@ int ext4_htree_fill_tree(struct file *dir_file, __u32 start_hash,
 
 	while (1) {
 		block = dx_get_block(frame->at);
+		dx_readahead_leaves(dir, frame);
 		ret = htree_dirblock_to_tree(dir_file, dir, block, &hinfo,
 					     start_hash, start_minor_hash);
 		if (ret < 0) {
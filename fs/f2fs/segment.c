@@ -1490,7 +1490,7 @@ void flush_sit_entries(struct f2fs_sb_info *sbi)
 	unsigned int segno = -1;
 	bool flushed;
 
-	mutex_lock(&curseg->curseg_mutex);
+	down_write(&curseg->journal_rwsem);
 	mutex_lock(&sit_i->sentry_lock);
 
 	/*
@@ -1540,7 +1540,7 @@ flush_done:
 		sit_i->dirty_sentries--;
 	}
 	mutex_unlock(&sit_i->sentry_lock);
-	mutex_unlock(&curseg->curseg_mutex);
+	up_write(&curseg->journal_rwsem);
 
 	/* writeout last modified SIT block */
 	f2fs_put_page(page, 1);
@@ -1666,6 +1666,7 @@ static int build_curseg(struct f2fs_sb_info *sbi)
 
 	for (i = 0; i < NR_CURSEG_TYPE; i++) {
 		mutex_init(&array[i].curseg_mutex);
+		init_rwsem(&array[i].journal_rwsem);
 		array[i].sum_blk = kzalloc(PAGE_CACHE_SIZE, GFP_KERNEL);
 		if (!array[i].sum_blk)
 			return -ENOMEM;
@@ -1697,16 +1698,16 @@ static void build_sit_entries(struct f2fs_sb_info *sbi)
 			struct f2fs_sit_entry sit;
 			struct page *page;
 
-			mutex_lock(&curseg->curseg_mutex);
+			down_read(&curseg->journal_rwsem);
 			for (i = 0; i < sits_in_cursum(sum); i++) {
 				if (le32_to_cpu(segno_in_journal(sum, i))
 								== start) {
 					sit = sit_in_journal(sum, i);
-					mutex_unlock(&curseg->curseg_mutex);
+					up_read(&curseg->journal_rwsem);
 					goto got_it;
 				}
 			}
-			mutex_unlock(&curseg->curseg_mutex);
+			up_read(&curseg->journal_rwsem);
 
 			page = get_current_sit_page(sbi, start);
 			sit_blk = (struct f2fs_sit_block *)page_address(page);
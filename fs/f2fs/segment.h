@@ -229,6 +229,12 @@ struct victim_selection {
 /* for active log information */
 struct curseg_info {
 	struct mutex curseg_mutex;		/* lock for consistency */
+	/*
+	 * Protects the nat/sit journal in sum_blk, so that journal lookups
+	 * don't contend with block allocation on curseg_mutex.  The journal
+	 * is only modified during checkpoint, while no blocks get allocated.
+	 */
+	struct rw_semaphore journal_rwsem;
 	struct f2fs_summary_block *sum_blk;	/* cached summary block */
 	unsigned char alloc_type;		/* current allocation type */
 	unsigned int segno;			/* current segment number */
@@ -1244,10 +1244,24 @@ static void wait_sb_inodes(struct super_block *sb)
 	 */
 	list_for_each_entry(inode, &sb->s_inodes, i_sb_list) {
 		struct address_space *mapping = inode->i_mapping;
+		bool wait = true;
+
+		/*
+		 * Only mappings with pages under writeback need waiting
+		 * on, and the writeback tag can be tested without i_lock.
+		 * That lets us skip the clean inodes, usually the vast
+		 * majority, without touching their lock or refcount. We
+		 * still pin one now and then, so that we can drop the list
+		 * lock for a reschedule.
+		 */
+		if (!mapping_tagged(mapping, PAGECACHE_TAG_WRITEBACK)) {
+			if (!need_resched())
+				continue;
+			wait = false;
+		}
 
 		spin_lock(&inode->i_lock);
-		if ((inode->i_state & (I_FREEING|I_WILL_FREE|I_NEW)) ||
-		    (mapping->nrpages == 0)) {
+		if (inode->i_state & (I_FREEING|I_WILL_FREE|I_NEW)) {
 			spin_unlock(&inode->i_lock);
 			continue;
 		}
@@ -1266,7 +1280,8 @@ static void wait_sb_inodes(struct super_block *sb)
 		iput(old_inode);
 		old_inode = inode;
 
-		filemap_fdatawait(mapping);
+		if (wait)
+			filemap_fdatawait(mapping);
 
 		cond_resched();
 
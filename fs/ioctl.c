@@ -536,6 +536,29 @@ static int ioctl_fsthaw(struct file *filp)
 	return thaw_super(sb);
 }
 
+static long ioctl_file_copy_range(struct file *filp,
+				  struct file_copy_range __user *argp)
+{
+	struct file_copy_range args;
+	struct fd src;
+	long ret;
+
+	if (copy_from_user(&args, argp, sizeof(args)))
+		return -EFAULT;
+	if ((loff_t)args.src_offset < 0 || (loff_t)args.dest_offset < 0)
+		return -EINVAL;
+	if (args.src_length > MAX_RW_COUNT)
+		args.src_length = MAX_RW_COUNT;
+
+	src = fdget(args.src_fd);
+	if (!src.file)
+		return -EBADF;
+	ret = vfs_copy_file_range(src.file, args.src_offset, filp,
+				  args.dest_offset, args.src_length, 0);
+	fdput(src);
+	return ret;
+}
+
 /*
  * When you add any new common ioctls to the switches above and below
  * please update compat_sys_ioctl() too.
@@ -591,6 +614,12 @@ int do_vfs_ioctl(struct file *filp, unsigned int fd, unsigned int cmd,
 	case FIGETBSZ:
 		return put_user(inode->i_sb->s_blocksize, argp);
 
+	case FIBATCHSTAT:
+		return vfs_batch_stat(filp, (void __user *)arg);
+
+	case FICOPYRANGE:
+		return ioctl_file_copy_range(filp, (void __user *)arg);
+
 	default:
 		if (S_ISREG(inode->i_mode))
 			error = file_ioctl(filp, cmd, arg);
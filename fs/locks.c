@@ -884,25 +884,24 @@ static int __posix_lock_file(struct inode *inode, struct file_lock *request, str
 	struct file_lock *fl;
 	struct file_lock *new_fl = NULL;
 	struct file_lock *new_fl2 = NULL;
-	struct file_lock *left = NULL;
-	struct file_lock *right = NULL;
+	struct file_lock *left;
+	struct file_lock *right;
 	struct file_lock **before;
 	int error;
-	bool added = false;
+	bool added;
 
 	/*
-	 * We may need two file_lock structures for this operation,
-	 * so we get them in advance to avoid races.
-	 *
-	 * In some cases we can be sure, that no new locks will be needed
+	 * A new lock needs a file_lock structure of its own, so get it in
+	 * advance to avoid races. Unlocks never insert one. The second
+	 * structure is only needed when an existing lock gets split in
+	 * two, which is rare, so it is allocated on demand below.
 	 */
-	if (!(request->fl_flags & FL_ACCESS) &&
-	    (request->fl_type != F_UNLCK ||
-	     request->fl_start != 0 || request->fl_end != OFFSET_MAX)) {
+	if (!(request->fl_flags & FL_ACCESS) && request->fl_type != F_UNLCK)
 		new_fl = locks_alloc_lock();
-		new_fl2 = locks_alloc_lock();
-	}
 
+again:
+	left = right = NULL;
+	added = false;
 	spin_lock(&inode->i_lock);
 	/*
 	 * New lock request. Walk all POSIX locks and look for conflicts. If
@@ -1043,9 +1042,19 @@ static int __posix_lock_file(struct inode *inode, struct file_lock *request, str
 	 * replacing. If new lock(s) need to be inserted all modifications are
 	 * done below this, so it's safe yet to bail out.
 	 */
-	error = -ENOLCK; /* "no luck" */
-	if (right && left == right && !new_fl2)
-		goto out;
+	if (right && left == right && !new_fl2) {
+		/*
+		 * A lock that encloses the request cannot have had an
+		 * adjacent one merged into the request, so nothing was
+		 * modified yet: get the second lock and start over.
+		 */
+		spin_unlock(&inode->i_lock);
+		new_fl2 = locks_alloc_lock();
+		if (new_fl2)
+			goto again;
+		error = -ENOLCK; /* "no luck" */
+		goto out_free;
+	}
 
 	error = 0;
 	if (!added) {
@@ -1082,6 +1091,7 @@ static int __posix_lock_file(struct inode *inode, struct file_lock *request, str
 	}
  out:
 	spin_unlock(&inode->i_lock);
+ out_free:
 	/*
 	 * Free any unused locks.
 	 */
@@ -146,6 +146,20 @@ static void nfs_direct_release_pages(struct page **pages, unsigned int npages)
 		page_cache_release(pages[i]);
 }
 
+/*
+ * One page vector is used for every segment of a request; size it for
+ * the largest rsize/wsize chunk pinned at once, which may start at any
+ * offset within its first page.
+ */
+static struct page **nfs_direct_alloc_pagevec(size_t iosize)
+{
+	unsigned int npages;
+
+	npages = nfs_page_array_len(PAGE_SIZE - 1,
+				    max_t(size_t, iosize, PAGE_SIZE));
+	return kmalloc(npages * sizeof(struct page *), GFP_KERNEL);
+}
+
 void nfs_init_cinfo_from_dreq(struct nfs_commit_info *cinfo,
 			      struct nfs_direct_req *dreq)
 {
@@ -317,13 +331,14 @@ static const struct nfs_pgio_completion_ops nfs_direct_read_completion_ops = {
 
 /*
  * For each rsize'd chunk of the user's buffer, dispatch an NFS READ
- * operation.  If nfs_readdata_alloc() or get_user_pages() fails,
+ * operation.  If nfs_readdata_alloc() or get_user_pages_fast() fails,
  * bail and stop sending more reads.  Read length accounting is
  * handled automatically by nfs_direct_read_result().  Otherwise, if
  * no requests have been sent, just return an error.
  */
 static ssize_t nfs_direct_read_schedule_segment(struct nfs_pageio_descriptor *desc,
 						const struct iovec *iov,
+						struct page **pagevec,
 						loff_t pos, bool uio)
 {
 	struct nfs_direct_req *dreq = desc->pg_dreq;
@@ -335,7 +350,6 @@ static ssize_t nfs_direct_read_schedule_segment(struct nfs_pageio_descriptor *de
 	unsigned int pgbase;
 	int result;
 	ssize_t started = 0;
-	struct page **pagevec = NULL;
 	unsigned int npages;
 
 	do {
@@ -345,18 +359,10 @@ static ssize_t nfs_direct_read_schedule_segment(struct nfs_pageio_descriptor *de
 		pgbase = user_addr & ~PAGE_MASK;
 		bytes = min(max_t(size_t, rsize, PAGE_SIZE), count);
 
-		result = -ENOMEM;
 		npages = nfs_page_array_len(pgbase, bytes);
-		if (!pagevec)
-			pagevec = kmalloc(npages * sizeof(struct page *),
-					  GFP_KERNEL);
-		if (!pagevec)
-			break;
 		if (uio) {
-			down_read(&current->mm->mmap_sem);
-			result = get_user_pages(current, current->mm, user_addr,
-					npages, 1, 0, pagevec, NULL);
-			up_read(&current->mm->mmap_sem);
+			result = get_user_pages_fast(user_addr, npages, 1,
+						     pagevec);
 			if (result < 0)
 				break;
 		} else {
@@ -406,8 +412,6 @@ static ssize_t nfs_direct_read_schedule_segment(struct nfs_pageio_descriptor *de
 		nfs_direct_release_pages(pagevec, npages);
 	} while (count != 0 && result >= 0);
 
-	kfree(pagevec);
-
 	if (started)
 		return started;
 	return result < 0 ? (ssize_t) result : -EFAULT;
@@ -420,10 +424,17 @@ static ssize_t nfs_direct_read_schedule_iovec(struct nfs_direct_req *dreq,
 {
 	struct nfs_pageio_descriptor desc;
 	struct inode *inode = dreq->inode;
+	struct page **pagevec;
 	ssize_t result = -EINVAL;
 	size_t requested_bytes = 0;
 	unsigned long seg;
 
+	pagevec = nfs_direct_alloc_pagevec(NFS_SERVER(inode)->rsize);
+	if (pagevec == NULL) {
+		nfs_direct_req_release(dreq);
+		return -ENOMEM;
+	}
+
 	NFS_PROTO(dreq->inode)->read_pageio_init(&desc, dreq->inode,
 			     &nfs_direct_read_completion_ops);
 	get_dreq(dreq);
@@ -432,7 +443,8 @@ static ssize_t nfs_direct_read_schedule_iovec(struct nfs_direct_req *dreq,
 
 	for (seg = 0; seg < nr_segs; seg++) {
 		const struct iovec *vec = &iov[seg];
-		result = nfs_direct_read_schedule_segment(&desc, vec, pos, uio);
+		result = nfs_direct_read_schedule_segment(&desc, vec, pagevec,
+							  pos, uio);
 		if (result < 0)
 			break;
 		requested_bytes += result;
@@ -442,6 +454,7 @@ static ssize_t nfs_direct_read_schedule_iovec(struct nfs_direct_req *dreq,
 	}
 
 	nfs_pageio_complete(&desc);
+	kfree(pagevec);
 
 	/*
 	 * If no bytes were started, return the error, and let the
@@ -687,13 +700,14 @@ static void nfs_direct_write_complete(struct nfs_direct_req *dreq, struct inode
  */
 /*
  * For each wsize'd chunk of the user's buffer, dispatch an NFS WRITE
- * operation.  If nfs_writedata_alloc() or get_user_pages() fails,
+ * operation.  If nfs_writedata_alloc() or get_user_pages_fast() fails,
  * bail and stop sending more writes.  Write length accounting is
  * handled automatically by nfs_direct_write_result().  Otherwise, if
  * no requests have been sent, just return an error.
  */
 static ssize_t nfs_direct_write_schedule_segment(struct nfs_pageio_descriptor *desc,
 						 const struct iovec *iov,
+						 struct page **pagevec,
 						 loff_t pos, bool uio)
 {
 	struct nfs_direct_req *dreq = desc->pg_dreq;
@@ -705,7 +719,6 @@ static ssize_t nfs_direct_write_schedule_segment(struct nfs_pageio_descriptor *d
 	unsigned int pgbase;
 	int result;
 	ssize_t started = 0;
-	struct page **pagevec = NULL;
 	unsigned int npages;
 
 	do {
@@ -715,18 +728,10 @@ static ssize_t nfs_direct_write_schedule_segment(struct nfs_pageio_descriptor *d
 		pgbase = user_addr & ~PAGE_MASK;
 		bytes = min(max_t(size_t, wsize, PAGE_SIZE), count);
 
-		result = -ENOMEM;
 		npages = nfs_page_array_len(pgbase, bytes);
-		if (!pagevec)
-			pagevec = kmalloc(npages * sizeof(struct page *), GFP_KERNEL);
-		if (!pagevec)
-			break;
-
 		if (uio) {
-			down_read(&current->mm->mmap_sem);
-			result = get_user_pages(current, current->mm, user_addr,
-						npages, 0, 0, pagevec, NULL);
-			up_read(&current->mm->mmap_sem);
+			result = get_user_pages_fast(user_addr, npages, 0,
+						     pagevec);
 			if (result < 0)
 				break;
 		} else {
@@ -777,8 +782,6 @@ static ssize_t nfs_direct_write_schedule_segment(struct nfs_pageio_descriptor *d
 		nfs_direct_release_pages(pagevec, npages);
 	} while (count != 0 && result >= 0);
 
-	kfree(pagevec);
-
 	if (started)
 		return started;
 	return result < 0 ? (ssize_t) result : -EFAULT;
@@ -870,10 +873,17 @@ static ssize_t nfs_direct_write_schedule_iovec(struct nfs_direct_req *dreq,
 {
 	struct nfs_pageio_descriptor desc;
 	struct inode *inode = dreq->inode;
+	struct page **pagevec;
 	ssize_t result = 0;
 	size_t requested_bytes = 0;
 	unsigned long seg;
 
+	pagevec = nfs_direct_alloc_pagevec(NFS_SERVER(inode)->wsize);
+	if (pagevec == NULL) {
+		nfs_direct_req_release(dreq);
+		return -ENOMEM;
+	}
+
 	NFS_PROTO(inode)->write_pageio_init(&desc, inode, FLUSH_COND_STABLE,
 			      &nfs_direct_write_completion_ops);
 	desc.pg_dreq = dreq;
@@ -883,7 +893,8 @@ static ssize_t nfs_direct_write_schedule_iovec(struct nfs_direct_req *dreq,
 	NFS_I(dreq->inode)->write_io += iov_length(iov, nr_segs);
 	for (seg = 0; seg < nr_segs; seg++) {
 		const struct iovec *vec = &iov[seg];
-		result = nfs_direct_write_schedule_segment(&desc, vec, pos, uio);
+		result = nfs_direct_write_schedule_segment(&desc, vec, pagevec,
+							   pos, uio);
 		if (result < 0)
 			break;
 		requested_bytes += result;
@@ -892,6 +903,7 @@ static ssize_t nfs_direct_write_schedule_iovec(struct nfs_direct_req *dreq,
 		pos += vec->iov_len;
 	}
 	nfs_pageio_complete(&desc);
+	kfree(pagevec);
 
 	/*
 	 * If no bytes were started, return the error, and let the
@@ -25,7 +25,7 @@
 #include <net/netns/generic.h>
 
 /* Hash tables for nfs4_clientid state */
-#define CLIENT_HASH_BITS                 4
+#define CLIENT_HASH_BITS                 8
 #define CLIENT_HASH_SIZE                (1 << CLIENT_HASH_BITS)
 #define CLIENT_HASH_MASK                (CLIENT_HASH_SIZE - 1)
 
@@ -66,7 +66,6 @@ struct nfsd_net {
 	struct rb_root conf_name_tree;
 	struct list_head *unconf_id_hashtbl;
 	struct rb_root unconf_name_tree;
-	struct list_head *ownerstr_hashtbl;
 	struct list_head *lockowner_ino_hashtbl;
 	struct list_head *sessionid_hashtbl;
 	/*
@@ -763,6 +763,26 @@ nfsd4_lookup(struct svc_rqst *rqstp, struct nfsd4_compound_state *cstate,
 			   &cstate->current_fh);
 }
 
+/*
+ * A spliced READ reply references page cache pages that are only
+ * copied out when the reply is sent, i.e. after the rest of the
+ * compound has run. That is fine as long as nothing later in the
+ * compound can change the file data; GETATTR, commonly sent after
+ * READ to refresh the client's attribute cache, cannot.
+ */
+static bool nfsd4_read_splice_ok(struct svc_rqst *rqstp)
+{
+	struct nfsd4_compoundres *resp = rqstp->rq_resp;
+	struct nfsd4_compoundargs *argp = rqstp->rq_argp;
+	int i;
+
+	for (i = resp->opcnt; i < argp->opcnt; i++) {
+		if (argp->ops[i].opnum != OP_GETATTR)
+			return false;
+	}
+	return true;
+}
+
 static __be32
 nfsd4_read(struct svc_rqst *rqstp, struct nfsd4_compound_state *cstate,
 	   struct nfsd4_read *read)
@@ -781,9 +801,10 @@ nfsd4_read(struct svc_rqst *rqstp, struct nfsd4_compound_state *cstate,
 	 * following compound.
 	 *
 	 * To ensure proper ordering, we therefore turn off zero copy if
-	 * the client wants us to do more in this compound:
+	 * the client wants us to do anything more in this compound that
+	 * could modify the file:
 	 */
-	if (!nfsd4_last_compound_op(rqstp))
+	if (!nfsd4_read_splice_ok(rqstp))
 		rqstp->rq_splice_ok = false;
 
 	nfs4_lock_state();
@@ -181,7 +181,6 @@ static int process_access_response(struct fsnotify_group *group,
 		return -ENOENT;
 
 	event->response = response;
-	wake_up(&group->fanotify_data.access_waitq);
 
 	return 0;
 }
@@ -317,23 +316,42 @@ static ssize_t fanotify_write(struct file *file, const char __user *buf, size_t
 #ifdef CONFIG_FANOTIFY_ACCESS_PERMISSIONS
 	struct fanotify_response response = { .fd = -1, .response = -1 };
 	struct fsnotify_group *group;
-	int ret;
+	size_t done = 0;
+	int ret = 0;
 
 	group = file->private_data;
 
-	if (count > sizeof(response))
-		count = sizeof(response);
-
 	pr_debug("%s: group=%p count=%zu\n", __func__, group, count);
 
-	if (copy_from_user(&response, buf, count))
-		return -EFAULT;
+	/*
+	 * A write may carry several responses back to back; they are all
+	 * applied, and the waiting processes woken, in one go. A short
+	 * write is treated as a single, partially filled, response as it
+	 * always has been.
+	 */
+	if (count < sizeof(response)) {
+		if (copy_from_user(&response, buf, count))
+			return -EFAULT;
+		ret = process_access_response(group, &response);
+		if (!ret)
+			done = count;
+	}
 
-	ret = process_access_response(group, &response);
-	if (ret < 0)
-		count = ret;
+	while (count - done >= sizeof(response)) {
+		if (copy_from_user(&response, buf + done, sizeof(response))) {
+			ret = -EFAULT;
+			break;
+		}
+		ret = process_access_response(group, &response);
+		if (ret < 0)
+			break;
+		done += sizeof(response);
+	}
+
+	if (done)
+		wake_up(&group->fanotify_data.access_waitq);
 
-	return count;
+	return done ? done : ret;
 #else
 	return -EINVAL;
 #endif
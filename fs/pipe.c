@@ -39,6 +39,13 @@ unsigned int pipe_max_size = 1048576;
  */
 unsigned int pipe_min_size = PAGE_SIZE;
 
+/*
+ * Size up to which a pipe that keeps filling up grows by itself, see
+ * pipe_autogrow(). Zero (the default) disables automatic growth. Can be
+ * set by root in /proc/sys/fs/pipe-autogrow-max
+ */
+int pipe_autogrow_max;
+
 /*
  * We use a start+len construction, which provides full use of the 
  * allocated memory.
@@ -535,7 +542,7 @@ redo2:
 			if (!total_len)
 				break;
 		}
-		if (bufs < pipe->buffers)
+		if (bufs < pipe->buffers || pipe_autogrow(pipe))
 			continue;
 		if (filp->f_flags & O_NONBLOCK) {
 			if (!ret)
@@ -1103,6 +1110,27 @@ static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long nr_pages)
 	return nr_pages * PAGE_SIZE;
 }
 
+/**
+ * pipe_autogrow - double a full pipe's capacity
+ * @pipe:	the pipe that has no free buffer slots
+ *
+ * Description:
+ *	Called with the pipe locked by a writer that found all buffer slots
+ *	in use. A pipe that is filled faster than its reader drains it is
+ *	doubled in size, up to pipe-autogrow-max, so that sustained streams
+ *	(socket -> pipe -> file splicing in particular) stop bouncing
+ *	between a full pipe and a sleeping writer. Returns true if the pipe
+ *	now has free slots.
+ */
+bool pipe_autogrow(struct pipe_inode_info *pipe)
+{
+	unsigned int limit = ACCESS_ONCE(pipe_autogrow_max) >> PAGE_SHIFT;
+
+	if (pipe->buffers * 2 > limit)
+		return false;
+	return pipe_set_size(pipe, pipe->buffers * 2) > 0;
+}
+
 /*
  * Currently we rely on the pipe array holding a power-of-2 number
  * of pages.
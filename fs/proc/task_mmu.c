@@ -686,6 +686,114 @@ const struct file_operations proc_tid_smaps_operations = {
 	.release	= seq_release_private,
 };
 
+/*
+ * smaps_rollup: the smaps counters summed over the whole address space.
+ * The page tables are walked exactly as for smaps, but nothing is printed
+ * per vma, and mmap_sem is dropped between vmas whenever someone else
+ * wants it or we should reschedule, so a huge address space neither
+ * starves writers nor hogs the cpu.
+ */
+static int show_smaps_rollup(struct seq_file *m, void *v)
+{
+	struct task_struct *task;
+	struct mm_struct *mm;
+	struct vm_area_struct *vma;
+	struct mem_size_stats mss;
+	struct mm_walk smaps_walk = {
+		.pmd_entry = smaps_pte_range,
+		.private = &mss,
+	};
+	unsigned long start = 0, last_end = 0;
+	u64 pss_locked = 0;
+
+	task = get_pid_task(m->private, PIDTYPE_PID);
+	if (!task)
+		return -ESRCH;
+	mm = mm_access(task, PTRACE_MODE_READ);
+	put_task_struct(task);
+	if (!mm)
+		return 0;
+	if (IS_ERR(mm))
+		return PTR_ERR(mm);
+
+	memset(&mss, 0, sizeof mss);
+	smaps_walk.mm = mm;
+
+	down_read(&mm->mmap_sem);
+	vma = mm->mmap;
+	if (vma)
+		start = vma->vm_start;
+	while (vma) {
+		unsigned long from = max(vma->vm_start, last_end);
+		u64 pss = mss.pss;
+
+		mss.vma = vma;
+		if (!is_vm_hugetlb_page(vma))
+			walk_page_range(from, vma->vm_end, &smaps_walk);
+		if (vma->vm_flags & VM_LOCKED)
+			pss_locked += mss.pss - pss;
+		last_end = vma->vm_end;
+
+		if (!need_resched() && !rwsem_is_contended(&mm->mmap_sem)) {
+			vma = vma->vm_next;
+			continue;
+		}
+		/*
+		 * The vma we were at may be gone or merged once mmap_sem is
+		 * retaken, so carry on from the first one ending after the
+		 * last address we accounted; 'from' above skips the part of
+		 * it we have already seen.
+		 */
+		up_read(&mm->mmap_sem);
+		cond_resched();
+		down_read(&mm->mmap_sem);
+		vma = find_vma(mm, last_end);
+	}
+	up_read(&mm->mmap_sem);
+	mmput(mm);
+
+	seq_setwidth(m, 25 + sizeof(void *) * 6 - 1);
+	seq_printf(m, "%08lx-%08lx ---p 00000000 00:00 0", start, last_end);
+	seq_pad(m, ' ');
+	seq_puts(m, "[rollup]\n");
+	seq_printf(m,
+		   "Rss:            %8lu kB\n"
+		   "Pss:            %8lu kB\n"
+		   "Shared_Clean:   %8lu kB\n"
+		   "Shared_Dirty:   %8lu kB\n"
+		   "Private_Clean:  %8lu kB\n"
+		   "Private_Dirty:  %8lu kB\n"
+		   "Referenced:     %8lu kB\n"
+		   "Anonymous:      %8lu kB\n"
+		   "AnonHugePages:  %8lu kB\n"
+		   "Swap:           %8lu kB\n"
+		   "Locked:         %8lu kB\n",
+		   mss.resident >> 10,
+		   (unsigned long)(mss.pss >> (10 + PSS_SHIFT)),
+		   mss.shared_clean  >> 10,
+		   mss.shared_dirty  >> 10,
+		   mss.private_clean >> 10,
+		   mss.private_dirty >> 10,
+		   mss.referenced >> 10,
+		   mss.anonymous >> 10,
+		   mss.anonymous_thp >> 10,
+		   mss.swap >> 10,
+		   (unsigned long)(pss_locked >> (10 + PSS_SHIFT)));
+	return 0;
+}
+
+static int smaps_rollup_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, show_smaps_rollup, proc_pid(inode));
+}
+
+const struct file_operations proc_pid_smaps_rollup_operations = {
+	.open		= smaps_rollup_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 /*
  * We do not want to have constant page-shift bits sitting in
  * pagemap entries and are about to reuse them some time soon.
@@ -806,6 +806,81 @@ ssize_t vfs_writev(struct file *file, const struct iovec __user *vec,
 
 EXPORT_SYMBOL(vfs_writev);
 
+/**
+ * vfs_copy_file_range - copy a range of data between two files
+ * @file_in:	source file, open for reading
+ * @pos_in:	offset to copy from
+ * @file_out:	destination file, open for writing
+ * @pos_out:	offset to copy to
+ * @len:	number of bytes to copy
+ * @flags:	must be zero
+ *
+ * Gives the filesystem a chance to do the copy without moving the data
+ * through this host (reflink, server side copy) through
+ * ->copy_file_range, as long as both files share the method. Otherwise,
+ * or when the method returns -EOPNOTSUPP or -EXDEV, falls back to copying
+ * through the page cache with do_splice_direct(). Like read() and write()
+ * this may copy less than @len; the number of bytes copied is returned.
+ */
+ssize_t vfs_copy_file_range(struct file *file_in, loff_t pos_in,
+			    struct file *file_out, loff_t pos_out,
+			    size_t len, unsigned int flags)
+{
+	struct inode *inode_in = file_inode(file_in);
+	struct inode *inode_out = file_inode(file_out);
+	ssize_t ret;
+
+	if (flags != 0)
+		return -EINVAL;
+
+	if (!S_ISREG(inode_in->i_mode) || !S_ISREG(inode_out->i_mode))
+		return -EINVAL;
+	if (!(file_in->f_mode & FMODE_READ) ||
+	    !(file_out->f_mode & FMODE_WRITE) ||
+	    (file_out->f_flags & O_APPEND))
+		return -EBADF;
+
+	if (len > MAX_RW_COUNT)
+		len = MAX_RW_COUNT;
+	ret = rw_verify_area(READ, file_in, &pos_in, len);
+	if (ret < 0)
+		return ret;
+	len = ret;
+	ret = rw_verify_area(WRITE, file_out, &pos_out, len);
+	if (ret < 0)
+		return ret;
+	len = ret;
+
+	if (len == 0)
+		return 0;
+
+	file_start_write(file_out);
+
+	ret = -EOPNOTSUPP;
+	if (file_out->f_op->copy_file_range &&
+	    file_out->f_op->copy_file_range == file_in->f_op->copy_file_range)
+		ret = file_out->f_op->copy_file_range(file_in, pos_in,
+						       file_out, pos_out,
+						       len, flags);
+	if (ret == -EOPNOTSUPP || ret == -EXDEV)
+		ret = do_splice_direct(file_in, &pos_in, file_out, &pos_out,
+				       len, 0);
+
+	if (ret > 0) {
+		fsnotify_access(file_in);
+		add_rchar(current, ret);
+		fsnotify_modify(file_out);
+		add_wchar(current, ret);
+	}
+	inc_syscr(current);
+	inc_syscw(current);
+
+	file_end_write(file_out);
+
+	return ret;
+}
+EXPORT_SYMBOL(vfs_copy_file_range);
+
 SYSCALL_DEFINE3(readv, unsigned long, fd, const struct iovec __user *, vec,
 		unsigned long, vlen)
 {
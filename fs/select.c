@@ -124,6 +124,7 @@ void poll_initwait(struct poll_wqueues *pwq)
 	pwq->error = 0;
 	pwq->table = NULL;
 	pwq->inline_index = 0;
+	pwq->cur_pollfd = NULL;
 }
 EXPORT_SYMBOL(poll_initwait);
 
@@ -212,6 +213,8 @@ static int pollwake(wait_queue_t *wait, unsigned mode, int sync, void *key)
 	entry = container_of(wait, struct poll_table_entry, wait);
 	if (key && !((unsigned long)key & entry->key))
 		return 0;
+	/* Ordered before ->triggered by the smp_wmb() in __pollwake() */
+	entry->woken = 1;
 	return __pollwake(wait, mode, sync, key);
 }
 
@@ -226,6 +229,8 @@ static void __pollwait(struct file *filp, wait_queue_head_t *wait_address,
 	entry->filp = get_file(filp);
 	entry->wait_address = wait_address;
 	entry->key = p->_key;
+	entry->pollfd = pwq->cur_pollfd;
+	entry->woken = 0;
 	init_waitqueue_func_entry(&entry->wait, pollwake);
 	entry->wait.private = pwq;
 	add_wait_queue(wait_address, &entry->wait);
@@ -778,6 +783,51 @@ static inline unsigned int do_pollfd(struct pollfd *pollfd, poll_table *pwait,
 	return mask;
 }
 
+/*
+ * Re-evaluate the pollfd that registered @entry, if the entry's wait queue
+ * fired since we last looked at it. Returns the change in the number of
+ * pollfds with a non-zero revents, so that several entries for the same
+ * pollfd are not counted twice.
+ */
+static int poll_recheck_entry(struct poll_table_entry *entry, poll_table *pt,
+			      struct pollfd **last)
+{
+	struct pollfd *pfd = entry->pollfd;
+	bool can_busy_poll = false;
+	int was_ready;
+
+	if (!xchg(&entry->woken, 0) || !pfd || pfd == *last)
+		return 0;
+	*last = pfd;
+	was_ready = pfd->revents != 0;
+	return (do_pollfd(pfd, pt, &can_busy_poll, 0) != 0) - was_ready;
+}
+
+/*
+ * After the first pass every pollfd either has its waiters registered or
+ * cannot wake us at all, so once we have slept only the pollfds whose
+ * waiters were actually woken need looking at again. This keeps the
+ * wakeup side of a poll() on a large, mostly idle set proportional to
+ * the number of active descriptors rather than to nfds.
+ */
+static int do_poll_woken(struct poll_wqueues *wait)
+{
+	struct poll_table_page *p;
+	struct pollfd *last = NULL;
+	int i, count = 0;
+
+	for (i = 0; i < wait->inline_index; i++)
+		count += poll_recheck_entry(wait->inline_entries + i,
+					    &wait->pt, &last);
+	for (p = wait->table; p; p = p->next) {
+		struct poll_table_entry *entry;
+
+		for (entry = p->entries; entry < p->entry; entry++)
+			count += poll_recheck_entry(entry, &wait->pt, &last);
+	}
+	return count;
+}
+
 static int do_poll(unsigned int nfds,  struct poll_list *list,
 		   struct poll_wqueues *wait, struct timespec *end_time)
 {
@@ -787,6 +837,7 @@ static int do_poll(unsigned int nfds,  struct poll_list *list,
 	unsigned long slack = 0;
 	unsigned int busy_flag = net_busy_loop_on() ? POLL_BUSY_LOOP : 0;
 	unsigned long busy_end = 0;
+	bool rescan_all = true;
 
 	/* Optimise the no-wait case */
 	if (end_time && !end_time->tv_sec && !end_time->tv_nsec) {
@@ -801,12 +852,24 @@ static int do_poll(unsigned int nfds,  struct poll_list *list,
 		struct poll_list *walk;
 		bool can_busy_loop = false;
 
-		for (walk = list; walk != NULL; walk = walk->next) {
+		/*
+		 * A timeout or a signal gets a full final pass, as does
+		 * everything before we first sleep.
+		 */
+		if (!rescan_all && !signal_pending(current)) {
+			count = do_poll_woken(wait);
+			walk = NULL;
+		} else {
+			walk = list;
+		}
+
+		for (; walk != NULL; walk = walk->next) {
 			struct pollfd * pfd, * pfd_end;
 
 			pfd = walk->entries;
 			pfd_end = pfd + walk->len;
 			for (; pfd != pfd_end; pfd++) {
+				wait->cur_pollfd = pfd;
 				/*
 				 * Fish for events. If we found one, record it
 				 * and kill poll_table->_qproc, so we don't
@@ -858,8 +921,11 @@ static int do_poll(unsigned int nfds,  struct poll_list *list,
 			to = &expire;
 		}
 
-		if (!poll_schedule_timeout(wait, TASK_INTERRUPTIBLE, to, slack))
+		rescan_all = false;
+		if (!poll_schedule_timeout(wait, TASK_INTERRUPTIBLE, to, slack)) {
 			timed_out = 1;
+			rescan_all = true;
+		}
 	}
 	return count;
 }
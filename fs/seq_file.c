@@ -10,6 +10,8 @@
 #include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/cred.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
 
 #include <asm/uaccess.h>
 #include <asm/page.h>
@@ -30,6 +32,50 @@ static void seq_set_overflow(struct seq_file *m)
 	m->count = m->size;
 }
 
+/*
+ * Upper bound on the growth of the buffer for readers asking for more than
+ * it holds; a single record larger than the buffer still doubles it.
+ */
+#define SEQ_READ_BUF_MAX	(PAGE_SIZE << 5)
+
+static void *seq_buf_alloc(unsigned long size)
+{
+	void *buf;
+
+	/*
+	 * __GFP_NORETRY to avoid oom-killings with high-order allocations -
+	 * it's better to fall back to vmalloc() than to kill things.
+	 */
+	buf = kmalloc(size, GFP_KERNEL | __GFP_NORETRY | __GFP_NOWARN);
+	if (!buf && size > PAGE_SIZE)
+		buf = vmalloc(size);
+	return buf;
+}
+
+/*
+ * The reader wants @want bytes but the next record does not fit: grow the
+ * buffer, keeping what has been rendered so far.
+ */
+static bool seq_buf_grow(struct seq_file *m, size_t want)
+{
+	size_t size;
+	char *buf;
+
+	if (m->size >= want || m->size >= SEQ_READ_BUF_MAX)
+		return false;
+
+	size = min_t(size_t, m->size << 1, SEQ_READ_BUF_MAX);
+	buf = seq_buf_alloc(size);
+	if (!buf)
+		return false;
+
+	memcpy(buf, m->buf, m->count);
+	kvfree(m->buf);
+	m->buf = buf;
+	m->size = size;
+	return true;
+}
+
 /**
  *	seq_open -	initialize sequential file
  *	@file: file we initialize
@@ -96,7 +142,7 @@ static int traverse(struct seq_file *m, loff_t offset)
 		return 0;
 	}
 	if (!m->buf) {
-		m->buf = kmalloc(m->size = PAGE_SIZE, GFP_KERNEL);
+		m->buf = seq_buf_alloc(m->size = PAGE_SIZE);
 		if (!m->buf)
 			return -ENOMEM;
 	}
@@ -135,9 +181,9 @@ static int traverse(struct seq_file *m, loff_t offset)
 
 Eoverflow:
 	m->op->stop(m, p);
-	kfree(m->buf);
+	kvfree(m->buf);
 	m->count = 0;
-	m->buf = kmalloc(m->size <<= 1, GFP_KERNEL);
+	m->buf = seq_buf_alloc(m->size <<= 1);
 	return !m->buf ? -ENOMEM : -EAGAIN;
 }
 
@@ -192,7 +238,7 @@ ssize_t seq_read(struct file *file, char __user *buf, size_t size, loff_t *ppos)
 
 	/* grab buffer if we didn't have one */
 	if (!m->buf) {
-		m->buf = kmalloc(m->size = PAGE_SIZE, GFP_KERNEL);
+		m->buf = seq_buf_alloc(m->size = PAGE_SIZE);
 		if (!m->buf)
 			goto Enomem;
 	}
@@ -232,9 +278,9 @@ ssize_t seq_read(struct file *file, char __user *buf, size_t size, loff_t *ppos)
 		if (m->count < m->size)
 			goto Fill;
 		m->op->stop(m, p);
-		kfree(m->buf);
+		kvfree(m->buf);
 		m->count = 0;
-		m->buf = kmalloc(m->size <<= 1, GFP_KERNEL);
+		m->buf = seq_buf_alloc(m->size <<= 1);
 		if (!m->buf)
 			goto Enomem;
 		m->version = 0;
@@ -254,9 +300,13 @@ Fill:
 			err = PTR_ERR(p);
 			break;
 		}
+retry:
 		err = m->op->show(m, p);
 		if (seq_overflow(m) || err) {
 			m->count = offs;
+			/* rather than stop short of a big read */
+			if (!err && seq_buf_grow(m, size))
+				goto retry;
 			if (likely(err <= 0))
 				break;
 		}
@@ -350,7 +400,7 @@ EXPORT_SYMBOL(seq_lseek);
 int seq_release(struct inode *inode, struct file *file)
 {
 	struct seq_file *m = file->private_data;
-	kfree(m->buf);
+	kvfree(m->buf);
 	kfree(m);
 	return 0;
 }
@@ -220,7 +220,7 @@ ssize_t splice_to_pipe(struct pipe_inode_info *pipe,
 
 			if (!--spd->nr_pages)
 				break;
-			if (pipe->nrbufs < pipe->buffers)
+			if (pipe->nrbufs < pipe->buffers || pipe_autogrow(pipe))
 				continue;
 
 			break;
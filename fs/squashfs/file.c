@@ -47,6 +47,7 @@
 #include <linux/string.h>
 #include <linux/pagemap.h>
 #include <linux/mutex.h>
+#include <linux/blkdev.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -497,7 +498,59 @@ out:
 	return 0;
 }
 
+static int squashfs_readpages_filler(void *data, struct page *page)
+{
+	return squashfs_readpage(data, page);
+}
+
+/*
+ * Readahead: before decompressing anything, look up all the datablocks
+ * covered by the readahead window and start the device I/O for all of
+ * them under one plug.  The blocks are then decompressed one after the
+ * other by squashfs_readpage(), which now overlaps with the I/O for the
+ * rest of the window instead of waiting for each block in turn.
+ */
+static int squashfs_readpages(struct file *file, struct address_space *mapping,
+	struct list_head *pages, unsigned nr_pages)
+{
+	struct inode *inode = mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int shift = msblk->block_log - PAGE_CACHE_SHIFT;
+	int file_end = i_size_read(inode) >> msblk->block_log;
+	int first = INT_MAX, last = -1, index;
+	struct blk_plug plug;
+	struct page *page;
+
+	list_for_each_entry(page, pages, lru) {
+		index = page->index >> shift;
+		first = min(first, index);
+		last = max(last, index);
+	}
+
+	blk_start_plug(&plug);
+	for (index = first; index <= last; index++) {
+		u64 block = 0;
+		int bsize;
+
+		/* The tail end may live in a fragment, read through the cache */
+		if (index >= file_end && squashfs_i(inode)->fragment_block !=
+						SQUASHFS_INVALID_BLK)
+			break;
+
+		bsize = read_blocklist(inode, index, &block);
+		if (bsize <= 0)
+			continue;
+
+		squashfs_readahead_data(inode->i_sb, block, bsize);
+	}
+	blk_finish_plug(&plug);
+
+	return read_cache_pages(mapping, pages, squashfs_readpages_filler,
+				file);
+}
+
 
 const struct address_space_operations squashfs_aops = {
-	.readpage = squashfs_readpage
+	.readpage = squashfs_readpage,
+	.readpages = squashfs_readpages
 };
@@ -287,6 +287,84 @@ SYSCALL_DEFINE2(newlstat, const char __user *, filename,
 	return cp_new_stat(&stat, statbuf);
 }
 
+/**
+ * vfs_batch_stat - stat many names relative to one directory
+ * @dir: open directory all names are resolved beneath
+ * @argp: user &struct fs_batch_stat describing the batch
+ *
+ * Backs the FIBATCHSTAT ioctl. The directory is pinned once by the
+ * caller's fd for the whole batch, and each name is walked from it as
+ * the lookup root (so absolute names and ".." stay beneath @dir).
+ * Per-name failures are reported through the errors array; only
+ * faults on the argument arrays or a fatal signal fail the call.
+ */
+int vfs_batch_stat(struct file *dir, struct fs_batch_stat __user *argp)
+{
+	const u64 __user *names;
+	struct stat __user *stats;
+	s32 __user *errors;
+	struct fs_batch_stat bs;
+	unsigned int lookup_flags;
+	u32 i;
+
+	if (copy_from_user(&bs, argp, sizeof(bs)))
+		return -EFAULT;
+	if (bs.flags & ~AT_SYMLINK_NOFOLLOW)
+		return -EINVAL;
+	if (!d_can_lookup(dir->f_path.dentry))
+		return -ENOTDIR;
+
+	names = (const u64 __user *)(unsigned long)bs.names;
+	stats = (struct stat __user *)(unsigned long)bs.stats;
+	errors = (s32 __user *)(unsigned long)bs.errors;
+
+	for (i = 0; i < bs.count; i++) {
+		struct filename *name;
+		struct kstat stat;
+		struct path path;
+		u64 uname;
+		int error;
+
+		if (get_user(uname, &names[i]))
+			return -EFAULT;
+
+		name = getname((const char __user *)(unsigned long)uname);
+		if (IS_ERR(name)) {
+			error = PTR_ERR(name);
+			goto report;
+		}
+
+		lookup_flags = bs.flags & AT_SYMLINK_NOFOLLOW ? 0 : LOOKUP_FOLLOW;
+retry:
+		error = vfs_path_lookup(dir->f_path.dentry, dir->f_path.mnt,
+					name->name, lookup_flags, &path);
+		if (!error) {
+			error = vfs_getattr(&path, &stat);
+			path_put(&path);
+			if (retry_estale(error, lookup_flags)) {
+				lookup_flags |= LOOKUP_REVAL;
+				goto retry;
+			}
+		}
+		putname(name);
+
+		if (!error) {
+			/* -EOVERFLOW is per name, only a fault fails the batch */
+			error = cp_new_stat(&stat, &stats[i]);
+			if (error == -EFAULT)
+				return -EFAULT;
+		}
+report:
+		if (put_user(error, &errors[i]))
+			return -EFAULT;
+
+		if (fatal_signal_pending(current))
+			return -EINTR;
+		cond_resched();
+	}
+	return 0;
+}
+
 #if !defined(__ARCH_WANT_STAT64) || defined(__ARCH_WANT_SYS_NEWFSTATAT)
 SYSCALL_DEFINE4(newfstatat, int, dfd, const char __user *, filename,
 		struct stat __user *, statbuf, int, flag)
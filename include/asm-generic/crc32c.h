@@ -0,0 +1,16 @@
+#ifndef __ASM_GENERIC_CRC32C_H
+#define __ASM_GENERIC_CRC32C_H
+
+#include <linux/types.h>
+
+static inline bool arch_crc32c_usable(void)
+{
+	return false;
+}
+
+static inline u32 arch_crc32c(u32 crc, const void *data, unsigned int len)
+{
+	return crc;
+}
+
+#endif /* __ASM_GENERIC_CRC32C_H */
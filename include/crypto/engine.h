@@ -0,0 +1,87 @@
+/*
+ * Crypto engine API
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+#ifndef _CRYPTO_ENGINE_H
+#define _CRYPTO_ENGINE_H
+
+#include <linux/crypto.h>
+#include <linux/kthread.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <crypto/algapi.h>
+
+struct crypto_engine;
+
+/**
+ * struct crypto_engine_ops - hardware hooks of a crypto engine
+ * @do_batch: hand the @n requests on @reqs, which all belong to the same
+ *	transform, to the hardware at once, ringing its doorbell a single
+ *	time. Return 0 once the hardware owns them; each must then be
+ *	completed with crypto_finalize_request() or crypto_finalize_batch().
+ *	On error, none of them was accepted and the engine completes them
+ *	all with the error. Called from the engine's kthread.
+ */
+struct crypto_engine_ops {
+	int (*do_batch)(struct crypto_engine *engine, struct list_head *reqs,
+			unsigned int n);
+};
+
+/**
+ * struct crypto_engine - queue feeding a hardware crypto accelerator
+ * @name: name of the kthread pumping the queue
+ * @queue_lock: protects @queue, @inflight and @running
+ * @queue: requests not yet handed to the hardware
+ * @inflight: requests handed to the hardware and not yet finalized
+ * @max_inflight: depth of the hardware queue; beyond it requests wait in
+ *	@queue, and once that is full too they are refused or backlogged
+ * @max_batch: maximum number of requests passed to one @ops->do_batch()
+ * @running: whether the engine accepts requests
+ * @ops: hardware hooks
+ * @kworker: worker running @pump_requests
+ * @kworker_task: kthread of @kworker
+ * @pump_requests: work moving requests from @queue to the hardware
+ * @priv_data: driver private data
+ */
+struct crypto_engine {
+	const char			*name;
+	spinlock_t			queue_lock;
+	struct crypto_queue		queue;
+	unsigned int			inflight;
+	unsigned int			max_inflight;
+	unsigned int			max_batch;
+	bool				running;
+	const struct crypto_engine_ops	*ops;
+
+	struct kthread_worker		kworker;
+	struct task_struct		*kworker_task;
+	struct kthread_work		pump_requests;
+
+	void				*priv_data;
+};
+
+struct crypto_engine *crypto_engine_alloc_init(const char *name,
+					const struct crypto_engine_ops *ops,
+					unsigned int qlen,
+					unsigned int max_inflight,
+					unsigned int max_batch);
+int crypto_engine_start(struct crypto_engine *engine);
+int crypto_engine_stop(struct crypto_engine *engine);
+void crypto_engine_exit(struct crypto_engine *engine);
+
+int crypto_engine_enqueue(struct crypto_engine *engine,
+			  struct crypto_async_request *req);
+int crypto_engine_enqueue_list(struct crypto_engine *engine,
+			       struct list_head *reqs);
+
+void crypto_finalize_request(struct crypto_engine *engine,
+			     struct crypto_async_request *req, int err);
+void crypto_finalize_batch(struct crypto_engine *engine,
+			   struct list_head *reqs, int err);
+
+#endif /* _CRYPTO_ENGINE_H */
@@ -4,6 +4,7 @@
 #include <linux/blkdev.h>
 
 struct blk_mq_tags;
+struct blk_mq_sched_type;
 
 struct blk_mq_cpu_notifier {
 	struct list_head list;
@@ -11,6 +12,18 @@ struct blk_mq_cpu_notifier {
 	void (*notify)(void *data, unsigned long action, unsigned int cpu);
 };
 
+/*
+ * Latency histograms, kept per cpu. Bucket i counts requests that took
+ * [2^i, 2^(i+1)) usecs, the first one everything under 2 usecs and the
+ * last one everything longer.
+ */
+#define BLK_MQ_LAT_BUCKETS	24
+
+struct blk_mq_lat_stat {
+	unsigned long		queue[BLK_MQ_LAT_BUCKETS];	/* to dispatch */
+	unsigned long		complete[BLK_MQ_LAT_BUCKETS];	/* to completion */
+};
+
 struct blk_mq_hw_ctx {
 	struct {
 		spinlock_t		lock;
@@ -32,15 +45,22 @@ struct blk_mq_hw_ctx {
 	unsigned int 		nr_ctx_map;
 	unsigned long		*ctx_map;
 
-	struct request		**rqs;
-	struct list_head	page_list;
 	struct blk_mq_tags	*tags;
+	atomic_t		nr_active;	/* tags held, if shared */
+
+	struct blk_mq_sched_type *sched;	/* optional, see below */
+	void			*sched_data;
 
 	unsigned long		queued;
 	unsigned long		run;
 #define BLK_MQ_MAX_DISPATCH_ORDER	10
 	unsigned long		dispatched[BLK_MQ_MAX_DISPATCH_ORDER];
 
+	unsigned long		poll_invoked;
+	unsigned long		poll_success;
+
+	struct blk_mq_lat_stat __percpu *lat_stat;
+
 	unsigned int		queue_depth;
 	unsigned int		numa_node;
 	unsigned int		cmd_size;	/* per-request extra data */
@@ -49,6 +69,25 @@ struct blk_mq_hw_ctx {
 	struct kobject		kobj;
 };
 
+/*
+ * Tags and requests shared by several request queues, e.g. all the LUNs
+ * behind one host adapter. Set up by the driver with blk_mq_alloc_tag_set()
+ * and handed to blk_mq_init_queue() through blk_mq_reg->tag_set, which then
+ * takes the queue geometry from here.
+ */
+struct blk_mq_tag_set {
+	unsigned int		nr_hw_queues;
+	unsigned int		queue_depth;	/* per hardware queue */
+	unsigned int		reserved_tags;
+	unsigned int		cmd_size;	/* per-request extra data */
+	int			numa_node;
+
+	struct blk_mq_tags	**tags;
+
+	struct mutex		tag_list_lock;
+	struct list_head	tag_list;	/* queues using this set */
+};
+
 struct blk_mq_reg {
 	struct blk_mq_ops	*ops;
 	unsigned int		nr_hw_queues;
@@ -58,6 +97,9 @@ struct blk_mq_reg {
 	int			numa_node;
 	unsigned int		timeout;
 	unsigned int		flags;		/* BLK_MQ_F_* */
+	struct blk_mq_tag_set	*tag_set;	/* optional, shared tags */
+	/* optional, CPUs of each hw queue, e.g. from pci_irq_get_affinity() */
+	const struct cpumask	*queue_affinity;
 };
 
 typedef int (queue_rq_fn)(struct blk_mq_hw_ctx *, struct request *);
@@ -66,6 +108,7 @@ typedef struct blk_mq_hw_ctx *(alloc_hctx_fn)(struct blk_mq_reg *,unsigned int);
 typedef void (free_hctx_fn)(struct blk_mq_hw_ctx *, unsigned int);
 typedef int (init_hctx_fn)(struct blk_mq_hw_ctx *, void *, unsigned int);
 typedef void (exit_hctx_fn)(struct blk_mq_hw_ctx *, unsigned int);
+typedef int (poll_fn)(struct blk_mq_hw_ctx *);
 
 struct blk_mq_ops {
 	/*
@@ -98,6 +141,39 @@ struct blk_mq_ops {
 	 */
 	init_hctx_fn		*init_hctx;
 	exit_hctx_fn		*exit_hctx;
+
+	/*
+	 * Reap completions on the hardware queue without waiting for an
+	 * interrupt. Returns the number of requests completed.
+	 */
+	poll_fn			*poll;
+};
+
+/*
+ * Optional I/O scheduler sitting between the software queues and the
+ * driver, for devices that care about the order they see requests in
+ * (rotational disks, SMR drives). Requests flushed off the software queues
+ * are handed to ->insert_requests() and pulled back one at a time with
+ * ->dispatch_request() while the driver accepts them. Each hardware queue
+ * gets its own instance, so no queue wide lock is needed. Flush sequence
+ * requests bypass the scheduler.
+ */
+struct blk_mq_sched_ops {
+	int (*init_hctx)(struct blk_mq_hw_ctx *);
+	void (*exit_hctx)(struct blk_mq_hw_ctx *);
+
+	void (*insert_requests)(struct blk_mq_hw_ctx *, struct list_head *);
+	struct request *(*dispatch_request)(struct blk_mq_hw_ctx *);
+	bool (*has_work)(struct blk_mq_hw_ctx *);
+};
+
+#define BLK_MQ_SCHED_NAME_MAX	16
+
+struct blk_mq_sched_type {
+	struct blk_mq_sched_ops	ops;
+	char			name[BLK_MQ_SCHED_NAME_MAX];
+	struct module		*owner;
+	struct list_head	list;
 };
 
 enum {
@@ -108,13 +184,19 @@ enum {
 	BLK_MQ_F_SHOULD_MERGE	= 1 << 0,
 	BLK_MQ_F_SHOULD_SORT	= 1 << 1,
 	BLK_MQ_F_SHOULD_IPI	= 1 << 2,
+	BLK_MQ_F_TAG_SHARED	= 1 << 3,
 
 	BLK_MQ_S_STOPPED	= 0,
+	BLK_MQ_S_TAG_ACTIVE	= 1,
 
 	BLK_MQ_MAX_DEPTH	= 2048,
 };
 
 struct request_queue *blk_mq_init_queue(struct blk_mq_reg *, void *);
+int blk_mq_alloc_tag_set(struct blk_mq_tag_set *set);
+void blk_mq_free_tag_set(struct blk_mq_tag_set *set);
+int blk_mq_sched_register(struct blk_mq_sched_type *);
+void blk_mq_sched_unregister(struct blk_mq_sched_type *);
 int blk_mq_register_disk(struct gendisk *);
 void blk_mq_unregister_disk(struct gendisk *);
 int blk_mq_init_commands(struct request_queue *, int (*init)(void *data, struct blk_mq_hw_ctx *, struct request *, unsigned int), void *data);
@@ -143,6 +225,7 @@ static inline void blk_mq_end_io(struct request *rq, int error)
 }
 
 void blk_mq_complete_request(struct request *rq);
+void blk_mq_complete_request_list(struct list_head *list);
 
 void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx);
 void blk_mq_start_hw_queue(struct blk_mq_hw_ctx *hctx);
@@ -162,11 +245,7 @@ static inline void *blk_mq_rq_to_pdu(struct request *rq)
 	return (void *) rq + sizeof(*rq);
 }
 
-static inline struct request *blk_mq_tag_to_rq(struct blk_mq_hw_ctx *hctx,
-					       unsigned int tag)
-{
-	return hctx->rqs[tag];
-}
+struct request *blk_mq_tag_to_rq(struct blk_mq_hw_ctx *hctx, unsigned int tag);
 
 #define queue_for_each_hw_ctx(q, hctx, i)				\
 	for ((i) = 0; (i) < (q)->nr_hw_queues &&			\
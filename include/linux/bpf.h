@@ -0,0 +1,74 @@
+/*
+ * Key/value maps for internal BPF programs
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ */
+#ifndef _LINUX_BPF_H
+#define _LINUX_BPF_H 1
+
+#include <uapi/linux/bpf.h>
+#include <linux/workqueue.h>
+#include <linux/list.h>
+#include <linux/err.h>
+
+struct bpf_map;
+
+/* map is generic key/value storage optionally accessible by BPF programs */
+struct bpf_map_ops {
+	/* funcs callable from userspace (via /dev/bpf) */
+	struct bpf_map *(*map_alloc)(struct bpf_map_create *attr);
+	void (*map_free)(struct bpf_map *);
+	int (*map_get_next_key)(struct bpf_map *map, void *key, void *next_key);
+
+	/* funcs callable from userspace and from BPF programs */
+	void *(*map_lookup_elem)(struct bpf_map *map, void *key);
+	int (*map_update_elem)(struct bpf_map *map, void *key, void *value,
+			       u64 flags);
+	int (*map_delete_elem)(struct bpf_map *map, void *key);
+};
+
+struct bpf_map {
+	atomic_t refcnt;
+	enum bpf_map_type map_type;
+	u32 key_size;
+	u32 value_size;
+	u32 max_entries;
+	const struct bpf_map_ops *ops;
+	struct work_struct work;
+};
+
+struct bpf_map_type_list {
+	struct list_head list_node;
+	const struct bpf_map_ops *ops;
+	enum bpf_map_type type;
+};
+
+#ifdef CONFIG_BPF_MAPS
+void bpf_register_map_type(struct bpf_map_type_list *tl);
+struct bpf_map *bpf_map_get(int fd);
+void bpf_map_put(struct bpf_map *map);
+
+/*
+ * Helpers for internal BPF programs, invoked through BPF_CALL with
+ * imm = helper - __bpf_call_base. R1 is the struct bpf_map pointer, R2
+ * points to the key and R3 to the value; lookup returns a pointer to
+ * the value or 0, update and delete return 0 or a negative errno. They
+ * must be called under rcu_read_lock(), as filters are.
+ */
+u64 bpf_map_lookup_elem(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5);
+u64 bpf_map_update_elem(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5);
+u64 bpf_map_delete_elem(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5);
+#else
+static inline struct bpf_map *bpf_map_get(int fd)
+{
+	return ERR_PTR(-EOPNOTSUPP);
+}
+
+static inline void bpf_map_put(struct bpf_map *map)
+{
+}
+#endif
+
+#endif /* _LINUX_BPF_H */
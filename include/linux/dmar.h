@@ -146,6 +146,19 @@ struct irte {
 				__reserved_2	: 8,
 				dest_id		: 32;
 		};
+		/* Posted format, see VT-d spec 9.11 */
+		struct {
+			__u64	p_present	: 1,
+				p_fpd		: 1,
+				p_res0		: 6,
+				p_avail		: 4,
+				p_res1		: 2,
+				p_urgent	: 1,
+				p_pst		: 1,
+				p_vector	: 8,
+				p_res2		: 14,
+				pda_l		: 26;
+		};
 		__u64 low;
 	};
 
@@ -156,6 +169,13 @@ struct irte {
 				svt		: 2,
 				__reserved_3	: 44;
 		};
+		struct {
+			__u64	p_sid		: 16,
+				p_sq		: 2,
+				p_svt		: 2,
+				p_res3		: 12,
+				pda_h		: 32;
+		};
 		__u64 high;
 	};
 };
@@ -55,7 +55,7 @@ extern const char *drbd_buildtag(void);
 #define REL_VERSION "8.4.3"
 #define API_VERSION 1
 #define PRO_VERSION_MIN 86
-#define PRO_VERSION_MAX 101
+#define PRO_VERSION_MAX 102
 
 
 enum drbd_io_error_p {
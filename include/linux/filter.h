@@ -71,7 +71,6 @@ struct sock_fprog_kern {
 
 struct sk_buff;
 struct sock;
-struct seccomp_data;
 
 struct sk_filter {
 	atomic_t		refcnt;
@@ -102,14 +101,25 @@ static inline unsigned int sk_filter_size(unsigned int proglen)
 
 int sk_filter(struct sock *sk, struct sk_buff *skb);
 
-u32 sk_run_filter_int_seccomp(const struct seccomp_data *ctx,
-			      const struct sock_filter_int *insni);
+/* Verdicts of a device early RX filter, see netdev_rx_filter_run() */
+#define NET_RX_FILTER_DROP	0
+#define NET_RX_FILTER_PASS	1
+
+struct net_device;
+u32 netdev_rx_filter_run(struct net_device *dev, void *data,
+			 unsigned int len, u16 rx_queue);
+
 u32 sk_run_filter_int_skb(const struct sk_buff *ctx,
 			  const struct sock_filter_int *insni);
 
 int sk_convert_filter(struct sock_filter *prog, int len,
 		      struct sock_filter_int *new_prog, int *new_len);
 
+u64 __bpf_call_base(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5);
+
+void sk_filter_select_runtime(struct sk_filter *fp);
+void sk_filter_free(struct sk_filter *fp);
+
 int sk_unattached_filter_create(struct sk_filter **pfp,
 				struct sock_fprog *fprog);
 void sk_unattached_filter_destroy(struct sk_filter *fp);
@@ -125,6 +135,8 @@ void sk_decode_filter(struct sock_filter *filt, struct sock_filter *to);
 void sk_filter_charge(struct sock *sk, struct sk_filter *fp);
 void sk_filter_uncharge(struct sock *sk, struct sk_filter *fp);
 
+void bpf_int_jit_compile(struct sk_filter *fp);
+
 #ifdef CONFIG_BPF_JIT
 #include <stdarg.h>
 #include <linux/linkage.h>
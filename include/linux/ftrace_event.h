@@ -399,6 +399,7 @@ enum event_trigger_type {
 	ETT_SNAPSHOT		= (1 << 1),
 	ETT_STACKTRACE		= (1 << 2),
 	ETT_EVENT_ENABLE	= (1 << 3),
+	ETT_EVENT_HIST		= (1 << 4),
 };
 
 extern void destroy_preds(struct ftrace_event_file *file);
@@ -617,6 +618,19 @@ extern void perf_trace_del(struct perf_event *event, int flags);
 extern int  ftrace_profile_set_filter(struct perf_event *event, int event_id,
 				     char *filter_str);
 extern void ftrace_profile_free_filter(struct perf_event *event);
+struct sock_fprog;
+#ifdef CONFIG_BPF_EVENTS
+extern int  ftrace_profile_set_bpf(struct perf_event *event,
+				   struct sock_fprog __user *uprog);
+extern void ftrace_profile_free_bpf(struct perf_event *event);
+#else
+static inline int ftrace_profile_set_bpf(struct perf_event *event,
+					 struct sock_fprog __user *uprog)
+{
+	return -EINVAL;
+}
+static inline void ftrace_profile_free_bpf(struct perf_event *event) { }
+#endif
 extern void *perf_trace_buf_prepare(int size, unsigned short type,
 				    struct pt_regs *regs, int *rctxp);
 
@@ -16,6 +16,7 @@
 #include <linux/bitops.h>
 #include <linux/init.h>
 #include <linux/rcupdate.h>
+#include <linux/spinlock_types.h>
 
 /*
  * We want shallower trees and thus more bits covered at each layer.  8
@@ -178,6 +179,23 @@ static inline int ida_get_new(struct ida *ida, int *p_id)
 	return ida_get_new_above(ida, 0, p_id);
 }
 
+/*
+ * An ida with a per-cpu cache of free IDs, for IDs allocated and freed
+ * at high rates. See ida_cache_get().
+ */
+struct ida_cache_cpu;
+
+struct ida_cache {
+	struct ida			ida;
+	spinlock_t			lock;	/* serializes ida */
+	struct ida_cache_cpu __percpu	*cpu;
+};
+
+int ida_cache_init(struct ida_cache *ic);
+void ida_cache_destroy(struct ida_cache *ic);
+int ida_cache_get(struct ida_cache *ic, gfp_t gfp_mask);
+void ida_cache_put(struct ida_cache *ic, int id);
+
 void __init idr_init_cache(void);
 
 #endif /* __IDR_H__ */
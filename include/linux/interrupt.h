@@ -265,6 +265,10 @@ struct irq_affinity_notify {
 extern int
 irq_set_affinity_notifier(unsigned int irq, struct irq_affinity_notify *notify);
 
+extern struct cpumask *irq_create_affinity_masks(int nvec);
+extern int irq_set_managed_affinity(unsigned int irq,
+				    const struct cpumask *mask);
+
 #else /* CONFIG_SMP */
 
 static inline int irq_set_affinity(unsigned int irq, const struct cpumask *m)
@@ -289,8 +293,55 @@ static inline int irq_set_affinity_hint(unsigned int irq,
 {
 	return -EINVAL;
 }
+
+static inline struct cpumask *irq_create_affinity_masks(int nvec)
+{
+	return NULL;
+}
+
+static inline int irq_set_managed_affinity(unsigned int irq,
+					   const struct cpumask *mask)
+{
+	return 0;
+}
 #endif /* CONFIG_SMP */
 
+/**
+ * struct irq_moderation_notify - context for adaptive interrupt moderation
+ * @irq:		Interrupt to which notification applies
+ * @nr_levels:		Number of moderation levels, at least one
+ * @thresholds:		Interrupt rates (per second) at which level i + 1 is
+ *			entered, @nr_levels - 1 increasing entries.  A level
+ *			is left again when the rate drops 25% below its
+ *			threshold.
+ * @level:		Current moderation level, 0 is the least moderated
+ * @rate:		Smoothed interrupt rate, per second
+ * @work:		Work item, for internal use
+ * @notify:		Function to be called when the suggested level
+ *			changes, typically to reprogram the device's
+ *			interrupt coalescing.  This will be called in
+ *			process context.
+ *
+ * The remaining fields are for internal use.
+ */
+struct irq_moderation_notify {
+	unsigned int irq;
+	unsigned int nr_levels;
+	const unsigned int *thresholds;
+	unsigned int level;
+	unsigned int rate;
+	struct work_struct work;
+	void (*notify)(struct irq_moderation_notify *, unsigned int level,
+		       unsigned int rate);
+
+	unsigned int count;
+	unsigned long window_start;
+};
+
+extern int
+irq_set_moderation_notifier(unsigned int irq,
+			    struct irq_moderation_notify *notify);
+
 /*
  * Special lockdep variants of irq disabling/enabling.
  * These should be used for locking constructs that
@@ -345,6 +396,8 @@ static inline void enable_irq_lockdep_irqrestore(unsigned int irq, unsigned long
 /* IRQ wakeup (PM) control: */
 extern int irq_set_irq_wake(unsigned int irq, unsigned int on);
 
+extern int irq_set_vcpu_affinity(unsigned int irq, void *vcpu_info);
+
 static inline int enable_irq_wake(unsigned int irq)
 {
 	return irq_set_irq_wake(irq, 1);
@@ -26,12 +26,28 @@ struct iova {
 	unsigned long	pfn_lo; /* IOMMU dish out addr lo */
 };
 
+/* Ranges of up to 1 << (IOVA_RANGE_CACHE_MAX_SIZE - 1) pages are cached */
+#define IOVA_RANGE_CACHE_MAX_SIZE 6
+#define IOVA_MAX_GLOBAL_MAGS 32
+
+struct iova_magazine;
+struct iova_cpu_rcaches;
+
+/* magazines of freed ranges of one size, shared by all cpus */
+struct iova_rcache {
+	spinlock_t	lock;
+	unsigned int	depot_size;
+	struct iova_magazine *depot[IOVA_MAX_GLOBAL_MAGS];
+};
+
 /* holds all the iova translations for a domain */
 struct iova_domain {
 	spinlock_t	iova_rbtree_lock; /* Lock to protect update of rbtree */
 	struct rb_root	rbroot;		/* iova domain rbtree root */
 	struct rb_node	*cached32_node; /* Save last alloced node */
 	unsigned long	dma_32bit_pfn;
+	struct iova_rcache rcaches[IOVA_RANGE_CACHE_MAX_SIZE];
+	struct iova_cpu_rcaches **cpu_rcaches; /* per cpu, set up on use */
 };
 
 struct iova *alloc_iova_mem(void);
@@ -41,6 +57,10 @@ void __free_iova(struct iova_domain *iovad, struct iova *iova);
 struct iova *alloc_iova(struct iova_domain *iovad, unsigned long size,
 	unsigned long limit_pfn,
 	bool size_aligned);
+unsigned long alloc_iova_fast(struct iova_domain *iovad, unsigned long size,
+	unsigned long limit_pfn, bool flush_rcache);
+void free_iova_fast(struct iova_domain *iovad, unsigned long pfn,
+	unsigned long size);
 struct iova *reserve_iova(struct iova_domain *iovad, unsigned long pfn_lo,
 	unsigned long pfn_hi);
 void copy_reserved_iova(struct iova_domain *from, struct iova_domain *to);
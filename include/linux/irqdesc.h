@@ -9,6 +9,7 @@
  */
 
 struct irq_affinity_notify;
+struct irq_moderation_notify;
 struct proc_dir_entry;
 struct module;
 struct irq_desc;
@@ -30,6 +31,8 @@ struct irq_desc;
  * @lock:		locking for SMP
  * @affinity_hint:	hint to user space for preferred irq affinity
  * @affinity_notify:	context for notification of affinity changes
+ * @managed_affinity:	kernel managed affinity, see irq_set_managed_affinity()
+ * @moderation_notify:	context for adaptive interrupt moderation
  * @pending_mask:	pending rebalanced interrupts
  * @threads_oneshot:	bitfield to handle shared oneshot threads
  * @threads_active:	number of irqaction threads currently running
@@ -57,10 +60,12 @@ struct irq_desc {
 #ifdef CONFIG_SMP
 	const struct cpumask	*affinity_hint;
 	struct irq_affinity_notify *affinity_notify;
+	const struct cpumask	*managed_affinity;
 #ifdef CONFIG_GENERIC_PENDING_IRQ
 	cpumask_var_t		pending_mask;
 #endif
 #endif
+	struct irq_moderation_notify *moderation_notify;
 	unsigned long		threads_oneshot;
 	atomic_t		threads_active;
 	wait_queue_head_t       wait_for_threads;
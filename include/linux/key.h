@@ -340,6 +340,7 @@ extern ctl_table key_sysctls[];
 extern int install_thread_keyring_to_cred(struct cred *cred);
 extern void key_fsuid_changed(struct task_struct *tsk);
 extern void key_fsgid_changed(struct task_struct *tsk);
+extern void keyring_search_cache_forget(const struct cred *cred);
 extern void key_init(void);
 
 #else /* CONFIG_KEYS */
@@ -356,6 +357,7 @@ extern void key_init(void);
 #define is_key_possessed(k)		0
 #define key_fsuid_changed(t)		do { } while(0)
 #define key_fsgid_changed(t)		do { } while(0)
+#define keyring_search_cache_forget(c)	do { } while(0)
 #define key_init()			do { } while(0)
 
 #endif /* CONFIG_KEYS */
@@ -30,6 +30,7 @@
 #include <linux/kvm_para.h>
 
 #include <linux/kvm_types.h>
+#include <linux/kvm_dirty_ring.h>
 
 #include <asm/kvm_host.h>
 
@@ -134,6 +135,7 @@ static inline bool is_error_page(struct page *page)
 #define KVM_REQ_EPR_EXIT          20
 #define KVM_REQ_SCAN_IOAPIC       21
 #define KVM_REQ_GLOBAL_CLOCK_UPDATE 22
+#define KVM_REQ_DIRTY_RING_FULL   23
 
 #define KVM_USERSPACE_IRQ_SOURCE_ID		0
 #define KVM_IRQFD_RESAMPLE_IRQ_SOURCE_ID	1
@@ -153,9 +155,25 @@ struct kvm_io_range {
 
 #define NR_IOBUS_DEVS 1000
 
+/*
+ * Exact-match entry for a doorbell device (an ioeventfd), hashed by
+ * address, length and, unless @wildcard, the data written.  @idx is the
+ * device's index in kvm_io_bus.range[]; @len is 0 for an empty entry.
+ */
+struct kvm_io_doorbell {
+	gpa_t addr;
+	u64 data;
+	int len;
+	bool wildcard;
+	int idx;
+};
+
 struct kvm_io_bus {
 	int dev_count;
 	int ioeventfd_count;
+	/* Open addressed, rebuilt with every copy of the bus; may be NULL */
+	struct kvm_io_doorbell *doorbells;
+	unsigned int doorbell_bits;
 	struct kvm_io_range range[];
 };
 
@@ -236,6 +254,8 @@ struct kvm_vcpu {
 	int sigset_active;
 	sigset_t sigset;
 	struct kvm_vcpu_stat stat;
+	unsigned int halt_poll_ns;
+	struct kvm_dirty_ring dirty_ring;
 
 #ifdef CONFIG_HAS_IOMEM
 	int mmio_needed;
@@ -414,6 +434,8 @@ struct kvm {
 	bool tlbs_dirty;
 
 	struct list_head devices;
+	/* Size in bytes of each vcpu's dirty ring, 0 when not enabled */
+	u32 dirty_ring_size;
 };
 
 #define kvm_err(fmt, ...) \
@@ -606,6 +628,10 @@ int kvm_get_dirty_log(struct kvm *kvm,
 			struct kvm_dirty_log *log, int *is_dirty);
 int kvm_vm_ioctl_get_dirty_log(struct kvm *kvm,
 				struct kvm_dirty_log *log);
+void kvm_arch_mmu_enable_log_dirty_pt_masked(struct kvm *kvm,
+					     struct kvm_memory_slot *slot,
+					     gfn_t gfn_offset,
+					     unsigned long mask);
 
 int kvm_vm_ioctl_irq_line(struct kvm *kvm, struct kvm_irq_level *irq_level,
 			bool line_status);
@@ -688,6 +714,11 @@ static inline bool kvm_arch_has_noncoherent_dma(struct kvm *kvm)
 }
 #endif
 
+#ifdef CONFIG_HAVE_KVM_IRQ_BYPASS
+int kvm_arch_update_irqfd_routing(struct kvm *kvm, unsigned int host_irq,
+				  uint32_t guest_irq, bool set);
+#endif
+
 static inline wait_queue_head_t *kvm_arch_vcpu_wq(struct kvm_vcpu *vcpu)
 {
 #ifdef __KVM_HAVE_ARCH_WQP
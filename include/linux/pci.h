@@ -354,6 +354,7 @@ struct pci_dev {
 #ifdef CONFIG_PCI_MSI
 	struct list_head msi_list;
 	const struct attribute_group **msi_irq_groups;
+	struct cpumask *msix_affinity;	/* per vector masks, see pci_enable_msix_spread() */
 #endif
 	struct pci_vpd *vpd;
 #ifdef CONFIG_PCI_ATS
@@ -1186,6 +1187,9 @@ static inline int pci_enable_msix_exact(struct pci_dev *dev,
 		return rc;
 	return 0;
 }
+int pci_enable_msix_spread(struct pci_dev *dev, struct msix_entry *entries,
+			   int minvec, int maxvec);
+const struct cpumask *pci_irq_get_affinity(struct pci_dev *dev, int nr);
 #else
 static inline int pci_msi_vec_count(struct pci_dev *dev) { return -ENOSYS; }
 static inline int pci_enable_msi_block(struct pci_dev *dev, int nvec)
@@ -1212,6 +1216,12 @@ static inline int pci_enable_msix_range(struct pci_dev *dev,
 static inline int pci_enable_msix_exact(struct pci_dev *dev,
 		      struct msix_entry *entries, int nvec)
 { return -ENOSYS; }
+static inline int pci_enable_msix_spread(struct pci_dev *dev,
+		      struct msix_entry *entries, int minvec, int maxvec)
+{ return -ENOSYS; }
+static inline const struct cpumask *pci_irq_get_affinity(struct pci_dev *dev,
+							 int nr)
+{ return NULL; }
 #endif
 
 #ifdef CONFIG_PCIEPORTBUS
@@ -288,6 +288,7 @@ struct swevent_hlist {
 
 struct perf_cgroup;
 struct ring_buffer;
+struct sk_filter;
 
 /**
  * struct perf_event - performance event kernel representation:
@@ -421,12 +422,18 @@ struct perf_event {
 	struct pid_namespace		*ns;
 	u64				id;
 
+	/* callchains already output, with attr.callchain_id */
+	atomic64_t			*callchain_ids;
+
 	perf_overflow_handler_t		overflow_handler;
 	void				*overflow_handler_context;
 
 #ifdef CONFIG_EVENT_TRACING
 	struct ftrace_event_call	*tp_event;
 	struct event_filter		*filter;
+#ifdef CONFIG_BPF_EVENTS
+	struct sk_filter		*bpf_filter;
+#endif
 #ifdef CONFIG_FUNCTION_TRACER
 	struct ftrace_ops               ftrace_ops;
 #endif
@@ -580,6 +587,7 @@ struct perf_sample_data {
 	u64				period;
 	union  perf_mem_data_src	data_src;
 	struct perf_callchain_entry	*callchain;
+	u64				callchain_id;
 	struct perf_raw_record		*raw;
 	struct perf_branch_stack	*br_stack;
 	struct perf_regs_user		regs_user;
@@ -123,6 +123,8 @@ void pipe_unlock(struct pipe_inode_info *);
 void pipe_double_lock(struct pipe_inode_info *, struct pipe_inode_info *);
 
 extern unsigned int pipe_max_size, pipe_min_size;
+extern int pipe_autogrow_max;
+bool pipe_autogrow(struct pipe_inode_info *pipe);
 int pipe_proc_fn(struct ctl_table *, int, void __user *, size_t *, loff_t *);
 
 
@@ -77,6 +77,8 @@ struct poll_table_entry {
 	unsigned long key;
 	wait_queue_t wait;
 	wait_queue_head_t *wait_address;
+	struct pollfd *pollfd;		/* poll() entry that registered us */
+	int woken;
 };
 
 /*
@@ -89,6 +91,7 @@ struct poll_wqueues {
 	int triggered;
 	int error;
 	int inline_index;
+	struct pollfd *cur_pollfd;
 	struct poll_table_entry inline_entries[N_INLINE_POLL_ENTRIES];
 };
 
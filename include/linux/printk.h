@@ -147,6 +147,7 @@ extern int dmesg_restrict;
 extern int kptr_restrict;
 
 extern void wake_up_klogd(void);
+extern void printk_stage_flush_all(void);
 
 void log_buf_kexec_setup(void);
 void __init setup_log_buf(int early);
@@ -183,6 +184,10 @@ static inline void wake_up_klogd(void)
 {
 }
 
+static inline void printk_stage_flush_all(void)
+{
+}
+
 static inline void log_buf_kexec_setup(void)
 {
 }
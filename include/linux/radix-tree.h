@@ -99,8 +99,13 @@ struct radix_tree_node {
 	};
 	/* For tree user */
 	struct list_head private_list;
-	void __rcu	*slots[RADIX_TREE_MAP_SIZE];
+	/*
+	 * The tags share the cacheline of the fields above, so a tagged
+	 * lookup only touches the slots it follows; nodes are cacheline
+	 * aligned and on 64-bit the slots start on a cacheline of their own.
+	 */
 	unsigned long	tags[RADIX_TREE_MAX_TAGS][RADIX_TREE_TAG_LONGS];
+	void __rcu	*slots[RADIX_TREE_MAP_SIZE];
 };
 
 /* root tags are stored in gfp_mask, shifted by __GFP_BITS_SHIFT */
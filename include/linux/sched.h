@@ -921,6 +921,9 @@ struct sched_domain {
 	u64 max_newidle_lb_cost;
 	unsigned long next_decay_max_lb_cost;
 
+	/* select_idle_sibling() stats */
+	u64 avg_scan_cost;		/* ns, of one select_idle_cpu() scan */
+
 #ifdef CONFIG_SCHEDSTATS
 	/* load_balance() stats */
 	unsigned int lb_count[CPU_MAX_IDLE_TYPES];
@@ -1166,6 +1169,32 @@ struct sched_dl_entity {
 
 struct rcu_node;
 
+/*
+ * Wake-queues are lists of tasks with a pending wakeup, whose callers have
+ * already done the work to ensure that the wakeups are correct: tasks are
+ * queued while holding a lock and woken once it is dropped, so they don't
+ * immediately contend on it.
+ *
+ * A task can only be on one wake-queue at a time: wake_q_add() does
+ * nothing if it is already queued, the pending wakeup covers it.
+ */
+struct wake_q_node {
+	struct wake_q_node *next;
+};
+
+struct wake_q_head {
+	struct wake_q_node *first;
+	struct wake_q_node **lastp;
+};
+
+#define WAKE_Q_TAIL ((struct wake_q_node *) 0x01)
+
+#define WAKE_Q(name)					\
+	struct wake_q_head name = { WAKE_Q_TAIL, &name.first }
+
+extern void wake_q_add(struct wake_q_head *head, struct task_struct *task);
+extern void wake_up_q(struct wake_q_head *head);
+
 enum perf_event_task_context {
 	perf_invalid_context = -1,
 	perf_hw_context = 0,
@@ -1386,6 +1415,8 @@ struct task_struct {
 	/* Protection of the PI data structures: */
 	raw_spinlock_t pi_lock;
 
+	struct wake_q_node wake_q;
+
 #ifdef CONFIG_RT_MUTEXES
 	/* PI waiters blocked on a rt_mutex held by this task */
 	struct rb_root pi_waiters;
@@ -203,6 +203,14 @@ struct rpc_xprt {
 	u32			xid;		/* Next XID value to use */
 	struct rpc_task *	snd_task;	/* Task blocked in send */
 	struct svc_xprt		*bc_xprt;	/* NFSv4.1 backchannel */
+
+	/*
+	 * Additional connections to the same server. Set up before
+	 * the owning rpc_clnt is visible, read-only afterwards.
+	 */
+	struct rpc_xprt **	peers;
+	unsigned int		npeers;
+	atomic_t		peer_rr;	/* round-robin cursor */
 #if defined(CONFIG_SUNRPC_BACKCHANNEL)
 	struct svc_serv		*bc_serv;       /* The RPC service which will */
 						/* process the callback */
@@ -281,6 +289,9 @@ struct xprt_class {
  * Generic internal transport functions
  */
 struct rpc_xprt		*xprt_create_transport(struct xprt_create *args);
+unsigned int		xprt_add_peers(struct rpc_xprt *xprt,
+				       struct xprt_create *args,
+				       unsigned int n);
 void			xprt_connect(struct rpc_task *task);
 void			xprt_reserve(struct rpc_task *task);
 void			xprt_retry_reserve(struct rpc_task *task);
@@ -162,6 +162,7 @@ static inline u64 get_cpu_iowait_time_us(int cpu, u64 *unused) { return -1; }
 #ifdef CONFIG_NO_HZ_FULL
 extern bool tick_nohz_full_running;
 extern cpumask_var_t tick_nohz_full_mask;
+extern cpumask_var_t housekeeping_mask;
 
 static inline bool tick_nohz_full_enabled(void)
 {
@@ -179,6 +180,31 @@ static inline bool tick_nohz_full_cpu(int cpu)
 	return cpumask_test_cpu(cpu, tick_nohz_full_mask);
 }
 
+/*
+ * Housekeeping CPUs are the ones outside nohz_full=.  They keep the
+ * periodic per-CPU work (unbound timers and works, kthreads, lockup
+ * detectors) that would otherwise break into the full dynticks CPUs.
+ */
+static inline const struct cpumask *housekeeping_cpumask(void)
+{
+	if (tick_nohz_full_enabled())
+		return housekeeping_mask;
+	return cpu_possible_mask;
+}
+
+static inline int housekeeping_any_cpu(void)
+{
+	return cpumask_any_and(housekeeping_mask, cpu_online_mask);
+}
+
+static inline bool is_housekeeping_cpu(int cpu)
+{
+	if (tick_nohz_full_enabled())
+		return cpumask_test_cpu(cpu, housekeeping_mask);
+	return true;
+}
+
+extern void housekeeping_affine(struct task_struct *t);
 extern void tick_nohz_init(void);
 extern void __tick_nohz_full_check(void);
 extern void tick_nohz_full_kick(void);
@@ -188,6 +214,13 @@ extern void __tick_nohz_task_switch(struct task_struct *tsk);
 static inline void tick_nohz_init(void) { }
 static inline bool tick_nohz_full_enabled(void) { return false; }
 static inline bool tick_nohz_full_cpu(int cpu) { return false; }
+static inline const struct cpumask *housekeeping_cpumask(void)
+{
+	return cpu_possible_mask;
+}
+static inline int housekeeping_any_cpu(void) { return smp_processor_id(); }
+static inline bool is_housekeeping_cpu(int cpu) { return true; }
+static inline void housekeeping_affine(struct task_struct *t) { }
 static inline void __tick_nohz_full_check(void) { }
 static inline void tick_nohz_full_kick(void) { }
 static inline void tick_nohz_full_kick_all(void) { }
@@ -22,6 +22,7 @@ struct timer_list {
 	unsigned long data;
 
 	int slack;
+	unsigned int idx;	/* wheel bucket, valid while pending */
 
 #ifdef CONFIG_TIMER_STATS
 	int start_pid;
@@ -26,6 +26,7 @@
 
 #include <linux/errno.h>
 #include <linux/rbtree.h>
+#include <linux/spinlock_types.h>
 #include <linux/types.h>
 
 struct vm_area_struct;
@@ -93,8 +94,14 @@ struct uprobe_task {
 
 struct xol_area;
 
+#define UPROBES_CACHE_BITS		3
+#define UPROBES_CACHE_SIZE		(1 << UPROBES_CACHE_BITS)
+
 struct uprobes_state {
 	struct xol_area		*xol_area;
+	/* recently hit uprobes, indexed by hash of the probed vaddr */
+	spinlock_t		cache_lock;
+	struct uprobe		*cache[UPROBES_CACHE_SIZE];
 };
 
 extern int __weak set_swbp(struct arch_uprobe *aup, struct mm_struct *mm, unsigned long vaddr);
@@ -118,6 +125,7 @@ extern int uprobe_pre_sstep_notifier(struct pt_regs *regs);
 extern void uprobe_notify_resume(struct pt_regs *regs);
 extern bool uprobe_deny_signal(void);
 extern bool arch_uprobe_skip_sstep(struct arch_uprobe *aup, struct pt_regs *regs);
+extern void uprobe_init_state(struct mm_struct *mm);
 extern void uprobe_clear_state(struct mm_struct *mm);
 extern int  arch_uprobe_analyze_insn(struct arch_uprobe *aup, struct mm_struct *mm, unsigned long addr);
 extern int  arch_uprobe_pre_xol(struct arch_uprobe *aup, struct pt_regs *regs);
@@ -175,6 +183,9 @@ static inline void uprobe_free_utask(struct task_struct *t)
 static inline void uprobe_copy_process(struct task_struct *t, unsigned long flags)
 {
 }
+static inline void uprobe_init_state(struct mm_struct *mm)
+{
+}
 static inline void uprobe_clear_state(struct mm_struct *mm)
 {
 }
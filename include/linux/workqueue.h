@@ -320,6 +320,17 @@ enum {
 	 */
 	WQ_POWER_EFFICIENT	= 1 << 7,
 
+	/*
+	 * Work items of WQ_BATCH workqueues form a separate class inside
+	 * the worker_pool they are queued on.  They are only started when
+	 * no regular work item is pending on the pool, so bulk work such
+	 * as writeback or encryption never delays latency critical work
+	 * sharing the pool, and an unbound pool executes at most one batch
+	 * work item per CPU in its cpumask at any time instead of spawning
+	 * a worker for each of them.
+	 */
+	WQ_BATCH		= 1 << 8,
+
 	__WQ_DRAINING		= 1 << 16, /* internal: workqueue is draining */
 	__WQ_ORDERED		= 1 << 17, /* internal: workqueue is ordered */
 
@@ -448,6 +459,8 @@ int apply_workqueue_attrs(struct workqueue_struct *wq,
 
 extern bool queue_work_on(int cpu, struct workqueue_struct *wq,
 			struct work_struct *work);
+extern int queue_work_batch_on(int cpu, struct workqueue_struct *wq,
+			struct work_struct **works, int nr_works);
 extern bool queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 			struct delayed_work *work, unsigned long delay);
 extern bool mod_delayed_work_on(int cpu, struct workqueue_struct *wq,
@@ -492,6 +505,23 @@ static inline bool queue_work(struct workqueue_struct *wq,
 	return queue_work_on(WORK_CPU_UNBOUND, wq, work);
 }
 
+/**
+ * queue_work_batch - queue a batch of works on a workqueue
+ * @wq: workqueue to use
+ * @works: array of works to queue
+ * @nr_works: number of entries in @works
+ *
+ * Returns the number of works which weren't already on a queue and
+ * got queued.
+ *
+ * See queue_work() and queue_work_batch_on().
+ */
+static inline int queue_work_batch(struct workqueue_struct *wq,
+				   struct work_struct **works, int nr_works)
+{
+	return queue_work_batch_on(WORK_CPU_UNBOUND, wq, works, nr_works);
+}
+
 /**
  * queue_delayed_work - queue work on a workqueue after delay
  * @wq: workqueue to use
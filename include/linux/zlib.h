@@ -494,11 +494,9 @@ extern int deflateInit2 (z_streamp strm,
    not perform any compression: this will be done by deflate().
 */
                             
-#if 0
 extern int zlib_deflateSetDictionary (z_streamp strm,
 						     const Byte *dictionary,
 						     uInt  dictLength);
-#endif
 /*
      Initializes the compression dictionary from the given byte sequence
    without producing any compressed output. This function must be called
@@ -532,6 +530,26 @@ extern int zlib_deflateSetDictionary (z_streamp strm,
    perform any compression: this will be done by deflate().
 */
 
+extern int zlib_deflate_parallel (Byte *out, uLong *out_len,
+				  const Byte *in, uLong in_len,
+				  int level, int windowBits, int memLevel);
+/*
+     Compresses in_len bytes at in into out, whose size is *out_len, using
+   several CPUs. The input is split into blocks of 128K that are compressed
+   as independent raw deflate streams, each primed with the window's worth
+   of input preceding it as a dictionary, and concatenated. The result is a
+   single valid stream, zlib wrapped unless windowBits is negative as for
+   deflateInit2, that compresses almost as well as a serial deflate.
+
+     This function allocates its workspaces and may sleep while the blocks
+   are compressed by the unbound workqueue, so it is meant for large jobs
+   from process context.
+
+     zlib_deflate_parallel returns Z_OK and sets *out_len to the compressed
+   size if success, Z_BUF_ERROR if out is too small, Z_MEM_ERROR if there
+   was not enough memory, or Z_STREAM_ERROR if a parameter is invalid.
+*/
+
 #if 0
 extern int zlib_deflateCopy (z_streamp dest, z_streamp source);
 #endif
@@ -117,6 +117,34 @@ out:
 	return rc;
 }
 
+/* poll the NAPI context napi_id once, for users not tied to one socket
+ * (epoll). Returns the number of packets processed or LL_FLUSH_*.
+ */
+static inline int napi_busy_loop_once(unsigned int napi_id)
+{
+	const struct net_device_ops *ops;
+	struct napi_struct *napi;
+	int rc = LL_FLUSH_FAILED;
+
+	rcu_read_lock_bh();
+
+	napi = napi_by_id(napi_id);
+	if (!napi)
+		goto out;
+
+	ops = napi->dev->netdev_ops;
+	if (!ops->ndo_busy_poll)
+		goto out;
+
+	rc = ops->ndo_busy_poll(napi);
+	if (rc > 0)
+		NET_ADD_STATS_BH(dev_net(napi->dev),
+				 LINUX_MIB_BUSYPOLLRXPACKETS, rc);
+out:
+	rcu_read_unlock_bh();
+	return rc;
+}
+
 /* used in the NIC receive handler to mark the skb */
 static inline void skb_mark_napi_id(struct sk_buff *skb,
 				    struct napi_struct *napi)
@@ -13,6 +13,16 @@ struct flow_keys {
 	u8 ip_proto;
 };
 
-bool skb_flow_dissect(const struct sk_buff *skb, struct flow_keys *flow);
+/* Do not read the transport ports, callers only want addresses/thoff */
+#define FLOW_DISSECTOR_F_STOP_AT_L3	0x1
+
+bool __skb_flow_dissect(const struct sk_buff *skb, struct flow_keys *flow,
+			unsigned int flags);
+
+static inline bool skb_flow_dissect(const struct sk_buff *skb,
+				    struct flow_keys *flow)
+{
+	return __skb_flow_dissect(skb, flow, 0);
+}
 __be32 skb_flow_get_ports(const struct sk_buff *skb, int thoff, u8 ip_proto);
 #endif
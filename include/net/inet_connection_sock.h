@@ -207,6 +207,22 @@ static inline void inet_csk_clear_xmit_timer(struct sock *sk, const int what)
 #endif
 }
 
+/*
+ *	Re-arm lazily: if the timer is already due to fire no later than the
+ *	new deadline (which the caller has stored in the socket), leave it
+ *	alone. The expiry handlers see the deadline is still in the future
+ *	and re-arm from there, which costs one extra expiry per timeout
+ *	period instead of a mod_timer() on every ACK that pushes it back.
+ */
+static inline void inet_csk_reset_timer_lazy(struct sock *sk,
+					     struct timer_list *timer,
+					     unsigned long expires)
+{
+	if (timer_pending(timer) && !time_after(timer->expires, expires))
+		return;
+	sk_reset_timer(sk, timer, expires);
+}
+
 /*
  *	Reset the retransmission timer
  */
@@ -228,11 +244,13 @@ static inline void inet_csk_reset_xmit_timer(struct sock *sk, const int what,
 	    what == ICSK_TIME_EARLY_RETRANS || what ==  ICSK_TIME_LOSS_PROBE) {
 		icsk->icsk_pending = what;
 		icsk->icsk_timeout = jiffies + when;
-		sk_reset_timer(sk, &icsk->icsk_retransmit_timer, icsk->icsk_timeout);
+		inet_csk_reset_timer_lazy(sk, &icsk->icsk_retransmit_timer,
+					  icsk->icsk_timeout);
 	} else if (what == ICSK_TIME_DACK) {
 		icsk->icsk_ack.pending |= ICSK_ACK_TIMER;
 		icsk->icsk_ack.timeout = jiffies + when;
-		sk_reset_timer(sk, &icsk->icsk_delack_timer, icsk->icsk_ack.timeout);
+		inet_csk_reset_timer_lazy(sk, &icsk->icsk_delack_timer,
+					  icsk->icsk_ack.timeout);
 	}
 #ifdef INET_CSK_DEBUG
 	else {
@@ -251,6 +251,8 @@ void inet_put_port(struct sock *sk);
 void inet_hashinfo_init(struct inet_hashinfo *h);
 
 int __inet_hash_nolisten(struct sock *sk, struct inet_timewait_sock *tw);
+bool inet_rcv_saddr_same(const struct sock *sk, const struct sock *sk2);
+int inet_reuseport_add_sock(struct sock *sk, struct inet_listen_hashbucket *ilb);
 void inet_hash(struct sock *sk);
 void inet_unhash(struct sock *sk);
 
@@ -328,6 +330,10 @@ struct sock *__inet_lookup_established(struct net *net,
 				       const __be32 daddr, const u16 hnum,
 				       const int dif);
 
+void inet_ehash_prefetch(struct net *net, struct inet_hashinfo *hashinfo,
+			 const __be32 saddr, const __be16 sport,
+			 const __be32 daddr, const u16 hnum);
+
 static inline struct sock *
 	inet_lookup_established(struct net *net, struct inet_hashinfo *hashinfo,
 				const __be32 saddr, const __be16 sport,
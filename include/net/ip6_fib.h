@@ -109,6 +109,9 @@ struct rt6_info {
 
 	atomic_t			rt6i_ref;
 
+	/* Per-CPU copies handed out by forwarding lookups of this route. */
+	struct rt6_info __percpu	**rt6i_pcpu;
+
 	/* These are in a separate cache line. */
 	struct rt6key			rt6i_dst ____cacheline_aligned_in_smp;
 	u32				rt6i_flags;
@@ -291,6 +294,8 @@ int fib6_del(struct rt6_info *rt, struct nl_info *info);
 
 void inet6_rt_notify(int event, struct rt6_info *rt, struct nl_info *info);
 
+void rt6_free_pcpu(struct rt6_info *rt);
+
 void fib6_run_gc(unsigned long expires, struct net *net, bool force);
 
 void fib6_gc_cleanup(void);
@@ -189,6 +189,9 @@ struct fib_table {
 
 int fib_table_lookup(struct fib_table *tb, const struct flowi4 *flp,
 		     struct fib_result *res, int fib_flags);
+void fib_table_lookup_batch(struct fib_table *tb, const struct flowi4 *flp,
+			    struct fib_result *res, int *err, unsigned int n,
+			    int fib_flags);
 int fib_table_insert(struct fib_table *, struct fib_config *);
 int fib_table_delete(struct fib_table *, struct fib_config *);
 int fib_table_dump(struct fib_table *table, struct sk_buff *skb,
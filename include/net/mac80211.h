@@ -3193,6 +3193,23 @@ void ieee80211_napi_add(struct ieee80211_hw *hw, struct napi_struct *napi,
  */
 void ieee80211_rx(struct ieee80211_hw *hw, struct sk_buff *skb);
 
+/**
+ * ieee80211_rx_list - receive a batch of frames
+ *
+ * Like ieee80211_rx() but takes all frames the driver has collected,
+ * e.g. in one NAPI poll. An A-MPDU typically arrives as a run of frames
+ * from the same station and TID; handing them over together lets
+ * mac80211 pass the resulting data frames up to the network stack in
+ * one go, after its own RX locks have been dropped.
+ *
+ * The same calling constraints as for ieee80211_rx() apply.
+ *
+ * @hw: the hardware the frames came in on
+ * @skbs: the frames to receive, owned by mac80211 after this call;
+ *	the list is empty on return
+ */
+void ieee80211_rx_list(struct ieee80211_hw *hw, struct sk_buff_head *skbs);
+
 /**
  * ieee80211_rx_irqsafe - receive frame
  *
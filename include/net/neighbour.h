@@ -131,7 +131,7 @@ struct neigh_statistics {
 #define NEIGH_CACHE_STAT_INC(tbl, field) this_cpu_inc((tbl)->stats->field)
 
 struct neighbour {
-	struct neighbour __rcu	*next;
+	/* written by the state machine, timers and slow path users */
 	struct neigh_table	*tbl;
 	struct neigh_parms	*parms;
 	unsigned long		confirmed;
@@ -144,16 +144,23 @@ struct neighbour {
 	unsigned long		used;
 	atomic_t		probes;
 	__u8			flags;
-	__u8			nud_state;
 	__u8			type;
 	__u8			dead;
-	seqlock_t		ha_lock;
-	unsigned char		ha[ALIGN(MAX_ADDR_LEN, sizeof(unsigned long))];
-	struct hh_cache		hh;
-	int			(*output)(struct neighbour *, struct sk_buff *);
 	const struct neigh_ops	*ops;
 	struct rcu_head		rcu;
+
+	/* read by the RCU lookup and output of every packet : kept together
+	 * with primary_key, away from the refcnt, lock and timer above.  Not
+	 * cacheline aligned, as the padding would move primary_key off the
+	 * end of the structure, where entry_size and dn_neigh expect it.
+	 */
+	struct neighbour __rcu	*next;
 	struct net_device	*dev;
+	int			(*output)(struct neighbour *, struct sk_buff *);
+	__u8			nud_state;
+	seqlock_t		ha_lock;
+	unsigned char		ha[ALIGN(MAX_ADDR_LEN, sizeof(unsigned long))];
+	struct hh_cache		hh;
 	u8			primary_key[0];
 };
 
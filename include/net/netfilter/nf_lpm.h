@@ -0,0 +1,59 @@
+#ifndef _NF_LPM_H
+#define _NF_LPM_H
+
+#include <linux/types.h>
+#include <linux/rcupdate.h>
+
+/*
+ * Path compressed binary trie keyed by bit strings of up to
+ * max_prefixlen bits, stored most significant bit first (network byte
+ * order for addresses). Lookups run under rcu_read_lock(); updates must
+ * be serialized by the caller.
+ */
+
+#define NF_LPM_NODE_INTERMEDIATE	0x1
+
+struct nf_lpm_node {
+	struct nf_lpm_node __rcu	*child[2];
+	struct rcu_head			rcu;
+	u32				prefixlen;
+	u32				flags;
+	u8				data[]
+		__attribute__((aligned(__alignof__(u64))));
+};
+
+struct nf_lpm_trie {
+	struct nf_lpm_node __rcu	*root;
+	unsigned int			n_entries;
+	unsigned int			max_prefixlen;
+	unsigned int			data_size;
+	unsigned int			value_size;
+};
+
+int nf_lpm_init(struct nf_lpm_trie *trie, unsigned int key_len,
+		unsigned int value_size);
+void nf_lpm_destroy(struct nf_lpm_trie *trie,
+		    void (*destroy)(void *value, void *arg), void *arg);
+
+int nf_lpm_insert(struct nf_lpm_trie *trie, const u8 *key,
+		  unsigned int prefixlen, const void *value, gfp_t gfp);
+int nf_lpm_delete(struct nf_lpm_trie *trie, const u8 *key,
+		  unsigned int prefixlen);
+
+void *nf_lpm_lookup(const struct nf_lpm_trie *trie, const u8 *key);
+void *nf_lpm_lookup_exact(const struct nf_lpm_trie *trie, const u8 *key,
+			  unsigned int prefixlen);
+void *nf_lpm_lookup_le(const struct nf_lpm_trie *trie, const u8 *key);
+
+int nf_lpm_walk(const struct nf_lpm_trie *trie,
+		int (*fn)(const u8 *key, unsigned int prefixlen,
+			  void *value, void *arg),
+		void *arg, gfp_t gfp);
+
+static inline void *nf_lpm_value(const struct nf_lpm_trie *trie,
+				 const struct nf_lpm_node *node)
+{
+	return (void *)node->data + trie->data_size;
+}
+
+#endif /* _NF_LPM_H */
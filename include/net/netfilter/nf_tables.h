@@ -145,6 +145,19 @@ struct nft_set_iter {
 			      const struct nft_set_elem *elem);
 };
 
+/**
+ *	enum nft_set_class - performance class of a set implementation
+ *
+ *	@NFT_SET_CLASS_O_1: constant lookup time, independent of set size
+ *	@NFT_SET_CLASS_O_LOG_N: lookup time logarithmic in the set size
+ *	@NFT_SET_CLASS_O_N: lookup time linear in the set size
+ */
+enum nft_set_class {
+	NFT_SET_CLASS_O_1,
+	NFT_SET_CLASS_O_LOG_N,
+	NFT_SET_CLASS_O_N,
+};
+
 /**
  *	struct nft_set_ops - nf_tables set operations
  *
@@ -158,6 +171,7 @@ struct nft_set_iter {
  *	@list: nf_tables_set_ops list node
  *	@owner: module reference
  *	@features: features supported by the implementation
+ *	@class: lookup performance class, used to pick an implementation
  */
 struct nft_set_ops {
 	bool				(*lookup)(const struct nft_set *set,
@@ -181,6 +195,7 @@ struct nft_set_ops {
 	struct list_head		list;
 	struct module			*owner;
 	u32				features;
+	enum nft_set_class		class;
 };
 
 int nft_register_set(struct nft_set_ops *ops);
@@ -328,6 +343,7 @@ static inline void *nft_expr_priv(const struct nft_expr *expr)
  *	@genmask: generation mask
  *	@dlen: length of expression data
  *	@ulen: length of user data (used for comments)
+ *	@prog: JITed internal BPF version of the expressions (optional)
  *	@data: expression data
  */
 struct nft_rule {
@@ -336,6 +352,7 @@ struct nft_rule {
 					genmask:2,
 					dlen:12,
 					ulen:8;
+	struct sk_filter		*prog;
 	unsigned char			data[]
 		__attribute__((aligned(__alignof__(struct nft_expr))));
 };
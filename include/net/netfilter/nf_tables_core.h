@@ -1,9 +1,19 @@
 #ifndef _NET_NF_TABLES_CORE_H
 #define _NET_NF_TABLES_CORE_H
 
+#include <net/netfilter/nf_tables.h>
+
 int nf_tables_core_module_init(void);
 void nf_tables_core_module_exit(void);
 
+struct nft_immediate_expr {
+	struct nft_data		data;
+	enum nft_registers	dreg:8;
+	u8			dlen;
+};
+
+extern const struct nft_expr_ops nft_imm_ops;
+
 int nft_immediate_module_init(void);
 void nft_immediate_module_exit(void);
 
@@ -49,4 +59,6 @@ extern const struct nft_expr_ops nft_payload_fast_ops;
 int nft_payload_module_init(void);
 void nft_payload_module_exit(void);
 
+void nft_rule_compile(struct nft_rule *rule);
+
 #endif /* _NET_NF_TABLES_CORE_H */
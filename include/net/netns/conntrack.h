@@ -94,6 +94,9 @@ struct netns_ct {
 	seqcount_t		generation;
 	struct kmem_cache	*nf_conntrack_cachep;
 	struct hlist_nulls_head	*hash;
+	/* table being filled by a resize, searched after a miss in hash */
+	struct hlist_nulls_head	*resize_hash;
+	unsigned int		resize_htable_size;
 	struct hlist_head	*expect_hash;
 	struct ct_pcpu __percpu *pcpu_lists;
 	struct ip_conntrack_stat __percpu *stat;
@@ -90,6 +90,7 @@ int qdisc_set_default(const char *id);
 
 void qdisc_list_add(struct Qdisc *q);
 void qdisc_list_del(struct Qdisc *q);
+struct Qdisc_ops *qdisc_lookup_ops(struct nlattr *kind);
 struct Qdisc *qdisc_lookup(struct net_device *dev, u32 handle);
 struct Qdisc *qdisc_lookup_class(struct net_device *dev, u32 handle);
 struct qdisc_rate_table *qdisc_get_rtab(struct tc_ratespec *r,
@@ -63,14 +63,17 @@ struct request_sock {
 	struct sock			*sk;
 	u32				secid;
 	u32				peer_secid;
+	int				rx_cpu; /* CPU the request was created on */
 };
 
 static inline struct request_sock *reqsk_alloc(const struct request_sock_ops *ops)
 {
 	struct request_sock *req = kmem_cache_alloc(ops->slab, GFP_ATOMIC);
 
-	if (req != NULL)
+	if (req != NULL) {
 		req->rsk_ops = ops;
+		req->rx_cpu = raw_smp_processor_id();
+	}
 
 	return req;
 }
@@ -137,6 +140,7 @@ struct fastopen_queue {
  * @rskq_accept_head - FIFO head of established children
  * @rskq_accept_tail - FIFO tail of established children
  * @rskq_defer_accept - User waits for some data after accept()
+ * @rskq_cpu_affinity - accept() prefers children created on the caller's CPU
  * @syn_wait_lock - serializer
  *
  * %syn_wait_lock is necessary only to avoid proc interface having to grab the main
@@ -153,7 +157,8 @@ struct request_sock_queue {
 	struct request_sock	*rskq_accept_tail;
 	rwlock_t		syn_wait_lock;
 	u8			rskq_defer_accept;
-	/* 3 bytes hole, try to pack */
+	u8			rskq_cpu_affinity;
+	/* 2 bytes hole, try to pack */
 	struct listen_sock	*listen_opt;
 	struct fastopen_queue	*fastopenq; /* This is non-NULL iff TFO has been
 					     * enabled on this listener. Check
@@ -224,6 +229,34 @@ static inline struct request_sock *reqsk_queue_remove(struct request_sock_queue
 	return req;
 }
 
+/*
+ * Unlink the oldest established child whose request was created on @cpu,
+ * so that it keeps running where its packets are steered. Falls back to
+ * the FIFO head if there is none.
+ */
+static inline struct request_sock *
+	reqsk_queue_remove_cpu(struct request_sock_queue *queue, int cpu)
+{
+	struct request_sock *req, *prev = NULL;
+
+	for (req = queue->rskq_accept_head; req; req = req->dl_next) {
+		if (req->rx_cpu == cpu)
+			break;
+		prev = req;
+	}
+	if (req == NULL)
+		return reqsk_queue_remove(queue);
+
+	if (prev == NULL)
+		queue->rskq_accept_head = req->dl_next;
+	else
+		prev->dl_next = req->dl_next;
+	if (queue->rskq_accept_tail == req)
+		queue->rskq_accept_tail = prev;
+
+	return req;
+}
+
 static inline int reqsk_queue_removed(struct request_sock_queue *queue,
 				      struct request_sock *req)
 {
@@ -769,7 +769,14 @@ struct sctp_transport {
 		hb_sent:1,
 
 		/* Is the Path MTU update pending on this tranport */
-		pmtu_pending:1;
+		pmtu_pending:1,
+
+		/* New DATA was queued to this transport during the
+		 * current outqueue flush.  The T3-rtx and heartbeat
+		 * timers are restarted once when the flush completes
+		 * rather than for every chunk.
+		 */
+		data_sent:1;
 
 	/* Has this transport moved the ctsn since we last sacked */
 	__u32 sack_generation;
@@ -0,0 +1,30 @@
+#ifndef _SOCK_REUSEPORT_H
+#define _SOCK_REUSEPORT_H
+
+#include <linux/types.h>
+#include <linux/rcupdate.h>
+
+struct sock;
+
+/*
+ * The sockets bound to the same address and port with SO_REUSEPORT.
+ * Lookups pick a member by flow hash in constant time instead of walking
+ * the hash chain; the array is written under reuseport_lock and read
+ * under RCU.
+ */
+struct sock_reuseport {
+	struct rcu_head		rcu;
+
+	u16			max_socks;	/* length of socks */
+	u16			num_socks;	/* elements in socks */
+	unsigned int		has_conns:1;	/* a member is connected */
+	struct sock		*socks[0];	/* array of sock pointers */
+};
+
+int reuseport_alloc(struct sock *sk);
+int reuseport_add_sock(struct sock *sk, struct sock *sk2);
+void reuseport_detach_sock(struct sock *sk);
+void reuseport_has_conns_set(struct sock *sk);
+struct sock *reuseport_select_sock(struct sock *sk, u32 hash);
+
+#endif  /* _SOCK_REUSEPORT_H */
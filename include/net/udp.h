@@ -186,6 +186,9 @@ int udp_push_pending_frames(struct sock *sk);
 void udp_flush_pending_frames(struct sock *sk);
 void udp4_hwcsum(struct sk_buff *skb, __be32 src, __be32 dst);
 int udp_rcv(struct sk_buff *skb);
+int udp_init_sock(struct sock *sk);
+struct sk_buff *__skb_recv_udp(struct sock *sk, unsigned int flags,
+			       int *peeked, int *off, int *err);
 int udp_ioctl(struct sock *sk, int cmd, unsigned long arg);
 int udp_disconnect(struct sock *sk, int flags);
 unsigned int udp_poll(struct file *file, struct socket *sock, poll_table *wait);
@@ -488,6 +488,8 @@ struct se_cmd {
 	int			sam_task_attr;
 	/* Used for se_sess->sess_tag_pool */
 	unsigned int		map_tag;
+	/* CPU the command was set up on, selects se_dev->queues[] */
+	int			cpuid;
 	/* Transport protocol dependent state, see transport_state_table */
 	enum transport_state_table t_state;
 	unsigned		cmd_wait_set:1;
@@ -734,6 +736,12 @@ struct se_dev_stat_grps {
 	struct config_group scsi_lu_group;
 };
 
+/* Per-CPU list of commands issued to a device, see se_device->queues */
+struct se_device_queue {
+	struct list_head	state_list;
+	spinlock_t		lock;
+} ____cacheline_aligned_in_smp;
+
 struct se_device {
 #define SE_DEV_LINK_MAGIC			0xfeeddeef
 	u32			dev_link_magic;
@@ -766,7 +774,6 @@ struct se_device {
 	atomic_t		dev_qf_count;
 	int			export_count;
 	spinlock_t		delayed_cmd_lock;
-	spinlock_t		execute_task_lock;
 	spinlock_t		dev_reservation_lock;
 	unsigned int		dev_reservation_flags;
 #define DRF_SPC2_RESERVATIONS			0x00000001
@@ -786,7 +793,6 @@ struct se_device {
 	struct workqueue_struct *tmr_wq;
 	struct work_struct	qf_work_queue;
 	struct list_head	delayed_cmd_list;
-	struct list_head	state_list;
 	struct list_head	qf_cmd_list;
 	struct list_head	g_dev_node;
 	/* Pointer to associated SE HBA */
@@ -798,6 +804,9 @@ struct se_device {
 	/* T10 SPC-2 + SPC-3 Reservations */
 	struct t10_reservation	t10_pr;
 	struct se_dev_attrib	dev_attrib;
+	/* Outstanding commands, one list per CPU */
+	struct se_device_queue	*queues;
+	unsigned int		queue_cnt;
 	struct config_group	dev_group;
 	struct config_group	dev_pr_group;
 	struct se_dev_stat_grps dev_stat_grps;
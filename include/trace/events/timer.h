@@ -342,6 +342,31 @@ TRACE_EVENT(tick_stop,
 
 	TP_printk("success=%s msg=%s",  __entry->success ? "yes" : "no", __get_str(msg))
 );
+
+/**
+ * tick_nohz_full_tick - called when the tick fires on a busy full dynticks CPU
+ * @user: whether the tick interrupted user mode
+ * @stopped: whether the tick was supposed to be stopped
+ */
+TRACE_EVENT(tick_nohz_full_tick,
+
+	TP_PROTO(int user, int stopped),
+
+	TP_ARGS(user, stopped),
+
+	TP_STRUCT__entry(
+		__field( int ,		user	)
+		__field( int ,		stopped	)
+	),
+
+	TP_fast_assign(
+		__entry->user		= user;
+		__entry->stopped	= stopped;
+	),
+
+	TP_printk("user=%s stopped=%s", __entry->user ? "yes" : "no",
+		  __entry->stopped ? "yes" : "no")
+);
 #endif
 
 #endif /*  _TRACE_TIMER_H */
@@ -0,0 +1,52 @@
+#ifndef _UAPI__LINUX_BPF_H__
+#define _UAPI__LINUX_BPF_H__
+
+/*
+ * Userspace interface for /dev/bpf - key/value maps shared between
+ * userspace and internal BPF programs
+ */
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+enum bpf_map_type {
+	BPF_MAP_TYPE_UNSPEC,
+	BPF_MAP_TYPE_HASH,
+	BPF_MAP_TYPE_ARRAY,
+};
+
+/* flags for BPF_MAP_UPDATE_ELEM */
+#define BPF_ANY		0 /* create new element or update existing */
+#define BPF_NOEXIST	1 /* create new element if it didn't exist */
+#define BPF_EXIST	2 /* update existing element */
+
+/* for BPF_MAP_CREATE on /dev/bpf, returns a map file descriptor */
+struct bpf_map_create {
+	__u32	map_type;	/* one of enum bpf_map_type */
+	__u32	key_size;	/* size of key in bytes */
+	__u32	value_size;	/* size of value in bytes */
+	__u32	max_entries;	/* max number of entries in a map */
+};
+
+/* for the element commands on a map file descriptor */
+struct bpf_map_elem {
+	__aligned_u64	key;
+	union {
+		__aligned_u64	value;
+		__aligned_u64	next_key;
+	};
+	__u64		flags;
+};
+
+#define BPFIO	0xBF
+
+/* ioctls for /dev/bpf */
+#define BPF_MAP_CREATE		_IOW(BPFIO, 0x00, struct bpf_map_create)
+
+/* ioctls for map fds */
+#define BPF_MAP_LOOKUP_ELEM	_IOW(BPFIO, 0x01, struct bpf_map_elem)
+#define BPF_MAP_UPDATE_ELEM	_IOW(BPFIO, 0x02, struct bpf_map_elem)
+#define BPF_MAP_DELETE_ELEM	_IOW(BPFIO, 0x03, struct bpf_map_elem)
+#define BPF_MAP_GET_NEXT_KEY	_IOW(BPFIO, 0x04, struct bpf_map_elem)
+
+#endif /* _UAPI__LINUX_BPF_H__ */
@@ -44,6 +44,28 @@ struct fstrim_range {
 	__u64 minlen;
 };
 
+/*
+ * Argument of FIBATCHSTAT, issued on a directory fd.  names points to
+ * count user pointers to NUL terminated names, resolved beneath that
+ * directory; stats and errors point to count struct stat and __s32
+ * slots receiving each result and its 0/-errno status.
+ */
+struct fs_batch_stat {
+	__u64 names;
+	__u64 stats;
+	__u64 errors;
+	__u32 count;
+	__u32 flags;		/* AT_SYMLINK_NOFOLLOW */
+};
+
+/* Argument of FICOPYRANGE, issued on the destination file */
+struct file_copy_range {
+	__s64 src_fd;
+	__u64 src_offset;
+	__u64 src_length;
+	__u64 dest_offset;
+};
+
 /* And dynamically-tunable limits and defaults: */
 struct files_stat_struct {
 	unsigned long nr_files;		/* read only */
@@ -156,6 +178,8 @@ struct inodes_stat_t {
 #define FIFREEZE	_IOWR('X', 119, int)	/* Freeze */
 #define FITHAW		_IOWR('X', 120, int)	/* Thaw */
 #define FITRIM		_IOWR('X', 121, struct fstrim_range)	/* Trim */
+#define FIBATCHSTAT	_IOW('X', 122, struct fs_batch_stat)	/* Multi-stat */
+#define FICOPYRANGE	_IOW('X', 123, struct file_copy_range)	/* Copy range */
 
 #define	FS_IOC_GETFLAGS			_IOR('f', 1, long)
 #define	FS_IOC_SETFLAGS			_IOW('f', 2, long)
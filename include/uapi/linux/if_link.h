@@ -145,6 +145,7 @@ enum {
 	IFLA_CARRIER,
 	IFLA_PHYS_PORT_ID,
 	IFLA_CARRIER_CHANGES,
+	IFLA_RX_FILTER,		/* Early RX BPF program, struct sock_filter[] */
 	__IFLA_MAX
 };
 
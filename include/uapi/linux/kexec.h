@@ -11,6 +11,7 @@
 /* kexec flags for different usage scenarios */
 #define KEXEC_ON_CRASH		0x00000001
 #define KEXEC_PRESERVE_CONTEXT	0x00000002
+#define KEXEC_PRESERVE_MEMORY	0x00000004
 #define KEXEC_ARCH_MASK		0xffff0000
 
 /* These values match the ELF architecture values.
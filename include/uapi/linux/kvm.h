@@ -171,6 +171,7 @@ struct kvm_pit_config {
 #define KVM_EXIT_WATCHDOG         21
 #define KVM_EXIT_S390_TSCH        22
 #define KVM_EXIT_EPR              23
+#define KVM_EXIT_DIRTY_RING_FULL  24
 
 /* For KVM_EXIT_INTERNAL_ERROR */
 /* Emulate instruction failed. */
@@ -344,6 +345,24 @@ struct kvm_coalesced_mmio_ring {
 	((PAGE_SIZE - sizeof(struct kvm_coalesced_mmio_ring)) / \
 	 sizeof(struct kvm_coalesced_mmio))
 
+/*
+ * for KVM_CAP_DIRTY_LOG_RING: the per-vcpu ring of dirty pages, mmap'ed
+ * (MAP_SHARED) from the vcpu fd at KVM_DIRTY_LOG_PAGE_OFFSET pages.
+ * KVM sets KVM_DIRTY_GFN_F_DIRTY once @slot and @offset are valid,
+ * userspace sets KVM_DIRTY_GFN_F_RESET once it has collected the entry
+ * and then calls KVM_RESET_DIRTY_RINGS to hand it back.
+ */
+#define KVM_DIRTY_LOG_PAGE_OFFSET 64
+
+#define KVM_DIRTY_GFN_F_DIRTY	(1 << 0)
+#define KVM_DIRTY_GFN_F_RESET	(1 << 1)
+
+struct kvm_dirty_gfn {
+	__u32 flags;
+	__u32 slot;	/* memslot id, as in KVM_GET_DIRTY_LOG */
+	__u64 offset;	/* page offset within the slot */
+};
+
 /* for KVM_TRANSLATE */
 struct kvm_translation {
 	/* in */
@@ -743,6 +762,7 @@ struct kvm_ppc_smmu_info {
 #define KVM_CAP_IOAPIC_POLARITY_IGNORED 97
 #define KVM_CAP_ENABLE_CAP_VM 98
 #define KVM_CAP_S390_IRQCHIP 99
+#define KVM_CAP_DIRTY_LOG_RING 100
 
 #ifdef KVM_CAP_IRQ_ROUTING
 
@@ -1109,6 +1129,8 @@ struct kvm_s390_ucas_mapping {
 #define KVM_ARM_VCPU_INIT	  _IOW(KVMIO,  0xae, struct kvm_vcpu_init)
 #define KVM_ARM_PREFERRED_TARGET  _IOR(KVMIO,  0xaf, struct kvm_vcpu_init)
 #define KVM_GET_REG_LIST	  _IOWR(KVMIO, 0xb0, struct kvm_reg_list)
+/* Available with KVM_CAP_DIRTY_LOG_RING */
+#define KVM_RESET_DIRTY_RINGS	  _IO(KVMIO,   0xc7)
 
 #define KVM_DEV_ASSIGN_ENABLE_IOMMU	(1 << 0)
 #define KVM_DEV_ASSIGN_PCI_2_3		(1 << 1)
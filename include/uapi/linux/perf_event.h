@@ -301,8 +301,9 @@ struct perf_event_attr {
 				exclude_callchain_kernel : 1, /* exclude kernel callchains */
 				exclude_callchain_user   : 1, /* exclude user callchains */
 				mmap2          :  1, /* include mmap with inode data     */
+				callchain_id   :  1, /* callchain ids in samples */
 
-				__reserved_1   : 40;
+				__reserved_1   : 39;
 
 	union {
 		__u32		wakeup_events;	  /* wakeup every n events */
@@ -348,6 +349,7 @@ struct perf_event_attr {
 #define PERF_EVENT_IOC_SET_OUTPUT	_IO ('$', 5)
 #define PERF_EVENT_IOC_SET_FILTER	_IOW('$', 6, char *)
 #define PERF_EVENT_IOC_ID		_IOR('$', 7, __u64 *)
+#define PERF_EVENT_IOC_SET_BPF		_IOW('$', 8, struct sock_fprog *)
 
 enum perf_event_ioc_flags {
 	PERF_IOC_FLAG_GROUP		= 1U << 0,
@@ -652,6 +654,9 @@ enum perf_event_type {
 	 *
 	 *	{ u64			nr,
 	 *	  u64			ips[nr];  } && PERF_SAMPLE_CALLCHAIN
+	 *					     && !callchain_id
+	 *	{ u64			callchain_id; } && PERF_SAMPLE_CALLCHAIN
+	 *					     && callchain_id
 	 *
 	 *	#
 	 *	# The RAW record below is opaque data wrt the ABI
@@ -705,6 +710,23 @@ enum perf_event_type {
 	 */
 	PERF_RECORD_MMAP2			= 10,
 
+	/*
+	 * With attr.callchain_id, samples carry the id of their callchain,
+	 * 0 for none, and this record is emitted the first time a given
+	 * callchain is sampled. It may follow samples of other CPUs that
+	 * already use its id. It can be emitted again for the same id.
+	 *
+	 * struct {
+	 *	struct perf_event_header	header;
+	 *
+	 *	u64				id;
+	 *	u64				nr;
+	 *	u64				ips[nr];
+	 * 	struct sample_id		sample_id;
+	 * };
+	 */
+	PERF_RECORD_CALLCHAIN			= 11,
+
 	PERF_RECORD_MAX,			/* non-ABI */
 };
 
@@ -605,6 +605,17 @@ struct tc_drr_stats {
 	__u32	deficit;
 };
 
+/* MQ */
+
+enum {
+	TCA_MQ_UNSPEC,
+	TCA_MQ_KIND,		/* qdisc kind attached to every TX queue */
+	TCA_MQ_OPTIONS,		/* options applied to all of them */
+	__TCA_MQ_MAX,
+};
+
+#define TCA_MQ_MAX (__TCA_MQ_MAX - 1)
+
 /* MQPRIO */
 #define TC_QOPT_BITMASK 15
 #define TC_QOPT_MAX_QUEUE 16
@@ -843,4 +854,36 @@ struct tc_pie_xstats {
 	__u32 maxq;             /* maximum queue size */
 	__u32 ecn_mark;         /* packets marked with ecn*/
 };
+
+/* MQHTB */
+
+enum {
+	TCA_MQHTB_UNSPEC,
+	TCA_MQHTB_RATE,		/* u64, total bytes per second, 0 = unlimited */
+	TCA_MQHTB_BURST,	/* u32, bucket depth in bytes */
+	TCA_MQHTB_LIMIT,	/* u32, packets per TX queue */
+	TCA_MQHTB_DEFCLS,	/* u32, minor of the default class */
+	TCA_MQHTB_CLASS,	/* nested, one per class, in minor order */
+	__TCA_MQHTB_MAX
+};
+
+#define TCA_MQHTB_MAX	(__TCA_MQHTB_MAX - 1)
+
+enum {
+	TCA_MQHTB_CLASS_UNSPEC,
+	TCA_MQHTB_CLASS_RATE,	/* u64, guaranteed bytes per second */
+	TCA_MQHTB_CLASS_CEIL,	/* u64, borrowing ceiling, 0 = root rate */
+	__TCA_MQHTB_CLASS_MAX
+};
+
+#define TCA_MQHTB_CLASS_MAX	(__TCA_MQHTB_CLASS_MAX - 1)
+
+#define TC_MQHTB_MAXCLASSES	16
+
+struct tc_mqhtb_xstats {
+	__u32	borrows;	/* packets sent above their class rate */
+	__u32	throttled;	/* times all backlogged classes were over limit */
+	__u32	classes;	/* configured classes */
+	__u32	pad;
+};
 #endif
@@ -112,6 +112,8 @@ enum {
 #define TCP_FASTOPEN		23	/* Enable FastOpen on listeners */
 #define TCP_TIMESTAMP		24
 #define TCP_NOTSENT_LOWAT	25	/* limit number of unsent bytes in write queue */
+#define TCP_ACCEPT_AFFINITY	26	/* accept() prefers connections from this CPU */
+#define TCP_AUTOCORK_USECS	27	/* coalesce small writes for up to N usecs */
 
 struct tcp_repair_opt {
 	__u32	opt_code;
@@ -0,0 +1,51 @@
+#ifndef _UAPI_TRACE_MMAP_H_
+#define _UAPI_TRACE_MMAP_H_
+
+#include <linux/types.h>
+
+/**
+ * struct trace_buffer_meta - Ring-buffer meta-page description.
+ * @meta_page_size:	Size of this meta-page.
+ * @meta_struct_len:	Size of this structure.
+ * @subbuf_size:	Size of each sub-buffer.
+ * @nr_subbufs:		Number of sub-buffers in the ring-buffer.
+ * @reader.lost_events:	Events lost before the current reader sub-buffer.
+ * @reader.id:		Id of the current reader sub-buffer.
+ * @reader.read:	Offset of the next event to read in that sub-buffer.
+ * @entries:		Number of entries in the ring-buffer.
+ * @overrun:		Number of entries lost in the ring-buffer.
+ * @read:		Number of entries that have been read.
+ *
+ * The meta-page is the first page of the mapping of a per-CPU
+ * trace_pipe_raw file, sub-buffer @id is mapped at page 1 + @id.
+ * Each sub-buffer starts with the page header (u64 time stamp and
+ * long commit) described in events/header_page, followed by the
+ * events. The meta-page is only updated by the
+ * TRACE_MMAP_IOCTL_GET_READER ioctl.
+ */
+struct trace_buffer_meta {
+	__u32		meta_page_size;
+	__u32		meta_struct_len;
+
+	__u32		subbuf_size;
+	__u32		nr_subbufs;
+
+	struct {
+		__u64	lost_events;
+		__u32	id;
+		__u32	read;
+	} reader;
+
+	__u64	entries;
+	__u64	overrun;
+	__u64	read;
+};
+
+/*
+ * Consume the reader sub-buffer up to the offset given as argument and,
+ * once it is fully consumed and the writer has left it, swap in the
+ * next one. The meta-page is then updated.
+ */
+#define TRACE_MMAP_IOCTL_GET_READER	_IO('T', 0x1)
+
+#endif /* _UAPI_TRACE_MMAP_H_ */
@@ -0,0 +1,384 @@
+/*
+ * BPF maps: /dev/bpf and map file descriptors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * A map is created with the BPF_MAP_CREATE ioctl on /dev/bpf, which
+ * returns an anonymous file descriptor owning a reference to the map.
+ * Userspace accesses elements through ioctls on that descriptor, kernel
+ * users take their own reference with bpf_map_get() and can hand the
+ * map to internal BPF programs, which call the helpers at the bottom
+ * of this file.
+ */
+#include <linux/bpf.h>
+#include <linux/module.h>
+#include <linux/miscdevice.h>
+#include <linux/anon_inodes.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/rcupdate.h>
+
+static LIST_HEAD(bpf_map_types);
+
+void bpf_register_map_type(struct bpf_map_type_list *tl)
+{
+	list_add(&tl->list_node, &bpf_map_types);
+}
+
+static struct bpf_map *find_and_alloc_map(struct bpf_map_create *attr)
+{
+	struct bpf_map_type_list *tl;
+	struct bpf_map *map;
+
+	list_for_each_entry(tl, &bpf_map_types, list_node) {
+		if (tl->type == attr->map_type) {
+			map = tl->ops->map_alloc(attr);
+			if (IS_ERR(map))
+				return map;
+			map->ops = tl->ops;
+			map->map_type = attr->map_type;
+			return map;
+		}
+	}
+	return ERR_PTR(-EINVAL);
+}
+
+/* called from workqueue, map_free may sleep waiting for RCU readers */
+static void bpf_map_free_deferred(struct work_struct *work)
+{
+	struct bpf_map *map = container_of(work, struct bpf_map, work);
+
+	map->ops->map_free(map);
+}
+
+/* decrement map refcnt and schedule it for freeing via workqueue
+ * (underlying map implementation ops->map_free() might sleep)
+ */
+void bpf_map_put(struct bpf_map *map)
+{
+	if (atomic_dec_and_test(&map->refcnt)) {
+		INIT_WORK(&map->work, bpf_map_free_deferred);
+		schedule_work(&map->work);
+	}
+}
+EXPORT_SYMBOL_GPL(bpf_map_put);
+
+static int bpf_map_release(struct inode *inode, struct file *filp)
+{
+	struct bpf_map *map = filp->private_data;
+
+	bpf_map_put(map);
+	return 0;
+}
+
+static void __user *u64_to_ptr(__u64 val)
+{
+	return (void __user *) (unsigned long) val;
+}
+
+static int map_lookup_elem(struct bpf_map *map, struct bpf_map_elem *elem)
+{
+	void *key, *value, *ptr;
+	int err;
+
+	err = -ENOMEM;
+	key = kmalloc(map->key_size, GFP_USER);
+	if (!key)
+		goto err_out;
+
+	err = -EFAULT;
+	if (copy_from_user(key, u64_to_ptr(elem->key), map->key_size))
+		goto free_key;
+
+	err = -ENOMEM;
+	value = kmalloc(map->value_size, GFP_USER);
+	if (!value)
+		goto free_key;
+
+	/* the element may be freed as soon as we leave the RCU section */
+	rcu_read_lock();
+	ptr = map->ops->map_lookup_elem(map, key);
+	if (ptr)
+		memcpy(value, ptr, map->value_size);
+	rcu_read_unlock();
+
+	err = -ENOENT;
+	if (!ptr)
+		goto free_value;
+
+	err = -EFAULT;
+	if (copy_to_user(u64_to_ptr(elem->value), value, map->value_size))
+		goto free_value;
+
+	err = 0;
+
+free_value:
+	kfree(value);
+free_key:
+	kfree(key);
+err_out:
+	return err;
+}
+
+static int map_update_elem(struct bpf_map *map, struct bpf_map_elem *elem)
+{
+	void *key, *value;
+	int err;
+
+	err = -ENOMEM;
+	key = kmalloc(map->key_size, GFP_USER);
+	if (!key)
+		goto err_out;
+
+	err = -EFAULT;
+	if (copy_from_user(key, u64_to_ptr(elem->key), map->key_size))
+		goto free_key;
+
+	err = -ENOMEM;
+	value = kmalloc(map->value_size, GFP_USER);
+	if (!value)
+		goto free_key;
+
+	err = -EFAULT;
+	if (copy_from_user(value, u64_to_ptr(elem->value), map->value_size))
+		goto free_value;
+
+	/* BPF programs using maps run under rcu_read_lock() and the map
+	 * implementations rely on that, so do the same here
+	 */
+	rcu_read_lock();
+	err = map->ops->map_update_elem(map, key, value, elem->flags);
+	rcu_read_unlock();
+
+free_value:
+	kfree(value);
+free_key:
+	kfree(key);
+err_out:
+	return err;
+}
+
+static int map_delete_elem(struct bpf_map *map, struct bpf_map_elem *elem)
+{
+	void *key;
+	int err;
+
+	err = -ENOMEM;
+	key = kmalloc(map->key_size, GFP_USER);
+	if (!key)
+		goto err_out;
+
+	err = -EFAULT;
+	if (copy_from_user(key, u64_to_ptr(elem->key), map->key_size))
+		goto free_key;
+
+	rcu_read_lock();
+	err = map->ops->map_delete_elem(map, key);
+	rcu_read_unlock();
+
+free_key:
+	kfree(key);
+err_out:
+	return err;
+}
+
+static int map_get_next_key(struct bpf_map *map, struct bpf_map_elem *elem)
+{
+	void *key, *next_key;
+	int err;
+
+	err = -ENOMEM;
+	key = kmalloc(map->key_size, GFP_USER);
+	if (!key)
+		goto err_out;
+
+	err = -EFAULT;
+	if (copy_from_user(key, u64_to_ptr(elem->key), map->key_size))
+		goto free_key;
+
+	err = -ENOMEM;
+	next_key = kmalloc(map->key_size, GFP_USER);
+	if (!next_key)
+		goto free_key;
+
+	rcu_read_lock();
+	err = map->ops->map_get_next_key(map, key, next_key);
+	rcu_read_unlock();
+	if (err)
+		goto free_next_key;
+
+	err = -EFAULT;
+	if (copy_to_user(u64_to_ptr(elem->next_key), next_key, map->key_size))
+		goto free_next_key;
+
+	err = 0;
+
+free_next_key:
+	kfree(next_key);
+free_key:
+	kfree(key);
+err_out:
+	return err;
+}
+
+static long bpf_map_ioctl(struct file *filp, unsigned int ioctl,
+			  unsigned long arg)
+{
+	struct bpf_map *map = filp->private_data;
+	struct bpf_map_elem elem;
+
+	if (copy_from_user(&elem, (void __user *) arg, sizeof(elem)))
+		return -EFAULT;
+
+	switch (ioctl) {
+	case BPF_MAP_LOOKUP_ELEM:
+		return map_lookup_elem(map, &elem);
+	case BPF_MAP_UPDATE_ELEM:
+		return map_update_elem(map, &elem);
+	case BPF_MAP_DELETE_ELEM:
+		return map_delete_elem(map, &elem);
+	case BPF_MAP_GET_NEXT_KEY:
+		return map_get_next_key(map, &elem);
+	default:
+		return -ENOTTY;
+	}
+}
+
+static const struct file_operations bpf_map_fops = {
+	.release	= bpf_map_release,
+	.unlocked_ioctl	= bpf_map_ioctl,
+	.compat_ioctl	= bpf_map_ioctl,
+	.llseek		= noop_llseek,
+};
+
+/**
+ *	bpf_map_get - take a reference to the map behind a file descriptor
+ *	@fd: map file descriptor as returned by BPF_MAP_CREATE
+ *
+ * The reference stays valid after @fd is closed and has to be dropped
+ * with bpf_map_put().
+ */
+struct bpf_map *bpf_map_get(int fd)
+{
+	struct fd f = fdget(fd);
+	struct bpf_map *map;
+
+	if (!f.file)
+		return ERR_PTR(-EBADF);
+
+	if (f.file->f_op != &bpf_map_fops) {
+		fdput(f);
+		return ERR_PTR(-EINVAL);
+	}
+
+	map = f.file->private_data;
+	atomic_inc(&map->refcnt);
+	fdput(f);
+
+	return map;
+}
+EXPORT_SYMBOL_GPL(bpf_map_get);
+
+static int bpf_map_create(struct bpf_map_create __user *uattr)
+{
+	struct bpf_map_create attr;
+	struct bpf_map *map;
+	int fd;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	if (copy_from_user(&attr, uattr, sizeof(attr)))
+		return -EFAULT;
+
+	map = find_and_alloc_map(&attr);
+	if (IS_ERR(map))
+		return PTR_ERR(map);
+
+	atomic_set(&map->refcnt, 1);
+
+	fd = anon_inode_getfd("bpf-map", &bpf_map_fops, map,
+			      O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		/* failed to allocate fd */
+		map->ops->map_free(map);
+
+	return fd;
+}
+
+static long bpf_dev_ioctl(struct file *filp, unsigned int ioctl,
+			  unsigned long arg)
+{
+	switch (ioctl) {
+	case BPF_MAP_CREATE:
+		return bpf_map_create((struct bpf_map_create __user *) arg);
+	default:
+		return -ENOTTY;
+	}
+}
+
+static const struct file_operations bpf_dev_fops = {
+	.owner		= THIS_MODULE,
+	.unlocked_ioctl	= bpf_dev_ioctl,
+	.compat_ioctl	= bpf_dev_ioctl,
+	.llseek		= noop_llseek,
+};
+
+static struct miscdevice bpf_dev = {
+	.minor	= MISC_DYNAMIC_MINOR,
+	.name	= "bpf",
+	.fops	= &bpf_dev_fops,
+};
+
+static int __init bpf_dev_init(void)
+{
+	return misc_register(&bpf_dev);
+}
+device_initcall(bpf_dev_init);
+
+/*
+ * Helpers called from internal BPF programs via BPF_CALL
+ */
+u64 bpf_map_lookup_elem(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5)
+{
+	/* the program builder guarantees that R1 is a map obtained from
+	 * bpf_map_get() and R2 points to map->key_size initialized bytes
+	 */
+	struct bpf_map *map = (struct bpf_map *) (unsigned long) r1;
+	void *key = (void *) (unsigned long) r2;
+	void *value;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	value = map->ops->map_lookup_elem(map, key);
+
+	/* lookup() returns either pointer to element value or NULL
+	 * which is the meaning of the return value of this helper
+	 */
+	return (unsigned long) value;
+}
+
+u64 bpf_map_update_elem(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5)
+{
+	struct bpf_map *map = (struct bpf_map *) (unsigned long) r1;
+	void *key = (void *) (unsigned long) r2;
+	void *value = (void *) (unsigned long) r3;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	return map->ops->map_update_elem(map, key, value, r4);
+}
+
+u64 bpf_map_delete_elem(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5)
+{
+	struct bpf_map *map = (struct bpf_map *) (unsigned long) r1;
+	void *key = (void *) (unsigned long) r2;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	return map->ops->map_delete_elem(map, key);
+}
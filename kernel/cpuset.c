@@ -150,6 +150,7 @@ typedef enum {
 	CS_SCHED_LOAD_BALANCE,
 	CS_SPREAD_PAGE,
 	CS_SPREAD_SLAB,
+	CS_SCHED_LLC_EXCLUSIVE,
 } cpuset_flagbits_t;
 
 /* convenient tests for these bits */
@@ -193,6 +194,11 @@ static inline int is_spread_slab(const struct cpuset *cs)
 	return test_bit(CS_SPREAD_SLAB, &cs->flags);
 }
 
+static inline int is_sched_llc_exclusive(const struct cpuset *cs)
+{
+	return test_bit(CS_SCHED_LLC_EXCLUSIVE, &cs->flags);
+}
+
 static struct cpuset top_cpuset = {
 	.flags = ((1 << CS_ONLINE) | (1 << CS_CPU_EXCLUSIVE) |
 		  (1 << CS_MEM_EXCLUSIVE)),
@@ -400,6 +406,26 @@ static void free_trial_cpuset(struct cpuset *trial)
 	kfree(trial);
 }
 
+/*
+ * cpus_share_llc - Would any cpu of @a share a last level cache with @b?
+ *
+ * Without multi-core topology information the cache domain of a cpu is
+ * only known to be the cpu itself.
+ */
+static bool cpus_share_llc(const struct cpumask *a, const struct cpumask *b)
+{
+#ifdef CONFIG_SCHED_MC
+	int cpu;
+
+	for_each_cpu(cpu, a)
+		if (cpumask_intersects(cpu_coregroup_mask(cpu), b))
+			return true;
+	return false;
+#else
+	return cpumask_intersects(a, b);
+#endif
+}
+
 /*
  * validate_change() - Used to validate that any proposed cpuset change
  *		       follows the structural rules for cpusets.
@@ -460,6 +486,11 @@ static int validate_change(struct cpuset *cur, struct cpuset *trial)
 		    c != cur &&
 		    nodes_intersects(trial->mems_allowed, c->mems_allowed))
 			goto out;
+		if ((is_sched_llc_exclusive(trial) ||
+		     is_sched_llc_exclusive(c)) &&
+		    c != cur &&
+		    cpus_share_llc(trial->cpus_allowed, c->cpus_allowed))
+			goto out;
 	}
 
 	/*
@@ -1526,6 +1557,7 @@ typedef enum {
 	FILE_MEMORY_PRESSURE,
 	FILE_SPREAD_PAGE,
 	FILE_SPREAD_SLAB,
+	FILE_SCHED_LLC_EXCLUSIVE,
 } cpuset_filetype_t;
 
 static int cpuset_write_u64(struct cgroup_subsys_state *css, struct cftype *cft,
@@ -1569,6 +1601,9 @@ static int cpuset_write_u64(struct cgroup_subsys_state *css, struct cftype *cft,
 	case FILE_SPREAD_SLAB:
 		retval = update_flag(CS_SPREAD_SLAB, cs, val);
 		break;
+	case FILE_SCHED_LLC_EXCLUSIVE:
+		retval = update_flag(CS_SCHED_LLC_EXCLUSIVE, cs, val);
+		break;
 	default:
 		retval = -EINVAL;
 		break;
@@ -1720,6 +1755,8 @@ static u64 cpuset_read_u64(struct cgroup_subsys_state *css, struct cftype *cft)
 		return is_spread_page(cs);
 	case FILE_SPREAD_SLAB:
 		return is_spread_slab(cs);
+	case FILE_SCHED_LLC_EXCLUSIVE:
+		return is_sched_llc_exclusive(cs);
 	default:
 		BUG();
 	}
@@ -1793,6 +1830,13 @@ static struct cftype files[] = {
 		.private = FILE_SCHED_LOAD_BALANCE,
 	},
 
+	{
+		.name = "sched_llc_exclusive",
+		.read_u64 = cpuset_read_u64,
+		.write_u64 = cpuset_write_u64,
+		.private = FILE_SCHED_LLC_EXCLUSIVE,
+	},
+
 	{
 		.name = "sched_relax_domain_level",
 		.read_s64 = cpuset_read_s64,
@@ -11,6 +11,7 @@
 
 #include <linux/perf_event.h>
 #include <linux/slab.h>
+#include <linux/jhash.h>
 #include "internal.h"
 
 struct callchain_cpus_entries {
@@ -207,3 +208,72 @@ exit_put:
 
 	return entry;
 }
+
+/*
+ * The ids of the callchains an event already sent to user space, with
+ * attr.callchain_id. The id is a 64-bit hash of the callchain; the table
+ * is shared with the inherited events, which output to the same buffer.
+ */
+#define CALLCHAIN_IDS_BITS	11
+#define CALLCHAIN_IDS_PROBES	8
+
+int alloc_callchain_ids(struct perf_event *event)
+{
+	event->callchain_ids = kcalloc(1 << CALLCHAIN_IDS_BITS,
+				       sizeof(atomic64_t), GFP_KERNEL);
+	if (!event->callchain_ids)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/*
+ * Returns the id of @entry, and whether it is the @first time it is
+ * seen, in which case the caller emits the callchain. The id is then
+ * claimed in the table, in *@slot, to be given back if that fails.
+ * When the table is full, the callchain is emitted every time.
+ */
+u64 perf_callchain_id(struct perf_event *event,
+		      struct perf_callchain_entry *entry,
+		      bool *first, atomic64_t **slot)
+{
+	u32 len, mask = (1 << CALLCHAIN_IDS_BITS) - 1;
+	atomic64_t *ids;
+	u64 id;
+	int i;
+
+	*first = false;
+	*slot = NULL;
+
+	if (!entry || !entry->nr)
+		return 0;
+
+	if (event->parent)
+		event = event->parent;
+	ids = event->callchain_ids;
+
+	len = entry->nr * (sizeof(u64) / sizeof(u32));
+	id = (u64)jhash2((u32 *)entry->ip, len, entry->nr) << 32 |
+	     jhash2((u32 *)entry->ip, len, ~entry->nr);
+	if (!id)
+		id = 1;
+
+	*first = true;
+	for (i = 0; i < CALLCHAIN_IDS_PROBES; i++) {
+		atomic64_t *s = &ids[((u32)id + i) & mask];
+		u64 old = atomic64_read(s);
+
+		if (!old)
+			old = atomic64_cmpxchg(s, 0, id);
+		if (!old) {
+			*slot = s;
+			break;
+		}
+		if (old == id) {
+			*first = false;
+			break;
+		}
+	}
+
+	return id;
+}
@@ -36,6 +36,7 @@
 #include <linux/kernel_stat.h>
 #include <linux/perf_event.h>
 #include <linux/ftrace_event.h>
+#include <linux/filter.h>
 #include <linux/hw_breakpoint.h>
 #include <linux/mm_types.h>
 #include <linux/cgroup.h>
@@ -3174,6 +3175,7 @@ static void free_event_rcu(struct rcu_head *head)
 	if (event->ns)
 		put_pid_ns(event->ns);
 	perf_event_free_filter(event);
+	kfree(event->callchain_ids);
 	kfree(event);
 }
 
@@ -3608,6 +3610,7 @@ static inline int perf_fget_light(int fd, struct fd *p)
 static int perf_event_set_output(struct perf_event *event,
 				 struct perf_event *output_event);
 static int perf_event_set_filter(struct perf_event *event, void __user *arg);
+static int perf_event_set_bpf(struct perf_event *event, void __user *arg);
 
 static long perf_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
@@ -3662,6 +3665,9 @@ static long perf_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	case PERF_EVENT_IOC_SET_FILTER:
 		return perf_event_set_filter(event, (void __user *)arg);
 
+	case PERF_EVENT_IOC_SET_BPF:
+		return perf_event_set_bpf(event, (void __user *)arg);
+
 	default:
 		return -ENOTTY;
 	}
@@ -4555,7 +4561,9 @@ void perf_output_sample(struct perf_output_handle *handle,
 		perf_output_read(handle, event);
 
 	if (sample_type & PERF_SAMPLE_CALLCHAIN) {
-		if (data->callchain) {
+		if (event->attr.callchain_id) {
+			perf_output_put(handle, data->callchain_id);
+		} else if (data->callchain) {
 			int size = 1;
 
 			if (data->callchain)
@@ -4652,6 +4660,58 @@ void perf_output_sample(struct perf_output_handle *handle,
 	}
 }
 
+struct perf_callchain_event {
+	struct perf_event_header	header;
+	u64				id;
+	u64				nr;
+};
+
+/*
+ * Returns the id samples carry for @entry, outputting the callchain
+ * in a PERF_RECORD_CALLCHAIN the first time.
+ */
+static u64 perf_output_callchain_id(struct perf_event *event,
+				    struct perf_callchain_entry *entry)
+{
+	struct perf_callchain_event callchain_event;
+	struct perf_output_handle handle;
+	struct perf_sample_data sample;
+	atomic64_t *slot;
+	bool first;
+	u64 id;
+
+	id = perf_callchain_id(event, entry, &first, &slot);
+	if (!first)
+		return id;
+
+	callchain_event = (struct perf_callchain_event){
+		.header = {
+			.type = PERF_RECORD_CALLCHAIN,
+			.misc = 0,
+			.size = sizeof(callchain_event) +
+				entry->nr * sizeof(u64),
+		},
+		.id	= id,
+		.nr	= entry->nr,
+	};
+
+	perf_event_header__init_id(&callchain_event.header, &sample, event);
+
+	if (perf_output_begin(&handle, event, callchain_event.header.size)) {
+		/* let the next sample try again */
+		if (slot)
+			atomic64_cmpxchg(slot, id, 0);
+		return id;
+	}
+
+	perf_output_put(&handle, callchain_event);
+	__output_copy(&handle, entry->ip, entry->nr * sizeof(u64));
+	perf_event__output_id_sample(event, &handle, &sample);
+	perf_output_end(&handle);
+
+	return id;
+}
+
 void perf_prepare_sample(struct perf_event_header *header,
 			 struct perf_sample_data *data,
 			 struct perf_event *event,
@@ -4675,7 +4735,10 @@ void perf_prepare_sample(struct perf_event_header *header,
 
 		data->callchain = perf_callchain(event, regs);
 
-		if (data->callchain)
+		if (event->attr.callchain_id)
+			data->callchain_id = perf_output_callchain_id(event,
+							data->callchain);
+		else if (data->callchain)
 			size += data->callchain->nr;
 
 		header->size += size * sizeof(u64);
@@ -5843,6 +5906,14 @@ static int perf_tp_filter_match(struct perf_event *event,
 {
 	void *record = data->raw->data;
 
+#ifdef CONFIG_BPF_EVENTS
+	struct sk_filter *prog = ACCESS_ONCE(event->bpf_filter);
+
+	/* see ftrace_profile_set_bpf() */
+	smp_read_barrier_depends();
+	if (prog && !SK_RUN_FILTER(prog, record))
+		return 0;
+#endif
 	if (likely(!event->filter) || filter_match_preds(event->filter, record))
 		return 1;
 	return 0;
@@ -5978,9 +6049,18 @@ static int perf_event_set_filter(struct perf_event *event, void __user *arg)
 	return ret;
 }
 
+static int perf_event_set_bpf(struct perf_event *event, void __user *arg)
+{
+	if (event->attr.type != PERF_TYPE_TRACEPOINT)
+		return -EINVAL;
+
+	return ftrace_profile_set_bpf(event, arg);
+}
+
 static void perf_event_free_filter(struct perf_event *event)
 {
 	ftrace_profile_free_filter(event);
+	ftrace_profile_free_bpf(event);
 }
 
 #else
@@ -5994,6 +6074,11 @@ static int perf_event_set_filter(struct perf_event *event, void __user *arg)
 	return -ENOENT;
 }
 
+static int perf_event_set_bpf(struct perf_event *event, void __user *arg)
+{
+	return -ENOENT;
+}
+
 static void perf_event_free_filter(struct perf_event *event)
 {
 }
@@ -6763,6 +6848,14 @@ perf_event_alloc(struct perf_event_attr *attr, int cpu,
 			err = get_callchain_buffers();
 			if (err)
 				goto err_pmu;
+
+			if (event->attr.callchain_id) {
+				err = alloc_callchain_ids(event);
+				if (err) {
+					put_callchain_buffers();
+					goto err_pmu;
+				}
+			}
 		}
 	}
 
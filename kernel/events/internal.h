@@ -150,6 +150,10 @@ extern struct perf_callchain_entry *
 perf_callchain(struct perf_event *event, struct pt_regs *regs);
 extern int get_callchain_buffers(void);
 extern void put_callchain_buffers(void);
+extern int alloc_callchain_ids(struct perf_event *event);
+extern u64 perf_callchain_id(struct perf_event *event,
+			     struct perf_callchain_entry *entry,
+			     bool *first, atomic64_t **slot);
 
 static inline int get_recursion_context(int *recursion)
 {
@@ -36,6 +36,7 @@
 #include "../../mm/internal.h"	/* munlock_vma_page */
 #include <linux/percpu-rwsem.h>
 #include <linux/task_work.h>
+#include <linux/hash.h>
 
 #include <linux/uprobes.h>
 
@@ -49,7 +50,7 @@ static struct rb_root uprobes_tree = RB_ROOT;
  */
 #define no_uprobe_events()	RB_EMPTY_ROOT(&uprobes_tree)
 
-static DEFINE_SPINLOCK(uprobes_treelock);	/* serialize rbtree access */
+static DEFINE_RWLOCK(uprobes_treelock);	/* serialize rbtree access */
 
 #define UPROBES_HASH_SZ	13
 /* serialize uprobe->pending_list */
@@ -60,8 +61,6 @@ static struct percpu_rw_semaphore dup_mmap_sem;
 
 /* Have a copy of original instruction */
 #define UPROBE_COPY_INSN	0
-/* Can skip singlestep */
-#define UPROBE_SKIP_SSTEP	1
 
 struct uprobe {
 	struct rb_node		rb_node;	/* node in the rb tree */
@@ -415,9 +414,9 @@ static struct uprobe *find_uprobe(struct inode *inode, loff_t offset)
 {
 	struct uprobe *uprobe;
 
-	spin_lock(&uprobes_treelock);
+	read_lock(&uprobes_treelock);
 	uprobe = __find_uprobe(inode, offset);
-	spin_unlock(&uprobes_treelock);
+	read_unlock(&uprobes_treelock);
 
 	return uprobe;
 }
@@ -466,9 +465,9 @@ static struct uprobe *insert_uprobe(struct uprobe *uprobe)
 {
 	struct uprobe *u;
 
-	spin_lock(&uprobes_treelock);
+	write_lock(&uprobes_treelock);
 	u = __insert_uprobe(uprobe);
-	spin_unlock(&uprobes_treelock);
+	write_unlock(&uprobes_treelock);
 
 	return u;
 }
@@ -491,8 +490,6 @@ static struct uprobe *alloc_uprobe(struct inode *inode, loff_t offset)
 	uprobe->offset = offset;
 	init_rwsem(&uprobe->register_rwsem);
 	init_rwsem(&uprobe->consumer_rwsem);
-	/* For now assume that the instruction need not be single-stepped */
-	__set_bit(UPROBE_SKIP_SSTEP, &uprobe->flags);
 
 	/* add to uprobes_tree, sorted on inode:offset */
 	cur_uprobe = insert_uprobe(uprobe);
@@ -695,9 +692,9 @@ static void delete_uprobe(struct uprobe *uprobe)
 	if (WARN_ON(!uprobe_is_active(uprobe)))
 		return;
 
-	spin_lock(&uprobes_treelock);
+	write_lock(&uprobes_treelock);
 	rb_erase(&uprobe->rb_node, &uprobes_tree);
-	spin_unlock(&uprobes_treelock);
+	write_unlock(&uprobes_treelock);
 	RB_CLEAR_NODE(&uprobe->rb_node); /* for uprobe_is_active() */
 	iput(uprobe->inode);
 	put_uprobe(uprobe);
@@ -1031,7 +1028,7 @@ static void build_probe_list(struct inode *inode,
 	min = vaddr_to_offset(vma, start);
 	max = min + (end - start) - 1;
 
-	spin_lock(&uprobes_treelock);
+	read_lock(&uprobes_treelock);
 	n = find_node_in_range(inode, min, max);
 	if (n) {
 		for (t = n; t; t = rb_prev(t)) {
@@ -1049,7 +1046,7 @@ static void build_probe_list(struct inode *inode,
 			atomic_inc(&u->ref);
 		}
 	}
-	spin_unlock(&uprobes_treelock);
+	read_unlock(&uprobes_treelock);
 }
 
 /*
@@ -1103,9 +1100,9 @@ vma_has_uprobes(struct vm_area_struct *vma, unsigned long start, unsigned long e
 	min = vaddr_to_offset(vma, start);
 	max = min + (end - start) - 1;
 
-	spin_lock(&uprobes_treelock);
+	read_lock(&uprobes_treelock);
 	n = find_node_in_range(inode, min, max);
-	spin_unlock(&uprobes_treelock);
+	read_unlock(&uprobes_treelock);
 
 	return !!n;
 }
@@ -1217,12 +1214,24 @@ static struct xol_area *get_xol_area(void)
 	return area;
 }
 
+void uprobe_init_state(struct mm_struct *mm)
+{
+	spin_lock_init(&mm->uprobes_state.cache_lock);
+	memset(mm->uprobes_state.cache, 0, sizeof(mm->uprobes_state.cache));
+}
+
 /*
  * uprobe_clear_state - Free the area allocated for slots.
  */
 void uprobe_clear_state(struct mm_struct *mm)
 {
 	struct xol_area *area = mm->uprobes_state.xol_area;
+	int i;
+
+	for (i = 0; i < UPROBES_CACHE_SIZE; i++) {
+		if (mm->uprobes_state.cache[i])
+			put_uprobe(mm->uprobes_state.cache[i]);
+	}
 
 	if (!area)
 		return;
@@ -1630,16 +1639,12 @@ bool uprobe_deny_signal(void)
 
 /*
  * Avoid singlestepping the original instruction if the original instruction
- * is a NOP or can be emulated.
+ * is a NOP or can be emulated.  Not sticky: an emulation that failed once,
+ * e.g. on a fault writing the stack, is tried again on the next hit.
  */
 static bool can_skip_sstep(struct uprobe *uprobe, struct pt_regs *regs)
 {
-	if (test_bit(UPROBE_SKIP_SSTEP, &uprobe->flags)) {
-		if (arch_uprobe_skip_sstep(&uprobe->arch, regs))
-			return true;
-		clear_bit(UPROBE_SKIP_SSTEP, &uprobe->flags);
-	}
-	return false;
+	return arch_uprobe_skip_sstep(&uprobe->arch, regs);
 }
 
 static void mmf_recalc_uprobes(struct mm_struct *mm)
@@ -1687,6 +1692,48 @@ static int is_trap_at_addr(struct mm_struct *mm, unsigned long vaddr)
 	return is_trap_insn(&opcode);
 }
 
+/*
+ * Like find_uprobe(), but first looks in the per-mm cache of the uprobes
+ * recently hit at @vaddr, sparing the threads of a heavily probed process
+ * the walk of uprobes_tree under the global uprobes_treelock. A cached
+ * uprobe holds a reference and is only reused while still in the tree
+ * and still at @inode:@offset, so an unregister or a new mapping at
+ * @vaddr simply misses and replaces the entry.
+ */
+static struct uprobe *find_uprobe_cached(struct mm_struct *mm,
+		struct inode *inode, loff_t offset, unsigned long vaddr)
+{
+	struct uprobes_state *state = &mm->uprobes_state;
+	struct uprobe **slot, *uprobe, *old;
+
+	slot = &state->cache[hash_long(vaddr, UPROBES_CACHE_BITS)];
+
+	spin_lock(&state->cache_lock);
+	uprobe = *slot;
+	if (uprobe && uprobe->inode == inode && uprobe->offset == offset &&
+	    uprobe_is_active(uprobe)) {
+		atomic_inc(&uprobe->ref);
+		spin_unlock(&state->cache_lock);
+		return uprobe;
+	}
+	spin_unlock(&state->cache_lock);
+
+	uprobe = find_uprobe(inode, offset);
+	if (!uprobe)
+		return NULL;
+
+	atomic_inc(&uprobe->ref);
+	spin_lock(&state->cache_lock);
+	old = *slot;
+	*slot = uprobe;
+	spin_unlock(&state->cache_lock);
+
+	if (old)
+		put_uprobe(old);
+
+	return uprobe;
+}
+
 static struct uprobe *find_active_uprobe(unsigned long bp_vaddr, int *is_swbp)
 {
 	struct mm_struct *mm = current->mm;
@@ -1700,7 +1747,7 @@ static struct uprobe *find_active_uprobe(unsigned long bp_vaddr, int *is_swbp)
 			struct inode *inode = file_inode(vma->vm_file);
 			loff_t offset = vaddr_to_offset(vma, bp_vaddr);
 
-			uprobe = find_uprobe(inode, offset);
+			uprobe = find_uprobe_cached(mm, inode, offset, bp_vaddr);
 		}
 
 		if (!uprobe)
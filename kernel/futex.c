@@ -64,6 +64,7 @@
 #include <linux/hugetlb.h>
 #include <linux/freezer.h>
 #include <linux/bootmem.h>
+#include <linux/moduleparam.h>
 
 #include <asm/futex.h>
 
@@ -259,6 +260,23 @@ static unsigned long __read_mostly futex_hashsize;
 
 static struct futex_hash_bucket *futex_queues;
 
+/*
+ * PTHREAD_PROCESS_PRIVATE futexes of a multi threaded mm are hashed into a
+ * table of its own, allocated on the node of the thread that first shares
+ * the mm, so that unrelated processes don't contend on the same bucket
+ * locks. Shared futexes always use the global futex_queues.
+ */
+struct futex_private_hash {
+	unsigned long mask;
+	struct futex_hash_bucket queues[0];
+};
+
+#define FUTEX_PRIVATE_HASH_MIN	16
+#define FUTEX_PRIVATE_HASH_MAX	256
+
+static bool futex_private_hash_enabled __read_mostly = true;
+core_param(futex_private_hash, futex_private_hash_enabled, bool, 0444);
+
 static inline void futex_get_mm(union futex_key *key)
 {
 	atomic_inc(&key->private.mm->mm_count);
@@ -309,12 +327,69 @@ static inline int hb_waiters_pending(struct futex_hash_bucket *hb)
  */
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
+	struct futex_private_hash *fph = NULL;
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
+
+	if (!(key->both.offset & (FUT_OFF_INODE | FUT_OFF_MMSHARED)))
+		fph = key->private.mm->futex_hash;
+	if (fph)
+		return &fph->queues[hash & fph->mask];
+
 	return &futex_queues[hash & (futex_hashsize - 1)];
 }
 
+/**
+ * futex_mm_share() - Set up the private futex hash of a shared mm
+ * @mm:		the mm that is about to gain another user
+ *
+ * Called by copy_mm() before a CLONE_VM child is attached to @mm. The
+ * table can only be switched while the caller is the sole user of @mm:
+ * nobody else can be queued on one of its private futexes then, so no
+ * waiter is left behind in the global hash. The table is sized by the
+ * number of cpus, which bounds how many threads contend at any time.
+ * On allocation failure the mm simply keeps using the global hash.
+ */
+void futex_mm_share(struct mm_struct *mm)
+{
+	struct futex_private_hash *fph;
+	unsigned long i, size;
+
+	if (!futex_private_hash_enabled || mm->futex_hash ||
+	    atomic_read(&mm->mm_users) != 1)
+		return;
+
+	size = roundup_pow_of_two(4 * num_online_cpus());
+	size = clamp_t(unsigned long, size, FUTEX_PRIVATE_HASH_MIN,
+		       min_t(unsigned long, futex_hashsize,
+			     FUTEX_PRIVATE_HASH_MAX));
+
+	fph = kmalloc_node(sizeof(*fph) + size * sizeof(fph->queues[0]),
+			   GFP_KERNEL | __GFP_NOWARN, numa_node_id());
+	if (!fph)
+		return;
+
+	fph->mask = size - 1;
+	for (i = 0; i < size; i++) {
+		atomic_set(&fph->queues[i].waiters, 0);
+		plist_head_init(&fph->queues[i].chain);
+		spin_lock_init(&fph->queues[i].lock);
+	}
+
+	mm->futex_hash = fph;
+}
+
+/**
+ * futex_mm_release() - Free the private futex hash of a dead mm
+ * @mm:		the mm whose last user is gone
+ */
+void futex_mm_release(struct mm_struct *mm)
+{
+	kfree(mm->futex_hash);
+	mm->futex_hash = NULL;
+}
+
 /*
  * Return 1 if two futex_keys are equal, 0 otherwise.
  */
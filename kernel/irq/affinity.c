@@ -0,0 +1,215 @@
+/*
+ * linux/kernel/irq/affinity.c
+ *
+ * Spreading of multiqueue device interrupts over NUMA nodes and CPUs,
+ * and management of the resulting affinities.
+ */
+
+#include <linux/interrupt.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/cpu.h>
+#include <linux/irq.h>
+
+#include "internals.h"
+
+/* Assign @cpus CPUs of @nmsk to @irqmsk, keeping thread siblings together */
+static void irq_spread_init_one(struct cpumask *irqmsk, struct cpumask *nmsk,
+				int cpus)
+{
+	const struct cpumask *siblmsk;
+	int cpu, sibl;
+
+	for ( ; cpus > 0; ) {
+		cpu = cpumask_first(nmsk);
+
+		/* Should not happen, but I'm too lazy to think about it */
+		if (cpu >= nr_cpu_ids)
+			return;
+
+		cpumask_clear_cpu(cpu, nmsk);
+		cpumask_set_cpu(cpu, irqmsk);
+		cpus--;
+
+		/* If the cpu has siblings, use them first */
+		siblmsk = topology_thread_cpumask(cpu);
+		for (sibl = -1; cpus > 0; ) {
+			sibl = cpumask_next(sibl, siblmsk);
+			if (sibl >= nr_cpu_ids)
+				break;
+			if (!cpumask_test_and_clear_cpu(sibl, nmsk))
+				continue;
+			cpumask_set_cpu(sibl, irqmsk);
+			cpus--;
+		}
+	}
+}
+
+static int get_nodes_in_cpumask(const struct cpumask *mask, nodemask_t *nodemsk)
+{
+	int n, nodes = 0;
+
+	/* Calculate the number of nodes in the supplied affinity mask */
+	for_each_online_node(n) {
+		if (cpumask_intersects(mask, cpumask_of_node(n))) {
+			node_set(n, *nodemsk);
+			nodes++;
+		}
+	}
+	return nodes;
+}
+
+/**
+ * irq_create_affinity_masks - Create affinity masks for multiqueue spreading
+ * @nvec:	The number of vectors
+ *
+ * Spreads the possible CPUs evenly over the NUMA nodes first and then over
+ * the vectors of each node, keeping thread siblings on the same vector.
+ * Possible rather than online CPUs are used, so the result stays valid
+ * across CPU hotplug.
+ *
+ * Return: an array of @nvec cpumasks to be freed with kfree(), or %NULL
+ * on allocation failure.
+ */
+struct cpumask *irq_create_affinity_masks(int nvec)
+{
+	int n, nodes, vecs_per_node, cpus_per_vec, extra_vecs, curvec = 0;
+	nodemask_t nodemsk = NODE_MASK_NONE;
+	struct cpumask *masks;
+	cpumask_var_t nmsk;
+
+	if (nvec <= 0)
+		return NULL;
+
+	if (!zalloc_cpumask_var(&nmsk, GFP_KERNEL))
+		return NULL;
+
+	masks = kcalloc(nvec, sizeof(*masks), GFP_KERNEL);
+	if (!masks)
+		goto out;
+
+	get_online_cpus();
+	nodes = get_nodes_in_cpumask(cpu_possible_mask, &nodemsk);
+
+	/*
+	 * If the number of nodes in the mask is greater than or equal the
+	 * number of vectors we just spread the vectors across the nodes.
+	 */
+	if (nvec <= nodes) {
+		for_each_node_mask(n, nodemsk) {
+			cpumask_and(masks + curvec, cpumask_of_node(n),
+				    cpu_possible_mask);
+			if (++curvec == nvec)
+				break;
+		}
+		goto done;
+	}
+
+	for_each_node_mask(n, nodemsk) {
+		int ncpus, v, vecs_to_assign;
+
+		/* Spread the vectors left over the nodes left */
+		vecs_per_node = (nvec - curvec) / nodes;
+		extra_vecs = (nvec - curvec) - vecs_per_node * nodes;
+		vecs_to_assign = vecs_per_node + (extra_vecs ? 1 : 0);
+
+		/* Get the cpus on this node which are in the mask */
+		cpumask_and(nmsk, cpu_possible_mask, cpumask_of_node(n));
+
+		/* Calculate the number of cpus per vector */
+		ncpus = cpumask_weight(nmsk);
+		vecs_to_assign = min(vecs_to_assign, ncpus);
+
+		for (v = 0; curvec < nvec && v < vecs_to_assign; curvec++, v++) {
+			cpus_per_vec = ncpus / (vecs_to_assign - v);
+			irq_spread_init_one(masks + curvec, nmsk, cpus_per_vec);
+			ncpus -= cpus_per_vec;
+		}
+
+		if (curvec >= nvec)
+			break;
+		nodes--;
+	}
+
+done:
+	put_online_cpus();
+
+	/* Vectors which didn't get CPUs (more vectors than CPUs) get all */
+	for (; curvec < nvec; curvec++)
+		cpumask_copy(masks + curvec, cpu_possible_mask);
+out:
+	free_cpumask_var(nmsk);
+	return masks;
+}
+EXPORT_SYMBOL_GPL(irq_create_affinity_masks);
+
+/**
+ * irq_set_managed_affinity - set a kernel managed affinity of an irq
+ * @irq:	Interrupt to manage
+ * @mask:	CPUs the interrupt is bound to, or %NULL to stop managing it
+ *
+ * The affinity of a managed interrupt can't be changed from user space,
+ * so irqbalance doesn't undo the queue to CPU mapping of multiqueue
+ * devices, and is restored when CPUs of @mask come back online after
+ * the interrupt has been moved off them.  @mask must stay valid until
+ * the interrupt is no longer managed.
+ */
+int irq_set_managed_affinity(unsigned int irq, const struct cpumask *mask)
+{
+	unsigned long flags;
+	struct irq_desc *desc = irq_get_desc_lock(irq, &flags,
+						  IRQ_GET_DESC_CHECK_GLOBAL);
+	int ret = 0;
+
+	if (!desc)
+		return -EINVAL;
+
+	desc->managed_affinity = mask;
+	if (mask) {
+		irqd_set(&desc->irq_data, IRQD_AFFINITY_MANAGED);
+		if (cpumask_intersects(mask, cpu_online_mask))
+			ret = irq_set_affinity_locked(&desc->irq_data,
+						      mask, false);
+	} else {
+		irqd_clear(&desc->irq_data, IRQD_AFFINITY_MANAGED);
+	}
+	irq_put_desc_unlock(desc, flags);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(irq_set_managed_affinity);
+
+/* Move managed interrupts of @cpu back to it when it comes online */
+static void irq_restore_managed_affinity(unsigned int cpu)
+{
+	struct irq_desc *desc;
+	unsigned long flags;
+	unsigned int irq;
+
+	for_each_irq_desc(irq, desc) {
+		raw_spin_lock_irqsave(&desc->lock, flags);
+		if (desc->managed_affinity &&
+		    cpumask_test_cpu(cpu, desc->managed_affinity) &&
+		    !cpumask_test_cpu(cpu, desc->irq_data.affinity))
+			irq_set_affinity_locked(&desc->irq_data,
+						desc->managed_affinity, false);
+		raw_spin_unlock_irqrestore(&desc->lock, flags);
+	}
+}
+
+static int irq_affinity_cpu_callback(struct notifier_block *nfb,
+				     unsigned long action, void *hcpu)
+{
+	switch (action & ~CPU_TASKS_FROZEN) {
+	case CPU_ONLINE:
+		irq_restore_managed_affinity((unsigned long)hcpu);
+		break;
+	}
+	return NOTIFY_OK;
+}
+
+static int __init irq_affinity_init(void)
+{
+	hotcpu_notifier(irq_affinity_cpu_callback, 0);
+	return 0;
+}
+core_initcall(irq_affinity_init);
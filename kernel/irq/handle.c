@@ -180,11 +180,69 @@ handle_irq_event_percpu(struct irq_desc *desc, struct irqaction *action)
 	return retval;
 }
 
+/* Length of the interrupt rate sampling window, in jiffies */
+#define IRQ_MODERATION_WINDOW	(HZ / 10 ? : 1)
+
+static unsigned int irq_moderation_level(struct irq_moderation_notify *mod)
+{
+	unsigned int level = mod->level, thr;
+
+	while (level < mod->nr_levels - 1 &&
+	       mod->rate >= mod->thresholds[level])
+		level++;
+	while (level > 0) {
+		thr = mod->thresholds[level - 1];
+		if (mod->rate >= thr - thr / 4)
+			break;
+		level--;
+	}
+	return level;
+}
+
+/*
+ * Measure the rate of @desc and suggest a new moderation level to the
+ * driver when it crosses one of its thresholds.  Called with desc->lock
+ * held.
+ */
+static void irq_moderation_account(struct irq_desc *desc)
+{
+	struct irq_moderation_notify *mod = desc->moderation_notify;
+	unsigned long now = jiffies, elapsed;
+	unsigned int rate, level;
+
+	mod->count++;
+	elapsed = now - mod->window_start;
+	if (elapsed < IRQ_MODERATION_WINDOW)
+		return;
+
+	rate = mod->count * HZ / elapsed;
+	/*
+	 * Average over a few windows, but forget the history after an idle
+	 * period, so a burst following it isn't handled with the latency
+	 * of a heavily moderated level or vice versa.
+	 */
+	if (elapsed > 4 * IRQ_MODERATION_WINDOW)
+		mod->rate = rate;
+	else
+		mod->rate = (3 * mod->rate + rate) / 4;
+	mod->count = 0;
+	mod->window_start = now;
+
+	level = irq_moderation_level(mod);
+	if (level != mod->level) {
+		mod->level = level;
+		schedule_work(&mod->work);
+	}
+}
+
 irqreturn_t handle_irq_event(struct irq_desc *desc)
 {
 	struct irqaction *action = desc->action;
 	irqreturn_t ret;
 
+	if (unlikely(desc->moderation_notify))
+		irq_moderation_account(desc);
+
 	desc->istate &= ~IRQS_PENDING;
 	irqd_set(&desc->irq_data, IRQD_IRQ_INPROGRESS);
 	raw_spin_unlock(&desc->lock);
@@ -340,6 +340,14 @@ setup_affinity(unsigned int irq, struct irq_desc *desc, struct cpumask *mask)
 			irqd_clear(&desc->irq_data, IRQD_AFFINITY_SET);
 	}
 
+	/* Managed interrupts stay on their CPUs, whatever their node */
+	if (desc->managed_affinity &&
+	    cpumask_intersects(desc->managed_affinity, cpu_online_mask)) {
+		cpumask_and(mask, cpu_online_mask, desc->managed_affinity);
+		irq_do_set_affinity(&desc->irq_data, mask, false);
+		return 0;
+	}
+
 	cpumask_and(mask, cpu_online_mask, set);
 	if (node != NUMA_NO_NODE) {
 		const struct cpumask *nodemask = cpumask_of_node(node);
@@ -382,6 +390,69 @@ setup_affinity(unsigned int irq, struct irq_desc *desc, struct cpumask *mask)
 }
 #endif
 
+static void irq_moderation_notify(struct work_struct *work)
+{
+	struct irq_moderation_notify *notify =
+		container_of(work, struct irq_moderation_notify, work);
+
+	notify->notify(notify, ACCESS_ONCE(notify->level),
+		       ACCESS_ONCE(notify->rate));
+}
+
+/**
+ *	irq_set_moderation_notifier - control adaptive moderation of an IRQ
+ *	@irq:		Interrupt for which to enable/disable moderation
+ *	@notify:	Context for moderation notification, or %NULL to
+ *			disable it.  Function pointer, @nr_levels and
+ *			@thresholds must be initialised; the other fields
+ *			will be initialised by this function.
+ *
+ *	The core measures the rate of @irq and calls @notify->notify with
+ *	the suggested moderation level whenever the rate crosses one of the
+ *	thresholds, so drivers share one heuristic for dynamic interrupt
+ *	coalescing instead of implementing their own.
+ *
+ *	Must be called in process context.  Moderation may only be enabled
+ *	after the IRQ is allocated and must be disabled before the IRQ is
+ *	freed using free_irq().
+ */
+int irq_set_moderation_notifier(unsigned int irq,
+				struct irq_moderation_notify *notify)
+{
+	struct irq_desc *desc = irq_to_desc(irq);
+	struct irq_moderation_notify *old_notify;
+	unsigned long flags;
+
+	might_sleep();
+
+	if (!desc)
+		return -EINVAL;
+
+	/* Complete initialisation of *notify */
+	if (notify) {
+		if (!notify->nr_levels || !notify->notify ||
+		    (notify->nr_levels > 1 && !notify->thresholds))
+			return -EINVAL;
+		notify->irq = irq;
+		notify->level = 0;
+		notify->rate = 0;
+		notify->count = 0;
+		notify->window_start = jiffies;
+		INIT_WORK(&notify->work, irq_moderation_notify);
+	}
+
+	raw_spin_lock_irqsave(&desc->lock, flags);
+	old_notify = desc->moderation_notify;
+	desc->moderation_notify = notify;
+	raw_spin_unlock_irqrestore(&desc->lock, flags);
+
+	if (old_notify)
+		cancel_work_sync(&old_notify->work);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(irq_set_moderation_notifier);
+
 void __disable_irq(struct irq_desc *desc, unsigned int irq, bool suspend)
 {
 	if (suspend) {
@@ -565,6 +636,36 @@ int irq_set_irq_wake(unsigned int irq, unsigned int on)
 }
 EXPORT_SYMBOL(irq_set_irq_wake);
 
+/**
+ *	irq_set_vcpu_affinity - Set vcpu affinity for the interrupt
+ *	@irq: interrupt number to set affinity
+ *	@vcpu_info: vCPU specific data, or NULL to return the interrupt
+ *		    to host delivery
+ *
+ *	This function uses the vCPU specific data to set the vCPU
+ *	affinity for an irq. The vCPU specific data is passed from
+ *	outside, such as KVM. One example code path is as below:
+ *	KVM -> IOMMU -> irq_set_vcpu_affinity().
+ */
+int irq_set_vcpu_affinity(unsigned int irq, void *vcpu_info)
+{
+	unsigned long flags;
+	struct irq_desc *desc = irq_get_desc_lock(irq, &flags, 0);
+	struct irq_chip *chip;
+	int ret = -ENOSYS;
+
+	if (!desc)
+		return -EINVAL;
+
+	chip = irq_desc_get_chip(desc);
+	if (chip && chip->irq_set_vcpu_affinity)
+		ret = chip->irq_set_vcpu_affinity(&desc->irq_data, vcpu_info);
+	irq_put_desc_unlock(desc, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(irq_set_vcpu_affinity);
+
 /*
  * Internal function that tells the architecture code whether a
  * particular irq has been exclusively allocated or is available
@@ -1421,6 +1522,8 @@ void free_irq(unsigned int irq, void *dev_id)
 	if (WARN_ON(desc->affinity_notify))
 		desc->affinity_notify = NULL;
 #endif
+	if (WARN_ON(desc->moderation_notify))
+		irq_set_moderation_notifier(irq, NULL);
 
 	chip_bus_lock(desc);
 	kfree(__free_irq(irq, dev_id));
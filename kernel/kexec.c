@@ -807,7 +807,7 @@ static int kimage_load_normal_segment(struct kimage *image,
 	while (mbytes) {
 		struct page *page;
 		char *ptr;
-		size_t uchunk, mchunk;
+		size_t uchunk, mchunk, offset;
 
 		page = kimage_alloc_page(image, GFP_HIGHUSER, maddr);
 		if (!page) {
@@ -820,14 +820,20 @@ static int kimage_load_normal_segment(struct kimage *image,
 			goto out;
 
 		ptr = kmap(page);
-		/* Start with a clear page */
-		clear_page(ptr);
-		ptr += maddr & ~PAGE_MASK;
-		mchunk = min_t(size_t, mbytes,
-				PAGE_SIZE - (maddr & ~PAGE_MASK));
+		offset = maddr & ~PAGE_MASK;
+		mchunk = min_t(size_t, mbytes, PAGE_SIZE - offset);
 		uchunk = min(ubytes, mchunk);
 
-		result = copy_from_user(ptr, buf, uchunk);
+		/* Only clear what the copy doesn't overwrite */
+		if (uchunk == 0)
+			clear_page(ptr);
+		else {
+			memset(ptr, 0, offset);
+			memset(ptr + offset + uchunk, 0,
+			       PAGE_SIZE - offset - uchunk);
+		}
+
+		result = copy_from_user(ptr + offset, buf, uchunk);
 		kunmap(page);
 		if (result) {
 			result = -EFAULT;
@@ -894,11 +900,28 @@ out:
 	return result;
 }
 
+/*
+ * With KEXEC_PRESERVE_MEMORY, a segment without a buffer describes memory
+ * whose content must survive the reboot, e.g. caches userspace wants to
+ * find again in the next kernel, which is told to keep away from it on
+ * its command line.  Listing it as a segment is enough: kimage_alloc_page()
+ * and the control page allocation never hand out pages in a destination
+ * range, so relocate_kernel doesn't write there.
+ */
+static bool kimage_segment_preserved(struct kimage *image,
+				     struct kexec_segment *segment)
+{
+	return image->preserve_memory && !segment->buf && !segment->bufsz;
+}
+
 static int kimage_load_segment(struct kimage *image,
 				struct kexec_segment *segment)
 {
 	int result = -ENOMEM;
 
+	if (kimage_segment_preserved(image, segment))
+		return 0;
+
 	switch (image->type) {
 	case KEXEC_TYPE_DEFAULT:
 		result = kimage_load_normal_segment(image, segment);
@@ -954,6 +977,10 @@ SYSCALL_DEFINE4(kexec_load, unsigned long, entry, unsigned long, nr_segments,
 	if ((flags & KEXEC_FLAGS) != (flags & ~KEXEC_ARCH_MASK))
 		return -EINVAL;
 
+	/* There is nothing to preserve in the crash kernel region */
+	if ((flags & KEXEC_ON_CRASH) && (flags & KEXEC_PRESERVE_MEMORY))
+		return -EINVAL;
+
 	/* Verify we are on the appropriate architecture */
 	if (((flags & KEXEC_ARCH_MASK) != KEXEC_ARCH) &&
 		((flags & KEXEC_ARCH_MASK) != KEXEC_ARCH_DEFAULT))
@@ -1004,6 +1031,8 @@ SYSCALL_DEFINE4(kexec_load, unsigned long, entry, unsigned long, nr_segments,
 
 		if (flags & KEXEC_PRESERVE_CONTEXT)
 			image->preserve_context = 1;
+		if (flags & KEXEC_PRESERVE_MEMORY)
+			image->preserve_memory = 1;
 		result = machine_kexec_prepare(image);
 		if (result)
 			goto out;
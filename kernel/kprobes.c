@@ -939,39 +939,140 @@ static int __kprobes prepare_kprobe(struct kprobe *p)
 	return arch_prepare_kprobe_ftrace(p);
 }
 
+/*
+ * Each update of the kprobe_ftrace_ops filter patches the ftrace call
+ * sites under stop_machine(). While a task registers or unregisters an
+ * array of kprobes, the kprobe-ftrace probes it arms or disarms are
+ * queued here instead, and kprobe_ftrace_batch_end() updates the filter
+ * once for all of them. Protected by kprobe_mutex.
+ */
+static struct task_struct *kprobe_ftrace_batch_task;
+static unsigned long *kprobe_ftrace_batch_ips;
+static unsigned int kprobe_ftrace_batch_cnt;
+static unsigned int kprobe_ftrace_batch_max;
+static int kprobe_ftrace_batch_remove;
+
 /* Caller must lock kprobe_mutex */
-static void __kprobes arm_kprobe_ftrace(struct kprobe *p)
+static void __kprobes __arm_kprobe_ftrace(unsigned long *ips, unsigned int cnt)
 {
 	int ret;
 
-	ret = ftrace_set_filter_ip(&kprobe_ftrace_ops,
-				   (unsigned long)p->addr, 0, 0);
-	WARN(ret < 0, "Failed to arm kprobe-ftrace at %p (%d)\n", p->addr, ret);
-	kprobe_ftrace_enabled++;
-	if (kprobe_ftrace_enabled == 1) {
+	ret = ftrace_set_filter_ips(&kprobe_ftrace_ops, ips, cnt, 0, 0);
+	WARN(ret < 0, "Failed to arm kprobe-ftrace at %p (%d)\n",
+	     (void *)ips[0], ret);
+	if (!kprobe_ftrace_enabled) {
 		ret = register_ftrace_function(&kprobe_ftrace_ops);
 		WARN(ret < 0, "Failed to init kprobe-ftrace (%d)\n", ret);
 	}
+	kprobe_ftrace_enabled += cnt;
 }
 
 /* Caller must lock kprobe_mutex */
-static void __kprobes disarm_kprobe_ftrace(struct kprobe *p)
+static void __kprobes __disarm_kprobe_ftrace(unsigned long *ips,
+					     unsigned int cnt)
 {
 	int ret;
 
-	kprobe_ftrace_enabled--;
+	kprobe_ftrace_enabled -= cnt;
 	if (kprobe_ftrace_enabled == 0) {
 		ret = unregister_ftrace_function(&kprobe_ftrace_ops);
 		WARN(ret < 0, "Failed to init kprobe-ftrace (%d)\n", ret);
 	}
-	ret = ftrace_set_filter_ip(&kprobe_ftrace_ops,
-			   (unsigned long)p->addr, 1, 0);
-	WARN(ret < 0, "Failed to disarm kprobe-ftrace at %p (%d)\n", p->addr, ret);
+	ret = ftrace_set_filter_ips(&kprobe_ftrace_ops, ips, cnt, 1, 0);
+	WARN(ret < 0, "Failed to disarm kprobe-ftrace at %p (%d)\n",
+	     (void *)ips[0], ret);
+}
+
+/* Caller must lock kprobe_mutex */
+static void __kprobes kprobe_ftrace_batch_flush(void)
+{
+	if (!kprobe_ftrace_batch_cnt)
+		return;
+
+	if (kprobe_ftrace_batch_remove)
+		__disarm_kprobe_ftrace(kprobe_ftrace_batch_ips,
+				       kprobe_ftrace_batch_cnt);
+	else
+		__arm_kprobe_ftrace(kprobe_ftrace_batch_ips,
+				    kprobe_ftrace_batch_cnt);
+	kprobe_ftrace_batch_cnt = 0;
+}
+
+/*
+ * Queue @p if current is batching. Otherwise the queued probes are
+ * processed first, so that they are seen in order, and false returned
+ * for @p to be done now.
+ */
+static bool __kprobes kprobe_ftrace_batch_add(struct kprobe *p, int remove)
+{
+	if (kprobe_ftrace_batch_task != current ||
+	    kprobe_ftrace_batch_remove != remove ||
+	    kprobe_ftrace_batch_cnt == kprobe_ftrace_batch_max) {
+		kprobe_ftrace_batch_flush();
+		return false;
+	}
+
+	kprobe_ftrace_batch_ips[kprobe_ftrace_batch_cnt++] =
+		(unsigned long)p->addr;
+	return true;
+}
+
+/* Caller must lock kprobe_mutex */
+static void __kprobes arm_kprobe_ftrace(struct kprobe *p)
+{
+	unsigned long ip = (unsigned long)p->addr;
+
+	if (!kprobe_ftrace_batch_add(p, 0))
+		__arm_kprobe_ftrace(&ip, 1);
+}
+
+/* Caller must lock kprobe_mutex */
+static void __kprobes disarm_kprobe_ftrace(struct kprobe *p)
+{
+	unsigned long ip = (unsigned long)p->addr;
+
+	if (!kprobe_ftrace_batch_add(p, 1))
+		__disarm_kprobe_ftrace(&ip, 1);
+}
+
+/*
+ * Start queueing the kprobe-ftrace probes current arms (or disarms if
+ * @remove) for up to @num probes. Without memory for the queue, they are
+ * simply armed one by one. Caller must lock kprobe_mutex.
+ */
+static void __kprobes kprobe_ftrace_batch_start(int num, int remove)
+{
+	if (num < 2 || kprobe_ftrace_batch_task)
+		return;
+
+	kprobe_ftrace_batch_ips = kmalloc_array(num, sizeof(unsigned long),
+						GFP_KERNEL | __GFP_NOWARN);
+	if (!kprobe_ftrace_batch_ips)
+		return;
+
+	kprobe_ftrace_batch_task = current;
+	kprobe_ftrace_batch_cnt = 0;
+	kprobe_ftrace_batch_max = num;
+	kprobe_ftrace_batch_remove = remove;
+}
+
+/* Caller must lock kprobe_mutex */
+static void __kprobes kprobe_ftrace_batch_end(void)
+{
+	if (kprobe_ftrace_batch_task != current)
+		return;
+
+	kprobe_ftrace_batch_flush();
+	kfree(kprobe_ftrace_batch_ips);
+	kprobe_ftrace_batch_ips = NULL;
+	kprobe_ftrace_batch_task = NULL;
 }
 #else	/* !CONFIG_KPROBES_ON_FTRACE */
 #define prepare_kprobe(p)	arch_prepare_kprobe(p)
 #define arm_kprobe_ftrace(p)	do {} while (0)
 #define disarm_kprobe_ftrace(p)	do {} while (0)
+#define kprobe_ftrace_batch_start(num, remove)	do {} while (0)
+#define kprobe_ftrace_batch_end()	do {} while (0)
 #endif
 
 /* Arm a kprobe with text_mutex */
@@ -1653,14 +1754,23 @@ int __kprobes register_kprobes(struct kprobe **kps, int num)
 
 	if (num <= 0)
 		return -EINVAL;
+
+	mutex_lock(&kprobe_mutex);
+	kprobe_ftrace_batch_start(num, 0);
+	mutex_unlock(&kprobe_mutex);
+
 	for (i = 0; i < num; i++) {
 		ret = register_kprobe(kps[i]);
-		if (ret < 0) {
-			if (i > 0)
-				unregister_kprobes(kps, i);
+		if (ret < 0)
 			break;
-		}
 	}
+
+	mutex_lock(&kprobe_mutex);
+	kprobe_ftrace_batch_end();
+	mutex_unlock(&kprobe_mutex);
+
+	if (ret < 0 && i > 0)
+		unregister_kprobes(kps, i);
 	return ret;
 }
 EXPORT_SYMBOL_GPL(register_kprobes);
@@ -1678,9 +1788,11 @@ void __kprobes unregister_kprobes(struct kprobe **kps, int num)
 	if (num <= 0)
 		return;
 	mutex_lock(&kprobe_mutex);
+	kprobe_ftrace_batch_start(num, 1);
 	for (i = 0; i < num; i++)
 		if (__unregister_kprobe_top(kps[i]) < 0)
 			kps[i]->addr = NULL;
+	kprobe_ftrace_batch_end();
 	mutex_unlock(&kprobe_mutex);
 
 	synchronize_sched();
@@ -1867,14 +1979,23 @@ int __kprobes register_kretprobes(struct kretprobe **rps, int num)
 
 	if (num <= 0)
 		return -EINVAL;
+
+	mutex_lock(&kprobe_mutex);
+	kprobe_ftrace_batch_start(num, 0);
+	mutex_unlock(&kprobe_mutex);
+
 	for (i = 0; i < num; i++) {
 		ret = register_kretprobe(rps[i]);
-		if (ret < 0) {
-			if (i > 0)
-				unregister_kretprobes(rps, i);
+		if (ret < 0)
 			break;
-		}
 	}
+
+	mutex_lock(&kprobe_mutex);
+	kprobe_ftrace_batch_end();
+	mutex_unlock(&kprobe_mutex);
+
+	if (ret < 0 && i > 0)
+		unregister_kretprobes(rps, i);
 	return ret;
 }
 EXPORT_SYMBOL_GPL(register_kretprobes);
@@ -1892,9 +2013,11 @@ void __kprobes unregister_kretprobes(struct kretprobe **rps, int num)
 	if (num <= 0)
 		return;
 	mutex_lock(&kprobe_mutex);
+	kprobe_ftrace_batch_start(num, 1);
 	for (i = 0; i < num; i++)
 		if (__unregister_kprobe_top(&rps[i]->kp) < 0)
 			rps[i]->kp.addr = NULL;
+	kprobe_ftrace_batch_end();
 	mutex_unlock(&kprobe_mutex);
 
 	synchronize_sched();
@@ -17,6 +17,7 @@
 #include <linux/slab.h>
 #include <linux/freezer.h>
 #include <linux/ptrace.h>
+#include <linux/tick.h>
 #include <linux/uaccess.h>
 #include <trace/events/sched.h>
 
@@ -315,10 +316,11 @@ struct task_struct *kthread_create_on_node(int (*threadfn)(void *data),
 		va_end(args);
 		/*
 		 * root may have changed our (kthreadd's) priority or CPU mask.
-		 * The kernel thread should not inherit these properties.
+		 * The kernel thread should not inherit these properties, but
+		 * stays off the nohz_full CPUs.
 		 */
 		sched_setscheduler_nocheck(task, SCHED_NORMAL, &param);
-		set_cpus_allowed_ptr(task, cpu_all_mask);
+		set_cpus_allowed_ptr(task, housekeeping_cpumask());
 	}
 	kfree(create);
 	return task;
@@ -488,6 +490,7 @@ int kthreadd(void *unused)
 	set_task_comm(tsk, "kthreadd");
 	ignore_signals(tsk);
 	set_cpus_allowed_ptr(tsk, cpu_all_mask);
+	housekeeping_affine(tsk);
 	set_mems_allowed(node_states[N_MEMORY]);
 
 	current->flags |= PF_NOFREEZE;
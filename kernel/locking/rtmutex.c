@@ -690,6 +690,57 @@ void rt_mutex_adjust_pi(struct task_struct *task)
 	rt_mutex_adjust_prio_chain(task, 0, NULL, NULL, task);
 }
 
+#if defined(CONFIG_SMP) && !defined(CONFIG_RT_MUTEX_TESTER)
+/*
+ * Adaptive spinning: as long as the owner of @lock is running on another
+ * cpu, the lock is likely to be released soon and waiting for that is
+ * cheaper than sleeping and being woken up again. Only the top waiter
+ * spins, it is the one that will be handed the lock.
+ *
+ * Called with lock->wait_lock held, returns with it released. Returns
+ * true when the owner let go of the lock and the caller should retry
+ * instead of going to sleep.
+ */
+static bool rt_mutex_spin_on_owner(struct rt_mutex *lock,
+				   struct rt_mutex_waiter *waiter)
+{
+	struct task_struct *owner = rt_mutex_owner(lock);
+	bool ret = false;
+
+	if (!owner || rt_mutex_top_waiter(lock) != waiter) {
+		raw_spin_unlock(&lock->wait_lock);
+		return false;
+	}
+
+	/* The rcu read lock keeps the owner task_struct alive. */
+	rcu_read_lock();
+	raw_spin_unlock(&lock->wait_lock);
+
+	while (rt_mutex_owner(lock) == owner) {
+		/*
+		 * Ensure we dereference owner->on_cpu only after having
+		 * checked that it still owns the lock.
+		 */
+		barrier();
+		if (!owner->on_cpu || need_resched())
+			goto out;
+
+		arch_mutex_cpu_relax();
+	}
+	ret = true;
+out:
+	rcu_read_unlock();
+	return ret;
+}
+#else
+static bool rt_mutex_spin_on_owner(struct rt_mutex *lock,
+				   struct rt_mutex_waiter *waiter)
+{
+	raw_spin_unlock(&lock->wait_lock);
+	return false;
+}
+#endif
+
 /**
  * __rt_mutex_slowlock() - Perform the wait-wake-try-to-take loop
  * @lock:		 the rt_mutex to take
@@ -726,11 +777,11 @@ __rt_mutex_slowlock(struct rt_mutex *lock, int state,
 				break;
 		}
 
-		raw_spin_unlock(&lock->wait_lock);
-
-		debug_rt_mutex_print_deadlock(waiter);
+		if (!rt_mutex_spin_on_owner(lock, waiter)) {
+			debug_rt_mutex_print_deadlock(waiter);
 
-		schedule_rt_mutex(lock);
+			schedule_rt_mutex(lock);
+		}
 
 		raw_spin_lock(&lock->wait_lock);
 		set_current_state(state);
@@ -10,6 +10,9 @@
 #include <linux/sched.h>
 #include <linux/init.h>
 #include <linux/export.h>
+#include <linux/sched/rt.h>
+
+#include "mcs_spinlock.h"
 
 /*
  * Initialize an rwsem:
@@ -27,6 +30,10 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	sem->count = RWSEM_UNLOCKED_VALUE;
 	raw_spin_lock_init(&sem->wait_lock);
 	INIT_LIST_HEAD(&sem->wait_list);
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	sem->owner = NULL;
+	sem->osq = NULL;
+#endif
 }
 
 EXPORT_SYMBOL(__init_rwsem);
@@ -140,6 +147,209 @@ __rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
 	return sem;
 }
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * Try to acquire write lock before the writer has been put on wait queue.
+ */
+static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
+{
+	long old, count = ACCESS_ONCE(sem->count);
+
+	while (true) {
+		if (!(count == 0 || count == RWSEM_WAITING_BIAS))
+			return false;
+
+		old = cmpxchg(&sem->count, count, count + RWSEM_ACTIVE_WRITE_BIAS);
+		if (old == count)
+			return true;
+
+		count = old;
+	}
+}
+
+/*
+ * Try to acquire read lock without queueing. Only done while nobody is
+ * queued, a waiting writer must not be starved by spinning readers.
+ */
+static inline bool rwsem_try_read_lock_unqueued(struct rw_semaphore *sem)
+{
+	long old, count = ACCESS_ONCE(sem->count);
+
+	while (count >= 0) {
+		old = cmpxchg(&sem->count, count, count + RWSEM_ACTIVE_READ_BIAS);
+		if (old == count)
+			return true;
+
+		count = old;
+	}
+	return false;
+}
+
+/*
+ * Would the lock be available to us right now? Without a write owner the
+ * rwsem is either free, held by readers, or a writer has not set the
+ * owner field yet; only the first is worth spinning on.
+ */
+static inline bool rwsem_looks_free(struct rw_semaphore *sem, bool read)
+{
+	long count = ACCESS_ONCE(sem->count);
+
+	if (read)
+		return count >= 0;
+
+	return count == 0 || count == RWSEM_WAITING_BIAS;
+}
+
+static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem, bool read)
+{
+	struct task_struct *owner;
+	bool on_cpu;
+
+	if (need_resched())
+		return false;
+
+	rcu_read_lock();
+	owner = ACCESS_ONCE(sem->owner);
+	if (owner)
+		on_cpu = owner->on_cpu;
+	else
+		on_cpu = rwsem_looks_free(sem, read);
+	rcu_read_unlock();
+
+	return on_cpu;
+}
+
+static inline bool owner_running(struct rw_semaphore *sem,
+				 struct task_struct *owner)
+{
+	if (sem->owner != owner)
+		return false;
+
+	/*
+	 * Ensure we emit the owner->on_cpu, dereference _after_ checking
+	 * sem->owner still matches owner, if that fails, owner might
+	 * point to free()d memory, if it still matches, the rcu_read_lock()
+	 * ensures the memory stays valid.
+	 */
+	barrier();
+
+	return owner->on_cpu;
+}
+
+/*
+ * Spin while the write owner is running. Returns true when the owner is
+ * gone and the lock looks available, false when we should stop spinning:
+ * the owner got preempted or blocked, or another writer took over.
+ */
+static noinline
+bool rwsem_spin_on_owner(struct rw_semaphore *sem, bool read)
+{
+	struct task_struct *owner = ACCESS_ONCE(sem->owner);
+
+	if (owner) {
+		rcu_read_lock();
+		while (owner_running(sem, owner)) {
+			if (need_resched())
+				break;
+
+			arch_mutex_cpu_relax();
+		}
+		rcu_read_unlock();
+
+		if (ACCESS_ONCE(sem->owner))
+			return false;
+	}
+
+	return rwsem_looks_free(sem, read);
+}
+
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+{
+	bool taken = false;
+
+	preempt_disable();
+
+	/* sem->wait_lock should not be held when doing optimistic spinning */
+	if (!rwsem_can_spin_on_owner(sem, false))
+		goto done;
+
+	if (!osq_lock(&sem->osq))
+		goto done;
+
+	while (rwsem_spin_on_owner(sem, false)) {
+		if (rwsem_try_write_lock_unqueued(sem)) {
+			taken = true;
+			break;
+		}
+
+		if (need_resched() || rt_task(current))
+			break;
+
+		arch_mutex_cpu_relax();
+	}
+	osq_unlock(&sem->osq);
+done:
+	preempt_enable();
+	return taken;
+}
+
+/*
+ * Readers only spin on a running write owner, there is no way to tell
+ * whether the holders of a read owned rwsem are on a cpu. Nor do they
+ * spin once somebody is queued, so as not to starve a waiting writer.
+ */
+static inline bool rwsem_can_read_spin(struct rw_semaphore *sem)
+{
+	return list_empty(&sem->wait_list) && ACCESS_ONCE(sem->owner) &&
+	       rwsem_can_spin_on_owner(sem, true);
+}
+
+/*
+ * Readers don't take the osq: they don't exclude each other, a queue
+ * would only serialise them behind one another once the writer is gone.
+ */
+static bool rwsem_optimistic_read_spin(struct rw_semaphore *sem)
+{
+	bool taken = false;
+
+	preempt_disable();
+	while (rwsem_spin_on_owner(sem, true)) {
+		if (rwsem_try_read_lock_unqueued(sem)) {
+			taken = true;
+			break;
+		}
+
+		if (need_resched() || rt_task(current))
+			break;
+
+		arch_mutex_cpu_relax();
+	}
+	preempt_enable();
+	return taken;
+}
+
+#else
+static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem, bool read)
+{
+	return false;
+}
+
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+{
+	return false;
+}
+
+static inline bool rwsem_can_read_spin(struct rw_semaphore *sem)
+{
+	return false;
+}
+
+static bool rwsem_optimistic_read_spin(struct rw_semaphore *sem)
+{
+	return false;
+}
+#endif
+
 /*
  * wait for the read lock to be granted
  */
@@ -149,6 +359,19 @@ struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
 	long count, adjustment = -RWSEM_ACTIVE_READ_BIAS;
 	struct rwsem_waiter waiter;
 	struct task_struct *tsk = current;
+	bool first = false;
+
+	/*
+	 * If a writer is running with the lock, drop our read bias and spin
+	 * until it is done: a short write side critical section is cheaper
+	 * to wait out than two context switches.
+	 */
+	if (rwsem_can_read_spin(sem)) {
+		rwsem_atomic_update(-RWSEM_ACTIVE_READ_BIAS, sem);
+		adjustment = 0;
+		if (rwsem_optimistic_read_spin(sem))
+			return sem;
+	}
 
 	/* set up my own style of waitqueue */
 	waiter.task = tsk;
@@ -156,8 +379,10 @@ struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
 	get_task_struct(tsk);
 
 	raw_spin_lock_irq(&sem->wait_lock);
-	if (list_empty(&sem->wait_list))
+	if (list_empty(&sem->wait_list)) {
 		adjustment += RWSEM_WAITING_BIAS;
+		first = true;
+	}
 	list_add_tail(&waiter.list, &sem->wait_list);
 
 	/* we're now waiting on the lock, but no longer actively locking */
@@ -169,8 +394,7 @@ struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
 	 * wake our own waiter to join the existing active readers !
 	 */
 	if (count == RWSEM_WAITING_BIAS ||
-	    (count > RWSEM_WAITING_BIAS &&
-	     adjustment != -RWSEM_ACTIVE_READ_BIAS))
+	    (count > RWSEM_WAITING_BIAS && first))
 		sem = __rwsem_do_wake(sem, RWSEM_WAKE_ANY);
 
 	raw_spin_unlock_irq(&sem->wait_lock);
@@ -197,14 +421,25 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 	long count, adjustment = -RWSEM_ACTIVE_WRITE_BIAS;
 	struct rwsem_waiter waiter;
 	struct task_struct *tsk = current;
+	bool first = false;
+
+	/* no longer actively locking, spin and steal the lock if possible */
+	if (rwsem_can_spin_on_owner(sem, false)) {
+		rwsem_atomic_update(-RWSEM_ACTIVE_WRITE_BIAS, sem);
+		adjustment = 0;
+		if (rwsem_optimistic_spin(sem))
+			return sem;
+	}
 
 	/* set up my own style of waitqueue */
 	waiter.task = tsk;
 	waiter.type = RWSEM_WAITING_FOR_WRITE;
 
 	raw_spin_lock_irq(&sem->wait_lock);
-	if (list_empty(&sem->wait_list))
+	if (list_empty(&sem->wait_list)) {
 		adjustment += RWSEM_WAITING_BIAS;
+		first = true;
+	}
 	list_add_tail(&waiter.list, &sem->wait_list);
 
 	/* we're now waiting on the lock, but no longer actively locking */
@@ -213,8 +448,7 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 	/* If there were already threads queued before us and there are no
 	 * active writers, the lock must be read owned; so we try to wake
 	 * any read locks that were queued ahead of us. */
-	if (count > RWSEM_WAITING_BIAS &&
-	    adjustment == -RWSEM_ACTIVE_WRITE_BIAS)
+	if (count > RWSEM_WAITING_BIAS && !first)
 		sem = __rwsem_do_wake(sem, RWSEM_WAKE_READERS);
 
 	/* wait until we successfully acquire the lock */
@@ -3012,6 +3012,7 @@ static void do_mod_ctors(struct module *mod)
 /* This is where the real work happens */
 static int do_init_module(struct module *mod)
 {
+	void *init_region;
 	int ret = 0;
 
 	/*
@@ -3093,13 +3094,23 @@ static int do_init_module(struct module *mod)
 	mod->symtab = mod->core_symtab;
 	mod->strtab = mod->core_strtab;
 #endif
+	/*
+	 * Under module_mutex, so set_all_modules_text_ro() can't make the
+	 * init text RO again before it is unlinked below.
+	 */
 	unset_module_init_ro_nx(mod);
-	module_free(mod, mod->module_init);
+	init_region = mod->module_init;
 	mod->module_init = NULL;
 	mod->init_size = 0;
 	mod->init_ro_size = 0;
 	mod->init_text_size = 0;
 	mutex_unlock(&module_mutex);
+
+	/*
+	 * Once unlinked from @mod the init sections are ours: don't hold up
+	 * the other loaders while freeing them.
+	 */
+	module_free(mod, init_region);
 	wake_up_all(&module_wq);
 
 	return 0;
@@ -3184,7 +3195,12 @@ static int unknown_module_param_cb(char *param, char *val, const char *modname)
 }
 
 /* Allocate and load the module: note that size of section 0 is always
-   zero, and we rely on this for optional sections. */
+   zero, and we rely on this for optional sections.
+
+   Loads run in parallel: module_mutex is only taken to reserve the name
+   in add_unformed_module(), per symbol in resolve_symbol(), and to
+   publish the module in complete_formation().  The signature check,
+   layout, relocations and init all run unlocked. */
 static int load_module(struct load_info *info, const char __user *uargs,
 		       int flags)
 {
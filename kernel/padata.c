@@ -134,6 +134,7 @@ int padata_do_parallel(struct padata_instance *pinst,
 	padata->cb_cpu = cb_cpu;
 
 	target_cpu = padata_cpu_hash(pd);
+	padata->cpu = target_cpu;
 	queue = per_cpu_ptr(pd->pqueue, target_cpu);
 
 	spin_lock(&queue->parallel.lock);
@@ -149,6 +150,21 @@ out:
 }
 EXPORT_SYMBOL(padata_do_parallel);
 
+/* The percpu reorder queue the next object to serialize will be on. */
+static struct padata_parallel_queue *padata_next_queue(struct parallel_data *pd)
+{
+	unsigned int next_index;
+	int cpu;
+
+	/*
+	 * Calculate the percpu reorder queue of the next object from
+	 * its sequence number.
+	 */
+	next_index = pd->processed % cpumask_weight(pd->cpumask.pcpu);
+	cpu = padata_index_to_cpu(pd, next_index);
+	return per_cpu_ptr(pd->pqueue, cpu);
+}
+
 /*
  * padata_get_next - Get the next object that needs serialization.
  *
@@ -159,31 +175,17 @@ EXPORT_SYMBOL(padata_do_parallel);
  *
  * NULL, if all percpu reorder queues are empty.
  *
- * -EINPROGRESS, if the next object that needs serialization will
- *  be parallel processed by another cpu and is not yet present in
- *  the cpu's reorder queue.
- *
- * -ENODATA, if this cpu has to do the parallel processing for
- *  the next object.
+ * -EINPROGRESS, if the next object that needs serialization is
+ *  still being processed and is not yet present in its cpu's
+ *  reorder queue.
  */
 static struct padata_priv *padata_get_next(struct parallel_data *pd)
 {
-	int cpu, num_cpus;
-	unsigned int next_nr, next_index;
 	struct padata_parallel_queue *next_queue;
 	struct padata_priv *padata;
 	struct padata_list *reorder;
 
-	num_cpus = cpumask_weight(pd->cpumask.pcpu);
-
-	/*
-	 * Calculate the percpu reorder queue and the sequence
-	 * number of the next object.
-	 */
-	next_nr = pd->processed;
-	next_index = next_nr % num_cpus;
-	cpu = padata_index_to_cpu(pd, next_index);
-	next_queue = per_cpu_ptr(pd->pqueue, cpu);
+	next_queue = padata_next_queue(pd);
 
 	padata = NULL;
 
@@ -203,11 +205,6 @@ static struct padata_priv *padata_get_next(struct parallel_data *pd)
 		goto out;
 	}
 
-	if (__this_cpu_read(pd->pqueue->cpu_index) == next_queue->cpu_index) {
-		padata = ERR_PTR(-ENODATA);
-		goto out;
-	}
-
 	padata = ERR_PTR(-EINPROGRESS);
 out:
 	return padata;
@@ -218,6 +215,7 @@ static void padata_reorder(struct parallel_data *pd)
 	int cb_cpu;
 	struct padata_priv *padata;
 	struct padata_serial_queue *squeue;
+	struct padata_parallel_queue *next_queue;
 	struct padata_instance *pinst = pd->pinst;
 
 	/*
@@ -238,24 +236,13 @@ static void padata_reorder(struct parallel_data *pd)
 
 		/*
 		 * All reorder queues are empty, or the next object that needs
-		 * serialization is parallel processed by another cpu and is
-		 * still on it's way to the cpu's reorder queue, nothing to
-		 * do for now.
+		 * serialization is still being processed and on it's way to
+		 * its reorder queue, nothing to do for now. Whoever queues
+		 * it will call us again.
 		 */
 		if (!padata || PTR_ERR(padata) == -EINPROGRESS)
 			break;
 
-		/*
-		 * This cpu has to do the parallel processing of the next
-		 * object. It's waiting in the cpu's parallelization queue,
-		 * so exit immediately.
-		 */
-		if (PTR_ERR(padata) == -ENODATA) {
-			del_timer(&pd->timer);
-			spin_unlock_bh(&pd->lock);
-			return;
-		}
-
 		cb_cpu = padata->cb_cpu;
 		squeue = per_cpu_ptr(pd->squeue, cb_cpu);
 
@@ -270,21 +257,26 @@ static void padata_reorder(struct parallel_data *pd)
 
 	/*
 	 * The next object that needs serialization might have arrived to
-	 * the reorder queues in the meantime, we will be called again
-	 * from the timer function if no one else cares for it.
+	 * the reorder queues while we held the lock, in which case its
+	 * padata_do_serial() failed the trylock above and left it to us.
+	 * Pick it up right away instead of waiting for more traffic.
+	 *
+	 * Pairs with the smp_mb() in padata_do_serial().
 	 */
-	if (atomic_read(&pd->reorder_objects)
-			&& !(pinst->flags & PADATA_RESET))
-		mod_timer(&pd->timer, jiffies + HZ);
-	else
-		del_timer(&pd->timer);
+	smp_mb();
 
-	return;
+	if (atomic_read(&pd->reorder_objects)
+			&& !(pinst->flags & PADATA_RESET)) {
+		next_queue = padata_next_queue(pd);
+		if (!list_empty(&next_queue->reorder.list))
+			queue_work(pinst->wq, &pd->reorder_work);
+	}
 }
 
-static void padata_reorder_timer(unsigned long arg)
+static void padata_reorder_work(struct work_struct *work)
 {
-	struct parallel_data *pd = (struct parallel_data *)arg;
+	struct parallel_data *pd = container_of(work, struct parallel_data,
+						reorder_work);
 
 	padata_reorder(pd);
 }
@@ -333,7 +325,12 @@ void padata_do_serial(struct padata_priv *padata)
 
 	pd = padata->pd;
 
-	cpu = get_cpu();
+	/*
+	 * Async crypto may complete on a different cpu than the one the
+	 * object was parallelized on; it still belongs in that cpu's
+	 * reorder queue.
+	 */
+	cpu = padata->cpu;
 	pqueue = per_cpu_ptr(pd->pqueue, cpu);
 
 	spin_lock(&pqueue->reorder.lock);
@@ -341,7 +338,11 @@ void padata_do_serial(struct padata_priv *padata)
 	list_add_tail(&padata->list, &pqueue->reorder.list);
 	spin_unlock(&pqueue->reorder.lock);
 
-	put_cpu();
+	/*
+	 * Make the object visible before trying the reorder lock, pairs
+	 * with the smp_mb() in padata_reorder().
+	 */
+	smp_mb();
 
 	padata_reorder(pd);
 }
@@ -427,7 +428,7 @@ static struct parallel_data *padata_alloc_pd(struct padata_instance *pinst,
 
 	padata_init_pqueues(pd);
 	padata_init_squeues(pd);
-	setup_timer(&pd->timer, padata_reorder_timer, (unsigned long)pd);
+	INIT_WORK(&pd->reorder_work, padata_reorder_work);
 	atomic_set(&pd->seq_nr, -1);
 	atomic_set(&pd->reorder_objects, 0);
 	atomic_set(&pd->refcnt, 0);
@@ -467,7 +468,7 @@ static void padata_flush_queues(struct parallel_data *pd)
 		flush_work(&pqueue->work);
 	}
 
-	del_timer_sync(&pd->timer);
+	flush_work(&pd->reorder_work);
 
 	if (atomic_read(&pd->reorder_objects))
 		padata_reorder(pd);
@@ -114,6 +114,7 @@ void panic(const char *fmt, ...)
 	 * everything else.
 	 * Do we want to call this before we try to display a message?
 	 */
+	printk_stage_flush_all();
 	crash_kexec(NULL);
 
 	/*
@@ -123,6 +124,9 @@ void panic(const char *fmt, ...)
 	 */
 	smp_send_stop();
 
+	/* The stopped CPUs may have left NMI messages behind */
+	printk_stage_flush_all();
+
 	/*
 	 * Run any panic handlers, including those that might need to
 	 * add information to the kmsg dump output.
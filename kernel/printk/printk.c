@@ -44,6 +44,7 @@
 #include <linux/rculist.h>
 #include <linux/poll.h>
 #include <linux/irq_work.h>
+#include <linux/kthread.h>
 #include <linux/utsname.h>
 
 #include <asm/uaccess.h>
@@ -121,6 +122,9 @@ EXPORT_SYMBOL(console_set_on_cmdline);
 /* Flag: console code may call schedule() */
 static int console_may_schedule;
 
+/* writes to the consoles on behalf of printk(), see printk_offload() */
+static struct task_struct *printk_kthread;
+
 /*
  * The printk log buffer consists of a chain of concatenated variable
  * length records. Every record starts with a record header, containing
@@ -1483,6 +1487,182 @@ static size_t cont_print_text(char *text, size_t size)
 	return textlen;
 }
 
+/*
+ * Messages printed from NMI, or by printk() recursing into itself, can't
+ * take logbuf_lock: this CPU may hold it already. They are staged in a
+ * per-CPU buffer instead, which is only ever appended to locklessly, and
+ * moved to the log buffer from irq_work on the same CPU. A CPU spinning
+ * with interrupts disabled never runs that irq_work, so panic() and the
+ * NMI backtrace code also drain all CPUs' buffers, see
+ * printk_stage_flush_all().
+ */
+#define PRINTK_STAGE_SIZE	4096
+
+struct printk_stage {
+	atomic_t		len;	/* bytes used in buffer */
+	raw_spinlock_t		lock;	/* serializes flushers */
+	struct irq_work		work;
+	char			buffer[PRINTK_STAGE_SIZE];
+};
+
+static void printk_stage_flush(struct irq_work *work);
+
+static DEFINE_PER_CPU(struct printk_stage, printk_stage) = {
+	.lock = __RAW_SPIN_LOCK_UNLOCKED(printk_stage.lock),
+	.work = {
+		.func = printk_stage_flush,
+	},
+};
+
+static atomic_t printk_stage_lost;
+static atomic_t printk_stage_dirty;
+
+/* Called with interrupts disabled */
+static int printk_stage_vprintk(const char *fmt, va_list args)
+{
+	struct printk_stage *s = this_cpu_ptr(&printk_stage);
+	va_list ap;
+	int len, add;
+
+again:
+	len = atomic_read(&s->len);
+	if (len >= PRINTK_STAGE_SIZE - 1) {
+		atomic_inc(&printk_stage_lost);
+		return 0;
+	}
+
+	va_copy(ap, args);
+	add = vscnprintf(s->buffer + len, PRINTK_STAGE_SIZE - len, fmt, ap);
+	va_end(ap);
+
+	/* An NMI appended to the buffer meanwhile, write after it */
+	if (atomic_cmpxchg(&s->len, len, len + add) != len)
+		goto again;
+
+	atomic_set(&printk_stage_dirty, 1);
+	irq_work_queue(&s->work);
+	return add;
+}
+
+/* Store the staged text as printed, line by line to keep the log levels */
+static void __printk_stage_flush(struct printk_stage *s)
+{
+	int start = 0, len, lost, i;
+	unsigned long flags;
+	bool locked = true;
+
+	/*
+	 * A CPU stopped by panic() may have been in the middle of a flush,
+	 * don't wait for it then.
+	 */
+	if (oops_in_progress)
+		locked = raw_spin_trylock_irqsave(&s->lock, flags);
+	else
+		raw_spin_lock_irqsave(&s->lock, flags);
+
+more:
+	len = atomic_read(&s->len);
+	for (i = start; i < len; start = ++i) {
+		while (i < len - 1 && s->buffer[i] != '\n')
+			i++;
+		printk("%.*s", i - start + 1, s->buffer + start);
+	}
+
+	/* Reset, unless an NMI appended more text meanwhile */
+	if (atomic_cmpxchg(&s->len, len, 0) != len)
+		goto more;
+
+	if (locked)
+		raw_spin_unlock_irqrestore(&s->lock, flags);
+
+	lost = atomic_xchg(&printk_stage_lost, 0);
+	if (lost)
+		printk(KERN_WARNING "printk: %d messages lost in NMI\n", lost);
+}
+
+static void printk_stage_flush(struct irq_work *work)
+{
+	__printk_stage_flush(container_of(work, struct printk_stage, work));
+}
+
+/**
+ * printk_stage_flush_all - move the text staged by all CPUs to the log
+ *
+ * For callers that may be looking at CPUs stuck with interrupts disabled,
+ * e.g. after NMI backtraces or on panic. Must not be called from NMI.
+ */
+void printk_stage_flush_all(void)
+{
+	int cpu;
+
+	if (!atomic_xchg(&printk_stage_dirty, 0))
+		return;
+
+	for_each_possible_cpu(cpu)
+		__printk_stage_flush(&per_cpu(printk_stage, cpu));
+}
+
+static bool printk_sync;
+module_param_named(synchronous, printk_sync, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(synchronous, "write to the consoles from the printk() caller");
+
+static int printk_kthread_pending;
+
+static void printk_kthread_wake(struct irq_work *work)
+{
+	wake_up_process(printk_kthread);
+}
+
+static DEFINE_PER_CPU(struct irq_work, printk_kthread_work) = {
+	.func = printk_kthread_wake,
+	.flags = IRQ_WORK_LAZY,
+};
+
+/*
+ * Whether printk() should leave the consoles to printk_kthread, instead
+ * of writing to them itself for as long as other CPUs keep adding
+ * messages. Slow serial consoles would otherwise stall whichever task
+ * happens to print during a burst of messages. When the system is
+ * crashing or going down, the messages go out right away as before.
+ */
+static bool printk_offload(void)
+{
+	return printk_kthread && !printk_sync && !oops_in_progress &&
+	       system_state == SYSTEM_RUNNING;
+}
+
+static int printk_kthread_func(void *data)
+{
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!printk_kthread_pending)
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		/* Messages stored after this are flushed or wake us again */
+		printk_kthread_pending = 0;
+		smp_mb();
+
+		console_lock();
+		console_unlock();
+	}
+	return 0;
+}
+
+static int __init printk_kthread_init(void)
+{
+	struct task_struct *thread;
+
+	thread = kthread_run(printk_kthread_func, NULL, "printk");
+	if (IS_ERR(thread)) {
+		pr_err("printk: unable to create printing thread\n");
+		return PTR_ERR(thread);
+	}
+	printk_kthread = thread;
+	return 0;
+}
+late_initcall(printk_kthread_init);
+
 asmlinkage int vprintk_emit(int facility, int level,
 			    const char *dict, size_t dictlen,
 			    const char *fmt, va_list args)
@@ -1503,6 +1683,15 @@ asmlinkage int vprintk_emit(int facility, int level,
 	local_irq_save(flags);
 	this_cpu = smp_processor_id();
 
+	/*
+	 * In NMI, stage the message unless we are crashing and it
+	 * should be printed right away.
+	 */
+	if (unlikely(in_nmi() && !oops_in_progress)) {
+		printed_len = printk_stage_vprintk(fmt, args);
+		goto out_restore_irqs;
+	}
+
 	/*
 	 * Ouch, printk recursed into itself!
 	 */
@@ -1510,12 +1699,13 @@ asmlinkage int vprintk_emit(int facility, int level,
 		/*
 		 * If a crash is occurring during printk() on this CPU,
 		 * then try to get the crash message out but make sure
-		 * we can't deadlock. Otherwise just return to avoid the
-		 * recursion and return - but flag the recursion so that
-		 * it can be printed at the next appropriate moment:
+		 * we can't deadlock. Otherwise stage the message to avoid
+		 * the recursion - and flag the recursion so that it can be
+		 * printed at the next appropriate moment:
 		 */
 		if (!oops_in_progress && !lockdep_recursing(current)) {
 			recursion_bug = 1;
+			printed_len = printk_stage_vprintk(fmt, args);
 			goto out_restore_irqs;
 		}
 		zap_locks();
@@ -1620,8 +1810,16 @@ asmlinkage int vprintk_emit(int facility, int level,
 	 *
 	 * The console_trylock_for_printk() function will release 'logbuf_lock'
 	 * regardless of whether it actually gets the console semaphore or not.
+	 *
+	 * Unless printk_kthread does it for us: it is woken from irq_work
+	 * as printk() may be called with scheduler locks held.
 	 */
-	if (console_trylock_for_printk(this_cpu))
+	if (printk_offload()) {
+		logbuf_cpu = UINT_MAX;
+		raw_spin_unlock(&logbuf_lock);
+		printk_kthread_pending = 1;
+		irq_work_queue(this_cpu_ptr(&printk_kthread_work));
+	} else if (console_trylock_for_printk(this_cpu))
 		console_unlock();
 
 	lockdep_on();
@@ -2082,6 +2280,10 @@ skip:
 		call_console_drivers(level, text, len);
 		start_critical_timings();
 		local_irq_restore(flags);
+
+		/* Nobody waits on printk_kthread, let others run */
+		if (current == printk_kthread)
+			cond_resched();
 	}
 	console_locked = 0;
 	mutex_release(&console_lock_dep_map, 1, _RET_IP_);
@@ -43,6 +43,10 @@ static cpumask_var_t rcu_nocb_mask; /* CPUs to have callbacks offloaded. */
 static bool have_rcu_nocb_mask;	    /* Was rcu_nocb_mask allocated? */
 static bool __read_mostly rcu_nocb_poll;    /* Offload kthread are to poll. */
 static char __initdata nocb_buf[NR_CPUS * 5];
+static int rcu_nocb_leader_stride = -1;	    /* Max CPUs per leader, -1: node. */
+module_param(rcu_nocb_leader_stride, int, 0444);
+static int rcu_nocb_batch_limit = 100;	    /* CBs per follower per pass. */
+module_param(rcu_nocb_batch_limit, int, 0644);
 #endif /* #ifdef CONFIG_RCU_NOCB_CPU */
 
 /*
@@ -2118,6 +2122,23 @@ bool rcu_is_nocb_cpu(int cpu)
 }
 #endif /* #ifndef CONFIG_RCU_NOCB_CPU_ALL */
 
+/*
+ * Kick the leader kthread for this follower's group.  Unless @force,
+ * don't bother if the leader has already been told to look.
+ */
+static void wake_nocb_leader(struct rcu_data *rdp, bool force)
+{
+	struct rcu_data *rdp_leader = rdp->nocb_leader;
+
+	if (!ACCESS_ONCE(rdp_leader->nocb_kthread))
+		return;
+	if (!ACCESS_ONCE(rdp_leader->nocb_leader_wake) || force) {
+		/* Prior xchg orders against prior callback enqueue. */
+		ACCESS_ONCE(rdp_leader->nocb_leader_wake) = true;
+		wake_up(&rdp_leader->nocb_wq);
+	}
+}
+
 /*
  * Enqueue the specified string of rcu_head structures onto the specified
  * CPU's no-CBs lists.  The CPU is specified by rdp, the head of the
@@ -2152,7 +2173,8 @@ static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
 	len = atomic_long_read(&rdp->nocb_q_count);
 	if (old_rhpp == &rdp->nocb_head) {
 		if (!irqs_disabled_flags(flags)) {
-			wake_up(&rdp->nocb_wq); /* ... if queue was empty ... */
+			/* ... if queue was empty ... */
+			wake_nocb_leader(rdp, false);
 			trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
 					    TPS("WakeEmpty"));
 		} else {
@@ -2162,7 +2184,7 @@ static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
 		}
 		rdp->qlen_last_fqs_check = 0;
 	} else if (len > rdp->qlen_last_fqs_check + qhimark) {
-		wake_up_process(t); /* ... or if many callbacks queued. */
+		wake_nocb_leader(rdp, true); /* ... or if many callbacks queued. */
 		rdp->qlen_last_fqs_check = LONG_MAX / 2;
 		trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu, TPS("WakeOvf"));
 	} else {
@@ -2269,82 +2291,168 @@ static void rcu_nocb_wait_gp(struct rcu_data *rdp)
 }
 
 /*
- * Per-rcu_data kthread, but only for no-CBs CPUs.  Each kthread invokes
- * callbacks queued by the corresponding no-CBs CPU.
+ * Leaders come here to wait for additional callbacks to show up.
+ * This function does not return until callbacks appear, have waited
+ * for a grace period and have been moved onto the followers' (leader
+ * included) ->nocb_done_head lists.
  */
-static int rcu_nocb_kthread(void *arg)
+static void nocb_leader_wait(struct rcu_data *my_rdp)
+{
+	bool firsttime = true;
+	bool gotcbs;
+	struct rcu_data *rdp;
+
+wait_again:
+	/* Wait for callbacks to appear. */
+	if (!rcu_nocb_poll) {
+		trace_rcu_nocb_wake(my_rdp->rsp->name, my_rdp->cpu, TPS("Sleep"));
+		wait_event_interruptible(my_rdp->nocb_wq,
+					 ACCESS_ONCE(my_rdp->nocb_leader_wake));
+		/* Memory barrier handled by smp_mb() calls below and repoll. */
+	} else if (firsttime) {
+		firsttime = false; /* Don't drown trace log with "Poll"! */
+		trace_rcu_nocb_wake(my_rdp->rsp->name, my_rdp->cpu, TPS("Poll"));
+	}
+
+	/*
+	 * Each pass through the following loop checks a follower for CBs.
+	 * We are our own first follower.  Any CBs found are moved to
+	 * nocb_gp_head, where they await a grace period.
+	 */
+	gotcbs = false;
+	for (rdp = my_rdp; rdp; rdp = rdp->nocb_next_follower) {
+		rdp->nocb_gp_head = ACCESS_ONCE(rdp->nocb_head);
+		if (!rdp->nocb_gp_head)
+			continue;  /* No CBs here, try next follower. */
+
+		/* Move callbacks to wait-for-GP list, which is empty. */
+		ACCESS_ONCE(rdp->nocb_head) = NULL;
+		rdp->nocb_gp_tail = xchg(&rdp->nocb_tail, &rdp->nocb_head);
+		rdp->nocb_gp_count = atomic_long_xchg(&rdp->nocb_q_count, 0);
+		rdp->nocb_gp_count_lazy =
+			atomic_long_xchg(&rdp->nocb_q_count_lazy, 0);
+		ACCESS_ONCE(rdp->nocb_p_count) += rdp->nocb_gp_count;
+		ACCESS_ONCE(rdp->nocb_p_count_lazy) += rdp->nocb_gp_count_lazy;
+		gotcbs = true;
+	}
+
+	/*
+	 * If there were no callbacks, sleep a bit, rescan after a
+	 * memory barrier, and go retry.
+	 */
+	if (unlikely(!gotcbs)) {
+		if (!rcu_nocb_poll)
+			trace_rcu_nocb_wake(my_rdp->rsp->name, my_rdp->cpu,
+					    TPS("WokeEmpty"));
+		flush_signals(current);
+		schedule_timeout_interruptible(1);
+
+		/* Rescan in case we were a victim of memory ordering. */
+		my_rdp->nocb_leader_wake = false;
+		smp_mb();  /* Ensure _wake false before scan. */
+		for (rdp = my_rdp; rdp; rdp = rdp->nocb_next_follower)
+			if (ACCESS_ONCE(rdp->nocb_head)) {
+				/* Found CB, so short-circuit next wait. */
+				my_rdp->nocb_leader_wake = true;
+				break;
+			}
+		goto wait_again;
+	}
+
+	/* Wait for one grace period on behalf of the whole group. */
+	rcu_nocb_wait_gp(my_rdp);
+
+	/*
+	 * We left ->nocb_leader_wake set to reduce cache thrashing.
+	 * We clear it now, but recheck for new callbacks while
+	 * traversing our follower list.
+	 */
+	my_rdp->nocb_leader_wake = false;
+	smp_mb(); /* Ensure _wake false before scan of ->nocb_head. */
+
+	/* Append the now-ready callbacks to each follower's "done" list. */
+	for (rdp = my_rdp; rdp; rdp = rdp->nocb_next_follower) {
+		if (ACCESS_ONCE(rdp->nocb_head))
+			my_rdp->nocb_leader_wake = true; /* No need to wait. */
+		if (!rdp->nocb_gp_head)
+			continue;
+		*rdp->nocb_done_tail = rdp->nocb_gp_head;
+		rdp->nocb_done_tail = rdp->nocb_gp_tail;
+		rdp->nocb_gp_head = NULL;
+	}
+}
+
+/*
+ * Invoke at most @limit of the callbacks on the specified follower's
+ * "done" list.  Returns true if some are left over for the next pass.
+ */
+static bool nocb_invoke_cbs(struct rcu_data *rdp, int limit)
 {
-	int c, cl;
-	bool firsttime = 1;
-	struct rcu_head *list;
+	int c = 0, cl = 0;
+	struct rcu_head *list = rdp->nocb_done_head;
 	struct rcu_head *next;
-	struct rcu_head **tail;
-	struct rcu_data *rdp = arg;
 
-	/* Each pass through this loop invokes one batch of callbacks */
-	for (;;) {
-		/* If not polling, wait for next batch of callbacks. */
-		if (!rcu_nocb_poll) {
-			trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
-					    TPS("Sleep"));
-			wait_event_interruptible(rdp->nocb_wq, rdp->nocb_head);
-			/* Memory barrier provide by xchg() below. */
-		} else if (firsttime) {
-			firsttime = 0;
+	if (!list)
+		return false;
+
+	trace_rcu_batch_start(rdp->rsp->name, rdp->nocb_p_count_lazy,
+			      rdp->nocb_p_count, limit);
+	while (list && c < limit) {
+		next = list->next;
+		/* Wait for enqueuing to complete, if needed. */
+		while (next == NULL && &list->next != rdp->nocb_done_tail) {
 			trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
-					    TPS("Poll"));
-		}
-		list = ACCESS_ONCE(rdp->nocb_head);
-		if (!list) {
-			if (!rcu_nocb_poll)
-				trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
-						    TPS("WokeEmpty"));
+					    TPS("WaitQueue"));
 			schedule_timeout_interruptible(1);
-			flush_signals(current);
-			continue;
-		}
-		firsttime = 1;
-		trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
-				    TPS("WokeNonEmpty"));
-
-		/*
-		 * Extract queued callbacks, update counts, and wait
-		 * for a grace period to elapse.
-		 */
-		ACCESS_ONCE(rdp->nocb_head) = NULL;
-		tail = xchg(&rdp->nocb_tail, &rdp->nocb_head);
-		c = atomic_long_xchg(&rdp->nocb_q_count, 0);
-		cl = atomic_long_xchg(&rdp->nocb_q_count_lazy, 0);
-		ACCESS_ONCE(rdp->nocb_p_count) += c;
-		ACCESS_ONCE(rdp->nocb_p_count_lazy) += cl;
-		rcu_nocb_wait_gp(rdp);
-
-		/* Each pass through the following loop invokes a callback. */
-		trace_rcu_batch_start(rdp->rsp->name, cl, c, -1);
-		c = cl = 0;
-		while (list) {
+			trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
+					    TPS("WokeQueue"));
 			next = list->next;
-			/* Wait for enqueuing to complete, if needed. */
-			while (next == NULL && &list->next != tail) {
-				trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
-						    TPS("WaitQueue"));
-				schedule_timeout_interruptible(1);
-				trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
-						    TPS("WokeQueue"));
-				next = list->next;
-			}
-			debug_rcu_head_unqueue(list);
-			local_bh_disable();
-			if (__rcu_reclaim(rdp->rsp->name, list))
-				cl++;
-			c++;
-			local_bh_enable();
-			list = next;
 		}
-		trace_rcu_batch_end(rdp->rsp->name, c, !!list, 0, 0, 1);
-		ACCESS_ONCE(rdp->nocb_p_count) -= c;
-		ACCESS_ONCE(rdp->nocb_p_count_lazy) -= cl;
-		rdp->n_nocbs_invoked += c;
+		debug_rcu_head_unqueue(list);
+		local_bh_disable();
+		if (__rcu_reclaim(rdp->rsp->name, list))
+			cl++;
+		c++;
+		local_bh_enable();
+		list = next;
+	}
+	rdp->nocb_done_head = list;
+	if (!list)
+		rdp->nocb_done_tail = &rdp->nocb_done_head;
+	trace_rcu_batch_end(rdp->rsp->name, c, !!list, 0, 0, 1);
+	ACCESS_ONCE(rdp->nocb_p_count) -= c;
+	ACCESS_ONCE(rdp->nocb_p_count_lazy) -= cl;
+	rdp->n_nocbs_invoked += c;
+	return list != NULL;
+}
+
+/*
+ * Per-group leader kthread, one for each group of no-CBs CPUs on the
+ * same NUMA node.  It waits for a grace period on behalf of the whole
+ * group, then invokes its followers' callbacks round robin, at most
+ * rcu_nocb_batch_limit of them per follower at a time, so that one
+ * CPU flooding call_rcu() cannot hold up the others.
+ */
+static int rcu_nocb_kthread(void *arg)
+{
+	bool more;
+	struct rcu_data *rdp;
+	struct rcu_data *my_rdp = arg;
+
+	/* Each pass through this loop invokes one batch of callbacks */
+	for (;;) {
+		nocb_leader_wait(my_rdp);
+		trace_rcu_nocb_wake(my_rdp->rsp->name, my_rdp->cpu,
+				    TPS("WokeNonEmpty"));
+		do {
+			int limit = max(ACCESS_ONCE(rcu_nocb_batch_limit), 1);
+
+			more = false;
+			for (rdp = my_rdp; rdp; rdp = rdp->nocb_next_follower)
+				if (nocb_invoke_cbs(rdp, limit))
+					more = true;
+			cond_resched();
+		} while (more);
 	}
 	return 0;
 }
@@ -2361,7 +2469,7 @@ static void do_nocb_deferred_wakeup(struct rcu_data *rdp)
 	if (!rcu_nocb_need_deferred_wakeup(rdp))
 		return;
 	ACCESS_ONCE(rdp->nocb_defer_wakeup) = false;
-	wake_up(&rdp->nocb_wq);
+	wake_nocb_leader(rdp, false);
 	trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu, TPS("DeferredWakeEmpty"));
 }
 
@@ -2369,24 +2477,69 @@ static void do_nocb_deferred_wakeup(struct rcu_data *rdp)
 static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
 {
 	rdp->nocb_tail = &rdp->nocb_head;
+	rdp->nocb_done_tail = &rdp->nocb_done_head;
 	init_waitqueue_head(&rdp->nocb_wq);
 }
 
-/* Create a kthread for each RCU flavor for each no-CBs CPU. */
+/*
+ * Group the no-CBs CPUs of each NUMA node under a leader, the lowest
+ * numbered CPU of the group.  With a positive rcu_nocb_leader_stride,
+ * a node is split into groups of at most that many CPUs.
+ */
+static void __init rcu_organize_nocb_kthreads(struct rcu_state *rsp)
+{
+	int cpu, fcpu, nl;
+	struct rcu_data *rdp, *frdp, *rdp_prev;
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		if (rdp->nocb_leader)
+			continue; /* Already some leader's follower. */
+
+		/* New leader, we are our own first follower. */
+		rdp->nocb_leader = rdp;
+		rdp_prev = rdp;
+		nl = 1;
+		for (fcpu = cpumask_next(cpu, rcu_nocb_mask);
+		     fcpu < nr_cpu_ids;
+		     fcpu = cpumask_next(fcpu, rcu_nocb_mask)) {
+			if (rcu_nocb_leader_stride > 0 &&
+			    nl >= rcu_nocb_leader_stride)
+				break;
+			if (cpu_to_node(fcpu) != cpu_to_node(cpu))
+				continue;
+			frdp = per_cpu_ptr(rsp->rda, fcpu);
+			if (frdp->nocb_leader)
+				continue;
+			frdp->nocb_leader = rdp;
+			rdp_prev->nocb_next_follower = frdp;
+			rdp_prev = frdp;
+			nl++;
+		}
+	}
+}
+
+/* Create a kthread for each RCU flavor for each group of no-CBs CPUs. */
 static void __init rcu_spawn_nocb_kthreads(struct rcu_state *rsp)
 {
 	int cpu;
-	struct rcu_data *rdp;
+	struct rcu_data *rdp, *frdp;
 	struct task_struct *t;
 
 	if (rcu_nocb_mask == NULL)
 		return;
+	rcu_organize_nocb_kthreads(rsp);
 	for_each_cpu(cpu, rcu_nocb_mask) {
 		rdp = per_cpu_ptr(rsp->rda, cpu);
-		t = kthread_run(rcu_nocb_kthread, rdp,
-				"rcuo%c/%d", rsp->abbr, cpu);
+		if (rdp->nocb_leader != rdp)
+			continue;
+		t = kthread_create_on_node(rcu_nocb_kthread, rdp,
+					   cpu_to_node(cpu),
+					   "rcuo%c/%d", rsp->abbr, cpu);
 		BUG_ON(IS_ERR(t));
-		ACCESS_ONCE(rdp->nocb_kthread) = t;
+		for (frdp = rdp; frdp; frdp = frdp->nocb_next_follower)
+			ACCESS_ONCE(frdp->nocb_kthread) = t;
+		wake_up_process(t);
 	}
 }
 
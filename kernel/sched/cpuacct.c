@@ -7,6 +7,7 @@
 #include <linux/rcupdate.h>
 #include <linux/kernel_stat.h>
 #include <linux/err.h>
+#include <linux/mutex.h>
 
 #include "sched.h"
 
@@ -25,12 +26,48 @@ enum cpuacct_stat_index {
 	CPUACCT_STAT_NSTATS,
 };
 
+struct cpuacct;
+
+/*
+ * Per cpu state of a cpu accounting group.
+ *
+ * Charging only touches the group of the task and links it, and the
+ * ancestors not linked yet, into the tree of groups updated on this cpu.
+ * Readers flush that tree and propagate the new charges to the ancestors,
+ * so the cost of an update doesn't depend on the depth of the hierarchy
+ * and a read only visits what changed since the last one.
+ */
+struct cpuacct_cpu {
+	/* charged to the tasks of the group */
+	u64 usage;
+	u64 cpustat[NR_STATS];
+
+	/* flushed from the children, protected by cpuacct_flush_mutex */
+	u64 subtree_usage;
+	u64 subtree_cpustat[NR_STATS];
+
+	/* own + subtree already propagated to the parent */
+	u64 last_usage;
+	u64 last_cpustat[NR_STATS];
+
+	/*
+	 * Updated tree, protected by cpuacct_cpu_lock: updated_children
+	 * lists the children with pending updates and points back to the
+	 * group itself when there are none, updated_next links the group
+	 * into the list of its parent and is NULL when it is not linked.
+	 */
+	struct cpuacct *updated_children;
+	struct cpuacct *updated_next;
+};
+
 /* track cpu usage of a group of tasks and its child groups */
 struct cpuacct {
 	struct cgroup_subsys_state css;
-	/* cpuusage holds pointer to a u64-type object on every cpu */
-	u64 __percpu *cpuusage;
-	struct kernel_cpustat __percpu *cpustat;
+	struct cpuacct_cpu __percpu *cpu;
+
+	/* totals over all cpus, protected by cpuacct_flush_mutex */
+	u64 usage;
+	u64 cpustat[NR_STATS];
 };
 
 static inline struct cpuacct *css_ca(struct cgroup_subsys_state *css)
@@ -49,17 +86,177 @@ static inline struct cpuacct *parent_ca(struct cpuacct *ca)
 	return css_ca(css_parent(&ca->css));
 }
 
-static DEFINE_PER_CPU(u64, root_cpuacct_cpuusage);
+static inline struct cpuacct_cpu *cpuacct_cpu(struct cpuacct *ca, int cpu)
+{
+	return per_cpu_ptr(ca->cpu, cpu);
+}
+
+static struct cpuacct root_cpuacct;
+static DEFINE_PER_CPU(struct cpuacct_cpu, root_cpuacct_cpu) = {
+	.updated_children	= &root_cpuacct,
+};
 static struct cpuacct root_cpuacct = {
-	.cpustat	= &kernel_cpustat,
-	.cpuusage	= &root_cpuacct_cpuusage,
+	.cpu		= &root_cpuacct_cpu,
 };
 
+static DEFINE_PER_CPU(raw_spinlock_t, cpuacct_cpu_lock) =
+	__RAW_SPIN_LOCK_UNLOCKED(cpuacct_cpu_lock);
+static DEFINE_MUTEX(cpuacct_flush_mutex);
+
+/* cpus with pending updates, including charges to the root group */
+static struct cpumask cpuacct_updated_cpus;
+
+/*
+ * Note that the charges to @ca on @cpu need propagating.
+ *
+ * Called with interrupts disabled.
+ */
+static void cpuacct_updated(struct cpuacct *ca, int cpu)
+{
+	raw_spinlock_t *lock = per_cpu_ptr(&cpuacct_cpu_lock, cpu);
+
+	/*
+	 * Speculative checks: racing with a flush only delays the charge
+	 * to the next one, as the counters are cumulative.
+	 */
+	if (ca == &root_cpuacct || ACCESS_ONCE(cpuacct_cpu(ca, cpu)->updated_next))
+		goto out;
+
+	raw_spin_lock(lock);
+	for (; ca != &root_cpuacct; ca = parent_ca(ca)) {
+		struct cpuacct_cpu *cac = cpuacct_cpu(ca, cpu);
+		struct cpuacct_cpu *pcac;
+
+		if (cac->updated_next)
+			break;
+
+		pcac = cpuacct_cpu(parent_ca(ca), cpu);
+		cac->updated_next = pcac->updated_children;
+		pcac->updated_children = ca;
+	}
+	raw_spin_unlock(lock);
+out:
+	if (!cpumask_test_cpu(cpu, &cpuacct_updated_cpus))
+		cpumask_set_cpu(cpu, &cpuacct_updated_cpus);
+}
+
+/*
+ * Walk the updated tree of @cpu in post order, unlinking each group as
+ * it is returned, children before their parent and the root group last.
+ */
+static struct cpuacct *cpuacct_pop_updated(struct cpuacct *pos, int cpu)
+{
+	struct cpuacct_cpu *cac, *pcac;
+	struct cpuacct *parent, **nextp;
+
+	if (pos == &root_cpuacct)
+		return NULL;
+
+	/* visit the first leaf below the parent of the last group */
+	pos = pos ? parent_ca(pos) : &root_cpuacct;
+	while (true) {
+		cac = cpuacct_cpu(pos, cpu);
+		if (cac->updated_children == pos)
+			break;
+		pos = cac->updated_children;
+	}
+
+	parent = parent_ca(pos);
+	if (!parent)
+		return pos;
+
+	pcac = cpuacct_cpu(parent, cpu);
+	nextp = &pcac->updated_children;
+	while (*nextp != pos) {
+		WARN_ON_ONCE(*nextp == parent);
+		nextp = &cpuacct_cpu(*nextp, cpu)->updated_next;
+	}
+	*nextp = cac->updated_next;
+	cac->updated_next = NULL;
+
+	return pos;
+}
+
+/* propagate the new charges to @ca on @cpu to its totals and its parent */
+static void cpuacct_flush_one(struct cpuacct *ca, int cpu)
+{
+	struct cpuacct_cpu *cac = cpuacct_cpu(ca, cpu);
+	struct cpuacct *parent = parent_ca(ca);
+	struct cpuacct_cpu *pcac = parent ? cpuacct_cpu(parent, cpu) : NULL;
+	u64 cur, delta;
+	int i;
+
+	cur = cac->usage + cac->subtree_usage;
+	delta = cur - cac->last_usage;
+	cac->last_usage = cur;
+	ca->usage += delta;
+	if (pcac)
+		pcac->subtree_usage += delta;
+
+	/* the root group uses kernel_cpustat, charged by the caller */
+	if (ca == &root_cpuacct)
+		return;
+
+	for (i = 0; i < NR_STATS; i++) {
+		cur = cac->cpustat[i] + cac->subtree_cpustat[i];
+		delta = cur - cac->last_cpustat[i];
+		cac->last_cpustat[i] = cur;
+		ca->cpustat[i] += delta;
+		if (parent != &root_cpuacct)
+			pcac->subtree_cpustat[i] += delta;
+	}
+}
+
+/*
+ * The charges are updated under rq->lock, take it to make reading them
+ * safe on 32-bit platforms. Called with interrupts disabled.
+ */
+static void cpuacct_lock_cpu(int cpu)
+{
+#ifndef CONFIG_64BIT
+	raw_spin_lock(&cpu_rq(cpu)->lock);
+#endif
+	raw_spin_lock(per_cpu_ptr(&cpuacct_cpu_lock, cpu));
+}
+
+static void cpuacct_unlock_cpu(int cpu)
+{
+	raw_spin_unlock(per_cpu_ptr(&cpuacct_cpu_lock, cpu));
+#ifndef CONFIG_64BIT
+	raw_spin_unlock(&cpu_rq(cpu)->lock);
+#endif
+}
+
+/* bring the totals of all groups up to date */
+static void cpuacct_flush(void)
+{
+	int cpu;
+
+	lockdep_assert_held(&cpuacct_flush_mutex);
+
+	for_each_cpu(cpu, &cpuacct_updated_cpus) {
+		struct cpuacct *pos = NULL;
+
+		cpumask_clear_cpu(cpu, &cpuacct_updated_cpus);
+		smp_mb__after_clear_bit();
+
+		local_irq_disable();
+		cpuacct_lock_cpu(cpu);
+		while ((pos = cpuacct_pop_updated(pos, cpu)))
+			cpuacct_flush_one(pos, cpu);
+		cpuacct_unlock_cpu(cpu);
+		local_irq_enable();
+
+		cond_resched();
+	}
+}
+
 /* create a new cpu accounting group */
 static struct cgroup_subsys_state *
 cpuacct_css_alloc(struct cgroup_subsys_state *parent_css)
 {
 	struct cpuacct *ca;
+	int cpu;
 
 	if (!parent_css)
 		return &root_cpuacct.css;
@@ -68,18 +265,15 @@ cpuacct_css_alloc(struct cgroup_subsys_state *parent_css)
 	if (!ca)
 		goto out;
 
-	ca->cpuusage = alloc_percpu(u64);
-	if (!ca->cpuusage)
+	ca->cpu = alloc_percpu(struct cpuacct_cpu);
+	if (!ca->cpu)
 		goto out_free_ca;
 
-	ca->cpustat = alloc_percpu(struct kernel_cpustat);
-	if (!ca->cpustat)
-		goto out_free_cpuusage;
+	for_each_possible_cpu(cpu)
+		cpuacct_cpu(ca, cpu)->updated_children = ca;
 
 	return &ca->css;
 
-out_free_cpuusage:
-	free_percpu(ca->cpuusage);
 out_free_ca:
 	kfree(ca);
 out:
@@ -91,55 +285,40 @@ static void cpuacct_css_free(struct cgroup_subsys_state *css)
 {
 	struct cpuacct *ca = css_ca(css);
 
-	free_percpu(ca->cpustat);
-	free_percpu(ca->cpuusage);
+	/* hand the last charges over to the parent and unlink @ca */
+	mutex_lock(&cpuacct_flush_mutex);
+	cpuacct_flush();
+	mutex_unlock(&cpuacct_flush_mutex);
+
+	free_percpu(ca->cpu);
 	kfree(ca);
 }
 
+/* usage of @ca and its children on @cpu, with the totals flushed */
 static u64 cpuacct_cpuusage_read(struct cpuacct *ca, int cpu)
 {
-	u64 *cpuusage = per_cpu_ptr(ca->cpuusage, cpu);
+	struct cpuacct_cpu *cac = cpuacct_cpu(ca, cpu);
 	u64 data;
 
-#ifndef CONFIG_64BIT
-	/*
-	 * Take rq->lock to make 64-bit read safe on 32-bit platforms.
-	 */
-	raw_spin_lock_irq(&cpu_rq(cpu)->lock);
-	data = *cpuusage;
-	raw_spin_unlock_irq(&cpu_rq(cpu)->lock);
-#else
-	data = *cpuusage;
-#endif
+	local_irq_disable();
+	cpuacct_lock_cpu(cpu);
+	data = cac->usage + cac->subtree_usage;
+	cpuacct_unlock_cpu(cpu);
+	local_irq_enable();
 
 	return data;
 }
 
-static void cpuacct_cpuusage_write(struct cpuacct *ca, int cpu, u64 val)
-{
-	u64 *cpuusage = per_cpu_ptr(ca->cpuusage, cpu);
-
-#ifndef CONFIG_64BIT
-	/*
-	 * Take rq->lock to make 64-bit write safe on 32-bit platforms.
-	 */
-	raw_spin_lock_irq(&cpu_rq(cpu)->lock);
-	*cpuusage = val;
-	raw_spin_unlock_irq(&cpu_rq(cpu)->lock);
-#else
-	*cpuusage = val;
-#endif
-}
-
 /* return total cpu usage (in nanoseconds) of a group */
 static u64 cpuusage_read(struct cgroup_subsys_state *css, struct cftype *cft)
 {
 	struct cpuacct *ca = css_ca(css);
-	u64 totalcpuusage = 0;
-	int i;
+	u64 totalcpuusage;
 
-	for_each_present_cpu(i)
-		totalcpuusage += cpuacct_cpuusage_read(ca, i);
+	mutex_lock(&cpuacct_flush_mutex);
+	cpuacct_flush();
+	totalcpuusage = ca->usage;
+	mutex_unlock(&cpuacct_flush_mutex);
 
 	return totalcpuusage;
 }
@@ -148,19 +327,32 @@ static int cpuusage_write(struct cgroup_subsys_state *css, struct cftype *cft,
 			  u64 reset)
 {
 	struct cpuacct *ca = css_ca(css);
-	int err = 0;
 	int i;
 
-	if (reset) {
-		err = -EINVAL;
-		goto out;
-	}
+	if (reset)
+		return -EINVAL;
 
-	for_each_present_cpu(i)
-		cpuacct_cpuusage_write(ca, i, 0);
+	/*
+	 * Flush first so the parent keeps what was charged so far, and the
+	 * pending charges of the children are not counted again.
+	 */
+	mutex_lock(&cpuacct_flush_mutex);
+	cpuacct_flush();
+	for_each_present_cpu(i) {
+		struct cpuacct_cpu *cac = cpuacct_cpu(ca, i);
+
+		local_irq_disable();
+		cpuacct_lock_cpu(i);
+		cac->usage = 0;
+		cac->subtree_usage = 0;
+		cac->last_usage = 0;
+		cpuacct_unlock_cpu(i);
+		local_irq_enable();
+	}
+	ca->usage = 0;
+	mutex_unlock(&cpuacct_flush_mutex);
 
-out:
-	return err;
+	return 0;
 }
 
 static int cpuacct_percpu_seq_show(struct seq_file *m, void *V)
@@ -169,10 +361,13 @@ static int cpuacct_percpu_seq_show(struct seq_file *m, void *V)
 	u64 percpu;
 	int i;
 
+	mutex_lock(&cpuacct_flush_mutex);
+	cpuacct_flush();
 	for_each_present_cpu(i) {
 		percpu = cpuacct_cpuusage_read(ca, i);
 		seq_printf(m, "%llu ", (unsigned long long) percpu);
 	}
+	mutex_unlock(&cpuacct_flush_mutex);
 	seq_printf(m, "\n");
 	return 0;
 }
@@ -182,30 +377,37 @@ static const char * const cpuacct_stat_desc[] = {
 	[CPUACCT_STAT_SYSTEM] = "system",
 };
 
+/* called with the totals flushed */
+static u64 cpuacct_stat(struct cpuacct *ca, int index)
+{
+	u64 val = 0;
+	int cpu;
+
+	if (ca != &root_cpuacct)
+		return ca->cpustat[index];
+
+	for_each_online_cpu(cpu)
+		val += kcpustat_cpu(cpu).cpustat[index];
+	return val;
+}
+
 static int cpuacct_stats_show(struct seq_file *sf, void *v)
 {
 	struct cpuacct *ca = css_ca(seq_css(sf));
-	int cpu;
-	s64 val = 0;
+	s64 user, system;
 
-	for_each_online_cpu(cpu) {
-		struct kernel_cpustat *kcpustat = per_cpu_ptr(ca->cpustat, cpu);
-		val += kcpustat->cpustat[CPUTIME_USER];
-		val += kcpustat->cpustat[CPUTIME_NICE];
-	}
-	val = cputime64_to_clock_t(val);
-	seq_printf(sf, "%s %lld\n", cpuacct_stat_desc[CPUACCT_STAT_USER], val);
-
-	val = 0;
-	for_each_online_cpu(cpu) {
-		struct kernel_cpustat *kcpustat = per_cpu_ptr(ca->cpustat, cpu);
-		val += kcpustat->cpustat[CPUTIME_SYSTEM];
-		val += kcpustat->cpustat[CPUTIME_IRQ];
-		val += kcpustat->cpustat[CPUTIME_SOFTIRQ];
-	}
+	mutex_lock(&cpuacct_flush_mutex);
+	cpuacct_flush();
+	user = cpuacct_stat(ca, CPUTIME_USER) + cpuacct_stat(ca, CPUTIME_NICE);
+	system = cpuacct_stat(ca, CPUTIME_SYSTEM) +
+		 cpuacct_stat(ca, CPUTIME_IRQ) +
+		 cpuacct_stat(ca, CPUTIME_SOFTIRQ);
+	mutex_unlock(&cpuacct_flush_mutex);
 
-	val = cputime64_to_clock_t(val);
-	seq_printf(sf, "%s %lld\n", cpuacct_stat_desc[CPUACCT_STAT_SYSTEM], val);
+	user = cputime64_to_clock_t(user);
+	seq_printf(sf, "%s %lld\n", cpuacct_stat_desc[CPUACCT_STAT_USER], user);
+	system = cputime64_to_clock_t(system);
+	seq_printf(sf, "%s %lld\n", cpuacct_stat_desc[CPUACCT_STAT_SYSTEM], system);
 
 	return 0;
 }
@@ -242,15 +444,8 @@ void cpuacct_charge(struct task_struct *tsk, u64 cputime)
 	rcu_read_lock();
 
 	ca = task_ca(tsk);
-
-	while (true) {
-		u64 *cpuusage = per_cpu_ptr(ca->cpuusage, cpu);
-		*cpuusage += cputime;
-
-		ca = parent_ca(ca);
-		if (!ca)
-			break;
-	}
+	cpuacct_cpu(ca, cpu)->usage += cputime;
+	cpuacct_updated(ca, cpu);
 
 	rcu_read_unlock();
 }
@@ -262,15 +457,13 @@ void cpuacct_charge(struct task_struct *tsk, u64 cputime)
  */
 void cpuacct_account_field(struct task_struct *p, int index, u64 val)
 {
-	struct kernel_cpustat *kcpustat;
 	struct cpuacct *ca;
 
 	rcu_read_lock();
 	ca = task_ca(p);
-	while (ca != &root_cpuacct) {
-		kcpustat = this_cpu_ptr(ca->cpustat);
-		kcpustat->cpustat[index] += val;
-		ca = parent_ca(ca);
+	if (ca != &root_cpuacct) {
+		this_cpu_ptr(ca->cpu)->cpustat[index] += val;
+		cpuacct_updated(ca, smp_processor_id());
 	}
 	rcu_read_unlock();
 }
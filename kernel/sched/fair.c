@@ -2309,6 +2309,9 @@ static inline void __update_cfs_rq_tg_load_contrib(struct cfs_rq *cfs_rq,
 	tg_contrib = cfs_rq->runnable_load_avg + cfs_rq->blocked_load_avg;
 	tg_contrib -= cfs_rq->tg_load_contrib;
 
+	if (!tg_contrib)
+		return;
+
 	if (force_update || abs(tg_contrib) > cfs_rq->tg_load_contrib / 8) {
 		atomic_long_add(tg_contrib, &tg->load_avg);
 		cfs_rq->tg_load_contrib += tg_contrib;
@@ -4355,13 +4358,183 @@ find_idlest_cpu(struct sched_group *group, struct task_struct *p, int this_cpu)
 	return idlest;
 }
 
+#ifdef CONFIG_SCHED_SMT
+
+struct static_key sched_smt_present = STATIC_KEY_INIT_FALSE;
+
+void __init sched_smt_init(void)
+{
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		if (cpumask_weight(cpu_smt_mask(cpu)) > 1) {
+			static_key_slow_inc(&sched_smt_present);
+			break;
+		}
+	}
+}
+
+/*
+ * Called on idle entry: if all the siblings of this core are now idle,
+ * tell the cache domain there is an idle core to be had. The hint is only
+ * cleared by select_idle_core() once it failed to find one, so that busy
+ * cpus leaving idle don't have to touch the shared cacheline.
+ */
+void __update_idle_core(struct rq *rq)
+{
+	int core = cpu_of(rq);
+	int cpu;
+
+	if (ACCESS_ONCE(llc_shared(core)->has_idle_cores))
+		return;
+
+	for_each_cpu(cpu, cpu_smt_mask(core)) {
+		if (cpu == core)
+			continue;
+
+		if (!idle_cpu(cpu))
+			return;
+	}
+
+	ACCESS_ONCE(llc_shared(core)->has_idle_cores) = 1;
+}
+
+/*
+ * Scan the cache domain for a core whose threads are all idle; an idle
+ * core beats an idle thread of a busy core. Only done while the hint says
+ * there is one, so the full scan is paid for rarely.
+ */
+static int select_idle_core(struct task_struct *p, struct sched_domain *sd,
+			    int target)
+{
+	int core, cpu;
+
+	if (!static_key_false(&sched_smt_present))
+		return -1;
+
+	if (!ACCESS_ONCE(llc_shared(target)->has_idle_cores))
+		return -1;
+
+	for_each_cpu_wrap(core, sched_domain_span(sd), target) {
+		bool idle = true;
+
+		/* Look at each core once, through its first thread */
+		if (cpumask_first(cpu_smt_mask(core)) != core)
+			continue;
+
+		for_each_cpu(cpu, cpu_smt_mask(core)) {
+			if (!idle_cpu(cpu)) {
+				idle = false;
+				break;
+			}
+		}
+
+		if (!idle)
+			continue;
+
+		cpu = cpumask_first_and(cpu_smt_mask(core), tsk_cpus_allowed(p));
+		if (cpu < nr_cpu_ids)
+			return cpu;
+	}
+
+	/* Failed to find an idle core; stop looking for one. */
+	ACCESS_ONCE(llc_shared(target)->has_idle_cores) = 0;
+
+	return -1;
+}
+
+/*
+ * Scan the threads of the target core for an idle one.
+ */
+static int select_idle_smt(struct task_struct *p, int target)
+{
+	int cpu;
+
+	if (!static_key_false(&sched_smt_present))
+		return -1;
+
+	for_each_cpu_and(cpu, cpu_smt_mask(target), tsk_cpus_allowed(p)) {
+		if (idle_cpu(cpu))
+			return cpu;
+	}
+
+	return -1;
+}
+
+#else /* CONFIG_SCHED_SMT */
+
+static inline int select_idle_core(struct task_struct *p,
+				   struct sched_domain *sd, int target)
+{
+	return -1;
+}
+
+static inline int select_idle_smt(struct task_struct *p, int target)
+{
+	return -1;
+}
+
+#endif /* CONFIG_SCHED_SMT */
+
+/*
+ * Scan the cache domain for any idle cpu, starting at the target.  The
+ * number of cpus looked at is proportional to how long this cpu has
+ * recently been idle for, relative to the average cost of a scan, so the
+ * search costs about the same however big the cache domain is.
+ */
+static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd,
+			   int target)
+{
+	struct sched_domain *this_sd;
+	u64 avg_cost, avg_idle = this_rq()->avg_idle;
+	u64 time, cost, span_avg;
+	s64 delta;
+	int cpu, nr;
+
+	this_sd = rcu_dereference(*this_cpu_ptr(&sd_llc));
+	if (!this_sd)
+		return -1;
+
+	/*
+	 * Due to large variance we need a large fuzz factor; wakeup heavy
+	 * benchmarks are particularly sensitive here.
+	 */
+	avg_idle /= 512;
+	avg_cost = this_sd->avg_scan_cost + 1;
+
+	span_avg = sd->span_weight * avg_idle;
+	if (span_avg > 4 * avg_cost)
+		nr = div_u64(span_avg, avg_cost);
+	else
+		nr = 4;
+
+	time = local_clock();
+
+	for_each_cpu_wrap(cpu, sched_domain_span(sd), target) {
+		if (!--nr) {
+			cpu = -1;
+			break;
+		}
+		if (!cpumask_test_cpu(cpu, tsk_cpus_allowed(p)))
+			continue;
+		if (idle_cpu(cpu))
+			break;
+	}
+
+	time = local_clock() - time;
+	cost = this_sd->avg_scan_cost;
+	delta = (s64)(time - cost) / 8;
+	this_sd->avg_scan_cost += delta;
+
+	return cpu;
+}
+
 /*
  * Try and locate an idle CPU in the sched_domain.
  */
 static int select_idle_sibling(struct task_struct *p, int target)
 {
 	struct sched_domain *sd;
-	struct sched_group *sg;
 	int i = task_cpu(p);
 
 	if (idle_cpu(target))
@@ -4373,30 +4546,22 @@ static int select_idle_sibling(struct task_struct *p, int target)
 	if (i != target && cpus_share_cache(i, target) && idle_cpu(i))
 		return i;
 
-	/*
-	 * Otherwise, iterate the domains and find an elegible idle cpu.
-	 */
 	sd = rcu_dereference(per_cpu(sd_llc, target));
-	for_each_lower_domain(sd) {
-		sg = sd->groups;
-		do {
-			if (!cpumask_intersects(sched_group_cpus(sg),
-						tsk_cpus_allowed(p)))
-				goto next;
+	if (!sd)
+		return target;
 
-			for_each_cpu(i, sched_group_cpus(sg)) {
-				if (i == target || !idle_cpu(i))
-					goto next;
-			}
+	i = select_idle_core(p, sd, target);
+	if ((unsigned)i < nr_cpu_ids)
+		return i;
+
+	i = select_idle_cpu(p, sd, target);
+	if ((unsigned)i < nr_cpu_ids)
+		return i;
+
+	i = select_idle_smt(p, target);
+	if ((unsigned)i < nr_cpu_ids)
+		return i;
 
-			target = cpumask_first_and(sched_group_cpus(sg),
-					tsk_cpus_allowed(p));
-			goto done;
-next:
-			sg = sg->next;
-		} while (sg != sd->groups);
-	}
-done:
 	return target;
 }
 
@@ -4996,6 +5161,7 @@ enum fbq_type { regular, remote, all };
 #define LBF_NEED_BREAK	0x02
 #define LBF_DST_PINNED  0x04
 #define LBF_SOME_PINNED	0x08
+#define LBF_CPUS_PRUNED	0x10
 
 struct lb_env {
 	struct sched_domain	*sd;
@@ -5349,21 +5515,32 @@ static void __update_blocked_averages_cpu(struct task_group *tg, int cpu)
 	if (throttled_hierarchy(cfs_rq))
 		return;
 
-	update_cfs_rq_blocked_load(cfs_rq, 1);
+	/*
+	 * Not forced: tg->load_avg is shared by all cpus, only fold in
+	 * changes that are big enough to matter (and only once a decay
+	 * period has passed), so that periodic updates of many idle-ish
+	 * groups don't keep pulling its cacheline around.
+	 */
+	update_cfs_rq_blocked_load(cfs_rq, 0);
 
 	if (se) {
 		update_entity_load_avg(se, 1);
 		/*
-		 * We pivot on our runnable average having decayed to zero for
-		 * list removal.  This generally implies that all our children
-		 * have also been removed (modulo rounding error or bandwidth
-		 * control); however, such cases are rare and we can fix these
-		 * at enqueue.
+		 * We pivot on our runnable average and our blocked load having
+		 * decayed to zero for list removal, so that only cfs_rqs that
+		 * still carry load are visited here.  This generally implies
+		 * that all our children have also been removed (modulo
+		 * rounding error or bandwidth control); however, such cases
+		 * are rare and we can fix these at enqueue.
 		 *
 		 * TODO: fix up out-of-order children on enqueue.
 		 */
-		if (!se->avg.runnable_avg_sum && !cfs_rq->nr_running)
+		if (!se->avg.runnable_avg_sum && !cfs_rq->nr_running &&
+		    !cfs_rq->blocked_load_avg) {
+			/* Leave nothing stale behind in tg->load_avg. */
+			__update_cfs_rq_tg_load_contrib(cfs_rq, 1);
 			list_del_leaf_cfs_rq(cfs_rq);
+		}
 	} else {
 		struct rq *rq = rq_of(cfs_rq);
 		update_rq_runnable_avg(rq, rq->nr_running);
@@ -5778,23 +5955,14 @@ static inline int sg_capacity(struct lb_env *env, struct sched_group *group)
 	return capacity;
 }
 
-/**
- * update_sg_lb_stats - Update sched_group's statistics for load balancing.
- * @env: The load balancing environment.
- * @group: sched_group whose statistics are to be updated.
- * @load_idx: Load index of sched_domain of this_cpu for load calc.
- * @local_group: Does group contain this_cpu.
- * @sgs: variable to hold the statistics for this group.
- */
-static inline void update_sg_lb_stats(struct lb_env *env,
+/* Accumulate the per cpu statistics of @group into @sgs. */
+static inline void sum_sg_lb_stats(struct lb_env *env,
 			struct sched_group *group, int load_idx,
 			int local_group, struct sg_lb_stats *sgs)
 {
 	unsigned long load;
 	int i;
 
-	memset(sgs, 0, sizeof(*sgs));
-
 	for_each_cpu_and(i, sched_group_cpus(group), env->cpus) {
 		struct rq *rq = cpu_rq(i);
 
@@ -5814,6 +5982,90 @@ static inline void update_sg_lb_stats(struct lb_env *env,
 		if (idle_cpu(i))
 			sgs->idle_cpus++;
 	}
+}
+
+/*
+ * At NUMA levels the groups are large and every cpu of the domain walks
+ * the same remote groups, all touching the same remote runqueue
+ * cachelines. The sums of a remote group are reused by all balancers
+ * within a jiffy rather than recomputed by each.
+ */
+static bool sg_lb_cache_read(struct sched_group *group, int load_idx,
+			     struct sg_lb_stats *sgs)
+{
+	struct sg_lb_cache *c = &group->sgp->lb_cache;
+	unsigned int seq;
+
+	do {
+		seq = read_seqcount_begin(&c->seq);
+		if (!c->valid || c->stamp != jiffies || c->load_idx != load_idx)
+			return false;
+
+		sgs->group_load = c->group_load;
+		sgs->sum_weighted_load = c->sum_weighted_load;
+		sgs->sum_nr_running = c->sum_nr_running;
+		sgs->idle_cpus = c->idle_cpus;
+#ifdef CONFIG_NUMA_BALANCING
+		sgs->nr_numa_running = c->nr_numa_running;
+		sgs->nr_preferred_running = c->nr_preferred_running;
+#endif
+	} while (read_seqcount_retry(&c->seq, seq));
+
+	return true;
+}
+
+static void sg_lb_cache_write(struct sched_group *group, int load_idx,
+			      struct sg_lb_stats *sgs)
+{
+	struct sg_lb_cache *c = &group->sgp->lb_cache;
+
+	if (!raw_spin_trylock(&c->lock))
+		return;
+
+	write_seqcount_begin(&c->seq);
+	c->valid = true;
+	c->stamp = jiffies;
+	c->load_idx = load_idx;
+	c->group_load = sgs->group_load;
+	c->sum_weighted_load = sgs->sum_weighted_load;
+	c->sum_nr_running = sgs->sum_nr_running;
+	c->idle_cpus = sgs->idle_cpus;
+#ifdef CONFIG_NUMA_BALANCING
+	c->nr_numa_running = sgs->nr_numa_running;
+	c->nr_preferred_running = sgs->nr_preferred_running;
+#endif
+	write_seqcount_end(&c->seq);
+
+	raw_spin_unlock(&c->lock);
+}
+
+/**
+ * update_sg_lb_stats - Update sched_group's statistics for load balancing.
+ * @env: The load balancing environment.
+ * @group: sched_group whose statistics are to be updated.
+ * @load_idx: Load index of sched_domain of this_cpu for load calc.
+ * @local_group: Does group contain this_cpu.
+ * @sgs: variable to hold the statistics for this group.
+ */
+static inline void update_sg_lb_stats(struct lb_env *env,
+			struct sched_group *group, int load_idx,
+			int local_group, struct sg_lb_stats *sgs)
+{
+	memset(sgs, 0, sizeof(*sgs));
+
+	/*
+	 * The local group is biased towards target_load() and the cpu mask
+	 * shrinks on retries, only the plain remote case can be shared.
+	 */
+	if (!local_group && (env->sd->flags & SD_NUMA) &&
+	    !(env->flags & LBF_CPUS_PRUNED)) {
+		if (!sg_lb_cache_read(group, load_idx, sgs)) {
+			sum_sg_lb_stats(env, group, load_idx, local_group, sgs);
+			sg_lb_cache_write(group, load_idx, sgs);
+		}
+	} else {
+		sum_sg_lb_stats(env, group, load_idx, local_group, sgs);
+	}
 
 	/* Adjust by relative CPU power of the group */
 	sgs->group_power = group->sgp->power;
@@ -6516,6 +6768,7 @@ more_balance:
 
 			/* Prevent to re-select dst_cpu via env's cpus */
 			cpumask_clear_cpu(env.dst_cpu, env.cpus);
+			env.flags	|= LBF_CPUS_PRUNED;
 
 			env.dst_rq	 = cpu_rq(env.new_dst_cpu);
 			env.dst_cpu	 = env.new_dst_cpu;
@@ -6545,6 +6798,7 @@ more_balance:
 		/* All tasks on this runqueue were pinned by CPU affinity */
 		if (unlikely(env.flags & LBF_ALL_PINNED)) {
 			cpumask_clear_cpu(cpu_of(busiest), cpus);
+			env.flags |= LBF_CPUS_PRUNED;
 			if (!cpumask_empty(cpus)) {
 				env.loop = 0;
 				env.loop_break = sched_nr_migrate_break;
@@ -27,6 +27,7 @@ static struct task_struct *
 pick_next_task_idle(struct rq *rq, struct task_struct *prev)
 {
 	put_prev_task(rq, prev);
+	update_idle_core(rq);
 
 	schedstat_inc(rq, sched_goidle);
 	return rq->idle;
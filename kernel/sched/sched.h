@@ -734,10 +734,45 @@ static inline struct sched_domain *lowest_flag_domain(int cpu, int flag)
 DECLARE_PER_CPU(struct sched_domain *, sd_llc);
 DECLARE_PER_CPU(int, sd_llc_size);
 DECLARE_PER_CPU(int, sd_llc_id);
+
+/*
+ * Wakeup hints shared by all cpus of a cache domain. Only the instance of
+ * the first cpu of the domain (sd_llc_id) is used, see llc_shared().
+ */
+struct sd_llc_shared {
+	int	has_idle_cores;
+};
+DECLARE_PER_CPU_SHARED_ALIGNED(struct sd_llc_shared, sd_llc_shared);
+
+static inline struct sd_llc_shared *llc_shared(int cpu)
+{
+	return &per_cpu(sd_llc_shared, per_cpu(sd_llc_id, cpu));
+}
 DECLARE_PER_CPU(struct sched_domain *, sd_numa);
 DECLARE_PER_CPU(struct sched_domain *, sd_busy);
 DECLARE_PER_CPU(struct sched_domain *, sd_asym);
 
+/*
+ * Per cpu sums over a group, as gathered by update_sg_lb_stats(), shared by
+ * all the cpus balancing at a NUMA level within the same jiffy. Updates are
+ * serialised by @lock (trylock only), readers retry against @seq.
+ */
+struct sg_lb_cache {
+	seqcount_t seq;
+	raw_spinlock_t lock;
+	bool valid;
+	int load_idx;
+	unsigned long stamp;		/* jiffies */
+	unsigned long group_load;
+	unsigned long sum_weighted_load;
+	unsigned int sum_nr_running;
+	unsigned int idle_cpus;
+#ifdef CONFIG_NUMA_BALANCING
+	unsigned int nr_numa_running;
+	unsigned int nr_preferred_running;
+#endif
+};
+
 struct sched_group_power {
 	atomic_t ref;
 	/*
@@ -752,6 +787,8 @@ struct sched_group_power {
 	 */
 	atomic_t nr_busy_cpus;
 
+	struct sg_lb_cache lb_cache;
+
 	unsigned long cpumask[0]; /* iteration mask */
 };
 
@@ -1184,10 +1221,26 @@ extern void trigger_load_balance(struct rq *rq);
 extern void idle_enter_fair(struct rq *this_rq);
 extern void idle_exit_fair(struct rq *this_rq);
 
+#ifdef CONFIG_SCHED_SMT
+extern struct static_key sched_smt_present;
+extern void __update_idle_core(struct rq *rq);
+extern void sched_smt_init(void);
+
+static inline void update_idle_core(struct rq *rq)
+{
+	if (static_key_false(&sched_smt_present))
+		__update_idle_core(rq);
+}
+#else
+static inline void update_idle_core(struct rq *rq) { }
+static inline void sched_smt_init(void) { }
+#endif
+
 #else
 
 static inline void idle_enter_fair(struct rq *rq) { }
 static inline void idle_exit_fair(struct rq *rq) { }
+static inline void update_idle_core(struct rq *rq) { }
 
 #endif
 
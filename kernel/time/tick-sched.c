@@ -154,6 +154,7 @@ static void tick_sched_handle(struct tick_sched *ts, struct pt_regs *regs)
 
 #ifdef CONFIG_NO_HZ_FULL
 cpumask_var_t tick_nohz_full_mask;
+cpumask_var_t housekeeping_mask;
 bool tick_nohz_full_running;
 
 static bool can_stop_full_tick(void)
@@ -340,6 +341,16 @@ static int tick_nohz_init_all(void)
 	return err;
 }
 
+/*
+ * Restrict @t to the housekeeping CPUs so that it, and the kthreads it
+ * spawns, stay off the full dynticks CPUs.
+ */
+void housekeeping_affine(struct task_struct *t)
+{
+	if (tick_nohz_full_enabled())
+		set_cpus_allowed_ptr(t, housekeeping_mask);
+}
+
 void __init tick_nohz_init(void)
 {
 	int cpu;
@@ -349,6 +360,15 @@ void __init tick_nohz_init(void)
 			return;
 	}
 
+	if (!alloc_cpumask_var(&housekeeping_mask, GFP_KERNEL)) {
+		WARN(1, "NO_HZ: Can't allocate not-full dynticks cpumask\n");
+		cpumask_clear(tick_nohz_full_mask);
+		tick_nohz_full_running = false;
+		return;
+	}
+	cpumask_andnot(housekeeping_mask,
+		       cpu_possible_mask, tick_nohz_full_mask);
+
 	for_each_cpu(cpu, tick_nohz_full_mask)
 		context_tracking_cpu_set(cpu);
 
@@ -1080,8 +1100,19 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 	 * Do not call, when we are not in irq context and have
 	 * no valid regs pointer
 	 */
-	if (regs)
+	if (regs) {
+		/*
+		 * Report ticks hitting a full dynticks CPU which is busy
+		 * running a task, the residual interruptions that
+		 * keep it from isolation.  The reason the tick couldn't
+		 * be stopped is reported by the tick_stop event.
+		 */
+		if (tick_nohz_full_cpu(smp_processor_id()) &&
+		    !is_idle_task(current))
+			trace_tick_nohz_full_tick(user_mode(regs),
+						  ts->tick_stopped);
 		tick_sched_handle(ts, regs);
+	}
 
 	hrtimer_forward(timer, now, tick_period);
 
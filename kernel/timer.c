@@ -57,23 +57,55 @@ __visible u64 jiffies_64 __cacheline_aligned_in_smp = INITIAL_JIFFIES;
 EXPORT_SYMBOL(jiffies_64);
 
 /*
- * per-CPU timer vector definitions:
+ * The timer wheel has LVL_DEPTH levels of LVL_SIZE buckets each.  Level 0
+ * has a granularity of one jiffy, every further level is LVL_CLK_DIV
+ * times coarser.  A timer is queued once, in the level whose range covers
+ * its timeout, and stays in that bucket until it expires or is removed:
+ * timers are never cascaded down to finer levels.  The price is that a
+ * timer in level n fires at its timeout rounded up to that level's
+ * granularity, i.e. up to 1/8 - 1/64 of the timeout late, which is fine
+ * for the vast majority of timers which are timeouts that get cancelled
+ * before they fire anyway.
+ *
+ * With HZ=1000 the levels cover:
+ *
+ * Level Offset  Granularity            Range
+ *  0      0         1 ms                0 ms -         62 ms
+ *  1     64         8 ms               63 ms -        503 ms
+ *  2    128        64 ms              504 ms -       4032 ms
+ *  3    192       512 ms             4032 ms -      32256 ms
+ *  4    256      4096 ms (~4s)         32 s  -        258 s
+ *  5    320     32768 ms (~32s)       258 s  -       2064 s
+ *  6    384    262144 ms (~4m)         34 m  -        275 m
+ *  7    448   2097152 ms (~34m)       275 m  -         36 h
+ *  8    512  16777216 ms (~4h)         36 h  -         12 d
+ *
+ * Timers beyond the last level are queued in its last bucket and requeued
+ * when that bucket is run before they are due.
  */
-#define TVN_BITS (CONFIG_BASE_SMALL ? 4 : 6)
-#define TVR_BITS (CONFIG_BASE_SMALL ? 6 : 8)
-#define TVN_SIZE (1 << TVN_BITS)
-#define TVR_SIZE (1 << TVR_BITS)
-#define TVN_MASK (TVN_SIZE - 1)
-#define TVR_MASK (TVR_SIZE - 1)
-#define MAX_TVAL ((unsigned long)((1ULL << (TVR_BITS + 4*TVN_BITS)) - 1))
-
-struct tvec {
-	struct list_head vec[TVN_SIZE];
-};
+#define LVL_CLK_SHIFT	3
+#define LVL_CLK_DIV	(1UL << LVL_CLK_SHIFT)
+#define LVL_CLK_MASK	(LVL_CLK_DIV - 1)
+#define LVL_SHIFT(n)	((n) * LVL_CLK_SHIFT)
+#define LVL_GRAN(n)	(1UL << LVL_SHIFT(n))
+
+#define LVL_BITS	(CONFIG_BASE_SMALL ? 4 : 6)
+#define LVL_SIZE	(1UL << LVL_BITS)
+#define LVL_MASK	(LVL_SIZE - 1)
+#define LVL_OFFS(n)	((n) * LVL_SIZE)
+
+/* The first timeout covered by level n, if n > 0 */
+#define LVL_START(n)	((LVL_SIZE - 1) << (((n) - 1) * LVL_CLK_SHIFT))
+
+#if HZ > 100
+# define LVL_DEPTH	9
+#else
+# define LVL_DEPTH	8
+#endif
 
-struct tvec_root {
-	struct list_head vec[TVR_SIZE];
-};
+#define WHEEL_SIZE	(LVL_SIZE * LVL_DEPTH)
+#define WHEEL_TIMEOUT_CUTOFF	(LVL_START(LVL_DEPTH))
+#define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
 
 struct tvec_base {
 	spinlock_t lock;
@@ -82,11 +114,8 @@ struct tvec_base {
 	unsigned long next_timer;
 	unsigned long active_timers;
 	unsigned long all_timers;
-	struct tvec_root tv1;
-	struct tvec tv2;
-	struct tvec tv3;
-	struct tvec tv4;
-	struct tvec tv5;
+	DECLARE_BITMAP(pending_map, WHEEL_SIZE);
+	struct list_head vectors[WHEEL_SIZE];
 } ____cacheline_aligned;
 
 struct tvec_base boot_tvec_bases;
@@ -352,48 +381,68 @@ static bool catchup_timer_jiffies(struct tvec_base *base)
 	return false;
 }
 
-static void
-__internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+/*
+ * Bucket index of @expires in level @lvl.  Round up to the granularity
+ * of the level, so a timer never fires before its expiry time.
+ */
+static inline unsigned int calc_index(unsigned long expires, unsigned int lvl)
 {
-	unsigned long expires = timer->expires;
-	unsigned long idx = expires - base->timer_jiffies;
-	struct list_head *vec;
-
-	if (idx < TVR_SIZE) {
-		int i = expires & TVR_MASK;
-		vec = base->tv1.vec + i;
-	} else if (idx < 1 << (TVR_BITS + TVN_BITS)) {
-		int i = (expires >> TVR_BITS) & TVN_MASK;
-		vec = base->tv2.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK;
-		vec = base->tv3.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv4.vec + i;
-	} else if ((signed long) idx < 0) {
+	expires = (expires + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl);
+	return LVL_OFFS(lvl) + (expires & LVL_MASK);
+}
+
+/* The jiffy at which the bucket a timer of level @lvl sits in is run */
+static inline unsigned long
+bucket_expiry(unsigned long expires, unsigned int lvl)
+{
+	return ((expires + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl)) <<
+		LVL_SHIFT(lvl);
+}
+
+static unsigned int calc_wheel_index(unsigned long expires, unsigned long clk)
+{
+	unsigned long delta = expires - clk;
+	unsigned int lvl;
+
+	if ((long)delta < 0) {
 		/*
 		 * Can happen if you add a timer with expires == jiffies,
 		 * or you set a timer to go off in the past
 		 */
-		vec = base->tv1.vec + (base->timer_jiffies & TVR_MASK);
-	} else {
-		int i;
-		/* If the timeout is larger than MAX_TVAL (on 64-bit
-		 * architectures or with CONFIG_BASE_SMALL=1) then we
-		 * use the maximum timeout.
+		return clk & LVL_MASK;
+	}
+	if (delta >= WHEEL_TIMEOUT_CUTOFF) {
+		/*
+		 * Park the timer in the last level, it gets requeued
+		 * from there once the wheel has caught up.
 		 */
-		if (idx > MAX_TVAL) {
-			idx = MAX_TVAL;
-			expires = idx + base->timer_jiffies;
-		}
-		i = (expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv5.vec + i;
+		expires = clk + WHEEL_TIMEOUT_MAX;
+		return calc_index(expires, LVL_DEPTH - 1);
 	}
+	for (lvl = 0; lvl < LVL_DEPTH - 1; lvl++)
+		if (delta < LVL_START(lvl + 1))
+			break;
+	return calc_index(expires, lvl);
+}
+
+/* The jiffy at which the bucket holding @timer is run */
+static inline unsigned long timer_bucket_expiry(struct timer_list *timer)
+{
+	return bucket_expiry(timer->expires, timer->idx / LVL_SIZE);
+}
+
+static void
+__internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+{
+	unsigned int idx = calc_wheel_index(timer->expires,
+					    base->timer_jiffies);
+
 	/*
 	 * Timers are FIFO:
 	 */
-	list_add_tail(&timer->entry, vec);
+	list_add_tail(&timer->entry, base->vectors + idx);
+	__set_bit(idx, base->pending_map);
+	timer->idx = idx;
 }
 
 static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
@@ -404,9 +453,11 @@ static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
 	 * Update base->active_timers and base->next_timer
 	 */
 	if (!tbase_get_deferrable(timer->base)) {
+		unsigned long expiry = timer_bucket_expiry(timer);
+
 		if (!base->active_timers++ ||
-		    time_before(timer->expires, base->next_timer))
-			base->next_timer = timer->expires;
+		    time_before(expiry, base->next_timer))
+			base->next_timer = expiry;
 	}
 	base->all_timers++;
 }
@@ -699,9 +750,11 @@ static int detach_if_pending(struct timer_list *timer, struct tvec_base *base,
 		return 0;
 
 	detach_timer(timer, clear_pending);
+	if (list_empty(base->vectors + timer->idx))
+		__clear_bit(timer->idx, base->pending_map);
 	if (!tbase_get_deferrable(timer->base)) {
 		base->active_timers--;
-		if (timer->expires == base->next_timer)
+		if (timer_bucket_expiry(timer) == base->next_timer)
 			base->next_timer = base->timer_jiffies;
 	}
 	base->all_timers--;
@@ -754,6 +807,21 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 
 	base = lock_timer_base(timer, &flags);
 
+	/*
+	 * If the timer is still queued and the new expiry time lands in
+	 * the very bucket it sits in, only the expiry time needs to be
+	 * updated.  A bucket run already moved to the expiry list is
+	 * recognized by its expiry time being in the past.
+	 */
+	if (timer_pending(timer) &&
+	    timer->idx / LVL_SIZE < LVL_DEPTH - 1 &&
+	    !time_before(timer_bucket_expiry(timer), base->timer_jiffies) &&
+	    calc_wheel_index(expires, base->timer_jiffies) == timer->idx) {
+		timer->expires = expires;
+		ret = 1;
+		goto out_unlock;
+	}
+
 	ret = detach_if_pending(timer, base, false);
 	if (!ret && pending_only)
 		goto out_unlock;
@@ -1091,27 +1159,6 @@ int del_timer_sync(struct timer_list *timer)
 EXPORT_SYMBOL(del_timer_sync);
 #endif
 
-static int cascade(struct tvec_base *base, struct tvec *tv, int index)
-{
-	/* cascade all the timers from tv up one level */
-	struct timer_list *timer, *tmp;
-	struct list_head tv_list;
-
-	list_replace_init(tv->vec + index, &tv_list);
-
-	/*
-	 * We are removing _all_ timers from the list, so we
-	 * don't have to detach them individually.
-	 */
-	list_for_each_entry_safe(timer, tmp, &tv_list, entry) {
-		BUG_ON(tbase_get_base(timer->base) != base);
-		/* No accounting, while moving them */
-		__internal_add_timer(base, timer);
-	}
-
-	return index;
-}
-
 static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 			  unsigned long data)
 {
@@ -1155,14 +1202,33 @@ static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 	}
 }
 
-#define INDEX(N) ((base->timer_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
+/*
+ * Move the buckets of all levels which are due at ->timer_jiffies to
+ * @head.  Level n is only looked at when the lower n * LVL_CLK_SHIFT bits
+ * of ->timer_jiffies are zero.
+ */
+static void collect_expired_timers(struct tvec_base *base,
+				   struct list_head *head)
+{
+	unsigned long clk = base->timer_jiffies;
+	unsigned int i, idx;
+
+	for (i = 0; i < LVL_DEPTH; i++) {
+		idx = (clk & LVL_MASK) + i * LVL_SIZE;
+
+		if (__test_and_clear_bit(idx, base->pending_map))
+			list_splice_tail_init(base->vectors + idx, head);
+		if (clk & LVL_CLK_MASK)
+			break;
+		clk >>= LVL_CLK_SHIFT;
+	}
+}
 
 /**
  * __run_timers - run all expired timers (if any) on this CPU.
  * @base: the timer vector to be processed.
  *
- * This function cascades all vectors and executes all expired timer
- * vectors.
+ * This function executes all expired timer vectors.
  */
 static inline void __run_timers(struct tvec_base *base)
 {
@@ -1174,26 +1240,32 @@ static inline void __run_timers(struct tvec_base *base)
 		return;
 	}
 	while (time_after_eq(jiffies, base->timer_jiffies)) {
-		struct list_head work_list;
+		LIST_HEAD(work_list);
 		struct list_head *head = &work_list;
-		int index = base->timer_jiffies & TVR_MASK;
 
-		/*
-		 * Cascade timers:
-		 */
-		if (!index &&
-			(!cascade(base, &base->tv2, INDEX(0))) &&
-				(!cascade(base, &base->tv3, INDEX(1))) &&
-					!cascade(base, &base->tv4, INDEX(2)))
-			cascade(base, &base->tv5, INDEX(3));
+		collect_expired_timers(base, head);
 		++base->timer_jiffies;
-		list_replace_init(base->tv1.vec + index, head);
 		while (!list_empty(head)) {
 			void (*fn)(unsigned long);
 			unsigned long data;
 			bool irqsafe;
 
 			timer = list_first_entry(head, struct timer_list,entry);
+
+			/* Parked beyond the wheel range and not due yet? */
+			if (unlikely(time_after(timer->expires,
+						base->timer_jiffies - 1))) {
+				list_del(&timer->entry);
+				__internal_add_timer(base, timer);
+				/* already counted in active_timers */
+				if (!tbase_get_deferrable(timer->base) &&
+				    time_before(timer_bucket_expiry(timer),
+						base->next_timer))
+					base->next_timer =
+						timer_bucket_expiry(timer);
+				continue;
+			}
+
 			fn = timer->function;
 			data = timer->data;
 			irqsafe = tbase_get_irqsafe(timer->base);
@@ -1219,6 +1291,40 @@ static inline void __run_timers(struct tvec_base *base)
 }
 
 #ifdef CONFIG_NO_HZ_COMMON
+/* Does @head hold a timer which isn't deferrable? */
+static bool bucket_has_active_timer(struct list_head *head)
+{
+	struct timer_list *nte;
+
+	list_for_each_entry(nte, head, entry)
+		if (!tbase_get_deferrable(nte->base))
+			return true;
+	return false;
+}
+
+/*
+ * Search the buckets of the level starting at @offset, beginning with
+ * position @clk, for the first one holding a non deferrable timer.
+ * Returns its distance from @clk in buckets, or -1 if there is none.
+ */
+static int next_pending_bucket(struct tvec_base *base, unsigned int offset,
+			       unsigned int clk)
+{
+	unsigned int pos, start = offset + clk;
+	unsigned int end = offset + LVL_SIZE;
+
+	for (pos = find_next_bit(base->pending_map, end, start); pos < end;
+	     pos = find_next_bit(base->pending_map, end, pos + 1))
+		if (bucket_has_active_timer(base->vectors + pos))
+			return pos - start;
+
+	for (pos = find_next_bit(base->pending_map, start, offset); pos < start;
+	     pos = find_next_bit(base->pending_map, start, pos + 1))
+		if (bucket_has_active_timer(base->vectors + pos))
+			return pos + LVL_SIZE - start;
+	return -1;
+}
+
 /*
  * Find out when the next timer event is due to happen. This
  * is used on S/390 to stop all activity when a CPU is idle.
@@ -1226,70 +1332,31 @@ static inline void __run_timers(struct tvec_base *base)
  */
 static unsigned long __next_timer_interrupt(struct tvec_base *base)
 {
-	unsigned long timer_jiffies = base->timer_jiffies;
-	unsigned long expires = timer_jiffies + NEXT_TIMER_MAX_DELTA;
-	int index, slot, array, found = 0;
-	struct timer_list *nte;
-	struct tvec *varray[4];
+	unsigned long clk = base->timer_jiffies;
+	unsigned long expires = clk + NEXT_TIMER_MAX_DELTA;
+	unsigned int lvl, offset = 0;
+	int adj, pos;
 
-	/* Look for timer events in tv1. */
-	index = slot = timer_jiffies & TVR_MASK;
-	do {
-		list_for_each_entry(nte, base->tv1.vec + slot, entry) {
-			if (tbase_get_deferrable(nte->base))
-				continue;
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++, offset += LVL_SIZE) {
+		/* Nothing in this or coarser levels can expire earlier */
+		if (!time_before(clk << LVL_SHIFT(lvl), expires))
+			break;
 
-			found = 1;
-			expires = nte->expires;
-			/* Look at the cascade bucket(s)? */
-			if (!index || slot < index)
-				goto cascade;
-			return expires;
+		pos = next_pending_bucket(base, offset, clk & LVL_MASK);
+		if (pos >= 0) {
+			unsigned long tmp = (clk + pos) << LVL_SHIFT(lvl);
+
+			if (time_before(tmp, expires))
+				expires = tmp;
 		}
-		slot = (slot + 1) & TVR_MASK;
-	} while (slot != index);
-
-cascade:
-	/* Calculate the next cascade event */
-	if (index)
-		timer_jiffies += TVR_SIZE - index;
-	timer_jiffies >>= TVR_BITS;
-
-	/* Check tv2-tv5. */
-	varray[0] = &base->tv2;
-	varray[1] = &base->tv3;
-	varray[2] = &base->tv4;
-	varray[3] = &base->tv5;
-
-	for (array = 0; array < 4; array++) {
-		struct tvec *varp = varray[array];
-
-		index = slot = timer_jiffies & TVN_MASK;
-		do {
-			list_for_each_entry(nte, varp->vec + slot, entry) {
-				if (tbase_get_deferrable(nte->base))
-					continue;
-
-				found = 1;
-				if (time_before(nte->expires, expires))
-					expires = nte->expires;
-			}
-			/*
-			 * Do we still search for the first timer or are
-			 * we looking up the cascade buckets ?
-			 */
-			if (found) {
-				/* Look at the cascade bucket(s)? */
-				if (!index || slot < index)
-					break;
-				return expires;
-			}
-			slot = (slot + 1) & TVN_MASK;
-		} while (slot != index);
 
-		if (index)
-			timer_jiffies += TVN_SIZE - index;
-		timer_jiffies >>= TVN_BITS;
+		/*
+		 * The next level is run when the lower bits of
+		 * ->timer_jiffies wrap, so round up to its position.
+		 */
+		adj = clk & LVL_CLK_MASK ? 1 : 0;
+		clk >>= LVL_CLK_SHIFT;
+		clk += adj;
 	}
 	return expires;
 }
@@ -1573,14 +1640,9 @@ static int init_timers_cpu(int cpu)
 	}
 
 
-	for (j = 0; j < TVN_SIZE; j++) {
-		INIT_LIST_HEAD(base->tv5.vec + j);
-		INIT_LIST_HEAD(base->tv4.vec + j);
-		INIT_LIST_HEAD(base->tv3.vec + j);
-		INIT_LIST_HEAD(base->tv2.vec + j);
-	}
-	for (j = 0; j < TVR_SIZE; j++)
-		INIT_LIST_HEAD(base->tv1.vec + j);
+	for (j = 0; j < WHEEL_SIZE; j++)
+		INIT_LIST_HEAD(base->vectors + j);
+	bitmap_zero(base->pending_map, WHEEL_SIZE);
 
 	base->timer_jiffies = jiffies;
 	base->next_timer = base->timer_jiffies;
@@ -1621,14 +1683,8 @@ static void migrate_timers(int cpu)
 
 	BUG_ON(old_base->running_timer);
 
-	for (i = 0; i < TVR_SIZE; i++)
-		migrate_timer_list(new_base, old_base->tv1.vec + i);
-	for (i = 0; i < TVN_SIZE; i++) {
-		migrate_timer_list(new_base, old_base->tv2.vec + i);
-		migrate_timer_list(new_base, old_base->tv3.vec + i);
-		migrate_timer_list(new_base, old_base->tv4.vec + i);
-		migrate_timer_list(new_base, old_base->tv5.vec + i);
-	}
+	for (i = 0; i < WHEEL_SIZE; i++)
+		migrate_timer_list(new_base, old_base->vectors + i);
 
 	spin_unlock(&old_base->lock);
 	spin_unlock_irq(&new_base->lock);
@@ -24,7 +24,10 @@
 #include <linux/list.h>
 #include <linux/cpu.h>
 #include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/trace_mmap.h>
 
+#include <asm/cacheflush.h>
 #include <asm/local.h>
 
 static void update_pages_handler(struct work_struct *work);
@@ -356,6 +359,7 @@ struct buffer_page {
 	unsigned	 read;		/* index for next read */
 	local_t		 entries;	/* entries on this page */
 	unsigned long	 real_end;	/* real end of data */
+	unsigned	 id;		/* index in a user space mapping */
 	struct buffer_data_page *page;	/* Actual data page */
 };
 
@@ -489,6 +493,11 @@ struct ring_buffer_per_cpu {
 	struct completion		update_done;
 
 	struct rb_irq_work		irq_work;
+
+	/* user space mapping, see ring_buffer_map() */
+	int				mapped;
+	struct trace_buffer_meta	*meta_page;
+	unsigned long			*subbuf_ids;	/* id to data page */
 };
 
 struct ring_buffer {
@@ -1127,8 +1136,9 @@ static int __rb_allocate_pages(int nr_pages, struct list_head *pages, int cpu)
 
 		list_add(&bpage->list, pages);
 
+		/* zeroed, as it may get mapped to user space */
 		page = alloc_pages_node(cpu_to_node(cpu),
-					GFP_KERNEL | __GFP_NORETRY, 0);
+					GFP_KERNEL | __GFP_NORETRY | __GFP_ZERO, 0);
 		if (!page)
 			goto free_pages;
 		bpage->page = page_address(page);
@@ -1202,7 +1212,7 @@ rb_allocate_cpu_buffer(struct ring_buffer *buffer, int nr_pages, int cpu)
 	rb_check_bpage(cpu_buffer, bpage);
 
 	cpu_buffer->reader_page = bpage;
-	page = alloc_pages_node(cpu_to_node(cpu), GFP_KERNEL, 0);
+	page = alloc_pages_node(cpu_to_node(cpu), GFP_KERNEL | __GFP_ZERO, 0);
 	if (!page)
 		goto fail_free_reader;
 	bpage->page = page_address(page);
@@ -1654,6 +1664,12 @@ int ring_buffer_resize(struct ring_buffer *buffer, unsigned long size,
 	/* prevent another thread from changing buffer sizes */
 	mutex_lock(&buffer->mutex);
 
+	/* ring_buffer_map() disables resizing under the mutex */
+	if (atomic_read(&buffer->resize_disabled)) {
+		mutex_unlock(&buffer->mutex);
+		return -EBUSY;
+	}
+
 	if (cpu_id == RING_BUFFER_ALL_CPUS) {
 		/* calculate the pages to update */
 		for_each_buffer_cpu(buffer, cpu) {
@@ -4305,6 +4321,12 @@ int ring_buffer_swap_cpu(struct ring_buffer *buffer_a,
 	if (cpu_buffer_a->nr_pages != cpu_buffer_b->nr_pages)
 		goto out;
 
+	ret = -EBUSY;
+
+	/* User space maps the pages of the buffers */
+	if (cpu_buffer_a->mapped || cpu_buffer_b->mapped)
+		goto out;
+
 	ret = -EAGAIN;
 
 	if (ring_buffer_flags != RB_BUFFERS_ON)
@@ -4469,6 +4491,10 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 
 	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
 
+	/* The reader page may be swapped, which would break the mapping */
+	if (cpu_buffer->mapped)
+		goto out_unlock;
+
 	reader = rb_get_reader_page(cpu_buffer);
 	if (!reader)
 		goto out_unlock;
@@ -4598,6 +4624,239 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 }
 EXPORT_SYMBOL_GPL(ring_buffer_read_page);
 
+static void rb_update_meta_page(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+
+	meta->reader.id = cpu_buffer->reader_page->id;
+	meta->reader.read = cpu_buffer->reader_page->read;
+	meta->entries = local_read(&cpu_buffer->entries);
+	meta->overrun = local_read(&cpu_buffer->overrun);
+	meta->read = cpu_buffer->read;
+
+	flush_dcache_page(virt_to_page(meta));
+}
+
+static void rb_setup_ids_meta_page(struct ring_buffer_per_cpu *cpu_buffer,
+				   unsigned long *subbuf_ids)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+	struct buffer_page *first, *bpage;
+	unsigned id = 0;
+
+	cpu_buffer->reader_page->id = id;
+	subbuf_ids[id++] = (unsigned long)cpu_buffer->reader_page->page;
+
+	/* Pages only change places in the ring under the reader_lock */
+	first = bpage = cpu_buffer->head_page;
+	do {
+		if (WARN_ON(id > cpu_buffer->nr_pages))
+			break;
+		bpage->id = id;
+		subbuf_ids[id++] = (unsigned long)bpage->page;
+		rb_inc_page(cpu_buffer, &bpage);
+	} while (bpage != first);
+
+	cpu_buffer->subbuf_ids = subbuf_ids;
+
+	meta->meta_page_size = PAGE_SIZE;
+	meta->meta_struct_len = sizeof(*meta);
+	meta->subbuf_size = PAGE_SIZE;
+	meta->nr_subbufs = id;
+	meta->reader.lost_events = 0;
+
+	rb_update_meta_page(cpu_buffer);
+}
+
+/**
+ * ring_buffer_map - prepare a cpu buffer to be mapped to user space
+ * @buffer: the buffer the cpu buffer is on
+ * @cpu: the cpu buffer to map
+ *
+ * The mapping is made of a meta page (struct trace_buffer_meta)
+ * followed by every data page of the cpu buffer, reader page included,
+ * each at the index given by its id. The pages keep their ids as the
+ * reader page is swapped with the head of the ring, which is why
+ * resizing, swapping and ring_buffer_read_page() are refused while the
+ * buffer is mapped. The mapping is read-only: it is consumed with
+ * ring_buffer_map_get_reader().
+ *
+ * Calls nest; each one must be paired with ring_buffer_unmap().
+ *
+ * Returns 0 on success or a negative errno.
+ */
+int ring_buffer_map(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	unsigned long *subbuf_ids;
+	unsigned long flags;
+	int ret = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+
+	if (cpu_buffer->mapped) {
+		cpu_buffer->mapped++;
+		goto out;
+	}
+
+	/* the reader page is not in the ring */
+	subbuf_ids = kcalloc(cpu_buffer->nr_pages + 1, sizeof(*subbuf_ids),
+			     GFP_KERNEL);
+	if (!subbuf_ids) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	cpu_buffer->meta_page = (void *)get_zeroed_page(GFP_KERNEL);
+	if (!cpu_buffer->meta_page) {
+		kfree(subbuf_ids);
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	atomic_inc(&buffer->resize_disabled);
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	rb_setup_ids_meta_page(cpu_buffer, subbuf_ids);
+	cpu_buffer->mapped = 1;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+ out:
+	mutex_unlock(&buffer->mutex);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map);
+
+/**
+ * ring_buffer_unmap - drop a mapping taken by ring_buffer_map()
+ * @buffer: the buffer the cpu buffer is on
+ * @cpu: the mapped cpu buffer
+ */
+void ring_buffer_unmap(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	unsigned long *subbuf_ids;
+	unsigned long flags;
+	void *meta;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+
+	if (WARN_ON(!cpu_buffer->mapped) || --cpu_buffer->mapped)
+		goto out;
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	meta = cpu_buffer->meta_page;
+	subbuf_ids = cpu_buffer->subbuf_ids;
+	cpu_buffer->meta_page = NULL;
+	cpu_buffer->subbuf_ids = NULL;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	atomic_dec(&buffer->resize_disabled);
+
+	/* user space drops its own references on the pages */
+	free_page((unsigned long)meta);
+	kfree(subbuf_ids);
+ out:
+	mutex_unlock(&buffer->mutex);
+}
+EXPORT_SYMBOL_GPL(ring_buffer_unmap);
+
+/**
+ * ring_buffer_map_fault - page of a cpu buffer mapping
+ * @buffer: the buffer the cpu buffer is on
+ * @cpu: the mapped cpu buffer
+ * @pgoff: the page offset in the mapping
+ *
+ * Returns the page, or NULL if @pgoff is past the mapping. The caller
+ * must hold a mapping of the cpu buffer.
+ */
+struct page *ring_buffer_map_fault(struct ring_buffer *buffer, int cpu,
+				   unsigned long pgoff)
+{
+	struct ring_buffer_per_cpu *cpu_buffer = buffer->buffers[cpu];
+
+	if (WARN_ON_ONCE(!cpu_buffer->mapped))
+		return NULL;
+
+	if (!pgoff)
+		return virt_to_page(cpu_buffer->meta_page);
+
+	if (pgoff - 1 >= cpu_buffer->meta_page->nr_subbufs)
+		return NULL;
+
+	return virt_to_page((void *)cpu_buffer->subbuf_ids[pgoff - 1]);
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_fault);
+
+/**
+ * ring_buffer_map_get_reader - consume the reader page of a mapping
+ * @buffer: the buffer the cpu buffer is on
+ * @cpu: the mapped cpu buffer
+ * @consumed: offset up to which user space has read the reader page
+ *
+ * Consumes the events of the reader page up to @consumed and, if the
+ * page is then fully consumed and the writer has moved on, swaps the
+ * next page of the ring in as the reader page. The meta page tells
+ * where to read next, and how many events were lost before it.
+ *
+ * Returns 0 on success or a negative errno.
+ */
+int ring_buffer_map_get_reader(struct ring_buffer *buffer, int cpu,
+			       unsigned long consumed)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct buffer_page *reader;
+	unsigned long flags;
+	int ret = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+
+	if (!cpu_buffer->mapped) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	reader = cpu_buffer->reader_page;
+	if (consumed > rb_page_size(reader)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	while (reader->read < consumed)
+		rb_advance_reader(cpu_buffer);
+
+	/* Only returns a page when it swapped a new one in */
+	if (reader->read == rb_page_size(reader) &&
+	    rb_get_reader_page(cpu_buffer)) {
+		cpu_buffer->meta_page->reader.lost_events =
+			cpu_buffer->lost_events;
+		cpu_buffer->lost_events = 0;
+		flush_dcache_page(virt_to_page(cpu_buffer->reader_page->page));
+	}
+
+	rb_update_meta_page(cpu_buffer);
+ out:
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_get_reader);
+
 #ifdef CONFIG_HOTPLUG_CPU
 static int rb_cpu_notify(struct notifier_block *self,
 			 unsigned long action, void *hcpu)
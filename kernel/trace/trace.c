@@ -39,6 +39,7 @@
 #include <linux/nmi.h>
 #include <linux/fs.h>
 #include <linux/sched/rt.h>
+#include <linux/trace_mmap.h>
 
 #include "trace.h"
 #include "trace_output.h"
@@ -1048,6 +1049,9 @@ update_max_tr(struct trace_array *tr, struct task_struct *tsk, int cpu)
 		return;
 	}
 
+	if (atomic_read(&tr->mapped))
+		return;
+
 	arch_spin_lock(&ftrace_max_lock);
 
 	buf = tr->trace_buffer.buffer;
@@ -1081,6 +1085,9 @@ update_max_tr_single(struct trace_array *tr, struct task_struct *tsk, int cpu)
 		return;
 	}
 
+	if (atomic_read(&tr->mapped))
+		return;
+
 	arch_spin_lock(&ftrace_max_lock);
 
 	ret = ring_buffer_swap_cpu(tr->max_buffer.buffer, tr->trace_buffer.buffer, cpu);
@@ -5425,12 +5432,110 @@ out:
 	return ret;
 }
 
+static void tracing_buffers_mmap_open(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+	/* can't fail, the cpu buffer is already mapped */
+	WARN_ON(ring_buffer_map(iter->trace_buffer->buffer, iter->cpu_file));
+#ifdef CONFIG_TRACER_MAX_TRACE
+	atomic_inc(&iter->tr->mapped);
+#endif
+}
+
+static void tracing_buffers_mmap_close(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+#ifdef CONFIG_TRACER_MAX_TRACE
+	atomic_dec(&iter->tr->mapped);
+#endif
+	ring_buffer_unmap(iter->trace_buffer->buffer, iter->cpu_file);
+}
+
+static int tracing_buffers_mmap_fault(struct vm_area_struct *vma,
+				      struct vm_fault *vmf)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+	struct trace_iterator *iter = &info->iter;
+	struct page *page;
+
+	page = ring_buffer_map_fault(iter->trace_buffer->buffer,
+				     iter->cpu_file, vmf->pgoff);
+	if (!page)
+		return VM_FAULT_SIGBUS;
+
+	get_page(page);
+	vmf->page = page;
+
+	return 0;
+}
+
+static const struct vm_operations_struct tracing_buffers_vmops = {
+	.open		= tracing_buffers_mmap_open,
+	.close		= tracing_buffers_mmap_close,
+	.fault		= tracing_buffers_mmap_fault,
+};
+
+/*
+ * Map the meta page and the data pages of the cpu buffer read-only,
+ * see include/uapi/linux/trace_mmap.h. While the mapping exists, the
+ * buffer is consumed with TRACE_MMAP_IOCTL_GET_READER instead of
+ * read() and splice(), and is neither resized nor snapshotted.
+ *
+ * Note, mmap_sem is held here, so trace_types_lock can't be taken.
+ */
+static int tracing_buffers_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = filp->private_data;
+	struct trace_iterator *iter = &info->iter;
+	int ret;
+
+	if (vma->vm_flags & (VM_WRITE | VM_EXEC))
+		return -EPERM;
+
+#ifdef CONFIG_TRACER_MAX_TRACE
+	if (iter->snapshot || iter->tr->allocated_snapshot)
+		return -EBUSY;
+#endif
+
+	ret = ring_buffer_map(iter->trace_buffer->buffer, iter->cpu_file);
+	if (ret)
+		return ret;
+
+#ifdef CONFIG_TRACER_MAX_TRACE
+	atomic_inc(&iter->tr->mapped);
+#endif
+	vma->vm_flags |= VM_DONTCOPY | VM_DONTEXPAND | VM_DONTDUMP;
+	vma->vm_flags &= ~(VM_MAYWRITE | VM_MAYEXEC);
+	vma->vm_ops = &tracing_buffers_vmops;
+
+	return 0;
+}
+
+static long tracing_buffers_ioctl(struct file *file, unsigned int cmd,
+				  unsigned long arg)
+{
+	struct ftrace_buffer_info *info = file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+	if (cmd != TRACE_MMAP_IOCTL_GET_READER)
+		return -ENOTTY;
+
+	return ring_buffer_map_get_reader(iter->trace_buffer->buffer,
+					  iter->cpu_file, arg);
+}
+
 static const struct file_operations tracing_buffers_fops = {
 	.open		= tracing_buffers_open,
 	.read		= tracing_buffers_read,
 	.poll		= tracing_buffers_poll,
 	.release	= tracing_buffers_release,
 	.splice_read	= tracing_buffers_splice_read,
+	.mmap		= tracing_buffers_mmap,
+	.unlocked_ioctl	= tracing_buffers_ioctl,
 	.llseek		= no_llseek,
 };
 
@@ -0,0 +1,196 @@
+/*
+ * BPF programs as perf trace event filters
+ *
+ * A classic BPF program attached to a perf trace event with the
+ * PERF_EVENT_IOC_SET_BPF ioctl is run over the raw record of each event,
+ * laid out as in the 'format' file of the event: BPF_LD|BPF_W|BPF_ABS
+ * loads the 32-bit word at the given offset and BPF_LD|BPF_W|BPF_LEN
+ * yields the size of the fixed part of the record. Events the program
+ * returns 0 for are dropped before they reach the perf buffer.
+ *
+ * The program is checked and converted to internal BPF like seccomp
+ * filters are, so it runs JITed where the architecture supports it.
+ */
+
+#include <linux/filter.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include "trace.h"
+
+/* The size of the fixed part of the records of @call */
+static unsigned int trace_event_record_size(struct ftrace_event_call *call)
+{
+	struct ftrace_event_field *field;
+	unsigned int size = sizeof(struct trace_entry);
+
+	list_for_each_entry(field, trace_get_fields(call), link)
+		size = max_t(unsigned int, size, field->offset + field->size);
+
+	return size;
+}
+
+/*
+ * Takes a filter checked by sk_chk_filter() and redirects the loads
+ * of skb data to the record, within @size, as seccomp_check_filter()
+ * does for seccomp_data.
+ */
+static int trace_bpf_check_filter(struct sock_filter *filter,
+				  unsigned int flen, unsigned int size)
+{
+	int pc;
+
+	for (pc = 0; pc < flen; pc++) {
+		struct sock_filter *ftest = &filter[pc];
+		u16 code = ftest->code;
+		u32 k = ftest->k;
+
+		switch (code) {
+		case BPF_S_LD_W_ABS:
+			ftest->code = BPF_LDX | BPF_W | BPF_ABS;
+			/* 32-bit aligned and not out of bounds. */
+			if (k > size - sizeof(u32) || k & 3)
+				return -EINVAL;
+			continue;
+		case BPF_S_LD_W_LEN:
+			ftest->code = BPF_LD | BPF_IMM;
+			ftest->k = size;
+			continue;
+		case BPF_S_LDX_W_LEN:
+			ftest->code = BPF_LDX | BPF_IMM;
+			ftest->k = size;
+			continue;
+		/* Explicitly include allowed calls. */
+		case BPF_S_RET_K:
+		case BPF_S_RET_A:
+		case BPF_S_ALU_ADD_K:
+		case BPF_S_ALU_ADD_X:
+		case BPF_S_ALU_SUB_K:
+		case BPF_S_ALU_SUB_X:
+		case BPF_S_ALU_MUL_K:
+		case BPF_S_ALU_MUL_X:
+		case BPF_S_ALU_DIV_X:
+		case BPF_S_ALU_AND_K:
+		case BPF_S_ALU_AND_X:
+		case BPF_S_ALU_OR_K:
+		case BPF_S_ALU_OR_X:
+		case BPF_S_ALU_XOR_K:
+		case BPF_S_ALU_XOR_X:
+		case BPF_S_ALU_LSH_K:
+		case BPF_S_ALU_LSH_X:
+		case BPF_S_ALU_RSH_K:
+		case BPF_S_ALU_RSH_X:
+		case BPF_S_ALU_NEG:
+		case BPF_S_LD_IMM:
+		case BPF_S_LDX_IMM:
+		case BPF_S_MISC_TAX:
+		case BPF_S_MISC_TXA:
+		case BPF_S_ALU_DIV_K:
+		case BPF_S_LD_MEM:
+		case BPF_S_LDX_MEM:
+		case BPF_S_ST:
+		case BPF_S_STX:
+		case BPF_S_JMP_JA:
+		case BPF_S_JMP_JEQ_K:
+		case BPF_S_JMP_JEQ_X:
+		case BPF_S_JMP_JGE_K:
+		case BPF_S_JMP_JGE_X:
+		case BPF_S_JMP_JGT_K:
+		case BPF_S_JMP_JGT_X:
+		case BPF_S_JMP_JSET_K:
+		case BPF_S_JMP_JSET_X:
+			sk_decode_filter(ftest, ftest);
+			continue;
+		default:
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
+
+int ftrace_profile_set_bpf(struct perf_event *event,
+			   struct sock_fprog __user *uprog)
+{
+	struct ftrace_event_call *call;
+	struct sock_filter *fp;
+	struct sk_filter *prog;
+	struct sock_fprog fprog;
+	unsigned long fp_size;
+	int new_len;
+	int err;
+
+	if (copy_from_user(&fprog, uprog, sizeof(fprog)))
+		return -EFAULT;
+
+	if (fprog.len == 0 || fprog.len > BPF_MAXINSNS)
+		return -EINVAL;
+
+	fp_size = fprog.len * sizeof(struct sock_filter);
+	fp = kmalloc(fp_size, GFP_KERNEL | __GFP_NOWARN);
+	if (!fp)
+		return -ENOMEM;
+
+	err = -EFAULT;
+	if (copy_from_user(fp, fprog.filter, fp_size))
+		goto free_fp;
+
+	err = sk_chk_filter(fp, fprog.len);
+	if (err)
+		goto free_fp;
+
+	mutex_lock(&event_mutex);
+
+	call = event->tp_event;
+
+	err = -EINVAL;
+	if (!call || ftrace_event_is_function(call))
+		goto out_unlock;
+
+	err = -EEXIST;
+	if (event->bpf_filter)
+		goto out_unlock;
+
+	err = trace_bpf_check_filter(fp, fprog.len,
+				     trace_event_record_size(call));
+	if (err)
+		goto out_unlock;
+
+	/* Convert 'sock_filter' insns to 'sock_filter_int' insns */
+	err = sk_convert_filter(fp, fprog.len, NULL, &new_len);
+	if (err)
+		goto out_unlock;
+
+	err = -ENOMEM;
+	prog = kzalloc(sk_filter_size(new_len), GFP_KERNEL | __GFP_NOWARN);
+	if (!prog)
+		goto out_unlock;
+
+	err = sk_convert_filter(fp, fprog.len, prog->insnsi, &new_len);
+	if (err) {
+		kfree(prog);
+		goto out_unlock;
+	}
+
+	atomic_set(&prog->refcnt, 1);
+	prog->len = new_len;
+	sk_filter_select_runtime(prog);
+
+	/* Pairs with smp_read_barrier_depends() in perf_tp_filter_match() */
+	smp_wmb();
+	event->bpf_filter = prog;
+
+ out_unlock:
+	mutex_unlock(&event_mutex);
+ free_fp:
+	kfree(fp);
+	return err;
+}
+
+/* Called once the event can no longer fire, after a grace period */
+void ftrace_profile_free_bpf(struct perf_event *event)
+{
+	struct sk_filter *prog = event->bpf_filter;
+
+	event->bpf_filter = NULL;
+	if (prog)
+		sk_filter_free(prog);
+}
@@ -0,0 +1,597 @@
+/*
+ * trace_events_hist - trace event hist triggers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A hist trigger aggregates the events it is attached to in a hash
+ * table, keyed on one or more event fields, instead of logging them:
+ *
+ *   hist:keys=<field>[,<field>...][:vals=<field>[,<field>...]][:size=<n>]
+ *	[if <filter>]
+ *
+ * Each entry counts its hits and sums the vals fields.  The table is
+ * allocated when the trigger is set and updated locklessly from the
+ * event, in any context; it is read through the 'hist' file of the event.
+ *
+ * Besides the event fields, a key can be 'cpu', the CPU the event hit
+ * on, and a key field suffixed with '.log2' is bucketed by its highest
+ * set bit: bucket n holds the values in [2^(n-1), 2^n), 0 holds 0.  So
+ * 'keys=pid,delay.log2' yields a latency histogram per task.
+ */
+
+#include <linux/module.h>
+#include <linux/kallsyms.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/jhash.h>
+#include <linux/sort.h>
+#include <linux/log2.h>
+
+#include "trace.h"
+
+#define HIST_KEYS_MAX		3
+#define HIST_VALS_MAX		3	/* besides the hitcount */
+#define HIST_SIZE_DEFAULT	2048
+#define HIST_SIZE_MAX		(1 << 16)
+
+#define HIST_FIELD_CPU		(1 << 0)
+#define HIST_FIELD_LOG2		(1 << 1)
+
+struct hist_field {
+	char			*name;
+	int			offset;
+	int			size;
+	int			is_signed;
+	unsigned int		flags;
+};
+
+struct hist_elt {
+	u64			key[HIST_KEYS_MAX];
+	atomic64_t		hitcount;
+	atomic64_t		vals[HIST_VALS_MAX];
+};
+
+/*
+ * The hash of the key claims a slot, 0 marks a free one.  The element
+ * is published once its key is set, so lookups skip slots without one.
+ */
+struct hist_slot {
+	u32			hash;
+	struct hist_elt		*elt;
+};
+
+struct hist_trigger_data {
+	struct hist_field	keys[HIST_KEYS_MAX];
+	unsigned int		n_keys;
+	struct hist_field	vals[HIST_VALS_MAX];
+	unsigned int		n_vals;
+	unsigned int		size;		/* max number of entries */
+	unsigned int		map_bits;	/* twice as many slots */
+	struct hist_slot	*slots;
+	struct hist_elt		*elts;
+	atomic_t		next_elt;
+	atomic64_t		drops;
+};
+
+static u64 hist_field_read_rec(struct hist_field *field, void *rec)
+{
+	void *addr = rec + field->offset;
+
+	switch (field->size) {
+	case 1:
+		return field->is_signed ? (u64)*(s8 *)addr : *(u8 *)addr;
+	case 2:
+		return field->is_signed ? (u64)*(s16 *)addr : *(u16 *)addr;
+	case 4:
+		return field->is_signed ? (u64)*(s32 *)addr : *(u32 *)addr;
+	default:
+		return *(u64 *)addr;
+	}
+}
+
+static u64 hist_field_read(struct hist_field *field, void *rec)
+{
+	u64 val;
+
+	if (field->flags & HIST_FIELD_CPU)
+		val = raw_smp_processor_id();
+	else
+		val = hist_field_read_rec(field, rec);
+
+	if (field->flags & HIST_FIELD_LOG2)
+		val = fls64(val);
+
+	return val;
+}
+
+static struct hist_elt *hist_elt_publish(struct hist_trigger_data *hist_data,
+					 struct hist_slot *slot, u64 *key)
+{
+	struct hist_elt *elt;
+	int idx;
+
+	/* Only claimed slots get here, so this can't wrap */
+	idx = atomic_inc_return(&hist_data->next_elt) - 1;
+	if (idx >= hist_data->size)
+		return NULL;
+
+	elt = &hist_data->elts[idx];
+	memcpy(elt->key, key, hist_data->n_keys * sizeof(u64));
+	smp_wmb();	/* pairs with smp_read_barrier_depends() in lookup */
+	ACCESS_ONCE(slot->elt) = elt;
+
+	return elt;
+}
+
+/*
+ * Find the entry of @key, inserting it if needed, by linear probing.
+ *
+ * Two events racing to insert the same key may both claim a slot for
+ * it; the entries are merged when printing.
+ */
+static struct hist_elt *hist_map_insert(struct hist_trigger_data *hist_data,
+					u64 *key)
+{
+	size_t key_size = hist_data->n_keys * sizeof(u64);
+	u32 mask = (1U << hist_data->map_bits) - 1;
+	u32 hash, idx, n;
+
+	hash = jhash(key, key_size, 0) ? : 1;
+	idx = hash & mask;
+
+	for (n = 0; n <= mask; n++, idx = (idx + 1) & mask) {
+		struct hist_slot *slot = &hist_data->slots[idx];
+		struct hist_elt *elt;
+		u32 slot_hash;
+
+		slot_hash = ACCESS_ONCE(slot->hash);
+		if (!slot_hash) {
+			slot_hash = cmpxchg(&slot->hash, 0, hash);
+			if (!slot_hash)
+				return hist_elt_publish(hist_data, slot, key);
+		}
+		if (slot_hash != hash)
+			continue;
+
+		elt = ACCESS_ONCE(slot->elt);
+		if (!elt)
+			continue;
+		smp_read_barrier_depends();
+		if (!memcmp(elt->key, key, key_size))
+			return elt;
+	}
+
+	return NULL;
+}
+
+static void
+event_hist_trigger(struct event_trigger_data *data, void *rec)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	u64 key[HIST_KEYS_MAX] = { };
+	struct hist_elt *elt;
+	unsigned int i;
+
+	/* Racing with the registration, before the cond flag is set */
+	if (!rec)
+		return;
+
+	for (i = 0; i < hist_data->n_keys; i++)
+		key[i] = hist_field_read(&hist_data->keys[i], rec);
+
+	elt = hist_map_insert(hist_data, key);
+	if (!elt) {
+		atomic64_inc(&hist_data->drops);
+		return;
+	}
+
+	atomic64_inc(&elt->hitcount);
+	for (i = 0; i < hist_data->n_vals; i++)
+		atomic64_add(hist_field_read(&hist_data->vals[i], rec),
+			     &elt->vals[i]);
+}
+
+static void destroy_hist_data(struct hist_trigger_data *hist_data)
+{
+	unsigned int i;
+
+	for (i = 0; i < hist_data->n_keys; i++)
+		kfree(hist_data->keys[i].name);
+	for (i = 0; i < hist_data->n_vals; i++)
+		kfree(hist_data->vals[i].name);
+	vfree(hist_data->slots);
+	vfree(hist_data->elts);
+	kfree(hist_data);
+}
+
+static int parse_hist_fields(struct ftrace_event_call *call, char *str,
+			     struct hist_field *fields, unsigned int *n_fields,
+			     unsigned int max_fields, bool is_val)
+{
+	struct ftrace_event_field *field;
+	struct hist_field *hist_field;
+	char *name, *modifier;
+
+	while ((name = strsep(&str, ",")) != NULL) {
+		if (!*name)
+			return -EINVAL;
+		/* always there */
+		if (is_val && !strcmp(name, "hitcount"))
+			continue;
+		if (*n_fields == max_fields)
+			return -EINVAL;
+
+		hist_field = &fields[*n_fields];
+		hist_field->flags = 0;
+
+		modifier = strchr(name, '.');
+		if (modifier) {
+			if (is_val || strcmp(modifier, ".log2"))
+				return -EINVAL;
+			hist_field->flags |= HIST_FIELD_LOG2;
+			*modifier = '\0';
+		}
+
+		field = trace_find_event_field(call, name);
+		if (!field && !is_val && !strcmp(name, "cpu")) {
+			hist_field->flags |= HIST_FIELD_CPU;
+		} else {
+			if (!field || field->filter_type != FILTER_OTHER)
+				return -EINVAL;
+			if (field->size != 1 && field->size != 2 &&
+			    field->size != 4 && field->size != 8)
+				return -EINVAL;
+			hist_field->offset = field->offset;
+			hist_field->size = field->size;
+			hist_field->is_signed = field->is_signed;
+		}
+
+		/* buckets are never negative */
+		if (hist_field->flags & HIST_FIELD_LOG2)
+			hist_field->is_signed = 0;
+
+		/* keep the modifier in the name, for printing the trigger */
+		if (modifier)
+			*modifier = '.';
+		hist_field->name = kstrdup(name, GFP_KERNEL);
+		if (!hist_field->name)
+			return -ENOMEM;
+		(*n_fields)++;
+	}
+
+	return 0;
+}
+
+static struct hist_trigger_data *
+create_hist_data(struct ftrace_event_call *call, char *trigger)
+{
+	struct hist_trigger_data *hist_data;
+	unsigned long size = HIST_SIZE_DEFAULT;
+	char *str;
+	int ret;
+
+	hist_data = kzalloc(sizeof(*hist_data), GFP_KERNEL);
+	if (!hist_data)
+		return ERR_PTR(-ENOMEM);
+
+	ret = -EINVAL;
+	while ((str = strsep(&trigger, ":")) != NULL) {
+		if (!strncmp(str, "keys=", strlen("keys=")))
+			ret = parse_hist_fields(call, str + strlen("keys="),
+						hist_data->keys,
+						&hist_data->n_keys,
+						HIST_KEYS_MAX, false);
+		else if (!strncmp(str, "vals=", strlen("vals=")))
+			ret = parse_hist_fields(call, str + strlen("vals="),
+						hist_data->vals,
+						&hist_data->n_vals,
+						HIST_VALS_MAX, true);
+		else if (!strncmp(str, "size=", strlen("size="))) {
+			ret = kstrtoul(str + strlen("size="), 0, &size);
+			if (!ret && (!size || size > HIST_SIZE_MAX))
+				ret = -EINVAL;
+		} else
+			ret = -EINVAL;
+		if (ret)
+			goto free;
+	}
+
+	ret = -EINVAL;
+	if (!hist_data->n_keys)
+		goto free;
+
+	hist_data->size = size;
+	hist_data->map_bits = ilog2(roundup_pow_of_two(size)) + 1;
+
+	ret = -ENOMEM;
+	hist_data->slots = vzalloc(sizeof(struct hist_slot) <<
+				   hist_data->map_bits);
+	hist_data->elts = vzalloc(sizeof(struct hist_elt) * size);
+	if (!hist_data->slots || !hist_data->elts)
+		goto free;
+
+	return hist_data;
+ free:
+	destroy_hist_data(hist_data);
+	return ERR_PTR(ret);
+}
+
+static int
+event_hist_trigger_print(struct seq_file *m, struct event_trigger_ops *ops,
+			 struct event_trigger_data *data)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	unsigned int i;
+
+	seq_puts(m, "hist:keys=");
+	for (i = 0; i < hist_data->n_keys; i++)
+		seq_printf(m, "%s%s", i ? "," : "", hist_data->keys[i].name);
+
+	seq_puts(m, ":vals=hitcount");
+	for (i = 0; i < hist_data->n_vals; i++)
+		seq_printf(m, ",%s", hist_data->vals[i].name);
+
+	seq_printf(m, ":size=%u", hist_data->size);
+
+	if (data->filter_str)
+		seq_printf(m, " if %s\n", data->filter_str);
+	else
+		seq_puts(m, "\n");
+
+	return 0;
+}
+
+static void
+event_hist_trigger_free(struct event_trigger_ops *ops,
+			struct event_trigger_data *data)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+
+	if (WARN_ON_ONCE(data->ref <= 0))
+		return;
+
+	data->ref--;
+	if (!data->ref) {
+		/* waits for the triggers running before freeing @data */
+		trigger_data_free(data);
+		destroy_hist_data(hist_data);
+	}
+}
+
+static struct event_trigger_ops event_hist_trigger_ops = {
+	.func			= event_hist_trigger,
+	.print			= event_hist_trigger_print,
+	.init			= event_trigger_init,
+	.free			= event_hist_trigger_free,
+};
+
+static struct event_trigger_ops *
+event_hist_get_trigger_ops(char *cmd, char *param)
+{
+	return &event_hist_trigger_ops;
+}
+
+static int
+event_hist_trigger_func(struct event_command *cmd_ops,
+			struct ftrace_event_file *file,
+			char *glob, char *cmd, char *param)
+{
+	struct event_trigger_data *trigger_data;
+	struct event_trigger_ops *trigger_ops;
+	struct hist_trigger_data *hist_data;
+	char *trigger;
+	int ret;
+
+	trigger_ops = cmd_ops->get_trigger_ops(cmd, param);
+
+	trigger_data = kzalloc(sizeof(*trigger_data), GFP_KERNEL);
+	if (!trigger_data)
+		return -ENOMEM;
+
+	trigger_data->count = -1;
+	trigger_data->ops = trigger_ops;
+	trigger_data->cmd_ops = cmd_ops;
+	INIT_LIST_HEAD(&trigger_data->list);
+
+	/* there is at most one hist trigger per event, no need to match */
+	if (glob[0] == '!') {
+		cmd_ops->unreg(glob+1, trigger_ops, trigger_data, file);
+		kfree(trigger_data);
+		return 0;
+	}
+
+	/* separate the trigger from the filter (k:v [if filter]) */
+	trigger = strsep(&param, " \t");
+	if (!trigger) {
+		kfree(trigger_data);
+		return -EINVAL;
+	}
+
+	hist_data = create_hist_data(file->event_call, trigger);
+	if (IS_ERR(hist_data)) {
+		kfree(trigger_data);
+		return PTR_ERR(hist_data);
+	}
+	trigger_data->private_data = hist_data;
+
+	if (param) {
+		ret = cmd_ops->set_filter(param, trigger_data, file);
+		if (ret < 0)
+			goto out_free;
+	}
+
+	ret = cmd_ops->reg(glob, trigger_ops, trigger_data, file);
+	/*
+	 * The above returns on success the # of triggers registered,
+	 * consider none a failure too.
+	 */
+	if (!ret) {
+		ret = -ENOENT;
+		goto out_free;
+	} else if (ret < 0)
+		goto out_free;
+
+	return 0;
+
+ out_free:
+	cmd_ops->set_filter(NULL, trigger_data, NULL);
+	kfree(trigger_data);
+	destroy_hist_data(hist_data);
+	return ret;
+}
+
+static struct event_command trigger_hist_cmd = {
+	.name			= "hist",
+	.trigger_type		= ETT_EVENT_HIST,
+	.needs_rec		= true,
+	.func			= event_hist_trigger_func,
+	.reg			= register_trigger,
+	.unreg			= unregister_trigger,
+	.get_trigger_ops	= event_hist_get_trigger_ops,
+	.set_filter		= set_trigger_filter,
+};
+
+__init int register_trigger_hist_cmd(void)
+{
+	int ret;
+
+	ret = register_event_command(&trigger_hist_cmd);
+	WARN_ON(ret < 0);
+
+	return ret;
+}
+
+static int cmp_hist_elt(const void *a, const void *b)
+{
+	const struct hist_elt *elt_a = *(const struct hist_elt **)a;
+	const struct hist_elt *elt_b = *(const struct hist_elt **)b;
+	unsigned int i;
+
+	/* unused keys are zero in every element */
+	for (i = 0; i < HIST_KEYS_MAX; i++) {
+		if (elt_a->key[i] != elt_b->key[i])
+			return elt_a->key[i] < elt_b->key[i] ? -1 : 1;
+	}
+	return 0;
+}
+
+static void hist_show_elt(struct seq_file *m,
+			  struct hist_trigger_data *hist_data,
+			  struct hist_elt *elt, u64 hitcount, u64 *vals)
+{
+	unsigned int i;
+
+	seq_puts(m, "{ ");
+	for (i = 0; i < hist_data->n_keys; i++) {
+		struct hist_field *key = &hist_data->keys[i];
+
+		seq_printf(m, i ? ", %s: " : "%s: ", key->name);
+		if (key->is_signed)
+			seq_printf(m, "%lld", (s64)elt->key[i]);
+		else
+			seq_printf(m, "%llu", elt->key[i]);
+	}
+	seq_printf(m, " } hitcount: %llu", hitcount);
+	for (i = 0; i < hist_data->n_vals; i++)
+		seq_printf(m, " %s: %llu", hist_data->vals[i].name, vals[i]);
+	seq_puts(m, "\n");
+}
+
+static int hist_show_data(struct seq_file *m, struct event_trigger_data *data)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	unsigned int nr_slots = 1U << hist_data->map_bits;
+	unsigned int i, j, n = 0, entries = 0;
+	struct hist_elt **elts;
+	u64 hits = 0;
+
+	elts = vmalloc(sizeof(*elts) * hist_data->size);
+	if (!elts)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_slots && n < hist_data->size; i++) {
+		struct hist_elt *elt = ACCESS_ONCE(hist_data->slots[i].elt);
+
+		if (!elt)
+			continue;
+		smp_read_barrier_depends();
+		elts[n++] = elt;
+	}
+
+	sort(elts, n, sizeof(*elts), cmp_hist_elt, NULL);
+
+	event_hist_trigger_print(m, data->ops, data);
+	seq_puts(m, "\n");
+
+	for (i = 0; i < n; i = j) {
+		u64 vals[HIST_VALS_MAX] = { };
+		u64 hitcount = 0;
+		unsigned int k;
+
+		/* merge the entries of a key inserted concurrently */
+		for (j = i; j < n && !cmp_hist_elt(&elts[i], &elts[j]); j++) {
+			hitcount += atomic64_read(&elts[j]->hitcount);
+			for (k = 0; k < hist_data->n_vals; k++)
+				vals[k] += atomic64_read(&elts[j]->vals[k]);
+		}
+
+		hist_show_elt(m, hist_data, elts[i], hitcount, vals);
+		hits += hitcount;
+		entries++;
+	}
+
+	seq_printf(m, "\nTotals:\n    Hits: %llu\n    Entries: %u\n"
+		   "    Dropped: %llu\n", hits, entries,
+		   (u64)atomic64_read(&hist_data->drops));
+
+	vfree(elts);
+	return 0;
+}
+
+static int hist_show(struct seq_file *m, void *v)
+{
+	struct event_trigger_data *data;
+	struct ftrace_event_file *file;
+	int ret = 0;
+
+	mutex_lock(&event_mutex);
+
+	file = event_file_data(m->private);
+	if (unlikely(!file)) {
+		ret = -ENODEV;
+		goto out_unlock;
+	}
+
+	list_for_each_entry_rcu(data, &file->triggers, list) {
+		if (data->cmd_ops->trigger_type == ETT_EVENT_HIST) {
+			ret = hist_show_data(m, data);
+			break;
+		}
+	}
+
+ out_unlock:
+	mutex_unlock(&event_mutex);
+
+	return ret;
+}
+
+static int event_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hist_show, file);
+}
+
+const struct file_operations event_hist_fops = {
+	.open = event_hist_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
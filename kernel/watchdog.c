@@ -24,6 +24,7 @@
 #include <linux/sysctl.h>
 #include <linux/smpboot.h>
 #include <linux/sched/rt.h>
+#include <linux/tick.h>
 
 #include <asm/irq_regs.h>
 #include <linux/kvm_para.h>
@@ -281,6 +282,9 @@ static enum hrtimer_restart watchdog_timer_fn(struct hrtimer *hrtimer)
 	/* .. and repeat */
 	hrtimer_forward_now(hrtimer, ns_to_ktime(sample_period));
 
+	/* print what a hard locked up CPU could not, e.g. its NMI warning */
+	printk_stage_flush_all();
+
 	if (touch_ts == 0) {
 		if (unlikely(__this_cpu_read(softlockup_touch_sync))) {
 			/*
@@ -351,6 +355,13 @@ static void watchdog_enable(unsigned int cpu)
 	hrtimer_init(hrtimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
 	hrtimer->function = watchdog_timer_fn;
 
+	/*
+	 * The sample timer would interrupt full dynticks CPUs every few
+	 * seconds, leave lockup detection to the housekeeping CPUs.
+	 */
+	if (!is_housekeeping_cpu(cpu))
+		return;
+
 	/* Enable the perf event */
 	watchdog_nmi_enable(cpu);
 
@@ -48,6 +48,7 @@
 #include <linux/nodemask.h>
 #include <linux/moduleparam.h>
 #include <linux/uaccess.h>
+#include <linux/tick.h>
 
 #include "workqueue_internal.h"
 
@@ -148,6 +149,9 @@ struct worker_pool {
 	unsigned int		flags;		/* X: flags */
 
 	struct list_head	worklist;	/* L: list of pending works */
+	struct list_head	batch_worklist;	/* L: pending WQ_BATCH works */
+	int			nr_batch_running; /* L: executing WQ_BATCH works */
+	int			max_batch_running; /* I: limit of the above */
 	int			nr_workers;	/* L: total number of workers */
 
 	/* nr_idle includes the ones off idle_list for rebinding */
@@ -731,6 +735,29 @@ static bool __need_more_worker(struct worker_pool *pool)
 	return !atomic_read(&pool->nr_running);
 }
 
+/*
+ * Return the work item a worker should start next, or NULL if there's
+ * nothing which can be started.  Regular works always go before
+ * WQ_BATCH ones, which are further limited by ->max_batch_running.
+ */
+static struct work_struct *first_pending_work(struct worker_pool *pool)
+{
+	if (!list_empty(&pool->worklist))
+		return list_first_entry(&pool->worklist,
+					struct work_struct, entry);
+	if (!list_empty(&pool->batch_worklist) &&
+	    pool->nr_batch_running < pool->max_batch_running)
+		return list_first_entry(&pool->batch_worklist,
+					struct work_struct, entry);
+	return NULL;
+}
+
+/* any work which can be started pending? */
+static bool pool_has_work(struct worker_pool *pool)
+{
+	return first_pending_work(pool) != NULL;
+}
+
 /*
  * Need to wake up a worker?  Called from anything but currently
  * running workers.
@@ -741,7 +768,7 @@ static bool __need_more_worker(struct worker_pool *pool)
  */
 static bool need_more_worker(struct worker_pool *pool)
 {
-	return !list_empty(&pool->worklist) && __need_more_worker(pool);
+	return pool_has_work(pool) && __need_more_worker(pool);
 }
 
 /* Can I start working?  Called from busy but !running workers. */
@@ -753,8 +780,7 @@ static bool may_start_working(struct worker_pool *pool)
 /* Do I need to keep working?  Called from currently running workers. */
 static bool keep_working(struct worker_pool *pool)
 {
-	return !list_empty(&pool->worklist) &&
-		atomic_read(&pool->nr_running) <= 1;
+	return pool_has_work(pool) && atomic_read(&pool->nr_running) <= 1;
 }
 
 /* Do we need a new worker?  Called from manager. */
@@ -883,8 +909,7 @@ struct task_struct *wq_worker_sleeping(struct task_struct *task, int cpu)
 	 * manipulating idle_list, so dereferencing idle_list without pool
 	 * lock is safe.
 	 */
-	if (atomic_dec_and_test(&pool->nr_running) &&
-	    !list_empty(&pool->worklist))
+	if (atomic_dec_and_test(&pool->nr_running) && pool_has_work(pool))
 		to_wakeup = first_worker(pool);
 	return to_wakeup ? to_wakeup->task : NULL;
 }
@@ -918,7 +943,7 @@ static inline void worker_set_flags(struct worker *worker, unsigned int flags,
 	    !(worker->flags & WORKER_NOT_RUNNING)) {
 		if (wakeup) {
 			if (atomic_dec_and_test(&pool->nr_running) &&
-			    !list_empty(&pool->worklist))
+			    pool_has_work(pool))
 				wake_up_worker(pool);
 		} else
 			atomic_dec(&pool->nr_running);
@@ -1102,12 +1127,20 @@ static void put_pwq_unlocked(struct pool_workqueue *pwq)
 	}
 }
 
+/* the pool worklist active work items of @pwq are queued on */
+static struct list_head *pwq_worklist(struct pool_workqueue *pwq)
+{
+	if (pwq->wq->flags & WQ_BATCH)
+		return &pwq->pool->batch_worklist;
+	return &pwq->pool->worklist;
+}
+
 static void pwq_activate_delayed_work(struct work_struct *work)
 {
 	struct pool_workqueue *pwq = get_work_pwq(work);
 
 	trace_workqueue_activate_work(work);
-	move_linked_works(work, &pwq->pool->worklist, NULL);
+	move_linked_works(work, pwq_worklist(pwq), NULL);
 	__clear_bit(WORK_STRUCT_DELAYED_BIT, work_data_bits(work));
 	pwq->nr_active++;
 }
@@ -1281,18 +1314,20 @@ fail:
  * CONTEXT:
  * spin_lock_irq(pool->lock).
  */
-static void insert_work(struct pool_workqueue *pwq, struct work_struct *work,
-			struct list_head *head, unsigned int extra_flags)
+static void __insert_work(struct pool_workqueue *pwq, struct work_struct *work,
+			  struct list_head *head, unsigned int extra_flags)
 {
-	struct worker_pool *pool = pwq->pool;
-
 	/* we own @work, set data and link */
 	set_work_pwq(work, pwq, extra_flags);
 	list_add_tail(&work->entry, head);
 	get_pwq(pwq);
+}
 
+/* wake up a worker for works just added with __insert_work() if needed */
+static void kick_pool(struct worker_pool *pool)
+{
 	/*
-	 * Ensure either wq_worker_sleeping() sees the above
+	 * Ensure either wq_worker_sleeping() sees the preceding
 	 * list_add_tail() or we see zero nr_running to avoid workers lying
 	 * around lazily while there are works to be processed.
 	 */
@@ -1302,6 +1337,13 @@ static void insert_work(struct pool_workqueue *pwq, struct work_struct *work,
 		wake_up_worker(pool);
 }
 
+static void insert_work(struct pool_workqueue *pwq, struct work_struct *work,
+			struct list_head *head, unsigned int extra_flags)
+{
+	__insert_work(pwq, work, head, extra_flags);
+	kick_pool(pwq->pool);
+}
+
 /*
  * Test whether @work is being queued from another work executing on the
  * same workqueue.
@@ -1318,38 +1360,35 @@ static bool is_chained_work(struct workqueue_struct *wq)
 	return worker && worker->current_pwq->wq == wq;
 }
 
-static void __queue_work(int cpu, struct workqueue_struct *wq,
-			 struct work_struct *work)
+/* pwq a request for @req_cpu on @wq uses unless the work is running */
+static struct pool_workqueue *dfl_work_pwq(int req_cpu,
+					   struct workqueue_struct *wq)
 {
-	struct pool_workqueue *pwq;
-	struct worker_pool *last_pool;
-	struct list_head *worklist;
-	unsigned int work_flags;
-	unsigned int req_cpu = cpu;
+	int cpu = req_cpu;
 
-	/*
-	 * While a work item is PENDING && off queue, a task trying to
-	 * steal the PENDING will busy-loop waiting for it to either get
-	 * queued or lose PENDING.  Grabbing PENDING and queueing should
-	 * happen with IRQ disabled.
-	 */
-	WARN_ON_ONCE(!irqs_disabled());
-
-	debug_work_activate(work);
-
-	/* if draining, only works from the same workqueue are allowed */
-	if (unlikely(wq->flags & __WQ_DRAINING) &&
-	    WARN_ON_ONCE(!is_chained_work(wq)))
-		return;
-retry:
 	if (req_cpu == WORK_CPU_UNBOUND)
 		cpu = raw_smp_processor_id();
 
-	/* pwq which will be used unless @work is executing elsewhere */
 	if (!(wq->flags & WQ_UNBOUND))
-		pwq = per_cpu_ptr(wq->cpu_pwqs, cpu);
+		return per_cpu_ptr(wq->cpu_pwqs, cpu);
 	else
-		pwq = unbound_pwq_by_node(wq, cpu_to_node(cpu));
+		return unbound_pwq_by_node(wq, cpu_to_node(cpu));
+}
+
+/*
+ * Determine the pwq @work should be queued on and lock its pool.  Returns
+ * the pwq with pool->lock held.
+ */
+static struct pool_workqueue *lock_work_pwq(int req_cpu,
+					    struct workqueue_struct *wq,
+					    struct work_struct *work)
+{
+	struct pool_workqueue *pwq;
+	struct worker_pool *last_pool;
+
+retry:
+	/* pwq which will be used unless @work is executing elsewhere */
+	pwq = dfl_work_pwq(req_cpu, wq);
 
 	/*
 	 * If @work was previously on a different pool, it might still be
@@ -1391,16 +1430,30 @@ retry:
 		}
 		/* oops */
 		WARN_ONCE(true, "workqueue: per-cpu pwq for %s on cpu%d has 0 refcnt",
-			  wq->name, cpu);
+			  wq->name, pwq->pool->cpu);
 	}
 
+	return pwq;
+}
+
+/*
+ * Queue @work on @pwq without waking up a worker.  Caller must follow up
+ * with kick_pool().
+ *
+ * CONTEXT:
+ * spin_lock(pwq->pool->lock).
+ */
+static void __queue_work_locked(int req_cpu, struct pool_workqueue *pwq,
+				struct work_struct *work)
+{
+	struct list_head *worklist;
+	unsigned int work_flags;
+
 	/* pwq determined, queue */
 	trace_workqueue_queue_work(req_cpu, pwq, work);
 
-	if (WARN_ON(!list_empty(&work->entry))) {
-		spin_unlock(&pwq->pool->lock);
+	if (WARN_ON(!list_empty(&work->entry)))
 		return;
-	}
 
 	pwq->nr_in_flight[pwq->work_color]++;
 	work_flags = work_color_to_flags(pwq->work_color);
@@ -1408,14 +1461,60 @@ retry:
 	if (likely(pwq->nr_active < pwq->max_active)) {
 		trace_workqueue_activate_work(work);
 		pwq->nr_active++;
-		worklist = &pwq->pool->worklist;
+		worklist = pwq_worklist(pwq);
 	} else {
 		work_flags |= WORK_STRUCT_DELAYED;
 		worklist = &pwq->delayed_works;
 	}
 
-	insert_work(pwq, work, worklist, work_flags);
+	__insert_work(pwq, work, worklist, work_flags);
+}
+
+/*
+ * Would lock_work_pwq() pick the already locked @pwq for @work?  A work
+ * last run on a different pool needs the full selection for
+ * non-reentrancy.
+ */
+static bool work_fits_pwq(int req_cpu, struct workqueue_struct *wq,
+			  struct pool_workqueue *pwq, struct work_struct *work)
+{
+	struct worker_pool *last_pool = get_work_pool(work);
+
+	return pwq == dfl_work_pwq(req_cpu, wq) &&
+		(!last_pool || last_pool == pwq->pool);
+}
+
+static bool __queue_work_prep(struct workqueue_struct *wq,
+			      struct work_struct *work)
+{
+	/*
+	 * While a work item is PENDING && off queue, a task trying to
+	 * steal the PENDING will busy-loop waiting for it to either get
+	 * queued or lose PENDING.  Grabbing PENDING and queueing should
+	 * happen with IRQ disabled.
+	 */
+	WARN_ON_ONCE(!irqs_disabled());
+
+	debug_work_activate(work);
+
+	/* if draining, only works from the same workqueue are allowed */
+	if (unlikely(wq->flags & __WQ_DRAINING) &&
+	    WARN_ON_ONCE(!is_chained_work(wq)))
+		return false;
+	return true;
+}
+
+static void __queue_work(int cpu, struct workqueue_struct *wq,
+			 struct work_struct *work)
+{
+	struct pool_workqueue *pwq;
+
+	if (!__queue_work_prep(wq, work))
+		return;
 
+	pwq = lock_work_pwq(cpu, wq, work);
+	__queue_work_locked(cpu, pwq, work);
+	kick_pool(pwq->pool);
 	spin_unlock(&pwq->pool->lock);
 }
 
@@ -1448,6 +1547,62 @@ bool queue_work_on(int cpu, struct workqueue_struct *wq,
 }
 EXPORT_SYMBOL(queue_work_on);
 
+/**
+ * queue_work_batch_on - queue a batch of works on specific cpu
+ * @cpu: CPU number to execute the works on
+ * @wq: workqueue to use
+ * @works: array of works to queue
+ * @nr_works: number of entries in @works
+ *
+ * Equivalent to calling queue_work_on() for each entry of @works in
+ * order, but consecutive works which end up on the same pool are queued
+ * in one pool->lock round and with a single worker wakeup.  Entries which
+ * are already pending are skipped.
+ *
+ * Return: the number of works which got queued.
+ */
+int queue_work_batch_on(int cpu, struct workqueue_struct *wq,
+			struct work_struct **works, int nr_works)
+{
+	struct pool_workqueue *pwq = NULL;
+	unsigned long flags;
+	int i, queued = 0;
+
+	local_irq_save(flags);
+
+	for (i = 0; i < nr_works; i++) {
+		struct work_struct *work = works[i];
+
+		if (test_and_set_bit(WORK_STRUCT_PENDING_BIT,
+				     work_data_bits(work)))
+			continue;
+
+		/* pwq below stays locked and so can't be released */
+		if (pwq && !work_fits_pwq(cpu, wq, pwq, work)) {
+			kick_pool(pwq->pool);
+			spin_unlock(&pwq->pool->lock);
+			pwq = NULL;
+		}
+
+		if (!__queue_work_prep(wq, work))
+			continue;
+
+		if (!pwq)
+			pwq = lock_work_pwq(cpu, wq, work);
+		__queue_work_locked(cpu, pwq, work);
+		queued++;
+	}
+
+	if (pwq) {
+		kick_pool(pwq->pool);
+		spin_unlock(&pwq->pool->lock);
+	}
+
+	local_irq_restore(flags);
+	return queued;
+}
+EXPORT_SYMBOL_GPL(queue_work_batch_on);
+
 void delayed_work_timer_fn(unsigned long __data)
 {
 	struct delayed_work *dwork = (struct delayed_work *)__data;
@@ -1944,6 +2099,8 @@ static void pool_mayday_timeout(unsigned long __pool)
 		 */
 		list_for_each_entry(work, &pool->worklist, entry)
 			send_mayday(work);
+		list_for_each_entry(work, &pool->batch_worklist, entry)
+			send_mayday(work);
 	}
 
 	spin_unlock(&pool->lock);
@@ -2152,6 +2309,7 @@ __acquires(&pool->lock)
 	struct pool_workqueue *pwq = get_work_pwq(work);
 	struct worker_pool *pool = worker->pool;
 	bool cpu_intensive = pwq->wq->flags & WQ_CPU_INTENSIVE;
+	bool batch = pwq->wq->flags & WQ_BATCH;
 	int work_color;
 	struct worker *collision;
 #ifdef CONFIG_LOCKDEP
@@ -2197,6 +2355,9 @@ __acquires(&pool->lock)
 
 	list_del_init(&work->entry);
 
+	if (unlikely(batch))
+		pool->nr_batch_running++;
+
 	/*
 	 * CPU intensive works don't participate in concurrency
 	 * management.  They're the scheduler's responsibility.
@@ -2257,6 +2418,9 @@ __acquires(&pool->lock)
 	if (unlikely(cpu_intensive))
 		worker_clr_flags(worker, WORKER_CPU_INTENSIVE);
 
+	if (unlikely(batch))
+		pool->nr_batch_running--;
+
 	/* we're done with it, release */
 	hash_del(&worker->hentry);
 	worker->current_work = NULL;
@@ -2344,9 +2508,7 @@ recheck:
 	worker_clr_flags(worker, WORKER_PREP | WORKER_REBOUND);
 
 	do {
-		struct work_struct *work =
-			list_first_entry(&pool->worklist,
-					 struct work_struct, entry);
+		struct work_struct *work = first_pending_work(pool);
 
 		if (likely(!(*work_data_bits(work) & WORK_STRUCT_LINKED))) {
 			/* optimization path, not strictly necessary */
@@ -2449,7 +2611,7 @@ repeat:
 		 * process'em.
 		 */
 		WARN_ON_ONCE(!list_empty(&rescuer->scheduled));
-		list_for_each_entry_safe(work, n, &pool->worklist, entry)
+		list_for_each_entry_safe(work, n, pwq_worklist(pwq), entry)
 			if (get_work_pwq(work) == pwq)
 				move_linked_works(work, scheduled, &n);
 
@@ -3539,6 +3701,9 @@ static int init_worker_pool(struct worker_pool *pool)
 	pool->node = NUMA_NO_NODE;
 	pool->flags |= POOL_DISASSOCIATED;
 	INIT_LIST_HEAD(&pool->worklist);
+	INIT_LIST_HEAD(&pool->batch_worklist);
+	/* per-cpu pools limit batch works through concurrency management */
+	pool->max_batch_running = INT_MAX;
 	INIT_LIST_HEAD(&pool->idle_list);
 	hash_init(pool->busy_hash);
 
@@ -3594,7 +3759,8 @@ static void put_unbound_pool(struct worker_pool *pool)
 
 	/* sanity checks */
 	if (WARN_ON(!(pool->flags & POOL_DISASSOCIATED)) ||
-	    WARN_ON(!list_empty(&pool->worklist)))
+	    WARN_ON(!list_empty(&pool->worklist)) ||
+	    WARN_ON(!list_empty(&pool->batch_worklist)))
 		return;
 
 	/* release id and unhash */
@@ -3674,6 +3840,10 @@ static struct worker_pool *get_unbound_pool(const struct workqueue_attrs *attrs)
 	 */
 	pool->attrs->no_numa = false;
 
+	/* unbound workers aren't concurrency managed, cap batch works */
+	pool->max_batch_running = max_t(int, 1,
+				cpumask_weight(pool->attrs->cpumask));
+
 	/* if cpumask is contained inside a NUMA node, we belong to that node */
 	if (wq_numa_enabled) {
 		for_each_node(node) {
@@ -5099,6 +5269,8 @@ static int __init init_workqueues(void)
 
 		BUG_ON(!(attrs = alloc_workqueue_attrs(GFP_KERNEL)));
 		attrs->nice = std_nice[i];
+		/* keep unbound works off full dynticks CPUs by default */
+		cpumask_copy(attrs->cpumask, housekeeping_cpumask());
 		unbound_std_wq_attrs[i] = attrs;
 
 		/*
@@ -5109,6 +5281,7 @@ static int __init init_workqueues(void)
 		BUG_ON(!(attrs = alloc_workqueue_attrs(GFP_KERNEL)));
 		attrs->nice = std_nice[i];
 		attrs->no_numa = true;
+		cpumask_copy(attrs->cpumask, housekeeping_cpumask());
 		ordered_wq_attrs[i] = attrs;
 	}
 
@@ -1139,6 +1139,134 @@ void ida_simple_remove(struct ida *ida, unsigned int id)
 }
 EXPORT_SYMBOL(ida_simple_remove);
 
+/*
+ * Every cpu keeps up to IDA_CACHE_SIZE free IDs reserved in the ida, and
+ * moves IDA_CACHE_BATCH of them at a time from or to the ida when it runs
+ * out or overflows, so the lock of the ida is only taken once for that
+ * many allocations or frees on a cpu.
+ */
+#define IDA_CACHE_SIZE		32
+#define IDA_CACHE_BATCH		16
+
+struct ida_cache_cpu {
+	unsigned int		nr;
+	int			ids[IDA_CACHE_SIZE];
+};
+
+/**
+ * ida_cache_init - initialize an ida_cache
+ * @ic: the ida_cache to initialize
+ *
+ * Returns 0 on success or -ENOMEM.
+ */
+int ida_cache_init(struct ida_cache *ic)
+{
+	ida_init(&ic->ida);
+	spin_lock_init(&ic->lock);
+	ic->cpu = alloc_percpu(struct ida_cache_cpu);
+	return ic->cpu ? 0 : -ENOMEM;
+}
+EXPORT_SYMBOL(ida_cache_init);
+
+/**
+ * ida_cache_destroy - release all cached resources within an ida_cache
+ * @ic: the ida_cache, with no ID left allocated from it
+ */
+void ida_cache_destroy(struct ida_cache *ic)
+{
+	free_percpu(ic->cpu);
+	ida_destroy(&ic->ida);
+}
+EXPORT_SYMBOL(ida_cache_destroy);
+
+/*
+ * Reserve up to IDA_CACHE_BATCH IDs in the cache @cc of this cpu. Called
+ * with interrupts disabled and @ic->lock held.
+ */
+static int ida_cache_refill(struct ida_cache *ic, struct ida_cache_cpu *cc)
+{
+	int ret = 0, id;
+
+	while (cc->nr < IDA_CACHE_BATCH) {
+		ret = ida_get_new(&ic->ida, &id);
+		if (ret)
+			break;
+		cc->ids[cc->nr++] = id;
+	}
+	return cc->nr ? 0 : ret;
+}
+
+/**
+ * ida_cache_get - get a new id
+ * @ic: the (initialized) ida_cache
+ * @gfp_mask: memory allocation flags
+ *
+ * Allocates an id from the cache of the local cpu. Unlike ida_simple_get(),
+ * which serializes all allocations on one lock, this only locks @ic when
+ * the cache is refilled. The IDs are not allocated lowest first.
+ *
+ * Returns the id, -ENOMEM or -ENOSPC once all IDs up to INT_MAX are used.
+ * May be called from any context, provided @gfp_mask allows it.
+ */
+int ida_cache_get(struct ida_cache *ic, gfp_t gfp_mask)
+{
+	struct ida_cache_cpu *cc;
+	unsigned long flags;
+	int ret;
+
+again:
+	local_irq_save(flags);
+	cc = this_cpu_ptr(ic->cpu);
+	if (likely(cc->nr)) {
+		ret = cc->ids[--cc->nr];
+		local_irq_restore(flags);
+		return ret;
+	}
+
+	spin_lock(&ic->lock);
+	ret = ida_cache_refill(ic, cc);
+	if (!ret)
+		ret = cc->ids[--cc->nr];
+	spin_unlock(&ic->lock);
+	local_irq_restore(flags);
+
+	if (unlikely(ret == -EAGAIN)) {
+		if (!ida_pre_get(&ic->ida, gfp_mask))
+			return -ENOMEM;
+		goto again;
+	}
+	return ret;
+}
+EXPORT_SYMBOL(ida_cache_get);
+
+/**
+ * ida_cache_put - free an id
+ * @ic: the ida_cache
+ * @id: the id returned by ida_cache_get()
+ *
+ * Keeps @id in the cache of the local cpu, returning part of the cache to
+ * the ida if it is full.
+ */
+void ida_cache_put(struct ida_cache *ic, int id)
+{
+	struct ida_cache_cpu *cc;
+	unsigned long flags;
+
+	BUG_ON(id < 0);
+
+	local_irq_save(flags);
+	cc = this_cpu_ptr(ic->cpu);
+	if (unlikely(cc->nr == IDA_CACHE_SIZE)) {
+		spin_lock(&ic->lock);
+		while (cc->nr > IDA_CACHE_SIZE - IDA_CACHE_BATCH)
+			ida_remove(&ic->ida, cc->ids[--cc->nr]);
+		spin_unlock(&ic->lock);
+	}
+	cc->ids[cc->nr++] = id;
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(ida_cache_put);
+
 /**
  * ida_init - initialize ida handle
  * @ida:	ida handle
@@ -36,9 +36,18 @@
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/static_key.h>
+#include <asm/crc32c.h>
 
 static struct crypto_shash *tfm;
 
+/*
+ * Set when the architecture can compute crc32c directly, which avoids
+ * the indirect calls and descriptor setup of the crypto API for every
+ * (typically small) buffer.
+ */
+static struct static_key crc32c_direct __read_mostly = STATIC_KEY_INIT_FALSE;
+
 u32 crc32c(u32 crc, const void *address, unsigned int length)
 {
 	struct {
@@ -47,6 +56,9 @@ u32 crc32c(u32 crc, const void *address, unsigned int length)
 	} desc;
 	int err;
 
+	if (static_key_false(&crc32c_direct))
+		return arch_crc32c(crc, address, length);
+
 	desc.shash.tfm = tfm;
 	desc.shash.flags = 0;
 	*(u32 *)desc.ctx = crc;
@@ -61,6 +73,11 @@ EXPORT_SYMBOL(crc32c);
 
 static int __init libcrc32c_mod_init(void)
 {
+	if (arch_crc32c_usable()) {
+		static_key_slow_inc(&crc32c_direct);
+		return 0;
+	}
+
 	tfm = crypto_alloc_shash("crc32c", 0, 0);
 	if (IS_ERR(tfm))
 		return PTR_ERR(tfm);
@@ -70,7 +87,8 @@ static int __init libcrc32c_mod_init(void)
 
 static void __exit libcrc32c_mod_fini(void)
 {
-	crypto_free_shash(tfm);
+	if (tfm)
+		crypto_free_shash(tfm);
 }
 
 module_init(libcrc32c_mod_init);
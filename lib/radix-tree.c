@@ -32,6 +32,7 @@
 #include <linux/string.h>
 #include <linux/bitops.h>
 #include <linux/rcupdate.h>
+#include <linux/prefetch.h>
 #include <linux/hardirq.h>		/* in_interrupt() */
 
 
@@ -742,8 +743,8 @@ void **radix_tree_next_chunk(struct radix_tree_root *root,
 			     struct radix_tree_iter *iter, unsigned flags)
 {
 	unsigned shift, tag = flags & RADIX_TREE_ITER_TAG_MASK;
-	struct radix_tree_node *rnode, *node;
-	unsigned long index, offset, height;
+	struct radix_tree_node *rnode, *node, *parent, *next;
+	unsigned long index, offset, poffset = 0, height;
 
 	if ((flags & RADIX_TREE_ITER_TAGGED) && !root_tag_get(root, tag))
 		return NULL;
@@ -783,6 +784,7 @@ restart:
 		return NULL;
 
 	node = rnode;
+	parent = NULL;
 	while (1) {
 		if ((flags & RADIX_TREE_ITER_TAGGED) ?
 				!test_bit(offset, node->tags[tag]) :
@@ -814,6 +816,8 @@ restart:
 		if (!shift)
 			break;
 
+		parent = node;
+		poffset = offset;
 		node = rcu_dereference_raw(node->slots[offset]);
 		if (node == NULL)
 			goto restart;
@@ -821,6 +825,22 @@ restart:
 		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
 	}
 
+	/*
+	 * The iteration most likely continues in the next leaf, start
+	 * fetching the part of it the next call looks at first while the
+	 * caller works through this chunk.
+	 */
+	if (parent && poffset < RADIX_TREE_MAP_MASK &&
+	    !(flags & RADIX_TREE_ITER_CONTIG)) {
+		next = rcu_dereference_raw(parent->slots[poffset + 1]);
+		if (flags & RADIX_TREE_ITER_TAGGED) {
+			if (next && test_bit(poffset + 1, parent->tags[tag]))
+				prefetch(next->tags[tag]);
+		} else if (next) {
+			prefetch(next->slots);
+		}
+	}
+
 	/* Update the iterator state */
 	iter->index = index;
 	iter->next_index = (index | RADIX_TREE_MAP_MASK) + 1;
@@ -1476,7 +1496,7 @@ void __init radix_tree_init(void)
 {
 	radix_tree_node_cachep = kmem_cache_create("radix_tree_node",
 			sizeof(struct radix_tree_node), 0,
-			SLAB_PANIC | SLAB_RECLAIM_ACCOUNT,
+			SLAB_PANIC | SLAB_RECLAIM_ACCOUNT | SLAB_HWCACHE_ALIGN,
 			radix_tree_node_ctor);
 	radix_tree_init_maxindex();
 	hotcpu_notifier(radix_tree_callback, 0);
@@ -49,6 +49,10 @@ const struct raid6_calls * const raid6_algos[] = {
 	&raid6_avx2x1,
 	&raid6_avx2x2,
 #endif
+#ifdef CONFIG_AS_AVX512
+	&raid6_avx512x1,
+	&raid6_avx512x2,
+#endif
 #endif
 #if defined(__x86_64__) && !defined(__arch_um__)
 	&raid6_sse2x1,
@@ -59,6 +63,11 @@ const struct raid6_calls * const raid6_algos[] = {
 	&raid6_avx2x2,
 	&raid6_avx2x4,
 #endif
+#ifdef CONFIG_AS_AVX512
+	&raid6_avx512x1,
+	&raid6_avx512x2,
+	&raid6_avx512x4,
+#endif
 #endif
 #ifdef CONFIG_ALTIVEC
 	&raid6_altivec1,
@@ -107,15 +116,52 @@ const struct raid6_recov_calls *const raid6_recov_algos[] = {
 #define time_before(x, y) ((x) < (y))
 #endif
 
-static inline const struct raid6_recov_calls *raid6_choose_recov(void)
+/*
+ * Time the recovery routines the same way as gen_syndrome: each pass
+ * rebuilds two data blocks and then one data block plus Q, writing the
+ * rebuilt blocks into the scratch pages.  The priority only breaks ties.
+ */
+static inline const struct raid6_recov_calls *raid6_choose_recov(
+	void *(*const dptrs)[(65536/PAGE_SIZE)+2], const int disks,
+	char *scratch)
 {
+	unsigned long perf, bestperf, j0, j1;
 	const struct raid6_recov_calls *const *algo;
 	const struct raid6_recov_calls *best;
+	void *ptrs[(65536/PAGE_SIZE)+2];
+	int i;
 
-	for (best = NULL, algo = raid6_recov_algos; *algo; algo++)
-		if (!best || (*algo)->priority > best->priority)
-			if (!(*algo)->valid || (*algo)->valid())
-				best = *algo;
+	for (i = 0; i < disks; i++)
+		ptrs[i] = (*dptrs)[i];
+	ptrs[0] = scratch;
+	ptrs[1] = scratch + PAGE_SIZE;
+
+	for (bestperf = 0, best = NULL, algo = raid6_recov_algos; *algo; algo++) {
+		if ((*algo)->valid && !(*algo)->valid())
+			continue;
+
+		perf = 0;
+
+		preempt_disable();
+		j0 = jiffies;
+		while ((j1 = jiffies) == j0)
+			cpu_relax();
+		while (time_before(jiffies,
+				    j1 + (1<<RAID6_TIME_JIFFIES_LG2))) {
+			(*algo)->data2(disks, PAGE_SIZE, 0, 1, ptrs);
+			(*algo)->datap(disks, PAGE_SIZE, 0, ptrs);
+			perf++;
+		}
+		preempt_enable();
+
+		if (perf > bestperf ||
+		    (perf == bestperf && (*algo)->priority > best->priority)) {
+			bestperf = perf;
+			best = *algo;
+		}
+		printk("raid6: %-8s recov %5ld MB/s\n", (*algo)->name,
+		       (perf*HZ) >> (20-16+RAID6_TIME_JIFFIES_LG2-1));
+	}
 
 	if (best) {
 		raid6_2data_recov = best->data2;
@@ -183,7 +229,7 @@ int __init raid6_select_algo(void)
 
 	const struct raid6_calls *gen_best;
 	const struct raid6_recov_calls *rec_best;
-	char *syndromes;
+	char *syndromes, *scratch;
 	void *dptrs[(65536/PAGE_SIZE)+2];
 	int i;
 
@@ -205,8 +251,15 @@ int __init raid6_select_algo(void)
 	gen_best = raid6_choose_gen(&dptrs, disks);
 
 	/* select raid recover functions */
-	rec_best = raid6_choose_recov();
+	scratch = (void *) __get_free_pages(GFP_KERNEL, 1);
+	if (!scratch) {
+		printk("raid6: Yikes!  No memory available.\n");
+		free_pages((unsigned long)syndromes, 1);
+		return -ENOMEM;
+	}
+	rec_best = raid6_choose_recov(&dptrs, disks, scratch);
 
+	free_pages((unsigned long)scratch, 1);
 	free_pages((unsigned long)syndromes, 1);
 
 	return gen_best && rec_best ? 0 : -EINVAL;
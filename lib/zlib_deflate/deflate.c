@@ -250,7 +250,6 @@ int zlib_deflateInit2(
 }
 
 /* ========================================================================= */
-#if 0
 int zlib_deflateSetDictionary(
 	z_streamp strm,
 	const Byte *dictionary,
@@ -266,9 +265,12 @@ int zlib_deflateSetDictionary(
 	return Z_STREAM_ERROR;
 
     s = (deflate_state *) strm->state;
-    if (s->status != INIT_STATE) return Z_STREAM_ERROR;
+    /* Raw streams start out in BUSY_STATE, allow them before any input */
+    if (s->noheader ? strm->total_in != 0 : s->status != INIT_STATE)
+	return Z_STREAM_ERROR;
 
-    strm->adler = zlib_adler32(strm->adler, dictionary, dictLength);
+    if (!s->noheader)
+	strm->adler = zlib_adler32(strm->adler, dictionary, dictLength);
 
     if (length < MIN_MATCH) return Z_OK;
     if (length > MAX_DIST(s)) {
@@ -293,7 +295,6 @@ int zlib_deflateSetDictionary(
     if (hash_head) hash_head = 0;  /* to make compiler happy */
     return Z_OK;
 }
-#endif  /*  0  */
 
 /* ========================================================================= */
 int zlib_deflateReset(
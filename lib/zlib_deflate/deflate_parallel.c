@@ -0,0 +1,243 @@
+/*
+ * linux/lib/zlib_deflate/deflate_parallel.c
+ *
+ * Deflate a large buffer with several CPUs.
+ *
+ * The input is cut into blocks that are compressed concurrently, each
+ * as a raw deflate stream that has the input preceding it preset as its
+ * dictionary, so that matches reaching back into the previous block are
+ * still found. All but the last block end with a sync flush, whose empty
+ * stored block byte-aligns them without marking them final, so their
+ * concatenation is one deflate stream. The zlib header and the adler32
+ * of the whole input are added around it.
+ */
+
+#include <linux/atomic.h>
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/zutil.h>
+
+#define PDEFLATE_BLOCK	(128 * 1024)
+
+struct pdeflate_block {
+	Byte *out;
+	uLong out_len;
+	int err;
+};
+
+struct pdeflate_job {
+	const Byte *in;
+	uLong in_len;
+	int level;
+	int windowBits;
+	int memLevel;
+	unsigned int nr_blocks;
+	atomic_t next;		/* next block to compress */
+	atomic_t workers;	/* workers still running */
+	struct completion done;
+	struct pdeflate_block blocks[];
+};
+
+struct pdeflate_worker {
+	struct work_struct work;
+	struct pdeflate_job *job;
+	void *workspace;
+};
+
+/* Worst case size of a block of len bytes, including the sync flush */
+static uLong pdeflate_bound(uLong len)
+{
+	return len + (len >> 3) + (len >> 6) + 16;
+}
+
+static int pdeflate_block(struct pdeflate_job *job, void *workspace,
+			  unsigned int i)
+{
+	struct pdeflate_block *block = &job->blocks[i];
+	uLong start = (uLong)i * PDEFLATE_BLOCK;
+	uInt len = min_t(uLong, PDEFLATE_BLOCK, job->in_len - start);
+	uLong bound = pdeflate_bound(len);
+	int last = i == job->nr_blocks - 1;
+	z_stream strm;
+	int ret;
+
+	block->out = vmalloc(bound);
+	if (!block->out)
+		return Z_MEM_ERROR;
+
+	strm.workspace = workspace;
+	ret = zlib_deflateInit2(&strm, job->level, Z_DEFLATED,
+				-job->windowBits, job->memLevel,
+				Z_DEFAULT_STRATEGY);
+	if (ret != Z_OK)
+		return ret;
+
+	if (start) {
+		uInt dict = min_t(uLong, start, 1UL << job->windowBits);
+
+		ret = zlib_deflateSetDictionary(&strm, job->in + start - dict,
+						dict);
+		if (ret != Z_OK)
+			goto out;
+	}
+
+	strm.next_in = job->in + start;
+	strm.avail_in = len;
+	strm.next_out = block->out;
+	strm.avail_out = bound;
+
+	ret = zlib_deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+	if (last ? ret == Z_STREAM_END :
+		   ret == Z_OK && !strm.avail_in && strm.avail_out) {
+		block->out_len = strm.total_out;
+		ret = Z_OK;
+	} else if (ret == Z_OK) {
+		ret = Z_BUF_ERROR;
+	}
+out:
+	zlib_deflateEnd(&strm);
+	return ret;
+}
+
+static void pdeflate_work(struct work_struct *work)
+{
+	struct pdeflate_worker *worker =
+		container_of(work, struct pdeflate_worker, work);
+	struct pdeflate_job *job = worker->job;
+	unsigned int i;
+
+	while ((i = atomic_inc_return(&job->next) - 1) < job->nr_blocks)
+		job->blocks[i].err = pdeflate_block(job, worker->workspace, i);
+
+	if (atomic_dec_and_test(&job->workers))
+		complete(&job->done);
+}
+
+static void putShortMSB(Byte *p, uInt b)
+{
+	p[0] = (Byte)(b >> 8);
+	p[1] = (Byte)(b & 0xff);
+}
+
+int zlib_deflate_parallel(Byte *out, uLong *out_len, const Byte *in,
+			  uLong in_len, int level, int windowBits,
+			  int memLevel)
+{
+	int noheader = windowBits < 0;
+	struct pdeflate_worker *workers;
+	struct pdeflate_job *job;
+	unsigned int nr_blocks, nr_workers, i;
+	uLong pos = 0;
+	int ret = Z_MEM_ERROR;
+
+	if (level == Z_DEFAULT_COMPRESSION)
+		level = 6;
+	if (noheader)
+		windowBits = -windowBits;
+	if (memLevel < 1 || memLevel > MAX_MEM_LEVEL ||
+	    windowBits < 9 || windowBits > 15 || level < 0 || level > 9)
+		return Z_STREAM_ERROR;
+
+	nr_blocks = max_t(uLong, DIV_ROUND_UP(in_len, PDEFLATE_BLOCK), 1);
+	nr_workers = min(nr_blocks, num_online_cpus());
+
+	job = vzalloc(sizeof(*job) + nr_blocks * sizeof(job->blocks[0]));
+	if (!job)
+		return Z_MEM_ERROR;
+	workers = kcalloc(nr_workers, sizeof(*workers), GFP_KERNEL);
+	if (!workers)
+		goto out_job;
+
+	/* Make do with fewer workers if their workspaces are hard to get */
+	for (i = 0; i < nr_workers; i++) {
+		workers[i].workspace =
+			vmalloc(zlib_deflate_workspacesize(windowBits,
+							   memLevel));
+		if (!workers[i].workspace)
+			break;
+		workers[i].job = job;
+		INIT_WORK(&workers[i].work, pdeflate_work);
+	}
+	nr_workers = i;
+	if (!nr_workers)
+		goto out_workers;
+
+	job->in = in;
+	job->in_len = in_len;
+	job->level = level;
+	job->windowBits = windowBits;
+	job->memLevel = memLevel;
+	job->nr_blocks = nr_blocks;
+	atomic_set(&job->next, 0);
+	atomic_set(&job->workers, nr_workers);
+	init_completion(&job->done);
+
+	for (i = 1; i < nr_workers; i++)
+		queue_work(system_unbound_wq, &workers[i].work);
+	pdeflate_work(&workers[0].work);
+	wait_for_completion(&job->done);
+
+	if (!noheader) {
+		uInt header = (Z_DEFLATED + ((windowBits - 8) << 4)) << 8;
+		uInt level_flags = (level - 1) >> 1;
+
+		if (level_flags > 3)
+			level_flags = 3;
+		header |= (level_flags << 6);
+		header += 31 - (header % 31);
+
+		ret = Z_BUF_ERROR;
+		if (*out_len < 2)
+			goto out_blocks;
+		putShortMSB(out, header);
+		pos = 2;
+	}
+
+	for (i = 0; i < nr_blocks; i++) {
+		struct pdeflate_block *block = &job->blocks[i];
+
+		ret = block->err;
+		if (ret != Z_OK)
+			goto out_blocks;
+		ret = Z_BUF_ERROR;
+		if (*out_len - pos < block->out_len)
+			goto out_blocks;
+		memcpy(out + pos, block->out, block->out_len);
+		pos += block->out_len;
+	}
+
+	if (!noheader) {
+		uLong adler = zlib_adler32(0, NULL, 0);
+		uLong done;
+
+		for (done = 0; done < in_len; done += PDEFLATE_BLOCK)
+			adler = zlib_adler32(adler, in + done,
+					     min_t(uLong, PDEFLATE_BLOCK,
+						   in_len - done));
+
+		ret = Z_BUF_ERROR;
+		if (*out_len - pos < 4)
+			goto out_blocks;
+		putShortMSB(out + pos, (uInt)(adler >> 16));
+		putShortMSB(out + pos + 2, (uInt)(adler & 0xffff));
+		pos += 4;
+	}
+
+	*out_len = pos;
+	ret = Z_OK;
+
+out_blocks:
+	for (i = 0; i < nr_blocks; i++)
+		vfree(job->blocks[i].out);
+out_workers:
+	for (i = 0; i < nr_workers; i++)
+		vfree(workers[i].workspace);
+	kfree(workers);
+out_job:
+	vfree(job);
+	return ret;
+}
@@ -15,4 +15,6 @@ EXPORT_SYMBOL(zlib_deflate);
 EXPORT_SYMBOL(zlib_deflateInit2);
 EXPORT_SYMBOL(zlib_deflateEnd);
 EXPORT_SYMBOL(zlib_deflateReset);
+EXPORT_SYMBOL(zlib_deflateSetDictionary);
+EXPORT_SYMBOL(zlib_deflate_parallel);
 MODULE_LICENSE("GPL");
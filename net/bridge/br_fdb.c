@@ -87,7 +87,7 @@ static void fdb_rcu_free(struct rcu_head *head)
 
 static void fdb_delete(struct net_bridge *br, struct net_bridge_fdb_entry *f)
 {
-	hlist_del_rcu(&f->hlist);
+	hlist_del_init_rcu(&f->hlist);
 	fdb_notify(br, f, RTM_DELNEIGH);
 	call_rcu(&f->rcu, fdb_rcu_free);
 }
@@ -225,23 +225,29 @@ void br_fdb_cleanup(unsigned long _data)
 	unsigned long next_timer = jiffies + br->ageing_time;
 	int i;
 
-	spin_lock(&br->hash_lock);
+	/* Walk the table under RCU and take hash_lock only to delete an
+	 * expired entry, so learning on other CPUs isn't held off for
+	 * the length of the scan.
+	 */
+	rcu_read_lock();
 	for (i = 0; i < BR_HASH_SIZE; i++) {
 		struct net_bridge_fdb_entry *f;
-		struct hlist_node *n;
 
-		hlist_for_each_entry_safe(f, n, &br->hash[i], hlist) {
+		hlist_for_each_entry_rcu(f, &br->hash[i], hlist) {
 			unsigned long this_timer;
 			if (f->is_static)
 				continue;
 			this_timer = f->updated + delay;
-			if (time_before_eq(this_timer, jiffies))
-				fdb_delete(br, f);
-			else if (time_before(this_timer, next_timer))
+			if (time_before_eq(this_timer, jiffies)) {
+				spin_lock(&br->hash_lock);
+				if (!hlist_unhashed(&f->hlist))
+					fdb_delete(br, f);
+				spin_unlock(&br->hash_lock);
+			} else if (time_before(this_timer, next_timer))
 				next_timer = this_timer;
 		}
 	}
-	spin_unlock(&br->hash_lock);
+	rcu_read_unlock();
 
 	mod_timer(&br->gc_timer, round_jiffies_up(next_timer));
 }
@@ -506,9 +512,13 @@ void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 					"own address as source address\n",
 					source->dev->name);
 		} else {
-			/* fastpath: update of existing entry */
-			fdb->dst = source;
-			fdb->updated = jiffies;
+			/* fastpath: update of existing entry, only dirty
+			 * the entry when something actually changed
+			 */
+			if (unlikely(source != fdb->dst))
+				fdb->dst = source;
+			if (jiffies != fdb->updated)
+				fdb->updated = jiffies;
 			if (unlikely(added_by_user))
 				fdb->added_by_user = 1;
 		}
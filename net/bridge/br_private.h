@@ -98,14 +98,17 @@ struct net_bridge_fdb_entry
 	struct hlist_node		hlist;
 	struct net_bridge_port		*dst;
 
-	struct rcu_head			rcu;
-	unsigned long			updated;
-	unsigned long			used;
 	mac_addr			addr;
 	unsigned char			is_local;
 	unsigned char			is_static;
 	unsigned char			added_by_user;
 	__u16				vlan_id;
+
+	/* written from the packet path, kept off the lookup cacheline */
+	unsigned long			updated ____cacheline_aligned_in_smp;
+	unsigned long			used;
+
+	struct rcu_head			rcu;
 };
 
 struct net_bridge_port_group {
@@ -1690,6 +1690,9 @@ static void handle_reply(struct ceph_osd_client *osdc, struct ceph_msg *msg,
 	int already_completed;
 	u32 bytes;
 	unsigned int i;
+	int reply_op_len[CEPH_OSD_MAX_OP];
+	s32 reply_op_result[CEPH_OSD_MAX_OP];
+	int decode_failed;
 
 	tid = le64_to_cpu(msg->hdr.tid);
 	dout("handle_reply %p tid %llu\n", msg, tid);
@@ -1713,33 +1716,24 @@ static void handle_reply(struct ceph_osd_client *osdc, struct ceph_msg *msg,
 	reassert_version = ceph_decode_64(&p);
 	osdmap_epoch = ceph_decode_32(&p);
 
-	/* lookup */
-	down_read(&osdc->map_sem);
-	mutex_lock(&osdc->request_mutex);
-	req = __lookup_request(osdc, tid);
-	if (req == NULL) {
-		dout("handle_reply tid %llu dne\n", tid);
-		goto bad_mutex;
-	}
-	ceph_osdc_get_request(req);
-
-	dout("handle_reply %p tid %llu req %p result %d\n", msg, tid,
-	     req, result);
-
-	ceph_decode_need(&p, end, 4, bad_put);
+	/*
+	 * Decode the rest of the reply into locals first so that
+	 * request_mutex, which every request of every OSD session goes
+	 * through, is only held for the lookup and the state update.
+	 */
+	decode_failed = 1;
+	ceph_decode_need(&p, end, 4, decoded);
 	numops = ceph_decode_32(&p);
 	if (numops > CEPH_OSD_MAX_OP)
-		goto bad_put;
-	if (numops != req->r_num_ops)
-		goto bad_put;
+		goto decoded;
 	payload_len = 0;
-	ceph_decode_need(&p, end, numops * sizeof(struct ceph_osd_op), bad_put);
+	ceph_decode_need(&p, end, numops * sizeof(struct ceph_osd_op), decoded);
 	for (i = 0; i < numops; i++) {
 		struct ceph_osd_op *op = p;
 		int len;
 
 		len = le32_to_cpu(op->payload_len);
-		req->r_reply_op_len[i] = len;
+		reply_op_len[i] = len;
 		dout(" op %d has %d bytes\n", i, len);
 		payload_len += len;
 		p += sizeof(*op);
@@ -1748,13 +1742,13 @@ static void handle_reply(struct ceph_osd_client *osdc, struct ceph_msg *msg,
 	if (payload_len != bytes) {
 		pr_warning("sum of op payload lens %d != data_len %d",
 			   payload_len, bytes);
-		goto bad_put;
+		goto decoded;
 	}
 
-	ceph_decode_need(&p, end, 4 + numops * 4, bad_put);
+	ceph_decode_need(&p, end, 4 + numops * 4, decoded);
 	retry_attempt = ceph_decode_32(&p);
 	for (i = 0; i < numops; i++)
-		req->r_reply_op_result[i] = ceph_decode_32(&p);
+		reply_op_result[i] = ceph_decode_32(&p);
 
 	if (le16_to_cpu(msg->hdr.version) >= 6) {
 		p += 8 + 4; /* skip replay_version */
@@ -1762,10 +1756,32 @@ static void handle_reply(struct ceph_osd_client *osdc, struct ceph_msg *msg,
 
 		err = ceph_redirect_decode(&p, end, &redir);
 		if (err)
-			goto bad_put;
+			goto decoded;
 	} else {
 		redir.oloc.pool = -1;
 	}
+	decode_failed = 0;
+
+decoded:
+	/* lookup */
+	down_read(&osdc->map_sem);
+	mutex_lock(&osdc->request_mutex);
+	req = __lookup_request(osdc, tid);
+	if (req == NULL) {
+		dout("handle_reply tid %llu dne\n", tid);
+		goto bad_mutex;
+	}
+	ceph_osdc_get_request(req);
+
+	dout("handle_reply %p tid %llu req %p result %d\n", msg, tid,
+	     req, result);
+
+	if (decode_failed || numops != req->r_num_ops)
+		goto bad_put;
+	for (i = 0; i < numops; i++) {
+		req->r_reply_op_len[i] = reply_op_len[i];
+		req->r_reply_op_result[i] = reply_op_result[i];
+	}
 
 	if (redir.oloc.pool != -1) {
 		dout("redirect pool %lld\n", redir.oloc.pool);
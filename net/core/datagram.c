@@ -82,8 +82,8 @@ static int receiver_wake_function(wait_queue_t *wait, unsigned int mode, int syn
 /*
  * Wait for the last received packet to be different from skb
  */
-static int wait_for_more_packets(struct sock *sk, int *err, long *timeo_p,
-				 const struct sk_buff *skb)
+int __skb_wait_for_more_packets(struct sock *sk, int *err, long *timeo_p,
+				const struct sk_buff *skb)
 {
 	int error;
 	DEFINE_WAIT_FUNC(wait, receiver_wake_function);
@@ -129,6 +129,77 @@ out_noerr:
 	error = 1;
 	goto out;
 }
+EXPORT_SYMBOL(__skb_wait_for_more_packets);
+
+/**
+ *	skb_wait_for_datagram - Wait for a datagram to be queued
+ *	@sk: socket
+ *	@timeo_p: time to wait in jiffies, updated with the time left
+ *
+ *	Sleep until something is added to the receive queue of @sk, for
+ *	callers that polled it with MSG_DONTWAIT and want to bound the wait
+ *	themselves. Returns 0 when the receive should be retried, 1 if the
+ *	socket was shut down for reading, -EAGAIN if the time ran out and
+ *	another negative error on socket errors or pending signals.
+ */
+int skb_wait_for_datagram(struct sock *sk, long *timeo_p)
+{
+	int err = 0;
+
+	if (!*timeo_p)
+		return -EAGAIN;
+
+	if (__skb_wait_for_more_packets(sk, &err, timeo_p,
+					(struct sk_buff *)&sk->sk_receive_queue))
+		return err ? : 1;
+	return 0;
+}
+EXPORT_SYMBOL(skb_wait_for_datagram);
+
+/**
+ *	__skb_try_recv_from_queue - Dequeue or peek a datagram skbuff
+ *	@sk: socket
+ *	@queue: queue to take the datagram from
+ *	@flags: MSG_ flags
+ *	@peeked: returns non-zero if this packet has been seen before
+ *	@off: an offset in bytes to peek skb from. Returns an offset
+ *	      within an skb where data actually starts
+ *	@last: set to the last skb walked, or to the queue head itself
+ *
+ *	The non-waiting part of __skb_recv_datagram(), for protocols that
+ *	move the receive queue to a private one and dequeue several
+ *	datagrams per lock round trip. The caller holds @queue->lock.
+ */
+struct sk_buff *__skb_try_recv_from_queue(struct sock *sk,
+					  struct sk_buff_head *queue,
+					  unsigned int flags,
+					  int *peeked, int *off,
+					  struct sk_buff **last)
+{
+	struct sk_buff *skb;
+	int _off = *off;
+
+	*last = (struct sk_buff *)queue;
+	skb_queue_walk(queue, skb) {
+		*last = skb;
+		*peeked = skb->peeked;
+		if (flags & MSG_PEEK) {
+			if (_off >= skb->len && (skb->len || _off ||
+						 skb->peeked)) {
+				_off -= skb->len;
+				continue;
+			}
+			skb->peeked = 1;
+			atomic_inc(&skb->users);
+		} else
+			__skb_unlink(skb, queue);
+
+		*off = _off;
+		return skb;
+	}
+	return NULL;
+}
+EXPORT_SYMBOL(__skb_try_recv_from_queue);
 
 /**
  *	__skb_recv_datagram - Receive a datagram skbuff
@@ -185,29 +256,13 @@ struct sk_buff *__skb_recv_datagram(struct sock *sk, unsigned int flags,
 		 */
 		unsigned long cpu_flags;
 		struct sk_buff_head *queue = &sk->sk_receive_queue;
-		int _off = *off;
 
-		last = (struct sk_buff *)queue;
 		spin_lock_irqsave(&queue->lock, cpu_flags);
-		skb_queue_walk(queue, skb) {
-			last = skb;
-			*peeked = skb->peeked;
-			if (flags & MSG_PEEK) {
-				if (_off >= skb->len && (skb->len || _off ||
-							 skb->peeked)) {
-					_off -= skb->len;
-					continue;
-				}
-				skb->peeked = 1;
-				atomic_inc(&skb->users);
-			} else
-				__skb_unlink(skb, queue);
-
-			spin_unlock_irqrestore(&queue->lock, cpu_flags);
-			*off = _off;
-			return skb;
-		}
+		skb = __skb_try_recv_from_queue(sk, queue, flags, peeked, off,
+						&last);
 		spin_unlock_irqrestore(&queue->lock, cpu_flags);
+		if (skb)
+			return skb;
 
 		if (sk_can_busy_loop(sk) &&
 		    sk_busy_loop(sk, flags & MSG_DONTWAIT))
@@ -218,7 +273,7 @@ struct sk_buff *__skb_recv_datagram(struct sock *sk, unsigned int flags,
 		if (!timeo)
 			goto no_packet;
 
-	} while (!wait_for_more_packets(sk, err, &timeo, last));
+	} while (!__skb_wait_for_more_packets(sk, err, &timeo, last));
 
 	return NULL;
 
@@ -286,18 +341,28 @@ EXPORT_SYMBOL(skb_free_datagram_locked);
  */
 
 int skb_kill_datagram(struct sock *sk, struct sk_buff *skb, unsigned int flags)
+{
+	return __skb_kill_datagram(sk, &sk->sk_receive_queue, skb, flags);
+}
+EXPORT_SYMBOL(skb_kill_datagram);
+
+/*
+ * As skb_kill_datagram(), for a datagram peeked from @queue.
+ */
+int __skb_kill_datagram(struct sock *sk, struct sk_buff_head *queue,
+			struct sk_buff *skb, unsigned int flags)
 {
 	int err = 0;
 
 	if (flags & MSG_PEEK) {
 		err = -ENOENT;
-		spin_lock_bh(&sk->sk_receive_queue.lock);
-		if (skb == skb_peek(&sk->sk_receive_queue)) {
-			__skb_unlink(skb, &sk->sk_receive_queue);
+		spin_lock_bh(&queue->lock);
+		if (skb == skb_peek(queue)) {
+			__skb_unlink(skb, queue);
 			atomic_dec(&skb->users);
 			err = 0;
 		}
-		spin_unlock_bh(&sk->sk_receive_queue.lock);
+		spin_unlock_bh(&queue->lock);
 	}
 
 	kfree_skb(skb);
@@ -306,7 +371,7 @@ int skb_kill_datagram(struct sock *sk, struct sk_buff *skb, unsigned int flags)
 
 	return err;
 }
-EXPORT_SYMBOL(skb_kill_datagram);
+EXPORT_SYMBOL(__skb_kill_datagram);
 
 /**
  *	skb_copy_datagram_iovec - Copy a datagram to an iovec.
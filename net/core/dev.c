@@ -135,7 +135,7 @@
 
 #include "net-sysfs.h"
 
-/* Instead of increasing this, you should create a hash table. */
+/* Maximum number of flows held in one GRO hash bucket. */
 #define MAX_GRO_SKBS 8
 
 /* This should be increased if a protocol with a bigger head is added. */
@@ -1706,7 +1706,7 @@ static inline int deliver_skb(struct sk_buff *skb,
 			      struct packet_type *pt_prev,
 			      struct net_device *orig_dev)
 {
-	if (unlikely(skb_orphan_frags(skb, GFP_ATOMIC)))
+	if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)))
 		return -ENOMEM;
 	atomic_inc(&skb->users);
 	return pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
@@ -2536,8 +2536,19 @@ netdev_features_t netif_skb_dev_features(struct sk_buff *skb,
 }
 EXPORT_SYMBOL(netif_skb_dev_features);
 
+/**
+ *	dev_hard_start_xmit - hand a buffer to the device driver
+ *	@skb: buffer to transmit, or a GSO buffer with pending segments
+ *	@dev: device to transmit on
+ *	@txq: transmit queue, locked by the caller
+ *	@more: the caller has further buffers for @txq right behind this one
+ *
+ *	@more is passed to the driver in skb->xmit_more, so that it can defer
+ *	the doorbell write until the end of the batch. Between the segments
+ *	of a GSO buffer xmit_more is always set.
+ */
 int dev_hard_start_xmit(struct sk_buff *skb, struct net_device *dev,
-			struct netdev_queue *txq)
+			struct netdev_queue *txq, bool more)
 {
 	const struct net_device_ops *ops = dev->netdev_ops;
 	int rc = NETDEV_TX_OK;
@@ -2603,6 +2614,7 @@ int dev_hard_start_xmit(struct sk_buff *skb, struct net_device *dev,
 			dev_queue_xmit_nit(skb, dev);
 
 		skb_len = skb->len;
+		skb->xmit_more = more;
 		trace_net_dev_start_xmit(skb, dev);
 		rc = ops->ndo_start_xmit(skb, dev);
 		trace_net_dev_xmit(skb, rc, dev, skb_len);
@@ -2622,6 +2634,7 @@ gso:
 			dev_queue_xmit_nit(nskb, dev);
 
 		skb_len = nskb->len;
+		nskb->xmit_more = skb->next || more;
 		trace_net_dev_start_xmit(nskb, dev);
 		rc = ops->ndo_start_xmit(nskb, dev);
 		trace_net_dev_xmit(nskb, rc, dev, skb_len);
@@ -2857,7 +2870,7 @@ static int __dev_queue_xmit(struct sk_buff *skb, void *accel_priv)
 
 			if (!netif_xmit_stopped(txq)) {
 				__this_cpu_inc(xmit_recursion);
-				rc = dev_hard_start_xmit(skb, dev, txq);
+				rc = dev_hard_start_xmit(skb, dev, txq, false);
 				__this_cpu_dec(xmit_recursion);
 				if (dev_xmit_complete(rc)) {
 					HARD_TX_UNLOCK(dev, txq);
@@ -3486,6 +3499,36 @@ void netdev_rx_handler_unregister(struct net_device *dev)
 }
 EXPORT_SYMBOL_GPL(netdev_rx_handler_unregister);
 
+/**
+ *	dev_set_rx_filter - attach an early RX filter to a device
+ *	@dev: device
+ *	@fp: unattached filter, or NULL to detach the current one
+ *
+ *	The filter is run by the driver on each received frame before an
+ *	skb is built for it, see netdev_rx_filter_run(), so only drivers
+ *	setting IFF_RX_FILTER accept one. On success the device owns the
+ *	reference to @fp.
+ *
+ *	The caller must hold the rtnl_mutex.
+ */
+int dev_set_rx_filter(struct net_device *dev, struct sk_filter *fp)
+{
+	struct sk_filter *old;
+
+	ASSERT_RTNL();
+
+	if (fp && !(dev->priv_flags & IFF_RX_FILTER))
+		return -EOPNOTSUPP;
+
+	old = rtnl_dereference(dev->rx_filter);
+	rcu_assign_pointer(dev->rx_filter, fp);
+	if (old)
+		sk_unattached_filter_destroy(old);
+
+	return 0;
+}
+EXPORT_SYMBOL(dev_set_rx_filter);
+
 /*
  * Limit the use of PFMEMALLOC reserves to those protocols that implement
  * the special handling of PFMEMALLOC skbs.
@@ -3628,7 +3671,7 @@ ncls:
 	}
 
 	if (pt_prev) {
-		if (unlikely(skb_orphan_frags(skb, GFP_ATOMIC)))
+		if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)))
 			goto drop;
 		else
 			ret = pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
@@ -3784,16 +3827,18 @@ out:
 	return netif_receive_skb_internal(skb);
 }
 
-/* napi->gro_list contains packets ordered by age.
+/* Each gro_hash bucket contains packets ordered by age.
  * youngest packets at the head of it.
  * Complete skbs in reverse order to reduce latencies.
  */
-void napi_gro_flush(struct napi_struct *napi, bool flush_old)
+static void __napi_gro_flush_chain(struct napi_struct *napi, u32 index,
+				   bool flush_old)
 {
+	struct gro_list *gro = &napi->gro_hash[index];
 	struct sk_buff *skb, *prev = NULL;
 
 	/* scan list and build reverse chain */
-	for (skb = napi->gro_list; skb != NULL; skb = skb->next) {
+	for (skb = gro->list; skb != NULL; skb = skb->next) {
 		skb->prev = prev;
 		prev = skb;
 	}
@@ -3806,20 +3851,33 @@ void napi_gro_flush(struct napi_struct *napi, bool flush_old)
 
 		prev = skb->prev;
 		napi_gro_complete(skb);
-		napi->gro_count--;
+		gro->count--;
 	}
 
-	napi->gro_list = NULL;
+	gro->list = NULL;
+	__clear_bit(index, &napi->gro_bitmask);
+}
+
+void napi_gro_flush(struct napi_struct *napi, bool flush_old)
+{
+	unsigned long bitmask = napi->gro_bitmask;
+	unsigned int i, base = ~0U;
+
+	while ((i = ffs(bitmask)) != 0) {
+		bitmask >>= i;
+		base += i;
+		__napi_gro_flush_chain(napi, base, flush_old);
+	}
 }
 EXPORT_SYMBOL(napi_gro_flush);
 
-static void gro_list_prepare(struct napi_struct *napi, struct sk_buff *skb)
+static void gro_list_prepare(struct sk_buff *head, struct sk_buff *skb)
 {
 	struct sk_buff *p;
 	unsigned int maclen = skb->dev->hard_header_len;
 	u32 hash = skb_get_hash_raw(skb);
 
-	for (p = napi->gro_list; p; p = p->next) {
+	for (p = head; p; p = p->next) {
 		unsigned long diffs;
 
 		NAPI_GRO_CB(p)->flush = 0;
@@ -3882,6 +3940,8 @@ static void gro_pull_from_frag0(struct sk_buff *skb, int grow)
 
 static enum gro_result dev_gro_receive(struct napi_struct *napi, struct sk_buff *skb)
 {
+	u32 hash = skb_get_hash_raw(skb) & (GRO_HASH_BUCKETS - 1);
+	struct gro_list *gro = &napi->gro_hash[hash];
 	struct sk_buff **pp = NULL;
 	struct packet_offload *ptype;
 	__be16 type = skb->protocol;
@@ -3896,7 +3956,7 @@ static enum gro_result dev_gro_receive(struct napi_struct *napi, struct sk_buff
 	if (skb_is_gso(skb) || skb_has_frag_list(skb))
 		goto normal;
 
-	gro_list_prepare(napi, skb);
+	gro_list_prepare(gro->list, skb);
 	NAPI_GRO_CB(skb)->csum = skb->csum; /* Needed for CHECKSUM_COMPLETE */
 
 	rcu_read_lock();
@@ -3911,7 +3971,7 @@ static enum gro_result dev_gro_receive(struct napi_struct *napi, struct sk_buff
 		NAPI_GRO_CB(skb)->free = 0;
 		NAPI_GRO_CB(skb)->udp_mark = 0;
 
-		pp = ptype->callbacks.gro_receive(&napi->gro_list, skb);
+		pp = ptype->callbacks.gro_receive(&gro->list, skb);
 		break;
 	}
 	rcu_read_unlock();
@@ -3928,7 +3988,7 @@ static enum gro_result dev_gro_receive(struct napi_struct *napi, struct sk_buff
 		*pp = nskb->next;
 		nskb->next = NULL;
 		napi_gro_complete(nskb);
-		napi->gro_count--;
+		gro->count--;
 	}
 
 	if (same_flow)
@@ -3937,8 +3997,8 @@ static enum gro_result dev_gro_receive(struct napi_struct *napi, struct sk_buff
 	if (NAPI_GRO_CB(skb)->flush)
 		goto normal;
 
-	if (unlikely(napi->gro_count >= MAX_GRO_SKBS)) {
-		struct sk_buff *nskb = napi->gro_list;
+	if (unlikely(gro->count >= MAX_GRO_SKBS)) {
+		struct sk_buff *nskb = gro->list;
 
 		/* locate the end of the list to select the 'oldest' flow */
 		while (nskb->next) {
@@ -3949,13 +4009,13 @@ static enum gro_result dev_gro_receive(struct napi_struct *napi, struct sk_buff
 		nskb->next = NULL;
 		napi_gro_complete(nskb);
 	} else {
-		napi->gro_count++;
+		gro->count++;
 	}
 	NAPI_GRO_CB(skb)->count = 1;
 	NAPI_GRO_CB(skb)->age = jiffies;
 	skb_shinfo(skb)->gso_size = skb_gro_len(skb);
-	skb->next = napi->gro_list;
-	napi->gro_list = skb;
+	skb->next = gro->list;
+	gro->list = skb;
 	ret = GRO_HELD;
 
 pull:
@@ -3963,6 +4023,11 @@ pull:
 	if (grow > 0)
 		gro_pull_from_frag0(skb, grow);
 ok:
+	if (gro->count)
+		__set_bit(hash, &napi->gro_bitmask);
+	else
+		__clear_bit(hash, &napi->gro_bitmask);
+
 	return ret;
 
 normal:
@@ -4241,7 +4306,7 @@ EXPORT_SYMBOL(__napi_schedule);
 void __napi_complete(struct napi_struct *n)
 {
 	BUG_ON(!test_bit(NAPI_STATE_SCHED, &n->state));
-	BUG_ON(n->gro_list);
+	BUG_ON(n->gro_bitmask);
 
 	list_del(&n->poll_list);
 	smp_mb__before_clear_bit();
@@ -4322,9 +4387,14 @@ EXPORT_SYMBOL_GPL(napi_hash_del);
 void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
 		    int (*poll)(struct napi_struct *, int), int weight)
 {
+	int i;
+
 	INIT_LIST_HEAD(&napi->poll_list);
-	napi->gro_count = 0;
-	napi->gro_list = NULL;
+	napi->gro_bitmask = 0;
+	for (i = 0; i < GRO_HASH_BUCKETS; i++) {
+		napi->gro_hash[i].list = NULL;
+		napi->gro_hash[i].count = 0;
+	}
 	napi->skb = NULL;
 	napi->poll = poll;
 	if (weight > NAPI_POLL_WEIGHT)
@@ -4343,12 +4413,17 @@ EXPORT_SYMBOL(netif_napi_add);
 
 void netif_napi_del(struct napi_struct *napi)
 {
+	int i;
+
 	list_del_init(&napi->dev_list);
 	napi_free_frags(napi);
 
-	kfree_skb_list(napi->gro_list);
-	napi->gro_list = NULL;
-	napi->gro_count = 0;
+	for (i = 0; i < GRO_HASH_BUCKETS; i++) {
+		kfree_skb_list(napi->gro_hash[i].list);
+		napi->gro_hash[i].list = NULL;
+		napi->gro_hash[i].count = 0;
+	}
+	napi->gro_bitmask = 0;
 }
 EXPORT_SYMBOL(netif_napi_del);
 
@@ -4414,7 +4489,7 @@ static void net_rx_action(struct softirq_action *h)
 				napi_complete(n);
 				local_irq_disable();
 			} else {
-				if (n->gro_list) {
+				if (n->gro_bitmask) {
 					/* flush too old packets
 					 * If HZ < 1000, flush all packets.
 					 */
@@ -5594,6 +5669,7 @@ static void rollback_registered_many(struct list_head *head)
 		/* Shutdown queueing discipline. */
 		dev_shutdown(dev);
 
+		dev_set_rx_filter(dev, NULL);
 
 		/* Notify protocols, that we are about to destroy
 		   this device. They should clean all the things.
@@ -29,6 +29,7 @@
 #include <linux/in.h>
 #include <linux/inet.h>
 #include <linux/netdevice.h>
+#include <linux/etherdevice.h>
 #include <linux/if_packet.h>
 #include <linux/gfp.h>
 #include <net/ip.h>
@@ -113,6 +114,55 @@ int sk_filter(struct sock *sk, struct sk_buff *skb)
 }
 EXPORT_SYMBOL(sk_filter);
 
+/**
+ *	netdev_rx_filter_run - run the early RX filter of a device
+ *	@dev: receiving Ethernet device
+ *	@data: start of the frame in the driver's RX buffer
+ *	@len: number of frame bytes present at @data
+ *	@rx_queue: RX queue the frame arrived on
+ *
+ * Called by drivers from their NAPI poll, before an skb is allocated
+ * for the frame. The program runs on a shell skb on the stack that
+ * points at @data, so packet loads and the protocol, pkttype, ifindex,
+ * hatype and queue ancillary fields work as they do for packet sockets.
+ * Fields only set later in the stack (mark, hash, vlan tag) read as 0.
+ *
+ * Returns NET_RX_FILTER_DROP if the program returned 0, otherwise
+ * NET_RX_FILTER_PASS; the length a socket filter would trim to has no
+ * meaning here.
+ */
+u32 netdev_rx_filter_run(struct net_device *dev, void *data,
+			 unsigned int len, u16 rx_queue)
+{
+	struct sk_filter *filter;
+	struct sk_buff skb;
+	u32 ret = NET_RX_FILTER_PASS;
+
+	if (unlikely(len < ETH_HLEN))
+		return ret;
+
+	rcu_read_lock();
+	filter = rcu_dereference(dev->rx_filter);
+	if (filter) {
+		memset(&skb, 0, sizeof(skb));
+		skb.head = data;
+		skb.data = data;
+		skb.len = len;
+		skb_set_tail_pointer(&skb, len);
+		skb_record_rx_queue(&skb, rx_queue);
+		skb.protocol = eth_type_trans(&skb, dev);
+		skb_reset_network_header(&skb);
+		__skb_push(&skb, ETH_HLEN);
+
+		if (!SK_RUN_FILTER(filter, &skb))
+			ret = NET_RX_FILTER_DROP;
+	}
+	rcu_read_unlock();
+
+	return ret;
+}
+EXPORT_SYMBOL(netdev_rx_filter_run);
+
 /* Base function for offset calculation. Needs to go into .text section,
  * therefore keeping it non-static as well; will also be used by JITs
  * anyway later on, so do not let the compiler omit it.
@@ -310,7 +360,7 @@ select_insn:
 		A = do_div(tmp, X);
 		CONT;
 	BPF_ALU_BPF_MOD_BPF_X:
-		if (unlikely(X == 0))
+		if (unlikely((u32) X == 0))
 			return 0;
 		tmp = (u32) A;
 		A = do_div(tmp, (u32) X);
@@ -329,7 +379,7 @@ select_insn:
 		do_div(A, X);
 		CONT;
 	BPF_ALU_BPF_DIV_BPF_X:
-		if (unlikely(X == 0))
+		if (unlikely((u32) X == 0))
 			return 0;
 		tmp = (u32) A;
 		do_div(tmp, (u32) X);
@@ -565,10 +615,6 @@ load_byte:
 #undef K
 }
 
-u32 sk_run_filter_int_seccomp(const struct seccomp_data *ctx,
-			      const struct sock_filter_int *insni)
-    __attribute__ ((alias ("__sk_run_filter")));
-
 u32 sk_run_filter_int_skb(const struct sk_buff *ctx,
 			  const struct sock_filter_int *insni)
     __attribute__ ((alias ("__sk_run_filter")));
@@ -1473,6 +1519,41 @@ static struct sk_filter *__sk_migrate_realloc(struct sk_filter *fp,
 	return fp_new;
 }
 
+/* Architectures with a JIT for the internal BPF instruction set
+ * override this; everybody else keeps running the interpreter.
+ */
+void __weak bpf_int_jit_compile(struct sk_filter *prog)
+{
+}
+
+/**
+ *	sk_filter_select_runtime - select execution runtime for BPF program
+ *	@fp: sk_filter populated with internal BPF program
+ *
+ * Try to JIT the internal BPF program; if the JIT is not available or
+ * refuses the program, fall back to the interpreter.
+ */
+void sk_filter_select_runtime(struct sk_filter *fp)
+{
+	fp->bpf_func = (void *) __sk_run_filter;
+
+	/* Probe if internal BPF can be JITed */
+	bpf_int_jit_compile(fp);
+}
+EXPORT_SYMBOL_GPL(sk_filter_select_runtime);
+
+/**
+ *	sk_filter_free - free an internal BPF program
+ *	@fp: sk_filter set up by sk_filter_select_runtime()
+ *
+ * Releases the JITed image (if any) together with @fp.
+ */
+void sk_filter_free(struct sk_filter *fp)
+{
+	bpf_jit_free(fp);
+}
+EXPORT_SYMBOL_GPL(sk_filter_free);
+
 static struct sk_filter *__sk_migrate_filter(struct sk_filter *fp,
 					     struct sock *sk)
 {
@@ -1523,7 +1604,6 @@ static struct sk_filter *__sk_migrate_filter(struct sk_filter *fp,
 		goto out_err_free;
 	}
 
-	fp->bpf_func = sk_run_filter_int_skb;
 	fp->len = new_len;
 
 	/* 2nd pass: remap sock_filter insns into sock_filter_int insns. */
@@ -1536,6 +1616,8 @@ static struct sk_filter *__sk_migrate_filter(struct sk_filter *fp,
 		 */
 		goto out_err_free;
 
+	sk_filter_select_runtime(fp);
+
 	kfree(old_prog);
 	return fp;
 
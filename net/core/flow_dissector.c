@@ -51,7 +51,16 @@ __be32 skb_flow_get_ports(const struct sk_buff *skb, int thoff, u8 ip_proto)
 }
 EXPORT_SYMBOL(skb_flow_get_ports);
 
-bool skb_flow_dissect(const struct sk_buff *skb, struct flow_keys *flow)
+/**
+ * __skb_flow_dissect - extract the flow keys of a packet
+ * @skb: buffer to dissect
+ * @flow: where to store the keys
+ * @flags: FLOW_DISSECTOR_F_* to skip the parts the caller does not need
+ *
+ * Returns false if the network header could not be parsed.
+ */
+bool __skb_flow_dissect(const struct sk_buff *skb, struct flow_keys *flow,
+			unsigned int flags)
 {
 	int nhoff = skb_network_offset(skb);
 	u8 ip_proto;
@@ -176,12 +185,13 @@ ipv6:
 	}
 
 	flow->ip_proto = ip_proto;
-	flow->ports = skb_flow_get_ports(skb, nhoff, ip_proto);
+	if (!(flags & FLOW_DISSECTOR_F_STOP_AT_L3))
+		flow->ports = skb_flow_get_ports(skb, nhoff, ip_proto);
 	flow->thoff = (u16) nhoff;
 
 	return true;
 }
-EXPORT_SYMBOL(skb_flow_dissect);
+EXPORT_SYMBOL(__skb_flow_dissect);
 
 static u32 hashrnd __read_mostly;
 static __always_inline void __flow_hash_secret_init(void)
@@ -205,7 +215,8 @@ static __always_inline u32 __flow_hash_1word(u32 a)
  * __skb_get_hash: calculate a flow hash based on src/dst addresses
  * and src/dst port numbers.  Sets hash in skb to non-zero hash value
  * on success, zero indicates no valid hash.  Also, sets l4_hash in skb
- * if hash is a canonical 4-tuple hash over transport ports.
+ * if hash is a canonical 4-tuple hash over transport ports, and sw_hash
+ * so that later skb_get_hash() calls reuse it.
  */
 void __skb_get_hash(struct sk_buff *skb)
 {
@@ -232,10 +243,22 @@ void __skb_get_hash(struct sk_buff *skb)
 	if (!hash)
 		hash = 1;
 
+	skb->sw_hash = 1;
 	skb->hash = hash;
 }
 EXPORT_SYMBOL(__skb_get_hash);
 
+/*
+ * skb_get_hash_perturb: flow hash mixed with a caller private value, for
+ * users (qdiscs) that need their own hash function. It reuses the hash
+ * cached in the skb instead of dissecting the packet again.
+ */
+u32 skb_get_hash_perturb(struct sk_buff *skb, u32 perturb)
+{
+	return jhash_1word(skb_get_hash(skb), perturb);
+}
+EXPORT_SYMBOL(skb_get_hash_perturb);
+
 /*
  * Returns a Tx hash based on the given packet descriptor a Tx queues' number
  * to be used as a distribution range.
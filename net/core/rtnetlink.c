@@ -1154,6 +1154,8 @@ static const struct nla_policy ifla_policy[IFLA_MAX+1] = {
 	[IFLA_NUM_TX_QUEUES]	= { .type = NLA_U32 },
 	[IFLA_NUM_RX_QUEUES]	= { .type = NLA_U32 },
 	[IFLA_PHYS_PORT_ID]	= { .type = NLA_BINARY, .len = MAX_PHYS_PORT_ID_LEN },
+	[IFLA_RX_FILTER]	= { .type = NLA_BINARY,
+				    .len = BPF_MAXINSNS * sizeof(struct sock_filter) },
 	[IFLA_CARRIER_CHANGES]	= { .type = NLA_U32 },  /* ignored */
 };
 
@@ -1539,6 +1541,34 @@ static int do_setlink(const struct sk_buff *skb,
 	if (tb[IFLA_TXQLEN])
 		dev->tx_queue_len = nla_get_u32(tb[IFLA_TXQLEN]);
 
+	if (tb[IFLA_RX_FILTER]) {
+		struct nlattr *attr = tb[IFLA_RX_FILTER];
+		struct sk_filter *fp = NULL;
+
+		/* an empty attribute detaches the filter */
+		if (nla_len(attr)) {
+			struct sock_fprog fprog;
+
+			if (nla_len(attr) % sizeof(struct sock_filter)) {
+				err = -EINVAL;
+				goto errout;
+			}
+			fprog.len = nla_len(attr) / sizeof(struct sock_filter);
+			fprog.filter = nla_data(attr);
+			err = sk_unattached_filter_create(&fp, &fprog);
+			if (err)
+				goto errout;
+		}
+
+		err = dev_set_rx_filter(dev, fp);
+		if (err) {
+			if (fp)
+				sk_unattached_filter_destroy(fp);
+			goto errout;
+		}
+		modified = 1;
+	}
+
 	if (tb[IFLA_OPERSTATE])
 		set_operstate(dev, nla_get_u8(tb[IFLA_OPERSTATE]));
 
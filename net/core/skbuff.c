@@ -62,6 +62,7 @@
 #include <linux/scatterlist.h>
 #include <linux/errqueue.h>
 #include <linux/prefetch.h>
+#include <linux/cpu.h>
 
 #include <net/protocol.h>
 #include <net/dst.h>
@@ -177,6 +178,83 @@ out:
 	return skb;
 }
 
+/*
+ * Per-CPU cache of sk_buff heads for NAPI context. RX allocations in a poll
+ * routine and the frees done by the stack and by TX completion in softirq
+ * recycle heads through it, refilling from and returning to the slab in
+ * batches. It is only touched from softirq context, which cannot nest on
+ * the same CPU; hard interrupts and process context go to the slab.
+ */
+#define SKB_HEAD_CACHE_SIZE	64
+#define SKB_HEAD_CACHE_BULK	16
+
+struct skb_head_cache {
+	unsigned int	count;
+	void		*heads[SKB_HEAD_CACHE_SIZE];
+};
+static DEFINE_PER_CPU(struct skb_head_cache, skb_head_cache);
+
+static inline bool skb_head_cache_usable(void)
+{
+	return in_serving_softirq() && !in_irq();
+}
+
+static struct sk_buff *skb_head_cache_get(gfp_t gfp_mask)
+{
+	struct skb_head_cache *hc;
+
+	if (!skb_head_cache_usable())
+		return kmem_cache_alloc(skbuff_head_cache, gfp_mask);
+
+	hc = &__get_cpu_var(skb_head_cache);
+	if (unlikely(!hc->count)) {
+		while (hc->count < SKB_HEAD_CACHE_BULK) {
+			void *head = kmem_cache_alloc(skbuff_head_cache,
+						      gfp_mask);
+
+			if (!head)
+				break;
+			hc->heads[hc->count++] = head;
+		}
+		if (!hc->count)
+			return NULL;
+	}
+
+	return hc->heads[--hc->count];
+}
+
+static void skb_head_cache_put(struct sk_buff *skb)
+{
+	struct skb_head_cache *hc;
+
+	if (!skb_head_cache_usable()) {
+		kmem_cache_free(skbuff_head_cache, skb);
+		return;
+	}
+
+	hc = &__get_cpu_var(skb_head_cache);
+	if (unlikely(hc->count == SKB_HEAD_CACHE_SIZE)) {
+		while (hc->count > SKB_HEAD_CACHE_SIZE - SKB_HEAD_CACHE_BULK)
+			kmem_cache_free(skbuff_head_cache,
+					hc->heads[--hc->count]);
+	}
+	hc->heads[hc->count++] = skb;
+}
+
+static int skb_head_cache_cpu_callback(struct notifier_block *nfb,
+				       unsigned long action, void *hcpu)
+{
+	if (action == CPU_DEAD || action == CPU_DEAD_FROZEN) {
+		struct skb_head_cache *hc;
+
+		hc = &per_cpu(skb_head_cache, (unsigned long)hcpu);
+		while (hc->count)
+			kmem_cache_free(skbuff_head_cache,
+					hc->heads[--hc->count]);
+	}
+	return NOTIFY_OK;
+}
+
 /**
  *	__alloc_skb	-	allocate a network buffer
  *	@size: size to allocate
@@ -210,7 +288,10 @@ struct sk_buff *__alloc_skb(unsigned int size, gfp_t gfp_mask,
 		gfp_mask |= __GFP_MEMALLOC;
 
 	/* Get the HEAD */
-	skb = kmem_cache_alloc_node(cache, gfp_mask & ~__GFP_DMA, node);
+	if (cache == skbuff_head_cache && node == NUMA_NO_NODE)
+		skb = skb_head_cache_get(gfp_mask & ~__GFP_DMA);
+	else
+		skb = kmem_cache_alloc_node(cache, gfp_mask & ~__GFP_DMA, node);
 	if (!skb)
 		goto out;
 	prefetchw(skb);
@@ -270,7 +351,10 @@ struct sk_buff *__alloc_skb(unsigned int size, gfp_t gfp_mask,
 out:
 	return skb;
 nodata:
-	kmem_cache_free(cache, skb);
+	if (cache == skbuff_head_cache)
+		skb_head_cache_put(skb);
+	else
+		kmem_cache_free(cache, skb);
 	skb = NULL;
 	goto out;
 }
@@ -300,7 +384,7 @@ struct sk_buff *build_skb(void *data, unsigned int frag_size)
 	struct sk_buff *skb;
 	unsigned int size = frag_size ? : ksize(data);
 
-	skb = kmem_cache_alloc(skbuff_head_cache, GFP_ATOMIC);
+	skb = skb_head_cache_get(GFP_ATOMIC);
 	if (!skb)
 		return NULL;
 
@@ -439,6 +523,34 @@ struct sk_buff *__netdev_alloc_skb(struct net_device *dev,
 }
 EXPORT_SYMBOL(__netdev_alloc_skb);
 
+/**
+ *	netdev_alloc_skb_bulk - allocate several skbuffs for rx
+ *	@dev: network device to receive on
+ *	@length: length to allocate for each buffer
+ *	@skbs: array to store the buffers in
+ *	@n: number of buffers wanted
+ *
+ *	Batched netdev_alloc_skb() for refilling an RX ring. Called from a
+ *	NAPI poll routine, the heads come from the per-CPU cache, which is
+ *	refilled from the slab in batches.
+ *
+ *	Returns the number of buffers stored, which is less than @n only if
+ *	memory ran out.
+ */
+unsigned int netdev_alloc_skb_bulk(struct net_device *dev, unsigned int length,
+				   struct sk_buff **skbs, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		skbs[i] = __netdev_alloc_skb(dev, length, GFP_ATOMIC);
+		if (unlikely(!skbs[i]))
+			break;
+	}
+	return i;
+}
+EXPORT_SYMBOL(netdev_alloc_skb_bulk);
+
 void skb_add_rx_frag(struct sk_buff *skb, int i, struct page *page, int off,
 		     int size, unsigned int truesize)
 {
@@ -528,7 +640,7 @@ static void kfree_skbmem(struct sk_buff *skb)
 
 	switch (skb->fclone) {
 	case SKB_FCLONE_UNAVAILABLE:
-		kmem_cache_free(skbuff_head_cache, skb);
+		skb_head_cache_put(skb);
 		break;
 
 	case SKB_FCLONE_ORIG:
@@ -835,6 +947,161 @@ int skb_copy_ubufs(struct sk_buff *skb, gfp_t gfp_mask)
 }
 EXPORT_SYMBOL_GPL(skb_copy_ubufs);
 
+/*
+ * MSG_ZEROCOPY completion notifications. The ubuf_info shared by the skbs
+ * of one send call lives in the cb of an empty skb, which is queued on the
+ * socket error queue once the last of those skbs has released the user
+ * pages. Notifications for consecutive ids are merged into one range.
+ */
+static struct sk_buff *skb_from_uarg(struct ubuf_info *uarg)
+{
+	return container_of((void *)uarg, struct sk_buff, cb);
+}
+
+static void sock_zerocopy_ofree(struct sk_buff *skb)
+{
+	atomic_sub(skb->truesize, &skb->sk->sk_omem_alloc);
+}
+
+/**
+ *	sock_zerocopy_alloc - allocate a MSG_ZEROCOPY notification
+ *	@sk: socket sending the user pages
+ *
+ *	Returns a ubuf_info holding one reference for the caller, charged
+ *	to the socket option memory, or %NULL if that is exhausted.
+ *	Must be called with the socket locked.
+ */
+struct ubuf_info *sock_zerocopy_alloc(struct sock *sk)
+{
+	struct ubuf_info *uarg;
+	struct sk_buff *skb;
+
+	BUILD_BUG_ON(sizeof(*uarg) > sizeof(skb->cb));
+
+	if (atomic_read(&sk->sk_omem_alloc) + SKB_TRUESIZE(0) >
+	    sysctl_optmem_max)
+		return NULL;
+
+	skb = alloc_skb(0, sk->sk_allocation);
+	if (!skb)
+		return NULL;
+
+	skb->sk = sk;
+	skb->destructor = sock_zerocopy_ofree;
+	atomic_add(skb->truesize, &sk->sk_omem_alloc);
+	sock_hold(sk);
+
+	uarg = (void *)skb->cb;
+	uarg->callback = sock_zerocopy_callback;
+	uarg->id = (u32)atomic_inc_return(&sk->sk_zckey) - 1;
+	uarg->zerocopy = true;
+	atomic_set(&uarg->refcnt, 1);
+
+	return uarg;
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_alloc);
+
+static void sock_zerocopy_notify(struct ubuf_info *uarg)
+{
+	struct sk_buff *tail, *skb = skb_from_uarg(uarg);
+	struct sock *sk = skb->sk;
+	struct sk_buff_head *q = &sk->sk_error_queue;
+	struct sock_exterr_skb *serr;
+	u8 code = uarg->zerocopy ? 0 : SO_EE_CODE_ZEROCOPY_COPIED;
+	u32 id = uarg->id;
+	unsigned long flags;
+
+	serr = SKB_EXT_ERR(skb);
+	memset(serr, 0, sizeof(*serr));
+	serr->ee.ee_origin = SO_EE_ORIGIN_ZEROCOPY;
+	serr->ee.ee_code = code;
+	serr->ee.ee_info = id;
+	serr->ee.ee_data = id;
+
+	spin_lock_irqsave(&q->lock, flags);
+	tail = skb_peek_tail(q);
+	if (tail && SKB_EXT_ERR(tail)->ee.ee_origin == SO_EE_ORIGIN_ZEROCOPY &&
+	    SKB_EXT_ERR(tail)->ee.ee_code == code &&
+	    SKB_EXT_ERR(tail)->ee.ee_data + 1 == id) {
+		SKB_EXT_ERR(tail)->ee.ee_data = id;
+	} else {
+		__skb_queue_tail(q, skb);
+		skb = NULL;
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	sk->sk_error_report(sk);
+	consume_skb(skb);
+	sock_put(sk);
+}
+
+/**
+ *	sock_zerocopy_callback - release an skb reference to a notification
+ *	@uarg: notification shared by the skb
+ *	@success: false if the user pages had to be copied after all
+ */
+void sock_zerocopy_callback(struct ubuf_info *uarg, bool success)
+{
+	if (!success)
+		uarg->zerocopy = false;
+	if (atomic_dec_and_test(&uarg->refcnt))
+		sock_zerocopy_notify(uarg);
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_callback);
+
+/**
+ *	sock_zerocopy_put - drop the sender's reference to a notification
+ *	@uarg: notification from sock_zerocopy_alloc(), may be %NULL
+ */
+void sock_zerocopy_put(struct ubuf_info *uarg)
+{
+	if (uarg && atomic_dec_and_test(&uarg->refcnt))
+		sock_zerocopy_notify(uarg);
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_put);
+
+/**
+ *	sock_zerocopy_put_abort - discard an unused notification
+ *	@uarg: notification from sock_zerocopy_alloc(), may be %NULL
+ *
+ *	For a send call that failed before any skb took a reference: the
+ *	notification is freed silently and its id is handed out again.
+ *	Must be called with the socket locked.
+ */
+void sock_zerocopy_put_abort(struct ubuf_info *uarg)
+{
+	struct sk_buff *skb;
+	struct sock *sk;
+
+	if (!uarg)
+		return;
+
+	skb = skb_from_uarg(uarg);
+	sk = skb->sk;
+	WARN_ON_ONCE(atomic_read(&uarg->refcnt) != 1);
+	atomic_dec(&sk->sk_zckey);
+	kfree_skb(skb);
+	sock_put(sk);
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_put_abort);
+
+/*
+ * @nskb was given frags of @skb, after skb_orphan_frags(): take a reference
+ * to the MSG_ZEROCOPY notification those still belong to, if any.
+ */
+static int skb_zerocopy_clone(struct sk_buff *nskb, struct sk_buff *skb)
+{
+	struct ubuf_info *uarg = skb_zcopy_uarg(skb);
+
+	if (!uarg)
+		return 0;
+	if (skb_zcopy(nskb))
+		return skb_zcopy_uarg(nskb) == uarg ? 0 : -EIO;
+
+	skb_zcopy_set(nskb, uarg);
+	return 0;
+}
+
 /**
  *	skb_clone	-	duplicate an sk_buff
  *	@skb: buffer to clone
@@ -987,7 +1254,8 @@ struct sk_buff *__pskb_copy(struct sk_buff *skb, int headroom, gfp_t gfp_mask)
 	if (skb_shinfo(skb)->nr_frags) {
 		int i;
 
-		if (skb_orphan_frags(skb, gfp_mask)) {
+		if (skb_orphan_frags(skb, gfp_mask) ||
+		    skb_zerocopy_clone(n, skb)) {
 			kfree_skb(n);
 			n = NULL;
 			goto out;
@@ -1067,6 +1335,9 @@ int pskb_expand_head(struct sk_buff *skb, int nhead, int ntail,
 		/* copy this zero copy skb frags */
 		if (skb_orphan_frags(skb, gfp_mask))
 			goto nofrags;
+		/* the new shinfo holds the notification as well */
+		if (skb_zcopy(skb))
+			atomic_inc(&skb_zcopy_uarg(skb)->refcnt);
 		for (i = 0; i < skb_shinfo(skb)->nr_frags; i++)
 			skb_frag_ref(skb, i);
 
@@ -1788,9 +2059,11 @@ static bool __skb_splice_bits(struct sk_buff *skb, struct pipe_inode_info *pipe,
  * the frag list, if such a thing exists. We'd probably need to recurse to
  * handle that cleanly.
  */
-int skb_splice_bits(struct sk_buff *skb, unsigned int offset,
-		    struct pipe_inode_info *pipe, unsigned int tlen,
-		    unsigned int flags)
+static int __skb_splice_to_pipe(struct sk_buff *skb, struct sock *sk,
+				unsigned int offset,
+				struct pipe_inode_info *pipe,
+				unsigned int tlen, unsigned int flags,
+				bool sk_locked)
 {
 	struct partial_page partial[MAX_SKB_FRAGS];
 	struct page *pages[MAX_SKB_FRAGS];
@@ -1803,7 +2076,6 @@ int skb_splice_bits(struct sk_buff *skb, unsigned int offset,
 		.spd_release = sock_spd_release,
 	};
 	struct sk_buff *frag_iter;
-	struct sock *sk = skb->sk;
 	int ret = 0;
 
 	/*
@@ -1836,14 +2108,46 @@ done:
 		 * we call into ->sendpage() with the i_mutex lock held
 		 * and networking will grab the socket lock.
 		 */
-		release_sock(sk);
+		if (sk_locked)
+			release_sock(sk);
 		ret = splice_to_pipe(pipe, &spd);
-		lock_sock(sk);
+		if (sk_locked)
+			lock_sock(sk);
 	}
 
 	return ret;
 }
 
+int skb_splice_bits(struct sk_buff *skb, unsigned int offset,
+		    struct pipe_inode_info *pipe, unsigned int tlen,
+		    unsigned int flags)
+{
+	return __skb_splice_to_pipe(skb, skb->sk, offset, pipe, tlen, flags,
+				    true);
+}
+
+/**
+ *	skb_splice_bits_nolock - map skb data into a pipe
+ *	@skb: buffer to splice from
+ *	@sk: receiving socket, used to allocate pages for linear data
+ *	@offset: offset in @skb to start from
+ *	@pipe: destination pipe
+ *	@tlen: number of bytes to splice
+ *	@flags: splice flags
+ *
+ *	Like skb_splice_bits(), but for callers that serialize readers with
+ *	their own lock rather than the socket lock, so lock_sock() is not
+ *	dropped around splice_to_pipe().
+ */
+int skb_splice_bits_nolock(struct sk_buff *skb, struct sock *sk,
+			   unsigned int offset, struct pipe_inode_info *pipe,
+			   unsigned int tlen, unsigned int flags)
+{
+	return __skb_splice_to_pipe(skb, sk, offset, pipe, tlen, flags,
+				    false);
+}
+EXPORT_SYMBOL_GPL(skb_splice_bits_nolock);
+
 /**
  *	skb_store_bits - store bits from kernel buffer to skb
  *	@skb: destination buffer
@@ -2132,6 +2436,7 @@ EXPORT_SYMBOL_GPL(skb_zerocopy_headlen);
  *	0: everything is OK
  *	-ENOMEM: couldn't orphan frags of @from due to lack of memory
  *	-EFAULT: skb_copy_bits() found some problem with skb geometry
+ *	-EIO: @to already holds another MSG_ZEROCOPY notification
  */
 int
 skb_zerocopy(struct sk_buff *to, struct sk_buff *from, int len, int hlen)
@@ -2173,6 +2478,8 @@ skb_zerocopy(struct sk_buff *to, struct sk_buff *from, int len, int hlen)
 		skb_tx_error(from);
 		return -ENOMEM;
 	}
+	if (unlikely(skb_zerocopy_clone(to, from)))
+		return -EIO;
 
 	for (i = 0; i < skb_shinfo(from)->nr_frags; i++) {
 		if (!len)
@@ -2454,6 +2761,11 @@ void skb_split(struct sk_buff *skb, struct sk_buff *skb1, const u32 len)
 		skb_split_inside_header(skb, skb1, len, pos);
 	else		/* Second chunk has no header, nothing to copy. */
 		skb_split_no_header(skb, skb1, len, pos);
+
+	/* MSG_ZEROCOPY user pages moved over keep their notification pending */
+	if (skb_shinfo(skb1)->nr_frags && skb_zcopy(skb) &&
+	    skb_zcopy_uarg(skb)->callback == sock_zerocopy_callback)
+		skb_zcopy_set(skb1, skb_zcopy_uarg(skb));
 }
 EXPORT_SYMBOL(skb_split);
 
@@ -2492,6 +2804,10 @@ int skb_shift(struct sk_buff *tgt, struct sk_buff *skb, int shiftlen)
 	BUG_ON(shiftlen > skb->len);
 	BUG_ON(skb_headlen(skb));	/* Would corrupt stream */
 
+	/* MSG_ZEROCOPY pages must stay with the skbs holding their notification */
+	if (skb_zcopy(skb) && skb_zcopy_uarg(tgt) != skb_zcopy_uarg(skb))
+		return 0;
+
 	todo = shiftlen;
 	from = 0;
 	to = skb_shinfo(tgt)->nr_frags;
@@ -3016,7 +3332,8 @@ struct sk_buff *skb_segment(struct sk_buff *head_skb,
 				goto err;
 			}
 
-			if (unlikely(skb_orphan_frags(frag_skb, GFP_ATOMIC)))
+			if (unlikely(skb_orphan_frags(frag_skb, GFP_ATOMIC) ||
+				     skb_zerocopy_clone(nskb, frag_skb)))
 				goto err;
 
 			*nskb_frag = *frag;
@@ -3228,6 +3545,7 @@ void __init skb_init(void)
 						0,
 						SLAB_HWCACHE_ALIGN|SLAB_PANIC,
 						NULL);
+	hotcpu_notifier(skb_head_cache_cpu_callback, 0);
 }
 
 /**
@@ -3939,6 +4257,9 @@ unsigned int skb_gso_transport_seglen(const struct sk_buff *skb)
 	if (likely(shinfo->gso_type & (SKB_GSO_TCPV4 | SKB_GSO_TCPV6)))
 		return tcp_hdrlen(skb) + shinfo->gso_size;
 
+	if (shinfo->gso_type & SKB_GSO_UDP_L4)
+		return sizeof(struct udphdr) + shinfo->gso_size;
+
 	/* UFO sets gso_size to the size of the fragmentation
 	 * payload, i.e. the size of the L4 (UDP) header is already
 	 * accounted for.
@@ -322,7 +322,10 @@ struct sock *inet_csk_accept(struct sock *sk, int flags, int *err)
 		if (error)
 			goto out_err;
 	}
-	req = reqsk_queue_remove(queue);
+	if (queue->rskq_cpu_affinity)
+		req = reqsk_queue_remove_cpu(queue, raw_smp_processor_id());
+	else
+		req = reqsk_queue_remove(queue);
 	newsk = req->sk;
 
 	sk_acceptq_removed(sk);
@@ -14,6 +14,7 @@
  */
 
 #include <linux/module.h>
+#include <linux/prefetch.h>
 #include <linux/random.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
@@ -23,6 +24,8 @@
 #include <net/inet_hashtables.h>
 #include <net/secure_seq.h>
 #include <net/ip.h>
+#include <net/ipv6.h>
+#include <net/sock_reuseport.h>
 
 static unsigned int inet_ehashfn(struct net *net, const __be32 laddr,
 				 const __u16 lport, const __be32 faddr,
@@ -209,12 +212,15 @@ struct sock *__inet_lookup_listener(struct net *net,
 	struct hlist_nulls_node *node;
 	unsigned int hash = inet_lhashfn(net, hnum);
 	struct inet_listen_hashbucket *ilb = &hashinfo->listening_hash[hash];
+	struct sock *reuse_sk;
 	int score, hiscore, matches = 0, reuseport = 0;
-	u32 phash = 0;
+	bool select_ok = true;
+	u32 phash = 0, reuse_hash = 0;
 
 	rcu_read_lock();
 begin:
 	result = NULL;
+	reuse_sk = NULL;
 	hiscore = 0;
 	sk_nulls_for_each_rcu(sk, node, &ilb->head) {
 		score = compute_score(sk, net, hnum, daddr, dif);
@@ -222,9 +228,12 @@ begin:
 			result = sk;
 			hiscore = score;
 			reuseport = sk->sk_reuseport;
+			reuse_sk = NULL;
 			if (reuseport) {
 				phash = inet_ehashfn(net, daddr, hnum,
 						     saddr, sport);
+				reuse_sk = sk;
+				reuse_hash = phash;
 				matches = 1;
 			}
 		} else if (score == hiscore && reuseport) {
@@ -241,12 +250,23 @@ begin:
 	 */
 	if (get_nulls_value(node) != hash + LISTENING_NULLS_BASE)
 		goto begin;
+	/*
+	 * Only pick from the SO_REUSEPORT group once the whole chain has been
+	 * scored: a listener bound to daddr or to a device may come later.
+	 */
+	if (reuse_sk && select_ok) {
+		struct sock *sk2 = reuseport_select_sock(reuse_sk, reuse_hash);
+
+		if (sk2)
+			result = sk2;
+	}
 	if (result) {
 		if (unlikely(!atomic_inc_not_zero(&result->sk_refcnt)))
 			result = NULL;
 		else if (unlikely(compute_score(result, net, hnum, daddr,
 				  dif) < hiscore)) {
 			sock_put(result);
+			select_ok = false;
 			goto begin;
 		}
 	}
@@ -317,6 +337,21 @@ found:
 }
 EXPORT_SYMBOL_GPL(__inet_lookup_established);
 
+/* Warm the established hash bucket a later __inet_lookup_established()
+ * for this 4-tuple will read, so that callers holding a batch of
+ * packets (GRO) can overlap the bucket cache miss with the rest of
+ * their work instead of paying it serially at demux time.
+ */
+void inet_ehash_prefetch(struct net *net, struct inet_hashinfo *hashinfo,
+			 const __be32 saddr, const __be16 sport,
+			 const __be32 daddr, const u16 hnum)
+{
+	unsigned int hash = inet_ehashfn(net, daddr, hnum, saddr, sport);
+
+	prefetch(&hashinfo->ehash[hash & hashinfo->ehash_mask]);
+}
+EXPORT_SYMBOL_GPL(inet_ehash_prefetch);
+
 /* called with local bh disabled */
 static int __inet_check_established(struct inet_timewait_death_row *death_row,
 				    struct sock *sk, __u16 lport,
@@ -423,6 +458,46 @@ int __inet_hash_nolisten(struct sock *sk, struct inet_timewait_sock *tw)
 }
 EXPORT_SYMBOL_GPL(__inet_hash_nolisten);
 
+bool inet_rcv_saddr_same(const struct sock *sk, const struct sock *sk2)
+{
+#if IS_ENABLED(CONFIG_IPV6)
+	if (sk->sk_family == AF_INET6)
+		return ipv6_addr_equal(&sk->sk_v6_rcv_saddr,
+				       &sk2->sk_v6_rcv_saddr);
+#endif
+	return inet_sk(sk)->inet_rcv_saddr == inet_sk(sk2)->inet_rcv_saddr;
+}
+EXPORT_SYMBOL_GPL(inet_rcv_saddr_same);
+
+/*
+ * Put a SO_REUSEPORT listener about to be hashed into the group of the
+ * listeners bound to exactly the same address and port, or start one.
+ * Called with the listening bucket locked. On failure the listener is
+ * still hashed and simply found by the scoring walk in the lookup.
+ */
+int inet_reuseport_add_sock(struct sock *sk, struct inet_listen_hashbucket *ilb)
+{
+	struct net *net = sock_net(sk);
+	kuid_t uid = sock_i_uid(sk);
+	struct hlist_nulls_node *node;
+	struct sock *sk2;
+
+	sk_nulls_for_each(sk2, node, &ilb->head) {
+		if (net_eq(sock_net(sk2), net) &&
+		    sk2 != sk &&
+		    sk2->sk_family == sk->sk_family &&
+		    ipv6_only_sock(sk2) == ipv6_only_sock(sk) &&
+		    inet_sk(sk2)->inet_num == inet_sk(sk)->inet_num &&
+		    sk2->sk_bound_dev_if == sk->sk_bound_dev_if &&
+		    sk2->sk_reuseport && uid_eq(uid, sock_i_uid(sk2)) &&
+		    inet_rcv_saddr_same(sk, sk2))
+			return reuseport_add_sock(sk, sk2);
+	}
+
+	return reuseport_alloc(sk);
+}
+EXPORT_SYMBOL_GPL(inet_reuseport_add_sock);
+
 static void __inet_hash(struct sock *sk)
 {
 	struct inet_hashinfo *hashinfo = sk->sk_prot->h.hashinfo;
@@ -437,6 +512,8 @@ static void __inet_hash(struct sock *sk)
 	ilb = &hashinfo->listening_hash[inet_sk_listen_hashfn(sk)];
 
 	spin_lock(&ilb->lock);
+	if (sk->sk_reuseport)
+		inet_reuseport_add_sock(sk, ilb);
 	__sk_nulls_add_node_rcu(sk, &ilb->head);
 	sock_prot_inuse_add(sock_net(sk), sk->sk_prot, 1);
 	spin_unlock(&ilb->lock);
@@ -467,6 +544,8 @@ void inet_unhash(struct sock *sk)
 		lock = inet_ehash_lockp(hashinfo, sk->sk_hash);
 
 	spin_lock_bh(lock);
+	if (rcu_access_pointer(sk->sk_reuseport_cb))
+		reuseport_detach_sock(sk);
 	done = __sk_nulls_del_node_init_rcu(sk);
 	if (done)
 		sock_prot_inuse_add(sock_net(sk), sk->sk_prot, -1);
@@ -402,6 +402,9 @@ void tcp_init_sock(struct sock *sk)
 	tp->snd_ssthresh = TCP_INFINITE_SSTHRESH;
 	tp->snd_cwnd_clamp = ~0;
 	tp->mss_cache = TCP_MSS_DEFAULT;
+	tp->app_limited = ~0U;
+	hrtimer_init(&tp->autocork_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	tp->autocork_timer.function = tcp_autocork_kick;
 
 	tp->reordering = sysctl_tcp_reordering;
 	tcp_enable_early_retrans(tp);
@@ -523,7 +526,7 @@ unsigned int tcp_poll(struct file *file, struct socket *sock, poll_table *wait)
 	}
 	/* This barrier is coupled with smp_wmb() in tcp_reset() */
 	smp_rmb();
-	if (sk->sk_err)
+	if (sk->sk_err || !skb_queue_empty(&sk->sk_error_queue))
 		mask |= POLLERR;
 
 	return mask;
@@ -640,6 +643,28 @@ static bool tcp_should_autocork(struct sock *sk, struct sk_buff *skb,
 	       atomic_read(&sk->sk_wmem_alloc) > skb->truesize;
 }
 
+/* With TCP_AUTOCORK_USECS, a not yet filled skb is also held back when
+ * no TX completion is pending, for at most autocork_usecs counted from
+ * the first write that was held. Filling the skb up to size_goal, or a
+ * TX completion, sends it right away; otherwise tcp_autocork_kick()
+ * flushes it once the window expires.
+ */
+static bool tcp_autocork_window(struct sock *sk, struct sk_buff *skb,
+				int nonagle, int size_goal)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	if (!tp->autocork_usecs || skb->len >= size_goal ||
+	    (nonagle & TCP_NAGLE_PUSH))
+		return false;
+
+	if (!hrtimer_is_queued(&tp->autocork_timer))
+		hrtimer_start(&tp->autocork_timer,
+			      ns_to_ktime(tp->autocork_usecs * NSEC_PER_USEC),
+			      HRTIMER_MODE_REL);
+	return true;
+}
+
 static void tcp_push(struct sock *sk, int flags, int mss_now,
 		     int nonagle, int size_goal)
 {
@@ -669,6 +694,10 @@ static void tcp_push(struct sock *sk, int flags, int mss_now,
 			return;
 	}
 
+	if (!(flags & (MSG_MORE | MSG_OOB)) && !forced_push(tp) &&
+	    tcp_autocork_window(sk, skb, nonagle, size_goal))
+		return;
+
 	if (flags & MSG_MORE)
 		nonagle = TCP_NAGLE_CORK;
 
@@ -897,6 +926,8 @@ static ssize_t do_tcp_sendpages(struct sock *sk, struct page *page, int offset,
 			goto out_err;
 	}
 
+	tcp_rate_check_app_limited(sk);  /* is sending application-limited? */
+
 	clear_bit(SOCK_ASYNC_NOSPACE, &sk->sk_socket->flags);
 
 	mss_now = tcp_send_mss(sk, &size_goal, flags);
@@ -1070,15 +1101,58 @@ static int tcp_sendmsg_fastopen(struct sock *sk, struct msghdr *msg,
 	return err;
 }
 
+/*
+ * Attach up to @len bytes of user memory at @from to @skb as page frags for
+ * a MSG_ZEROCOPY send, pinning the pages instead of copying them. @skb must
+ * have a free frag slot. Returns the number of bytes attached, or -EFAULT.
+ */
+static int tcp_zerocopy_pin_pages(struct sock *sk, struct sk_buff *skb,
+				  unsigned char __user *from, int len)
+{
+	struct page *pages[MAX_SKB_FRAGS];
+	unsigned long base = (unsigned long)from;
+	int i = skb_shinfo(skb)->nr_frags;
+	int j, n, npages, copied = 0;
+
+	npages = min_t(int, MAX_SKB_FRAGS - i,
+		       DIV_ROUND_UP((base & ~PAGE_MASK) + len, PAGE_SIZE));
+	n = get_user_pages_fast(base, npages, 0, pages);
+	if (n <= 0)
+		return -EFAULT;
+
+	for (j = 0; j < n; j++) {
+		int off = base & ~PAGE_MASK;
+		int size = min_t(int, len - copied, PAGE_SIZE - off);
+
+		if (skb_can_coalesce(skb, i, pages[j], off)) {
+			skb_frag_size_add(&skb_shinfo(skb)->frags[i - 1], size);
+			put_page(pages[j]);
+		} else {
+			skb_fill_page_desc(skb, i++, pages[j], off, size);
+		}
+		base += size;
+		copied += size;
+	}
+
+	skb->len += copied;
+	skb->data_len += copied;
+	skb->truesize += copied;
+	sk->sk_wmem_queued += copied;
+	sk_mem_charge(sk, copied);
+
+	return copied;
+}
+
 int tcp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 		size_t size)
 {
 	struct iovec *iov;
 	struct tcp_sock *tp = tcp_sk(sk);
+	struct ubuf_info *uarg = NULL;
 	struct sk_buff *skb;
 	int iovlen, flags, err, copied = 0;
 	int mss_now = 0, size_goal, copied_syn = 0, offset = 0;
-	bool sg;
+	bool sg, zc = false;
 	long timeo;
 
 	lock_sock(sk);
@@ -1118,6 +1192,8 @@ int tcp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 		/* 'common' sending to sendq */
 	}
 
+	tcp_rate_check_app_limited(sk);  /* is sending application-limited? */
+
 	/* This should be in poll */
 	clear_bit(SOCK_ASYNC_NOSPACE, &sk->sk_socket->flags);
 
@@ -1134,6 +1210,20 @@ int tcp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 
 	sg = !!(sk->sk_route_caps & NETIF_F_SG);
 
+	if ((flags & MSG_ZEROCOPY) && size) {
+		err = -ENOBUFS;
+		uarg = sock_zerocopy_alloc(sk);
+		if (!uarg)
+			goto out_err;
+
+		/* Without these the pages would be copied for checksumming
+		 * anyway. Copy up front and only report completion.
+		 */
+		zc = sg && (sk->sk_route_caps & NETIF_F_ALL_CSUM);
+		if (!zc)
+			uarg->zerocopy = false;
+	}
+
 	while (--iovlen >= 0) {
 		size_t seglen = iov->iov_len;
 		unsigned char __user *from = iov->iov_base;
@@ -1197,7 +1287,25 @@ new_segment:
 				copy = seglen;
 
 			/* Where to copy to? */
-			if (skb_availroom(skb) > 0) {
+			if (zc) {
+				/* An skb only carries one send's notification */
+				if ((skb_zcopy(skb) && skb_zcopy_uarg(skb) != uarg) ||
+				    skb_shinfo(skb)->nr_frags == MAX_SKB_FRAGS) {
+					tcp_mark_push(tp, skb);
+					goto new_segment;
+				}
+
+				if (!sk_wmem_schedule(sk, copy))
+					goto wait_for_memory;
+
+				err = tcp_zerocopy_pin_pages(sk, skb, from, copy);
+				if (err < 0)
+					goto do_fault;
+				copy = err;
+
+				if (!skb_zcopy(skb))
+					skb_zcopy_set(skb, uarg);
+			} else if (skb_availroom(skb) > 0) {
 				/* We have some space in skb head. Superb! */
 				copy = min_t(int, copy, skb_availroom(skb));
 				err = skb_add_data_nocache(sk, skb, from, copy);
@@ -1282,6 +1390,7 @@ wait_for_memory:
 out:
 	if (copied)
 		tcp_push(sk, flags, mss_now, tp->nonagle, size_goal);
+	sock_zerocopy_put(uarg);
 	release_sock(sk);
 	return copied + copied_syn;
 
@@ -1299,6 +1408,7 @@ do_error:
 	if (copied + copied_syn)
 		goto out;
 out_err:
+	sock_zerocopy_put_abort(uarg);
 	err = sk_stream_error(sk, flags, err);
 	release_sock(sk);
 	return err;
@@ -1616,6 +1726,9 @@ int tcp_recvmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 	struct sk_buff *skb;
 	u32 urg_hole = 0;
 
+	if (unlikely(flags & MSG_ERRQUEUE))
+		return inet_recv_error(sk, msg, len, addr_len);
+
 	if (sk_can_busy_loop(sk) && skb_queue_empty(&sk->sk_receive_queue) &&
 	    (sk->sk_state == TCP_ESTABLISHED))
 		sk_busy_loop(sk, nonblock);
@@ -2698,6 +2811,15 @@ static int do_tcp_setsockopt(struct sock *sk, int level,
 		tp->notsent_lowat = val;
 		sk->sk_write_space(sk);
 		break;
+	case TCP_ACCEPT_AFFINITY:
+		icsk->icsk_accept_queue.rskq_cpu_affinity = !!val;
+		break;
+	case TCP_AUTOCORK_USECS:
+		if (val < 0 || val > TCP_AUTOCORK_MAX_USECS)
+			err = -EINVAL;
+		else
+			tp->autocork_usecs = val;
+		break;
 	default:
 		err = -ENOPROTOOPT;
 		break;
@@ -2922,6 +3044,12 @@ static int do_tcp_getsockopt(struct sock *sk, int level,
 	case TCP_NOTSENT_LOWAT:
 		val = tp->notsent_lowat;
 		break;
+	case TCP_ACCEPT_AFFINITY:
+		val = icsk->icsk_accept_queue.rskq_cpu_affinity;
+		break;
+	case TCP_AUTOCORK_USECS:
+		val = tp->autocork_usecs;
+		break;
 	default:
 		return -ENOPROTOOPT;
 	}
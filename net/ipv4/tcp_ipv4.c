@@ -86,6 +86,8 @@
 #include <linux/crypto.h>
 #include <linux/scatterlist.h>
 
+#include <crypto/algapi.h>
+
 int sysctl_tcp_tw_reuse __read_mostly;
 int sysctl_tcp_low_latency __read_mostly;
 EXPORT_SYMBOL(sysctl_tcp_low_latency);
@@ -1322,8 +1324,8 @@ static bool tcp_fastopen_check(struct sock *sk, struct sk_buff *skb,
 			tcp_fastopen_cookie_gen(ip_hdr(skb)->saddr,
 						ip_hdr(skb)->daddr, valid_foc);
 			if ((valid_foc->len != TCP_FASTOPEN_COOKIE_SIZE) ||
-			    memcmp(&foc->val[0], &valid_foc->val[0],
-			    TCP_FASTOPEN_COOKIE_SIZE) != 0)
+			    crypto_memneq(&foc->val[0], &valid_foc->val[0],
+					  TCP_FASTOPEN_COOKIE_SIZE))
 				return false;
 			valid_foc->len = -1;
 		}
@@ -91,7 +91,20 @@ struct tcpm_hash_bucket {
 	struct tcp_metrics_block __rcu	*chain;
 };
 
-static DEFINE_SPINLOCK(tcp_metrics_lock);
+/* Writers (new entries, reclaim, netlink removal) serialize per hash
+ * chain on one of these locks rather than on a single global lock, so
+ * connections to distinct peers can populate the cache in parallel.
+ * Metric updates themselves run under RCU only.
+ */
+#define TCP_METRICS_LOCKS_LOG	8
+#define TCP_METRICS_LOCKS	(1U << TCP_METRICS_LOCKS_LOG)
+
+static spinlock_t tcp_metrics_locks[TCP_METRICS_LOCKS] ____cacheline_aligned_in_smp;
+
+static spinlock_t *tcpm_hash_lock(unsigned int hash)
+{
+	return &tcp_metrics_locks[hash & (TCP_METRICS_LOCKS - 1)];
+}
 
 static void tcpm_suck_dst(struct tcp_metrics_block *tm,
 			  const struct dst_entry *dst,
@@ -152,7 +165,7 @@ static struct tcp_metrics_block *tcpm_new(struct dst_entry *dst,
 	struct net *net;
 	bool reclaim = false;
 
-	spin_lock_bh(&tcp_metrics_lock);
+	spin_lock_bh(tcpm_hash_lock(hash));
 	net = dev_net(dst->dev);
 
 	/* While waiting for the spin-lock the cache might have been populated
@@ -194,7 +207,7 @@ static struct tcp_metrics_block *tcpm_new(struct dst_entry *dst,
 	}
 
 out_unlock:
-	spin_unlock_bh(&tcp_metrics_lock);
+	spin_unlock_bh(tcpm_hash_lock(hash));
 	return tm;
 }
 
@@ -1017,9 +1030,9 @@ out_free:
 	return ret;
 }
 
-#define deref_locked_genl(p)	\
+#define deref_locked_genl(p, hash)	\
 	rcu_dereference_protected(p, lockdep_genl_is_held() && \
-				     lockdep_is_held(&tcp_metrics_lock))
+				     lockdep_is_held(tcpm_hash_lock(hash)))
 
 #define deref_genl(p)	rcu_dereference_protected(p, lockdep_genl_is_held())
 
@@ -1031,11 +1044,11 @@ static int tcp_metrics_flush_all(struct net *net)
 	unsigned int row;
 
 	for (row = 0; row < max_rows; row++, hb++) {
-		spin_lock_bh(&tcp_metrics_lock);
-		tm = deref_locked_genl(hb->chain);
+		spin_lock_bh(tcpm_hash_lock(row));
+		tm = deref_locked_genl(hb->chain, row);
 		if (tm)
 			hb->chain = NULL;
-		spin_unlock_bh(&tcp_metrics_lock);
+		spin_unlock_bh(tcpm_hash_lock(row));
 		while (tm) {
 			struct tcp_metrics_block *next;
 
@@ -1070,8 +1083,9 @@ static int tcp_metrics_nl_cmd_del(struct sk_buff *skb, struct genl_info *info)
 	hash = hash_32(hash, net->ipv4.tcp_metrics_hash_log);
 	hb = net->ipv4.tcp_metrics_hash + hash;
 	pp = &hb->chain;
-	spin_lock_bh(&tcp_metrics_lock);
-	for (tm = deref_locked_genl(*pp); tm; tm = deref_locked_genl(*pp)) {
+	spin_lock_bh(tcpm_hash_lock(hash));
+	for (tm = deref_locked_genl(*pp, hash); tm;
+	     tm = deref_locked_genl(*pp, hash)) {
 		if (addr_same(&tm->tcpm_daddr, &daddr) &&
 		    (!src || addr_same(&tm->tcpm_saddr, &saddr))) {
 			*pp = tm->tcpm_next;
@@ -1081,7 +1095,7 @@ static int tcp_metrics_nl_cmd_del(struct sk_buff *skb, struct genl_info *info)
 			pp = &tm->tcpm_next;
 		}
 	}
-	spin_unlock_bh(&tcp_metrics_lock);
+	spin_unlock_bh(tcpm_hash_lock(hash));
 	if (!found)
 		return -ESRCH;
 	return 0;
@@ -1126,7 +1140,9 @@ static int __net_init tcp_net_metrics_init(struct net *net)
 
 	slots = tcpmhash_entries;
 	if (!slots) {
-		if (totalram_pages >= 128 * 1024)
+		if (totalram_pages >= 1024 * 1024)
+			slots = 64 * 1024;
+		else if (totalram_pages >= 128 * 1024)
 			slots = 16 * 1024;
 		else
 			slots = 8 * 1024;
@@ -1172,8 +1188,12 @@ static __net_initdata struct pernet_operations tcp_net_metrics_ops = {
 
 void __init tcp_metrics_init(void)
 {
+	unsigned int i;
 	int ret;
 
+	for (i = 0; i < TCP_METRICS_LOCKS; i++)
+		spin_lock_init(&tcp_metrics_locks[i]);
+
 	ret = register_pernet_subsys(&tcp_net_metrics_ops);
 	if (ret < 0)
 		goto cleanup;
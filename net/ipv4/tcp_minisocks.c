@@ -419,6 +419,10 @@ struct sock *tcp_create_openreq_child(struct sock *sk, struct request_sock *req,
 		 */
 		newtp->snd_cwnd = TCP_INIT_CWND;
 		newtp->snd_cwnd_cnt = 0;
+		newtp->app_limited = ~0U;
+		hrtimer_init(&newtp->autocork_timer, CLOCK_MONOTONIC,
+			     HRTIMER_MODE_REL);
+		newtp->autocork_timer.function = tcp_autocork_kick;
 
 		if (newicsk->icsk_ca_ops != &tcp_init_congestion_ops &&
 		    !try_module_get(newicsk->icsk_ca_ops->owner))
@@ -269,10 +269,31 @@ static int tcp_v4_gso_send_check(struct sk_buff *skb)
 	return 0;
 }
 
+/* A segment that opened a new GRO flow is held until the end of the
+ * NAPI poll, after which ip_rcv_finish()/tcp_v4_rcv() look its socket up.
+ * Prefetch the established hash bucket now, so that the lookups for a
+ * whole poll's worth of flows hit warm buckets.
+ */
+static void tcp4_gro_prefetch_sk(struct sk_buff *skb, unsigned int thoff)
+{
+	const struct iphdr *iph = skb_gro_network_header(skb);
+	const struct tcphdr *th;
+
+	th = skb_gro_header_fast(skb, thoff);
+	if (skb_gro_header_hard(skb, thoff + sizeof(*th)))
+		th = (const struct tcphdr *)(skb->data + thoff);
+
+	inet_ehash_prefetch(dev_net(skb->dev), &tcp_hashinfo,
+			    iph->saddr, th->source, iph->daddr,
+			    ntohs(th->dest));
+}
+
 static struct sk_buff **tcp4_gro_receive(struct sk_buff **head, struct sk_buff *skb)
 {
 	/* Use the IP hdr immediately proceeding for this transport */
 	const struct iphdr *iph = skb_gro_network_header(skb);
+	unsigned int thoff = skb_gro_offset(skb);
+	struct sk_buff **pp;
 	__wsum wsum;
 
 	/* Don't bother verifying checksum if we're going to flush anyway. */
@@ -300,7 +321,11 @@ static struct sk_buff **tcp4_gro_receive(struct sk_buff **head, struct sk_buff *
 	}
 
 skip_csum:
-	return tcp_gro_receive(head, skb);
+	pp = tcp_gro_receive(head, skb);
+	if (!NAPI_GRO_CB(skb)->same_flow && !NAPI_GRO_CB(skb)->flush)
+		tcp4_gro_prefetch_sk(skb, thoff);
+
+	return pp;
 }
 
 static int tcp4_gro_complete(struct sk_buff *skb, int thoff)
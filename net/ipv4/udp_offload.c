@@ -13,6 +13,7 @@
 #include <linux/skbuff.h>
 #include <net/udp.h>
 #include <net/protocol.h>
+#include <net/sock.h>
 
 static DEFINE_SPINLOCK(udp_offload_lock);
 static struct udp_offload_priv __rcu *udp_offload_base __read_mostly;
@@ -47,6 +48,109 @@ static int udp4_ufo_send_check(struct sk_buff *skb)
 	return 0;
 }
 
+static void udp4_gso_set_check(struct sk_buff *skb, __sum16 check)
+{
+	struct udphdr *uh = udp_hdr(skb);
+
+	uh->check = check;
+	if (skb->ip_summed != CHECKSUM_PARTIAL) {
+		uh->check = csum_fold(csum_partial(uh, sizeof(*uh), skb->csum));
+		if (uh->check == 0)
+			uh->check = CSUM_MANGLED_0;
+	}
+}
+
+/* Split a UDP_SEGMENT datagram into gso_size sized datagrams, each with
+ * its own UDP header, the way tcp_gso_segment() splits a TSO packet.
+ */
+static struct sk_buff *udp4_gso_segment(struct sk_buff *skb,
+					netdev_features_t features)
+{
+	struct sk_buff *segs = ERR_PTR(-EINVAL);
+	unsigned int sum_truesize = 0;
+	struct sk_buff *gso_skb = skb;
+	struct udphdr *uh;
+	unsigned int oldlen;
+	unsigned int mss;
+	unsigned int len;
+	bool copy_destructor;
+	__sum16 newcheck;
+	__be32 delta;
+
+	if (!pskb_may_pull(skb, sizeof(*uh)))
+		goto out;
+
+	mss = skb_shinfo(skb)->gso_size;
+	if (unlikely(skb->len <= sizeof(*uh) + mss))
+		goto out;
+
+	if (skb_gso_ok(skb, features | NETIF_F_GSO_ROBUST)) {
+		/* Packet is from an untrusted source, reset gso_segs. */
+		int type = skb_shinfo(skb)->gso_type;
+
+		if (unlikely(type & ~(SKB_GSO_UDP_L4 | SKB_GSO_DODGY)))
+			goto out;
+
+		skb_shinfo(skb)->gso_segs = DIV_ROUND_UP(skb->len - sizeof(*uh),
+							 mss);
+
+		segs = NULL;
+		goto out;
+	}
+
+	oldlen = (u16)~skb->len;
+	__skb_pull(skb, sizeof(*uh));
+
+	copy_destructor = gso_skb->destructor == sock_wfree;
+
+	segs = skb_segment(skb, features);
+	if (IS_ERR(segs))
+		goto out;
+
+	delta = htonl(oldlen + (sizeof(*uh) + mss));
+
+	skb = segs;
+	uh = udp_hdr(skb);
+
+	newcheck = ~csum_fold((__force __wsum)((__force u32)uh->check +
+					       (__force u32)delta));
+
+	do {
+		uh->len = htons(sizeof(*uh) + mss);
+		udp4_gso_set_check(skb, newcheck);
+
+		if (copy_destructor) {
+			skb->destructor = gso_skb->destructor;
+			skb->sk = gso_skb->sk;
+			sum_truesize += skb->truesize;
+		}
+		skb = skb->next;
+		uh = udp_hdr(skb);
+	} while (skb->next);
+
+	/* Keep the send buffer charged until the last segment is freed,
+	 * not just until the GSO engine drops gso_skb.
+	 */
+	if (copy_destructor) {
+		swap(gso_skb->sk, skb->sk);
+		swap(gso_skb->destructor, skb->destructor);
+		sum_truesize += skb->truesize;
+		atomic_add(sum_truesize - gso_skb->truesize,
+			   &skb->sk->sk_wmem_alloc);
+	}
+
+	/* The last segment may be shorter than gso_size */
+	len = skb_tail_pointer(skb) - skb_transport_header(skb) +
+	      skb->data_len;
+	delta = htonl(oldlen + len);
+	uh->len = htons(len);
+	udp4_gso_set_check(skb, ~csum_fold((__force __wsum)
+					   ((__force u32)uh->check +
+					    (__force u32)delta)));
+out:
+	return segs;
+}
+
 static struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 					 netdev_features_t features)
 {
@@ -61,6 +165,11 @@ static struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 		goto out;
 	}
 
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4) {
+		segs = udp4_gso_segment(skb, features);
+		goto out;
+	}
+
 	mss = skb_shinfo(skb)->gso_size;
 	if (unlikely(skb->len <= mss))
 		goto out;
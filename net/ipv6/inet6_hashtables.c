@@ -22,6 +22,7 @@
 #include <net/inet6_hashtables.h>
 #include <net/secure_seq.h>
 #include <net/ip.h>
+#include <net/sock_reuseport.h>
 
 static unsigned int inet6_ehashfn(struct net *net,
 				  const struct in6_addr *laddr,
@@ -68,6 +69,8 @@ int __inet6_hash(struct sock *sk, struct inet_timewait_sock *tw)
 
 		ilb = &hashinfo->listening_hash[inet_sk_listen_hashfn(sk)];
 		spin_lock(&ilb->lock);
+		if (sk->sk_reuseport)
+			inet_reuseport_add_sock(sk, ilb);
 		__sk_nulls_add_node_rcu(sk, &ilb->head);
 		spin_unlock(&ilb->lock);
 	} else {
@@ -176,14 +179,17 @@ struct sock *inet6_lookup_listener(struct net *net,
 	struct sock *sk;
 	const struct hlist_nulls_node *node;
 	struct sock *result;
+	struct sock *reuse_sk;
 	int score, hiscore, matches = 0, reuseport = 0;
-	u32 phash = 0;
+	bool select_ok = true;
+	u32 phash = 0, reuse_hash = 0;
 	unsigned int hash = inet_lhashfn(net, hnum);
 	struct inet_listen_hashbucket *ilb = &hashinfo->listening_hash[hash];
 
 	rcu_read_lock();
 begin:
 	result = NULL;
+	reuse_sk = NULL;
 	hiscore = 0;
 	sk_nulls_for_each(sk, node, &ilb->head) {
 		score = compute_score(sk, net, hnum, daddr, dif);
@@ -191,9 +197,12 @@ begin:
 			hiscore = score;
 			result = sk;
 			reuseport = sk->sk_reuseport;
+			reuse_sk = NULL;
 			if (reuseport) {
 				phash = inet6_ehashfn(net, daddr, hnum,
 						      saddr, sport);
+				reuse_sk = sk;
+				reuse_hash = phash;
 				matches = 1;
 			}
 		} else if (score == hiscore && reuseport) {
@@ -210,12 +219,23 @@ begin:
 	 */
 	if (get_nulls_value(node) != hash + LISTENING_NULLS_BASE)
 		goto begin;
+	/*
+	 * Only pick from the SO_REUSEPORT group once the whole chain has been
+	 * scored: a listener bound to daddr or to a device may come later.
+	 */
+	if (reuse_sk && select_ok) {
+		struct sock *sk2 = reuseport_select_sock(reuse_sk, reuse_hash);
+
+		if (sk2)
+			result = sk2;
+	}
 	if (result) {
 		if (unlikely(!atomic_inc_not_zero(&result->sk_refcnt)))
 			result = NULL;
 		else if (unlikely(compute_score(result, net, hnum, daddr,
 				  dif) < hiscore)) {
 			sock_put(result);
+			select_ok = false;
 			goto begin;
 		}
 	}
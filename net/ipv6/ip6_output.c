@@ -453,7 +453,12 @@ int ip6_forward(struct sk_buff *skb)
 		else
 			target = &hdr->daddr;
 
-		peer = inet_getpeer_v6(net->ipv6.peers, &rt->rt6i_dst.addr, 1);
+		/* A per-CPU copy still carries its parent's prefix, rate
+		 * limit by the real destination instead.
+		 */
+		peer = inet_getpeer_v6(net->ipv6.peers,
+				       rt->rt6i_flags & RTF_PCPU ?
+				       &hdr->daddr : &rt->rt6i_dst.addr, 1);
 
 		/* Limit redirects both by destination (here)
 		   and by source (inside ndisc_send_redirect)
@@ -329,6 +329,8 @@ static void ip6_dst_destroy(struct dst_entry *dst)
 	if (!(rt->dst.flags & DST_HOST))
 		dst_destroy_metrics_generic(dst);
 
+	free_percpu(rt->rt6i_pcpu);
+
 	if (idev) {
 		rt->rt6i_idev = NULL;
 		in6_dev_put(idev);
@@ -914,6 +916,77 @@ static struct rt6_info *rt6_alloc_clone(struct rt6_info *ort,
 	return rt;
 }
 
+static struct rt6_info *ip6_rt_pcpu_alloc(struct rt6_info *ort)
+{
+	struct net *net = dev_net(ort->dst.dev);
+	struct rt6_info *rt = ip6_dst_alloc(net, ort->dst.dev, DST_NOCOUNT,
+					    ort->rt6i_table);
+
+	if (rt) {
+		rt->dst.input = ort->dst.input;
+		rt->dst.output = ort->dst.output;
+		rt->dst.error = ort->dst.error;
+		rt->dst.lastuse = jiffies;
+
+		rt->rt6i_dst = ort->rt6i_dst;
+		rt->rt6i_idev = ort->rt6i_idev;
+		if (rt->rt6i_idev)
+			in6_dev_hold(rt->rt6i_idev);
+		rt->rt6i_gateway = ort->rt6i_gateway;
+		rt->rt6i_flags = ort->rt6i_flags | RTF_PCPU;
+		rt6_set_from(rt, ort);
+		dst_init_metrics(&rt->dst, dst_metrics_ptr(&ort->dst), true);
+		rt->rt6i_metric = ort->rt6i_metric;
+		rt->rt6i_protocol = ort->rt6i_protocol;
+
+#ifdef CONFIG_IPV6_SUBTREES
+		rt->rt6i_src = ort->rt6i_src;
+#endif
+		rt->rt6i_prefsrc = ort->rt6i_prefsrc;
+		rt->rt6i_table = ort->rt6i_table;
+		rt->rt6i_node = ort->rt6i_node;
+	}
+	return rt;
+}
+
+/*
+ * Return this CPU's copy of a forwarding route, creating it if needed.
+ * Called with tb6_lock held for reading, which keeps rt6_free_pcpu()
+ * away and BHs disabled.
+ */
+static struct rt6_info *rt6_get_pcpu_route(struct rt6_info *rt)
+{
+	struct rt6_info **p = this_cpu_ptr(rt->rt6i_pcpu);
+
+	if (!*p)
+		*p = ip6_rt_pcpu_alloc(rt);
+	return *p;
+}
+
+/*
+ * Drop the per-CPU copies of a route leaving the tree. Holders of a copy
+ * keep it alive, but ip6_dst_check() fails on it once rt6i_node is gone.
+ * Called with tb6_lock held for writing.
+ */
+void rt6_free_pcpu(struct rt6_info *rt)
+{
+	int cpu;
+
+	if (!rt->rt6i_pcpu)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct rt6_info **p = per_cpu_ptr(rt->rt6i_pcpu, cpu);
+		struct rt6_info *pcpu_rt = *p;
+
+		if (pcpu_rt) {
+			*p = NULL;
+			pcpu_rt->rt6i_node = NULL;
+			dst_free(&pcpu_rt->dst);
+		}
+	}
+}
+
 static struct rt6_info *ip6_pol_route(struct net *net, struct fib6_table *table, int oif,
 				      struct flowi6 *fl6, int flags)
 {
@@ -941,6 +1014,22 @@ restart:
 	    rt->rt6i_flags & RTF_CACHE)
 		goto out;
 
+	/*
+	 * Forwarding through a gateway route only needs the route itself,
+	 * so hand out this CPU's copy rather than cloning a host entry
+	 * into the tree per destination.
+	 */
+	if ((flags & RT6_LOOKUP_F_PCPU) && rt->rt6i_pcpu &&
+	    (rt->rt6i_flags & RTF_GATEWAY) && !(rt->dst.flags & DST_HOST)) {
+		nrt = rt6_get_pcpu_route(rt);
+		if (nrt) {
+			rt = nrt;
+			dst_hold(&rt->dst);
+			read_unlock_bh(&table->tb6_lock);
+			goto out2;
+		}
+	}
+
 	dst_hold(&rt->dst);
 	read_unlock_bh(&table->tb6_lock);
 
@@ -988,7 +1077,8 @@ out2:
 static struct rt6_info *ip6_pol_route_input(struct net *net, struct fib6_table *table,
 					    struct flowi6 *fl6, int flags)
 {
-	return ip6_pol_route(net, table, fl6->flowi6_iif, fl6, flags);
+	return ip6_pol_route(net, table, fl6->flowi6_iif, fl6,
+			     flags | RT6_LOOKUP_F_PCPU);
 }
 
 static struct dst_entry *ip6_route_input_lookup(struct net *net,
@@ -1519,6 +1609,18 @@ int ip6_route_add(struct fib6_config *cfg)
 		goto out;
 	}
 
+	/* RA routes are added from softirq, where alloc_percpu() can't
+	 * be used; they keep being cloned on lookup.
+	 */
+	if ((cfg->fc_flags & RTF_GATEWAY) && !(cfg->fc_flags & RTF_ADDRCONF) &&
+	    cfg->fc_dst_len != 128) {
+		rt->rt6i_pcpu = alloc_percpu(struct rt6_info *);
+		if (!rt->rt6i_pcpu) {
+			err = -ENOMEM;
+			goto out;
+		}
+	}
+
 	if (cfg->fc_flags & RTF_EXPIRES)
 		rt6_set_expires(rt, jiffies +
 				clock_t_to_jiffies(cfg->fc_expires));
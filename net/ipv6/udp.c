@@ -50,6 +50,7 @@
 
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
+#include <net/sock_reuseport.h>
 #include <trace/events/skb.h>
 #include "udp_impl.h"
 
@@ -223,11 +224,14 @@ static struct sock *udp6_lib_lookup2(struct net *net,
 {
 	struct sock *sk, *result;
 	struct hlist_nulls_node *node;
+	struct sock *reuse_sk;
 	int score, badness, matches = 0, reuseport = 0;
-	u32 hash = 0;
+	bool select_ok = true;
+	u32 hash = 0, reuse_hash = 0;
 
 begin:
 	result = NULL;
+	reuse_sk = NULL;
 	badness = -1;
 	udp_portaddr_for_each_entry_rcu(sk, node, &hslot2->head) {
 		score = compute_score2(sk, net, saddr, sport,
@@ -236,9 +240,12 @@ begin:
 			result = sk;
 			badness = score;
 			reuseport = sk->sk_reuseport;
+			reuse_sk = NULL;
 			if (reuseport) {
 				hash = udp6_ehashfn(net, daddr, hnum,
 						    saddr, sport);
+				reuse_sk = sk;
+				reuse_hash = hash;
 				matches = 1;
 			} else if (score == SCORE2_MAX)
 				goto exact_match;
@@ -256,7 +263,16 @@ begin:
 	 */
 	if (get_nulls_value(node) != slot2)
 		goto begin;
+	/*
+	 * Only pick from the SO_REUSEPORT group once the whole chain has been
+	 * scored: a connected or more specifically bound socket may come later.
+	 */
+	if (reuse_sk && select_ok) {
+		struct sock *sk2 = reuseport_select_sock(reuse_sk, reuse_hash);
 
+		if (sk2)
+			result = sk2;
+	}
 	if (result) {
 exact_match:
 		if (unlikely(!atomic_inc_not_zero_hint(&result->sk_refcnt, 2)))
@@ -264,6 +280,7 @@ exact_match:
 		else if (unlikely(compute_score2(result, net, saddr, sport,
 				  daddr, hnum, dif) < badness)) {
 			sock_put(result);
+			select_ok = false;
 			goto begin;
 		}
 	}
@@ -280,8 +297,10 @@ struct sock *__udp6_lib_lookup(struct net *net,
 	unsigned short hnum = ntohs(dport);
 	unsigned int hash2, slot2, slot = udp_hashfn(net, hnum, udptable->mask);
 	struct udp_hslot *hslot2, *hslot = &udptable->hash[slot];
+	struct sock *reuse_sk;
 	int score, badness, matches = 0, reuseport = 0;
-	u32 hash = 0;
+	bool select_ok = true;
+	u32 hash = 0, reuse_hash = 0;
 
 	rcu_read_lock();
 	if (hslot->count > 10) {
@@ -310,6 +329,7 @@ struct sock *__udp6_lib_lookup(struct net *net,
 	}
 begin:
 	result = NULL;
+	reuse_sk = NULL;
 	badness = -1;
 	sk_nulls_for_each_rcu(sk, node, &hslot->head) {
 		score = compute_score(sk, net, hnum, saddr, sport, daddr, dport, dif);
@@ -317,9 +337,12 @@ begin:
 			result = sk;
 			badness = score;
 			reuseport = sk->sk_reuseport;
+			reuse_sk = NULL;
 			if (reuseport) {
 				hash = udp6_ehashfn(net, daddr, hnum,
 						    saddr, sport);
+				reuse_sk = sk;
+				reuse_hash = hash;
 				matches = 1;
 			}
 		} else if (score == badness && reuseport) {
@@ -336,13 +359,23 @@ begin:
 	 */
 	if (get_nulls_value(node) != slot)
 		goto begin;
+	/*
+	 * Only pick from the SO_REUSEPORT group once the whole chain has been
+	 * scored: a connected or more specifically bound socket may come later.
+	 */
+	if (reuse_sk && select_ok) {
+		struct sock *sk2 = reuseport_select_sock(reuse_sk, reuse_hash);
 
+		if (sk2)
+			result = sk2;
+	}
 	if (result) {
 		if (unlikely(!atomic_inc_not_zero_hint(&result->sk_refcnt, 2)))
 			result = NULL;
 		else if (unlikely(compute_score(result, net, hnum, saddr, sport,
 					daddr, dport, dif) < badness)) {
 			sock_put(result);
+			select_ok = false;
 			goto begin;
 		}
 	}
@@ -399,8 +432,8 @@ int udpv6_recvmsg(struct kiocb *iocb, struct sock *sk,
 		return ipv6_recv_rxpmtu(sk, msg, len, addr_len);
 
 try_again:
-	skb = __skb_recv_datagram(sk, flags | (noblock ? MSG_DONTWAIT : 0),
-				  &peeked, &off, &err);
+	skb = __skb_recv_udp(sk, flags | (noblock ? MSG_DONTWAIT : 0),
+			     &peeked, &off, &err);
 	if (!skb)
 		goto out;
 
@@ -500,7 +533,7 @@ out:
 
 csum_copy_err:
 	slow = lock_sock_fast(sk);
-	if (!skb_kill_datagram(sk, skb, flags)) {
+	if (!__skb_kill_datagram(sk, &udp_sk(sk)->reader_queue, skb, flags)) {
 		if (is_udp4) {
 			UDP_INC_STATS_USER(sock_net(sk),
 					UDP_MIB_CSUMERRORS, is_udplite);
@@ -1327,6 +1360,7 @@ void udpv6_destroy_sock(struct sock *sk)
 	struct udp_sock *up = udp_sk(sk);
 	lock_sock(sk);
 	udp_v6_flush_pending_frames(sk);
+	skb_queue_purge(&up->reader_queue);
 	release_sock(sk);
 
 	if (static_key_false(&udpv6_encap_needed) && up->encap_type) {
@@ -1450,6 +1484,7 @@ struct proto udpv6_prot = {
 	.connect	   = ip6_datagram_connect,
 	.disconnect	   = udp_disconnect,
 	.ioctl		   = udp_ioctl,
+	.init		   = udp_init_sock,
 	.destroy	   = udpv6_destroy_sock,
 	.setsockopt	   = udpv6_setsockopt,
 	.getsockopt	   = udpv6_getsockopt,
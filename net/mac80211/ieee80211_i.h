@@ -227,6 +227,12 @@ struct ieee80211_rx_data {
 
 	u32 tkip_iv32;
 	u16 tkip_iv16;
+
+	/*
+	 * Frames for the local stack are queued here and passed up
+	 * once the RX handlers have run, see ieee80211_rx_handlers().
+	 */
+	struct sk_buff_head *list;
 };
 
 struct beacon_data {
@@ -220,8 +220,11 @@ u32 ieee80211_reset_erp_info(struct ieee80211_sub_if_data *sdata)
 static void ieee80211_tasklet_handler(unsigned long data)
 {
 	struct ieee80211_local *local = (struct ieee80211_local *) data;
+	struct sk_buff_head rx_list;
 	struct sk_buff *skb;
 
+	__skb_queue_head_init(&rx_list);
+
 	while ((skb = skb_dequeue(&local->skb_queue)) ||
 	       (skb = skb_dequeue(&local->skb_queue_unreliable))) {
 		switch (skb->pkt_type) {
@@ -229,9 +232,11 @@ static void ieee80211_tasklet_handler(unsigned long data)
 			/* Clear skb->pkt_type in order to not confuse kernel
 			 * netstack. */
 			skb->pkt_type = 0;
-			ieee80211_rx(&local->hw, skb);
+			__skb_queue_tail(&rx_list, skb);
 			break;
 		case IEEE80211_TX_STATUS_MSG:
+			/* keep frames ordered against the status reports */
+			ieee80211_rx_list(&local->hw, &rx_list);
 			skb->pkt_type = 0;
 			ieee80211_tx_status(&local->hw, skb);
 			break;
@@ -242,6 +247,8 @@ static void ieee80211_tasklet_handler(unsigned long data)
 			break;
 		}
 	}
+
+	ieee80211_rx_list(&local->hw, &rx_list);
 }
 
 static void ieee80211_restart_work(struct work_struct *work)
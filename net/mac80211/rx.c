@@ -1964,7 +1964,9 @@ ieee80211_deliver_skb(struct ieee80211_rx_data *rx)
 		/* deliver to local stack */
 		skb->protocol = eth_type_trans(skb, dev);
 		memset(skb->cb, 0, sizeof(skb->cb));
-		if (rx->local->napi)
+		if (rx->list)
+			__skb_queue_tail(rx->list, skb);
+		else if (rx->local->napi)
 			napi_gro_receive(rx->local->napi, skb);
 		else
 			netif_receive_skb(skb);
@@ -2933,12 +2935,38 @@ static void ieee80211_rx_handlers_result(struct ieee80211_rx_data *rx,
 	}
 }
 
+static void ieee80211_rx_deliver_list(struct ieee80211_local *local,
+				      struct sk_buff_head *list)
+{
+	struct sk_buff *skb;
+
+	while ((skb = __skb_dequeue(list))) {
+		if (local->napi)
+			napi_gro_receive(local->napi, skb);
+		else
+			netif_receive_skb(skb);
+	}
+}
+
+/*
+ * Runs the handlers over all frames released for one station/TID under a
+ * single rx_path_lock section. Frames for the local stack are collected on
+ * rx->list and only passed up after the lock is dropped; if the caller did
+ * not provide a list (see ieee80211_rx_list()) they are passed up here.
+ */
 static void ieee80211_rx_handlers(struct ieee80211_rx_data *rx,
 				  struct sk_buff_head *frames)
 {
 	ieee80211_rx_result res = RX_DROP_MONITOR;
+	struct sk_buff_head deliver;
+	struct sk_buff_head *list = rx->list;
 	struct sk_buff *skb;
 
+	if (!list) {
+		__skb_queue_head_init(&deliver);
+		rx->list = &deliver;
+	}
+
 #define CALL_RXH(rxh)			\
 	do {				\
 		res = rxh(rx);		\
@@ -2988,6 +3016,11 @@ static void ieee80211_rx_handlers(struct ieee80211_rx_data *rx,
 	}
 
 	spin_unlock_bh(&rx->local->rx_path_lock);
+
+	if (!list) {
+		rx->list = NULL;
+		ieee80211_rx_deliver_list(rx->local, &deliver);
+	}
 }
 
 static void ieee80211_invoke_rx_handlers(struct ieee80211_rx_data *rx)
@@ -3194,7 +3227,8 @@ static bool ieee80211_prepare_and_rx_handle(struct ieee80211_rx_data *rx,
  * be called with rcu_read_lock protection.
  */
 static void __ieee80211_rx_handle_packet(struct ieee80211_hw *hw,
-					 struct sk_buff *skb)
+					 struct sk_buff *skb,
+					 struct sk_buff_head *list)
 {
 	struct ieee80211_local *local = hw_to_local(hw);
 	struct ieee80211_sub_if_data *sdata;
@@ -3209,6 +3243,7 @@ static void __ieee80211_rx_handle_packet(struct ieee80211_hw *hw,
 	memset(&rx, 0, sizeof(rx));
 	rx.skb = skb;
 	rx.local = local;
+	rx.list = list;
 
 	if (ieee80211_is_data(fc) || ieee80211_is_mgmt(fc))
 		local->dot11ReceivedFragmentCount++;
@@ -3303,10 +3338,11 @@ static void __ieee80211_rx_handle_packet(struct ieee80211_hw *hw,
 }
 
 /*
- * This is the receive path handler. It is called by a low level driver when an
- * 802.11 MPDU is received from the hardware.
+ * Frames for the local stack are queued on @list when it is given,
+ * the caller passes them up.
  */
-void ieee80211_rx(struct ieee80211_hw *hw, struct sk_buff *skb)
+static void __ieee80211_rx(struct ieee80211_hw *hw, struct sk_buff *skb,
+			   struct sk_buff_head *list)
 {
 	struct ieee80211_local *local = hw_to_local(hw);
 	struct ieee80211_rate *rate = NULL;
@@ -3405,7 +3441,7 @@ void ieee80211_rx(struct ieee80211_hw *hw, struct sk_buff *skb)
 	ieee80211_tpt_led_trig_rx(local,
 			((struct ieee80211_hdr *)skb->data)->frame_control,
 			skb->len);
-	__ieee80211_rx_handle_packet(hw, skb);
+	__ieee80211_rx_handle_packet(hw, skb, list);
 
 	rcu_read_unlock();
 
@@ -3413,8 +3449,36 @@ void ieee80211_rx(struct ieee80211_hw *hw, struct sk_buff *skb)
  drop:
 	kfree_skb(skb);
 }
+
+/*
+ * This is the receive path handler. It is called by a low level driver when an
+ * 802.11 MPDU is received from the hardware.
+ */
+void ieee80211_rx(struct ieee80211_hw *hw, struct sk_buff *skb)
+{
+	__ieee80211_rx(hw, skb, NULL);
+}
 EXPORT_SYMBOL(ieee80211_rx);
 
+void ieee80211_rx_list(struct ieee80211_hw *hw, struct sk_buff_head *skbs)
+{
+	struct sk_buff_head deliver;
+	struct sk_buff *skb;
+
+	__skb_queue_head_init(&deliver);
+
+	/* the interfaces the queued frames belong to are protected by RCU */
+	rcu_read_lock();
+
+	while ((skb = __skb_dequeue(skbs)))
+		__ieee80211_rx(hw, skb, &deliver);
+
+	ieee80211_rx_deliver_list(hw_to_local(hw), &deliver);
+
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL(ieee80211_rx_list);
+
 /* This is a version of the rx handler that can be called from hard irq
  * context. Post the skb on the queue and schedule the tasklet */
 void ieee80211_rx_irqsafe(struct ieee80211_hw *hw, struct sk_buff *skb)
@@ -0,0 +1,368 @@
+/* This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/* Kernel module implementing an IP set type: the lpm:net type
+ *
+ * Networks are kept in a longest prefix match trie, so matching a packet
+ * walks a single path instead of probing every stored prefix length as
+ * hash:net does.
+ */
+
+#include <linux/module.h>
+#include <linux/ip.h>
+#include <linux/skbuff.h>
+#include <linux/errno.h>
+#include <net/ip.h>
+#include <net/ipv6.h>
+#include <net/netlink.h>
+
+#include <linux/netfilter.h>
+#include <linux/netfilter/ipset/pfxlen.h>
+#include <linux/netfilter/ipset/ip_set.h>
+#include <net/netfilter/nf_lpm.h>
+
+#define IPSET_TYPE_REV_MIN	0
+#define IPSET_TYPE_REV_MAX	0
+
+MODULE_LICENSE("GPL");
+IP_SET_MODULE_DESC("lpm:net", IPSET_TYPE_REV_MIN, IPSET_TYPE_REV_MAX);
+MODULE_ALIAS("ip_set_lpm:net");
+
+/* Member elements */
+struct lpm_net_elem {
+	u8 nomatch;
+};
+
+/* Type structure */
+struct lpm_net {
+	struct nf_lpm_trie trie;
+};
+
+static inline u8
+lpm_net_host_mask(const struct ip_set *set)
+{
+	return set->family == NFPROTO_IPV4 ? 32 : 128;
+}
+
+static int
+lpm_net_adt(struct ip_set *set, const u8 *key, u8 cidr,
+	    enum ipset_adt adt, u32 flags)
+{
+	struct lpm_net *map = set->data;
+	struct lpm_net_elem e, *elem;
+	int ret;
+
+	switch (adt) {
+	case IPSET_TEST:
+		if (cidr == lpm_net_host_mask(set))
+			elem = nf_lpm_lookup(&map->trie, key);
+		else
+			elem = nf_lpm_lookup_exact(&map->trie, key, cidr);
+		if (elem == NULL)
+			return 0;
+		return elem->nomatch ? -ENOTEMPTY : 1;
+	case IPSET_ADD:
+		e.nomatch = (flags >> 16) & IPSET_FLAG_NOMATCH;
+		/* Called under set->lock, so no sleeping allocation */
+		ret = nf_lpm_insert(&map->trie, key, cidr, &e, GFP_ATOMIC);
+		if (ret != -EEXIST)
+			return ret;
+		if (!(flags & IPSET_FLAG_EXIST))
+			return -IPSET_ERR_EXIST;
+		elem = nf_lpm_lookup_exact(&map->trie, key, cidr);
+		elem->nomatch = e.nomatch;
+		return 0;
+	case IPSET_DEL:
+		ret = nf_lpm_delete(&map->trie, key, cidr);
+		return ret == -ENOENT ? -IPSET_ERR_EXIST : ret;
+	default:
+		return -EINVAL;
+	}
+}
+
+static int
+lpm_net_kadt(struct ip_set *set, const struct sk_buff *skb,
+	     const struct xt_action_param *par,
+	     enum ipset_adt adt, struct ip_set_adt_opt *opt)
+{
+	bool src = opt->flags & IPSET_DIM_ONE_SRC;
+	union nf_inet_addr ip;
+
+	if (set->family == NFPROTO_IPV4)
+		ip4addrptr(skb, src, &ip.ip);
+	else
+		ip6addrptr(skb, src, &ip.in6);
+
+	return lpm_net_adt(set, (const u8 *)&ip, lpm_net_host_mask(set),
+			   adt, opt->cmdflags);
+}
+
+static int
+lpm_net_uadt(struct ip_set *set, struct nlattr *tb[],
+	     enum ipset_adt adt, u32 *lineno, u32 flags, bool retried)
+{
+	u8 cidr = lpm_net_host_mask(set);
+	union nf_inet_addr ip = {};
+	u32 ip_from, ip_to, last;
+	__be32 key;
+	int ret;
+
+	if (unlikely(!tb[IPSET_ATTR_IP] ||
+		     !ip_set_optattr_netorder(tb, IPSET_ATTR_CADT_FLAGS)))
+		return -IPSET_ERR_PROTOCOL;
+
+	if (tb[IPSET_ATTR_LINENO])
+		*lineno = nla_get_u32(tb[IPSET_ATTR_LINENO]);
+
+	if (set->family == NFPROTO_IPV4)
+		ret = ip_set_get_ipaddr4(tb[IPSET_ATTR_IP], &ip.ip);
+	else
+		ret = ip_set_get_ipaddr6(tb[IPSET_ATTR_IP], &ip);
+	if (ret)
+		return ret;
+
+	if (tb[IPSET_ATTR_CIDR]) {
+		cidr = nla_get_u8(tb[IPSET_ATTR_CIDR]);
+		if (!cidr || cidr > lpm_net_host_mask(set))
+			return -IPSET_ERR_INVALID_CIDR;
+	}
+
+	if (tb[IPSET_ATTR_CADT_FLAGS]) {
+		u32 cadt_flags = ip_set_get_h32(tb[IPSET_ATTR_CADT_FLAGS]);
+		if (cadt_flags & IPSET_FLAG_NOMATCH)
+			flags |= (IPSET_FLAG_NOMATCH << 16);
+	}
+
+	if (adt == IPSET_TEST || !tb[IPSET_ATTR_IP_TO]) {
+		ret = lpm_net_adt(set, (const u8 *)&ip, cidr, adt, flags);
+		return ip_set_enomatch(ret, flags, adt, set) ? -ret :
+		       ip_set_eexist(ret, flags) ? 0 : ret;
+	}
+
+	if (set->family != NFPROTO_IPV4)
+		return -IPSET_ERR_PROTOCOL;
+
+	/* Split the IPv4 range into the covering prefixes */
+	ip_from = ntohl(ip.ip);
+	ret = ip_set_get_hostipaddr4(tb[IPSET_ATTR_IP_TO], &ip_to);
+	if (ret)
+		return ret;
+	if (ip_to < ip_from)
+		swap(ip_from, ip_to);
+	if (ip_from + UINT_MAX == ip_to)
+		return -IPSET_ERR_INVALID_CIDR;
+
+	while (!after(ip_from, ip_to)) {
+		key = htonl(ip_from);
+		last = ip_set_range_to_cidr(ip_from, ip_to, &cidr);
+		ret = lpm_net_adt(set, (const u8 *)&key, cidr, adt, flags);
+		if (ret && !ip_set_eexist(ret, flags))
+			return ret;
+		else
+			ret = 0;
+		ip_from = last + 1;
+	}
+	return ret;
+}
+
+static void
+lpm_net_flush(struct ip_set *set)
+{
+	struct lpm_net *map = set->data;
+
+	nf_lpm_destroy(&map->trie, NULL, NULL);
+}
+
+static void
+lpm_net_destroy(struct ip_set *set)
+{
+	lpm_net_flush(set);
+	kfree(set->data);
+
+	set->data = NULL;
+}
+
+static int
+lpm_net_head(struct ip_set *set, struct sk_buff *skb)
+{
+	const struct lpm_net *map = set->data;
+	struct nlattr *nested;
+	size_t memsize;
+
+	/* Each entry may need an intermediate node to join it in */
+	memsize = sizeof(*map) + map->trie.n_entries * 2 *
+		  (sizeof(struct nf_lpm_node) + map->trie.data_size +
+		   map->trie.value_size);
+
+	nested = ipset_nest_start(skb, IPSET_ATTR_DATA);
+	if (!nested)
+		goto nla_put_failure;
+	if (nla_put_net32(skb, IPSET_ATTR_REFERENCES, htonl(set->ref - 1)) ||
+	    nla_put_net32(skb, IPSET_ATTR_MEMSIZE, htonl(memsize)))
+		goto nla_put_failure;
+	ipset_nest_end(skb, nested);
+
+	return 0;
+nla_put_failure:
+	return -EMSGSIZE;
+}
+
+struct lpm_net_dump {
+	const struct ip_set *set;
+	struct sk_buff *skb;
+	struct netlink_callback *cb;
+	unsigned long index;
+	bool first;
+};
+
+static int
+lpm_net_list_elem(const u8 *key, unsigned int prefixlen, void *value,
+		  void *arg)
+{
+	struct lpm_net_dump *d = arg;
+	const struct lpm_net_elem *e = value;
+	struct nlattr *nested;
+	int ret;
+
+	/* Skip what earlier dump calls already sent */
+	if (d->index++ < d->cb->args[IPSET_CB_ARG0])
+		return 0;
+
+	nested = ipset_nest_start(d->skb, IPSET_ATTR_DATA);
+	if (!nested)
+		return -EMSGSIZE;
+	if (d->set->family == NFPROTO_IPV4)
+		ret = nla_put_ipaddr4(d->skb, IPSET_ATTR_IP,
+				      *(const __be32 *)key);
+	else
+		ret = nla_put_ipaddr6(d->skb, IPSET_ATTR_IP,
+				      (const struct in6_addr *)key);
+	if (ret ||
+	    nla_put_u8(d->skb, IPSET_ATTR_CIDR, prefixlen) ||
+	    (e->nomatch &&
+	     nla_put_net32(d->skb, IPSET_ATTR_CADT_FLAGS,
+			   htonl(IPSET_FLAG_NOMATCH)))) {
+		nla_nest_cancel(d->skb, nested);
+		return -EMSGSIZE;
+	}
+	ipset_nest_end(d->skb, nested);
+	d->cb->args[IPSET_CB_ARG0]++;
+	d->first = false;
+	return 0;
+}
+
+static int
+lpm_net_list(const struct ip_set *set,
+	     struct sk_buff *skb, struct netlink_callback *cb)
+{
+	const struct lpm_net *map = set->data;
+	struct lpm_net_dump d = {
+		.set	= set,
+		.skb	= skb,
+		.cb	= cb,
+		.first	= true,
+	};
+	struct nlattr *atd;
+	int ret;
+
+	atd = ipset_nest_start(skb, IPSET_ATTR_ADT);
+	if (!atd)
+		return -EMSGSIZE;
+
+	/* Listing runs under the set read lock */
+	ret = nf_lpm_walk(&map->trie, lpm_net_list_elem, &d, GFP_ATOMIC);
+	if (ret == -EMSGSIZE && !d.first) {
+		/* Message is full, continue in the next one */
+		ipset_nest_end(skb, atd);
+		return 0;
+	}
+	if (ret) {
+		nla_nest_cancel(skb, atd);
+		cb->args[IPSET_CB_ARG0] = 0;
+		return ret;
+	}
+
+	ipset_nest_end(skb, atd);
+	/* Set listing finished */
+	cb->args[IPSET_CB_ARG0] = 0;
+	return 0;
+}
+
+static bool
+lpm_net_same_set(const struct ip_set *a, const struct ip_set *b)
+{
+	return a->family == b->family &&
+	       a->extensions == b->extensions;
+}
+
+static const struct ip_set_type_variant lpm_net_variant = {
+	.kadt	= lpm_net_kadt,
+	.uadt	= lpm_net_uadt,
+	.destroy = lpm_net_destroy,
+	.flush	= lpm_net_flush,
+	.head	= lpm_net_head,
+	.list	= lpm_net_list,
+	.same_set = lpm_net_same_set,
+};
+
+static int
+lpm_net_create(struct net *net, struct ip_set *set, struct nlattr *tb[],
+	       u32 flags)
+{
+	struct lpm_net *map;
+	int ret;
+
+	if (!(set->family == NFPROTO_IPV4 || set->family == NFPROTO_IPV6))
+		return -IPSET_ERR_INVALID_FAMILY;
+
+	map = kzalloc(sizeof(*map), GFP_KERNEL);
+	if (!map)
+		return -ENOMEM;
+
+	ret = nf_lpm_init(&map->trie, lpm_net_host_mask(set) / 8,
+			  sizeof(struct lpm_net_elem));
+	if (ret) {
+		kfree(map);
+		return ret;
+	}
+
+	set->data = map;
+	set->variant = &lpm_net_variant;
+	return 0;
+}
+
+static struct ip_set_type lpm_net_type __read_mostly = {
+	.name		= "lpm:net",
+	.protocol	= IPSET_PROTOCOL,
+	.features	= IPSET_TYPE_IP | IPSET_TYPE_NOMATCH,
+	.dimension	= IPSET_DIM_ONE,
+	.family		= NFPROTO_UNSPEC,
+	.revision_min	= IPSET_TYPE_REV_MIN,
+	.revision_max	= IPSET_TYPE_REV_MAX,
+	.create		= lpm_net_create,
+	.adt_policy	= {
+		[IPSET_ATTR_IP]		= { .type = NLA_NESTED },
+		[IPSET_ATTR_IP_TO]	= { .type = NLA_NESTED },
+		[IPSET_ATTR_CIDR]	= { .type = NLA_U8 },
+		[IPSET_ATTR_LINENO]	= { .type = NLA_U32 },
+		[IPSET_ATTR_CADT_FLAGS]	= { .type = NLA_U32 },
+	},
+	.me		= THIS_MODULE,
+};
+
+static int __init
+lpm_net_init(void)
+{
+	return ip_set_type_register(&lpm_net_type);
+}
+
+static void __exit
+lpm_net_fini(void)
+{
+	ip_set_type_unregister(&lpm_net_type);
+}
+
+module_init(lpm_net_init);
+module_exit(lpm_net_fini);
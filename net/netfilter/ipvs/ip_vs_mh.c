@@ -0,0 +1,473 @@
+/*
+ * IPVS:        Maglev Hashing scheduling module
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU General Public License
+ *              as published by the Free Software Foundation; either version
+ *              2 of the License, or (at your option) any later version.
+ *
+ * Changes:
+ *
+ */
+
+/*
+ * The mh algorithm assigns a preference list of all the lookup table
+ * positions to each destination and populates the table with the most
+ * preferred position of each destination in turn, the way Maglev does
+ * ("Maglev: A Fast and Reliable Software Network Load Balancer", NSDI
+ * 2016). The pseudo code is as follows:
+ *
+ *       offset <- hash1(dest) % M;
+ *       skip <- hash2(dest) % (M - 1) + 1;
+ *       permutation[dest][j] <- (offset + j * skip) % M;
+ *
+ *       while the table is not full:
+ *           for each dest, weight / gcd(weights) times:
+ *               take the next free position in permutation[dest];
+ *
+ *       n <- table[hash(src_ip) % M];
+ *
+ * Destinations get table positions in proportion to their weight, and
+ * adding or removing a destination only moves the positions it takes
+ * or gives up, so most connections keep their server. The mapping only
+ * depends on the destinations, not on the director, so several
+ * directors with the same service agree on it without syncing.
+ *
+ * Scheduling a connection is a table lookup under RCU and takes no
+ * lock; the table is rebuilt from the control path when the
+ * destinations change.
+ */
+
+#define KMSG_COMPONENT "IPVS"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/ip.h>
+#include <linux/slab.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/skbuff.h>
+#include <linux/jhash.h>
+#include <linux/gcd.h>
+
+#include <net/ip_vs.h>
+
+#include <net/tcp.h>
+#include <linux/udp.h>
+#include <linux/sctp.h>
+
+
+/*
+ *      IPVS MH bucket
+ */
+struct ip_vs_mh_bucket {
+	struct ip_vs_dest __rcu	*dest;	/* real server */
+};
+
+/*
+ *      The lookup table size must be prime, pick one close to 2^N
+ */
+#ifndef CONFIG_IP_VS_MH_TAB_INDEX
+#define CONFIG_IP_VS_MH_TAB_INDEX	12
+#endif
+#define IP_VS_MH_TAB_INDEX		CONFIG_IP_VS_MH_TAB_INDEX
+
+static const int ip_vs_mh_primes[] = {
+	251, 509, 1021, 2039, 4093, 8191, 16381, 32749, 65521, 131071
+};
+
+#define IP_VS_MH_TAB_SIZE	ip_vs_mh_primes[IP_VS_MH_TAB_INDEX - 8]
+
+/* fixed seeds, so that every director builds the same table */
+#define IP_VS_MH_SEED_OFFSET	0x8cd8b1a7
+#define IP_VS_MH_SEED_SKIP	0x1f3d5b79
+
+struct ip_vs_mh_state {
+	struct rcu_head			rcu_head;
+	struct ip_vs_mh_bucket		*buckets;
+};
+
+/* Preference list of a destination while the table is populated */
+struct ip_vs_mh_dest_setup {
+	struct ip_vs_dest		*dest;
+	unsigned int			offset;
+	unsigned int			skip;
+	unsigned int			perm;
+	int				turns;
+};
+
+/* Helper function to determine if server is unavailable */
+static inline bool is_unavailable(struct ip_vs_dest *dest)
+{
+	return atomic_read(&dest->weight) <= 0 ||
+	       dest->flags & IP_VS_DEST_F_OVERLOAD;
+}
+
+static inline u32
+ip_vs_mh_addr_hash(int af, const union nf_inet_addr *addr, __be16 port,
+		   u32 seed)
+{
+#ifdef CONFIG_IP_VS_IPV6
+	if (af == AF_INET6)
+		return jhash_3words((__force u32)addr->ip6[0] ^
+				    (__force u32)addr->ip6[1],
+				    (__force u32)addr->ip6[2] ^
+				    (__force u32)addr->ip6[3],
+				    (__force u32)port, seed);
+#endif
+	return jhash_2words((__force u32)addr->ip, (__force u32)port, seed);
+}
+
+/*
+ *	Returns hash value for IPVS MH entry
+ */
+static inline unsigned int
+ip_vs_mh_hashkey(int af, const union nf_inet_addr *addr,
+		 __be16 port, unsigned int offset)
+{
+	return ip_vs_mh_addr_hash(af, addr, port, offset) % IP_VS_MH_TAB_SIZE;
+}
+
+
+/*
+ *      Get ip_vs_dest associated with supplied parameters.
+ */
+static inline struct ip_vs_dest *
+ip_vs_mh_get(struct ip_vs_service *svc, struct ip_vs_mh_state *s,
+	     const union nf_inet_addr *addr, __be16 port)
+{
+	unsigned int hash = ip_vs_mh_hashkey(svc->af, addr, port, 0);
+	struct ip_vs_dest *dest = rcu_dereference(s->buckets[hash].dest);
+
+	return (!dest || is_unavailable(dest)) ? NULL : dest;
+}
+
+
+/* As ip_vs_mh_get, but with fallback if selected server is unavailable
+ *
+ * The fallback strategy rehashes with a different offset until it finds
+ * an available server, so the choice stays deterministic.
+ */
+static inline struct ip_vs_dest *
+ip_vs_mh_get_fallback(struct ip_vs_service *svc, struct ip_vs_mh_state *s,
+		      const union nf_inet_addr *addr, __be16 port)
+{
+	unsigned int offset, roffset;
+	unsigned int hash, ihash;
+	struct ip_vs_dest *dest;
+
+	/* first try the dest it's supposed to go to */
+	ihash = ip_vs_mh_hashkey(svc->af, addr, port, 0);
+	dest = rcu_dereference(s->buckets[ihash].dest);
+	if (!dest)
+		return NULL;
+	if (!is_unavailable(dest))
+		return dest;
+
+	IP_VS_DBG_BUF(6, "MH: selected unavailable server %s:%d, reselecting",
+		      IP_VS_DBG_ADDR(svc->af, &dest->addr), ntohs(dest->port));
+
+	for (offset = 0; offset < IP_VS_MH_TAB_SIZE; offset++) {
+		roffset = (offset + ihash) % IP_VS_MH_TAB_SIZE;
+		hash = ip_vs_mh_hashkey(svc->af, addr, port, roffset);
+		dest = rcu_dereference(s->buckets[hash].dest);
+		if (!dest)
+			break;
+		if (!is_unavailable(dest))
+			return dest;
+		IP_VS_DBG_BUF(6, "MH: selected unavailable "
+			      "server %s:%d (offset %d), reselecting",
+			      IP_VS_DBG_ADDR(svc->af, &dest->addr),
+			      ntohs(dest->port), roffset);
+	}
+
+	return NULL;
+}
+
+
+/*
+ *      Flush all the hash buckets of the specified table.
+ */
+static void ip_vs_mh_flush(struct ip_vs_mh_state *s)
+{
+	int i;
+	struct ip_vs_mh_bucket *b;
+	struct ip_vs_dest *dest;
+
+	b = &s->buckets[0];
+	for (i = 0; i < IP_VS_MH_TAB_SIZE; i++) {
+		dest = rcu_dereference_protected(b->dest, 1);
+		if (dest) {
+			ip_vs_dest_put(dest);
+			RCU_INIT_POINTER(b->dest, NULL);
+		}
+		b++;
+	}
+}
+
+
+/*
+ *      Populate the lookup table from the destinations' preference lists.
+ *      Called under __ip_vs_mutex.
+ */
+static int
+ip_vs_mh_reassign(struct ip_vs_mh_state *s, struct ip_vs_service *svc)
+{
+	struct ip_vs_mh_dest_setup *ds, *d;
+	unsigned long *table_used;
+	struct ip_vs_dest *dest, *old;
+	int n, i, weight, gcd_weight = 0;
+	unsigned int c, filled = 0;
+
+	n = 0;
+	list_for_each_entry(dest, &svc->destinations, n_list) {
+		weight = atomic_read(&dest->weight);
+		if (weight <= 0)
+			continue;
+		gcd_weight = gcd_weight ? gcd(gcd_weight, weight) : weight;
+		n++;
+	}
+
+	if (n == 0) {
+		ip_vs_mh_flush(s);
+		return 0;
+	}
+
+	ds = kcalloc(n, sizeof(*ds), GFP_KERNEL);
+	table_used = kcalloc(BITS_TO_LONGS(IP_VS_MH_TAB_SIZE),
+			     sizeof(unsigned long), GFP_KERNEL);
+	if (!ds || !table_used) {
+		kfree(ds);
+		kfree(table_used);
+		return -ENOMEM;
+	}
+
+	d = ds;
+	list_for_each_entry(dest, &svc->destinations, n_list) {
+		weight = atomic_read(&dest->weight);
+		if (weight <= 0)
+			continue;
+		d->dest = dest;
+		d->offset = ip_vs_mh_addr_hash(svc->af, &dest->addr,
+					       dest->port,
+					       IP_VS_MH_SEED_OFFSET) %
+			    IP_VS_MH_TAB_SIZE;
+		d->skip = ip_vs_mh_addr_hash(svc->af, &dest->addr,
+					     dest->port,
+					     IP_VS_MH_SEED_SKIP) %
+			  (IP_VS_MH_TAB_SIZE - 1) + 1;
+		d->perm = d->offset;
+		d->turns = weight / gcd_weight;
+		d++;
+	}
+
+	while (filled < IP_VS_MH_TAB_SIZE) {
+		for (d = ds; d < ds + n && filled < IP_VS_MH_TAB_SIZE; d++) {
+			for (i = 0; i < d->turns &&
+				    filled < IP_VS_MH_TAB_SIZE; i++) {
+				c = d->perm;
+				while (test_bit(c, table_used)) {
+					c += d->skip;
+					if (c >= IP_VS_MH_TAB_SIZE)
+						c -= IP_VS_MH_TAB_SIZE;
+				}
+				__set_bit(c, table_used);
+				d->perm = c;
+
+				old = rcu_dereference_protected(
+						s->buckets[c].dest, 1);
+				if (old != d->dest) {
+					ip_vs_dest_hold(d->dest);
+					RCU_INIT_POINTER(s->buckets[c].dest,
+							 d->dest);
+					if (old)
+						ip_vs_dest_put(old);
+				}
+				filled++;
+			}
+		}
+	}
+
+	IP_VS_DBG(6, "MH: table with %d buckets assigned to %d dests\n",
+		  IP_VS_MH_TAB_SIZE, n);
+
+	kfree(table_used);
+	kfree(ds);
+	return 0;
+}
+
+
+static int ip_vs_mh_init_svc(struct ip_vs_service *svc)
+{
+	struct ip_vs_mh_state *s;
+	int ret;
+
+	/* allocate the MH table for this service */
+	s = kzalloc(sizeof(struct ip_vs_mh_state), GFP_KERNEL);
+	if (s == NULL)
+		return -ENOMEM;
+
+	s->buckets = kcalloc(IP_VS_MH_TAB_SIZE, sizeof(struct ip_vs_mh_bucket),
+			     GFP_KERNEL);
+	if (s->buckets == NULL) {
+		kfree(s);
+		return -ENOMEM;
+	}
+
+	IP_VS_DBG(6, "MH lookup table (memory=%Zdbytes) allocated for "
+		  "current service\n",
+		  sizeof(struct ip_vs_mh_bucket) * IP_VS_MH_TAB_SIZE);
+
+	/* assign the lookup table with current dests */
+	ret = ip_vs_mh_reassign(s, svc);
+	if (ret < 0) {
+		ip_vs_mh_flush(s);
+		kfree(s->buckets);
+		kfree(s);
+		return ret;
+	}
+
+	svc->sched_data = s;
+	return 0;
+}
+
+
+static void ip_vs_mh_state_free(struct rcu_head *head)
+{
+	struct ip_vs_mh_state *s;
+
+	s = container_of(head, struct ip_vs_mh_state, rcu_head);
+	kfree(s->buckets);
+	kfree(s);
+}
+
+static void ip_vs_mh_done_svc(struct ip_vs_service *svc)
+{
+	struct ip_vs_mh_state *s = svc->sched_data;
+
+	/* got to clean up lookup table here */
+	ip_vs_mh_flush(s);
+
+	/* release the table itself */
+	call_rcu(&s->rcu_head, ip_vs_mh_state_free);
+	IP_VS_DBG(6, "MH lookup table (memory=%Zdbytes) released\n",
+		  sizeof(struct ip_vs_mh_bucket) * IP_VS_MH_TAB_SIZE);
+}
+
+
+static int ip_vs_mh_dest_changed(struct ip_vs_service *svc,
+				 struct ip_vs_dest *dest)
+{
+	struct ip_vs_mh_state *s = svc->sched_data;
+
+	/* assign the lookup table with the updated service */
+	return ip_vs_mh_reassign(s, svc);
+}
+
+
+/* Helper function to get port number */
+static inline __be16
+ip_vs_mh_get_port(const struct sk_buff *skb, struct ip_vs_iphdr *iph)
+{
+	__be16 port;
+	struct tcphdr _tcph, *th;
+	struct udphdr _udph, *uh;
+	sctp_sctphdr_t _sctph, *sh;
+
+	switch (iph->protocol) {
+	case IPPROTO_TCP:
+		th = skb_header_pointer(skb, iph->len, sizeof(_tcph), &_tcph);
+		if (unlikely(th == NULL))
+			return 0;
+		port = th->source;
+		break;
+	case IPPROTO_UDP:
+		uh = skb_header_pointer(skb, iph->len, sizeof(_udph), &_udph);
+		if (unlikely(uh == NULL))
+			return 0;
+		port = uh->source;
+		break;
+	case IPPROTO_SCTP:
+		sh = skb_header_pointer(skb, iph->len, sizeof(_sctph), &_sctph);
+		if (unlikely(sh == NULL))
+			return 0;
+		port = sh->source;
+		break;
+	default:
+		port = 0;
+	}
+
+	return port;
+}
+
+
+/*
+ *      Maglev Hashing scheduling
+ */
+static struct ip_vs_dest *
+ip_vs_mh_schedule(struct ip_vs_service *svc, const struct sk_buff *skb,
+		  struct ip_vs_iphdr *iph)
+{
+	struct ip_vs_dest *dest;
+	struct ip_vs_mh_state *s;
+	__be16 port = 0;
+
+	IP_VS_DBG(6, "ip_vs_mh_schedule(): Scheduling...\n");
+
+	if (svc->flags & IP_VS_SVC_F_SCHED_MH_PORT)
+		port = ip_vs_mh_get_port(skb, iph);
+
+	s = (struct ip_vs_mh_state *) svc->sched_data;
+
+	if (svc->flags & IP_VS_SVC_F_SCHED_MH_FALLBACK)
+		dest = ip_vs_mh_get_fallback(svc, s, &iph->saddr, port);
+	else
+		dest = ip_vs_mh_get(svc, s, &iph->saddr, port);
+
+	if (!dest) {
+		ip_vs_scheduler_err(svc, "no destination available");
+		return NULL;
+	}
+
+	IP_VS_DBG_BUF(6, "MH: source IP address %s --> server %s:%d\n",
+		      IP_VS_DBG_ADDR(svc->af, &iph->saddr),
+		      IP_VS_DBG_ADDR(svc->af, &dest->addr),
+		      ntohs(dest->port));
+
+	return dest;
+}
+
+
+/*
+ *      IPVS MH Scheduler structure
+ */
+static struct ip_vs_scheduler ip_vs_mh_scheduler =
+{
+	.name =			"mh",
+	.refcnt =		ATOMIC_INIT(0),
+	.module =		THIS_MODULE,
+	.n_list	 =		LIST_HEAD_INIT(ip_vs_mh_scheduler.n_list),
+	.init_service =		ip_vs_mh_init_svc,
+	.done_service =		ip_vs_mh_done_svc,
+	.add_dest =		ip_vs_mh_dest_changed,
+	.del_dest =		ip_vs_mh_dest_changed,
+	.upd_dest =		ip_vs_mh_dest_changed,
+	.schedule =		ip_vs_mh_schedule,
+};
+
+
+static int __init ip_vs_mh_init(void)
+{
+	return register_ip_vs_scheduler(&ip_vs_mh_scheduler);
+}
+
+
+static void __exit ip_vs_mh_cleanup(void)
+{
+	unregister_ip_vs_scheduler(&ip_vs_mh_scheduler);
+	rcu_barrier();
+}
+
+
+module_init(ip_vs_mh_init);
+module_exit(ip_vs_mh_cleanup);
+MODULE_LICENSE("GPL");
@@ -429,28 +429,18 @@ nf_ct_key_equal(struct nf_conntrack_tuple_hash *h,
 		nf_ct_is_confirmed(ct);
 }
 
-/*
- * Warning :
- * - Caller must take a reference on returned object
- *   and recheck nf_ct_tuple_equal(tuple, &h->tuple)
- */
 static struct nf_conntrack_tuple_hash *
-____nf_conntrack_find(struct net *net, u16 zone,
-		      const struct nf_conntrack_tuple *tuple, u32 hash)
+nf_conntrack_find_bucket(struct net *net, struct hlist_nulls_head *ct_hash,
+			 unsigned int bucket, u16 zone,
+			 const struct nf_conntrack_tuple *tuple)
 {
 	struct nf_conntrack_tuple_hash *h;
 	struct hlist_nulls_node *n;
-	unsigned int bucket = hash_bucket(hash, net);
 
-	/* Disable BHs the entire time since we normally need to disable them
-	 * at least once for the stats anyway.
-	 */
-	local_bh_disable();
 begin:
-	hlist_nulls_for_each_entry_rcu(h, n, &net->ct.hash[bucket], hnnode) {
+	hlist_nulls_for_each_entry_rcu(h, n, &ct_hash[bucket], hnnode) {
 		if (nf_ct_key_equal(h, tuple, zone)) {
 			NF_CT_STAT_INC(net, found);
-			local_bh_enable();
 			return h;
 		}
 		NF_CT_STAT_INC(net, searched);
@@ -464,11 +454,49 @@ begin:
 		NF_CT_STAT_INC(net, search_restart);
 		goto begin;
 	}
-	local_bh_enable();
 
 	return NULL;
 }
 
+/*
+ * Warning :
+ * - Caller must take a reference on returned object
+ *   and recheck nf_ct_tuple_equal(tuple, &h->tuple)
+ */
+static struct nf_conntrack_tuple_hash *
+____nf_conntrack_find(struct net *net, u16 zone,
+		      const struct nf_conntrack_tuple *tuple, u32 hash)
+{
+	struct nf_conntrack_tuple_hash *h;
+	struct hlist_nulls_head *ct_hash, *resize_hash;
+	unsigned int size, resize_size, sequence;
+
+	/* Disable BHs the entire time since we normally need to disable them
+	 * at least once for the stats anyway.
+	 */
+	local_bh_disable();
+	do {
+		sequence = read_seqcount_begin(&net->ct.generation);
+		ct_hash = net->ct.hash;
+		size = net->ct.htable_size;
+		resize_hash = net->ct.resize_hash;
+		resize_size = net->ct.resize_htable_size;
+	} while (read_seqcount_retry(&net->ct.generation, sequence));
+
+	h = nf_conntrack_find_bucket(net, ct_hash, __hash_bucket(hash, size),
+				     zone, tuple);
+	/* Entries only move from the old table to the new one during a
+	 * resize, so anything missed in the old table is in the new one.
+	 */
+	if (!h && resize_hash)
+		h = nf_conntrack_find_bucket(net, resize_hash,
+					     __hash_bucket(hash, resize_size),
+					     zone, tuple);
+	local_bh_enable();
+
+	return h;
+}
+
 /* Find a connection corresponding to a tuple. */
 static struct nf_conntrack_tuple_hash *
 __nf_conntrack_find_get(struct net *net, u16 zone,
@@ -717,25 +745,39 @@ nf_conntrack_tuple_taken(const struct nf_conntrack_tuple *tuple,
 {
 	struct net *net = nf_ct_net(ignored_conntrack);
 	struct nf_conntrack_tuple_hash *h;
+	struct hlist_nulls_head *ct_hash[2];
 	struct hlist_nulls_node *n;
 	struct nf_conn *ct;
 	u16 zone = nf_ct_zone(ignored_conntrack);
-	unsigned int hash = hash_conntrack(net, zone, tuple);
+	unsigned int size[2], sequence, i;
+	u32 hash = hash_conntrack_raw(tuple, zone);
 
 	/* Disable BHs the entire time since we need to disable them at
 	 * least once for the stats anyway.
 	 */
 	rcu_read_lock_bh();
-	hlist_nulls_for_each_entry_rcu(h, n, &net->ct.hash[hash], hnnode) {
-		ct = nf_ct_tuplehash_to_ctrack(h);
-		if (ct != ignored_conntrack &&
-		    nf_ct_tuple_equal(tuple, &h->tuple) &&
-		    nf_ct_zone(ct) == zone) {
-			NF_CT_STAT_INC(net, found);
-			rcu_read_unlock_bh();
-			return 1;
+	do {
+		sequence = read_seqcount_begin(&net->ct.generation);
+		ct_hash[0] = net->ct.hash;
+		size[0] = net->ct.htable_size;
+		ct_hash[1] = net->ct.resize_hash;
+		size[1] = net->ct.resize_htable_size;
+	} while (read_seqcount_retry(&net->ct.generation, sequence));
+
+	/* See ____nf_conntrack_find() for the table being resized into. */
+	for (i = 0; i < 2 && ct_hash[i]; i++) {
+		hlist_nulls_for_each_entry_rcu(h, n,
+				&ct_hash[i][__hash_bucket(hash, size[i])], hnnode) {
+			ct = nf_ct_tuplehash_to_ctrack(h);
+			if (ct != ignored_conntrack &&
+			    nf_ct_tuple_equal(tuple, &h->tuple) &&
+			    nf_ct_zone(ct) == zone) {
+				NF_CT_STAT_INC(net, found);
+				rcu_read_unlock_bh();
+				return 1;
+			}
+			NF_CT_STAT_INC(net, searched);
 		}
-		NF_CT_STAT_INC(net, searched);
 	}
 	rcu_read_unlock_bh();
 
@@ -1623,13 +1665,15 @@ int nf_conntrack_set_hashsize(const char *val, struct kernel_param *kp)
 
 	local_bh_disable();
 	nf_conntrack_all_lock();
-	write_seqcount_begin(&init_net.ct.generation);
 
-	/* Lookups in the old hash might happen in parallel, which means we
-	 * might get false negatives during connection lookup. New connections
-	 * created because of a false negative won't make it into the hash
-	 * though since that required taking the locks.
+	/* Inserts and deletes are held off by the bucket locks. Lookups
+	 * keep running against the old table and fall back to the new one
+	 * on a miss, so only the two pointer updates below make them wait.
 	 */
+	write_seqcount_begin(&init_net.ct.generation);
+	init_net.ct.resize_hash = hash;
+	init_net.ct.resize_htable_size = hashsize;
+	write_seqcount_end(&init_net.ct.generation);
 
 	for (i = 0; i < init_net.ct.htable_size; i++) {
 		while (!hlist_nulls_empty(&init_net.ct.hash[i])) {
@@ -1645,13 +1689,17 @@ int nf_conntrack_set_hashsize(const char *val, struct kernel_param *kp)
 	old_size = init_net.ct.htable_size;
 	old_hash = init_net.ct.hash;
 
+	write_seqcount_begin(&init_net.ct.generation);
 	init_net.ct.htable_size = nf_conntrack_htable_size = hashsize;
 	init_net.ct.hash = hash;
-
+	init_net.ct.resize_hash = NULL;
 	write_seqcount_end(&init_net.ct.generation);
+
 	nf_conntrack_all_unlock();
 	local_bh_enable();
 
+	/* wait for lookups still walking the old table */
+	synchronize_net();
 	nf_ct_free_hashtable(old_hash, old_size);
 	return 0;
 }
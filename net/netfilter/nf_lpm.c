@@ -0,0 +1,455 @@
+/*
+ * Longest prefix match trie shared by the ipset and nf_tables set types
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Every node covers the first prefixlen bits of its key. Its children
+ * extend that prefix, child[0] where the next bit is clear and child[1]
+ * where it is set. Nodes only created to join two diverging prefixes
+ * are flagged intermediate and carry no value; they always have both
+ * children. A lookup walks down a single path, so it costs at most one
+ * node per distinct prefix length, independent of the number of entries.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <net/netfilter/nf_lpm.h>
+
+/* Readers either hold rcu_read_lock() or the lock serializing updates. */
+#define lpm_deref(p)	rcu_dereference_raw(p)
+
+static inline int extract_bit(const u8 *data, unsigned int index)
+{
+	return !!(data[index / 8] & (1 << (7 - (index % 8))));
+}
+
+/* Number of leading bits @key shares with @node, up to @limit. */
+static unsigned int longest_prefix_match(const struct nf_lpm_node *node,
+					 const u8 *key, unsigned int limit)
+{
+	unsigned int i, prefixlen = 0;
+	u8 diff;
+
+	for (i = 0; prefixlen < limit; i++) {
+		diff = node->data[i] ^ key[i];
+		if (diff) {
+			prefixlen += 8 - fls(diff);
+			break;
+		}
+		prefixlen += 8;
+	}
+
+	return min(prefixlen, limit);
+}
+
+static unsigned int match_limit(const struct nf_lpm_node *node,
+				unsigned int prefixlen)
+{
+	return min(node->prefixlen, prefixlen);
+}
+
+static struct nf_lpm_node *lpm_node_alloc(const struct nf_lpm_trie *trie,
+					  bool value, gfp_t gfp)
+{
+	size_t size = sizeof(struct nf_lpm_node) + trie->data_size;
+
+	if (value)
+		size += trie->value_size;
+
+	return kzalloc(size, gfp);
+}
+
+/**
+ *	nf_lpm_init - initialize an empty trie
+ *	@trie: trie to set up
+ *	@key_len: key length in bytes
+ *	@value_size: size of the value stored with each entry
+ */
+int nf_lpm_init(struct nf_lpm_trie *trie, unsigned int key_len,
+		unsigned int value_size)
+{
+	if (key_len == 0 || key_len > 16)
+		return -EINVAL;
+
+	RCU_INIT_POINTER(trie->root, NULL);
+	trie->n_entries = 0;
+	trie->max_prefixlen = key_len * 8;
+	trie->data_size = ALIGN(key_len, __alignof__(u64));
+	trie->value_size = value_size;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(nf_lpm_init);
+
+/**
+ *	nf_lpm_insert - add a prefix
+ *	@trie: trie to update
+ *	@key: prefix, bits beyond @prefixlen are ignored
+ *	@prefixlen: prefix length in bits
+ *	@value: value copied into the new entry
+ *	@gfp: allocation flags
+ *
+ *	Returns -EEXIST if the prefix is already present.
+ */
+int nf_lpm_insert(struct nf_lpm_trie *trie, const u8 *key,
+		  unsigned int prefixlen, const void *value, gfp_t gfp)
+{
+	struct nf_lpm_node *node, *new_node, *im_node;
+	struct nf_lpm_node __rcu **slot;
+	unsigned int matchlen = 0, i;
+	int next_bit;
+
+	if (prefixlen > trie->max_prefixlen)
+		return -EINVAL;
+
+	new_node = lpm_node_alloc(trie, true, gfp);
+	if (new_node == NULL)
+		return -ENOMEM;
+
+	memcpy(new_node->data, key, trie->max_prefixlen / 8);
+	for (i = prefixlen; i < trie->max_prefixlen; i++)
+		new_node->data[i / 8] &= ~(1 << (7 - (i % 8)));
+	new_node->prefixlen = prefixlen;
+	memcpy(nf_lpm_value(trie, new_node), value, trie->value_size);
+
+	/* Find the node to hang the new one below, or to replace. */
+	slot = &trie->root;
+	while ((node = lpm_deref(*slot)) != NULL) {
+		matchlen = longest_prefix_match(node, new_node->data,
+						match_limit(node, prefixlen));
+		if (node->prefixlen != matchlen ||
+		    node->prefixlen == prefixlen ||
+		    node->prefixlen == trie->max_prefixlen)
+			break;
+
+		next_bit = extract_bit(new_node->data, node->prefixlen);
+		slot = &node->child[next_bit];
+	}
+
+	if (node == NULL) {
+		rcu_assign_pointer(*slot, new_node);
+		goto out;
+	}
+
+	if (node->prefixlen == prefixlen && matchlen == prefixlen) {
+		if (!(node->flags & NF_LPM_NODE_INTERMEDIATE)) {
+			kfree(new_node);
+			return -EEXIST;
+		}
+		/* an intermediate node is taking a value */
+		RCU_INIT_POINTER(new_node->child[0], lpm_deref(node->child[0]));
+		RCU_INIT_POINTER(new_node->child[1], lpm_deref(node->child[1]));
+		rcu_assign_pointer(*slot, new_node);
+		kfree_rcu(node, rcu);
+		goto out;
+	}
+
+	if (matchlen == prefixlen) {
+		/* the new node covers the existing one */
+		next_bit = extract_bit(node->data, matchlen);
+		RCU_INIT_POINTER(new_node->child[next_bit], node);
+		rcu_assign_pointer(*slot, new_node);
+		goto out;
+	}
+
+	/* the prefixes diverge at matchlen, join them */
+	im_node = lpm_node_alloc(trie, false, gfp);
+	if (im_node == NULL) {
+		kfree(new_node);
+		return -ENOMEM;
+	}
+
+	im_node->prefixlen = matchlen;
+	im_node->flags |= NF_LPM_NODE_INTERMEDIATE;
+	memcpy(im_node->data, node->data, trie->max_prefixlen / 8);
+
+	if (extract_bit(new_node->data, matchlen)) {
+		RCU_INIT_POINTER(im_node->child[0], node);
+		RCU_INIT_POINTER(im_node->child[1], new_node);
+	} else {
+		RCU_INIT_POINTER(im_node->child[0], new_node);
+		RCU_INIT_POINTER(im_node->child[1], node);
+	}
+	rcu_assign_pointer(*slot, im_node);
+out:
+	trie->n_entries++;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(nf_lpm_insert);
+
+/**
+ *	nf_lpm_delete - remove a prefix
+ *	@trie: trie to update
+ *	@key: prefix
+ *	@prefixlen: prefix length in bits
+ *
+ *	Nodes are freed after an RCU grace period.
+ */
+int nf_lpm_delete(struct nf_lpm_trie *trie, const u8 *key,
+		  unsigned int prefixlen)
+{
+	struct nf_lpm_node __rcu **trim, **trim2;
+	struct nf_lpm_node *node, *parent = NULL;
+	unsigned int matchlen = 0;
+
+	if (prefixlen > trie->max_prefixlen)
+		return -EINVAL;
+
+	trim = &trie->root;
+	trim2 = trim;
+	while ((node = lpm_deref(*trim)) != NULL) {
+		matchlen = longest_prefix_match(node, key,
+						match_limit(node, prefixlen));
+		if (node->prefixlen != matchlen ||
+		    node->prefixlen == prefixlen)
+			break;
+
+		parent = node;
+		trim2 = trim;
+		trim = &node->child[extract_bit(key, node->prefixlen)];
+	}
+
+	if (node == NULL || node->prefixlen != prefixlen ||
+	    node->prefixlen != matchlen ||
+	    (node->flags & NF_LPM_NODE_INTERMEDIATE))
+		return -ENOENT;
+
+	trie->n_entries--;
+
+	/* Still needed to join its children; the value stays readable
+	 * for lookups that already found it.
+	 */
+	if (lpm_deref(node->child[0]) && lpm_deref(node->child[1])) {
+		node->flags |= NF_LPM_NODE_INTERMEDIATE;
+		return 0;
+	}
+
+	/* A leaf below an intermediate node takes the parent with it. */
+	if (parent && (parent->flags & NF_LPM_NODE_INTERMEDIATE) &&
+	    !lpm_deref(node->child[0]) && !lpm_deref(node->child[1])) {
+		if (node == lpm_deref(parent->child[0]))
+			rcu_assign_pointer(*trim2,
+					   lpm_deref(parent->child[1]));
+		else
+			rcu_assign_pointer(*trim2,
+					   lpm_deref(parent->child[0]));
+		kfree_rcu(parent, rcu);
+		kfree_rcu(node, rcu);
+		return 0;
+	}
+
+	if (lpm_deref(node->child[0]))
+		rcu_assign_pointer(*trim, lpm_deref(node->child[0]));
+	else if (lpm_deref(node->child[1]))
+		rcu_assign_pointer(*trim, lpm_deref(node->child[1]));
+	else
+		RCU_INIT_POINTER(*trim, NULL);
+	kfree_rcu(node, rcu);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(nf_lpm_delete);
+
+/**
+ *	nf_lpm_lookup - find the longest prefix covering a key
+ *	@trie: trie to search
+ *	@key: full length key
+ *
+ *	Returns the value of the matching entry or NULL.
+ */
+void *nf_lpm_lookup(const struct nf_lpm_trie *trie, const u8 *key)
+{
+	const struct nf_lpm_node *node, *found = NULL;
+	unsigned int matchlen;
+
+	for (node = lpm_deref(trie->root); node != NULL;) {
+		matchlen = longest_prefix_match(node, key, node->prefixlen);
+		if (matchlen < node->prefixlen)
+			break;
+
+		if (!(node->flags & NF_LPM_NODE_INTERMEDIATE))
+			found = node;
+		if (node->prefixlen == trie->max_prefixlen)
+			break;
+
+		node = lpm_deref(node->child[extract_bit(key, node->prefixlen)]);
+	}
+
+	return found ? nf_lpm_value(trie, found) : NULL;
+}
+EXPORT_SYMBOL_GPL(nf_lpm_lookup);
+
+/**
+ *	nf_lpm_lookup_exact - find an entry by prefix
+ *	@trie: trie to search
+ *	@key: prefix
+ *	@prefixlen: prefix length in bits
+ */
+void *nf_lpm_lookup_exact(const struct nf_lpm_trie *trie, const u8 *key,
+			  unsigned int prefixlen)
+{
+	const struct nf_lpm_node *node;
+	unsigned int matchlen;
+
+	for (node = lpm_deref(trie->root); node != NULL;) {
+		matchlen = longest_prefix_match(node, key,
+						match_limit(node, prefixlen));
+		if (matchlen < node->prefixlen)
+			return NULL;
+		if (node->prefixlen == prefixlen)
+			break;
+		if (node->prefixlen > prefixlen)
+			return NULL;
+
+		node = lpm_deref(node->child[extract_bit(key, node->prefixlen)]);
+	}
+
+	if (node == NULL || (node->flags & NF_LPM_NODE_INTERMEDIATE))
+		return NULL;
+	return nf_lpm_value(trie, node);
+}
+EXPORT_SYMBOL_GPL(nf_lpm_lookup_exact);
+
+static const struct nf_lpm_node *lpm_last_leaf(const struct nf_lpm_node *node)
+{
+	const struct nf_lpm_node *child;
+
+	for (;;) {
+		child = lpm_deref(node->child[1]);
+		if (child == NULL)
+			child = lpm_deref(node->child[0]);
+		if (child == NULL)
+			return node;
+		node = child;
+	}
+}
+
+/**
+ *	nf_lpm_lookup_le - find the greatest key not above a key
+ *	@trie: trie holding full length keys only
+ *	@key: full length key
+ *
+ *	Used for interval sets, which store the boundaries of each range.
+ *	Returns the value of the matching entry or NULL.
+ */
+void *nf_lpm_lookup_le(const struct nf_lpm_trie *trie, const u8 *key)
+{
+	const struct nf_lpm_node *node, *lower = NULL, *child;
+	unsigned int matchlen;
+	int bit;
+
+	for (node = lpm_deref(trie->root); node != NULL;) {
+		matchlen = longest_prefix_match(node, key, node->prefixlen);
+		if (matchlen == trie->max_prefixlen)
+			return nf_lpm_value(trie, node);
+
+		if (matchlen < node->prefixlen) {
+			/* the whole subtree sorts below the key */
+			if (extract_bit(key, matchlen))
+				lower = node;
+			break;
+		}
+
+		bit = extract_bit(key, node->prefixlen);
+		if (bit) {
+			child = lpm_deref(node->child[0]);
+			if (child != NULL)
+				lower = child;
+		}
+		node = lpm_deref(node->child[bit]);
+	}
+
+	return lower ? nf_lpm_value(trie, lpm_last_leaf(lower)) : NULL;
+}
+EXPORT_SYMBOL_GPL(nf_lpm_lookup_le);
+
+/**
+ *	nf_lpm_walk - call a function for each entry in key order
+ *	@trie: trie to walk
+ *	@fn: callback, a non zero return stops the walk and is returned
+ *	@arg: callback argument
+ *	@gfp: allocation flags for the walk stack
+ */
+int nf_lpm_walk(const struct nf_lpm_trie *trie,
+		int (*fn)(const u8 *key, unsigned int prefixlen,
+			  void *value, void *arg),
+		void *arg, gfp_t gfp)
+{
+	const struct nf_lpm_node **stack, *node, *child;
+	unsigned int sp = 0;
+	int err = 0;
+
+	node = lpm_deref(trie->root);
+	if (node == NULL)
+		return 0;
+
+	/* one pending sibling per level, plus the root */
+	stack = kmalloc((trie->max_prefixlen + 2) * sizeof(*stack), gfp);
+	if (stack == NULL)
+		return -ENOMEM;
+
+	stack[sp++] = node;
+	while (sp > 0) {
+		node = stack[--sp];
+		if (!(node->flags & NF_LPM_NODE_INTERMEDIATE)) {
+			err = fn(node->data, node->prefixlen,
+				 nf_lpm_value(trie, node), arg);
+			if (err)
+				break;
+		}
+
+		child = lpm_deref(node->child[1]);
+		if (child != NULL)
+			stack[sp++] = child;
+		child = lpm_deref(node->child[0]);
+		if (child != NULL)
+			stack[sp++] = child;
+	}
+
+	kfree(stack);
+	return err;
+}
+EXPORT_SYMBOL_GPL(nf_lpm_walk);
+
+/**
+ *	nf_lpm_destroy - free all entries
+ *	@trie: trie without concurrent readers
+ *	@destroy: optional callback releasing each value
+ *	@arg: callback argument
+ */
+void nf_lpm_destroy(struct nf_lpm_trie *trie,
+		    void (*destroy)(void *value, void *arg), void *arg)
+{
+	struct nf_lpm_node __rcu **slot;
+	struct nf_lpm_node *node;
+
+	/* Free leaves one at a time, so no stack is needed. */
+	for (;;) {
+		slot = &trie->root;
+		node = lpm_deref(*slot);
+		if (node == NULL)
+			break;
+
+		for (;;) {
+			if (lpm_deref(node->child[0]))
+				slot = &node->child[0];
+			else if (lpm_deref(node->child[1]))
+				slot = &node->child[1];
+			else
+				break;
+			node = lpm_deref(*slot);
+		}
+
+		if (destroy && !(node->flags & NF_LPM_NODE_INTERMEDIATE))
+			destroy(nf_lpm_value(trie, node), arg);
+		RCU_INIT_POINTER(*slot, NULL);
+		kfree(node);
+	}
+	trie->n_entries = 0;
+}
+EXPORT_SYMBOL_GPL(nf_lpm_destroy);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Longest prefix match trie for netfilter sets");
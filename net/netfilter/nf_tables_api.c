@@ -12,6 +12,7 @@
 #include <linux/init.h>
 #include <linux/list.h>
 #include <linux/skbuff.h>
+#include <linux/filter.h>
 #include <linux/netlink.h>
 #include <linux/netfilter.h>
 #include <linux/netfilter/nfnetlink.h>
@@ -1551,6 +1552,8 @@ static void nf_tables_rule_destroy(const struct nft_ctx *ctx,
 		nf_tables_expr_destroy(ctx, expr);
 		expr = nft_expr_next(expr);
 	}
+	if (rule->prog)
+		sk_filter_free(rule->prog);
 	kfree(rule);
 }
 
@@ -1679,6 +1682,7 @@ static int nf_tables_newrule(struct sock *nlsk, struct sk_buff *skb,
 		info[i].ops = NULL;
 		expr = nft_expr_next(expr);
 	}
+	nft_rule_compile(rule);
 
 	if (nlh->nlmsg_flags & NLM_F_REPLACE) {
 		if (nft_rule_is_active_next(net, old_rule)) {
@@ -1912,9 +1916,23 @@ void nft_unregister_set(struct nft_set_ops *ops)
 }
 EXPORT_SYMBOL_GPL(nft_unregister_set);
 
+/* Prefer the fastest lookup class, then the implementation carrying the
+ * fewest features that were not asked for.
+ */
+static bool nft_set_ops_better(const struct nft_set_ops *ops,
+			       const struct nft_set_ops *bops, u32 features)
+{
+	if (bops == NULL)
+		return true;
+	if (ops->class != bops->class)
+		return ops->class < bops->class;
+	return hweight32(ops->features & ~features) <
+	       hweight32(bops->features & ~features);
+}
+
 static const struct nft_set_ops *nft_select_set_ops(const struct nlattr * const nla[])
 {
-	const struct nft_set_ops *ops;
+	const struct nft_set_ops *ops, *bops = NULL;
 	u32 features;
 
 #ifdef CONFIG_MODULES
@@ -1932,16 +1950,21 @@ static const struct nft_set_ops *nft_select_set_ops(const struct nlattr * const
 		features &= NFT_SET_INTERVAL | NFT_SET_MAP;
 	}
 
-	// FIXME: implement selection properly
 	list_for_each_entry(ops, &nf_tables_set_ops, list) {
 		if ((ops->features & features) != features)
 			continue;
+		if (!nft_set_ops_better(ops, bops, features))
+			continue;
 		if (!try_module_get(ops->owner))
 			continue;
-		return ops;
+		if (bops != NULL)
+			module_put(bops->owner);
+		bops = ops;
 	}
 
-	return ERR_PTR(-EOPNOTSUPP);
+	if (bops == NULL)
+		return ERR_PTR(-EOPNOTSUPP);
+	return bops;
 }
 
 static const struct nla_policy nft_set_policy[NFTA_SET_MAX + 1] = {
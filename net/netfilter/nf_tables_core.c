@@ -13,6 +13,8 @@
 #include <linux/list.h>
 #include <linux/rculist.h>
 #include <linux/skbuff.h>
+#include <linux/filter.h>
+#include <linux/slab.h>
 #include <linux/netlink.h>
 #include <linux/netfilter.h>
 #include <linux/netfilter/nfnetlink.h>
@@ -51,6 +53,9 @@ static bool nft_payload_fast_eval(const struct nft_expr *expr,
 	if (unlikely(ptr + priv->len >= skb_tail_pointer(skb)))
 		return false;
 
+	/* don't leave stale bytes above a narrow load for a following cmp */
+	if (priv->len != 4)
+		dest->data[0] = 0;
 	if (priv->len == 2)
 		*(u16 *)dest->data = *(u16 *)ptr;
 	else if (priv->len == 4)
@@ -60,6 +65,222 @@ static bool nft_payload_fast_eval(const struct nft_expr *expr,
 	return true;
 }
 
+/*
+ * Rules made only of fast payload loads, fast compares and immediates are
+ * translated to internal BPF when they are built, so the JIT can turn
+ * them into straight-line code. The program works on the register file
+ * through struct nft_bpf_ctx and returns NFT_BPF_DONE, or NFT_BPF_FALLBACK
+ * when a payload load would cross the linear area, in which case the rule
+ * is evaluated again by the interpreter below. Expressions only write the
+ * registers, so running the rule twice is harmless.
+ */
+struct nft_bpf_ctx {
+	struct nft_data		*data;
+	const unsigned char	*nh;
+	const unsigned char	*th;
+	const unsigned char	*tail;
+};
+
+#define NFT_BPF_FALLBACK	0
+#define NFT_BPF_DONE		1
+
+/* registers the program keeps the context fields in */
+#define NFT_BPF_DATA		6
+#define NFT_BPF_NH		7
+#define NFT_BPF_TH		8
+#define NFT_BPF_TAIL		9
+
+/* worst case instructions per expression, plus prologue and epilogue */
+#define NFT_BPF_EXPR_INSNS	8
+#define NFT_BPF_EXTRA_INSNS	8
+
+struct nft_bpf_prog {
+	struct sock_filter_int	*insn;
+	unsigned int		len;
+	unsigned int		nfallback;
+	unsigned int		*fallback;
+};
+
+static void nft_bpf_emit(struct nft_bpf_prog *p, u8 code, u8 a_reg,
+			 u8 x_reg, s16 off, s32 imm)
+{
+	struct sock_filter_int *insn = &p->insn[p->len++];
+
+	insn->code = code;
+	insn->a_reg = a_reg;
+	insn->x_reg = x_reg;
+	insn->off = off;
+	insn->imm = imm;
+}
+
+static int nft_bpf_size(unsigned int len)
+{
+	switch (len) {
+	case 1:
+		return BPF_B;
+	case 2:
+		return BPF_H;
+	default:
+		return BPF_W;
+	}
+}
+
+static void nft_bpf_emit_payload(struct nft_bpf_prog *p,
+				 const struct nft_payload *priv)
+{
+	u8 base = priv->base == NFT_PAYLOAD_NETWORK_HEADER ?
+		  NFT_BPF_NH : NFT_BPF_TH;
+
+	/* r0 = base + offset; r1 = r0 + len */
+	nft_bpf_emit(p, BPF_ALU64 | BPF_MOV | BPF_X, 0, base, 0, 0);
+	nft_bpf_emit(p, BPF_ALU64 | BPF_ADD | BPF_K, 0, 0, 0, priv->offset);
+	nft_bpf_emit(p, BPF_ALU64 | BPF_MOV | BPF_X, 1, 0, 0, 0);
+	nft_bpf_emit(p, BPF_ALU64 | BPF_ADD | BPF_K, 1, 0, 0, priv->len);
+	/* if (r1 >= tail) goto fallback, patched in nft_rule_compile() */
+	p->fallback[p->nfallback++] = p->len;
+	nft_bpf_emit(p, BPF_JMP | BPF_JGE | BPF_X, 1, NFT_BPF_TAIL, 0, 0);
+	/* data[dreg] = *(r0), zero extended as in nft_payload_fast_eval() */
+	if (priv->len != 4)
+		nft_bpf_emit(p, BPF_ST | BPF_MEM | BPF_W, NFT_BPF_DATA, 0,
+			     priv->dreg * sizeof(struct nft_data), 0);
+	nft_bpf_emit(p, BPF_LDX | BPF_MEM | nft_bpf_size(priv->len), 2, 0, 0, 0);
+	nft_bpf_emit(p, BPF_STX | BPF_MEM | nft_bpf_size(priv->len),
+		     NFT_BPF_DATA, 2, priv->dreg * sizeof(struct nft_data), 0);
+}
+
+static void nft_bpf_emit_cmp(struct nft_bpf_prog *p,
+			     const struct nft_cmp_fast_expr *priv)
+{
+	/* if ((data[sreg] & mask) == priv->data) continue; */
+	nft_bpf_emit(p, BPF_LDX | BPF_MEM | BPF_W, 2, NFT_BPF_DATA,
+		     priv->sreg * sizeof(struct nft_data), 0);
+	nft_bpf_emit(p, BPF_ALU | BPF_AND | BPF_K, 2, 0, 0,
+		     nft_cmp_fast_mask(priv->len));
+	nft_bpf_emit(p, BPF_ALU | BPF_MOV | BPF_K, 3, 0, 0, priv->data);
+	nft_bpf_emit(p, BPF_JMP | BPF_JEQ | BPF_X, 2, 3, 3, 0);
+	/* else verdict = NFT_BREAK */
+	nft_bpf_emit(p, BPF_ST | BPF_MEM | BPF_W, NFT_BPF_DATA, 0,
+		     offsetof(struct nft_data, verdict), NFT_BREAK);
+	nft_bpf_emit(p, BPF_ALU | BPF_MOV | BPF_K, 0, 0, 0, NFT_BPF_DONE);
+	nft_bpf_emit(p, BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+}
+
+static void nft_bpf_emit_immediate(struct nft_bpf_prog *p,
+				   const struct nft_immediate_expr *priv)
+{
+	unsigned int i;
+
+	/* same as nft_data_copy() */
+	for (i = 0; i < ARRAY_SIZE(priv->data.data); i++)
+		nft_bpf_emit(p, BPF_ST | BPF_MEM | BPF_W, NFT_BPF_DATA, 0,
+			     priv->dreg * sizeof(struct nft_data) +
+			     i * sizeof(u32), priv->data.data[i]);
+
+	if (priv->dreg == NFT_REG_VERDICT &&
+	    priv->data.verdict != NFT_CONTINUE) {
+		nft_bpf_emit(p, BPF_ALU | BPF_MOV | BPF_K, 0, 0, 0, NFT_BPF_DONE);
+		nft_bpf_emit(p, BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+	}
+}
+
+/**
+ *	nft_rule_compile - translate a rule to internal BPF
+ *	@rule: rule whose expressions have been initialized
+ *
+ *	Best effort: rules using other expressions, or a kernel without a
+ *	JIT for internal BPF, leave @rule->prog NULL and keep being
+ *	interpreted by nft_do_chain().
+ */
+void nft_rule_compile(struct nft_rule *rule)
+{
+	const struct nft_expr *expr, *last;
+	struct nft_bpf_prog p = {};
+	struct sk_filter *fp;
+	unsigned int n = 0, i;
+
+	/* the context pointers are loaded as double words */
+	if (!IS_ENABLED(CONFIG_64BIT))
+		return;
+
+	nft_rule_for_each_expr(expr, last, rule) {
+		if (expr->ops != &nft_payload_fast_ops &&
+		    expr->ops != &nft_cmp_fast_ops &&
+		    expr->ops != &nft_imm_ops)
+			return;
+		n++;
+	}
+	if (n == 0)
+		return;
+
+	p.insn = kcalloc(n * NFT_BPF_EXPR_INSNS + NFT_BPF_EXTRA_INSNS,
+			 sizeof(*p.insn), GFP_KERNEL);
+	p.fallback = kcalloc(n, sizeof(*p.fallback), GFP_KERNEL);
+	if (!p.insn || !p.fallback)
+		goto out;
+
+	/* load the context into callee saved registers */
+	nft_bpf_emit(&p, BPF_LDX | BPF_MEM | BPF_DW, NFT_BPF_DATA, ARG1_REG,
+		     offsetof(struct nft_bpf_ctx, data), 0);
+	nft_bpf_emit(&p, BPF_LDX | BPF_MEM | BPF_DW, NFT_BPF_NH, ARG1_REG,
+		     offsetof(struct nft_bpf_ctx, nh), 0);
+	nft_bpf_emit(&p, BPF_LDX | BPF_MEM | BPF_DW, NFT_BPF_TH, ARG1_REG,
+		     offsetof(struct nft_bpf_ctx, th), 0);
+	nft_bpf_emit(&p, BPF_LDX | BPF_MEM | BPF_DW, NFT_BPF_TAIL, ARG1_REG,
+		     offsetof(struct nft_bpf_ctx, tail), 0);
+
+	nft_rule_for_each_expr(expr, last, rule) {
+		if (expr->ops == &nft_payload_fast_ops)
+			nft_bpf_emit_payload(&p, nft_expr_priv(expr));
+		else if (expr->ops == &nft_cmp_fast_ops)
+			nft_bpf_emit_cmp(&p, nft_expr_priv(expr));
+		else
+			nft_bpf_emit_immediate(&p, nft_expr_priv(expr));
+	}
+
+	nft_bpf_emit(&p, BPF_ALU | BPF_MOV | BPF_K, 0, 0, 0, NFT_BPF_DONE);
+	nft_bpf_emit(&p, BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+
+	/* the fallback exit is the last instruction, as the JIT wants */
+	for (i = 0; i < p.nfallback; i++)
+		p.insn[p.fallback[i]].off = p.len - p.fallback[i] - 1;
+	nft_bpf_emit(&p, BPF_ALU | BPF_MOV | BPF_K, 0, 0, 0, NFT_BPF_FALLBACK);
+	nft_bpf_emit(&p, BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+
+	fp = kzalloc(sk_filter_size(p.len), GFP_KERNEL | __GFP_NOWARN);
+	if (!fp)
+		goto out;
+
+	memcpy(fp->insnsi, p.insn, p.len * sizeof(*p.insn));
+	fp->len = p.len;
+	sk_filter_select_runtime(fp);
+
+	/* the BPF interpreter would not beat our own */
+	if (!fp->jited) {
+		sk_filter_free(fp);
+		goto out;
+	}
+	rule->prog = fp;
+out:
+	kfree(p.fallback);
+	kfree(p.insn);
+}
+EXPORT_SYMBOL_GPL(nft_rule_compile);
+
+static bool nft_rule_run_prog(const struct nft_rule *rule,
+			      struct nft_data data[NFT_REG_MAX + 1],
+			      const struct nft_pktinfo *pkt)
+{
+	const struct sk_buff *skb = pkt->skb;
+	struct nft_bpf_ctx ctx = {
+		.data	= data,
+		.nh	= skb_network_header(skb),
+		.th	= skb_network_header(skb) + pkt->xt.thoff,
+		.tail	= skb_tail_pointer(skb),
+	};
+
+	return SK_RUN_FILTER(rule->prog, (void *)&ctx) == NFT_BPF_DONE;
+}
+
 struct nft_jumpstack {
 	const struct nft_chain	*chain;
 	const struct nft_rule	*rule;
@@ -142,6 +363,9 @@ next_rule:
 
 		rulenum++;
 
+		if (rule->prog && nft_rule_run_prog(rule, data, pkt))
+			goto rule_verdict;
+
 		nft_rule_for_each_expr(expr, last, rule) {
 			if (expr->ops == &nft_cmp_fast_ops)
 				nft_cmp_fast_eval(expr, data);
@@ -153,6 +377,7 @@ next_rule:
 				break;
 		}
 
+rule_verdict:
 		switch (data[NFT_REG_VERDICT].verdict) {
 		case NFT_BREAK:
 			data[NFT_REG_VERDICT].verdict = NFT_CONTINUE;
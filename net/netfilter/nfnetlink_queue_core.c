@@ -28,6 +28,13 @@
 #include <linux/netfilter/nfnetlink.h>
 #include <linux/netfilter/nfnetlink_queue.h>
 #include <linux/list.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <linux/icmp.h>
+#include <linux/icmpv6.h>
+#include <net/ip.h>
+#include <net/ipv6.h>
 #include <net/sock.h>
 #include <net/tcp_states.h>
 #include <net/netfilter/nf_queue.h>
@@ -278,6 +285,75 @@ nla_put_failure:
 	return -1;
 }
 
+/* Length of the network and transport headers at the front of the packet,
+ * for queues that only copy headers to userspace.
+ */
+static unsigned int nfqnl_headers_len(const struct nf_queue_entry *entry)
+{
+	const struct sk_buff *skb = entry->skb;
+	unsigned int nhoff = skb_network_offset(skb);
+	int thoff;
+	u8 proto;
+
+	switch (entry->pf) {
+	case NFPROTO_IPV4: {
+		const struct iphdr *iph;
+		struct iphdr _iph;
+
+		iph = skb_header_pointer(skb, nhoff, sizeof(_iph), &_iph);
+		if (iph == NULL)
+			return skb->len;
+		thoff = nhoff + iph->ihl * 4;
+		if (iph->frag_off & htons(IP_OFFSET))
+			return thoff;
+		proto = iph->protocol;
+		break;
+	}
+#if IS_ENABLED(CONFIG_IPV6)
+	case NFPROTO_IPV6: {
+		const struct ipv6hdr *ip6h;
+		struct ipv6hdr _ip6h;
+		__be16 frag_off;
+
+		ip6h = skb_header_pointer(skb, nhoff, sizeof(_ip6h), &_ip6h);
+		if (ip6h == NULL)
+			return skb->len;
+		proto = ip6h->nexthdr;
+		thoff = ipv6_skip_exthdr(skb, nhoff + sizeof(_ip6h), &proto,
+					 &frag_off);
+		if (thoff < 0)
+			return skb->len;
+		if (frag_off & htons(~0x7))
+			return thoff;
+		break;
+	}
+#endif
+	default:
+		return skb->len;
+	}
+
+	switch (proto) {
+	case IPPROTO_TCP: {
+		const struct tcphdr *th;
+		struct tcphdr _th;
+
+		th = skb_header_pointer(skb, thoff, sizeof(_th), &_th);
+		if (th == NULL)
+			return skb->len;
+		return thoff + th->doff * 4;
+	}
+	case IPPROTO_UDP:
+	case IPPROTO_UDPLITE:
+		return thoff + sizeof(struct udphdr);
+	case IPPROTO_ICMP:
+		return thoff + sizeof(struct icmphdr);
+	case IPPROTO_ICMPV6:
+		return thoff + sizeof(struct icmp6hdr);
+	default:
+		return thoff;
+	}
+}
+
 static struct sk_buff *
 nfqnl_build_packet_message(struct net *net, struct nfqnl_instance *queue,
 			   struct nf_queue_entry *entry,
@@ -334,6 +410,9 @@ nfqnl_build_packet_message(struct net *net, struct nfqnl_instance *queue,
 			return NULL;
 
 		data_len = ACCESS_ONCE(queue->copy_range);
+		if (queue->flags & NFQA_CFG_F_HEADERS)
+			data_len = min_t(size_t, data_len,
+					 nfqnl_headers_len(entry));
 		if (data_len > entskb->len)
 			data_len = entskb->len;
 
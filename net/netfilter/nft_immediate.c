@@ -17,12 +17,6 @@
 #include <net/netfilter/nf_tables_core.h>
 #include <net/netfilter/nf_tables.h>
 
-struct nft_immediate_expr {
-	struct nft_data		data;
-	enum nft_registers	dreg:8;
-	u8			dlen;
-};
-
 static void nft_immediate_eval(const struct nft_expr *expr,
 			       struct nft_data data[NFT_REG_MAX + 1],
 			       const struct nft_pktinfo *pkt)
@@ -104,7 +98,7 @@ static int nft_immediate_validate(const struct nft_ctx *ctx,
 }
 
 static struct nft_expr_type nft_imm_type;
-static const struct nft_expr_ops nft_imm_ops = {
+const struct nft_expr_ops nft_imm_ops = {
 	.type		= &nft_imm_type,
 	.size		= NFT_EXPR_SIZE(sizeof(struct nft_immediate_expr)),
 	.eval		= nft_immediate_eval,
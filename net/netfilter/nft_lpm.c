@@ -0,0 +1,205 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Trie set backend. Elements are stored as full length keys, so exact
+ * lookups walk one path of the trie and interval lookups find the
+ * closest lower boundary the same way, in time bound by the key length
+ * rather than the number of elements. Packet path lookups run under
+ * rcu_read_lock(); updates are serialized by the nfnetlink mutex.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables.h>
+#include <net/netfilter/nf_lpm.h>
+
+struct nft_lpm {
+	struct nf_lpm_trie		trie;
+};
+
+struct nft_lpm_elem {
+	u32				flags;
+	struct nft_data			data;
+};
+
+static bool nft_lpm_lookup(const struct nft_set *set,
+			   const struct nft_data *key,
+			   struct nft_data *data)
+{
+	const struct nft_lpm *priv = nft_set_priv(set);
+	const struct nft_lpm_elem *le;
+
+	if (set->flags & NFT_SET_INTERVAL)
+		le = nf_lpm_lookup_le(&priv->trie, (const u8 *)key->data);
+	else
+		le = nf_lpm_lookup_exact(&priv->trie, (const u8 *)key->data,
+					 set->klen * BITS_PER_BYTE);
+	if (le == NULL || le->flags & NFT_SET_ELEM_INTERVAL_END)
+		return false;
+
+	if (set->flags & NFT_SET_MAP)
+		nft_data_copy(data, &le->data);
+	return true;
+}
+
+static int nft_lpm_insert(const struct nft_set *set,
+			  const struct nft_set_elem *elem)
+{
+	struct nft_lpm *priv = nft_set_priv(set);
+	struct nft_lpm_elem le;
+
+	le.flags = elem->flags;
+	if (set->flags & NFT_SET_MAP &&
+	    !(elem->flags & NFT_SET_ELEM_INTERVAL_END))
+		nft_data_copy(&le.data, &elem->data);
+
+	return nf_lpm_insert(&priv->trie, (const u8 *)elem->key.data,
+			     set->klen * BITS_PER_BYTE, &le, GFP_KERNEL);
+}
+
+static void nft_lpm_remove(const struct nft_set *set,
+			   const struct nft_set_elem *elem)
+{
+	struct nft_lpm *priv = nft_set_priv(set);
+
+	nf_lpm_delete(&priv->trie, (const u8 *)elem->key.data,
+		      set->klen * BITS_PER_BYTE);
+}
+
+static int nft_lpm_get(const struct nft_set *set, struct nft_set_elem *elem)
+{
+	const struct nft_lpm *priv = nft_set_priv(set);
+	struct nft_lpm_elem *le;
+
+	le = nf_lpm_lookup_exact(&priv->trie, (const u8 *)elem->key.data,
+				 set->klen * BITS_PER_BYTE);
+	if (le == NULL)
+		return -ENOENT;
+
+	elem->cookie = le;
+	if (set->flags & NFT_SET_MAP &&
+	    !(le->flags & NFT_SET_ELEM_INTERVAL_END))
+		nft_data_copy(&elem->data, &le->data);
+	elem->flags = le->flags;
+	return 0;
+}
+
+struct nft_lpm_walk_arg {
+	const struct nft_ctx		*ctx;
+	const struct nft_set		*set;
+	struct nft_set_iter		*iter;
+};
+
+static int nft_lpm_walk_elem(const u8 *key, unsigned int prefixlen,
+			     void *value, void *arg)
+{
+	const struct nft_lpm_walk_arg *w = arg;
+	const struct nft_lpm_elem *le = value;
+	struct nft_set_iter *iter = w->iter;
+	struct nft_set_elem elem;
+
+	if (iter->count < iter->skip)
+		goto cont;
+
+	memset(&elem.key, 0, sizeof(elem.key));
+	memcpy(elem.key.data, key, w->set->klen);
+	if (w->set->flags & NFT_SET_MAP &&
+	    !(le->flags & NFT_SET_ELEM_INTERVAL_END))
+		nft_data_copy(&elem.data, &le->data);
+	elem.flags = le->flags;
+
+	iter->err = iter->fn(w->ctx, w->set, iter, &elem);
+	if (iter->err < 0)
+		return iter->err;
+cont:
+	iter->count++;
+	return 0;
+}
+
+static void nft_lpm_walk(const struct nft_ctx *ctx,
+			 const struct nft_set *set,
+			 struct nft_set_iter *iter)
+{
+	const struct nft_lpm *priv = nft_set_priv(set);
+	struct nft_lpm_walk_arg w = {
+		.ctx	= ctx,
+		.set	= set,
+		.iter	= iter,
+	};
+	int err;
+
+	err = nf_lpm_walk(&priv->trie, nft_lpm_walk_elem, &w, GFP_KERNEL);
+	if (err < 0)
+		iter->err = err;
+}
+
+static unsigned int nft_lpm_privsize(const struct nlattr * const nla[])
+{
+	return sizeof(struct nft_lpm);
+}
+
+static int nft_lpm_init(const struct nft_set *set,
+			const struct nlattr * const nla[])
+{
+	struct nft_lpm *priv = nft_set_priv(set);
+	unsigned int value_size;
+
+	value_size = offsetof(struct nft_lpm_elem, data);
+	if (set->flags & NFT_SET_MAP)
+		value_size = sizeof(struct nft_lpm_elem);
+
+	return nf_lpm_init(&priv->trie, set->klen, value_size);
+}
+
+static void nft_lpm_elem_destroy(void *value, void *arg)
+{
+	const struct nft_set *set = arg;
+	struct nft_lpm_elem *le = value;
+
+	if (set->flags & NFT_SET_MAP &&
+	    !(le->flags & NFT_SET_ELEM_INTERVAL_END))
+		nft_data_uninit(&le->data, set->dtype);
+}
+
+static void nft_lpm_destroy(const struct nft_set *set)
+{
+	struct nft_lpm *priv = nft_set_priv(set);
+
+	nf_lpm_destroy(&priv->trie, nft_lpm_elem_destroy, (void *)set);
+}
+
+static struct nft_set_ops nft_lpm_ops __read_mostly = {
+	.privsize	= nft_lpm_privsize,
+	.init		= nft_lpm_init,
+	.destroy	= nft_lpm_destroy,
+	.insert		= nft_lpm_insert,
+	.remove		= nft_lpm_remove,
+	.get		= nft_lpm_get,
+	.lookup		= nft_lpm_lookup,
+	.walk		= nft_lpm_walk,
+	.features	= NFT_SET_INTERVAL | NFT_SET_MAP,
+	.class		= NFT_SET_CLASS_O_1,
+	.owner		= THIS_MODULE,
+};
+
+static int __init nft_lpm_module_init(void)
+{
+	return nft_register_set(&nft_lpm_ops);
+}
+
+static void __exit nft_lpm_module_exit(void)
+{
+	nft_unregister_set(&nft_lpm_ops);
+}
+
+module_init(nft_lpm_module_init);
+module_exit(nft_lpm_module_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_ALIAS_NFT_SET();
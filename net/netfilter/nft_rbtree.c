@@ -232,6 +232,7 @@ static struct nft_set_ops nft_rbtree_ops __read_mostly = {
 	.lookup		= nft_rbtree_lookup,
 	.walk		= nft_rbtree_walk,
 	.features	= NFT_SET_INTERVAL | NFT_SET_MAP,
+	.class		= NFT_SET_CLASS_O_LOG_N,
 	.owner		= THIS_MODULE,
 };
 
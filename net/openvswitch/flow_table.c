@@ -40,6 +40,8 @@
 #include <linux/icmp.h>
 #include <linux/icmpv6.h>
 #include <linux/rculist.h>
+#include <linux/percpu.h>
+#include <linux/sort.h>
 #include <net/ip.h>
 #include <net/ipv6.h>
 #include <net/ndisc.h>
@@ -47,6 +49,16 @@
 #define TBL_MIN_BUCKETS		1024
 #define REHASH_INTERVAL		(10 * 60 * HZ)
 
+#define MASK_ARRAY_SIZE_MIN	16
+#define MASK_REBALANCE_INTERVAL	(4 * HZ)
+
+/* The mask cache is probed at up to MC_HASH_SEGS slots, one for each
+ * MC_HASH_SHIFT bit segment of the skb hash.
+ */
+#define MC_HASH_SHIFT		8
+#define MC_HASH_ENTRIES		(1u << MC_HASH_SHIFT)
+#define MC_HASH_SEGS		((sizeof(u32) * 8) / MC_HASH_SHIFT)
+
 static struct kmem_cache *flow_cache;
 
 static u16 range_n_bytes(const struct sw_flow_key_range *range)
@@ -158,25 +170,6 @@ void ovs_flow_free(struct sw_flow *flow, bool deferred)
 	if (!flow)
 		return;
 
-	if (flow->mask) {
-		struct sw_flow_mask *mask = flow->mask;
-
-		/* ovs-lock is required to protect mask-refcount and
-		 * mask list.
-		 */
-		ASSERT_OVSL();
-		BUG_ON(!mask->ref_count);
-		mask->ref_count--;
-
-		if (!mask->ref_count) {
-			list_del_rcu(&mask->list);
-			if (deferred)
-				kfree_rcu(mask, rcu);
-			else
-				kfree(mask);
-		}
-	}
-
 	if (deferred)
 		call_rcu(&flow->rcu, rcu_free_flow_callback);
 	else
@@ -216,18 +209,127 @@ static struct table_instance *table_instance_alloc(int new_size)
 	return ti;
 }
 
+static void __mask_array_destroy(struct mask_array *ma)
+{
+	free_percpu(ma->cache);
+	free_percpu(ma->usage);
+	kfree(ma);
+}
+
+static void mask_array_rcu_cb(struct rcu_head *rcu)
+{
+	struct mask_array *ma = container_of(rcu, struct mask_array, rcu);
+
+	__mask_array_destroy(ma);
+}
+
+static struct mask_array *tbl_mask_array_alloc(int size)
+{
+	struct mask_array *new;
+
+	size = max(MASK_ARRAY_SIZE_MIN, size);
+	new = kzalloc(sizeof(struct mask_array) +
+		      sizeof(struct sw_flow_mask *) * size, GFP_KERNEL);
+	if (!new)
+		return NULL;
+
+	new->cache = __alloc_percpu(sizeof(struct mask_cache_entry) *
+				    MC_HASH_ENTRIES,
+				    __alignof__(struct mask_cache_entry));
+	new->usage = __alloc_percpu(sizeof(u64) * size, __alignof__(u64));
+	if (!new->cache || !new->usage) {
+		__mask_array_destroy(new);
+		return NULL;
+	}
+
+	new->count = 0;
+	new->max = size;
+	return new;
+}
+
+struct mask_usage {
+	struct sw_flow_mask *mask;
+	u64 hits;
+};
+
+static int mask_usage_cmp(const void *a, const void *b)
+{
+	const struct mask_usage *x = a, *y = b;
+
+	if (x->hits > y->hits)
+		return -1;
+	return x->hits < y->hits;
+}
+
+/* Replace the mask array with one of 'size' slots holding the same masks,
+ * packed at the front and, if 'by_usage', sorted by recent hit count.
+ * Mask cache entries and hit counters start afresh.
+ */
+static int tbl_mask_array_realloc(struct flow_table *tbl, int size,
+				  bool by_usage)
+{
+	struct mask_array *old = ovsl_dereference(tbl->mask_array);
+	struct mask_array *new;
+	struct mask_usage *mu;
+	int i, n = 0, cpu;
+
+	new = tbl_mask_array_alloc(size);
+	if (!new)
+		return -ENOMEM;
+
+	mu = kmalloc_array(old->max, sizeof(*mu), GFP_KERNEL);
+	if (!mu) {
+		__mask_array_destroy(new);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < old->max; i++) {
+		struct sw_flow_mask *mask = ovsl_dereference(old->masks[i]);
+
+		if (!mask)
+			continue;
+
+		mu[n].mask = mask;
+		mu[n].hits = 0;
+		if (by_usage)
+			for_each_possible_cpu(cpu)
+				mu[n].hits += per_cpu_ptr(old->usage, cpu)[i];
+		n++;
+	}
+
+	if (by_usage)
+		sort(mu, n, sizeof(*mu), mask_usage_cmp, NULL);
+
+	for (i = 0; i < n; i++)
+		RCU_INIT_POINTER(new->masks[i], mu[i].mask);
+	new->count = n;
+	kfree(mu);
+
+	rcu_assign_pointer(tbl->mask_array, new);
+	call_rcu(&old->rcu, mask_array_rcu_cb);
+	return 0;
+}
+
 int ovs_flow_tbl_init(struct flow_table *table)
 {
 	struct table_instance *ti;
+	struct mask_array *ma;
+
+	ma = tbl_mask_array_alloc(MASK_ARRAY_SIZE_MIN);
+	if (!ma)
+		return -ENOMEM;
 
 	ti = table_instance_alloc(TBL_MIN_BUCKETS);
 
-	if (!ti)
+	if (!ti) {
+		__mask_array_destroy(ma);
 		return -ENOMEM;
+	}
 
 	rcu_assign_pointer(table->ti, ti);
-	INIT_LIST_HEAD(&table->mask_list);
+	rcu_assign_pointer(table->mask_array, ma);
 	table->last_rehash = jiffies;
+	table->last_rebalance = jiffies;
 	table->count = 0;
 	return 0;
 }
@@ -239,7 +341,10 @@ static void flow_tbl_destroy_rcu_cb(struct rcu_head *rcu)
 	__table_instance_destroy(ti);
 }
 
-static void table_instance_destroy(struct table_instance *ti, bool deferred)
+static void flow_mask_remove(struct flow_table *tbl, struct sw_flow_mask *mask);
+
+static void table_instance_destroy(struct flow_table *table,
+				   struct table_instance *ti, bool deferred)
 {
 	int i;
 
@@ -257,6 +362,7 @@ static void table_instance_destroy(struct table_instance *ti, bool deferred)
 
 		hlist_for_each_entry_safe(flow, n, head, hash_node[ver]) {
 			hlist_del_rcu(&flow->hash_node[ver]);
+			flow_mask_remove(table, flow->mask);
 			ovs_flow_free(flow, deferred);
 		}
 	}
@@ -271,8 +377,14 @@ skip_flows:
 void ovs_flow_tbl_destroy(struct flow_table *table, bool deferred)
 {
 	struct table_instance *ti = ovsl_dereference(table->ti);
+	struct mask_array *ma = ovsl_dereference(table->mask_array);
 
-	table_instance_destroy(ti, deferred);
+	table_instance_destroy(table, ti, deferred);
+
+	if (deferred)
+		call_rcu(&ma->rcu, mask_array_rcu_cb);
+	else
+		__mask_array_destroy(ma);
 }
 
 struct sw_flow *ovs_flow_tbl_dump_next(struct table_instance *ti,
@@ -368,7 +480,7 @@ int ovs_flow_tbl_flush(struct flow_table *flow_table)
 	flow_table->last_rehash = jiffies;
 	flow_table->count = 0;
 
-	table_instance_destroy(old_ti, true);
+	table_instance_destroy(flow_table, old_ti, true);
 	return 0;
 }
 
@@ -448,41 +560,118 @@ static struct sw_flow *masked_flow_lookup(struct table_instance *ti,
 	return NULL;
 }
 
-struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
-				    const struct sw_flow_key *key,
-				    u32 *n_mask_hit)
+/* Try the mask at '*index' first, then all the others.  On success
+ * '*index' is set to the slot of the matching mask.
+ */
+static struct sw_flow *flow_lookup(struct table_instance *ti,
+				   const struct mask_array *ma,
+				   const struct sw_flow_key *key,
+				   u32 *n_mask_hit, u32 *index)
 {
-	struct table_instance *ti = rcu_dereference_ovsl(tbl->ti);
 	struct sw_flow_mask *mask;
 	struct sw_flow *flow;
+	int i;
+
+	if (likely(*index < ma->max)) {
+		mask = rcu_dereference_ovsl(ma->masks[*index]);
+		if (mask) {
+			(*n_mask_hit)++;
+			flow = masked_flow_lookup(ti, key, mask);
+			if (flow)
+				return flow;
+		}
+	}
+
+	for (i = 0; i < ma->max; i++) {
+		if (i == *index)
+			continue;
+
+		mask = rcu_dereference_ovsl(ma->masks[i]);
+		if (!mask)
+			continue;
 
-	*n_mask_hit = 0;
-	list_for_each_entry_rcu(mask, &tbl->mask_list, list) {
 		(*n_mask_hit)++;
 		flow = masked_flow_lookup(ti, key, mask);
-		if (flow)  /* Found */
+		if (flow) {  /* Found */
+			*index = i;
 			return flow;
+		}
 	}
+
 	return NULL;
 }
 
+/* Packet path lookup, with BHs disabled.  The mask that matched the last
+ * packet with the same skb hash is tried first, so the steady state of a
+ * flow costs a single masked lookup however many masks there are.
+ */
+struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
+				    const struct sw_flow_key *key,
+				    u32 skb_hash,
+				    u32 *n_mask_hit)
+{
+	struct mask_array *ma = rcu_dereference_ovsl(tbl->mask_array);
+	struct table_instance *ti = rcu_dereference_ovsl(tbl->ti);
+	struct mask_cache_entry *entries, *ce, *e;
+	struct sw_flow *flow;
+	u32 hash = skb_hash;
+	u32 index = 0;
+	int seg;
+
+	*n_mask_hit = 0;
+	if (unlikely(!skb_hash)) {
+		flow = flow_lookup(ti, ma, key, n_mask_hit, &index);
+		goto out;
+	}
+
+	ce = NULL;
+	entries = this_cpu_ptr(ma->cache);
+
+	/* Find the cache entry, or the best one to replace on a miss. */
+	for (seg = 0; seg < MC_HASH_SEGS; seg++) {
+		e = &entries[hash & (MC_HASH_ENTRIES - 1)];
+		if (e->skb_hash == skb_hash) {
+			index = e->mask_index;
+			flow = flow_lookup(ti, ma, key, n_mask_hit, &index);
+			if (flow)
+				e->mask_index = index;
+			else
+				e->skb_hash = 0;
+			goto out;
+		}
+
+		if (!ce || e->skb_hash < ce->skb_hash)
+			ce = e;
+		hash >>= MC_HASH_SHIFT;
+	}
+
+	flow = flow_lookup(ti, ma, key, n_mask_hit, &index);
+	if (flow) {
+		ce->skb_hash = skb_hash;
+		ce->mask_index = index;
+	}
+out:
+	if (flow)
+		this_cpu_ptr(ma->usage)[index]++;
+	return flow;
+}
+
 struct sw_flow *ovs_flow_tbl_lookup(struct flow_table *tbl,
 				    const struct sw_flow_key *key)
 {
-	u32 __always_unused n_mask_hit;
+	struct table_instance *ti = rcu_dereference_ovsl(tbl->ti);
+	struct mask_array *ma = rcu_dereference_ovsl(tbl->mask_array);
+	u32 __always_unused n_mask_hit = 0;
+	u32 index = 0;
 
-	return ovs_flow_tbl_lookup_stats(tbl, key, &n_mask_hit);
+	return flow_lookup(ti, ma, key, &n_mask_hit, &index);
 }
 
 int ovs_flow_tbl_num_masks(const struct flow_table *table)
 {
-	struct sw_flow_mask *mask;
-	int num = 0;
-
-	list_for_each_entry(mask, &table->mask_list, list)
-		num++;
+	struct mask_array *ma = rcu_dereference_ovsl(table->mask_array);
 
-	return num;
+	return ma->count;
 }
 
 static struct table_instance *table_instance_expand(struct table_instance *ti)
@@ -490,6 +679,34 @@ static struct table_instance *table_instance_expand(struct table_instance *ti)
 	return table_instance_rehash(ti, ti->n_buckets * 2);
 }
 
+/* Drop a flow's reference to its mask, and remove the mask from the mask
+ * array once no flow uses it.  Must be called with ovs-lock, which
+ * protects the mask refcount and the mask array.
+ */
+static void flow_mask_remove(struct flow_table *tbl, struct sw_flow_mask *mask)
+{
+	struct mask_array *ma;
+	int i;
+
+	if (!mask)
+		return;
+
+	ASSERT_OVSL();
+	BUG_ON(!mask->ref_count);
+	if (--mask->ref_count)
+		return;
+
+	ma = ovsl_dereference(tbl->mask_array);
+	for (i = 0; i < ma->max; i++) {
+		if (mask == ovsl_dereference(ma->masks[i])) {
+			RCU_INIT_POINTER(ma->masks[i], NULL);
+			ma->count--;
+			break;
+		}
+	}
+	kfree_rcu(mask, rcu);
+}
+
 void ovs_flow_tbl_remove(struct flow_table *table, struct sw_flow *flow)
 {
 	struct table_instance *ti = ovsl_dereference(table->ti);
@@ -497,6 +714,11 @@ void ovs_flow_tbl_remove(struct flow_table *table, struct sw_flow *flow)
 	BUG_ON(table->count == 0);
 	hlist_del_rcu(&flow->hash_node[ti->node_ver]);
 	table->count--;
+
+	/* RCU readers may still be dumping the flow with its mask, both
+	 * are only freed after a grace period so leave the pointer be.
+	 */
+	flow_mask_remove(table, flow->mask);
 }
 
 static struct sw_flow_mask *mask_alloc(void)
@@ -524,19 +746,45 @@ static bool mask_equal(const struct sw_flow_mask *a,
 static struct sw_flow_mask *flow_mask_find(const struct flow_table *tbl,
 					   const struct sw_flow_mask *mask)
 {
-	struct list_head *ml;
+	struct mask_array *ma = ovsl_dereference(tbl->mask_array);
+	int i;
+
+	for (i = 0; i < ma->max; i++) {
+		struct sw_flow_mask *m = ovsl_dereference(ma->masks[i]);
 
-	list_for_each(ml, &tbl->mask_list) {
-		struct sw_flow_mask *m;
-		m = container_of(ml, struct sw_flow_mask, list);
-		if (mask_equal(mask, m))
+		if (m && mask_equal(mask, m))
 			return m;
 	}
 
 	return NULL;
 }
 
-/* Add 'mask' into the mask list, if it is not already there. */
+/* Put 'mask' into a free slot of the mask array, growing it if full. */
+static int tbl_mask_array_add_mask(struct flow_table *tbl,
+				   struct sw_flow_mask *mask)
+{
+	struct mask_array *ma = ovsl_dereference(tbl->mask_array);
+	int i, err;
+
+	if (ma->count >= ma->max) {
+		err = tbl_mask_array_realloc(tbl, ma->max * 2, false);
+		if (err)
+			return err;
+		ma = ovsl_dereference(tbl->mask_array);
+	}
+
+	for (i = 0; i < ma->max; i++) {
+		if (!ovsl_dereference(ma->masks[i]))
+			break;
+	}
+	BUG_ON(i == ma->max);
+
+	rcu_assign_pointer(ma->masks[i], mask);
+	ma->count++;
+	return 0;
+}
+
+/* Add 'mask' into the mask array, if it is not already there. */
 static int flow_mask_insert(struct flow_table *tbl, struct sw_flow *flow,
 			    struct sw_flow_mask *new)
 {
@@ -549,7 +797,10 @@ static int flow_mask_insert(struct flow_table *tbl, struct sw_flow *flow,
 			return -ENOMEM;
 		mask->key = new->key;
 		mask->range = new->range;
-		list_add_rcu(&mask->list, &tbl->mask_list);
+		if (tbl_mask_array_add_mask(tbl, mask)) {
+			kfree(mask);
+			return -ENOMEM;
+		}
 	} else {
 		BUG_ON(!mask->ref_count);
 		mask->ref_count++;
@@ -584,9 +835,18 @@ int ovs_flow_tbl_insert(struct flow_table *table, struct sw_flow *flow,
 
 	if (new_ti) {
 		rcu_assign_pointer(table->ti, new_ti);
-		table_instance_destroy(ti, true);
+		table_instance_destroy(table, ti, true);
 		table->last_rehash = jiffies;
 	}
+
+	/* Move the most used masks to the front of the mask walk. */
+	if (time_after(jiffies, table->last_rebalance +
+				MASK_REBALANCE_INTERVAL)) {
+		struct mask_array *ma = ovsl_dereference(table->mask_array);
+
+		tbl_mask_array_realloc(table, ma->max, true);
+		table->last_rebalance = jiffies;
+	}
 	return 0;
 }
 
@@ -45,10 +45,31 @@ struct table_instance {
 	bool keep_flows;
 };
 
+/* Per-CPU exact match cache in front of the mask walk: remembers, by
+ * skb hash, which mask matched the last packet of a flow.
+ */
+struct mask_cache_entry {
+	u32 skb_hash;
+	u32 mask_index;
+};
+
+/* Masks are kept in an array, so that cached indices can be checked and
+ * the array can be reordered by hit count.  The cache and the hit
+ * counters refer to array slots and live and die with the array.
+ */
+struct mask_array {
+	struct rcu_head rcu;
+	int count, max;
+	struct mask_cache_entry __percpu *cache;
+	u64 __percpu *usage;
+	struct sw_flow_mask __rcu *masks[];
+};
+
 struct flow_table {
 	struct table_instance __rcu *ti;
-	struct list_head mask_list;
+	struct mask_array __rcu *mask_array;
 	unsigned long last_rehash;
+	unsigned long last_rebalance;
 	unsigned int count;
 };
 
@@ -71,6 +92,7 @@ struct sw_flow *ovs_flow_tbl_dump_next(struct table_instance *table,
 				       u32 *bucket, u32 *idx);
 struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *,
 				    const struct sw_flow_key *,
+				    u32 skb_hash,
 				    u32 *n_mask_hit);
 struct sw_flow *ovs_flow_tbl_lookup(struct flow_table *,
 				    const struct sw_flow_key *);
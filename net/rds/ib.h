@@ -15,6 +15,8 @@
 #define RDS_IB_MAX_SGE			8
 #define RDS_IB_RECV_SGE 		2
 
+#define RDS_IB_MAX_FRAG_SIZE		(16 * 1024)
+
 #define RDS_IB_DEFAULT_RECV_WR		1024
 #define RDS_IB_DEFAULT_SEND_WR		256
 
@@ -28,9 +30,10 @@ extern struct rw_semaphore rds_ib_devices_lock;
 extern struct list_head rds_ib_devices;
 
 /*
- * IB posts RDS_FRAG_SIZE fragments of pages to the receive queues to
- * try and minimize the amount of memory tied up both the device and
- * socket receive queues.
+ * IB posts fragments of pages to the receive queues to try and minimize
+ * the amount of memory tied up both the device and socket receive queues.
+ * Fragments are RDS_FRAG_SIZE unless both peers negotiated a larger
+ * i_frag_sz, in which case they may span a compound page.
  */
 struct rds_page_frag {
 	struct list_head	f_item;
@@ -62,7 +65,7 @@ struct rds_ib_connect_private {
 	u8			dp_protocol_major;
 	u8			dp_protocol_minor;
 	__be16			dp_protocol_minor_mask; /* bitmask */
-	__be32			dp_reserved1;
+	__be32			dp_frag_sz;		/* 0 means RDS_FRAG_SIZE */
 	__be64			dp_ack_seq;
 	__be32			dp_credit;		/* non-zero enables flow ctl */
 };
@@ -118,6 +121,7 @@ struct rds_ib_connection {
 	struct rds_ib_work_ring	i_recv_ring;
 	struct rds_ib_incoming	*i_ibinc;
 	u32			i_recv_data_rem;
+	u32			i_frag_sz;	/* negotiated fragment size */
 	struct rds_header	*i_recv_hdrs;
 	u64			i_recv_hdrs_dma;
 	struct rds_ib_recv_work *i_recvs;
@@ -368,6 +372,7 @@ extern unsigned long rds_ib_sysctl_max_recv_wr;
 extern unsigned long rds_ib_sysctl_max_unsig_wrs;
 extern unsigned long rds_ib_sysctl_max_unsig_bytes;
 extern unsigned long rds_ib_sysctl_max_recv_allocation;
+extern unsigned long rds_ib_sysctl_max_frag_size;
 extern unsigned int rds_ib_sysctl_flow_control;
 
 #endif
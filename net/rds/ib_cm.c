@@ -93,6 +93,54 @@ static void rds_ib_set_flow_control(struct rds_connection *conn, u32 credits)
 	}
 }
 
+/*
+ * The largest receive fragment we are willing to use on this connection.
+ * Every send work request carries one header and enough page sized data
+ * segments to fill a fragment, so the device's max_sge bounds it as well.
+ */
+static u32 rds_ib_frag_size_max(struct rds_ib_connection *ic)
+{
+	u32 frag_sz = rounddown_pow_of_two(rds_ib_sysctl_max_frag_size);
+
+	frag_sz = clamp_t(u32, frag_sz, RDS_FRAG_SIZE, RDS_IB_MAX_FRAG_SIZE);
+	while (frag_sz > RDS_FRAG_SIZE &&
+	       DIV_ROUND_UP(frag_sz, PAGE_SIZE) + 1 > ic->rds_ibdev->max_sge)
+		frag_sz >>= 1;
+
+	return frag_sz;
+}
+
+/*
+ * Settle on the smaller of the two fragment sizes. Peers that predate
+ * the negotiation send 0 and get RDS_FRAG_SIZE.
+ */
+static void rds_ib_set_frag_size(struct rds_connection *conn, u32 peer_frag_sz)
+{
+	struct rds_ib_connection *ic = conn->c_transport_data;
+
+	if (peer_frag_sz < RDS_FRAG_SIZE || !is_power_of_2(peer_frag_sz))
+		ic->i_frag_sz = RDS_FRAG_SIZE;
+	else
+		ic->i_frag_sz = min(peer_frag_sz, rds_ib_frag_size_max(ic));
+}
+
+/*
+ * The passive side settled on the size in its REP. Take it as long as it
+ * is no larger than what we offered in i_frag_sz, rather than recomputing
+ * ours, which changes if the sysctl is lowered in between.
+ */
+static void rds_ib_accept_frag_size(struct rds_connection *conn,
+				    u32 peer_frag_sz)
+{
+	struct rds_ib_connection *ic = conn->c_transport_data;
+
+	if (peer_frag_sz < RDS_FRAG_SIZE || !is_power_of_2(peer_frag_sz) ||
+	    peer_frag_sz > ic->i_frag_sz)
+		ic->i_frag_sz = RDS_FRAG_SIZE;
+	else
+		ic->i_frag_sz = peer_frag_sz;
+}
+
 /*
  * Tune RNR behavior. Without flow control, we use a rather
  * low timeout, but not the absolute minimum - this should
@@ -138,6 +186,8 @@ void rds_ib_cm_connect_complete(struct rds_connection *conn, struct rdma_cm_even
 				RDS_PROTOCOL(dp->dp_protocol_major,
 				dp->dp_protocol_minor));
 			rds_ib_set_flow_control(conn, be32_to_cpu(dp->dp_credit));
+			rds_ib_accept_frag_size(conn,
+						be32_to_cpu(dp->dp_frag_sz));
 		}
 	}
 
@@ -150,11 +200,13 @@ void rds_ib_cm_connect_complete(struct rds_connection *conn, struct rdma_cm_even
 		rds_conn_destroy(conn);
 		return;
 	} else {
-		printk(KERN_NOTICE "RDS/IB: connected to %pI4 version %u.%u%s\n",
+		printk(KERN_NOTICE "RDS/IB: connected to %pI4 version %u.%u%s, "
+		       "frag size %u\n",
 		       &conn->c_faddr,
 		       RDS_PROTOCOL_MAJOR(conn->c_version),
 		       RDS_PROTOCOL_MINOR(conn->c_version),
-		       ic->i_flowctl ? ", flow control" : "");
+		       ic->i_flowctl ? ", flow control" : "",
+		       ic->i_frag_sz);
 	}
 
 	/*
@@ -216,6 +268,7 @@ static void rds_ib_cm_fill_conn_param(struct rds_connection *conn,
 		dp->dp_protocol_minor = RDS_PROTOCOL_MINOR(protocol_version);
 		dp->dp_protocol_minor_mask = cpu_to_be16(RDS_IB_SUPPORTED_PROTOCOLS);
 		dp->dp_ack_seq = rds_ib_piggyb_ack(ic);
+		dp->dp_frag_sz = cpu_to_be32(ic->i_frag_sz);
 
 		/* Advertise flow control */
 		if (ic->i_flowctl) {
@@ -521,6 +574,8 @@ int rds_ib_cm_handle_connect(struct rdma_cm_id *cm_id,
 		goto out;
 	}
 
+	rds_ib_set_frag_size(conn, be32_to_cpu(dp->dp_frag_sz));
+
 	rds_ib_cm_fill_conn_param(conn, &conn_param, &dp_rep, version,
 		event->param.conn.responder_resources,
 		event->param.conn.initiator_depth);
@@ -558,6 +613,9 @@ int rds_ib_cm_initiate_connect(struct rdma_cm_id *cm_id)
 		goto out;
 	}
 
+	/* Offer our largest fragment, the REP carries the peer's choice */
+	ic->i_frag_sz = rds_ib_frag_size_max(ic);
+
 	rds_ib_cm_fill_conn_param(conn, &conn_param, &dp, RDS_PROTOCOL_VERSION,
 		UINT_MAX, UINT_MAX);
 	ret = rdma_connect(cm_id, &conn_param);
@@ -759,6 +817,7 @@ int rds_ib_conn_alloc(struct rds_connection *conn, gfp_t gfp)
 	}
 
 	INIT_LIST_HEAD(&ic->ib_node);
+	ic->i_frag_sz = RDS_FRAG_SIZE;
 	tasklet_init(&ic->i_recv_tasklet, rds_ib_recv_tasklet_fn,
 		     (unsigned long) ic);
 	mutex_init(&ic->i_recv_mutex);
@@ -66,7 +66,7 @@ void rds_ib_recv_init_ring(struct rds_ib_connection *ic)
 
 		sge = &recv->r_sge[1];
 		sge->addr = 0;
-		sge->length = RDS_FRAG_SIZE;
+		sge->length = ic->i_frag_sz;
 		sge->lkey = ic->i_mr->lkey;
 	}
 }
@@ -151,6 +151,13 @@ static void rds_ib_cache_splice_all_lists(struct rds_ib_refill_cache *cache,
 	}
 }
 
+/* Release a cached frag along with the page it holds */
+static void rds_ib_frag_drop(struct rds_page_frag *frag)
+{
+	put_page(sg_page(&frag->f_sg));
+	kmem_cache_free(rds_ib_frag_slab, frag);
+}
+
 void rds_ib_recv_free_caches(struct rds_ib_connection *ic)
 {
 	struct rds_ib_incoming *inc;
@@ -176,7 +183,7 @@ void rds_ib_recv_free_caches(struct rds_ib_connection *ic)
 	list_for_each_entry_safe(frag, frag_tmp, &list, f_cache_entry) {
 		list_del(&frag->f_cache_entry);
 		WARN_ON(!list_empty(&frag->f_item));
-		kmem_cache_free(rds_ib_frag_slab, frag);
+		rds_ib_frag_drop(frag);
 	}
 }
 
@@ -270,21 +277,45 @@ static struct rds_ib_incoming *rds_ib_refill_one_inc(struct rds_ib_connection *i
 static struct rds_page_frag *rds_ib_refill_one_frag(struct rds_ib_connection *ic,
 						    gfp_t slab_mask, gfp_t page_mask)
 {
-	struct rds_page_frag *frag;
+	struct rds_page_frag *frag = NULL;
 	struct list_head *cache_item;
+	struct page *page;
 	int ret;
 
-	cache_item = rds_ib_recv_cache_get(&ic->i_cache_frags);
-	if (cache_item) {
+	/* Frags cached before the fragment size was renegotiated don't fit */
+	while ((cache_item = rds_ib_recv_cache_get(&ic->i_cache_frags))) {
 		frag = container_of(cache_item, struct rds_page_frag, f_cache_entry);
-	} else {
+		if (frag->f_sg.length == ic->i_frag_sz)
+			break;
+		rds_ib_frag_drop(frag);
+		frag = NULL;
+	}
+
+	if (!frag) {
 		frag = kmem_cache_alloc(rds_ib_frag_slab, slab_mask);
 		if (!frag)
 			return NULL;
 
 		sg_init_table(&frag->f_sg, 1);
-		ret = rds_page_remainder_alloc(&frag->f_sg,
-					       RDS_FRAG_SIZE, page_mask);
+		if (ic->i_frag_sz > PAGE_SIZE) {
+			/*
+			 * The copy and congestion map paths address the
+			 * whole frag through a single kmap, so keep it out
+			 * of highmem.
+			 */
+			page = alloc_pages((page_mask & ~__GFP_HIGHMEM) |
+					   __GFP_COMP | __GFP_NOWARN,
+					   get_order(ic->i_frag_sz));
+			if (page) {
+				sg_set_page(&frag->f_sg, page, ic->i_frag_sz, 0);
+				ret = 0;
+			} else {
+				ret = -ENOMEM;
+			}
+		} else {
+			ret = rds_page_remainder_alloc(&frag->f_sg,
+						       ic->i_frag_sz, page_mask);
+		}
 		if (ret) {
 			kmem_cache_free(rds_ib_frag_slab, frag);
 			return NULL;
@@ -347,10 +378,44 @@ out:
 	return ret;
 }
 
+/*
+ * Post a chain of @nr refilled work requests with a single doorbell.
+ * Returns the number that made it onto the queue pair; the rest are
+ * handed back to the ring.
+ */
+static unsigned int rds_ib_recv_post(struct rds_connection *conn,
+				     struct ib_recv_wr *first, unsigned int nr)
+{
+	struct rds_ib_connection *ic = conn->c_transport_data;
+	struct ib_recv_wr *failed_wr;
+	struct ib_recv_wr *wr;
+	unsigned int unposted = 0;
+	int ret;
+
+	if (!nr)
+		return 0;
+
+	/* XXX when can this fail? */
+	ret = ib_post_recv(ic->i_cm_id->qp, first, &failed_wr);
+	rdsdebug("recv wr %p nr %u ret %d\n", first, nr, ret);
+	if (ret) {
+		for (wr = failed_wr; wr; wr = wr->next)
+			unposted++;
+		rds_ib_ring_unalloc(&ic->i_recv_ring, unposted);
+		rds_ib_conn_error(conn, "recv post on "
+		       "%pI4 returned %d, disconnecting and "
+		       "reconnecting\n", &conn->c_faddr,
+		       ret);
+	}
+
+	return nr - unposted;
+}
+
 /*
  * This tries to allocate and post unused work requests after making sure that
  * they have all the allocations they need to queue received fragments into
- * sockets.
+ * sockets.  Work requests are chained and posted RDS_IB_RECYCLE_BATCH_COUNT
+ * at a time rather than one ib_post_recv() per fragment.
  *
  * -1 is returned if posting fails due to temporary resource exhaustion.
  */
@@ -358,9 +423,12 @@ void rds_ib_recv_refill(struct rds_connection *conn, int prefill)
 {
 	struct rds_ib_connection *ic = conn->c_transport_data;
 	struct rds_ib_recv_work *recv;
-	struct ib_recv_wr *failed_wr;
+	struct ib_recv_wr *first = NULL;
+	struct ib_recv_wr *last = NULL;
 	unsigned int posted = 0;
-	int ret = 0;
+	unsigned int batch = 0;
+	unsigned int nr;
+	int ret;
 	u32 pos;
 
 	while ((prefill || rds_conn_up(conn)) &&
@@ -374,34 +442,39 @@ void rds_ib_recv_refill(struct rds_connection *conn, int prefill)
 		recv = &ic->i_recvs[pos];
 		ret = rds_ib_recv_refill_one(conn, recv, prefill);
 		if (ret) {
+			rds_ib_ring_unalloc(&ic->i_recv_ring, 1);
 			break;
 		}
 
-		/* XXX when can this fail? */
-		ret = ib_post_recv(ic->i_cm_id->qp, &recv->r_wr, &failed_wr);
-		rdsdebug("recv %p ibinc %p page %p addr %lu ret %d\n", recv,
+		rdsdebug("recv %p ibinc %p page %p addr %lu\n", recv,
 			 recv->r_ibinc, sg_page(&recv->r_frag->f_sg),
 			 (long) ib_sg_dma_address(
 				ic->i_cm_id->device,
-				&recv->r_frag->f_sg),
-			ret);
-		if (ret) {
-			rds_ib_conn_error(conn, "recv post on "
-			       "%pI4 returned %d, disconnecting and "
-			       "reconnecting\n", &conn->c_faddr,
-			       ret);
-			break;
-		}
+				&recv->r_frag->f_sg));
 
-		posted++;
+		recv->r_wr.next = NULL;
+		if (last)
+			last->next = &recv->r_wr;
+		else
+			first = &recv->r_wr;
+		last = &recv->r_wr;
+
+		if (++batch == RDS_IB_RECYCLE_BATCH_COUNT) {
+			nr = rds_ib_recv_post(conn, first, batch);
+			posted += nr;
+			if (nr != batch)
+				goto out;
+			first = last = NULL;
+			batch = 0;
+		}
 	}
 
+	posted += rds_ib_recv_post(conn, first, batch);
+
+out:
 	/* We're doing flow control - update the window. */
 	if (ic->i_flowctl && posted)
 		rds_ib_advertise_credits(conn, posted);
-
-	if (ret)
-		rds_ib_ring_unalloc(&ic->i_recv_ring, 1);
 }
 
 /*
@@ -490,7 +563,7 @@ int rds_ib_inc_copy_to_user(struct rds_incoming *inc, struct iovec *first_iov,
 	len = be32_to_cpu(inc->i_hdr.h_len);
 
 	while (copied < size && copied < len) {
-		if (frag_off == RDS_FRAG_SIZE) {
+		if (frag_off == frag->f_sg.length) {
 			frag = list_entry(frag->f_item.next,
 					  struct rds_page_frag, f_item);
 			frag_off = 0;
@@ -500,7 +573,8 @@ int rds_ib_inc_copy_to_user(struct rds_incoming *inc, struct iovec *first_iov,
 			iov++;
 		}
 
-		to_copy = min(iov->iov_len - iov_off, RDS_FRAG_SIZE - frag_off);
+		to_copy = min(iov->iov_len - iov_off,
+			      frag->f_sg.length - frag_off);
 		to_copy = min_t(size_t, to_copy, size - copied);
 		to_copy = min_t(unsigned long, to_copy, len - copied);
 
@@ -764,7 +838,7 @@ static void rds_ib_cong_recv(struct rds_connection *conn,
 		uint64_t *src, *dst;
 		unsigned int k;
 
-		to_copy = min(RDS_FRAG_SIZE - frag_off, PAGE_SIZE - map_off);
+		to_copy = min(frag->f_sg.length - frag_off, PAGE_SIZE - map_off);
 		BUG_ON(to_copy & 7); /* Must be 64bit aligned. */
 
 		addr = kmap_atomic(sg_page(&frag->f_sg));
@@ -788,7 +862,7 @@ static void rds_ib_cong_recv(struct rds_connection *conn,
 		}
 
 		frag_off += to_copy;
-		if (frag_off == RDS_FRAG_SIZE) {
+		if (frag_off == frag->f_sg.length) {
 			frag = list_entry(frag->f_item.next,
 					  struct rds_page_frag, f_item);
 			frag_off = 0;
@@ -913,8 +987,8 @@ static void rds_ib_process_recv(struct rds_connection *conn,
 	list_add_tail(&recv->r_frag->f_item, &ibinc->ii_frags);
 	recv->r_frag = NULL;
 
-	if (ic->i_recv_data_rem > RDS_FRAG_SIZE)
-		ic->i_recv_data_rem -= RDS_FRAG_SIZE;
+	if (ic->i_recv_data_rem > ic->i_frag_sz)
+		ic->i_recv_data_rem -= ic->i_frag_sz;
 	else {
 		ic->i_recv_data_rem = 0;
 		ic->i_ibinc = NULL;
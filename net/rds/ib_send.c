@@ -222,7 +222,7 @@ static struct rds_message *rds_ib_send_unmap_op(struct rds_ib_connection *ic,
 void rds_ib_send_init_ring(struct rds_ib_connection *ic)
 {
 	struct rds_ib_send_work *send;
-	u32 i;
+	u32 i, j;
 
 	for (i = 0, send = ic->i_sends; i < ic->i_send_ring.w_nr; i++, send++) {
 		struct ib_sge *sge;
@@ -238,7 +238,8 @@ void rds_ib_send_init_ring(struct rds_ib_connection *ic)
 		sge->length = sizeof(struct rds_header);
 		sge->lkey = ic->i_mr->lkey;
 
-		send->s_sge[1].lkey = ic->i_mr->lkey;
+		for (j = 1; j < RDS_IB_MAX_SGE; j++)
+			send->s_sge[j].lkey = ic->i_mr->lkey;
 	}
 }
 
@@ -560,7 +561,7 @@ int rds_ib_xmit(struct rds_connection *conn, struct rds_message *rm,
 	if (be32_to_cpu(rm->m_inc.i_hdr.h_len) == 0)
 		i = 1;
 	else
-		i = ceil(be32_to_cpu(rm->m_inc.i_hdr.h_len), RDS_FRAG_SIZE);
+		i = ceil(be32_to_cpu(rm->m_inc.i_hdr.h_len), ic->i_frag_sz);
 
 	work_alloc = rds_ib_ring_alloc(&ic->i_send_ring, i, &pos);
 	if (work_alloc == 0) {
@@ -661,7 +662,9 @@ int rds_ib_xmit(struct rds_connection *conn, struct rds_message *rm,
 	scat = &ic->i_data_op->op_sg[sg];
 	i = 0;
 	do {
-		unsigned int len = 0;
+		struct ib_sge *sge;
+		unsigned int frag_len;
+		unsigned int len;
 
 		/* Set up the header */
 		send->s_wr.send_flags = send_flags;
@@ -677,15 +680,24 @@ int rds_ib_xmit(struct rds_connection *conn, struct rds_message *rm,
 
 		memcpy(&ic->i_send_hdrs[pos], &rm->m_inc.i_hdr, sizeof(struct rds_header));
 
-		/* Set up the data, if present */
-		if (i < work_alloc
-		    && scat != &rm->data.op_sg[rm->data.op_count]) {
-			len = min(RDS_FRAG_SIZE, ib_sg_dma_len(dev, scat) - off);
-			send->s_wr.num_sge = 2;
-
-			send->s_sge[1].addr = ib_sg_dma_address(dev, scat) + off;
-			send->s_sge[1].length = len;
-
+		/*
+		 * Set up the data, if present.  A fragment larger than a
+		 * page is gathered from consecutive scatterlist entries,
+		 * rds_ib_frag_size_max() made sure they fit in max_sge.
+		 */
+		frag_len = 0;
+		while (i < work_alloc
+		       && scat != &rm->data.op_sg[rm->data.op_count]
+		       && frag_len < ic->i_frag_sz
+		       && send->s_wr.num_sge < ic->rds_ibdev->max_sge) {
+			len = min(ic->i_frag_sz - frag_len,
+				  ib_sg_dma_len(dev, scat) - off);
+
+			sge = &send->s_sge[send->s_wr.num_sge++];
+			sge->addr = ib_sg_dma_address(dev, scat) + off;
+			sge->length = len;
+
+			frag_len += len;
 			bytes_sent += len;
 			off += len;
 			if (off == ib_sg_dma_len(dev, scat)) {
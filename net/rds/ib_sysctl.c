@@ -41,6 +41,7 @@ static struct ctl_table_header *rds_ib_sysctl_hdr;
 unsigned long rds_ib_sysctl_max_send_wr = RDS_IB_DEFAULT_SEND_WR;
 unsigned long rds_ib_sysctl_max_recv_wr = RDS_IB_DEFAULT_RECV_WR;
 unsigned long rds_ib_sysctl_max_recv_allocation = (128 * 1024 * 1024) / RDS_FRAG_SIZE;
+unsigned long rds_ib_sysctl_max_frag_size = RDS_FRAG_SIZE;
 static unsigned long rds_ib_sysctl_max_wr_min = 1;
 /* hardware will fail CQ creation long before this */
 static unsigned long rds_ib_sysctl_max_wr_max = (u32)~0;
@@ -49,6 +50,9 @@ unsigned long rds_ib_sysctl_max_unsig_wrs = 16;
 static unsigned long rds_ib_sysctl_max_unsig_wr_min = 1;
 static unsigned long rds_ib_sysctl_max_unsig_wr_max = 64;
 
+static unsigned long rds_ib_sysctl_frag_size_min = RDS_FRAG_SIZE;
+static unsigned long rds_ib_sysctl_frag_size_max = RDS_IB_MAX_FRAG_SIZE;
+
 /*
  * This sysctl does nothing.
  *
@@ -96,6 +100,15 @@ static struct ctl_table rds_ib_sysctl_table[] = {
 		.mode           = 0644,
 		.proc_handler   = proc_doulongvec_minmax,
 	},
+	{
+		.procname       = "max_frag_size",
+		.data		= &rds_ib_sysctl_max_frag_size,
+		.maxlen         = sizeof(unsigned long),
+		.mode           = 0644,
+		.proc_handler   = proc_doulongvec_minmax,
+		.extra1		= &rds_ib_sysctl_frag_size_min,
+		.extra2		= &rds_ib_sysctl_frag_size_max,
+	},
 	{
 		.procname	= "flow_control",
 		.data		= &rds_ib_sysctl_flow_control,
@@ -273,6 +273,11 @@ static u32 flow_key_get(struct sk_buff *skb, int key, struct flow_keys *flow)
 			  (1 << FLOW_KEY_NFCT_PROTO_SRC) |	\
 			  (1 << FLOW_KEY_NFCT_PROTO_DST))
 
+#define FLOW_PORTS_NEEDED ((1 << FLOW_KEY_PROTO_SRC) |		\
+			   (1 << FLOW_KEY_PROTO_DST) |		\
+			   (1 << FLOW_KEY_NFCT_PROTO_SRC) |	\
+			   (1 << FLOW_KEY_NFCT_PROTO_DST))
+
 static int flow_classify(struct sk_buff *skb, const struct tcf_proto *tp,
 			 struct tcf_result *res)
 {
@@ -292,7 +297,9 @@ static int flow_classify(struct sk_buff *skb, const struct tcf_proto *tp,
 
 		keymask = f->keymask;
 		if (keymask & FLOW_KEYS_NEEDED)
-			skb_flow_dissect(skb, &flow_keys);
+			__skb_flow_dissect(skb, &flow_keys,
+					   keymask & FLOW_PORTS_NEEDED ? 0 :
+					   FLOW_DISSECTOR_F_STOP_AT_L3);
 
 		for (n = 0; n < f->nkeys; n++) {
 			key = ffs(keymask) - 1;
@@ -324,7 +324,7 @@ static struct Qdisc *qdisc_leaf(struct Qdisc *p, u32 classid)
 
 /* Find queueing discipline by name */
 
-static struct Qdisc_ops *qdisc_lookup_ops(struct nlattr *kind)
+struct Qdisc_ops *qdisc_lookup_ops(struct nlattr *kind)
 {
 	struct Qdisc_ops *q = NULL;
 
@@ -341,6 +341,7 @@ static struct Qdisc_ops *qdisc_lookup_ops(struct nlattr *kind)
 	}
 	return q;
 }
+EXPORT_SYMBOL(qdisc_lookup_ops);
 
 /* The linklayer setting were not transferred from iproute2, in older
  * versions, and the rate tables lookup systems have been dropped in
@@ -45,17 +45,76 @@ EXPORT_SYMBOL(default_qdisc_ops);
  * - updates to tree and tree walking are only done under the rtnl mutex.
  */
 
+/*
+ * q->gso_skb of a root qdisc holds either a GSO skb, possibly with the
+ * segments not sent yet linked to it, or a chain of skbs from a bulk
+ * dequeue. A chain only ever has a GSO skb at its end.
+ */
+static inline unsigned int qdisc_skb_chain_len(const struct sk_buff *skb)
+{
+	unsigned int n = 1;
+
+	if (skb_is_gso(skb))
+		return 1;
+	while ((skb = skb->next) != NULL)
+		n++;
+	return n;
+}
+
+static inline void qdisc_free_skb_chain(struct sk_buff *skb)
+{
+	if (skb && skb_is_gso(skb))
+		kfree_skb(skb);
+	else
+		kfree_skb_list(skb);
+}
+
 static inline int dev_requeue_skb(struct sk_buff *skb, struct Qdisc *q)
 {
 	skb_dst_force(skb);
 	q->gso_skb = skb;
 	q->qstats.requeues++;
-	q->q.qlen++;	/* it's still part of the queue */
+	q->q.qlen += qdisc_skb_chain_len(skb);	/* it's still part of the queue */
 	__netif_schedule(q);
 
 	return 0;
 }
 
+static inline int qdisc_avail_bulklimit(const struct netdev_queue *txq)
+{
+#ifdef CONFIG_BQL
+	/* Drivers without BQL report no room, which disables bulking */
+	return dql_avail(&txq->dql);
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Dequeue more skbs behind @skb while BQL says @txq has room for them, so
+ * that the driver gets them as one batch and rings its doorbell once.
+ */
+static void try_bulk_dequeue_skb(struct Qdisc *q, struct sk_buff *skb,
+				 const struct netdev_queue *txq)
+{
+	int bytelimit = qdisc_avail_bulklimit(txq) - skb->len;
+
+	while (bytelimit > 0) {
+		struct sk_buff *nskb = q->dequeue(q);
+
+		if (!nskb)
+			break;
+
+		bytelimit -= nskb->len;
+		skb->next = nskb;
+		skb = nskb;
+		/* it may end up partially sent, so it has to come last */
+		if (skb_is_gso(nskb))
+			break;
+	}
+	skb->next = NULL;
+}
+
 static inline struct sk_buff *dequeue_skb(struct Qdisc *q)
 {
 	struct sk_buff *skb = q->gso_skb;
@@ -66,17 +125,59 @@ static inline struct sk_buff *dequeue_skb(struct Qdisc *q)
 		txq = netdev_get_tx_queue(txq->dev, skb_get_queue_mapping(skb));
 		if (!netif_xmit_frozen_or_stopped(txq)) {
 			q->gso_skb = NULL;
-			q->q.qlen--;
+			q->q.qlen -= qdisc_skb_chain_len(skb);
 		} else
 			skb = NULL;
 	} else {
-		if (!(q->flags & TCQ_F_ONETXQUEUE) || !netif_xmit_frozen_or_stopped(txq))
+		if (!(q->flags & TCQ_F_ONETXQUEUE) || !netif_xmit_frozen_or_stopped(txq)) {
 			skb = q->dequeue(q);
+			/* all skbs of a one-queue qdisc go to the same txq */
+			if (skb && (q->flags & TCQ_F_ONETXQUEUE) &&
+			    !skb_is_gso(skb))
+				try_bulk_dequeue_skb(q, skb, txq);
+		}
 	}
 
 	return skb;
 }
 
+/*
+ * Hand what dequeue_skb() returned to the driver, with xmit_more set on
+ * every skb of a chain but the last. On failure *skbp is left at the part
+ * of the chain that was not sent.
+ */
+static int dev_xmit_skb_chain(struct sk_buff **skbp, struct net_device *dev,
+			      struct netdev_queue *txq)
+{
+	struct sk_buff *skb = *skbp;
+	int ret;
+
+	if (skb_is_gso(skb))
+		return dev_hard_start_xmit(skb, dev, txq, false);
+
+	for (;;) {
+		struct sk_buff *next = skb->next;
+
+		skb->next = NULL;
+		ret = dev_hard_start_xmit(skb, dev, txq, next != NULL);
+		if (!dev_xmit_complete(ret)) {
+			/* a GSO skb at the end keeps its own segment list */
+			if (next)
+				skb->next = next;
+			break;
+		}
+		skb = next;
+		if (!skb)
+			break;
+		if (netif_xmit_frozen_or_stopped(txq)) {
+			ret = NETDEV_TX_BUSY;
+			break;
+		}
+	}
+	*skbp = skb;
+	return ret;
+}
+
 static inline int handle_dev_cpu_collision(struct sk_buff *skb,
 					   struct netdev_queue *dev_queue,
 					   struct Qdisc *q)
@@ -90,7 +191,7 @@ static inline int handle_dev_cpu_collision(struct sk_buff *skb,
 		 * detect it by checking xmit owner and drop the packet when
 		 * deadloop is detected. Return OK to try the next skb.
 		 */
-		kfree_skb(skb);
+		qdisc_free_skb_chain(skb);
 		net_warn_ratelimited("Dead loop on netdevice %s, fix it urgently!\n",
 				     dev_queue->dev->name);
 		ret = qdisc_qlen(q);
@@ -107,9 +208,9 @@ static inline int handle_dev_cpu_collision(struct sk_buff *skb,
 }
 
 /*
- * Transmit one skb, and handle the return status as required. Holding the
- * __QDISC_STATE_RUNNING bit guarantees that only one CPU can execute this
- * function.
+ * Transmit one skb, or a chain of them from a bulk dequeue, and handle the
+ * return status as required. Holding the __QDISC_STATE_RUNNING bit
+ * guarantees that only one CPU can execute this function.
  *
  * Returns to the caller:
  *				0  - queue is empty or throttled.
@@ -126,7 +227,7 @@ int sch_direct_xmit(struct sk_buff *skb, struct Qdisc *q,
 
 	HARD_TX_LOCK(dev, txq, smp_processor_id());
 	if (!netif_xmit_frozen_or_stopped(txq))
-		ret = dev_hard_start_xmit(skb, dev, txq);
+		ret = dev_xmit_skb_chain(&skb, dev, txq);
 
 	HARD_TX_UNLOCK(dev, txq);
 
@@ -616,7 +717,7 @@ void qdisc_reset(struct Qdisc *qdisc)
 		ops->reset(qdisc);
 
 	if (qdisc->gso_skb) {
-		kfree_skb(qdisc->gso_skb);
+		qdisc_free_skb_chain(qdisc->gso_skb);
 		qdisc->gso_skb = NULL;
 		qdisc->q.qlen = 0;
 	}
@@ -652,7 +753,7 @@ void qdisc_destroy(struct Qdisc *qdisc)
 	module_put(ops->owner);
 	dev_put(qdisc_dev(qdisc));
 
-	kfree_skb(qdisc->gso_skb);
+	qdisc_free_skb_chain(qdisc->gso_skb);
 	/*
 	 * gen_estimator est_timer() might access qdisc->q.lock,
 	 * wait a RCU grace period before freeing qdisc.
@@ -177,19 +177,12 @@ static u32 hhf_time_stamp(void)
 }
 
 static unsigned int skb_hash(const struct hhf_sched_data *q,
-			     const struct sk_buff *skb)
+			     struct sk_buff *skb)
 {
-	struct flow_keys keys;
-	unsigned int hash;
-
 	if (skb->sk && skb->sk->sk_hash)
 		return skb->sk->sk_hash;
 
-	skb_flow_dissect(skb, &keys);
-	hash = jhash_3words((__force u32)keys.dst,
-			    (__force u32)keys.src ^ keys.ip_proto,
-			    (__force u32)keys.ports, q->perturbation);
-	return hash;
+	return skb_get_hash_perturb(skb, q->perturbation);
 }
 
 /* Looks up a heavy-hitter flow in a chaining list of table T. */
@@ -12,6 +12,7 @@
 #include <linux/slab.h>
 #include <linux/kernel.h>
 #include <linux/export.h>
+#include <linux/module.h>
 #include <linux/string.h>
 #include <linux/errno.h>
 #include <linux/skbuff.h>
@@ -20,6 +21,12 @@
 
 struct mq_sched {
 	struct Qdisc		**qdiscs;
+	struct Qdisc_ops	*ops;	/* kind of the per-queue qdiscs */
+};
+
+static const struct nla_policy mq_policy[TCA_MQ_MAX + 1] = {
+	[TCA_MQ_KIND]		= { .type = NLA_STRING, .len = IFNAMSIZ - 1 },
+	[TCA_MQ_OPTIONS]	= { .type = NLA_NESTED },
 };
 
 static void mq_destroy(struct Qdisc *sch)
@@ -28,6 +35,8 @@ static void mq_destroy(struct Qdisc *sch)
 	struct mq_sched *priv = qdisc_priv(sch);
 	unsigned int ntx;
 
+	if (priv->ops)
+		module_put(priv->ops->owner);
 	if (!priv->qdiscs)
 		return;
 	for (ntx = 0; ntx < dev->num_tx_queues && priv->qdiscs[ntx]; ntx++)
@@ -35,13 +44,39 @@ static void mq_destroy(struct Qdisc *sch)
 	kfree(priv->qdiscs);
 }
 
+/* Apply the shared options to every per-queue qdisc of our kind */
+static int mq_change_qdiscs(struct Qdisc *sch, struct nlattr *qopt)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	struct mq_sched *priv = qdisc_priv(sch);
+	struct Qdisc *qdisc;
+	unsigned int ntx;
+	int err;
+
+	for (ntx = 0; ntx < dev->num_tx_queues; ntx++) {
+		if (priv->qdiscs)
+			qdisc = priv->qdiscs[ntx];
+		else
+			qdisc = netdev_get_tx_queue(dev, ntx)->qdisc_sleeping;
+		if (qdisc->ops != priv->ops)
+			continue;
+		err = qdisc->ops->change(qdisc, qopt);
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
 static int mq_init(struct Qdisc *sch, struct nlattr *opt)
 {
 	struct net_device *dev = qdisc_dev(sch);
 	struct mq_sched *priv = qdisc_priv(sch);
+	struct nlattr *tb[TCA_MQ_MAX + 1];
 	struct netdev_queue *dev_queue;
+	struct nlattr *qopt = NULL;
 	struct Qdisc *qdisc;
 	unsigned int ntx;
+	int err;
 
 	if (sch->parent != TC_H_ROOT)
 		return -EOPNOTSUPP;
@@ -49,29 +84,87 @@ static int mq_init(struct Qdisc *sch, struct nlattr *opt)
 	if (!netif_is_multiqueue(dev))
 		return -EOPNOTSUPP;
 
+	if (opt) {
+		err = nla_parse_nested(tb, TCA_MQ_MAX, opt, mq_policy);
+		if (err < 0)
+			return err;
+		if (tb[TCA_MQ_KIND]) {
+			priv->ops = qdisc_lookup_ops(tb[TCA_MQ_KIND]);
+			if (!priv->ops)
+				return -ENOENT;
+		}
+		qopt = tb[TCA_MQ_OPTIONS];
+	}
+	if (!priv->ops) {
+		if (!try_module_get(default_qdisc_ops->owner))
+			return -ENOENT;
+		priv->ops = (struct Qdisc_ops *)default_qdisc_ops;
+	}
+	/* from here on mq_destroy() drops the ops module reference */
+	if (qopt && !priv->ops->change) {
+		err = -EOPNOTSUPP;
+		goto err;
+	}
+
 	/* pre-allocate qdiscs, attachment can't fail */
 	priv->qdiscs = kcalloc(dev->num_tx_queues, sizeof(priv->qdiscs[0]),
 			       GFP_KERNEL);
-	if (priv->qdiscs == NULL)
-		return -ENOMEM;
+	if (priv->qdiscs == NULL) {
+		err = -ENOMEM;
+		goto err;
+	}
 
 	for (ntx = 0; ntx < dev->num_tx_queues; ntx++) {
 		dev_queue = netdev_get_tx_queue(dev, ntx);
-		qdisc = qdisc_create_dflt(dev_queue, default_qdisc_ops,
+		qdisc = qdisc_create_dflt(dev_queue, priv->ops,
 					  TC_H_MAKE(TC_H_MAJ(sch->handle),
 						    TC_H_MIN(ntx + 1)));
-		if (qdisc == NULL)
+		if (qdisc == NULL) {
+			err = -ENOMEM;
 			goto err;
+		}
 		priv->qdiscs[ntx] = qdisc;
 		qdisc->flags |= TCQ_F_ONETXQUEUE;
 	}
 
+	if (qopt) {
+		err = mq_change_qdiscs(sch, qopt);
+		if (err)
+			goto err;
+	}
+
 	sch->flags |= TCQ_F_MQROOT;
 	return 0;
 
 err:
 	mq_destroy(sch);
-	return -ENOMEM;
+	priv->ops = NULL;
+	priv->qdiscs = NULL;
+	return err;
+}
+
+static int mq_change(struct Qdisc *sch, struct nlattr *opt)
+{
+	struct mq_sched *priv = qdisc_priv(sch);
+	struct nlattr *tb[TCA_MQ_MAX + 1];
+	int err;
+
+	if (!opt)
+		return 0;
+
+	err = nla_parse_nested(tb, TCA_MQ_MAX, opt, mq_policy);
+	if (err < 0)
+		return err;
+
+	/* the kind only changes by replacing the qdisc */
+	if (tb[TCA_MQ_KIND] && nla_strcmp(tb[TCA_MQ_KIND], priv->ops->id))
+		return -EINVAL;
+	if (!tb[TCA_MQ_OPTIONS])
+		return 0;
+	if (!priv->ops->change)
+		return -EOPNOTSUPP;
+
+	return mq_change_qdiscs(sch, tb[TCA_MQ_OPTIONS]);
 }
 
 static void mq_attach(struct Qdisc *sch)
@@ -99,9 +192,17 @@ static void mq_attach(struct Qdisc *sch)
 static int mq_dump(struct Qdisc *sch, struct sk_buff *skb)
 {
 	struct net_device *dev = qdisc_dev(sch);
+	struct mq_sched *priv = qdisc_priv(sch);
+	struct nlattr *opts;
 	struct Qdisc *qdisc;
 	unsigned int ntx;
 
+	opts = nla_nest_start(skb, TCA_OPTIONS);
+	if (opts == NULL ||
+	    nla_put_string(skb, TCA_MQ_KIND, priv->ops->id))
+		goto nla_put_failure;
+	nla_nest_end(skb, opts);
+
 	sch->q.qlen = 0;
 	memset(&sch->bstats, 0, sizeof(sch->bstats));
 	memset(&sch->qstats, 0, sizeof(sch->qstats));
@@ -120,6 +221,10 @@ static int mq_dump(struct Qdisc *sch, struct sk_buff *skb)
 		spin_unlock_bh(qdisc_lock(qdisc));
 	}
 	return 0;
+
+nla_put_failure:
+	nla_nest_cancel(skb, opts);
+	return -1;
 }
 
 static struct netdev_queue *mq_queue_get(struct Qdisc *sch, unsigned long cl)
@@ -243,6 +348,7 @@ struct Qdisc_ops mq_qdisc_ops __read_mostly = {
 	.init		= mq_init,
 	.destroy	= mq_destroy,
 	.attach		= mq_attach,
+	.change		= mq_change,
 	.dump		= mq_dump,
 	.owner		= THIS_MODULE,
 };
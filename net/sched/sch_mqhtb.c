@@ -0,0 +1,564 @@
+/*
+ * net/sched/sch_mqhtb.c	Hierarchical rate limiting for multiqueue devices
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	as published by the Free Software Foundation; either version
+ *	2 of the License, or (at your option) any later version.
+ *
+ *  A two level shaper (root rate, classes with a guaranteed rate and a
+ *  ceiling) meant to be attached to every TX queue through mq :
+ *
+ *	tc qdisc add dev eth0 root handle 1: mq kind mqhtb rate ... class ...
+ *
+ *  Each TX queue gets its own mqhtb instance, with its own qdisc lock and
+ *  its own per class packet queues. All instances below the same parent
+ *  share one set of token buckets, so the limits apply to the device as a
+ *  whole, but no lock is shared between TX queues.
+ *
+ *  Buckets are GCRA style : each holds the theoretical arrival time (tat)
+ *  of the next byte, advanced with cmpxchg by whichever queue sends. A
+ *  packet conforms when tat <= now + burst.
+ *
+ *  dequeue() : first serves classes under their guaranteed rate, then lets
+ *  classes borrow up to their ceiling while the root bucket conforms.
+ *  Classes are served round robin in both passes. If every backlogged
+ *  class is over limit, the watchdog is armed for the earliest time one of
+ *  them may send again.
+ *
+ *  Classification : skb->priority major:minor, where major is the handle of
+ *  the mq parent and minor selects class 1..N. Everything else goes to the
+ *  default class.
+ */
+
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <linux/list.h>
+#include <linux/rtnetlink.h>
+#include <net/netlink.h>
+#include <net/pkt_sched.h>
+
+#define MQHTB_MAXCLASSES	TC_MQHTB_MAXCLASSES
+
+struct mqhtb_rate {
+	struct psched_ratecfg	cfg;		/* rate_bytes_ps == 0 : not limited */
+	u64			burst_ns;
+};
+
+/* configuration, replaced as a whole under RCU */
+struct mqhtb_params {
+	unsigned int		nclasses;
+	unsigned int		defcls;		/* index of the default class */
+	u32			burst;
+	struct mqhtb_rate	root;
+	struct mqhtb_rate	rate[MQHTB_MAXCLASSES];
+	struct mqhtb_rate	ceil[MQHTB_MAXCLASSES];
+	struct rcu_head		rcu;
+};
+
+struct mqhtb_class_tat {
+	atomic64_t		rate;
+	atomic64_t		ceil;
+} ____cacheline_aligned_in_smp;
+
+/* one per (device, parent) pair, shared by all TX queue instances */
+struct mqhtb_shared {
+	struct list_head	list;
+	struct net_device	*dev;
+	u32			handle;
+	int			refcnt;		/* protected by RTNL */
+	struct mqhtb_params __rcu *params;
+
+	atomic64_t		root_tat ____cacheline_aligned_in_smp;
+	struct mqhtb_class_tat	tat[MQHTB_MAXCLASSES];
+};
+
+struct mqhtb_sched_data {
+	struct mqhtb_shared	*shared;
+	unsigned long		active;		/* bitmap of non empty queues */
+	unsigned int		rotor;
+	struct sk_buff_head	queues[MQHTB_MAXCLASSES];
+
+	u32			stat_borrows;
+	u32			stat_throttled;
+	struct qdisc_watchdog	watchdog;
+};
+
+static LIST_HEAD(mqhtb_shared_list);
+
+static bool mqhtb_conform(const struct mqhtb_rate *r, atomic64_t *tat, u64 now)
+{
+	return !r->cfg.rate_bytes_ps ||
+	       (u64)atomic64_read(tat) <= now + r->burst_ns;
+}
+
+/* earliest time the bucket conforms again, 0 if it already does */
+static u64 mqhtb_conform_time(const struct mqhtb_rate *r, atomic64_t *tat)
+{
+	u64 t;
+
+	if (!r->cfg.rate_bytes_ps)
+		return 0;
+	t = atomic64_read(tat);
+	return t > r->burst_ns ? t - r->burst_ns : 0;
+}
+
+static void mqhtb_charge(const struct mqhtb_rate *r, atomic64_t *tat,
+			 unsigned int len, u64 now)
+{
+	u64 cost, old, new;
+
+	if (!r->cfg.rate_bytes_ps)
+		return;
+
+	cost = psched_l2t_ns(&r->cfg, len);
+	do {
+		old = atomic64_read(tat);
+		new = max(old, now) + cost;
+	} while (atomic64_cmpxchg(tat, old, new) != old);
+}
+
+static unsigned int mqhtb_classify(const struct mqhtb_shared *sh,
+				   const struct mqhtb_params *p,
+				   const struct sk_buff *skb)
+{
+	u32 prio = skb->priority;
+
+	if (!p)
+		return 0;
+	if (TC_H_MAJ(prio) == sh->handle &&
+	    TC_H_MIN(prio) >= 1 && TC_H_MIN(prio) <= p->nclasses)
+		return TC_H_MIN(prio) - 1;
+	return p->defcls;
+}
+
+static int mqhtb_enqueue(struct sk_buff *skb, struct Qdisc *sch)
+{
+	struct mqhtb_sched_data *q = qdisc_priv(sch);
+	struct mqhtb_params *p = NULL;
+	unsigned int cl;
+
+	if (unlikely(sch->q.qlen >= sch->limit))
+		return qdisc_drop(skb, sch);
+
+	rcu_read_lock_bh();
+	if (q->shared)
+		p = rcu_dereference_bh(q->shared->params);
+	cl = mqhtb_classify(q->shared, p, skb);
+	rcu_read_unlock_bh();
+
+	__skb_queue_tail(&q->queues[cl], skb);
+	__set_bit(cl, &q->active);
+	sch->qstats.backlog += qdisc_pkt_len(skb);
+	sch->q.qlen++;
+	return NET_XMIT_SUCCESS;
+}
+
+static struct sk_buff *mqhtb_take(struct Qdisc *sch, unsigned int cl)
+{
+	struct mqhtb_sched_data *q = qdisc_priv(sch);
+	struct sk_buff *skb = __skb_dequeue(&q->queues[cl]);
+
+	if (skb_queue_empty(&q->queues[cl]))
+		__clear_bit(cl, &q->active);
+	q->rotor = (cl + 1) % MQHTB_MAXCLASSES;
+	sch->qstats.backlog -= qdisc_pkt_len(skb);
+	sch->q.qlen--;
+	qdisc_unthrottled(sch);
+	qdisc_bstats_update(sch, skb);
+	return skb;
+}
+
+static struct sk_buff *mqhtb_dequeue(struct Qdisc *sch)
+{
+	struct mqhtb_sched_data *q = qdisc_priv(sch);
+	struct mqhtb_shared *sh = q->shared;
+	struct sk_buff *skb = NULL;
+	struct mqhtb_params *p;
+	u64 now, t, next = ~0ULL;
+	unsigned int i, cl, len;
+
+	if (!q->active)
+		return NULL;
+
+	if (!sh)
+		return mqhtb_take(sch, __ffs(q->active));
+
+	now = ktime_to_ns(ktime_get());
+	rcu_read_lock_bh();
+	p = rcu_dereference_bh(sh->params);
+
+	/* pass 1 : classes still within their guaranteed rate */
+	for (i = 0; i < MQHTB_MAXCLASSES; i++) {
+		cl = (q->rotor + i) % MQHTB_MAXCLASSES;
+		if (!test_bit(cl, &q->active) || !p->rate[cl].cfg.rate_bytes_ps ||
+		    !mqhtb_conform(&p->rate[cl], &sh->tat[cl].rate, now))
+			continue;
+		len = qdisc_pkt_len(skb_peek(&q->queues[cl]));
+		mqhtb_charge(&p->rate[cl], &sh->tat[cl].rate, len, now);
+		mqhtb_charge(&p->ceil[cl], &sh->tat[cl].ceil, len, now);
+		mqhtb_charge(&p->root, &sh->root_tat, len, now);
+		skb = mqhtb_take(sch, cl);
+		goto out;
+	}
+
+	/* pass 2 : borrow up to the class ceiling, bounded by the root */
+	if (mqhtb_conform(&p->root, &sh->root_tat, now)) {
+		for (i = 0; i < MQHTB_MAXCLASSES; i++) {
+			cl = (q->rotor + i) % MQHTB_MAXCLASSES;
+			if (!test_bit(cl, &q->active) ||
+			    !mqhtb_conform(&p->ceil[cl], &sh->tat[cl].ceil, now))
+				continue;
+			len = qdisc_pkt_len(skb_peek(&q->queues[cl]));
+			mqhtb_charge(&p->ceil[cl], &sh->tat[cl].ceil, len, now);
+			mqhtb_charge(&p->root, &sh->root_tat, len, now);
+			q->stat_borrows++;
+			skb = mqhtb_take(sch, cl);
+			goto out;
+		}
+	}
+
+	/* everybody is over limit : wake up when the first one conforms */
+	for_each_set_bit(cl, &q->active, MQHTB_MAXCLASSES) {
+		t = max(mqhtb_conform_time(&p->ceil[cl], &sh->tat[cl].ceil),
+			mqhtb_conform_time(&p->root, &sh->root_tat));
+		if (p->rate[cl].cfg.rate_bytes_ps)
+			t = min(t, mqhtb_conform_time(&p->rate[cl],
+						      &sh->tat[cl].rate));
+		next = min(next, t);
+	}
+	q->stat_throttled++;
+	sch->qstats.overlimits++;
+	qdisc_watchdog_schedule_ns(&q->watchdog, max(next, now + 1));
+out:
+	rcu_read_unlock_bh();
+	return skb;
+}
+
+static void mqhtb_reset(struct Qdisc *sch)
+{
+	struct mqhtb_sched_data *q = qdisc_priv(sch);
+	unsigned int i;
+
+	for (i = 0; i < MQHTB_MAXCLASSES; i++)
+		__skb_queue_purge(&q->queues[i]);
+	q->active = 0;
+	sch->qstats.backlog = 0;
+	sch->q.qlen = 0;
+	qdisc_watchdog_cancel(&q->watchdog);
+}
+
+/* shared buckets are keyed by device and the major of the mq parent */
+static u32 mqhtb_handle(const struct Qdisc *sch)
+{
+	if (sch->parent == TC_H_ROOT)
+		return TC_H_MAJ(sch->handle);
+	return TC_H_MAJ(sch->parent);
+}
+
+static void mqhtb_shared_put(struct mqhtb_shared *sh)
+{
+	ASSERT_RTNL();
+
+	if (--sh->refcnt)
+		return;
+	list_del(&sh->list);
+	if (rtnl_dereference(sh->params))
+		kfree_rcu(rtnl_dereference(sh->params), rcu);
+	kfree(sh);
+}
+
+static struct mqhtb_shared *mqhtb_shared_get(struct Qdisc *sch)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	u32 handle = mqhtb_handle(sch);
+	struct mqhtb_shared *sh;
+
+	ASSERT_RTNL();
+
+	list_for_each_entry(sh, &mqhtb_shared_list, list) {
+		if (sh->dev == dev && sh->handle == handle) {
+			sh->refcnt++;
+			return sh;
+		}
+	}
+
+	sh = kzalloc(sizeof(*sh), GFP_KERNEL);
+	if (!sh)
+		return NULL;
+	sh->dev = dev;
+	sh->handle = handle;
+	sh->refcnt = 1;
+	list_add(&sh->list, &mqhtb_shared_list);
+	return sh;
+}
+
+static void mqhtb_set_rate(struct mqhtb_rate *r, u64 rate, u32 burst)
+{
+	struct tc_ratespec conf = {
+		.linklayer	= TC_LINKLAYER_ETHERNET,
+	};
+
+	psched_ratecfg_precompute(&r->cfg, &conf, rate);
+	r->burst_ns = rate ? psched_l2t_ns(&r->cfg, burst) : 0;
+}
+
+static const struct nla_policy mqhtb_policy[TCA_MQHTB_MAX + 1] = {
+	[TCA_MQHTB_RATE]	= { .type = NLA_U64 },
+	[TCA_MQHTB_BURST]	= { .type = NLA_U32 },
+	[TCA_MQHTB_LIMIT]	= { .type = NLA_U32 },
+	[TCA_MQHTB_DEFCLS]	= { .type = NLA_U32 },
+	[TCA_MQHTB_CLASS]	= { .type = NLA_NESTED },
+};
+
+static const struct nla_policy mqhtb_class_policy[TCA_MQHTB_CLASS_MAX + 1] = {
+	[TCA_MQHTB_CLASS_RATE]	= { .type = NLA_U64 },
+	[TCA_MQHTB_CLASS_CEIL]	= { .type = NLA_U64 },
+};
+
+static int mqhtb_parse(struct mqhtb_params *p, struct nlattr *opt,
+		       struct nlattr **tb, const struct mqhtb_params *old,
+		       u32 mtu)
+{
+	struct nlattr *tbc[TCA_MQHTB_CLASS_MAX + 1];
+	u64 root = 0, rate, ceil;
+	unsigned int n = 0;
+	struct nlattr *nla;
+	int rem, err;
+
+	p->burst = old ? old->burst : 10 * mtu;
+	if (tb[TCA_MQHTB_BURST])
+		p->burst = max(nla_get_u32(tb[TCA_MQHTB_BURST]), mtu);
+
+	if (old)
+		root = old->root.cfg.rate_bytes_ps;
+	if (tb[TCA_MQHTB_RATE])
+		root = nla_get_u64(tb[TCA_MQHTB_RATE]);
+	mqhtb_set_rate(&p->root, root, p->burst);
+
+	/* classes are replaced as a set, or kept if none is given */
+	if (!tb[TCA_MQHTB_CLASS]) {
+		if (!old) {
+			/* a single class, only bound by the root rate */
+			p->nclasses = 1;
+			return 0;
+		}
+		n = old->nclasses;
+		for (rem = 0; rem < n; rem++) {
+			mqhtb_set_rate(&p->rate[rem],
+				       old->rate[rem].cfg.rate_bytes_ps,
+				       p->burst);
+			mqhtb_set_rate(&p->ceil[rem],
+				       old->ceil[rem].cfg.rate_bytes_ps,
+				       p->burst);
+		}
+	} else {
+		nla_for_each_nested(nla, opt, rem) {
+			if (nla_type(nla) != TCA_MQHTB_CLASS)
+				continue;
+			if (n == MQHTB_MAXCLASSES)
+				return -E2BIG;
+			err = nla_parse_nested(tbc, TCA_MQHTB_CLASS_MAX, nla,
+					       mqhtb_class_policy);
+			if (err < 0)
+				return err;
+			rate = tbc[TCA_MQHTB_CLASS_RATE] ?
+			       nla_get_u64(tbc[TCA_MQHTB_CLASS_RATE]) : 0;
+			ceil = tbc[TCA_MQHTB_CLASS_CEIL] ?
+			       nla_get_u64(tbc[TCA_MQHTB_CLASS_CEIL]) : 0;
+			if (ceil && ceil < rate)
+				return -EINVAL;
+			mqhtb_set_rate(&p->rate[n], rate, p->burst);
+			mqhtb_set_rate(&p->ceil[n], ceil, p->burst);
+			n++;
+		}
+	}
+	p->nclasses = n;
+
+	p->defcls = old ? old->defcls : 0;
+	if (tb[TCA_MQHTB_DEFCLS]) {
+		u32 minor = nla_get_u32(tb[TCA_MQHTB_DEFCLS]);
+
+		if (minor < 1 || minor > n)
+			return -EINVAL;
+		p->defcls = minor - 1;
+	}
+	if (p->defcls >= n)
+		return -EINVAL;
+	return 0;
+}
+
+static int mqhtb_change(struct Qdisc *sch, struct nlattr *opt)
+{
+	struct mqhtb_sched_data *q = qdisc_priv(sch);
+	struct nlattr *tb[TCA_MQHTB_MAX + 1];
+	struct mqhtb_params *p, *old;
+	struct mqhtb_shared *sh;
+	int err, drop_count = 0;
+
+	if (!opt)
+		return -EINVAL;
+
+	err = nla_parse_nested(tb, TCA_MQHTB_MAX, opt, mqhtb_policy);
+	if (err < 0)
+		return err;
+
+	sh = q->shared;
+	if (!sh) {
+		sh = mqhtb_shared_get(sch);
+		if (!sh)
+			return -ENOMEM;
+	}
+
+	p = kzalloc(sizeof(*p), GFP_KERNEL);
+	if (!p) {
+		err = -ENOMEM;
+		goto err;
+	}
+	old = rtnl_dereference(sh->params);
+	err = mqhtb_parse(p, opt, tb, old, psched_mtu(qdisc_dev(sch)));
+	if (err) {
+		kfree(p);
+		goto err;
+	}
+
+	/* every TX queue below the parent picks up the new parameters */
+	rcu_assign_pointer(sh->params, p);
+	if (old)
+		kfree_rcu(old, rcu);
+
+	sch_tree_lock(sch);
+	q->shared = sh;
+	if (tb[TCA_MQHTB_LIMIT])
+		sch->limit = nla_get_u32(tb[TCA_MQHTB_LIMIT]);
+	while (sch->q.qlen > sch->limit) {
+		unsigned int cl = fls(q->active) - 1;
+
+		kfree_skb(mqhtb_take(sch, cl));
+		drop_count++;
+	}
+	qdisc_tree_decrease_qlen(sch, drop_count);
+	sch_tree_unlock(sch);
+	return 0;
+
+err:
+	if (!q->shared)
+		mqhtb_shared_put(sh);
+	return err;
+}
+
+static void mqhtb_destroy(struct Qdisc *sch)
+{
+	struct mqhtb_sched_data *q = qdisc_priv(sch);
+
+	mqhtb_reset(sch);
+	if (q->shared)
+		mqhtb_shared_put(q->shared);
+}
+
+static int mqhtb_init(struct Qdisc *sch, struct nlattr *opt)
+{
+	struct mqhtb_sched_data *q = qdisc_priv(sch);
+	unsigned int i;
+
+	for (i = 0; i < MQHTB_MAXCLASSES; i++)
+		__skb_queue_head_init(&q->queues[i]);
+	sch->limit = qdisc_dev(sch)->tx_queue_len ? : 1;
+	qdisc_watchdog_init(&q->watchdog, sch);
+
+	/* without options (e.g. created by mq) we are a plain fifo */
+	if (opt)
+		return mqhtb_change(sch, opt);
+	return 0;
+}
+
+static int mqhtb_dump(struct Qdisc *sch, struct sk_buff *skb)
+{
+	struct mqhtb_sched_data *q = qdisc_priv(sch);
+	struct nlattr *opts, *nest;
+	struct mqhtb_params *p;
+	unsigned int i;
+
+	opts = nla_nest_start(skb, TCA_OPTIONS);
+	if (opts == NULL)
+		goto nla_put_failure;
+
+	if (nla_put_u32(skb, TCA_MQHTB_LIMIT, sch->limit))
+		goto nla_put_failure;
+
+	p = q->shared ? rtnl_dereference(q->shared->params) : NULL;
+	if (!p)
+		return nla_nest_end(skb, opts);
+
+	if (nla_put_u64(skb, TCA_MQHTB_RATE, p->root.cfg.rate_bytes_ps) ||
+	    nla_put_u32(skb, TCA_MQHTB_BURST, p->burst) ||
+	    nla_put_u32(skb, TCA_MQHTB_DEFCLS, p->defcls + 1))
+		goto nla_put_failure;
+
+	for (i = 0; i < p->nclasses; i++) {
+		nest = nla_nest_start(skb, TCA_MQHTB_CLASS);
+		if (nest == NULL ||
+		    nla_put_u64(skb, TCA_MQHTB_CLASS_RATE,
+				p->rate[i].cfg.rate_bytes_ps) ||
+		    nla_put_u64(skb, TCA_MQHTB_CLASS_CEIL,
+				p->ceil[i].cfg.rate_bytes_ps))
+			goto nla_put_failure;
+		nla_nest_end(skb, nest);
+	}
+
+	return nla_nest_end(skb, opts);
+
+nla_put_failure:
+	nla_nest_cancel(skb, opts);
+	return -1;
+}
+
+static int mqhtb_dump_stats(struct Qdisc *sch, struct gnet_dump *d)
+{
+	struct mqhtb_sched_data *q = qdisc_priv(sch);
+	struct mqhtb_params *p;
+	struct tc_mqhtb_xstats st = {
+		.borrows	= q->stat_borrows,
+		.throttled	= q->stat_throttled,
+	};
+
+	p = q->shared ? rtnl_dereference(q->shared->params) : NULL;
+	if (p)
+		st.classes = p->nclasses;
+
+	return gnet_stats_copy_app(d, &st, sizeof(st));
+}
+
+static struct Qdisc_ops mqhtb_qdisc_ops __read_mostly = {
+	.id		=	"mqhtb",
+	.priv_size	=	sizeof(struct mqhtb_sched_data),
+
+	.enqueue	=	mqhtb_enqueue,
+	.dequeue	=	mqhtb_dequeue,
+	.peek		=	qdisc_peek_dequeued,
+	.init		=	mqhtb_init,
+	.reset		=	mqhtb_reset,
+	.destroy	=	mqhtb_destroy,
+	.change		=	mqhtb_change,
+	.dump		=	mqhtb_dump,
+	.dump_stats	=	mqhtb_dump_stats,
+	.owner		=	THIS_MODULE,
+};
+
+static int __init mqhtb_module_init(void)
+{
+	return register_qdisc(&mqhtb_qdisc_ops);
+}
+
+static void __exit mqhtb_module_exit(void)
+{
+	unregister_qdisc(&mqhtb_qdisc_ops);
+}
+
+module_init(mqhtb_module_init)
+module_exit(mqhtb_module_exit)
+MODULE_LICENSE("GPL");
@@ -1058,7 +1058,10 @@ static int sctp_outq_flush(struct sctp_outq *q, int rtx_timeout)
 			list_add_tail(&chunk->transmitted_list,
 				      &transport->transmitted);
 
-			sctp_transport_reset_timers(transport);
+			/* Defer the timer restart to the end of the
+			 * flush, one mod_timer per transport is enough.
+			 */
+			transport->data_sent = 1;
 
 			/* Only let one DATA chunk get bundled with a
 			 * COOKIE-ECHO chunk.
@@ -1090,6 +1093,11 @@ sctp_flush_out:
 		if (!sctp_packet_empty(packet))
 			error = sctp_packet_transmit(packet);
 
+		if (t->data_sent) {
+			sctp_transport_reset_timers(t);
+			t->data_sent = 0;
+		}
+
 		/* Clear the burst limited state, if any */
 		sctp_transport_burst_reset(t);
 	}
@@ -2327,6 +2327,49 @@ SYSCALL_DEFINE3(recvmsg, int, fd, struct msghdr __user *, msg,
 	return __sys_recvmsg(fd, msg, flags);
 }
 
+/*
+ * Receive one datagram for recvmmsg() without sleeping past @end_time.
+ * The receive itself never blocks; in between attempts we sleep on the
+ * socket's wait queue for at most the time left, and no longer than
+ * SO_RCVTIMEO allows in total.
+ */
+static int ___sys_recvmsg_deadline(struct socket *sock,
+				   struct msghdr __user *msg,
+				   struct msghdr *msg_sys, unsigned int flags,
+				   int nosec, struct timespec *end_time)
+{
+	long rcvtimeo = sock_rcvtimeo(sock->sk, 0);
+	struct timespec left;
+	long timeo, slept;
+	int err;
+
+	if (!end_time)
+		return ___sys_recvmsg(sock, msg, msg_sys, flags, nosec);
+
+	for (;;) {
+		err = ___sys_recvmsg(sock, msg, msg_sys, flags | MSG_DONTWAIT,
+				     nosec);
+		if (err != -EAGAIN)
+			return err;
+
+		ktime_get_ts(&left);
+		left = timespec_sub(*end_time, left);
+		if (left.tv_sec < 0)
+			return -EAGAIN;
+
+		timeo = min_t(long, timespec_to_jiffies(&left), rcvtimeo);
+		slept = timeo;
+		err = skb_wait_for_datagram(sock->sk, &timeo);
+		if (err < 0)
+			return err;
+		if (rcvtimeo != MAX_SCHEDULE_TIMEOUT)
+			rcvtimeo -= slept - timeo;
+		/* Shut down: let a blocking receive report it */
+		if (err > 0)
+			return ___sys_recvmsg(sock, msg, msg_sys, flags, nosec);
+	}
+}
+
 /*
  *     Linux recvmmsg interface
  */
@@ -2340,6 +2383,7 @@ int __sys_recvmmsg(int fd, struct mmsghdr __user *mmsg, unsigned int vlen,
 	struct compat_mmsghdr __user *compat_entry;
 	struct msghdr msg_sys;
 	struct timespec end_time;
+	bool deadline;
 
 	if (timeout &&
 	    poll_select_set_timeout(&end_time, timeout->tv_sec,
@@ -2359,23 +2403,37 @@ int __sys_recvmmsg(int fd, struct mmsghdr __user *mmsg, unsigned int vlen,
 	entry = mmsg;
 	compat_entry = (struct compat_mmsghdr __user *)mmsg;
 
+	/*
+	 * For datagram sockets, whose receive paths wait in
+	 * net/core/datagram.c, the timeout also bounds the wait for each
+	 * datagram rather than being checked only once one has arrived.
+	 */
+	deadline = timeout && !(sock->file->f_flags & O_NONBLOCK) &&
+		   (sock->type == SOCK_DGRAM || sock->type == SOCK_RAW);
+
 	while (datagrams < vlen) {
+		struct timespec *end = NULL;
+
+		if (deadline && !(flags & MSG_DONTWAIT))
+			end = &end_time;
+
 		/*
 		 * No need to ask LSM for more than the first datagram.
 		 */
 		if (MSG_CMSG_COMPAT & flags) {
-			err = ___sys_recvmsg(sock, (struct msghdr __user *)compat_entry,
-					     &msg_sys, flags & ~MSG_WAITFORONE,
-					     datagrams);
+			err = ___sys_recvmsg_deadline(sock,
+					(struct msghdr __user *)compat_entry,
+					&msg_sys, flags & ~MSG_WAITFORONE,
+					datagrams, end);
 			if (err < 0)
 				break;
 			err = __put_user(err, &compat_entry->msg_len);
 			++compat_entry;
 		} else {
-			err = ___sys_recvmsg(sock,
-					     (struct msghdr __user *)entry,
-					     &msg_sys, flags & ~MSG_WAITFORONE,
-					     datagrams);
+			err = ___sys_recvmsg_deadline(sock,
+					(struct msghdr __user *)entry,
+					&msg_sys, flags & ~MSG_WAITFORONE,
+					datagrams, end);
 			if (err < 0)
 				break;
 			err = put_user(err, &entry->msg_len);
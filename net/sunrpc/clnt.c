@@ -546,6 +546,13 @@ struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 	if (args->flags & RPC_CLNT_CREATE_NONPRIVPORT)
 		xprt->resvport = 0;
 
+	/*
+	 * Extra connections are only opened to an already known port;
+	 * each one would otherwise need its own rpcbind query.
+	 */
+	if (args->nconnect > 1 && xprt_bound(xprt))
+		xprt_add_peers(xprt, &xprtargs, args->nconnect - 1);
+
 	return rpc_create_xprt(args, xprt);
 }
 EXPORT_SYMBOL_GPL(rpc_create);
@@ -1136,6 +1136,21 @@ void xprt_free(struct rpc_xprt *xprt)
 }
 EXPORT_SYMBOL_GPL(xprt_free);
 
+/*
+ * Pick the transport a new request goes out on. Requests stay on the
+ * transport they were given for their whole lifetime, so retransmits
+ * keep the source address and port the server's reply cache expects.
+ */
+static struct rpc_xprt *xprt_select(struct rpc_xprt *xprt)
+{
+	unsigned int i;
+
+	if (likely(xprt->npeers == 0))
+		return xprt;
+	i = (unsigned int)atomic_inc_return(&xprt->peer_rr) % (xprt->npeers + 1);
+	return i ? xprt->peers[i - 1] : xprt;
+}
+
 /**
  * xprt_reserve - allocate an RPC request slot
  * @task: RPC task requesting a slot allocation
@@ -1155,7 +1170,7 @@ void xprt_reserve(struct rpc_task *task)
 	task->tk_timeout = 0;
 	task->tk_status = -EAGAIN;
 	rcu_read_lock();
-	xprt = rcu_dereference(task->tk_client->cl_xprt);
+	xprt = xprt_select(rcu_dereference(task->tk_client->cl_xprt));
 	if (!xprt_throttle_congested(xprt, task))
 		xprt->ops->alloc_slot(xprt, task);
 	rcu_read_unlock();
@@ -1181,7 +1196,7 @@ void xprt_retry_reserve(struct rpc_task *task)
 	task->tk_timeout = 0;
 	task->tk_status = -EAGAIN;
 	rcu_read_lock();
-	xprt = rcu_dereference(task->tk_client->cl_xprt);
+	xprt = xprt_select(rcu_dereference(task->tk_client->cl_xprt));
 	xprt->ops->alloc_slot(xprt, task);
 	rcu_read_unlock();
 }
@@ -1230,10 +1245,15 @@ void xprt_release(struct rpc_task *task)
 
 	if (req == NULL) {
 		if (task->tk_client) {
+			unsigned int i;
+
 			rcu_read_lock();
 			xprt = rcu_dereference(task->tk_client->cl_xprt);
 			if (xprt->snd_task == task)
 				xprt_release_write(xprt, task);
+			for (i = 0; i < xprt->npeers; i++)
+				if (xprt->peers[i]->snd_task == task)
+					xprt_release_write(xprt->peers[i], task);
 			rcu_read_unlock();
 		}
 		return;
@@ -1351,6 +1371,48 @@ out:
 	return xprt;
 }
 
+/**
+ * xprt_add_peers - open additional connections alongside a transport
+ * @xprt: primary transport
+ * @args: rpc transport creation arguments used for @xprt
+ * @n: number of additional transports wanted
+ *
+ * Must be called before @xprt is handed to an rpc_clnt. Transports
+ * that fail to set up are skipped; the primary keeps working with
+ * however many peers were created. Returns that number.
+ */
+unsigned int xprt_add_peers(struct rpc_xprt *xprt, struct xprt_create *args,
+			    unsigned int n)
+{
+	struct rpc_xprt **peers;
+	struct rpc_xprt *peer;
+	unsigned int i;
+
+	if (n == 0 || xprt->peers != NULL)
+		return 0;
+	peers = kcalloc(n, sizeof(*peers), GFP_KERNEL);
+	if (peers == NULL)
+		return 0;
+
+	for (i = 0; i < n; i++) {
+		peer = xprt_create_transport(args);
+		if (IS_ERR(peer))
+			break;
+		peer->resvport = xprt->resvport;
+		peers[i] = peer;
+	}
+	if (i == 0) {
+		kfree(peers);
+		return 0;
+	}
+
+	xprt->peers = peers;
+	xprt->npeers = i;
+	dprintk("RPC:       transport %p has %u peers\n", xprt, i);
+	return i;
+}
+EXPORT_SYMBOL_GPL(xprt_add_peers);
+
 /**
  * xprt_destroy - destroy an RPC transport, killing off all requests.
  * @xprt: transport to destroy
@@ -1358,7 +1420,12 @@ out:
  */
 static void xprt_destroy(struct rpc_xprt *xprt)
 {
+	unsigned int i;
+
 	dprintk("RPC:       destroying transport %p\n", xprt);
+	for (i = 0; i < xprt->npeers; i++)
+		xprt_put(xprt->peers[i]);
+	kfree(xprt->peers);
 	del_timer_sync(&xprt->timer);
 
 	rpc_destroy_wait_queue(&xprt->binding);
@@ -117,6 +117,7 @@
 #include <net/checksum.h>
 #include <linux/security.h>
 #include <linux/freezer.h>
+#include <linux/splice.h>
 
 struct hlist_head unix_socket_table[2 * UNIX_HASH_SIZE];
 EXPORT_SYMBOL_GPL(unix_socket_table);
@@ -520,6 +521,11 @@ static int unix_stream_sendmsg(struct kiocb *, struct socket *,
 			       struct msghdr *, size_t);
 static int unix_stream_recvmsg(struct kiocb *, struct socket *,
 			       struct msghdr *, size_t, int);
+static ssize_t unix_stream_sendpage(struct socket *, struct page *, int,
+				    size_t, int);
+static ssize_t unix_stream_splice_read(struct socket *, loff_t *,
+				       struct pipe_inode_info *, size_t,
+				       unsigned int);
 static int unix_dgram_sendmsg(struct kiocb *, struct socket *,
 			      struct msghdr *, size_t);
 static int unix_dgram_recvmsg(struct kiocb *, struct socket *,
@@ -563,7 +569,8 @@ static const struct proto_ops unix_stream_ops = {
 	.sendmsg =	unix_stream_sendmsg,
 	.recvmsg =	unix_stream_recvmsg,
 	.mmap =		sock_no_mmap,
-	.sendpage =	sock_no_sendpage,
+	.sendpage =	unix_stream_sendpage,
+	.splice_read =	unix_stream_splice_read,
 	.set_peek_off =	unix_set_peek_off,
 };
 
@@ -1728,6 +1735,73 @@ out_err:
 	return sent ? : err;
 }
 
+/* Queue a reference to the page instead of copying it: each call becomes
+ * one skb holding a single page fragment.
+ */
+static ssize_t unix_stream_sendpage(struct socket *socket, struct page *page,
+				    int offset, size_t size, int flags)
+{
+	struct sock *sk = socket->sk;
+	struct msghdr msg = { .msg_flags = flags };
+	struct scm_cookie scm;
+	struct sock *other;
+	struct sk_buff *skb;
+	int err;
+
+	if (flags & MSG_OOB)
+		return -EOPNOTSUPP;
+
+	other = unix_peer(sk);
+	if (!other || sk->sk_state != TCP_ESTABLISHED)
+		return -ENOTCONN;
+
+	if (sk->sk_shutdown & SEND_SHUTDOWN)
+		goto pipe_err;
+
+	skb = sock_alloc_send_pskb(sk, 0, 0, flags & MSG_DONTWAIT, &err, 0);
+	if (!skb)
+		return err;
+
+	err = scm_send(socket, &msg, &scm, false);
+	if (err < 0)
+		goto out_free;
+	err = unix_scm_to_skb(&scm, skb, false);
+	scm_destroy(&scm);
+	if (err < 0)
+		goto out_free;
+
+	get_page(page);
+	skb_fill_page_desc(skb, 0, page, offset, size);
+	skb->len += size;
+	skb->data_len += size;
+	skb->truesize += size;
+	atomic_add(size, &sk->sk_wmem_alloc);
+
+	unix_state_lock(other);
+
+	if (sock_flag(other, SOCK_DEAD) ||
+	    (other->sk_shutdown & RCV_SHUTDOWN))
+		goto pipe_err_free;
+
+	maybe_add_creds(skb, socket, other);
+	skb_queue_tail(&other->sk_receive_queue, skb);
+	unix_state_unlock(other);
+	other->sk_data_ready(other);
+
+	return size;
+
+pipe_err_free:
+	unix_state_unlock(other);
+	kfree_skb(skb);
+pipe_err:
+	if (!(flags & MSG_NOSIGNAL))
+		send_sig(SIGPIPE, current, 0);
+	return -EPIPE;
+out_free:
+	kfree_skb(skb);
+	return err;
+}
+
 static int unix_seqpacket_sendmsg(struct kiocb *kiocb, struct socket *sock,
 				  struct msghdr *msg, size_t len)
 {
@@ -2068,6 +2142,108 @@ out:
 	return copied ? : err;
 }
 
+/* Move queued data into a pipe by page reference. u->readlock is held
+ * across splice_to_pipe(), so readers can't see the same bytes twice.
+ * Like read(2), a splice can't pass descriptors on: any attached to the
+ * data it consumes are released.
+ */
+static ssize_t unix_stream_splice_read(struct socket *sock, loff_t *ppos,
+				       struct pipe_inode_info *pipe,
+				       size_t size, unsigned int flags)
+{
+	struct sock *sk = sock->sk;
+	struct unix_sock *u = unix_sk(sk);
+	int noblock = (flags & SPLICE_F_NONBLOCK) ||
+		      (sock->file->f_flags & O_NONBLOCK);
+	ssize_t spliced = 0;
+	long timeo;
+	int err;
+
+	if (unlikely(*ppos))
+		return -ESPIPE;
+
+	if (sk->sk_state != TCP_ESTABLISHED)
+		return -EINVAL;
+
+	timeo = sock_rcvtimeo(sk, noblock);
+
+	err = mutex_lock_interruptible(&u->readlock);
+	if (unlikely(err))
+		return noblock ? -EAGAIN : -ERESTARTSYS;
+
+	while (size) {
+		struct sk_buff *skb, *last;
+		int chunk;
+
+		unix_state_lock(sk);
+		last = skb = skb_peek(&sk->sk_receive_queue);
+		if (skb == NULL) {
+			unix_sk(sk)->recursion_level = 0;
+			if (spliced)
+				goto unlock;
+
+			err = sock_error(sk);
+			if (err)
+				goto unlock;
+			if (sk->sk_shutdown & RCV_SHUTDOWN)
+				goto unlock;
+
+			unix_state_unlock(sk);
+			err = -EAGAIN;
+			if (!timeo)
+				break;
+			mutex_unlock(&u->readlock);
+
+			timeo = unix_stream_data_wait(sk, timeo, last);
+
+			if (signal_pending(current) ||
+			    mutex_lock_interruptible(&u->readlock)) {
+				err = sock_intr_errno(timeo);
+				goto out;
+			}
+
+			continue;
+unlock:
+			unix_state_unlock(sk);
+			break;
+		}
+		unix_state_unlock(sk);
+
+		chunk = min_t(unsigned int, unix_skb_len(skb), size);
+		chunk = skb_splice_bits_nolock(skb, sk, UNIXCB(skb).consumed,
+					       pipe, chunk, flags);
+		if (chunk <= 0) {
+			if (!spliced)
+				err = chunk;
+			break;
+		}
+		spliced += chunk;
+		size -= chunk;
+
+		UNIXCB(skb).consumed += chunk;
+		sk_peek_offset_bwd(sk, chunk);
+
+		if (UNIXCB(skb).fp) {
+			struct scm_cookie scm;
+
+			memset(&scm, 0, sizeof(scm));
+			unix_detach_fds(&scm, skb);
+			scm_destroy(&scm);
+		}
+
+		/* The pipe is full */
+		if (unix_skb_len(skb))
+			break;
+
+		skb_unlink(skb, &sk->sk_receive_queue);
+		consume_skb(skb);
+	}
+
+	mutex_unlock(&u->readlock);
+out:
+	return spliced ? : err;
+}
+
 static int unix_shutdown(struct socket *sock, int mode)
 {
 	struct sock *sk = sock->sk;
@@ -245,7 +245,7 @@ unsigned int aa_str_perms(struct aa_dfa *dfa, unsigned int start,
 		return DFA_NOMATCH;
 	}
 
-	state = aa_dfa_match(dfa, start, name);
+	state = aa_dfa_match_cached(dfa, start, name);
 	*perms = compute_perms(dfa, state, cond);
 
 	return state;
@@ -93,10 +93,30 @@ struct table_header {
 #define ACCEPT_TABLE(DFA) ((u32 *)((DFA)->tables[YYTD_ID_ACCEPT]->td_data))
 #define ACCEPT_TABLE2(DFA) ((u32 *)((DFA)->tables[YYTD_ID_ACCEPT2]->td_data))
 
+/* packed transitions: check state in the high half, next state in the low */
+#define TRANS_PACK(CHK, NXT) (((u32)(CHK) << 16) | (NXT))
+#define TRANS_CHECK(T) ((T) >> 16)
+#define TRANS_NEXT(T) ((T) & 0xffff)
+
+#define DFA_MATCH_CACHE_BITS	6
+#define DFA_MATCH_CACHE_MAXLEN	256
+
+/* a cached aa_dfa_match_cached() result */
+struct aa_match_entry {
+	struct rcu_head rcu;
+	unsigned int start;
+	unsigned int state;
+	unsigned int len;
+	char str[];
+};
+
+/* match_cache slots are published with xchg and read under rcu */
 struct aa_dfa {
 	struct kref count;
 	u16 flags;
 	struct table_header *tables[YYTD_ID_TSIZE];
+	u32 *trans;
+	struct aa_match_entry *match_cache[1 << DFA_MATCH_CACHE_BITS];
 };
 
 #define byte_to_byte(X) (X)
@@ -121,6 +141,8 @@ unsigned int aa_dfa_match_len(struct aa_dfa *dfa, unsigned int start,
 			      const char *str, int len);
 unsigned int aa_dfa_match(struct aa_dfa *dfa, unsigned int start,
 			  const char *str);
+unsigned int aa_dfa_match_cached(struct aa_dfa *dfa, unsigned int start,
+				 const char *str);
 unsigned int aa_dfa_next(struct aa_dfa *dfa, unsigned int state,
 			 const char c);
 
@@ -19,6 +19,9 @@
 #include <linux/vmalloc.h>
 #include <linux/err.h>
 #include <linux/kref.h>
+#include <linux/hash.h>
+#include <linux/dcache.h>
+#include <linux/rcupdate.h>
 
 #include "include/apparmor.h"
 #include "include/match.h"
@@ -159,6 +162,41 @@ out:
 	return error;
 }
 
+/**
+ * pack_transitions - interleave the next and check tables of @dfa
+ * @dfa: verified dfa to pack  (NOT NULL)
+ *
+ * Every transition reads check[pos] and, when it matches, next[pos].
+ * Storing the pair in one word means each input byte touches a single
+ * cacheline of transition data instead of two.  The next and check
+ * tables are not used for matching after this and are freed.
+ *
+ * Returns: %0 else -ENOMEM
+ */
+static int pack_transitions(struct aa_dfa *dfa)
+{
+	size_t i, trans_count = dfa->tables[YYTD_ID_NXT]->td_lolen;
+	u16 *next = NEXT_TABLE(dfa);
+	u16 *check = CHECK_TABLE(dfa);
+
+	dfa->trans = kvzalloc(trans_count * sizeof(*dfa->trans));
+	if (!dfa->trans)
+		return -ENOMEM;
+
+	for (i = 0; i < trans_count; i++)
+		dfa->trans[i] = TRANS_PACK(check[i], next[i]);
+
+	kvfree(dfa->tables[YYTD_ID_NXT]);
+	dfa->tables[YYTD_ID_NXT] = NULL;
+	kvfree(dfa->tables[YYTD_ID_CHK]);
+	dfa->tables[YYTD_ID_CHK] = NULL;
+
+	/* as in unpack_table, sync the page tables before going live */
+	if (is_vmalloc_addr(dfa->trans))
+		vm_unmap_aliases();
+	return 0;
+}
+
 /**
  * dfa_free - free a dfa allocated by aa_dfa_unpack
  * @dfa: the dfa to free  (MAYBE NULL)
@@ -174,6 +212,10 @@ static void dfa_free(struct aa_dfa *dfa)
 			kvfree(dfa->tables[i]);
 			dfa->tables[i] = NULL;
 		}
+		kvfree(dfa->trans);
+		/* no references left, so no rcu readers of the cache either */
+		for (i = 0; i < ARRAY_SIZE(dfa->match_cache); i++)
+			kfree(dfa->match_cache[i]);
 		kfree(dfa);
 	}
 }
@@ -273,6 +315,10 @@ struct aa_dfa *aa_dfa_unpack(void *blob, size_t size, int flags)
 	if (error)
 		goto fail;
 
+	error = pack_transitions(dfa);
+	if (error)
+		goto fail;
+
 	return dfa;
 
 fail:
@@ -281,6 +327,24 @@ fail:
 	return ERR_PTR(error);
 }
 
+/**
+ * dfa_next - step one input class from @state
+ * @dfa: the dfa to traverse  (NOT NULL)
+ * @state: the state to step from
+ * @c: the input byte, already mapped through the equivalence classes
+ *
+ * Returns: state reached after input @c
+ */
+static inline unsigned int dfa_next(struct aa_dfa *dfa, unsigned int state,
+				    unsigned int c)
+{
+	u32 trans = dfa->trans[base_idx(BASE_TABLE(dfa)[state]) + c];
+
+	if (TRANS_CHECK(trans) == state)
+		return TRANS_NEXT(trans);
+	return DEFAULT_TABLE(dfa)[state];
+}
+
 /**
  * aa_dfa_match_len - traverse @dfa to find state @str stops at
  * @dfa: the dfa to match @str against  (NOT NULL)
@@ -300,11 +364,7 @@ fail:
 unsigned int aa_dfa_match_len(struct aa_dfa *dfa, unsigned int start,
 			      const char *str, int len)
 {
-	u16 *def = DEFAULT_TABLE(dfa);
-	u32 *base = BASE_TABLE(dfa);
-	u16 *next = NEXT_TABLE(dfa);
-	u16 *check = CHECK_TABLE(dfa);
-	unsigned int state = start, pos;
+	unsigned int state = start;
 
 	if (state == 0)
 		return 0;
@@ -313,23 +373,11 @@ unsigned int aa_dfa_match_len(struct aa_dfa *dfa, unsigned int start,
 	if (dfa->tables[YYTD_ID_EC]) {
 		/* Equivalence class table defined */
 		u8 *equiv = EQUIV_TABLE(dfa);
-		/* default is direct to next state */
-		for (; len; len--) {
-			pos = base_idx(base[state]) + equiv[(u8) *str++];
-			if (check[pos] == state)
-				state = next[pos];
-			else
-				state = def[state];
-		}
+		for (; len; len--)
+			state = dfa_next(dfa, state, equiv[(u8) *str++]);
 	} else {
-		/* default is direct to next state */
-		for (; len; len--) {
-			pos = base_idx(base[state]) + (u8) *str++;
-			if (check[pos] == state)
-				state = next[pos];
-			else
-				state = def[state];
-		}
+		for (; len; len--)
+			state = dfa_next(dfa, state, (u8) *str++);
 	}
 
 	return state;
@@ -350,11 +398,7 @@ unsigned int aa_dfa_match_len(struct aa_dfa *dfa, unsigned int start,
 unsigned int aa_dfa_match(struct aa_dfa *dfa, unsigned int start,
 			  const char *str)
 {
-	u16 *def = DEFAULT_TABLE(dfa);
-	u32 *base = BASE_TABLE(dfa);
-	u16 *next = NEXT_TABLE(dfa);
-	u16 *check = CHECK_TABLE(dfa);
-	unsigned int state = start, pos;
+	unsigned int state = start;
 
 	if (state == 0)
 		return 0;
@@ -363,23 +407,64 @@ unsigned int aa_dfa_match(struct aa_dfa *dfa, unsigned int start,
 	if (dfa->tables[YYTD_ID_EC]) {
 		/* Equivalence class table defined */
 		u8 *equiv = EQUIV_TABLE(dfa);
-		/* default is direct to next state */
-		while (*str) {
-			pos = base_idx(base[state]) + equiv[(u8) *str++];
-			if (check[pos] == state)
-				state = next[pos];
-			else
-				state = def[state];
-		}
+		while (*str)
+			state = dfa_next(dfa, state, equiv[(u8) *str++]);
 	} else {
-		/* default is direct to next state */
-		while (*str) {
-			pos = base_idx(base[state]) + (u8) *str++;
-			if (check[pos] == state)
-				state = next[pos];
-			else
-				state = def[state];
-		}
+		while (*str)
+			state = dfa_next(dfa, state, (u8) *str++);
+	}
+
+	return state;
+}
+
+/**
+ * aa_dfa_match_cached - aa_dfa_match through the dfa's cache of recent matches
+ * @dfa: the dfa to match @str against  (NOT NULL)
+ * @start: the state of the dfa to start matching in
+ * @str: the null terminated string of bytes to match against the dfa (NOT NULL)
+ *
+ * Mediation matches the same few paths over and over.  While the dfa is
+ * live its tables never change, so the final state for a (@start, @str)
+ * pair can be remembered and a repeat lookup costs a hash and a memcmp
+ * instead of a table walk per byte.  The cache goes away with the dfa,
+ * so replacing a profile starts out with an empty one.
+ *
+ * Returns: final state reached after input is consumed
+ */
+unsigned int aa_dfa_match_cached(struct aa_dfa *dfa, unsigned int start,
+				 const char *str)
+{
+	struct aa_match_entry *ent, *old;
+	size_t len = strlen(str);
+	unsigned int hash, state;
+
+	if (start == 0 || len > DFA_MATCH_CACHE_MAXLEN)
+		return aa_dfa_match_len(dfa, start, str, len);
+
+	hash = hash_32(full_name_hash(str, len) ^ start, DFA_MATCH_CACHE_BITS);
+
+	rcu_read_lock();
+	ent = rcu_dereference(dfa->match_cache[hash]);
+	if (ent && ent->start == start && ent->len == len &&
+	    memcmp(ent->str, str, len) == 0) {
+		state = ent->state;
+		rcu_read_unlock();
+		return state;
+	}
+	rcu_read_unlock();
+
+	state = aa_dfa_match_len(dfa, start, str, len);
+
+	/* caching is best effort, don't dip into reserves or sleep for it */
+	ent = kmalloc(sizeof(*ent) + len, GFP_NOWAIT | __GFP_NOWARN);
+	if (ent) {
+		ent->start = start;
+		ent->state = state;
+		ent->len = len;
+		memcpy(ent->str, str, len);
+		old = xchg(&dfa->match_cache[hash], ent);
+		if (old)
+			kfree_rcu(old, rcu);
 	}
 
 	return state;
@@ -398,31 +483,10 @@ unsigned int aa_dfa_match(struct aa_dfa *dfa, unsigned int start,
 unsigned int aa_dfa_next(struct aa_dfa *dfa, unsigned int state,
 			  const char c)
 {
-	u16 *def = DEFAULT_TABLE(dfa);
-	u32 *base = BASE_TABLE(dfa);
-	u16 *next = NEXT_TABLE(dfa);
-	u16 *check = CHECK_TABLE(dfa);
-	unsigned int pos;
-
 	/* current state is <state>, matching character *str */
-	if (dfa->tables[YYTD_ID_EC]) {
+	if (dfa->tables[YYTD_ID_EC])
 		/* Equivalence class table defined */
-		u8 *equiv = EQUIV_TABLE(dfa);
-		/* default is direct to next state */
+		return dfa_next(dfa, state, EQUIV_TABLE(dfa)[(u8) c]);
 
-		pos = base_idx(base[state]) + equiv[(u8) c];
-		if (check[pos] == state)
-			state = next[pos];
-		else
-			state = def[state];
-	} else {
-		/* default is direct to next state */
-		pos = base_idx(base[state]) + (u8) c;
-		if (check[pos] == state)
-			state = next[pos];
-		else
-			state = def[state];
-	}
-
-	return state;
+	return dfa_next(dfa, state, (u8) c);
 }
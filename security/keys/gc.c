@@ -282,6 +282,11 @@ maybe_resched:
 	 */
 	kdebug("pass complete");
 
+	/* Keys may have died or be about to be freed, neither of which the
+	 * search cache may go on naming past the grace period below.
+	 */
+	keyring_search_invalidate();
+
 	if (gc_state & KEY_GC_SET_TIMER && new_timer != (time_t)LONG_MAX) {
 		new_timer += key_gc_delay;
 		key_schedule_gc(new_timer);
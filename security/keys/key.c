@@ -998,6 +998,7 @@ void key_revoke(struct key *key)
 	}
 
 	up_write(&key->sem);
+	keyring_search_invalidate();
 }
 EXPORT_SYMBOL(key_revoke);
 
@@ -1019,6 +1020,7 @@ void key_invalidate(struct key *key)
 		if (!test_and_set_bit(KEY_FLAG_INVALIDATED, &key->flags))
 			key_schedule_gc_links();
 		up_write(&key->sem);
+		keyring_search_invalidate();
 	}
 }
 EXPORT_SYMBOL(key_invalidate);
@@ -16,6 +16,8 @@
 #include <linux/security.h>
 #include <linux/seq_file.h>
 #include <linux/err.h>
+#include <linux/hash.h>
+#include <linux/dcache.h>
 #include <keys/keyring-type.h>
 #include <keys/user-type.h>
 #include <linux/assoc_array_priv.h>
@@ -794,6 +796,207 @@ found:
 	return true;
 }
 
+/*
+ * Cache of recent search results.
+ *
+ * An entry remembers which key a search for (type, description) starting at a
+ * keyring turned up for a particular set of credentials.  The entry doesn't
+ * pin the key or the keyring; instead, anything that could change the outcome
+ * of a search - linking, unlinking, revocation, invalidation, permission and
+ * ownership changes and garbage collection - bumps keyring_search_gen, and an
+ * entry is only used if it was filled in the current generation.  The
+ * garbage collector bumps the generation before its RCU grace period, so a
+ * key named by a current entry can't be freed under an RCU reader.  The
+ * credentials aren't pinned either, that would keep their keyrings and user
+ * alive; instead put_cred_rcu() clears the entries naming a cred before its
+ * address can be reused, see keyring_search_cache_forget().
+ *
+ * A hit is revalidated against the key's state, the match function and the
+ * key's permissions just as a full search would, so only the route through
+ * the keyring tree is taken on trust.
+ */
+#define KEYRING_SEARCH_CACHE_BITS	7
+
+struct keyring_search_cache_entry {
+	spinlock_t		lock;
+	int			gen;
+	bool			possessed;
+	unsigned		flags;
+	const struct cred	*cred;
+	struct key		*keyring;
+	struct key_type		*type;
+	key_match_func_t	match;
+	unsigned int		desc_hash;
+	size_t			desc_len;
+	struct key		*key;
+};
+
+static struct keyring_search_cache_entry
+	keyring_search_cache[1 << KEYRING_SEARCH_CACHE_BITS];
+static atomic_t keyring_search_gen = ATOMIC_INIT(0);
+
+/*
+ * Note that something happened that may change the outcome of a search.
+ */
+void keyring_search_invalidate(void)
+{
+	/* Make the change visible before the new generation */
+	smp_mb__before_atomic_inc();
+	atomic_inc(&keyring_search_gen);
+}
+
+/*
+ * Only plain searches by description are cached.
+ */
+static inline bool keyring_search_cacheable(const struct keyring_search_context *ctx)
+{
+	return ctx->index_key.description &&
+		ctx->match_data == ctx->index_key.description &&
+		!(ctx->flags & KEYRING_SEARCH_NO_STATE_CHECK);
+}
+
+static struct keyring_search_cache_entry *
+keyring_search_cache_slot(struct key *keyring,
+			  const struct keyring_search_context *ctx,
+			  unsigned int desc_hash)
+{
+	u32 hash = desc_hash ^ hash_ptr(keyring, 32) ^ hash_ptr(ctx->cred, 32);
+
+	return &keyring_search_cache[hash_32(hash, KEYRING_SEARCH_CACHE_BITS)];
+}
+
+static bool keyring_search_cache_match(const struct keyring_search_cache_entry *ce,
+				       struct key *keyring,
+				       const struct keyring_search_context *ctx,
+				       unsigned int desc_hash, size_t desc_len,
+				       int gen)
+{
+	return ce->key &&
+		ce->gen == gen &&
+		ce->keyring == keyring &&
+		ce->cred == ctx->cred &&
+		ce->possessed == ctx->possessed &&
+		ce->flags == ctx->flags &&
+		ce->type == ctx->index_key.type &&
+		ce->match == ctx->match &&
+		ce->desc_hash == desc_hash &&
+		ce->desc_len == desc_len;
+}
+
+/*
+ * Look for a cached result of this search and revalidate it.
+ *
+ * Must be called with the RCU read lock held.  On success ctx->result is set
+ * as search_nested_keyrings() would have set it.
+ */
+static bool keyring_search_cache_lookup(struct key *keyring,
+					struct keyring_search_context *ctx)
+{
+	struct keyring_search_cache_entry *ce;
+	struct key *key = NULL;
+	unsigned int desc_hash;
+	unsigned flags = ctx->flags;
+	size_t desc_len;
+	int gen;
+
+	if (!keyring_search_cacheable(ctx))
+		return false;
+
+	desc_len = strlen(ctx->index_key.description);
+	desc_hash = full_name_hash(ctx->index_key.description, desc_len);
+	ce = keyring_search_cache_slot(keyring, ctx, desc_hash);
+
+	gen = atomic_read(&keyring_search_gen);
+	smp_rmb();
+
+	spin_lock_bh(&ce->lock);
+	if (keyring_search_cache_match(ce, keyring, ctx, desc_hash, desc_len,
+				       gen))
+		key = ce->key;
+	spin_unlock_bh(&ce->lock);
+	if (!key)
+		return false;
+
+	/* Check the key as search_nested_keyrings() would below the top */
+	ctx->skipped_ret = 0;
+	ctx->flags |= KEYRING_SEARCH_DO_STATE_CHECK;
+	if (ctx->iterator(keyring_key_to_ptr(key), ctx) != 1) {
+		ctx->flags = flags;
+		ctx->result = ERR_PTR(-EAGAIN);
+		return false;
+	}
+	ctx->flags = flags;
+
+	/* The keyrings between the two don't get their times updated */
+	if (!(flags & KEYRING_SEARCH_NO_UPDATE_TIME)) {
+		key->last_used_at = ctx->now.tv_sec;
+		keyring->last_used_at = ctx->now.tv_sec;
+	}
+	return true;
+}
+
+/*
+ * Record the result of a successful search made in generation @gen.
+ */
+static void keyring_search_cache_fill(struct key *keyring,
+				      const struct keyring_search_context *ctx,
+				      unsigned flags, int gen)
+{
+	struct keyring_search_cache_entry *ce;
+	unsigned int desc_hash;
+	size_t desc_len;
+
+	desc_len = strlen(ctx->index_key.description);
+	desc_hash = full_name_hash(ctx->index_key.description, desc_len);
+	ce = keyring_search_cache_slot(keyring, ctx, desc_hash);
+
+	spin_lock_bh(&ce->lock);
+	ce->gen = gen;
+	ce->possessed = ctx->possessed;
+	ce->flags = flags;
+	ce->cred = ctx->cred;
+	ce->keyring = keyring;
+	ce->type = ctx->index_key.type;
+	ce->match = ctx->match;
+	ce->desc_hash = desc_hash;
+	ce->desc_len = desc_len;
+	ce->key = key_ref_to_ptr(ctx->result);
+	spin_unlock_bh(&ce->lock);
+}
+
+/*
+ * Drop the cached results of searches made with @cred, which is about to be
+ * freed.  Called from put_cred_rcu(), so nobody can be searching with it.
+ */
+void keyring_search_cache_forget(const struct cred *cred)
+{
+	struct keyring_search_cache_entry *ce;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(keyring_search_cache); i++) {
+		ce = &keyring_search_cache[i];
+		if (ACCESS_ONCE(ce->cred) != cred)
+			continue;
+
+		spin_lock_bh(&ce->lock);
+		if (ce->cred == cred) {
+			ce->cred = NULL;
+			ce->key = NULL;
+		}
+		spin_unlock_bh(&ce->lock);
+	}
+}
+
+static int __init keyring_search_cache_init(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(keyring_search_cache); i++)
+		spin_lock_init(&keyring_search_cache[i].lock);
+	return 0;
+}
+core_initcall(keyring_search_cache_init);
+
 /**
  * keyring_search_aux - Search a keyring tree for a key matching some criteria
  * @keyring_ref: A pointer to the keyring with possession indicator.
@@ -830,7 +1033,9 @@ key_ref_t keyring_search_aux(key_ref_t keyring_ref,
 			     struct keyring_search_context *ctx)
 {
 	struct key *keyring;
+	unsigned flags = ctx->flags;
 	long err;
+	int gen;
 
 	ctx->iterator = keyring_search_iterator;
 	ctx->possessed = is_key_possessed(keyring_ref);
@@ -850,8 +1055,20 @@ key_ref_t keyring_search_aux(key_ref_t keyring_ref,
 
 	rcu_read_lock();
 	ctx->now = current_kernel_time();
-	if (search_nested_keyrings(keyring, ctx))
+	if (keyring_search_cache_lookup(keyring, ctx)) {
+		__key_get(key_ref_to_ptr(ctx->result));
+		goto out;
+	}
+
+	gen = atomic_read(&keyring_search_gen);
+	smp_rmb();
+	if (search_nested_keyrings(keyring, ctx)) {
 		__key_get(key_ref_to_ptr(ctx->result));
+		ctx->flags = flags;
+		if (keyring_search_cacheable(ctx))
+			keyring_search_cache_fill(keyring, ctx, flags, gen);
+	}
+out:
 	rcu_read_unlock();
 	return ctx->result;
 }
@@ -1132,6 +1349,7 @@ void __key_link(struct key *key, struct assoc_array_edit **_edit)
 	assoc_array_insert_set_object(*_edit, keyring_key_to_ptr(key));
 	assoc_array_apply_edit(*_edit);
 	*_edit = NULL;
+	keyring_search_invalidate();
 }
 
 /*
@@ -1249,6 +1467,7 @@ int key_unlink(struct key *keyring, struct key *key)
 
 	assoc_array_apply_edit(edit);
 	key_payload_reserve(keyring, keyring->datalen - KEYQUOTA_LINK_BYTES);
+	keyring_search_invalidate();
 	ret = 0;
 
 error:
@@ -1282,6 +1501,7 @@ int keyring_clear(struct key *keyring)
 		if (edit)
 			assoc_array_apply_edit(edit);
 		key_payload_reserve(keyring, 0);
+		keyring_search_invalidate();
 		ret = 0;
 	}
 
@@ -1360,5 +1580,6 @@ do_gc:
 	assoc_array_gc(&keyring->keys, &keyring_assoc_array_ops,
 		       keyring_gc_select_iterator, &limit);
 	up_write(&keyring->sem);
+	keyring_search_invalidate();
 	kleave(" [gc]");
 }
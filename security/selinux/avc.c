@@ -22,6 +22,7 @@
 #include <linux/init.h>
 #include <linux/skbuff.h>
 #include <linux/percpu.h>
+#include <linux/hardirq.h>
 #include <net/sock.h>
 #include <linux/un.h>
 #include <net/af_unix.h>
@@ -36,6 +37,7 @@
 #define AVC_CACHE_SLOTS			512
 #define AVC_DEF_CACHE_THRESHOLD		512
 #define AVC_CACHE_RECLAIM		16
+#define AVC_PCPU_SLOTS			32
 
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
 #define avc_cache_stats_incr(field)	this_cpu_inc(avc_cache_stats.field)
@@ -56,6 +58,22 @@ struct avc_node {
 	struct rcu_head		rhead;
 };
 
+/*
+ * Per-CPU front cache of the most recent decisions, consulted from task
+ * context ahead of the shared cache so that repeated checks of the same
+ * (ssid, tsid, tclass) stay on CPU-local cachelines.  An entry is only
+ * valid while its gen matches avc_pcpu_gen, which is bumped whenever a
+ * decision in the shared cache is changed or flushed.
+ */
+struct avc_pcpu_entry {
+	struct avc_entry	ae;
+	int			gen;
+};
+
+struct avc_pcpu_cache {
+	struct avc_pcpu_entry	slots[AVC_PCPU_SLOTS];
+};
+
 struct avc_cache {
 	struct hlist_head	slots[AVC_CACHE_SLOTS]; /* head for avc_node->list */
 	spinlock_t		slots_lock[AVC_CACHE_SLOTS]; /* lock for writes */
@@ -77,6 +95,9 @@ unsigned int avc_cache_threshold = AVC_DEF_CACHE_THRESHOLD;
 DEFINE_PER_CPU(struct avc_cache_stats, avc_cache_stats) = { 0 };
 #endif
 
+static DEFINE_PER_CPU(struct avc_pcpu_cache, avc_pcpu_cache);
+static atomic_t avc_pcpu_gen __read_mostly = ATOMIC_INIT(1);
+
 static struct avc_cache avc_cache;
 static struct avc_callback_node *avc_callbacks;
 static struct kmem_cache *avc_node_cachep;
@@ -86,6 +107,67 @@ static inline int avc_hash(u32 ssid, u32 tsid, u16 tclass)
 	return (ssid ^ (tsid<<2) ^ (tclass<<4)) & (AVC_CACHE_SLOTS - 1);
 }
 
+/*
+ * The front cache is only used from task context, so that a lookup can
+ * never be interrupted by an update of the same per-CPU slot.
+ */
+static inline struct avc_pcpu_entry *avc_pcpu_entry(u32 ssid, u32 tsid,
+						    u16 tclass)
+{
+	int hvalue = avc_hash(ssid, tsid, tclass) & (AVC_PCPU_SLOTS - 1);
+
+	return &get_cpu_var(avc_pcpu_cache).slots[hvalue];
+}
+
+static inline int avc_pcpu_lookup(u32 ssid, u32 tsid, u16 tclass,
+				  struct av_decision *avd)
+{
+	struct avc_pcpu_entry *pe;
+	int hit = 0;
+
+	if (in_interrupt())
+		return 0;
+
+	pe = avc_pcpu_entry(ssid, tsid, tclass);
+	if (pe->gen == atomic_read(&avc_pcpu_gen) &&
+	    pe->ae.ssid == ssid && pe->ae.tsid == tsid &&
+	    pe->ae.tclass == tclass) {
+		memcpy(avd, &pe->ae.avd, sizeof(*avd));
+		hit = 1;
+	}
+	put_cpu_var(avc_pcpu_cache);
+
+	return hit;
+}
+
+/*
+ * @gen must have been sampled before the decision was looked up, so
+ * that an update racing with the lookup leaves the entry stale.
+ */
+static inline void avc_pcpu_fill(u32 ssid, u32 tsid, u16 tclass,
+				 struct av_decision *avd, int gen)
+{
+	struct avc_pcpu_entry *pe;
+
+	if (in_interrupt())
+		return;
+
+	pe = avc_pcpu_entry(ssid, tsid, tclass);
+	pe->ae.ssid = ssid;
+	pe->ae.tsid = tsid;
+	pe->ae.tclass = tclass;
+	memcpy(&pe->ae.avd, avd, sizeof(*avd));
+	pe->gen = gen;
+	put_cpu_var(avc_pcpu_cache);
+}
+
+static inline void avc_pcpu_invalidate(void)
+{
+	/* Make the shared cache update visible before the new generation */
+	smp_mb__before_atomic_inc();
+	atomic_inc(&avc_pcpu_gen);
+}
+
 /**
  * avc_dump_av - Display an access vector in human-readable form.
  * @tclass: target security class
@@ -598,6 +680,8 @@ static int avc_update_node(u32 event, u32 perms, u32 ssid, u32 tsid, u16 tclass,
 	avc_node_replace(node, orig);
 out_unlock:
 	spin_unlock_irqrestore(lock, flag);
+	if (!rc)
+		avc_pcpu_invalidate();
 out:
 	return rc;
 }
@@ -628,6 +712,7 @@ static void avc_flush(void)
 		rcu_read_unlock();
 		spin_unlock_irqrestore(lock, flag);
 	}
+	avc_pcpu_invalidate();
 }
 
 /**
@@ -716,11 +801,21 @@ inline int avc_has_perm_noaudit(u32 ssid, u32 tsid,
 			 struct av_decision *avd)
 {
 	struct avc_node *node;
-	int rc = 0;
+	int rc = 0, gen;
 	u32 denied;
 
 	BUG_ON(!requested);
 
+	/* a hit that falls through is counted by avc_lookup() */
+	if (avc_pcpu_lookup(ssid, tsid, tclass, avd) &&
+	    likely(!(requested & ~(avd->allowed)))) {
+		avc_cache_stats_incr(lookups);
+		return 0;
+	}
+
+	gen = atomic_read(&avc_pcpu_gen);
+	smp_rmb();
+
 	rcu_read_lock();
 
 	node = avc_lookup(ssid, tsid, tclass);
@@ -730,6 +825,7 @@ inline int avc_has_perm_noaudit(u32 ssid, u32 tsid,
 		memcpy(avd, &node->ae.avd, sizeof(*avd));
 		avd = &node->ae.avd;
 	}
+	avc_pcpu_fill(ssid, tsid, tclass, avd, gen);
 
 	denied = requested & ~(avd->allowed);
 	if (unlikely(denied))
@@ -19,7 +19,9 @@
 
 #include <linux/kernel.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <linux/errno.h>
+#include <linux/jhash.h>
 #include "avtab.h"
 #include "policydb.h"
 
@@ -27,8 +29,19 @@ static struct kmem_cache *avtab_node_cachep;
 
 static inline int avtab_hash(struct avtab_key *keyp, u16 mask)
 {
-	return ((keyp->target_class + (keyp->target_type << 2) +
-		 (keyp->source_type << 9)) & mask);
+	return jhash_3words(keyp->source_type, keyp->target_type,
+			    keyp->target_class, 0) & mask;
+}
+
+/*
+ * Chains are kept sorted by (source_type, target_type, target_class);
+ * fold the three fields into one value so that walking a chain costs a
+ * single compare per node.
+ */
+static inline u64 avtab_key_order(const struct avtab_key *keyp)
+{
+	return ((u64)keyp->source_type << 32) |
+	       ((u32)keyp->target_type << 16) | keyp->target_class;
 }
 
 static struct avtab_node*
@@ -59,6 +72,7 @@ static int avtab_insert(struct avtab *h, struct avtab_key *key, struct avtab_dat
 	int hvalue;
 	struct avtab_node *prev, *cur, *newnode;
 	u16 specified = key->specified & ~(AVTAB_ENABLED|AVTAB_ENABLED_OLD);
+	u64 order = avtab_key_order(key);
 
 	if (!h || !h->htable)
 		return -EINVAL;
@@ -67,19 +81,11 @@ static int avtab_insert(struct avtab *h, struct avtab_key *key, struct avtab_dat
 	for (prev = NULL, cur = h->htable[hvalue];
 	     cur;
 	     prev = cur, cur = cur->next) {
-		if (key->source_type == cur->key.source_type &&
-		    key->target_type == cur->key.target_type &&
-		    key->target_class == cur->key.target_class &&
-		    (specified & cur->key.specified))
+		u64 cur_order = avtab_key_order(&cur->key);
+
+		if (order == cur_order && (specified & cur->key.specified))
 			return -EEXIST;
-		if (key->source_type < cur->key.source_type)
-			break;
-		if (key->source_type == cur->key.source_type &&
-		    key->target_type < cur->key.target_type)
-			break;
-		if (key->source_type == cur->key.source_type &&
-		    key->target_type == cur->key.target_type &&
-		    key->target_class < cur->key.target_class)
+		if (order < cur_order)
 			break;
 	}
 
@@ -100,6 +106,7 @@ avtab_insert_nonunique(struct avtab *h, struct avtab_key *key, struct avtab_datu
 	int hvalue;
 	struct avtab_node *prev, *cur;
 	u16 specified = key->specified & ~(AVTAB_ENABLED|AVTAB_ENABLED_OLD);
+	u64 order = avtab_key_order(key);
 
 	if (!h || !h->htable)
 		return NULL;
@@ -107,19 +114,11 @@ avtab_insert_nonunique(struct avtab *h, struct avtab_key *key, struct avtab_datu
 	for (prev = NULL, cur = h->htable[hvalue];
 	     cur;
 	     prev = cur, cur = cur->next) {
-		if (key->source_type == cur->key.source_type &&
-		    key->target_type == cur->key.target_type &&
-		    key->target_class == cur->key.target_class &&
-		    (specified & cur->key.specified))
-			break;
-		if (key->source_type < cur->key.source_type)
-			break;
-		if (key->source_type == cur->key.source_type &&
-		    key->target_type < cur->key.target_type)
+		u64 cur_order = avtab_key_order(&cur->key);
+
+		if (order == cur_order && (specified & cur->key.specified))
 			break;
-		if (key->source_type == cur->key.source_type &&
-		    key->target_type == cur->key.target_type &&
-		    key->target_class < cur->key.target_class)
+		if (order < cur_order)
 			break;
 	}
 	return avtab_insert_node(h, hvalue, prev, cur, key, datum);
@@ -130,26 +129,19 @@ struct avtab_datum *avtab_search(struct avtab *h, struct avtab_key *key)
 	int hvalue;
 	struct avtab_node *cur;
 	u16 specified = key->specified & ~(AVTAB_ENABLED|AVTAB_ENABLED_OLD);
+	u64 order = avtab_key_order(key);
 
 	if (!h || !h->htable)
 		return NULL;
 
 	hvalue = avtab_hash(key, h->mask);
 	for (cur = h->htable[hvalue]; cur; cur = cur->next) {
-		if (key->source_type == cur->key.source_type &&
-		    key->target_type == cur->key.target_type &&
-		    key->target_class == cur->key.target_class &&
-		    (specified & cur->key.specified))
+		u64 cur_order = avtab_key_order(&cur->key);
+
+		if (order == cur_order && (specified & cur->key.specified))
 			return &cur->datum;
 
-		if (key->source_type < cur->key.source_type)
-			break;
-		if (key->source_type == cur->key.source_type &&
-		    key->target_type < cur->key.target_type)
-			break;
-		if (key->source_type == cur->key.source_type &&
-		    key->target_type == cur->key.target_type &&
-		    key->target_class < cur->key.target_class)
+		if (order < cur_order)
 			break;
 	}
 
@@ -165,26 +157,19 @@ avtab_search_node(struct avtab *h, struct avtab_key *key)
 	int hvalue;
 	struct avtab_node *cur;
 	u16 specified = key->specified & ~(AVTAB_ENABLED|AVTAB_ENABLED_OLD);
+	u64 order = avtab_key_order(key);
 
 	if (!h || !h->htable)
 		return NULL;
 
 	hvalue = avtab_hash(key, h->mask);
 	for (cur = h->htable[hvalue]; cur; cur = cur->next) {
-		if (key->source_type == cur->key.source_type &&
-		    key->target_type == cur->key.target_type &&
-		    key->target_class == cur->key.target_class &&
-		    (specified & cur->key.specified))
+		u64 cur_order = avtab_key_order(&cur->key);
+
+		if (order == cur_order && (specified & cur->key.specified))
 			return cur;
 
-		if (key->source_type < cur->key.source_type)
-			break;
-		if (key->source_type == cur->key.source_type &&
-		    key->target_type < cur->key.target_type)
-			break;
-		if (key->source_type == cur->key.source_type &&
-		    key->target_type == cur->key.target_type &&
-		    key->target_class < cur->key.target_class)
+		if (order < cur_order)
 			break;
 	}
 	return NULL;
@@ -194,26 +179,21 @@ struct avtab_node*
 avtab_search_node_next(struct avtab_node *node, int specified)
 {
 	struct avtab_node *cur;
+	u64 order;
 
 	if (!node)
 		return NULL;
 
+	order = avtab_key_order(&node->key);
+
 	specified &= ~(AVTAB_ENABLED|AVTAB_ENABLED_OLD);
 	for (cur = node->next; cur; cur = cur->next) {
-		if (node->key.source_type == cur->key.source_type &&
-		    node->key.target_type == cur->key.target_type &&
-		    node->key.target_class == cur->key.target_class &&
-		    (specified & cur->key.specified))
+		u64 cur_order = avtab_key_order(&cur->key);
+
+		if (order == cur_order && (specified & cur->key.specified))
 			return cur;
 
-		if (node->key.source_type < cur->key.source_type)
-			break;
-		if (node->key.source_type == cur->key.source_type &&
-		    node->key.target_type < cur->key.target_type)
-			break;
-		if (node->key.source_type == cur->key.source_type &&
-		    node->key.target_type == cur->key.target_type &&
-		    node->key.target_class < cur->key.target_class)
+		if (order < cur_order)
 			break;
 	}
 	return NULL;
@@ -236,7 +216,7 @@ void avtab_destroy(struct avtab *h)
 		}
 		h->htable[i] = NULL;
 	}
-	kfree(h->htable);
+	kvfree(h->htable);
 	h->htable = NULL;
 	h->nslot = 0;
 	h->mask = 0;
@@ -270,7 +250,11 @@ int avtab_alloc(struct avtab *h, u32 nrules)
 		nslot = MAX_AVTAB_HASH_BUCKETS;
 	mask = nslot - 1;
 
-	h->htable = kcalloc(nslot, sizeof(*(h->htable)), GFP_KERNEL);
+	/* the largest tables would be order 4 allocations */
+	if (nslot * sizeof(*(h->htable)) > PAGE_SIZE)
+		h->htable = vzalloc(nslot * sizeof(*(h->htable)));
+	else
+		h->htable = kcalloc(nslot, sizeof(*(h->htable)), GFP_KERNEL);
 	if (!h->htable)
 		return -ENOMEM;
 
@@ -34,6 +34,12 @@ extern int bench_mem_memset(int argc, const char **argv, const char *prefix);
 extern int bench_futex_hash(int argc, const char **argv, const char *prefix);
 extern int bench_futex_wake(int argc, const char **argv, const char *prefix);
 extern int bench_futex_requeue(int argc, const char **argv, const char *prefix);
+extern int bench_net_tcp_rr(int argc, const char **argv, const char *prefix);
+extern int bench_net_tcp_stream(int argc, const char **argv, const char *prefix);
+extern int bench_net_udp(int argc, const char **argv, const char *prefix);
+extern int bench_net_epoll(int argc, const char **argv, const char *prefix);
+extern int bench_io_aio(int argc, const char **argv, const char *prefix);
+extern int bench_io_syscall(int argc, const char **argv, const char *prefix);
 
 #define BENCH_FORMAT_DEFAULT_STR	"default"
 #define BENCH_FORMAT_DEFAULT		0
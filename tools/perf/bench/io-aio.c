@@ -0,0 +1,235 @@
+/*
+ * io-aio.c
+ *
+ * aio: O_DIRECT random reads through native AIO at increasing queue depths
+ *
+ * Meant to be pointed at a null_blk device (modprobe null_blk; the default
+ * target is /dev/nullb0), where the media costs nothing and IOPS and
+ * completion latency are down to the submission and completion paths of
+ * the block layer and AIO.  Each depth from 1 up to the maximum, doubling,
+ * is run for the given time and reported with its completion latency
+ * percentiles.  Only reads are issued, so the target's contents are never
+ * touched.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+#include "latency.h"
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * The AIO ABI, as in include/uapi/linux/aio_abi.h, which can't be used next
+ * to perf's own linux/types.h.  aio_key and aio_reserved1 swap places on
+ * big endian, but both are always zero here.
+ */
+typedef unsigned long aio_context_t;
+
+#define IOCB_CMD_PREAD		0
+
+struct io_event {
+	u64	data;
+	u64	obj;
+	s64	res;
+	s64	res2;
+};
+
+struct iocb {
+	u64	aio_data;
+	u32	aio_key;
+	u32	aio_reserved1;
+	u16	aio_lio_opcode;
+	s16	aio_reqprio;
+	u32	aio_fildes;
+	u64	aio_buf;
+	u64	aio_nbytes;
+	s64	aio_offset;
+	u64	aio_reserved2;
+	u32	aio_flags;
+	u32	aio_resfd;
+};
+
+static const char *filename = "/dev/nullb0";
+static unsigned int bsize = 4096;
+static unsigned int max_depth = 128;
+static unsigned int nsecs = 3;
+
+static const struct option options[] = {
+	OPT_STRING ('f', "file",    &filename,  "path", "Specify file or block device to read from"),
+	OPT_UINTEGER('b', "bsize",  &bsize,     "Specify I/O size (in bytes)"),
+	OPT_UINTEGER('d', "depth",  &max_depth, "Specify maximum queue depth"),
+	OPT_UINTEGER('r', "runtime", &nsecs,    "Specify runtime per queue depth (in seconds)"),
+	OPT_END()
+};
+
+static const char * const bench_io_aio_usage[] = {
+	"perf bench io aio <options>",
+	NULL
+};
+
+static inline int io_setup(unsigned int nr, aio_context_t *ctx)
+{
+	return syscall(__NR_io_setup, nr, ctx);
+}
+
+static inline int io_destroy(aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+static inline int io_submit(aio_context_t ctx, long nr, struct iocb **iocbs)
+{
+	return syscall(__NR_io_submit, ctx, nr, iocbs);
+}
+
+static inline int io_getevents(aio_context_t ctx, long min_nr, long nr,
+			       struct io_event *events)
+{
+	return syscall(__NR_io_getevents, ctx, min_nr, nr, events, NULL);
+}
+
+struct aio_run {
+	int			fd;
+	unsigned int		depth;
+	u64			nblocks;
+	unsigned int		seed;
+	struct iocb		*iocbs;
+	struct io_event		*events;
+	u64			*submitted;
+	void			*bufs;
+};
+
+static void prep_read(struct aio_run *run, unsigned int i)
+{
+	struct iocb *iocb = &run->iocbs[i];
+	u64 block = ((u64)rand_r(&run->seed) << 31 | rand_r(&run->seed)) %
+		    run->nblocks;
+
+	memset(iocb, 0, sizeof(*iocb));
+	iocb->aio_data = i;
+	iocb->aio_lio_opcode = IOCB_CMD_PREAD;
+	iocb->aio_fildes = run->fd;
+	iocb->aio_buf = (u64)(unsigned long)run->bufs + (u64)i * bsize;
+	iocb->aio_nbytes = bsize;
+	iocb->aio_offset = block * bsize;
+}
+
+static int submit_read(aio_context_t ctx, struct aio_run *run, unsigned int i)
+{
+	struct iocb *iocb = &run->iocbs[i];
+
+	prep_read(run, i);
+	run->submitted[i] = bench_now_ns();
+	return io_submit(ctx, 1, &iocb) == 1 ? 0 : -1;
+}
+
+/* Keep @run->depth reads in flight for @nsecs and report how it went */
+static void run_depth(struct aio_run *run)
+{
+	aio_context_t ctx = 0;
+	struct lat_hist lat;
+	unsigned int i, inflight = 0;
+	unsigned long ios = 0;
+	u64 start, end, now;
+	int n, j;
+
+	if (io_setup(run->depth, &ctx))
+		err(EXIT_FAILURE, "io_setup");
+
+	lat_hist_init(&lat);
+	start = now = bench_now_ns();
+	end = start + nsecs * 1000000000ULL;
+
+	for (i = 0; i < run->depth; i++) {
+		if (submit_read(ctx, run, i))
+			err(EXIT_FAILURE, "io_submit");
+		inflight++;
+	}
+
+	while (inflight) {
+		n = io_getevents(ctx, 1, run->depth, run->events);
+		if (n < 0)
+			err(EXIT_FAILURE, "io_getevents");
+
+		now = bench_now_ns();
+		for (j = 0; j < n; j++) {
+			struct io_event *ev = &run->events[j];
+
+			inflight--;
+			if (ev->res != bsize)
+				errx(EXIT_FAILURE, "read failed: %lld",
+				     (long long)ev->res);
+			lat_hist_add(&lat, now - run->submitted[ev->data]);
+			ios++;
+
+			if (now < end) {
+				if (submit_read(ctx, run, ev->data))
+					err(EXIT_FAILURE, "io_submit");
+				inflight++;
+			}
+		}
+	}
+
+	io_destroy(ctx);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("depth %4u: %10.0f IOPS %8.1f MB/sec\n", run->depth,
+		       ios * 1e9 / (now - start),
+		       ios * 1e9 / (now - start) * bsize / (1 << 20));
+	else
+		printf("%u %.0f\n", run->depth, ios * 1e9 / (now - start));
+	lat_hist_print(&lat, "completion");
+}
+
+int bench_io_aio(int argc, const char **argv,
+		 const char *prefix __maybe_unused)
+{
+	struct aio_run run;
+	off_t size;
+
+	argc = parse_options(argc, argv, options, bench_io_aio_usage, 0);
+	if (argc || !bsize || !max_depth || bsize % 512) {
+		usage_with_options(bench_io_aio_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	memset(&run, 0, sizeof(run));
+	run.fd = open(filename, O_RDONLY | O_DIRECT);
+	if (run.fd < 0) {
+		/* not fatal, so that 'perf bench all' carries on */
+		warn("open: %s (modprobe null_blk or use -f)", filename);
+		return 1;
+	}
+
+	size = lseek(run.fd, 0, SEEK_END);
+	if (size < (off_t)bsize)
+		errx(EXIT_FAILURE, "%s: too small for %u byte reads", filename, bsize);
+	run.nblocks = size / bsize;
+
+	run.iocbs = calloc(max_depth, sizeof(*run.iocbs));
+	run.events = calloc(max_depth, sizeof(*run.events));
+	run.submitted = calloc(max_depth, sizeof(*run.submitted));
+	if (!run.iocbs || !run.events || !run.submitted)
+		err(EXIT_FAILURE, "calloc");
+	if (posix_memalign(&run.bufs, 4096, (size_t)max_depth * bsize))
+		err(EXIT_FAILURE, "posix_memalign");
+
+	printf("Run summary [PID %d]: %u byte random reads from %s, %u secs per depth.\n\n",
+	       getpid(), bsize, filename, nsecs);
+
+	for (run.depth = 1; run.depth <= max_depth; run.depth *= 2)
+		run_depth(&run);
+
+	free(run.bufs);
+	free(run.submitted);
+	free(run.events);
+	free(run.iocbs);
+	close(run.fd);
+	return 0;
+}
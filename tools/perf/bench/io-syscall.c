@@ -0,0 +1,151 @@
+/*
+ * io-syscall.c
+ *
+ * syscall: baseline rate of a trivial system call from N threads
+ *
+ * Every thread calls getppid(), which libc neither caches nor emulates,
+ * in batches and times each batch, so the per-call cost percentiles are
+ * not swamped by the cost of reading the clock.  This is the floor under
+ * every other benchmark here: changes to the entry and exit paths show up
+ * in it first.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+#include "latency.h"
+
+#include <err.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define SYSCALL_BATCH	256
+
+static unsigned int nthreads = 1;
+static unsigned int nsecs = 5;
+static volatile int done;
+static bool silent = false;
+
+static pthread_mutex_t thread_lock;
+static pthread_cond_t thread_parent, thread_worker;
+static unsigned int threads_starting;
+
+struct syscall_worker {
+	pthread_t		thread;
+	unsigned long		calls;
+	struct lat_hist		lat;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads, "Specify amount of threads"),
+	OPT_UINTEGER('r', "runtime", &nsecs,    "Specify runtime (in seconds)"),
+	OPT_BOOLEAN( 's', "silent",  &silent,   "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_io_syscall_usage[] = {
+	"perf bench io syscall <options>",
+	NULL
+};
+
+static void *workerfn(void *arg)
+{
+	struct syscall_worker *w = arg;
+	unsigned int i;
+	u64 t0;
+
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	while (!done) {
+		t0 = bench_now_ns();
+		for (i = 0; i < SYSCALL_BATCH; i++)
+			getppid();
+		lat_hist_add(&w->lat, (bench_now_ns() - t0) / SYSCALL_BATCH);
+		w->calls += SYSCALL_BATCH;
+	}
+
+	return NULL;
+}
+
+int bench_io_syscall(int argc, const char **argv,
+		     const char *prefix __maybe_unused)
+{
+	struct syscall_worker *worker;
+	struct stats call_stats;
+	struct lat_hist lat;
+	unsigned int i;
+	double secs, total = 0;
+	u64 start;
+
+	argc = parse_options(argc, argv, options, bench_io_syscall_usage, 0);
+	if (argc || !nthreads) {
+		usage_with_options(bench_io_syscall_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		err(EXIT_FAILURE, "calloc");
+
+	printf("Run summary [PID %d]: %u threads calling getppid() for %u secs.\n\n",
+	       getpid(), nthreads, nsecs);
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+	threads_starting = nthreads;
+
+	for (i = 0; i < nthreads; i++) {
+		lat_hist_init(&worker[i].lat);
+		if (pthread_create(&worker[i].thread, NULL, workerfn, &worker[i]))
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	start = bench_now_ns();
+	sleep(nsecs);
+	done = 1;
+
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_join(worker[i].thread, NULL))
+			err(EXIT_FAILURE, "pthread_join");
+	}
+	secs = (bench_now_ns() - start) / 1e9;
+
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	init_stats(&call_stats);
+	lat_hist_init(&lat);
+	for (i = 0; i < nthreads; i++) {
+		double rate = worker[i].calls / secs;
+
+		update_stats(&call_stats, rate);
+		lat_hist_merge(&lat, &worker[i].lat);
+		total += rate;
+		if (!silent)
+			printf("[thread %3u] %.0f syscalls/sec\n", i, rate);
+	}
+
+	printf("%sTotal %.0f syscalls/sec, %.0f per thread (+- %.2f%%)\n",
+	       !silent ? "\n" : "", total, avg_stats(&call_stats),
+	       rel_stddev_stats(stddev_stats(&call_stats), avg_stats(&call_stats)));
+	lat_hist_print(&lat, "per call");
+
+	free(worker);
+	return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * latency.c
+ *
+ * Latency histograms and percentile reporting shared by the net and io
+ * benchmark collections.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "bench.h"
+#include "latency.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void lat_hist_init(struct lat_hist *h)
+{
+	memset(h, 0, sizeof(*h));
+	h->min = (u64) -1;
+}
+
+void lat_hist_merge(struct lat_hist *dst, struct lat_hist *src)
+{
+	unsigned int i;
+
+	for (i = 0; i < LAT_HIST_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+	dst->count += src->count;
+	dst->sum += src->sum;
+	if (src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+/* The lowest value that falls in bucket @idx */
+static u64 lat_hist_value(unsigned int idx)
+{
+	unsigned int shift;
+
+	if (idx < LAT_HIST_SUB)
+		return idx;
+
+	shift = (idx >> LAT_HIST_SUB_BITS) - 1;
+	return (u64)(LAT_HIST_SUB + (idx & (LAT_HIST_SUB - 1))) << shift;
+}
+
+/*
+ * Returns the value below which @pct percent of the samples fall, as
+ * the midpoint of the bucket it is in, clamped to the observed range.
+ */
+u64 lat_hist_percentile(struct lat_hist *h, double pct)
+{
+	u64 want, seen = 0, lo, hi;
+	unsigned int i;
+
+	if (!h->count)
+		return 0;
+
+	want = (u64)(h->count * pct / 100.0);
+	if (want >= h->count)
+		want = h->count - 1;
+
+	for (i = 0; i < LAT_HIST_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen > want)
+			break;
+	}
+	if (i == LAT_HIST_BUCKETS)
+		return h->max;
+
+	lo = lat_hist_value(i);
+	hi = i + 1 < LAT_HIST_BUCKETS ? lat_hist_value(i + 1) : lo;
+	lo += (hi - lo) / 2;
+
+	if (lo < h->min)
+		return h->min;
+	if (lo > h->max)
+		return h->max;
+	return lo;
+}
+
+void lat_hist_print(struct lat_hist *h, const char *what)
+{
+	static const double pcts[] = { 50.0, 90.0, 99.0, 99.9 };
+	unsigned int i;
+
+	if (!h->count) {
+		printf(" %14s: no samples\n", what);
+		return;
+	}
+
+	if (bench_format == BENCH_FORMAT_SIMPLE) {
+		printf("%s %.3f %.3f", what, h->min / 1000.0,
+		       h->sum / h->count / 1000.0);
+		for (i = 0; i < ARRAY_SIZE(pcts); i++)
+			printf(" %.3f", lat_hist_percentile(h, pcts[i]) / 1000.0);
+		printf(" %.3f\n", h->max / 1000.0);
+		return;
+	}
+
+	printf(" %14s: %" PRIu64 " samples, usecs: min %.3f avg %.3f",
+	       what, h->count, h->min / 1000.0, h->sum / h->count / 1000.0);
+	for (i = 0; i < ARRAY_SIZE(pcts); i++)
+		printf(" p%g %.3f", pcts[i],
+		       lat_hist_percentile(h, pcts[i]) / 1000.0);
+	printf(" max %.3f\n", h->max / 1000.0);
+}
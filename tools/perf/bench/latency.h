@@ -0,0 +1,64 @@
+#ifndef _BENCH_LATENCY_H
+#define _BENCH_LATENCY_H
+
+/*
+ * Latency histograms for the benchmarks that report percentiles.
+ *
+ * Samples are in nanoseconds and land in log-linear buckets: each power
+ * of two is split into 1 << LAT_HIST_SUB_BITS linear buckets, so any
+ * percentile is exact to within about 6% at every scale while a
+ * histogram stays a fixed 8KB that threads can fill without locking
+ * and merge at the end.
+ */
+
+#include <time.h>
+#include "../util/types.h"
+
+#define LAT_HIST_SUB_BITS	4
+#define LAT_HIST_SUB		(1 << LAT_HIST_SUB_BITS)
+#define LAT_HIST_BUCKETS	(64 * LAT_HIST_SUB)
+
+struct lat_hist {
+	u64	count;
+	u64	min, max;
+	double	sum;
+	u64	buckets[LAT_HIST_BUCKETS];
+};
+
+static inline u64 bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline unsigned int lat_hist_index(u64 val)
+{
+	unsigned int shift;
+
+	if (val < LAT_HIST_SUB)
+		return val;
+
+	shift = 63 - __builtin_clzll(val) - LAT_HIST_SUB_BITS;
+	return ((shift + 1) << LAT_HIST_SUB_BITS) +
+		((val >> shift) & (LAT_HIST_SUB - 1));
+}
+
+static inline void lat_hist_add(struct lat_hist *h, u64 val)
+{
+	h->buckets[lat_hist_index(val)]++;
+	h->count++;
+	h->sum += val;
+	if (val < h->min)
+		h->min = val;
+	if (val > h->max)
+		h->max = val;
+}
+
+void lat_hist_init(struct lat_hist *h);
+void lat_hist_merge(struct lat_hist *dst, struct lat_hist *src);
+u64 lat_hist_percentile(struct lat_hist *h, double pct);
+void lat_hist_print(struct lat_hist *h, const char *what);
+
+#endif /* _BENCH_LATENCY_H */
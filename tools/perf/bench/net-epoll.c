@@ -0,0 +1,225 @@
+/*
+ * net-epoll.c
+ *
+ * epoll: wakeup latency of many threads each waiting in its own epoll set
+ *
+ * Every thread owns an epoll instance watching a set of pipes.  The
+ * threads form a ring: each one writes a timestamp into a random pipe of
+ * its successor and then waits for its predecessor to do the same, so
+ * there is always one event in flight per thread and the latency from
+ * write() to the waiter reading it covers ep_poll_callback(), the wakeup
+ * and epoll_wait() returning.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+#include "latency.h"
+
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+
+static unsigned int nthreads = 0;
+static unsigned int nfds = 16;
+static unsigned int nsecs = 5;
+static volatile int done;
+static bool silent = false;
+
+static pthread_mutex_t thread_lock;
+static pthread_cond_t thread_parent, thread_worker;
+static unsigned int threads_starting;
+
+struct epoll_worker {
+	int			epfd;
+	int			(*pipes)[2];
+	struct epoll_worker	*next;
+	unsigned int		seed;
+	pthread_t		thread;
+	unsigned long		events;
+	struct lat_hist		lat;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads, "Specify amount of threads"),
+	OPT_UINTEGER('f', "fds",     &nfds,     "Specify amount of pipes watched per thread"),
+	OPT_UINTEGER('r', "runtime", &nsecs,    "Specify runtime (in seconds)"),
+	OPT_BOOLEAN( 's', "silent",  &silent,   "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_net_epoll_usage[] = {
+	"perf bench net epoll <options>",
+	NULL
+};
+
+static void kick(struct epoll_worker *w)
+{
+	struct epoll_worker *next = w->next;
+	u64 now = bench_now_ns();
+
+	if (write(next->pipes[rand_r(&w->seed) % nfds][1], &now, sizeof(now)) !=
+	    sizeof(now))
+		err(EXIT_FAILURE, "write");
+}
+
+static void *workerfn(void *arg)
+{
+	struct epoll_worker *w = arg;
+	struct epoll_event *events;
+	int i, n;
+	u64 ts;
+
+	events = calloc(nfds, sizeof(*events));
+	if (!events)
+		err(EXIT_FAILURE, "calloc");
+
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	kick(w);
+	while (!done) {
+		/* time out now and then so the end of the run is noticed */
+		n = epoll_wait(w->epfd, events, nfds, 100);
+		for (i = 0; i < n; i++) {
+			if (read(events[i].data.fd, &ts, sizeof(ts)) != sizeof(ts))
+				continue;
+			lat_hist_add(&w->lat, bench_now_ns() - ts);
+			w->events++;
+			if (!done)
+				kick(w);
+		}
+	}
+
+	free(events);
+	return NULL;
+}
+
+static void setup_worker(struct epoll_worker *w)
+{
+	struct epoll_event ev;
+	unsigned int i;
+
+	w->epfd = epoll_create(nfds);
+	if (w->epfd < 0)
+		err(EXIT_FAILURE, "epoll_create");
+
+	w->pipes = calloc(nfds, sizeof(*w->pipes));
+	if (!w->pipes)
+		err(EXIT_FAILURE, "calloc");
+
+	for (i = 0; i < nfds; i++) {
+		if (pipe(w->pipes[i]))
+			err(EXIT_FAILURE, "pipe");
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = w->pipes[i][0];
+		if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->pipes[i][0], &ev))
+			err(EXIT_FAILURE, "epoll_ctl");
+	}
+	lat_hist_init(&w->lat);
+}
+
+static void teardown_worker(struct epoll_worker *w)
+{
+	unsigned int i;
+
+	for (i = 0; i < nfds; i++) {
+		close(w->pipes[i][0]);
+		close(w->pipes[i][1]);
+	}
+	free(w->pipes);
+	close(w->epfd);
+}
+
+int bench_net_epoll(int argc, const char **argv,
+		    const char *prefix __maybe_unused)
+{
+	struct epoll_worker *worker;
+	struct stats event_stats;
+	struct lat_hist lat;
+	unsigned int i;
+	double secs;
+	u64 start;
+
+	argc = parse_options(argc, argv, options, bench_net_epoll_usage, 0);
+	if (argc || !nfds) {
+		usage_with_options(bench_net_epoll_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!nthreads) /* default to the number of CPUs */
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		err(EXIT_FAILURE, "calloc");
+
+	printf("Run summary [PID %d]: %u threads, each watching %u pipes for %u secs.\n\n",
+	       getpid(), nthreads, nfds, nsecs);
+
+	for (i = 0; i < nthreads; i++) {
+		setup_worker(&worker[i]);
+		worker[i].next = &worker[(i + 1) % nthreads];
+		worker[i].seed = i;
+	}
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+	threads_starting = nthreads;
+
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&worker[i].thread, NULL, workerfn, &worker[i]))
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	start = bench_now_ns();
+	sleep(nsecs);
+	done = 1;
+
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_join(worker[i].thread, NULL))
+			err(EXIT_FAILURE, "pthread_join");
+	}
+	secs = (bench_now_ns() - start) / 1e9;
+
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	init_stats(&event_stats);
+	lat_hist_init(&lat);
+	for (i = 0; i < nthreads; i++) {
+		update_stats(&event_stats, worker[i].events / secs);
+		lat_hist_merge(&lat, &worker[i].lat);
+		if (!silent)
+			printf("[thread %3u] %.0f events/sec\n", i,
+			       worker[i].events / secs);
+		teardown_worker(&worker[i]);
+	}
+
+	printf("%sAveraged %.0f events/sec per thread (+- %.2f%%)\n",
+	       !silent ? "\n" : "", avg_stats(&event_stats),
+	       rel_stddev_stats(stddev_stats(&event_stats), avg_stats(&event_stats)));
+	lat_hist_print(&lat, "wakeup");
+
+	free(worker);
+	return 0;
+}
@@ -0,0 +1,380 @@
+/*
+ * net-tcp.c
+ *
+ * tcp-rr:     request/response transactions over loopback TCP flows
+ * tcp-stream: bulk transfer over loopback TCP flows
+ *
+ * Each flow is a connected pair of sockets with one thread on either end,
+ * so with many flows this stresses the socket and TCP fast paths from all
+ * CPUs at once.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+#include "latency.h"
+
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+static unsigned int nflows = 1;
+static unsigned int nsecs = 5;
+static unsigned int rr_bytes = 1;
+static unsigned int stream_bytes = 65536;
+static volatile int done;
+static bool silent = false;
+
+static pthread_mutex_t thread_lock;
+static pthread_cond_t thread_parent, thread_worker;
+static unsigned int threads_starting;
+
+struct flow {
+	int			client_fd;
+	int			server_fd;
+	unsigned int		bytes;
+	pthread_t		client;
+	pthread_t		server;
+	unsigned long		ops;
+	unsigned long long	rx_bytes;
+	struct lat_hist		lat;
+};
+
+static const struct option rr_options[] = {
+	OPT_UINTEGER('f', "flows",   &nflows,   "Specify amount of flows"),
+	OPT_UINTEGER('b', "bytes",   &rr_bytes, "Specify request and response size"),
+	OPT_UINTEGER('r', "runtime", &nsecs,    "Specify runtime (in seconds)"),
+	OPT_BOOLEAN( 's', "silent",  &silent,   "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_net_tcp_rr_usage[] = {
+	"perf bench net tcp-rr <options>",
+	NULL
+};
+
+static const struct option stream_options[] = {
+	OPT_UINTEGER('f', "flows",   &nflows,       "Specify amount of flows"),
+	OPT_UINTEGER('b', "bytes",   &stream_bytes, "Specify size of each write"),
+	OPT_UINTEGER('r', "runtime", &nsecs,        "Specify runtime (in seconds)"),
+	OPT_BOOLEAN( 's', "silent",  &silent,       "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_net_tcp_stream_usage[] = {
+	"perf bench net tcp-stream <options>",
+	NULL
+};
+
+static void wait_for_start(void)
+{
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+}
+
+static int read_full(int fd, char *buf, size_t len)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = read(fd, buf, len);
+		if (ret <= 0)
+			return -1;
+		buf += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+static int write_full(int fd, const char *buf, size_t len)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = write(fd, buf, len);
+		if (ret <= 0)
+			return -1;
+		buf += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+static void *rr_client(void *arg)
+{
+	struct flow *f = arg;
+	char *buf = zalloc(f->bytes);
+	u64 t0;
+
+	if (!buf)
+		err(EXIT_FAILURE, "zalloc");
+
+	wait_for_start();
+
+	while (!done) {
+		t0 = bench_now_ns();
+		if (write_full(f->client_fd, buf, f->bytes) ||
+		    read_full(f->client_fd, buf, f->bytes))
+			break;
+		lat_hist_add(&f->lat, bench_now_ns() - t0);
+		f->ops++;
+	}
+
+	shutdown(f->client_fd, SHUT_WR);
+	free(buf);
+	return NULL;
+}
+
+static void *rr_server(void *arg)
+{
+	struct flow *f = arg;
+	char *buf = zalloc(f->bytes);
+
+	if (!buf)
+		err(EXIT_FAILURE, "zalloc");
+
+	wait_for_start();
+
+	while (!read_full(f->server_fd, buf, f->bytes) &&
+	       !write_full(f->server_fd, buf, f->bytes))
+		;
+
+	free(buf);
+	return NULL;
+}
+
+static void *stream_client(void *arg)
+{
+	struct flow *f = arg;
+	char *buf = zalloc(f->bytes);
+	u64 t0;
+
+	if (!buf)
+		err(EXIT_FAILURE, "zalloc");
+
+	wait_for_start();
+
+	while (!done) {
+		t0 = bench_now_ns();
+		if (write_full(f->client_fd, buf, f->bytes))
+			break;
+		lat_hist_add(&f->lat, bench_now_ns() - t0);
+		f->ops++;
+	}
+
+	shutdown(f->client_fd, SHUT_WR);
+	free(buf);
+	return NULL;
+}
+
+static void *stream_server(void *arg)
+{
+	struct flow *f = arg;
+	char *buf = zalloc(f->bytes);
+	ssize_t ret;
+
+	if (!buf)
+		err(EXIT_FAILURE, "zalloc");
+
+	wait_for_start();
+
+	while ((ret = read(f->server_fd, buf, f->bytes)) > 0) {
+		if (!done)
+			f->rx_bytes += ret;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+/* Connect @nflows socket pairs over loopback */
+static void setup_flows(struct flow *flows, unsigned int bytes, bool nodelay)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int lfd, one = 1;
+	unsigned int i;
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0)
+		err(EXIT_FAILURE, "socket");
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    getsockname(lfd, (struct sockaddr *)&addr, &len) ||
+	    listen(lfd, nflows))
+		err(EXIT_FAILURE, "listen");
+
+	for (i = 0; i < nflows; i++) {
+		struct flow *f = &flows[i];
+
+		f->bytes = bytes;
+		lat_hist_init(&f->lat);
+
+		f->client_fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (f->client_fd < 0)
+			err(EXIT_FAILURE, "socket");
+		if (connect(f->client_fd, (struct sockaddr *)&addr, sizeof(addr)))
+			err(EXIT_FAILURE, "connect");
+		f->server_fd = accept(lfd, NULL, NULL);
+		if (f->server_fd < 0)
+			err(EXIT_FAILURE, "accept");
+
+		if (nodelay &&
+		    (setsockopt(f->client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) ||
+		     setsockopt(f->server_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one))))
+			err(EXIT_FAILURE, "setsockopt(TCP_NODELAY)");
+	}
+
+	close(lfd);
+}
+
+static double run_flows(struct flow *flows, void *(*client)(void *),
+			void *(*server)(void *))
+{
+	unsigned int i;
+	u64 start;
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	/* the benches of a collection run one after another in one process */
+	done = 0;
+	threads_starting = 2 * nflows;
+	for (i = 0; i < nflows; i++) {
+		if (pthread_create(&flows[i].server, NULL, server, &flows[i]) ||
+		    pthread_create(&flows[i].client, NULL, client, &flows[i]))
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	start = bench_now_ns();
+	sleep(nsecs);
+	done = 1;
+
+	for (i = 0; i < nflows; i++) {
+		if (pthread_join(flows[i].client, NULL) ||
+		    pthread_join(flows[i].server, NULL))
+			err(EXIT_FAILURE, "pthread_join");
+		close(flows[i].client_fd);
+		close(flows[i].server_fd);
+	}
+
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	return (bench_now_ns() - start) / 1e9;
+}
+
+int bench_net_tcp_rr(int argc, const char **argv,
+		     const char *prefix __maybe_unused)
+{
+	struct stats tps_stats;
+	struct lat_hist lat;
+	struct flow *flows;
+	unsigned int i;
+	double secs, total = 0;
+
+	argc = parse_options(argc, argv, rr_options, bench_net_tcp_rr_usage, 0);
+	if (argc || !nflows || !rr_bytes) {
+		usage_with_options(bench_net_tcp_rr_usage, rr_options);
+		exit(EXIT_FAILURE);
+	}
+
+	flows = calloc(nflows, sizeof(*flows));
+	if (!flows)
+		err(EXIT_FAILURE, "calloc");
+
+	printf("Run summary [PID %d]: %u flows, %u byte transactions for %u secs.\n\n",
+	       getpid(), nflows, rr_bytes, nsecs);
+
+	setup_flows(flows, rr_bytes, true);
+	secs = run_flows(flows, rr_client, rr_server);
+
+	init_stats(&tps_stats);
+	lat_hist_init(&lat);
+	for (i = 0; i < nflows; i++) {
+		double tps = flows[i].ops / secs;
+
+		update_stats(&tps_stats, tps);
+		lat_hist_merge(&lat, &flows[i].lat);
+		total += tps;
+		if (!silent)
+			printf("[flow %3u] %.0f transactions/sec\n", i, tps);
+	}
+
+	printf("%sTotal %.0f transactions/sec, %.0f per flow (+- %.2f%%)\n",
+	       !silent ? "\n" : "", total, avg_stats(&tps_stats),
+	       rel_stddev_stats(stddev_stats(&tps_stats), avg_stats(&tps_stats)));
+	lat_hist_print(&lat, "round trip");
+
+	free(flows);
+	return 0;
+}
+
+int bench_net_tcp_stream(int argc, const char **argv,
+			 const char *prefix __maybe_unused)
+{
+	struct stats bw_stats;
+	struct lat_hist lat;
+	struct flow *flows;
+	unsigned int i;
+	double secs, total = 0;
+
+	argc = parse_options(argc, argv, stream_options, bench_net_tcp_stream_usage, 0);
+	if (argc || !nflows || !stream_bytes) {
+		usage_with_options(bench_net_tcp_stream_usage, stream_options);
+		exit(EXIT_FAILURE);
+	}
+
+	flows = calloc(nflows, sizeof(*flows));
+	if (!flows)
+		err(EXIT_FAILURE, "calloc");
+
+	printf("Run summary [PID %d]: %u flows, %u byte writes for %u secs.\n\n",
+	       getpid(), nflows, stream_bytes, nsecs);
+
+	setup_flows(flows, stream_bytes, false);
+	secs = run_flows(flows, stream_client, stream_server);
+
+	init_stats(&bw_stats);
+	lat_hist_init(&lat);
+	for (i = 0; i < nflows; i++) {
+		double mbps = flows[i].rx_bytes / secs / (1 << 20);
+
+		update_stats(&bw_stats, mbps);
+		lat_hist_merge(&lat, &flows[i].lat);
+		total += mbps;
+		if (!silent)
+			printf("[flow %3u] %.1f MB/sec\n", i, mbps);
+	}
+
+	printf("%sTotal %.1f MB/sec, %.1f per flow (+- %.2f%%)\n",
+	       !silent ? "\n" : "", total, avg_stats(&bw_stats),
+	       rel_stddev_stats(stddev_stats(&bw_stats), avg_stats(&bw_stats)));
+	lat_hist_print(&lat, "write");
+
+	free(flows);
+	return 0;
+}
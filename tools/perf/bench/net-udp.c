@@ -0,0 +1,251 @@
+/*
+ * net-udp.c
+ *
+ * udp: datagram rate over loopback into a SO_REUSEPORT group of sockets
+ *
+ * A group of receiver threads each own a socket bound to the same port
+ * with SO_REUSEPORT, and sender threads blast datagrams at that port
+ * from sockets of their own.  On loopback the whole receive path runs
+ * in the sender's sendto(), so its latency is reported as the cost of a
+ * datagram through the stack, and the spread across receivers shows how
+ * evenly the reuseport group fans out.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+#include "latency.h"
+
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifndef SO_REUSEPORT
+#define SO_REUSEPORT	15
+#endif
+
+static unsigned int nreceivers = 0;
+static unsigned int nsenders = 0;
+static unsigned int nsecs = 5;
+static unsigned int nbytes = 64;
+static volatile int done;
+static bool silent = false;
+
+static pthread_mutex_t thread_lock;
+static pthread_cond_t thread_parent, thread_worker;
+static unsigned int threads_starting;
+static struct sockaddr_in group_addr;
+
+struct udp_worker {
+	int			fd;
+	pthread_t		thread;
+	unsigned long		packets;
+	struct lat_hist		lat;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "receivers", &nreceivers, "Specify amount of receiving threads"),
+	OPT_UINTEGER('c', "senders",   &nsenders,   "Specify amount of sending threads"),
+	OPT_UINTEGER('b', "bytes",     &nbytes,     "Specify datagram payload size"),
+	OPT_UINTEGER('r', "runtime",   &nsecs,      "Specify runtime (in seconds)"),
+	OPT_BOOLEAN( 's', "silent",    &silent,     "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_net_udp_usage[] = {
+	"perf bench net udp <options>",
+	NULL
+};
+
+static void wait_for_start(void)
+{
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+}
+
+static void *receiver(void *arg)
+{
+	struct udp_worker *w = arg;
+	char *buf = zalloc(nbytes);
+
+	if (!buf)
+		err(EXIT_FAILURE, "zalloc");
+
+	wait_for_start();
+
+	while (!done) {
+		if (recv(w->fd, buf, nbytes, 0) >= 0)
+			w->packets++;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static void *sender(void *arg)
+{
+	struct udp_worker *w = arg;
+	char *buf = zalloc(nbytes);
+	u64 t0;
+
+	if (!buf)
+		err(EXIT_FAILURE, "zalloc");
+
+	wait_for_start();
+
+	while (!done) {
+		t0 = bench_now_ns();
+		if (sendto(w->fd, buf, nbytes, 0, (struct sockaddr *)&group_addr,
+			   sizeof(group_addr)) < 0)
+			continue;
+		lat_hist_add(&w->lat, bench_now_ns() - t0);
+		w->packets++;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static void setup_receivers(struct udp_worker *rx)
+{
+	/* so that receivers notice the end of the run */
+	struct timeval tv = { .tv_sec = 0, .tv_usec = 100000 };
+	socklen_t len = sizeof(group_addr);
+	int one = 1;
+	unsigned int i;
+
+	memset(&group_addr, 0, sizeof(group_addr));
+	group_addr.sin_family = AF_INET;
+	group_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	for (i = 0; i < nreceivers; i++) {
+		rx[i].fd = socket(AF_INET, SOCK_DGRAM, 0);
+		if (rx[i].fd < 0)
+			err(EXIT_FAILURE, "socket");
+		if (setsockopt(rx[i].fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)))
+			err(EXIT_FAILURE, "setsockopt(SO_REUSEPORT)");
+		if (setsockopt(rx[i].fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)))
+			err(EXIT_FAILURE, "setsockopt(SO_RCVTIMEO)");
+		/* the first bind picks the port the rest of the group joins */
+		if (bind(rx[i].fd, (struct sockaddr *)&group_addr, sizeof(group_addr)))
+			err(EXIT_FAILURE, "bind");
+		if (!i && getsockname(rx[i].fd, (struct sockaddr *)&group_addr, &len))
+			err(EXIT_FAILURE, "getsockname");
+	}
+}
+
+int bench_net_udp(int argc, const char **argv,
+		  const char *prefix __maybe_unused)
+{
+	struct udp_worker *rx, *tx;
+	struct stats rx_stats;
+	struct lat_hist lat;
+	unsigned long sent = 0, received = 0;
+	unsigned int i, ncpus;
+	double secs;
+	u64 start;
+
+	argc = parse_options(argc, argv, options, bench_net_udp_usage, 0);
+	if (argc || !nbytes) {
+		usage_with_options(bench_net_udp_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nreceivers)
+		nreceivers = max(ncpus / 2, 1U);
+	if (!nsenders)
+		nsenders = max(ncpus - nreceivers, 1U);
+
+	rx = calloc(nreceivers, sizeof(*rx));
+	tx = calloc(nsenders, sizeof(*tx));
+	if (!rx || !tx)
+		err(EXIT_FAILURE, "calloc");
+
+	setup_receivers(rx);
+
+	printf("Run summary [PID %d]: %u senders, %u receivers, %u byte datagrams for %u secs.\n\n",
+	       getpid(), nsenders, nreceivers, nbytes, nsecs);
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+	threads_starting = nreceivers + nsenders;
+
+	for (i = 0; i < nreceivers; i++) {
+		if (pthread_create(&rx[i].thread, NULL, receiver, &rx[i]))
+			err(EXIT_FAILURE, "pthread_create");
+	}
+	for (i = 0; i < nsenders; i++) {
+		tx[i].fd = socket(AF_INET, SOCK_DGRAM, 0);
+		if (tx[i].fd < 0)
+			err(EXIT_FAILURE, "socket");
+		lat_hist_init(&tx[i].lat);
+		if (pthread_create(&tx[i].thread, NULL, sender, &tx[i]))
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	start = bench_now_ns();
+	sleep(nsecs);
+	done = 1;
+
+	for (i = 0; i < nsenders; i++) {
+		if (pthread_join(tx[i].thread, NULL))
+			err(EXIT_FAILURE, "pthread_join");
+		close(tx[i].fd);
+	}
+	for (i = 0; i < nreceivers; i++) {
+		if (pthread_join(rx[i].thread, NULL))
+			err(EXIT_FAILURE, "pthread_join");
+		close(rx[i].fd);
+	}
+	secs = (bench_now_ns() - start) / 1e9;
+
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	init_stats(&rx_stats);
+	for (i = 0; i < nreceivers; i++) {
+		update_stats(&rx_stats, rx[i].packets / secs);
+		received += rx[i].packets;
+		if (!silent)
+			printf("[receiver %3u] %.0f packets/sec\n", i,
+			       rx[i].packets / secs);
+	}
+
+	lat_hist_init(&lat);
+	for (i = 0; i < nsenders; i++) {
+		lat_hist_merge(&lat, &tx[i].lat);
+		sent += tx[i].packets;
+	}
+
+	printf("%sSent %.0f packets/sec, received %.0f packets/sec (%.2f%% dropped)\n",
+	       !silent ? "\n" : "", sent / secs, received / secs,
+	       sent ? 100.0 * (sent - min(received, sent)) / sent : 0.0);
+	printf("Per receiver %.0f packets/sec (+- %.2f%%)\n", avg_stats(&rx_stats),
+	       rel_stddev_stats(stddev_stats(&rx_stats), avg_stats(&rx_stats)));
+	lat_hist_print(&lat, "sendto");
+
+	free(rx);
+	free(tx);
+	return 0;
+}
@@ -13,6 +13,8 @@
  *  mem   ... memory access performance
  *  numa  ... NUMA scheduling and MM performance
  *  futex ... Futex performance
+ *  net   ... Network stack performance
+ *  io    ... Block layer and syscall performance
  */
 #include "perf.h"
 #include "util/util.h"
@@ -63,6 +65,22 @@ static struct bench futex_benchmarks[] = {
 	{ NULL,		NULL,						NULL			}
 };
 
+static struct bench net_benchmarks[] = {
+	{ "tcp-rr",	"Benchmark for TCP request/response over loopback",	bench_net_tcp_rr	},
+	{ "tcp-stream",	"Benchmark for TCP bulk transfer over loopback",	bench_net_tcp_stream	},
+	{ "udp",	"Benchmark for UDP packet rate over a reuseport group",	bench_net_udp		},
+	{ "epoll",	"Benchmark for epoll wakeups across threads",		bench_net_epoll		},
+	{ "all",	"Test all network benchmarks",				NULL			},
+	{ NULL,		NULL,							NULL			}
+};
+
+static struct bench io_benchmarks[] = {
+	{ "syscall",	"Benchmark for syscall entry and exit",			bench_io_syscall	},
+	{ "aio",	"Benchmark for O_DIRECT AIO at increasing queue depths",	bench_io_aio		},
+	{ "all",	"Test all I/O benchmarks",				NULL			},
+	{ NULL,		NULL,							NULL			}
+};
+
 struct collection {
 	const char	*name;
 	const char	*summary;
@@ -76,6 +94,8 @@ static struct collection collections[] = {
 	{ "numa",	"NUMA scheduling and MM benchmarks",		numa_benchmarks		},
 #endif
 	{"futex",       "Futex stressing benchmarks",                   futex_benchmarks        },
+	{ "net",	"Network stack benchmarks",			net_benchmarks		},
+	{ "io",		"Block layer and syscall benchmarks",		io_benchmarks		},
 	{ "all",	"All benchmarks",				NULL			},
 	{ NULL,		NULL,						NULL			}
 };
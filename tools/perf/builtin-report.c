@@ -52,6 +52,7 @@ struct report {
 	bool			header;
 	bool			header_only;
 	int			max_stack;
+	int			nr_jobs;
 	struct perf_read_values	show_threads_values;
 	const char		*pretty_printing_style;
 	const char		*cpu_list;
@@ -537,6 +538,10 @@ static int __cmd_report(struct report *rep)
 	if (ret)
 		return ret;
 
+	ret = machine__preload_dsos(&session->machines.host, rep->nr_jobs);
+	if (ret)
+		return ret;
+
 	ret = perf_session__process_events(session, &rep->tool);
 	if (ret)
 		return ret;
@@ -730,6 +735,7 @@ int cmd_report(int argc, const char **argv, const char *prefix __maybe_unused)
 			.ordering_requires_timestamps = true,
 		},
 		.max_stack		 = PERF_MAX_STACK_DEPTH,
+		.nr_jobs		 = sysconf(_SC_NPROCESSORS_ONLN),
 		.pretty_printing_style	 = "normal",
 	};
 	const struct option options[] = {
@@ -777,6 +783,9 @@ int cmd_report(int argc, const char **argv, const char *prefix __maybe_unused)
 		    "Set the maximum stack depth when parsing the callchain, "
 		    "anything beyond the specified depth will be ignored. "
 		    "Default: " __stringify(PERF_MAX_STACK_DEPTH)),
+	OPT_INTEGER(0, "jobs", &report.nr_jobs,
+		    "Number of threads loading the DSO symbols up front. "
+		    "Default: the number of online CPUs"),
 	OPT_BOOLEAN('G', "inverted", &report.inverted_callchain,
 		    "alias for inverted call graph"),
 	OPT_CALLBACK(0, "ignore-callees", NULL, "regex",
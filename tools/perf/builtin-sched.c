@@ -139,6 +139,8 @@ struct perf_sched {
 	char		 next_shortname1;
 	char		 next_shortname2;
 	unsigned int	 replay_repeat;
+	bool		 live;
+	unsigned int	 live_duration;
 	unsigned long	 nr_run_events;
 	unsigned long	 nr_sleep_events;
 	unsigned long	 nr_wakeup_events;
@@ -1554,6 +1556,286 @@ static int perf_sched__lat(struct perf_sched *sched)
 	return 0;
 }
 
+/*
+ * perf sched latency --live: instead of recording every scheduler event,
+ * have a hist trigger on sched_stat_wait bucket the wait times in the
+ * kernel, keyed on pid, cpu and log2 of the delay, and read back only
+ * the table once done.  Bucket n holds the delays in [2^(n-1), 2^n) ns.
+ *
+ * sched_stat_wait is only emitted with CONFIG_SCHEDSTATS, and for the
+ * fair class only.  It also fires when a runnable task is dequeued for
+ * migration, so a wait spanning a migration is split in two and its
+ * first part is charged to the CPU it was migrated to.
+ */
+#define LIVE_EVENT		"sched/sched_stat_wait"
+#define LIVE_TRIGGER		"hist:keys=pid,cpu,delay.log2:vals=delay:size=65536"
+#define LIVE_NR_BUCKETS		65
+
+struct live_lat {
+	int		id;		/* pid or cpu */
+	u64		nr;
+	u64		total;
+	u64		buckets[LIVE_NR_BUCKETS];
+};
+
+static volatile int live_done;
+
+static void live_sig_handler(int sig __maybe_unused)
+{
+	live_done = 1;
+}
+
+static int live_write_trigger(const char *trigger)
+{
+	char path[PATH_MAX];
+	ssize_t len = strlen(trigger);
+	int fd, err = 0;
+
+	snprintf(path, sizeof(path), "%s/%s/trigger", tracing_events_path,
+		 LIVE_EVENT);
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -errno;
+	if (write(fd, trigger, len) != len)
+		err = -errno;
+	close(fd);
+	return err;
+}
+
+static u64 live_bucket_max(unsigned int bucket)
+{
+	return bucket < 64 ? 1ULL << bucket : ~0ULL;
+}
+
+/* Upper bound of the bucket holding the @pct percentile */
+static u64 live_lat_percentile(struct live_lat *lat, double pct)
+{
+	u64 want = ceil(lat->nr * pct / 100.0), seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < LIVE_NR_BUCKETS; i++) {
+		seen += lat->buckets[i];
+		if (seen && seen >= want)
+			return live_bucket_max(i);
+	}
+	return 0;
+}
+
+static u64 live_lat_max(struct live_lat *lat)
+{
+	int i;
+
+	for (i = LIVE_NR_BUCKETS - 1; i >= 0; i--) {
+		if (lat->buckets[i])
+			return live_bucket_max(i);
+	}
+	return 0;
+}
+
+static const char live_rule[] =
+	"--------------------------------------------------------------------------------------------";
+
+/* The delay columns are upper bounds, of the bucket the delay falls in */
+static void live_lat_header(const char *name)
+{
+	printf("  %-22s|%9s |%19s |%16s |%16s |\n", name, "Waits",
+	       "Average delay ms", "< 99% delay ms", "< Max delay ms");
+	printf(" %s\n", live_rule);
+}
+
+static void live_lat_print(struct live_lat *lat, const char *name)
+{
+	printf("  %-22s|%9" PRIu64 " |%16.3f ms |%13.3f ms |%13.3f ms |\n",
+	       name, lat->nr, lat->nr ? (double)lat->total / lat->nr / 1e6 : 0,
+	       (double)live_lat_percentile(lat, 99) / 1e6,
+	       (double)live_lat_max(lat) / 1e6);
+}
+
+static void live_lat_print_hist(struct live_lat *lat)
+{
+	u64 peak = 0;
+	unsigned int i;
+
+	for (i = 0; i < LIVE_NR_BUCKETS; i++)
+		peak = max(peak, lat->buckets[i]);
+
+	for (i = 0; i < LIVE_NR_BUCKETS; i++) {
+		u64 nr = lat->buckets[i];
+		int bar = peak ? nr * 40 / peak : 0;
+
+		if (!nr)
+			continue;
+		printf("      %12" PRIu64 " -> %-12" PRIu64 " ns : %9" PRIu64
+		       " |%-40.*s|\n", i ? live_bucket_max(i - 1) : 0,
+		       live_bucket_max(i), nr, bar,
+		       "****************************************");
+	}
+}
+
+static void live_task_name(int pid, char *name, size_t size)
+{
+	char path[PATH_MAX], comm[COMM_LEN] = "<exited>";
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "/proc/%d/comm", pid);
+	fp = fopen(path, "r");
+	if (fp) {
+		if (fgets(comm, sizeof(comm), fp))
+			comm[strcspn(comm, "\n")] = '\0';
+		fclose(fp);
+	}
+	snprintf(name, size, "%s:%d", comm, pid);
+}
+
+static int live_lat_cmp(const void *a, const void *b)
+{
+	const struct live_lat *la = a, *lb = b;
+
+	if (la->total != lb->total)
+		return la->total < lb->total ? 1 : -1;
+	return la->id - lb->id;
+}
+
+static int perf_sched__lat_live_report(struct perf_sched *sched, FILE *fp)
+{
+	struct live_lat *tasks = NULL, *cpus, all = { .id = -1 };
+	int nr_tasks = 0, max_tasks = 0, i;
+	char line[BUFSIZ], name[COMM_LEN + 16];
+	u64 dropped = 0;
+
+	cpus = calloc(MAX_CPUS, sizeof(*cpus));
+	if (!cpus)
+		return -ENOMEM;
+
+	while (fgets(line, sizeof(line), fp)) {
+		unsigned int bucket;
+		u64 nr, total;
+		int pid, cpu;
+
+		sscanf(line, " Dropped: %" SCNu64, &dropped);
+		if (sscanf(line, "{ pid: %d, cpu: %d, delay.log2: %u } hitcount: %"
+			   SCNu64 " delay: %" SCNu64, &pid, &cpu, &bucket, &nr,
+			   &total) != 5)
+			continue;
+		if (cpu < 0 || cpu >= MAX_CPUS || bucket >= LIVE_NR_BUCKETS)
+			continue;
+		if (sched->profile_cpu != -1 && cpu != sched->profile_cpu)
+			continue;
+
+		/* the table is sorted on the keys, pid first */
+		if (!nr_tasks || tasks[nr_tasks - 1].id != pid) {
+			if (nr_tasks == max_tasks) {
+				struct live_lat *tmp;
+
+				max_tasks = max_tasks ? max_tasks * 2 : 256;
+				tmp = realloc(tasks, max_tasks * sizeof(*tasks));
+				if (!tmp) {
+					free(tasks);
+					free(cpus);
+					return -ENOMEM;
+				}
+				tasks = tmp;
+			}
+			memset(&tasks[nr_tasks], 0, sizeof(*tasks));
+			tasks[nr_tasks++].id = pid;
+		}
+
+		tasks[nr_tasks - 1].nr += nr;
+		tasks[nr_tasks - 1].total += total;
+		tasks[nr_tasks - 1].buckets[bucket] += nr;
+		cpus[cpu].nr += nr;
+		cpus[cpu].total += total;
+		cpus[cpu].buckets[bucket] += nr;
+		all.nr += nr;
+		all.total += total;
+		all.buckets[bucket] += nr;
+	}
+
+	qsort(tasks, nr_tasks, sizeof(*tasks), live_lat_cmp);
+
+	printf("\n %s\n", live_rule);
+	live_lat_header("Task");
+	for (i = 0; i < nr_tasks; i++) {
+		live_task_name(tasks[i].id, name, sizeof(name));
+		live_lat_print(&tasks[i], name);
+		if (verbose)
+			live_lat_print_hist(&tasks[i]);
+	}
+
+	printf(" %s\n", live_rule);
+	live_lat_header("CPU");
+	for (i = 0; i < MAX_CPUS; i++) {
+		if (!cpus[i].nr)
+			continue;
+		snprintf(name, sizeof(name), "%d", i);
+		live_lat_print(&cpus[i], name);
+		if (verbose)
+			live_lat_print_hist(&cpus[i]);
+	}
+
+	printf(" %s\n", live_rule);
+	live_lat_print(&all, "TOTAL:");
+	live_lat_print_hist(&all);
+
+	if (dropped)
+		printf("  INFO: %" PRIu64 " waits dropped, the kernel table is full\n",
+		       dropped);
+	if (!all.nr)
+		printf("  INFO: no waits collected, is the kernel built without CONFIG_SCHEDSTATS?\n");
+	printf("\n");
+
+	free(tasks);
+	free(cpus);
+	return 0;
+}
+
+static int perf_sched__lat_live(struct perf_sched *sched)
+{
+	char path[PATH_MAX];
+	unsigned int elapsed = 0;
+	FILE *fp;
+	int err;
+
+	err = live_write_trigger(LIVE_TRIGGER);
+	if (err) {
+		if (err == -ENOENT)
+			pr_err("Can't find %s/%s, is the kernel built with hist triggers?\n",
+			       tracing_events_path, LIVE_EVENT);
+		else if (err == -EEXIST)
+			pr_err("%s already has a hist trigger\n", LIVE_EVENT);
+		else
+			pr_err("Can't set the %s hist trigger: %s\n",
+			       LIVE_EVENT, strerror(-err));
+		return -1;
+	}
+
+	signal(SIGINT, live_sig_handler);
+	signal(SIGTERM, live_sig_handler);
+
+	if (!sched->live_duration)
+		fprintf(stderr, "Aggregating in the kernel, Ctrl-C to stop...\n");
+	while (!live_done &&
+	       (!sched->live_duration || elapsed < sched->live_duration)) {
+		sleep(1);
+		elapsed++;
+	}
+
+	snprintf(path, sizeof(path), "%s/%s/hist", tracing_events_path,
+		 LIVE_EVENT);
+	fp = fopen(path, "r");
+	if (fp) {
+		setup_pager();
+		err = perf_sched__lat_live_report(sched, fp);
+		fclose(fp);
+	} else {
+		pr_err("Can't read %s: %s\n", path, strerror(errno));
+		err = -1;
+	}
+
+	live_write_trigger("!hist");
+	return err;
+}
+
 static int perf_sched__map(struct perf_sched *sched)
 {
 	sched->max_cpu = sysconf(_SC_NPROCESSORS_CONF);
@@ -1685,6 +1967,10 @@ int cmd_sched(int argc, const char **argv, const char *prefix __maybe_unused)
 		    "CPU to profile on"),
 	OPT_BOOLEAN('D', "dump-raw-trace", &dump_trace,
 		    "dump raw trace in ASCII"),
+	OPT_BOOLEAN(0, "live", &sched.live,
+		    "aggregate the wait times in the kernel, no recording"),
+	OPT_UINTEGER('d', "duration", &sched.live_duration,
+		     "with --live, stop after this many seconds"),
 	OPT_END()
 	};
 	const struct option replay_options[] = {
@@ -1757,6 +2043,8 @@ int cmd_sched(int argc, const char **argv, const char *prefix __maybe_unused)
 			if (argc)
 				usage_with_options(latency_usage, latency_options);
 		}
+		if (sched.live)
+			return perf_sched__lat_live(&sched);
 		setup_sorting(&sched, latency_options, latency_usage);
 		return perf_sched__lat(&sched);
 	} else if (!strcmp(argv[0], "map")) {
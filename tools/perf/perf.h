@@ -15,6 +15,18 @@
 #ifndef __NR_futex
 # define __NR_futex 240
 #endif
+#ifndef __NR_io_setup
+# define __NR_io_setup 245
+#endif
+#ifndef __NR_io_destroy
+# define __NR_io_destroy 246
+#endif
+#ifndef __NR_io_getevents
+# define __NR_io_getevents 247
+#endif
+#ifndef __NR_io_submit
+# define __NR_io_submit 248
+#endif
 #endif
 
 #if defined(__x86_64__)
@@ -29,6 +41,18 @@
 #ifndef __NR_futex
 # define __NR_futex 202
 #endif
+#ifndef __NR_io_setup
+# define __NR_io_setup 206
+#endif
+#ifndef __NR_io_destroy
+# define __NR_io_destroy 207
+#endif
+#ifndef __NR_io_getevents
+# define __NR_io_getevents 208
+#endif
+#ifndef __NR_io_submit
+# define __NR_io_submit 209
+#endif
 #endif
 
 #ifdef __powerpc__
@@ -9,6 +9,7 @@
 #include "strlist.h"
 #include "thread.h"
 #include <stdbool.h>
+#include <pthread.h>
 #include <symbol/kallsyms.h>
 #include "unwind.h"
 
@@ -682,6 +683,91 @@ int machine__load_vmlinux_path(struct machine *machine, enum map_type type,
 	return ret;
 }
 
+struct dso_preload {
+	struct dso	**dsos;
+	int		nr_dsos;
+	int		next;
+	symbol_filter_t	filter;
+};
+
+static void *dso_preload_worker(void *arg)
+{
+	struct dso_preload *dp = arg;
+	int i;
+
+	while ((i = __sync_fetch_and_add(&dp->next, 1)) < dp->nr_dsos) {
+		struct map *map = map__new2(0, dp->dsos[i], MAP__FUNCTION);
+
+		/*
+		 * The symbols go to the dso, the map is just for loading;
+		 * map__load warns about the DSOs left without symbols, as
+		 * it won't get to once they are marked loaded.
+		 */
+		if (map) {
+			map__load(map, dp->filter);
+			map__delete(map);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Load the function symbols of the user DSOs known so far, usually those
+ * of the build-id table in the perf.data header, in @nr_jobs threads
+ * instead of one at a time when samples first hit them.
+ *
+ * Loading a user DSO only touches the dso itself, unlike the kernel ones
+ * which add modules and maps to the machine, so those are left alone.
+ * Must be called before processing events.
+ */
+int machine__preload_dsos(struct machine *machine, int nr_jobs)
+{
+	struct dso_preload dp = { .filter = machine->symbol_filter, };
+	pthread_t *threads;
+	struct dso *pos;
+	int i, n = 0;
+
+	list_for_each_entry(pos, &machine->user_dsos, node)
+		dp.nr_dsos++;
+
+	if (nr_jobs > dp.nr_dsos)
+		nr_jobs = dp.nr_dsos;
+	if (nr_jobs < 2)
+		return 0;
+
+	dp.dsos = malloc(dp.nr_dsos * sizeof(*dp.dsos));
+	threads = malloc((nr_jobs - 1) * sizeof(*threads));
+	if (!dp.dsos || !threads) {
+		free(dp.dsos);
+		free(threads);
+		return -ENOMEM;
+	}
+
+	dp.nr_dsos = 0;
+	list_for_each_entry(pos, &machine->user_dsos, node) {
+		/* [vdso], [heap], ... have no symtab to load */
+		if (pos->long_name[0] == '[' ||
+		    dso__loaded(pos, MAP__FUNCTION))
+			continue;
+		dp.dsos[dp.nr_dsos++] = pos;
+	}
+
+	for (n = 0; n < nr_jobs - 1; n++) {
+		if (pthread_create(&threads[n], NULL, dso_preload_worker, &dp))
+			break;
+	}
+
+	dso_preload_worker(&dp);
+
+	for (i = 0; i < n; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	free(dp.dsos);
+	return 0;
+}
+
 static void map_groups__fixup_end(struct map_groups *mg)
 {
 	int i;
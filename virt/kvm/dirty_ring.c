@@ -0,0 +1,172 @@
+/*
+ * kvm dirty ring support
+ *
+ * Dirty pages are pushed by the vcpu that dirtied them to its own ring,
+ * which userspace harvests through mmap without walking a bitmap of the
+ * whole memslot.  Userspace marks the harvested entries with
+ * KVM_DIRTY_GFN_F_RESET and calls KVM_RESET_DIRTY_RINGS, which
+ * write-protects those pages again and makes the entries reusable.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include <linux/kvm_host.h>
+#include <linux/kvm.h>
+#include <linux/vmalloc.h>
+#include <linux/kvm_dirty_ring.h>
+
+static u32 kvm_dirty_ring_used(struct kvm_dirty_ring *ring)
+{
+	return ring->dirty_index - ACCESS_ONCE(ring->reset_index);
+}
+
+bool kvm_dirty_ring_soft_full(struct kvm_dirty_ring *ring)
+{
+	return kvm_dirty_ring_used(ring) >= ring->soft_limit;
+}
+
+int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring, u32 size)
+{
+	ring->dirty_gfns = vzalloc(size);
+	if (!ring->dirty_gfns)
+		return -ENOMEM;
+
+	ring->size = size / sizeof(struct kvm_dirty_gfn);
+	ring->soft_limit = ring->size - KVM_DIRTY_RING_RSVD_ENTRIES;
+	ring->dirty_index = 0;
+	ring->reset_index = 0;
+
+	return 0;
+}
+
+void kvm_dirty_ring_free(struct kvm_dirty_ring *ring)
+{
+	vfree(ring->dirty_gfns);
+	ring->dirty_gfns = NULL;
+}
+
+/*
+ * Called by the vcpu owning @ring.  Returns false if the ring is full,
+ * in which case the caller has to record the page some other way.
+ */
+bool kvm_dirty_ring_push(struct kvm_dirty_ring *ring, u32 slot, u64 offset)
+{
+	struct kvm_dirty_gfn *entry;
+
+	if (kvm_dirty_ring_used(ring) >= ring->size)
+		return false;
+
+	entry = &ring->dirty_gfns[ring->dirty_index & (ring->size - 1)];
+	entry->slot = slot;
+	entry->offset = offset;
+	/* Make the gfn visible before userspace can see the flag. */
+	smp_wmb();
+	entry->flags = KVM_DIRTY_GFN_F_DIRTY;
+	ring->dirty_index++;
+
+	return true;
+}
+
+static void kvm_dirty_ring_reset_gfns(struct kvm *kvm, u32 slot, u64 offset,
+				      unsigned long mask)
+{
+	struct kvm_memory_slot *memslot;
+
+	if (!mask || slot >= KVM_USER_MEM_SLOTS)
+		return;
+
+	memslot = id_to_memslot(kvm_memslots(kvm), slot);
+	/*
+	 * The slot may have been deleted or stopped logging since, and the
+	 * entries are writable by userspace: every gfn in the mask must lie
+	 * within the slot.
+	 */
+	if (!memslot->dirty_bitmap || offset >= memslot->npages ||
+	    offset + __fls(mask) >= memslot->npages)
+		return;
+
+	spin_lock(&kvm->mmu_lock);
+	kvm_arch_mmu_enable_log_dirty_pt_masked(kvm, memslot, offset, mask);
+	spin_unlock(&kvm->mmu_lock);
+}
+
+/*
+ * Recycle the entries userspace has marked as harvested, write-protecting
+ * the pages they name again.  Consecutive gfns of a slot are batched into
+ * one mask, so the common sequential case costs one call per BITS_PER_LONG
+ * pages.  Called with kvm->slots_lock held; returns the number of entries
+ * recycled.
+ */
+int kvm_dirty_ring_reset(struct kvm *kvm, struct kvm_dirty_ring *ring)
+{
+	u32 cur_slot = 0, next_slot;
+	u64 cur_offset = 0, next_offset;
+	u32 reset_index = ring->reset_index;
+	unsigned long mask = 0;
+	int count = 0;
+
+	while (reset_index != ACCESS_ONCE(ring->dirty_index)) {
+		struct kvm_dirty_gfn *entry;
+
+		entry = &ring->dirty_gfns[reset_index & (ring->size - 1)];
+		if (!(ACCESS_ONCE(entry->flags) & KVM_DIRTY_GFN_F_RESET))
+			break;
+		smp_rmb();
+
+		next_slot = ACCESS_ONCE(entry->slot);
+		next_offset = ACCESS_ONCE(entry->offset);
+		entry->flags = 0;
+		reset_index++;
+		count++;
+
+		if (mask && next_slot == cur_slot) {
+			s64 delta = next_offset - cur_offset;
+
+			if (delta >= 0 && delta < BITS_PER_LONG) {
+				mask |= 1UL << delta;
+				continue;
+			}
+			/* Backwards visit, but still within this mask. */
+			if (delta < 0 && delta > -BITS_PER_LONG &&
+			    (mask << -delta >> -delta) == mask) {
+				cur_offset = next_offset;
+				mask = (mask << -delta) | 1;
+				continue;
+			}
+		}
+		kvm_dirty_ring_reset_gfns(kvm, cur_slot, cur_offset, mask);
+		cur_slot = next_slot;
+		cur_offset = next_offset;
+		mask = 1;
+	}
+	kvm_dirty_ring_reset_gfns(kvm, cur_slot, cur_offset, mask);
+
+	/* The cleared entries must be seen before the vcpu can reuse them. */
+	smp_wmb();
+	ring->reset_index = reset_index;
+
+	return count;
+}
+
+struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring, u32 offset)
+{
+	return vmalloc_to_page((void *)ring->dirty_gfns + offset * PAGE_SIZE);
+}
+
+/*
+ * Called before entering the guest: keep exiting to userspace while the
+ * ring is over its soft limit, until KVM_RESET_DIRTY_RINGS makes room.
+ */
+bool kvm_dirty_ring_check_request(struct kvm_vcpu *vcpu)
+{
+	if (kvm_check_request(KVM_REQ_DIRTY_RING_FULL, vcpu) &&
+	    kvm_dirty_ring_soft_full(&vcpu->dirty_ring)) {
+		kvm_make_request(KVM_REQ_DIRTY_RING_FULL, vcpu);
+		vcpu->run->exit_reason = KVM_EXIT_DIRTY_RING_FULL;
+		return true;
+	}
+
+	return false;
+}
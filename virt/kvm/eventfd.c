@@ -32,6 +32,7 @@
 #include <linux/eventfd.h>
 #include <linux/kernel.h>
 #include <linux/slab.h>
+#include <linux/irqbypass.h>
 
 #include "iodev.h"
 
@@ -89,6 +90,11 @@ struct _irqfd {
 	struct list_head list;
 	poll_table pt;
 	struct work_struct shutdown;
+#ifdef CONFIG_HAVE_KVM_IRQ_BYPASS
+	struct irq_bypass_consumer consumer;
+	/* Device interrupt bypassing the eventfd, under irqfds.lock */
+	struct irq_bypass_producer *producer;
+#endif
 };
 
 static struct workqueue_struct *irqfd_cleanup_wq;
@@ -176,6 +182,9 @@ irqfd_shutdown(struct work_struct *work)
 	 */
 	flush_work(&irqfd->inject);
 
+#ifdef CONFIG_HAVE_KVM_IRQ_BYPASS
+	irq_bypass_unregister_consumer(&irqfd->consumer);
+#endif
 	if (irqfd->resampler) {
 		irqfd_resampler_shutdown(irqfd);
 		eventfd_ctx_put(irqfd->resamplefd);
@@ -286,6 +295,49 @@ static void irqfd_update(struct kvm *kvm, struct _irqfd *irqfd,
 	}
 }
 
+#ifdef CONFIG_HAVE_KVM_IRQ_BYPASS
+/*
+ * A device interrupt signalling this irqfd's eventfd has been found; let the
+ * arch deliver it straight to the guest where the routing allows it.
+ */
+static int irqfd_bypass_add_producer(struct irq_bypass_consumer *cons,
+				     struct irq_bypass_producer *prod)
+{
+	struct _irqfd *irqfd = container_of(cons, struct _irqfd, consumer);
+	struct kvm *kvm = irqfd->kvm;
+	int ret;
+
+	spin_lock_irq(&kvm->irqfds.lock);
+	ret = kvm_arch_update_irqfd_routing(kvm, prod->irq, irqfd->gsi, true);
+	if (!ret)
+		irqfd->producer = prod;
+	spin_unlock_irq(&kvm->irqfds.lock);
+
+	return ret;
+}
+
+static void irqfd_bypass_del_producer(struct irq_bypass_consumer *cons,
+				      struct irq_bypass_producer *prod)
+{
+	struct _irqfd *irqfd = container_of(cons, struct _irqfd, consumer);
+	struct kvm *kvm = irqfd->kvm;
+	int ret;
+
+	spin_lock_irq(&kvm->irqfds.lock);
+	WARN_ON(irqfd->producer != prod);
+	/*
+	 * Return the interrupt to host delivery; from here on it signals
+	 * the eventfd again and goes through irqfd_wakeup().
+	 */
+	ret = kvm_arch_update_irqfd_routing(kvm, prod->irq, irqfd->gsi, false);
+	if (ret)
+		printk(KERN_INFO "irq bypass consumer (token %p) unregistration"
+		       " fails: %d\n", cons->token, ret);
+	irqfd->producer = NULL;
+	spin_unlock_irq(&kvm->irqfds.lock);
+}
+#endif
+
 static int
 kvm_irqfd_assign(struct kvm *kvm, struct kvm_irqfd *args)
 {
@@ -404,6 +456,16 @@ kvm_irqfd_assign(struct kvm *kvm, struct kvm_irqfd *args)
 	if (events & POLLIN)
 		schedule_work(&irqfd->inject);
 
+#ifdef CONFIG_HAVE_KVM_IRQ_BYPASS
+	irqfd->consumer.token = (void *)irqfd->eventfd;
+	irqfd->consumer.add_producer = irqfd_bypass_add_producer;
+	irqfd->consumer.del_producer = irqfd_bypass_del_producer;
+	ret = irq_bypass_register_consumer(&irqfd->consumer);
+	if (ret)
+		printk(KERN_INFO "irq bypass consumer (token %p) registration"
+		       " fails: %d\n", irqfd->consumer.token, ret);
+#endif
+
 	/*
 	 * do not drop the file until the irqfd is fully initialized, otherwise
 	 * we might race against the POLLHUP
@@ -535,9 +597,18 @@ void kvm_irq_routing_update(struct kvm *kvm,
 
 	rcu_assign_pointer(kvm->irq_routing, irq_rt);
 
-	list_for_each_entry(irqfd, &kvm->irqfds.items, list)
+	list_for_each_entry(irqfd, &kvm->irqfds.items, list) {
 		irqfd_update(kvm, irqfd, irq_rt);
 
+#ifdef CONFIG_HAVE_KVM_IRQ_BYPASS
+		if (irqfd->producer) {
+			int ret = kvm_arch_update_irqfd_routing(kvm,
+					irqfd->producer->irq, irqfd->gsi, true);
+			WARN_ON(ret);
+		}
+#endif
+	}
+
 	spin_unlock_irq(&kvm->irqfds.lock);
 }
 
@@ -658,9 +729,20 @@ ioeventfd_destructor(struct kvm_io_device *this)
 	ioeventfd_release(p);
 }
 
+static bool
+ioeventfd_doorbell(struct kvm_io_device *this, u64 *datamatch, bool *wildcard)
+{
+	struct _ioeventfd *p = to_ioeventfd(this);
+
+	*datamatch = p->datamatch;
+	*wildcard = p->wildcard;
+	return true;
+}
+
 static const struct kvm_io_device_ops ioeventfd_ops = {
 	.write      = ioeventfd_write,
 	.destructor = ioeventfd_destructor,
+	.doorbell   = ioeventfd_doorbell,
 };
 
 /* assumes kvm->slots_lock held */
@@ -16,6 +16,7 @@
 #ifndef __KVM_IODEV_H__
 #define __KVM_IODEV_H__
 
+#include <linux/types.h>
 #include <linux/kvm_types.h>
 #include <asm/errno.h>
 
@@ -36,6 +37,14 @@ struct kvm_io_device_ops {
 		     int len,
 		     const void *val);
 	void (*destructor)(struct kvm_io_device *this);
+	/*
+	 * Optional: returns true if the device accepts exactly the writes
+	 * of its whole range carrying @datamatch, or any data if @wildcard,
+	 * so that the bus can dispatch them without searching.
+	 */
+	bool (*doorbell)(struct kvm_io_device *this,
+			 u64 *datamatch,
+			 bool *wildcard);
 };
 
 
@@ -61,6 +70,13 @@ static inline int kvm_iodevice_write(struct kvm_io_device *dev,
 	return dev->ops->write ? dev->ops->write(dev, addr, l, v) : -EOPNOTSUPP;
 }
 
+static inline bool kvm_iodevice_doorbell(struct kvm_io_device *dev,
+					 u64 *datamatch, bool *wildcard)
+{
+	return dev->ops->doorbell ?
+		dev->ops->doorbell(dev, datamatch, wildcard) : false;
+}
+
 static inline void kvm_iodevice_destructor(struct kvm_io_device *dev)
 {
 	if (dev->ops->destructor)
@@ -49,6 +49,7 @@
 #include <linux/slab.h>
 #include <linux/sort.h>
 #include <linux/bsearch.h>
+#include <linux/hash.h>
 
 #include <asm/processor.h>
 #include <asm/io.h>
@@ -64,6 +65,18 @@
 MODULE_AUTHOR("Qumranet");
 MODULE_LICENSE("GPL");
 
+/* Upper bound, in ns, of the time a halted vcpu polls before sleeping */
+static unsigned int halt_poll_ns = 500000;
+module_param(halt_poll_ns, uint, S_IRUGO | S_IWUSR);
+
+/* Factor the per-vcpu poll window grows by after a short halt */
+static unsigned int halt_poll_ns_grow = 2;
+module_param(halt_poll_ns_grow, uint, S_IRUGO | S_IWUSR);
+
+/* Divisor the window shrinks by after a long halt; 0 resets it */
+static unsigned int halt_poll_ns_shrink;
+module_param(halt_poll_ns_shrink, uint, S_IRUGO | S_IWUSR);
+
 /*
  * Ordering of locks:
  *
@@ -115,6 +128,20 @@ bool kvm_is_mmio_pfn(pfn_t pfn)
 	return true;
 }
 
+/* The vcpu loaded on each cpu, so that its dirty ring can be found */
+static DEFINE_PER_CPU(struct kvm_vcpu *, kvm_running_vcpu);
+
+static struct kvm_vcpu *kvm_get_running_vcpu(void)
+{
+	struct kvm_vcpu *vcpu;
+
+	preempt_disable();
+	vcpu = __this_cpu_read(kvm_running_vcpu);
+	preempt_enable();
+
+	return vcpu;
+}
+
 /*
  * Switches to specified vcpu, until a matching vcpu_put()
  */
@@ -133,6 +160,7 @@ int vcpu_load(struct kvm_vcpu *vcpu)
 		put_pid(oldpid);
 	}
 	cpu = get_cpu();
+	__this_cpu_write(kvm_running_vcpu, vcpu);
 	preempt_notifier_register(&vcpu->preempt_notifier);
 	kvm_arch_vcpu_load(vcpu, cpu);
 	put_cpu();
@@ -144,6 +172,7 @@ void vcpu_put(struct kvm_vcpu *vcpu)
 	preempt_disable();
 	kvm_arch_vcpu_put(vcpu);
 	preempt_notifier_unregister(&vcpu->preempt_notifier);
+	__this_cpu_write(kvm_running_vcpu, NULL);
 	preempt_enable();
 	mutex_unlock(&vcpu->mutex);
 }
@@ -231,11 +260,20 @@ int kvm_vcpu_init(struct kvm_vcpu *vcpu, struct kvm *kvm, unsigned id)
 	kvm_vcpu_set_dy_eligible(vcpu, false);
 	vcpu->preempted = false;
 
+	if (kvm->dirty_ring_size) {
+		r = kvm_dirty_ring_alloc(&vcpu->dirty_ring,
+					 kvm->dirty_ring_size);
+		if (r)
+			goto fail_free_run;
+	}
+
 	r = kvm_arch_vcpu_init(vcpu);
 	if (r < 0)
-		goto fail_free_run;
+		goto fail_free_ring;
 	return 0;
 
+fail_free_ring:
+	kvm_dirty_ring_free(&vcpu->dirty_ring);
 fail_free_run:
 	free_page((unsigned long)vcpu->run);
 fail:
@@ -247,6 +285,7 @@ void kvm_vcpu_uninit(struct kvm_vcpu *vcpu)
 {
 	put_pid(vcpu->pid);
 	kvm_arch_vcpu_uninit(vcpu);
+	kvm_dirty_ring_free(&vcpu->dirty_ring);
 	free_page((unsigned long)vcpu->run);
 }
 EXPORT_SYMBOL_GPL(kvm_vcpu_uninit);
@@ -1643,6 +1682,23 @@ static void mark_page_dirty_in_slot(struct kvm *kvm,
 {
 	if (memslot && memslot->dirty_bitmap) {
 		unsigned long rel_gfn = gfn - memslot->base_gfn;
+		struct kvm_vcpu *vcpu = NULL;
+
+		if (kvm->dirty_ring_size)
+			vcpu = kvm_get_running_vcpu();
+
+		/*
+		 * Pages dirtied by a vcpu of this VM go to its dirty ring;
+		 * anything else, or a page that finds the ring full, still
+		 * goes to the bitmap and is reported by KVM_GET_DIRTY_LOG.
+		 */
+		if (vcpu && vcpu->kvm == kvm && vcpu->dirty_ring.dirty_gfns &&
+		    kvm_dirty_ring_push(&vcpu->dirty_ring, memslot->id,
+					rel_gfn)) {
+			if (kvm_dirty_ring_soft_full(&vcpu->dirty_ring))
+				kvm_make_request(KVM_REQ_DIRTY_RING_FULL, vcpu);
+			return;
+		}
 
 		set_bit_le(rel_gfn, memslot->dirty_bitmap);
 	}
@@ -1657,29 +1713,98 @@ void mark_page_dirty(struct kvm *kvm, gfn_t gfn)
 }
 EXPORT_SYMBOL_GPL(mark_page_dirty);
 
+static void grow_halt_poll_ns(struct kvm_vcpu *vcpu)
+{
+	unsigned int val = vcpu->halt_poll_ns;
+
+	/* 10us base */
+	if (val == 0 && halt_poll_ns_grow)
+		val = 10000;
+	else
+		val *= halt_poll_ns_grow;
+
+	vcpu->halt_poll_ns = min(val, halt_poll_ns);
+}
+
+static void shrink_halt_poll_ns(struct kvm_vcpu *vcpu)
+{
+	unsigned int val = vcpu->halt_poll_ns;
+
+	if (halt_poll_ns_shrink == 0)
+		val = 0;
+	else
+		val /= halt_poll_ns_shrink;
+
+	vcpu->halt_poll_ns = val;
+}
+
+static bool kvm_vcpu_check_block(struct kvm_vcpu *vcpu)
+{
+	if (kvm_arch_vcpu_runnable(vcpu)) {
+		kvm_make_request(KVM_REQ_UNHALT, vcpu);
+		return true;
+	}
+	if (kvm_cpu_has_pending_timer(vcpu))
+		return true;
+	if (signal_pending(current))
+		return true;
+
+	return false;
+}
+
 /*
  * The vCPU has executed a HLT instruction with in-kernel mode enabled.
+ *
+ * Before sleeping, a halted vcpu polls for wakeup events for up to
+ * vcpu->halt_poll_ns, which saves the cost of an IPI and a reschedule
+ * when the guest is woken shortly after halting.  The window grows
+ * while halts end within halt_poll_ns and shrinks once they do not.
  */
 void kvm_vcpu_block(struct kvm_vcpu *vcpu)
 {
 	DEFINE_WAIT(wait);
+	u64 start, now, block_ns;
+
+	start = now = ktime_to_ns(ktime_get());
+	if (vcpu->halt_poll_ns) {
+		u64 stop = start + vcpu->halt_poll_ns;
+
+		++vcpu->stat.halt_attempted_poll;
+		do {
+			if (kvm_vcpu_check_block(vcpu)) {
+				++vcpu->stat.halt_successful_poll;
+				goto out;
+			}
+			cpu_relax();
+			now = ktime_to_ns(ktime_get());
+		} while (!need_resched() && now < stop);
+	}
 
 	for (;;) {
 		prepare_to_wait(&vcpu->wq, &wait, TASK_INTERRUPTIBLE);
 
-		if (kvm_arch_vcpu_runnable(vcpu)) {
-			kvm_make_request(KVM_REQ_UNHALT, vcpu);
-			break;
-		}
-		if (kvm_cpu_has_pending_timer(vcpu))
-			break;
-		if (signal_pending(current))
+		if (kvm_vcpu_check_block(vcpu))
 			break;
 
 		schedule();
 	}
 
 	finish_wait(&vcpu->wq, &wait);
+	now = ktime_to_ns(ktime_get());
+
+out:
+	block_ns = now - start;
+
+	if (!halt_poll_ns)
+		vcpu->halt_poll_ns = 0;
+	else if (block_ns <= vcpu->halt_poll_ns)
+		;
+	/* a long halt: polling only wasted cpu time */
+	else if (vcpu->halt_poll_ns && block_ns > halt_poll_ns)
+		shrink_halt_poll_ns(vcpu);
+	/* a short halt the window was too small to catch */
+	else if (vcpu->halt_poll_ns < halt_poll_ns && block_ns < halt_poll_ns)
+		grow_halt_poll_ns(vcpu);
 }
 EXPORT_SYMBOL_GPL(kvm_vcpu_block);
 
@@ -1824,6 +1949,14 @@ void kvm_vcpu_on_spin(struct kvm_vcpu *me)
 }
 EXPORT_SYMBOL_GPL(kvm_vcpu_on_spin);
 
+static bool kvm_page_in_dirty_ring(struct kvm_vcpu *vcpu, unsigned long pgoff)
+{
+	return vcpu->dirty_ring.dirty_gfns &&
+	       pgoff >= KVM_DIRTY_LOG_PAGE_OFFSET &&
+	       pgoff < KVM_DIRTY_LOG_PAGE_OFFSET +
+			vcpu->kvm->dirty_ring_size / PAGE_SIZE;
+}
+
 static int kvm_vcpu_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 {
 	struct kvm_vcpu *vcpu = vma->vm_file->private_data;
@@ -1839,6 +1972,9 @@ static int kvm_vcpu_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	else if (vmf->pgoff == KVM_COALESCED_MMIO_PAGE_OFFSET)
 		page = virt_to_page(vcpu->kvm->coalesced_mmio_ring);
 #endif
+	else if (kvm_page_in_dirty_ring(vcpu, vmf->pgoff))
+		page = kvm_dirty_ring_get_page(&vcpu->dirty_ring,
+				vmf->pgoff - KVM_DIRTY_LOG_PAGE_OFFSET);
 	else
 		return kvm_arch_vcpu_fault(vcpu, vmf);
 	get_page(page);
@@ -1852,6 +1988,15 @@ static const struct vm_operations_struct kvm_vcpu_vm_ops = {
 
 static int kvm_vcpu_mmap(struct file *file, struct vm_area_struct *vma)
 {
+	struct kvm_vcpu *vcpu = file->private_data;
+	unsigned long pages = (vma->vm_end - vma->vm_start) >> PAGE_SHIFT;
+
+	/* The dirty ring is only any use if it is shared with the kernel. */
+	if ((kvm_page_in_dirty_ring(vcpu, vma->vm_pgoff) ||
+	     kvm_page_in_dirty_ring(vcpu, vma->vm_pgoff + pages - 1)) &&
+	    !(vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+
 	vma->vm_ops = &kvm_vcpu_vm_ops;
 	return 0;
 }
@@ -2318,6 +2463,51 @@ static int kvm_ioctl_create_device(struct kvm *kvm,
 	return 0;
 }
 
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+static int kvm_vm_ioctl_enable_dirty_log_ring(struct kvm *kvm, u32 size)
+{
+	int r;
+
+	/* A power of two number of entries, taking whole pages */
+	if (size < PAGE_SIZE || (size & (size - 1)) ||
+	    size > KVM_DIRTY_RING_MAX_ENTRIES * sizeof(struct kvm_dirty_gfn))
+		return -EINVAL;
+
+	mutex_lock(&kvm->lock);
+	if (atomic_read(&kvm->online_vcpus))
+		r = -EINVAL;
+	else if (kvm->dirty_ring_size)
+		r = -EBUSY;
+	else {
+		kvm->dirty_ring_size = size;
+		r = 0;
+	}
+	mutex_unlock(&kvm->lock);
+
+	return r;
+}
+
+static int kvm_vm_ioctl_reset_dirty_pages(struct kvm *kvm)
+{
+	struct kvm_vcpu *vcpu;
+	int i, cleared = 0;
+
+	if (!kvm->dirty_ring_size)
+		return -EINVAL;
+
+	mutex_lock(&kvm->slots_lock);
+	kvm_for_each_vcpu(i, vcpu, kvm)
+		if (vcpu->dirty_ring.dirty_gfns)
+			cleared += kvm_dirty_ring_reset(kvm, &vcpu->dirty_ring);
+	mutex_unlock(&kvm->slots_lock);
+
+	if (cleared)
+		kvm_flush_remote_tlbs(kvm);
+
+	return cleared;
+}
+#endif
+
 static long kvm_vm_ioctl(struct file *filp,
 			   unsigned int ioctl, unsigned long arg)
 {
@@ -2481,6 +2671,27 @@ static long kvm_vm_ioctl(struct file *filp,
 		r = 0;
 		break;
 	}
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+	case KVM_ENABLE_CAP: {
+		struct kvm_enable_cap cap;
+
+		r = -EFAULT;
+		if (copy_from_user(&cap, argp, sizeof(cap)))
+			goto out;
+		if (cap.cap != KVM_CAP_DIRTY_LOG_RING) {
+			r = kvm_arch_vm_ioctl(filp, ioctl, arg);
+			break;
+		}
+		r = -EINVAL;
+		if (cap.flags)
+			goto out;
+		r = kvm_vm_ioctl_enable_dirty_log_ring(kvm, cap.args[0]);
+		break;
+	}
+	case KVM_RESET_DIRTY_RINGS:
+		r = kvm_vm_ioctl_reset_dirty_pages(kvm);
+		break;
+#endif
 	default:
 		r = kvm_arch_vm_ioctl(filp, ioctl, arg);
 		if (r == -ENOTTY)
@@ -2585,6 +2796,10 @@ static long kvm_dev_ioctl_check_extension_generic(long arg)
 #ifdef CONFIG_HAVE_KVM_IRQ_ROUTING
 	case KVM_CAP_IRQ_ROUTING:
 		return KVM_MAX_IRQ_ROUTES;
+#endif
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+	case KVM_CAP_DIRTY_LOG_RING:
+		return KVM_DIRTY_RING_MAX_ENTRIES * sizeof(struct kvm_dirty_gfn);
 #endif
 	default:
 		break;
@@ -2771,6 +2986,12 @@ static struct notifier_block kvm_reboot_notifier = {
 	.priority = 0,
 };
 
+static void kvm_io_bus_free(struct kvm_io_bus *bus)
+{
+	kfree(bus->doorbells);
+	kfree(bus);
+}
+
 static void kvm_io_bus_destroy(struct kvm_io_bus *bus)
 {
 	int i;
@@ -2780,7 +3001,118 @@ static void kvm_io_bus_destroy(struct kvm_io_bus *bus)
 
 		kvm_iodevice_destructor(pos);
 	}
-	kfree(bus);
+	kvm_io_bus_free(bus);
+}
+
+static u32 kvm_io_doorbell_hash(gpa_t addr, int len, u64 data, bool wildcard,
+				unsigned int bits)
+{
+	if (wildcard)
+		data = ~0ULL;
+	return hash_64(addr ^ (data << 12) ^ len, bits);
+}
+
+/*
+ * Build the doorbell table of a new copy of the bus, before it is
+ * published.  Failing to allocate one only costs the fast path.
+ */
+static void kvm_io_bus_build_doorbells(struct kvm_io_bus *bus)
+{
+	struct kvm_io_doorbell *db;
+	unsigned int bits, mask;
+	int i, count = 0;
+	u64 data;
+	bool wildcard;
+
+	bus->doorbells = NULL;
+	bus->doorbell_bits = 0;
+
+	for (i = 0; i < bus->dev_count; i++)
+		if (kvm_iodevice_doorbell(bus->range[i].dev, &data, &wildcard))
+			count++;
+	if (!count)
+		return;
+
+	/* Keep the table at most half full so that misses end quickly. */
+	bits = ilog2(count) + 2;
+	mask = (1U << bits) - 1;
+	db = kcalloc(1U << bits, sizeof(*db), GFP_KERNEL);
+	if (!db)
+		return;
+
+	for (i = 0; i < bus->dev_count; i++) {
+		struct kvm_io_range *range = &bus->range[i];
+		u32 h;
+
+		if (!kvm_iodevice_doorbell(range->dev, &data, &wildcard))
+			continue;
+
+		h = kvm_io_doorbell_hash(range->addr, range->len, data,
+					 wildcard, bits);
+		while (db[h].len)
+			h = (h + 1) & mask;
+		db[h] = (struct kvm_io_doorbell) {
+			.addr = range->addr,
+			.data = wildcard ? 0 : data,
+			.len = range->len,
+			.wildcard = wildcard,
+			.idx = i,
+		};
+	}
+
+	bus->doorbells = db;
+	bus->doorbell_bits = bits;
+}
+
+static int kvm_io_doorbell_find(struct kvm_io_bus *bus, gpa_t addr, int len,
+				u64 data, bool wildcard)
+{
+	unsigned int mask = (1U << bus->doorbell_bits) - 1;
+	u32 h = kvm_io_doorbell_hash(addr, len, data, wildcard,
+				     bus->doorbell_bits);
+	struct kvm_io_doorbell *db;
+
+	for (db = &bus->doorbells[h]; db->len; db = &bus->doorbells[h]) {
+		if (db->addr == addr && db->len == len &&
+		    db->wildcard == wildcard && db->data == data)
+			return db->idx;
+		h = (h + 1) & mask;
+	}
+
+	return -ENOENT;
+}
+
+/* Returns the index of the doorbell device @val is written to, if any */
+static int kvm_io_bus_get_doorbell(struct kvm_io_bus *bus, gpa_t addr,
+				   int len, const void *val)
+{
+	u64 data;
+	int idx;
+
+	if (!bus->doorbells)
+		return -ENOENT;
+
+	switch (len) {
+	case 1:
+		data = *(u8 *)val;
+		break;
+	case 2:
+		data = *(u16 *)val;
+		break;
+	case 4:
+		data = *(u32 *)val;
+		break;
+	case 8:
+		data = *(u64 *)val;
+		break;
+	default:
+		return -ENOENT;
+	}
+
+	idx = kvm_io_doorbell_find(bus, addr, len, data, false);
+	if (idx < 0)
+		idx = kvm_io_doorbell_find(bus, addr, len, 0, true);
+	return idx;
 }
 
 static inline int kvm_io_bus_cmp(const struct kvm_io_range *r1,
@@ -2842,6 +3174,12 @@ static int __kvm_io_bus_write(struct kvm_io_bus *bus,
 {
 	int idx;
 
+	/* Doorbells (virtio notifies) are found without a search. */
+	idx = kvm_io_bus_get_doorbell(bus, range->addr, range->len, val);
+	if (idx >= 0 && !kvm_iodevice_write(bus->range[idx].dev, range->addr,
+					    range->len, val))
+		return idx;
+
 	idx = kvm_io_bus_get_first_dev(bus, range->addr, range->len);
 	if (idx < 0)
 		return -EOPNOTSUPP;
@@ -2960,9 +3298,10 @@ int kvm_io_bus_register_dev(struct kvm *kvm, enum kvm_bus bus_idx, gpa_t addr,
 	memcpy(new_bus, bus, sizeof(*bus) + (bus->dev_count *
 	       sizeof(struct kvm_io_range)));
 	kvm_io_bus_insert_dev(new_bus, dev, addr, len);
+	kvm_io_bus_build_doorbells(new_bus);
 	rcu_assign_pointer(kvm->buses[bus_idx], new_bus);
 	synchronize_srcu_expedited(&kvm->srcu);
-	kfree(bus);
+	kvm_io_bus_free(bus);
 
 	return 0;
 }
@@ -2994,10 +3333,11 @@ int kvm_io_bus_unregister_dev(struct kvm *kvm, enum kvm_bus bus_idx,
 	new_bus->dev_count--;
 	memcpy(new_bus->range + i, bus->range + i + 1,
 	       (new_bus->dev_count - i) * sizeof(struct kvm_io_range));
+	kvm_io_bus_build_doorbells(new_bus);
 
 	rcu_assign_pointer(kvm->buses[bus_idx], new_bus);
 	synchronize_srcu_expedited(&kvm->srcu);
-	kfree(bus);
+	kvm_io_bus_free(bus);
 	return r;
 }
 
@@ -3110,6 +3450,7 @@ static void kvm_sched_in(struct preempt_notifier *pn, int cpu)
 	if (vcpu->preempted)
 		vcpu->preempted = false;
 
+	__this_cpu_write(kvm_running_vcpu, vcpu);
 	kvm_arch_vcpu_load(vcpu, cpu);
 }
 
@@ -3121,6 +3462,7 @@ static void kvm_sched_out(struct preempt_notifier *pn,
 	if (current->state == TASK_RUNNING)
 		vcpu->preempted = true;
 	kvm_arch_vcpu_put(vcpu);
+	__this_cpu_write(kvm_running_vcpu, NULL);
 }
 
 int kvm_init(void *opaque, unsigned vcpu_size, unsigned vcpu_align,